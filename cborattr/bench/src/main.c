@@ -0,0 +1,569 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * cborattr microbenchmarks.
+ *
+ * Each payload is encoded with cbor_write_object() and decoded with
+ * cbor_read_flat_attrs() (cbor_read_object() over a flat buffer) the
+ * configured number of times.  Every benchmark runs in a freshly initialized
+ * task so that the task's stack high-water mark reflects that benchmark
+ * alone.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include "os/mynewt.h"
+#if MYNEWT_VAL(BSP_SIMULATED)
+#include <time.h>
+#endif
+
+#include "console/console.h"
+#include "tinycbor/cbor.h"
+#include "tinycbor/cbor_buf_writer.h"
+#include "cborattr/cborattr.h"
+
+#define BENCH_ITERATIONS    MYNEWT_VAL(CBORATTR_BENCH_ITERATIONS)
+#define BENCH_STACK_SIZE    MYNEWT_VAL(CBORATTR_BENCH_STACK_SIZE)
+
+#define BENCH_CHUNK_LEN     512
+#define BENCH_SHA_LEN       32
+#define BENCH_ARGC          8
+#define BENCH_OBJ_CNT       8
+#define BENCH_INT_CNT       100
+
+/** A benchmarked payload: what to encode, and how to decode it. */
+struct bench_payload {
+    const char *name;
+
+    /* Terminated with an entry whose attribute is NULL. */
+    const struct cbor_out_attr_t *out_attrs;
+    const struct cbor_attr_t *in_attrs;
+
+    /* Whether an earlier payload already encodes the same attributes. */
+    bool decode_only;
+
+    /* The encoding of out_attrs. */
+    uint8_t buf[1024];
+    int len;
+};
+
+typedef int bench_op_fn(struct bench_payload *payload);
+
+/*
+ * Upload chunk: img_mgmt's upload request carrying 512 bytes of data.
+ */
+
+static uint8_t bench_chunk_data[BENCH_CHUNK_LEN];
+static uint8_t bench_chunk_sha[BENCH_SHA_LEN];
+
+static uint8_t bench_chunk_in_data[BENCH_CHUNK_LEN];
+static size_t bench_chunk_in_data_len;
+static uint8_t bench_chunk_in_sha[BENCH_SHA_LEN];
+static size_t bench_chunk_in_sha_len;
+static struct cbor_bytestring_ref bench_chunk_in_ref;
+static long long unsigned int bench_chunk_in_image;
+static long long unsigned int bench_chunk_in_len;
+static long long unsigned int bench_chunk_in_off;
+
+static const struct cbor_out_attr_t bench_chunk_out[] = {
+    {
+        .attribute = "image",
+        .val = { .type = CborAttrUnsignedIntegerType, .uinteger = 0 },
+    },
+    {
+        .attribute = "data",
+        .val = {
+            .type = CborAttrByteStringType,
+            .bytestring.data = bench_chunk_data,
+            .bytestring.len = sizeof bench_chunk_data,
+        },
+    },
+    {
+        .attribute = "len",
+        .val = { .type = CborAttrUnsignedIntegerType, .uinteger = 262144 },
+    },
+    {
+        .attribute = "off",
+        .val = { .type = CborAttrUnsignedIntegerType, .uinteger = 0 },
+    },
+    {
+        .attribute = "sha",
+        .val = {
+            .type = CborAttrByteStringType,
+            .bytestring.data = bench_chunk_sha,
+            .bytestring.len = sizeof bench_chunk_sha,
+        },
+    },
+    { 0 },
+};
+
+static const struct cbor_attr_t bench_chunk_in[] = {
+    {
+        .attribute = "image",
+        .type = CborAttrUnsignedIntegerType,
+        .addr.uinteger = &bench_chunk_in_image,
+        .nodefault = true,
+    },
+    {
+        .attribute = "data",
+        .type = CborAttrByteStringType,
+        .addr.bytestring.data = bench_chunk_in_data,
+        .addr.bytestring.len = &bench_chunk_in_data_len,
+        .len = sizeof bench_chunk_in_data,
+    },
+    {
+        .attribute = "len",
+        .type = CborAttrUnsignedIntegerType,
+        .addr.uinteger = &bench_chunk_in_len,
+        .nodefault = true,
+    },
+    {
+        .attribute = "off",
+        .type = CborAttrUnsignedIntegerType,
+        .addr.uinteger = &bench_chunk_in_off,
+        .nodefault = true,
+    },
+    {
+        .attribute = "sha",
+        .type = CborAttrByteStringType,
+        .addr.bytestring.data = bench_chunk_in_sha,
+        .addr.bytestring.len = &bench_chunk_in_sha_len,
+        .len = sizeof bench_chunk_in_sha,
+    },
+    { 0 },
+};
+
+/* As above, but referring to the data in place rather than copying it. */
+static const struct cbor_attr_t bench_chunk_ref_in[] = {
+    {
+        .attribute = "image",
+        .type = CborAttrUnsignedIntegerType,
+        .addr.uinteger = &bench_chunk_in_image,
+        .nodefault = true,
+    },
+    {
+        .attribute = "data",
+        .type = CborAttrByteStringRefType,
+        .addr.bytestring_ref = &bench_chunk_in_ref,
+        .len = sizeof bench_chunk_in_data,
+    },
+    {
+        .attribute = "len",
+        .type = CborAttrUnsignedIntegerType,
+        .addr.uinteger = &bench_chunk_in_len,
+        .nodefault = true,
+    },
+    {
+        .attribute = "off",
+        .type = CborAttrUnsignedIntegerType,
+        .addr.uinteger = &bench_chunk_in_off,
+        .nodefault = true,
+    },
+    {
+        .attribute = "sha",
+        .type = CborAttrByteStringType,
+        .addr.bytestring.data = bench_chunk_in_sha,
+        .addr.bytestring.len = &bench_chunk_in_sha_len,
+        .len = sizeof bench_chunk_in_sha,
+    },
+    { 0 },
+};
+
+/*
+ * shell_mgmt argv array.
+ */
+
+static struct cbor_out_val_t bench_argv_vals[BENCH_ARGC] = {
+    { .type = CborAttrTextStringType, .string = "log" },
+    { .type = CborAttrTextStringType, .string = "show" },
+    { .type = CborAttrTextStringType, .string = "reboot_log" },
+    { .type = CborAttrTextStringType, .string = "-n" },
+    { .type = CborAttrTextStringType, .string = "20" },
+    { .type = CborAttrTextStringType, .string = "--index" },
+    { .type = CborAttrTextStringType, .string = "1024" },
+    { .type = CborAttrTextStringType, .string = "--verbose" },
+};
+
+static char *bench_argv_in[BENCH_ARGC];
+static char bench_argv_in_store[128];
+static int bench_argv_in_cnt;
+
+static const struct cbor_out_attr_t bench_argv_out[] = {
+    {
+        .attribute = "argv",
+        .val = {
+            .type = CborAttrArrayType,
+            .array = { .elems = bench_argv_vals, .len = BENCH_ARGC },
+        },
+    },
+    { 0 },
+};
+
+static const struct cbor_attr_t bench_argv_in_attrs[] = {
+    {
+        .attribute = "argv",
+        .type = CborAttrArrayType,
+        .addr.array = {
+            .element_type = CborAttrTextStringType,
+            .arr.strings.ptrs = bench_argv_in,
+            .arr.strings.store = bench_argv_in_store,
+            .arr.strings.storelen = sizeof bench_argv_in_store,
+            .count = &bench_argv_in_cnt,
+            .maxlen = BENCH_ARGC,
+        },
+        .nodefault = true,
+    },
+    { 0 },
+};
+
+/*
+ * Array of objects: a: [ { n:"...", v:... }, ... ]
+ */
+
+struct bench_obj {
+    char n[16];
+    long long int v;
+};
+
+static struct cbor_out_attr_t bench_obj_attrs[BENCH_OBJ_CNT][3];
+static struct cbor_out_val_t bench_obj_vals[BENCH_OBJ_CNT];
+
+static struct bench_obj bench_obj_in[BENCH_OBJ_CNT];
+static int bench_obj_in_cnt;
+
+static const struct cbor_out_attr_t bench_obj_out[] = {
+    {
+        .attribute = "a",
+        .val = {
+            .type = CborAttrArrayType,
+            .array = { .elems = bench_obj_vals, .len = BENCH_OBJ_CNT },
+        },
+    },
+    { 0 },
+};
+
+static const struct cbor_attr_t bench_obj_in_sub[] = {
+    {
+        .attribute = "n",
+        .type = CborAttrTextStringType,
+        CBORATTR_STRUCT_OBJECT(struct bench_obj, n),
+        .len = sizeof bench_obj_in[0].n,
+    },
+    {
+        .attribute = "v",
+        .type = CborAttrIntegerType,
+        CBORATTR_STRUCT_OBJECT(struct bench_obj, v),
+    },
+    { 0 },
+};
+
+static const struct cbor_attr_t bench_obj_in_attrs[] = {
+    {
+        .attribute = "a",
+        .type = CborAttrArrayType,
+        CBORATTR_STRUCT_ARRAY(bench_obj_in, bench_obj_in_sub,
+                              &bench_obj_in_cnt),
+        .nodefault = true,
+    },
+    { 0 },
+};
+
+/*
+ * 100-element integer array.
+ */
+
+static struct cbor_out_val_t bench_int_vals[BENCH_INT_CNT];
+static long long int bench_int_in[BENCH_INT_CNT];
+static int bench_int_in_cnt;
+
+static const struct cbor_out_attr_t bench_int_out[] = {
+    {
+        .attribute = "a",
+        .val = {
+            .type = CborAttrArrayType,
+            .array = { .elems = bench_int_vals, .len = BENCH_INT_CNT },
+        },
+    },
+    { 0 },
+};
+
+static const struct cbor_attr_t bench_int_in_attrs[] = {
+    {
+        .attribute = "a",
+        .type = CborAttrArrayType,
+        .addr.array = {
+            .element_type = CborAttrIntegerType,
+            .arr.integers.store = bench_int_in,
+            .count = &bench_int_in_cnt,
+            .maxlen = BENCH_INT_CNT,
+        },
+        .nodefault = true,
+    },
+    { 0 },
+};
+
+static struct bench_payload bench_payloads[] = {
+    {
+        .name = "upload chunk",
+        .out_attrs = bench_chunk_out,
+        .in_attrs = bench_chunk_in,
+    },
+    {
+        .name = "upload chunk (ref)",
+        .out_attrs = bench_chunk_out,
+        .in_attrs = bench_chunk_ref_in,
+        .decode_only = true,
+    },
+    {
+        .name = "shell argv",
+        .out_attrs = bench_argv_out,
+        .in_attrs = bench_argv_in_attrs,
+    },
+    {
+        .name = "object array",
+        .out_attrs = bench_obj_out,
+        .in_attrs = bench_obj_in_attrs,
+    },
+    {
+        .name = "int array",
+        .out_attrs = bench_int_out,
+        .in_attrs = bench_int_in_attrs,
+    },
+};
+
+#define BENCH_PAYLOAD_CNT   (sizeof bench_payloads / sizeof bench_payloads[0])
+
+/*
+ * Benchmark runner.
+ */
+
+static struct os_task bench_task;
+static os_stack_t bench_stack[BENCH_STACK_SIZE];
+static struct os_sem bench_done_sem;
+
+static struct bench_payload *bench_cur_payload;
+static bench_op_fn *bench_cur_op;
+static uint64_t bench_cur_ns;
+static int bench_cur_rc;
+
+/*
+ * The simulator's cputime follows simulated time rather than the host's, so
+ * time the host directly there.
+ */
+#if MYNEWT_VAL(BSP_SIMULATED)
+typedef uint64_t bench_time_t;
+
+static bench_time_t
+bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t
+bench_elapsed_ns(bench_time_t start)
+{
+    return bench_now() - start;
+}
+#else
+typedef uint32_t bench_time_t;
+
+static bench_time_t
+bench_now(void)
+{
+    return os_cputime_get32();
+}
+
+static uint64_t
+bench_elapsed_ns(bench_time_t start)
+{
+    return (uint64_t)os_cputime_ticks_to_usecs(bench_now() - start) * 1000;
+}
+#endif
+
+static int
+bench_encode_into(struct bench_payload *payload, uint8_t *buf, size_t size)
+{
+    struct cbor_buf_writer writer;
+    struct CborEncoder encoder;
+    int rc;
+
+    cbor_buf_writer_init(&writer, buf, size);
+    cbor_encoder_init(&encoder, &writer.enc, 0);
+
+    rc = cbor_write_object(&encoder, payload->out_attrs);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return cbor_buf_writer_buffer_size(&writer, buf);
+}
+
+static int
+bench_encode(struct bench_payload *payload)
+{
+    static uint8_t buf[sizeof payload->buf];
+    int rc;
+
+    rc = bench_encode_into(payload, buf, sizeof buf);
+    return rc < 0 ? rc : 0;
+}
+
+static int
+bench_decode(struct bench_payload *payload)
+{
+    return cbor_read_flat_attrs(payload->buf, payload->len,
+                                payload->in_attrs);
+}
+
+static void
+bench_task_handler(void *arg)
+{
+    bench_time_t start;
+    int rc;
+    int i;
+
+    rc = 0;
+    start = bench_now();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        rc = bench_cur_op(bench_cur_payload);
+        if (rc != 0) {
+            break;
+        }
+    }
+    bench_cur_ns = bench_elapsed_ns(start);
+    bench_cur_rc = rc;
+
+    os_sem_release(&bench_done_sem);
+
+    /* Wait to be removed. */
+    while (1) {
+        os_time_delay(OS_TICKS_PER_SEC);
+    }
+}
+
+/**
+ * Runs one operation over one payload in a new task and reports the time per
+ * operation and the task's stack high-water mark.
+ */
+static void
+bench_run(struct bench_payload *payload, bench_op_fn *op, const char *op_name)
+{
+    struct os_task_info oti;
+    int rc;
+
+    bench_cur_payload = payload;
+    bench_cur_op = op;
+
+    rc = os_task_init(&bench_task, "cborattr_bench", bench_task_handler, NULL,
+                      MYNEWT_VAL(CBORATTR_BENCH_PRIO), OS_WAIT_FOREVER,
+                      bench_stack, BENCH_STACK_SIZE);
+    assert(rc == 0);
+
+    os_sem_pend(&bench_done_sem, OS_TIMEOUT_NEVER);
+
+    rc = os_task_info_get(&bench_task, &oti);
+    assert(rc == 0);
+    os_task_remove(&bench_task);
+
+    if (bench_cur_rc != 0) {
+        console_printf("%-20s %-7s failed (rc %d)\n",
+                       payload->name, op_name, bench_cur_rc);
+        return;
+    }
+
+    console_printf("%-20s %-7s %8lu ns/op %6u B stack\n",
+                   payload->name, op_name,
+                   (unsigned long)(bench_cur_ns / BENCH_ITERATIONS),
+                   (unsigned int)(oti.oti_stkusage * sizeof(os_stack_t)));
+}
+
+static void
+bench_payloads_init(void)
+{
+    struct bench_payload *payload;
+    int rc;
+    int i;
+
+    for (i = 0; i < BENCH_CHUNK_LEN; i++) {
+        bench_chunk_data[i] = i;
+    }
+    for (i = 0; i < BENCH_SHA_LEN; i++) {
+        bench_chunk_sha[i] = 0xa0 + i;
+    }
+
+    for (i = 0; i < BENCH_OBJ_CNT; i++) {
+        bench_obj_attrs[i][0] = (struct cbor_out_attr_t) {
+            .attribute = "n",
+            .val = { .type = CborAttrTextStringType, .string = "sensor" },
+        };
+        bench_obj_attrs[i][1] = (struct cbor_out_attr_t) {
+            .attribute = "v",
+            .val = { .type = CborAttrIntegerType, .integer = -1000 * i },
+        };
+        bench_obj_vals[i] = (struct cbor_out_val_t) {
+            .type = CborAttrObjectType,
+            .obj = bench_obj_attrs[i],
+        };
+    }
+
+    for (i = 0; i < BENCH_INT_CNT; i++) {
+        bench_int_vals[i] = (struct cbor_out_val_t) {
+            .type = CborAttrIntegerType,
+            .integer = i * 1000,
+        };
+    }
+
+    for (i = 0; i < BENCH_PAYLOAD_CNT; i++) {
+        payload = &bench_payloads[i];
+        rc = bench_encode_into(payload, payload->buf, sizeof payload->buf);
+        assert(rc > 0);
+        payload->len = rc;
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int i;
+
+    sysinit();
+
+    os_sem_init(&bench_done_sem, 0);
+    bench_payloads_init();
+
+    console_printf("cborattr benchmarks, %d iterations each\n",
+                   BENCH_ITERATIONS);
+
+    for (i = 0; i < BENCH_PAYLOAD_CNT; i++) {
+        if (!bench_payloads[i].decode_only) {
+            bench_run(&bench_payloads[i], bench_encode, "encode");
+        }
+        bench_run(&bench_payloads[i], bench_decode, "decode");
+    }
+
+    while (1) {
+        os_eventq_run(os_eventq_dflt_get());
+    }
+
+    return 0;
+}
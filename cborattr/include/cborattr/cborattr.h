@@ -22,6 +22,7 @@
 #define CBORATTR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <ctype.h>
 #include <stdio.h>
@@ -55,10 +56,69 @@ typedef enum CborAttrType {
     CborAttrObjectType,
     CborAttrStructObjectType,
     CborAttrNullType,
+    CborAttrByteStringRefType,
+
+    /* Packed array element types; see cbor_read_array(). */
+    CborAttrUint16Type,
+    CborAttrUint32Type,
+    CborAttrFloat32Type,
 } CborAttrType;
 
+/*
+ * RFC 8746 typed array tags understood by cbor_read_array() and emitted by
+ * cbor_encode_typed_array().  Each tags a byte string holding the packed
+ * elements.
+ */
+#define CBORATTR_TAG_UINT16_BE      65
+#define CBORATTR_TAG_UINT32_BE      66
+#define CBORATTR_TAG_UINT16_LE      69
+#define CBORATTR_TAG_UINT32_LE      70
+#define CBORATTR_TAG_FLOAT32_BE     81
+#define CBORATTR_TAG_FLOAT32_LE     85
+
 struct cbor_attr_t;
 
+/**
+ * The result of decoding a CborAttrByteStringRefType attribute.  Rather than
+ * copying the byte string, the decoder records where the data lives in the
+ * source buffer.  The reference is only valid while that buffer is.
+ *
+ * Both definite and indefinite-length (chunked) byte strings can be
+ * referenced.  A chunked byte string never has a contiguous view; its data is
+ * read with cbor_bytestring_ref_copy() or cbor_bytestring_ref_foreach().
+ */
+struct cbor_bytestring_ref {
+    /** Contiguous view of the data; NULL if the data is fragmented. */
+    const uint8_t *data;
+    /** Total length of the byte string, in bytes. */
+    size_t len;
+
+    /* Private; used by cbor_bytestring_ref_copy(). */
+    struct cbor_decoder_reader *reader;
+    int offset;
+    bool chunked;
+};
+
+/**
+ * @brief Consumes a piece of a referenced byte string.
+ *
+ * @param data                  The piece's data.
+ * @param off                   Offset of the piece within the byte string.
+ * @param len                   Length of the piece, in bytes.
+ * @param arg                   Optional argument.
+ *
+ * @return                      0 to continue; nonzero to stop.
+ */
+typedef int cbor_bytestring_chunk_fn(const uint8_t *data, size_t off,
+                                     size_t len, void *arg);
+
+/**
+ * @brief Returns a pointer to `len` contiguous bytes at the specified offset
+ * of a decoder reader, or NULL if the reader cannot provide one.
+ */
+typedef const uint8_t *cbor_attr_span_fn(struct cbor_decoder_reader *d,
+                                         int offset, size_t len);
+
 struct cbor_enum_t {
     char *name;
     long long int value;
@@ -92,6 +152,15 @@ struct cbor_array_t {
         struct {
             bool *store;
         } booleans;
+        struct {
+            uint16_t *store;
+        } uint16s;
+        struct {
+            uint32_t *store;
+        } uint32s;
+        struct {
+            float *store;
+        } float32s;
     } arr;
     int *count;
     int maxlen;
@@ -112,6 +181,7 @@ struct cbor_attr_t {
             uint8_t *data;
             size_t *len;
         } bytestring;
+        struct cbor_bytestring_ref *bytestring_ref;
         struct cbor_array_t array;
         size_t offset;
         struct cbor_attr_t *obj;
@@ -187,11 +257,186 @@ struct cbor_out_attr_t {
 
 #define CBORATTR_ATTR_UNNAMED (char *)(-1)
 
+/**
+ * One field of a struct to be encoded as a key-value pair by
+ * cbor_write_struct().  Declare with CBORATTR_ENC_FIELD().
+ *
+ * Supported types:
+ *     CborAttrIntegerType          - signed integer of 1, 2, 4 or 8 bytes.
+ *     CborAttrUnsignedIntegerType  - unsigned integer of 1, 2, 4 or 8 bytes.
+ *     CborAttrBooleanType          - bool.
+ *     CborAttrTextStringType       - NUL-terminated char array.
+ */
+struct cbor_enc_attr_t {
+    const char *key;
+    uint8_t key_len;
+    uint8_t size;
+    uint16_t offset;
+    CborAttrType type;
+};
+
+/*
+ * Declares the encoding of field f of struct type s under the string literal
+ * key k.  The key length is taken at compile time.
+ */
+#define CBORATTR_ENC_FIELD(k, t, s, f) {                                \
+    .key = (k),                                                         \
+    .key_len = sizeof (k) - 1,                                          \
+    .size = sizeof (((s *)0)->f),                                       \
+    .offset = offsetof(s, f),                                           \
+    .type = (t),                                                        \
+}
+
+/**
+ * @brief Encodes fields of a struct as key-value pairs of an open map, as
+ * described by a table.
+ *
+ * @param enc                   The map encoder to write to.
+ * @param attrs                 The fields to encode.
+ * @param count                 The number of entries in attrs.
+ * @param base                  The struct to read the fields from.
+ *
+ * @return                      0 on success; CborError on failure.
+ */
+int cbor_write_struct(struct CborEncoder *enc,
+                      const struct cbor_enc_attr_t *attrs, int count,
+                      const void *base);
+
 int cbor_read_object(struct CborValue *, const struct cbor_attr_t *);
+
+/* Largest attribute list an index can describe; longer lists are decoded
+ * with a linear search.
+ */
+#define CBORATTR_INDEX_MAX      32
+#define CBORATTR_INDEX_BUCKETS  16
+#define CBORATTR_INDEX_LINEAR   0xff
+
+/**
+ * Precomputed lookup tables for an attribute list: the length of each key
+ * and a hash of the keys.  An index depends only on the names and order of
+ * the attributes, not on their target addresses, so one static index can
+ * serve an attribute list that is rebuilt on the stack for every request.
+ * It is filled in the first time it is used.
+ */
+struct cbor_attr_index {
+    /* Number of attributes; 0 until compiled, CBORATTR_INDEX_LINEAR if the
+     * list is too long.
+     */
+    uint8_t count;
+    /* 1-based index of the CBORATTR_ATTR_UNNAMED attribute; 0 if none. */
+    uint8_t unnamed;
+    uint8_t key_len[CBORATTR_INDEX_MAX];
+    /* 1-based hash chains; 0 terminates. */
+    uint8_t heads[CBORATTR_INDEX_BUCKETS];
+    uint8_t next[CBORATTR_INDEX_MAX];
+};
+
+/* Defines an attribute index, to be passed to cbor_read_object_indexed(). */
+#define CBORATTR_INDEX_DEFINE(name_)    static struct cbor_attr_index name_
+
+/**
+ * @brief Decodes a map like cbor_read_object(), but looks keys up through a
+ * precomputed index, and only fills in defaults of the attributes missing
+ * from the map.  Nested objects and arrays are decoded without an index.
+ *
+ * @param value                 The map to decode.
+ * @param attrs                 The attributes to look for; must always have
+ *                                  the same names in the same order for a
+ *                                  given index.
+ * @param index                 The index of attrs.
+ *
+ * @return                      0 on success; CborError on failure.
+ */
+int cbor_read_object_indexed(struct CborValue *value,
+                             const struct cbor_attr_t *attrs,
+                             struct cbor_attr_index *index);
+
+/**
+ * @brief Decodes an array into the store of an array descriptor.
+ *
+ * Arrays of the packed element types (CborAttrUint16Type,
+ * CborAttrUint32Type, CborAttrFloat32Type) are stored as native uint16_t,
+ * uint32_t, or float.  They may be encoded either as plain CBOR arrays, or
+ * as RFC 8746 typed arrays of matching element type in either byte order.
+ * A typed array is copied into the store in one pass and byte-swapped in
+ * place if its byte order is not the host's, without decoding each element.
+ *
+ * @param value                 The array to decode.
+ * @param arr                   Where to store the elements.
+ *
+ * @return                      0 on success; CborErrorDataTooLarge if the
+ *                                  array holds more than arr->maxlen
+ *                                  elements, the first maxlen of which are
+ *                                  stored; other CborError on failure.
+ */
 int cbor_read_array(struct CborValue *, const struct cbor_array_t *);
 
+/**
+ * @brief Encodes an array of a packed element type as an RFC 8746 typed
+ * array: a tagged byte string holding the elements in host byte order.  The
+ * elements are written straight from `vals`, without per-element encoding.
+ *
+ * @param enc                   The encoder to write to.
+ * @param type                  CborAttrUint16Type, CborAttrUint32Type, or
+ *                                  CborAttrFloat32Type.
+ * @param vals                  The elements.
+ * @param count                 The number of elements.
+ *
+ * @return                      0 on success; CborError on failure.
+ */
+int cbor_encode_typed_array(struct CborEncoder *enc, CborAttrType type,
+                            const void *vals, size_t count);
+
 int cbor_read_flat_attrs(const uint8_t *data, int len,
                          const struct cbor_attr_t *attrs);
+
+/**
+ * @brief Copies part of a referenced byte string into a caller buffer.  This
+ * works whether or not the data is contiguous, so it can be used to walk a
+ * fragmented byte string a chunk at a time.
+ *
+ * @param ref                   The byte string reference to read from.
+ * @param off                   Offset within the byte string to start at.
+ * @param dst                   Destination buffer.
+ * @param len                   Number of bytes to copy.
+ *
+ * @return                      0 on success; CborError on failure.
+ */
+int cbor_bytestring_ref_copy(const struct cbor_bytestring_ref *ref,
+                             size_t off, void *dst, size_t len);
+
+/**
+ * @brief Passes a referenced byte string to a callback in pieces of at most
+ * `buf_len` bytes, in order.  Pieces that are contiguous in the source buffer
+ * are passed in place; others are first copied into `buf`.  Pieces do not
+ * span the chunks of a chunked byte string, so a piece may be shorter than
+ * `buf_len` even when more data follows.
+ *
+ * This lets a handler consume a byte string of any size with a fixed amount
+ * of RAM.
+ *
+ * @param ref                   The byte string reference to read from.
+ * @param buf                   Staging buffer for non-contiguous pieces.
+ * @param buf_len               Size of `buf`; the maximum piece length.
+ * @param cb                    The callback to pass each piece to.
+ * @param arg                   Optional argument to pass to the callback.
+ *
+ * @return                      0 on success; the callback's return code if
+ *                                  it stopped the walk.
+ */
+int cbor_bytestring_ref_foreach(const struct cbor_bytestring_ref *ref,
+                                void *buf, size_t buf_len,
+                                cbor_bytestring_chunk_fn *cb, void *arg);
+
+/**
+ * @brief Configures a function that maps reader offsets to contiguous memory.
+ * Byte string references decoded from readers other than a flat buffer
+ * reader are only given a `data` pointer if this function returns one.
+ * The function must return NULL for any reader it does not recognize.
+ *
+ * @param fn                    The span function; NULL to clear.
+ */
+void cbor_attr_set_span_fn(cbor_attr_span_fn *fn);
 #ifdef MYNEWT
 int cbor_read_mbuf_attrs(struct os_mbuf *m, uint16_t off, uint16_t len,
                          const struct cbor_attr_t *attrs);
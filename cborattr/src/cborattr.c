@@ -17,6 +17,9 @@
  * under the License.
  */
 
+#include <limits.h>
+#include <string.h>
+
 #include "cborattr/cborattr.h"
 #include "tinycbor/cbor.h"
 #include "tinycbor/cbor_buf_reader.h"
@@ -38,6 +41,14 @@
 #define CBORATTR_MAX_SIZE MYNEWT_VAL(CBORATTR_MAX_SIZE)
 #endif
 
+static cbor_attr_span_fn *cbor_attr_span_cb;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define CBORATTR_HOST_BE    1
+#else
+#define CBORATTR_HOST_BE    0
+#endif
+
 /* this maps a CborType to a matching CborAtter Type. The mapping is not
  * one-to-one because of signedness of integers
  * and therefore we need a function to do this trickery */
@@ -52,6 +63,7 @@ valid_attr_type(CborType ct, CborAttrType at)
         }
         break;
     case CborAttrByteStringType:
+    case CborAttrByteStringRefType:
         if (ct == CborByteStringType) {
             return 1;
         }
@@ -84,7 +96,8 @@ valid_attr_type(CborType ct, CborAttrType at)
         break;
 #endif
     case CborAttrArrayType:
-        if (ct == CborArrayType) {
+        /* a tag may introduce a typed array */
+        if (ct == CborArrayType || ct == CborTagType) {
             return 1;
         }
         break;
@@ -138,6 +151,9 @@ cbor_target_address(const struct cbor_attr_t *cursor,
         case CborAttrByteStringType:
             targetaddr = (char *) cursor->addr.bytestring.data;
             break;
+        case CborAttrByteStringRefType:
+            targetaddr = (char *) cursor->addr.bytestring_ref;
+            break;
         case CborAttrTextStringType:
             targetaddr = cursor->addr.string;
             break;
@@ -157,53 +173,323 @@ cbor_target_address(const struct cbor_attr_t *cursor,
     return targetaddr;
 }
 
+/* returns a pointer to contiguous reader data, if one can be determined */
+static const uint8_t *
+cbor_attr_span(struct cbor_decoder_reader *d, int offset, size_t len)
+{
+    struct cbor_buf_reader probe;
+
+    /* Flat buffers are always contiguous.  The buffer reader's handlers are
+     * private to tinycbor, so identify it by comparing against a probe.
+     */
+    cbor_buf_reader_init(&probe, NULL, 0);
+    if (d->get8 == probe.r.get8) {
+        return ((struct cbor_buf_reader *)d)->buffer + offset;
+    }
+
+    if (cbor_attr_span_cb != NULL) {
+        return cbor_attr_span_cb(d, offset, len);
+    }
+
+    return NULL;
+}
+
+/*
+ * reads the header of the chunk at *offset of a chunked byte string and
+ * advances *offset to the chunk's data.  Returns 1 for a chunk, 0 for the
+ * break that ends the string and -1 if the header is malformed or does not
+ * end before `end`.
+ */
+static int
+cbor_bytestring_chunk_hdr(struct cbor_decoder_reader *d, int *offset,
+                          int end, size_t *len)
+{
+    uint64_t val;
+    uint8_t ib;
+    int cnt;
+
+    if (*offset >= end) {
+        return -1;
+    }
+    ib = d->get8(d, (*offset)++);
+    if (ib == 0xff) {
+        return 0;
+    }
+    if ((ib >> 5) != (CborByteStringType >> 5) || (ib & 0x1f) > 27) {
+        return -1;
+    }
+
+    ib &= 0x1f;
+    if (ib < 24) {
+        *len = ib;
+        return 1;
+    }
+
+    cnt = 1 << (ib - 24);
+    if (cnt > end - *offset) {
+        return -1;
+    }
+    val = 0;
+    while (cnt-- > 0) {
+        val = (val << 8) | d->get8(d, (*offset)++);
+    }
+    if (val > (uint64_t)(end - *offset)) {
+        return -1;
+    }
+
+    *len = val;
+    return 1;
+}
+
+static CborError
+cbor_read_bytestring_ref(const CborValue *value,
+                         struct cbor_bytestring_ref *ref, size_t maxlen)
+{
+    CborValue next;
+    CborError err;
+    size_t chunk_len;
+    size_t len;
+    int offset;
+    int rc;
+
+    /* The data ends where the next item begins. */
+    next = *value;
+    err = cbor_value_advance(&next);
+    if (err != CborNoError) {
+        return err;
+    }
+
+    ref->reader = value->parser->d;
+
+    if (!cbor_value_is_length_known(value)) {
+        /* Chunked; total the chunks up so that the whole string can be
+         * addressed by offset, like a definite-length one.
+         */
+        offset = value->offset + 1;
+        len = 0;
+        while ((rc = cbor_bytestring_chunk_hdr(ref->reader, &offset,
+                                               next.offset,
+                                               &chunk_len)) > 0) {
+            offset += (int)chunk_len;
+            len += chunk_len;
+        }
+        if (rc < 0) {
+            return CborErrorIllegalType;
+        }
+        if (maxlen != 0 && len > maxlen) {
+            return CborErrorOutOfMemory;
+        }
+
+        ref->len = len;
+        ref->offset = value->offset + 1;
+        ref->data = NULL;
+        ref->chunked = true;
+
+        return CborNoError;
+    }
+
+    err = cbor_value_get_string_length(value, &len);
+    if (err != CborNoError) {
+        return err;
+    }
+    if (maxlen != 0 && len > maxlen) {
+        return CborErrorOutOfMemory;
+    }
+
+    ref->len = len;
+    ref->offset = next.offset - (int)len;
+    ref->data = cbor_attr_span(ref->reader, ref->offset, len);
+    ref->chunked = false;
+
+    return CborNoError;
+}
+
+/* fills in an attribute's default value, unless it has none */
+static void
+cbor_attr_stuff_default(const struct cbor_attr_t *cursor,
+                        const struct cbor_array_t *parent, int offset)
+{
+    void *lptr;
+
+    if (cursor->nodefault) {
+        return;
+    }
+
+    lptr = cbor_target_address(cursor, parent, offset);
+    if (lptr == NULL) {
+        return;
+    }
+
+    switch (cursor->type) {
+    case CborAttrIntegerType:
+        memcpy(lptr, &cursor->dflt.integer, sizeof(long long int));
+        break;
+    case CborAttrUnsignedIntegerType:
+        memcpy(lptr, &cursor->dflt.integer,
+               sizeof(long long unsigned int));
+        break;
+    case CborAttrBooleanType:
+        memcpy(lptr, &cursor->dflt.boolean, sizeof(bool));
+        break;
+    case CborAttrByteStringRefType:
+        memset(lptr, 0, sizeof(struct cbor_bytestring_ref));
+        break;
+#if FLOAT_SUPPORT
+    case CborAttrHalfFloatType:
+        memcpy(lptr, &cursor->dflt.halffloat, sizeof(uint16_t));
+        break;
+    case CborAttrFloatType:
+        memcpy(lptr, &cursor->dflt.fval, sizeof(float));
+        break;
+    case CborAttrDoubleType:
+        memcpy(lptr, &cursor->dflt.real, sizeof(double));
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+/* hashes a key into a bucket of an attribute index */
+static int
+cbor_attr_index_hash(const char *key, size_t len)
+{
+    if (len == 0) {
+        return 0;
+    }
+
+    return (len * 7 + (uint8_t)key[0] + (uint8_t)key[len - 1]) %
+           CBORATTR_INDEX_BUCKETS;
+}
+
+/* builds the lookup tables of an attribute index from an attribute list */
+static void
+cbor_attr_index_compile(struct cbor_attr_index *index,
+                        const struct cbor_attr_t *attrs)
+{
+    const struct cbor_attr_t *cursor;
+    size_t len;
+    int count;
+    int h;
+    int i;
+
+    count = 0;
+    for (cursor = attrs; cursor->attribute != NULL; cursor++) {
+        count++;
+    }
+    if (count > CBORATTR_INDEX_MAX) {
+        index->count = CBORATTR_INDEX_LINEAR;
+        return;
+    }
+
+    memset(index->heads, 0, sizeof index->heads);
+    index->unnamed = 0;
+
+    /* Chain in reverse so that earlier attributes are found first. */
+    for (i = count - 1; i >= 0; i--) {
+        if (attrs[i].attribute == CBORATTR_ATTR_UNNAMED) {
+            index->unnamed = i + 1;
+            index->next[i] = 0;
+            continue;
+        }
+
+        len = strlen(attrs[i].attribute);
+        index->key_len[i] = len > UINT8_MAX ? UINT8_MAX : len;
+        h = cbor_attr_index_hash(attrs[i].attribute, len);
+        index->next[i] = index->heads[h];
+        index->heads[h] = i + 1;
+    }
+
+    index->count = count;
+}
+
+/* finds the attribute matching a key and value type with an index */
+static const struct cbor_attr_t *
+cbor_attr_index_find(const struct cbor_attr_index *index,
+                     const struct cbor_attr_t *attrs, const char *key,
+                     size_t len, CborType type)
+{
+    const struct cbor_attr_t *cursor;
+    int i;
+
+    for (i = index->heads[cbor_attr_index_hash(key, len)]; i != 0;
+         i = index->next[i - 1]) {
+
+        cursor = &attrs[i - 1];
+        if (index->key_len[i - 1] == len &&
+            !memcmp(cursor->attribute, key, len) &&
+            valid_attr_type(type, cursor->type)) {
+
+            return cursor;
+        }
+    }
+
+    if (len == 0 && index->unnamed != 0 &&
+        valid_attr_type(type, attrs[index->unnamed - 1].type)) {
+
+        return &attrs[index->unnamed - 1];
+    }
+
+    return NULL;
+}
+
+/* finds the attribute matching a key and value type by scanning the list */
+static const struct cbor_attr_t *
+cbor_attr_find(const struct cbor_attr_t *attrs, const char *key, size_t len,
+               CborType type)
+{
+    const struct cbor_attr_t *cursor, *best_match;
+
+    best_match = NULL;
+    for (cursor = attrs; cursor->attribute != NULL; cursor++) {
+        if (valid_attr_type(type, cursor->type)) {
+            if (cursor->attribute == CBORATTR_ATTR_UNNAMED &&
+                len == 0) {
+                best_match = cursor;
+            } else if (strlen(cursor->attribute) == len &&
+                !memcmp(cursor->attribute, key, len)) {
+                return cursor;
+            }
+        }
+    }
+
+    return best_match;
+}
+
 static int
 cbor_internal_read_object(CborValue *root_value,
                           const struct cbor_attr_t *attrs,
                           const struct cbor_array_t *parent,
-                          int offset)
+                          int offset, struct cbor_attr_index *index)
 {
-    const struct cbor_attr_t *cursor, *best_match;
+    const struct cbor_attr_t *cursor;
     char attrbuf[CBORATTR_MAX_SIZE + 1];
+    const char *key;
+    uint32_t seen;
     void *lptr;
     CborValue cur_value;
+    CborValue next_value;
     CborError err = 0;
     size_t len = 0;
     CborType type = CborInvalidType;
+    int i;
 
-    /* stuff fields with defaults in case they're omitted in the JSON input */
-    for (cursor = attrs; cursor->attribute != NULL; cursor++) {
-        if (!cursor->nodefault) {
-            lptr = cbor_target_address(cursor, parent, offset);
-            if (lptr != NULL) {
-                switch (cursor->type) {
-                case CborAttrIntegerType:
-                    memcpy(lptr, &cursor->dflt.integer, sizeof(long long int));
-                    break;
-                case CborAttrUnsignedIntegerType:
-                    memcpy(lptr, &cursor->dflt.integer,
-                           sizeof(long long unsigned int));
-                    break;
-                case CborAttrBooleanType:
-                    memcpy(lptr, &cursor->dflt.boolean, sizeof(bool));
-                    break;
-#if FLOAT_SUPPORT
-                case CborAttrHalfFloatType:
-                    memcpy(lptr, &cursor->dflt.halffloat, sizeof(uint16_t));
-                    break;
-                case CborAttrFloatType:
-                    memcpy(lptr, &cursor->dflt.fval, sizeof(float));
-                    break;
-                case CborAttrDoubleType:
-                    memcpy(lptr, &cursor->dflt.real, sizeof(double));
-                    break;
-#endif
-                default:
-                    break;
-                }
-            }
+    if (index != NULL && index->count == 0) {
+        cbor_attr_index_compile(index, attrs);
+    }
+    if (index != NULL && index->count == CBORATTR_INDEX_LINEAR) {
+        index = NULL;
+    }
+
+    /* stuff fields with defaults in case they're omitted in the JSON input;
+     * with an index, only the omitted ones get stuffed, once parsing is done
+     */
+    if (index == NULL) {
+        for (cursor = attrs; cursor->attribute != NULL; cursor++) {
+            cbor_attr_stuff_default(cursor, parent, offset);
         }
     }
+    seen = 0;
 
     if (cbor_value_is_map(root_value)) {
         err |= cbor_value_enter_container(root_value, &cur_value);
@@ -215,19 +501,39 @@ cbor_internal_read_object(CborValue *root_value,
     /* contains key value pairs */
     while (cbor_value_is_valid(&cur_value) && !err) {
         /* get the attribute */
+        len = 0;
+        key = NULL;
         if (cbor_value_is_text_string(&cur_value)) {
-            if (cbor_value_calculate_string_length(&cur_value, &len) == 0) {
-                if (len > CBORATTR_MAX_SIZE) {
-                    err |= CborErrorDataTooLarge;
-                    break;
+            /* the key ends where its value begins; if the reader holds it
+             * contiguously, it is matched in place */
+            next_value = cur_value;
+            err |= cbor_value_advance(&next_value);
+            if (err) {
+                break;
+            }
+            if (cbor_value_is_length_known(&cur_value) &&
+                cbor_value_get_string_length(&cur_value, &len) == 0) {
+
+                key = (const char *)cbor_attr_span(
+                    root_value->parser->d, next_value.offset - (int)len, len);
+            }
+            if (key == NULL) {
+                /* chunked or fragmented; copy it */
+                key = attrbuf;
+                if (cbor_value_calculate_string_length(&cur_value,
+                                                       &len) == 0) {
+                    if (len > CBORATTR_MAX_SIZE) {
+                        err |= CborErrorDataTooLarge;
+                        break;
+                    }
+                    err |= cbor_value_copy_text_string(&cur_value, attrbuf,
+                                                       &len, NULL);
                 }
-                err |= cbor_value_copy_text_string(&cur_value, attrbuf, &len,
-                                                     NULL);
             }
+            cur_value = next_value;
 
             /* at least get the type of the next value so we can match the
              * attribute name and type for a perfect match */
-            err |= cbor_value_advance(&cur_value);
             if (cbor_value_is_valid(&cur_value)) {
                 type = cbor_value_get_type(&cur_value);
             } else {
@@ -236,27 +542,21 @@ cbor_internal_read_object(CborValue *root_value,
             }
         } else {
             attrbuf[0] = '\0';
+            key = attrbuf;
             type = cbor_value_get_type(&cur_value);
         }
 
         /* find this attribute in our list */
-        best_match = NULL;
-        for (cursor = attrs; cursor->attribute != NULL; cursor++) {
-            if (valid_attr_type(type, cursor->type)) {
-                if (cursor->attribute == CBORATTR_ATTR_UNNAMED &&
-                    attrbuf[0] == '\0') {
-                    best_match = cursor;
-                } else if (strlen(cursor->attribute) == len &&
-                    !memcmp(cursor->attribute, attrbuf, len)) {
-                    break;
-                }
-            }
-        }
-        if (!cursor->attribute && best_match) {
-            cursor = best_match;
+        if (index != NULL) {
+            cursor = cbor_attr_index_find(index, attrs, key, len, type);
+        } else {
+            cursor = cbor_attr_find(attrs, key, len, type);
         }
         /* we found a match */
-        if (cursor->attribute != NULL) {
+        if (cursor != NULL) {
+            if (index != NULL) {
+                seen |= 1u << (cursor - attrs);
+            }
             lptr = cbor_target_address(cursor, parent, offset);
             switch (cursor->type) {
             case CborAttrNullType:
@@ -289,6 +589,15 @@ cbor_internal_read_object(CborValue *root_value,
                 *cursor->addr.bytestring.len = len;
                 break;
             }
+            case CborAttrByteStringRefType:
+                err |= cbor_read_bytestring_ref(&cur_value, lptr, cursor->len);
+                if (err) {
+                    /* Not overwritten by the advance below; a reference
+                     * that was not taken must not read as an empty string.
+                     */
+                    return err;
+                }
+                break;
             case CborAttrTextStringType: {
                 size_t len = cursor->len;
                 err |= cbor_value_copy_text_string(&cur_value, lptr,
@@ -300,7 +609,7 @@ cbor_internal_read_object(CborValue *root_value,
                 continue;
             case CborAttrObjectType:
                 err |= cbor_internal_read_object(&cur_value, cursor->addr.obj,
-                                                 NULL, 0);
+                                                 NULL, 0, NULL);
                 continue;
             default:
                 err |= CborErrorIllegalType;
@@ -312,6 +621,129 @@ cbor_internal_read_object(CborValue *root_value,
         /* that should be it for this container */
         err |= cbor_value_leave_container(root_value, &cur_value);
     }
+
+    if (index != NULL) {
+        for (i = 0; i < index->count; i++) {
+            if (!(seen & (1u << i))) {
+                cbor_attr_stuff_default(&attrs[i], parent, offset);
+            }
+        }
+    }
+
+    return err;
+}
+
+/*
+ * element size, typed array tags, and store of a packed array element type;
+ * returns 0 if the type is not packed
+ */
+static size_t
+cbor_typed_array_info(const struct cbor_array_t *arr, CborTag *tag_le,
+                      CborTag *tag_be, void **store)
+{
+    switch (arr->element_type) {
+    case CborAttrUint16Type:
+        *tag_le = CBORATTR_TAG_UINT16_LE;
+        *tag_be = CBORATTR_TAG_UINT16_BE;
+        *store = arr->arr.uint16s.store;
+        return sizeof (uint16_t);
+    case CborAttrUint32Type:
+        *tag_le = CBORATTR_TAG_UINT32_LE;
+        *tag_be = CBORATTR_TAG_UINT32_BE;
+        *store = arr->arr.uint32s.store;
+        return sizeof (uint32_t);
+    case CborAttrFloat32Type:
+        *tag_le = CBORATTR_TAG_FLOAT32_LE;
+        *tag_be = CBORATTR_TAG_FLOAT32_BE;
+        *store = arr->arr.float32s.store;
+        return sizeof (float);
+    default:
+        return 0;
+    }
+}
+
+static void
+cbor_typed_array_swap(void *store, size_t size, int count)
+{
+    uint16_t *p16;
+    uint32_t *p32;
+    int i;
+
+    if (size == sizeof (uint16_t)) {
+        p16 = store;
+        for (i = 0; i < count; i++) {
+            p16[i] = __builtin_bswap16(p16[i]);
+        }
+    } else {
+        p32 = store;
+        for (i = 0; i < count; i++) {
+            p32[i] = __builtin_bswap32(p32[i]);
+        }
+    }
+}
+
+/* decodes an RFC 8746 typed array and moves the value past it */
+static CborError
+cbor_read_typed_array(struct CborValue *value, const struct cbor_array_t *arr)
+{
+    struct cbor_bytestring_ref ref;
+    CborTag tag_le;
+    CborTag tag_be;
+    CborTag tag;
+    CborError err;
+    size_t size;
+    void *store;
+    bool swap;
+    int count;
+
+    size = cbor_typed_array_info(arr, &tag_le, &tag_be, &store);
+    if (size == 0) {
+        return CborErrorIllegalType;
+    }
+
+    err = cbor_value_get_tag(value, &tag);
+    if (err != CborNoError) {
+        return err;
+    }
+    if (tag == tag_le) {
+        swap = CBORATTR_HOST_BE;
+    } else if (tag == tag_be) {
+        swap = !CBORATTR_HOST_BE;
+    } else {
+        return CborErrorIllegalType;
+    }
+
+    err = cbor_value_skip_tag(value);
+    if (err != CborNoError) {
+        return err;
+    }
+    if (!cbor_value_is_byte_string(value)) {
+        return CborErrorIllegalType;
+    }
+
+    err = cbor_read_bytestring_ref(value, &ref, 0);
+    if (err != CborNoError) {
+        return err;
+    }
+    if (ref.len % size != 0) {
+        return CborErrorIllegalType;
+    }
+
+    count = ref.len / size;
+    if (count > arr->maxlen) {
+        err = CborErrorDataTooLarge;
+        count = arr->maxlen;
+    }
+
+    err |= cbor_bytestring_ref_copy(&ref, 0, store, count * size);
+    if (swap) {
+        cbor_typed_array_swap(store, size, count);
+    }
+    if (arr->count) {
+        *arr->count = count;
+    }
+
+    err |= cbor_value_advance(value);
     return err;
 }
 
@@ -321,10 +753,18 @@ cbor_read_array(struct CborValue *value, const struct cbor_array_t *arr)
     CborError err = 0;
     struct CborValue elem;
     int off, arrcount;
+    uint64_t u64;
+#if FLOAT_SUPPORT
+    double dval;
+#endif
     size_t len;
     void *lptr;
     char *tp;
 
+    if (cbor_value_is_tag(value)) {
+        return cbor_read_typed_array(value, arr);
+    }
+
     err = cbor_value_enter_container(value, &elem);
     if (err) {
         return err;
@@ -355,7 +795,33 @@ cbor_read_array(struct CborValue *value, const struct cbor_array_t *arr)
             lptr = &arr->arr.reals.store[off];
             err |= cbor_value_get_double(&elem, lptr);
             break;
+        case CborAttrFloat32Type:
+            lptr = &arr->arr.float32s.store[off];
+            if (cbor_value_is_float(&elem)) {
+                err |= cbor_value_get_float(&elem, lptr);
+            } else {
+                dval = 0;
+                err |= cbor_value_get_double(&elem, &dval);
+                *(float *)lptr = (float)dval;
+            }
+            break;
 #endif
+        case CborAttrUint16Type:
+            u64 = 0;
+            err |= cbor_value_get_uint64(&elem, &u64);
+            if (u64 > UINT16_MAX) {
+                err |= CborErrorDataTooLarge;
+            }
+            arr->arr.uint16s.store[off] = (uint16_t)u64;
+            break;
+        case CborAttrUint32Type:
+            u64 = 0;
+            err |= cbor_value_get_uint64(&elem, &u64);
+            if (u64 > UINT32_MAX) {
+                err |= CborErrorDataTooLarge;
+            }
+            arr->arr.uint32s.store[off] = (uint32_t)u64;
+            break;
         case CborAttrTextStringType:
             len = arr->arr.strings.storelen - (tp - arr->arr.strings.store);
             err |= cbor_value_copy_text_string(&elem, tp, &len, NULL);
@@ -364,7 +830,7 @@ cbor_read_array(struct CborValue *value, const struct cbor_array_t *arr)
             break;
         case CborAttrStructObjectType:
             err |= cbor_internal_read_object(&elem, arr->arr.objects.subtype,
-                                             arr, off);
+                                             arr, off, NULL);
             break;
         default:
             err |= CborErrorIllegalType;
@@ -394,10 +860,18 @@ cbor_read_object(struct CborValue *value, const struct cbor_attr_t *attrs)
 {
     int st;
 
-    st = cbor_internal_read_object(value, attrs, NULL, 0);
+    st = cbor_internal_read_object(value, attrs, NULL, 0, NULL);
     return st;
 }
 
+int
+cbor_read_object_indexed(struct CborValue *value,
+                         const struct cbor_attr_t *attrs,
+                         struct cbor_attr_index *index)
+{
+    return cbor_internal_read_object(value, attrs, NULL, 0, index);
+}
+
 /*
  * Read in cbor key/values from flat buffer pointed by data, and fill them
  * into attrs.
@@ -425,6 +899,262 @@ cbor_read_flat_attrs(const uint8_t *data, int len,
     return cbor_read_object(&value, attrs);
 }
 
+/* receives a piece of a byte string at reader offset `roff` */
+typedef int cbor_bytestring_seg_fn(const struct cbor_bytestring_ref *ref,
+                                   int roff, size_t off, size_t len,
+                                   void *arg);
+
+/*
+ * walks [off, off + len) of a referenced byte string in pieces of at most
+ * `max_seg` bytes (0 for no limit) that do not span chunks
+ */
+static int
+cbor_bytestring_ref_walk(const struct cbor_bytestring_ref *ref, size_t off,
+                         size_t len, size_t max_seg,
+                         cbor_bytestring_seg_fn *fn, void *arg)
+{
+    size_t chunk_len;
+    size_t chunk_off;
+    size_t n;
+    int roff;
+    int rc;
+
+    if (off > ref->len || len > ref->len - off) {
+        return CborErrorUnexpectedEOF;
+    }
+
+    roff = ref->offset;
+    chunk_off = 0;
+    while (len > 0) {
+        if (!ref->chunked) {
+            chunk_len = ref->len;
+        } else if (cbor_bytestring_chunk_hdr(ref->reader, &roff, INT_MAX,
+                                             &chunk_len) <= 0) {
+            /* Validated when decoded; cannot run out before `len`. */
+            return CborErrorUnexpectedEOF;
+        }
+
+        while (len > 0 && off < chunk_off + chunk_len) {
+            n = chunk_off + chunk_len - off;
+            if (n > len) {
+                n = len;
+            }
+            if (max_seg != 0 && n > max_seg) {
+                n = max_seg;
+            }
+
+            rc = fn(ref, roff + (int)(off - chunk_off), off, n, arg);
+            if (rc != 0) {
+                return rc;
+            }
+            off += n;
+            len -= n;
+        }
+
+        roff += (int)chunk_len;
+        chunk_off += chunk_len;
+    }
+
+    return 0;
+}
+
+struct cbor_bytestring_copy_arg {
+    uint8_t *dst;
+    size_t off;
+};
+
+static int
+cbor_bytestring_copy_seg(const struct cbor_bytestring_ref *ref, int roff,
+                         size_t off, size_t len, void *arg)
+{
+    struct cbor_bytestring_copy_arg *copy = arg;
+
+    ref->reader->cpy(ref->reader, (char *)copy->dst + (off - copy->off),
+                     roff, len);
+    return 0;
+}
+
+int
+cbor_bytestring_ref_copy(const struct cbor_bytestring_ref *ref,
+                         size_t off, void *dst, size_t len)
+{
+    struct cbor_bytestring_copy_arg copy;
+
+    if (off > ref->len || len > ref->len - off) {
+        return CborErrorUnexpectedEOF;
+    }
+
+    if (ref->data != NULL) {
+        memcpy(dst, ref->data + off, len);
+        return CborNoError;
+    }
+
+    copy.dst = dst;
+    copy.off = off;
+    return cbor_bytestring_ref_walk(ref, off, len, 0,
+                                    cbor_bytestring_copy_seg, &copy);
+}
+
+struct cbor_bytestring_foreach_arg {
+    uint8_t *buf;
+    cbor_bytestring_chunk_fn *cb;
+    void *arg;
+};
+
+static int
+cbor_bytestring_foreach_seg(const struct cbor_bytestring_ref *ref, int roff,
+                            size_t off, size_t len, void *arg)
+{
+    struct cbor_bytestring_foreach_arg *fe = arg;
+    const uint8_t *data;
+
+    if (ref->data != NULL) {
+        data = ref->data + off;
+    } else {
+        data = cbor_attr_span(ref->reader, roff, len);
+        if (data == NULL) {
+            ref->reader->cpy(ref->reader, (char *)fe->buf, roff, len);
+            data = fe->buf;
+        }
+    }
+
+    return fe->cb(data, off, len, fe->arg);
+}
+
+int
+cbor_bytestring_ref_foreach(const struct cbor_bytestring_ref *ref,
+                            void *buf, size_t buf_len,
+                            cbor_bytestring_chunk_fn *cb, void *arg)
+{
+    struct cbor_bytestring_foreach_arg fe;
+
+    if (buf_len == 0) {
+        return CborErrorOutOfMemory;
+    }
+
+    fe.buf = buf;
+    fe.cb = cb;
+    fe.arg = arg;
+    return cbor_bytestring_ref_walk(ref, 0, ref->len, buf_len,
+                                    cbor_bytestring_foreach_seg, &fe);
+}
+
+void
+cbor_attr_set_span_fn(cbor_attr_span_fn *fn)
+{
+    cbor_attr_span_cb = fn;
+}
+
+/* reads an integer field of any supported width */
+static uint64_t
+cbor_enc_field_uint(const uint8_t *p, uint8_t size)
+{
+    uint64_t v64;
+    uint32_t v32;
+    uint16_t v16;
+
+    switch (size) {
+    case 1:
+        return *p;
+    case 2:
+        memcpy(&v16, p, sizeof v16);
+        return v16;
+    case 4:
+        memcpy(&v32, p, sizeof v32);
+        return v32;
+    default:
+        memcpy(&v64, p, sizeof v64);
+        return v64;
+    }
+}
+
+static int64_t
+cbor_enc_field_int(const uint8_t *p, uint8_t size)
+{
+    int64_t v64;
+    int32_t v32;
+    int16_t v16;
+
+    switch (size) {
+    case 1:
+        return *(const int8_t *)p;
+    case 2:
+        memcpy(&v16, p, sizeof v16);
+        return v16;
+    case 4:
+        memcpy(&v32, p, sizeof v32);
+        return v32;
+    default:
+        memcpy(&v64, p, sizeof v64);
+        return v64;
+    }
+}
+
+int
+cbor_write_struct(struct CborEncoder *enc,
+                  const struct cbor_enc_attr_t *attrs, int count,
+                  const void *base)
+{
+    const struct cbor_enc_attr_t *attr;
+    const uint8_t *p;
+    CborError err;
+    bool b;
+    int i;
+
+    err = CborNoError;
+    for (i = 0; i < count; i++) {
+        attr = &attrs[i];
+        p = (const uint8_t *)base + attr->offset;
+
+        err |= cbor_encode_text_string(enc, attr->key, attr->key_len);
+        switch (attr->type) {
+        case CborAttrUnsignedIntegerType:
+            err |= cbor_encode_uint(enc, cbor_enc_field_uint(p, attr->size));
+            break;
+        case CborAttrIntegerType:
+            err |= cbor_encode_int(enc, cbor_enc_field_int(p, attr->size));
+            break;
+        case CborAttrBooleanType:
+            memcpy(&b, p, sizeof b);
+            err |= cbor_encode_boolean(enc, b);
+            break;
+        case CborAttrTextStringType:
+            err |= cbor_encode_text_string(enc, (const char *)p,
+                                           strnlen((const char *)p,
+                                                   attr->size));
+            break;
+        default:
+            err |= CborErrorIllegalType;
+            break;
+        }
+    }
+
+    return err;
+}
+
+int
+cbor_encode_typed_array(struct CborEncoder *enc, CborAttrType type,
+                        const void *vals, size_t count)
+{
+    struct cbor_array_t arr = { .element_type = type };
+    CborTag tag_le;
+    CborTag tag_be;
+    CborError err;
+    size_t size;
+    void *store;
+
+    size = cbor_typed_array_info(&arr, &tag_le, &tag_be, &store);
+    if (size == 0) {
+        return CborErrorIllegalType;
+    }
+
+    /* the host's byte order needs no conversion */
+    err = cbor_encode_tag(enc, CBORATTR_HOST_BE ? tag_be : tag_le);
+    err |= cbor_encode_byte_string(enc, vals, count * size);
+
+    return err;
+}
+
 #ifdef MYNEWT
 static int cbor_write_val(struct CborEncoder *enc,
                           const struct cbor_out_val_t *val);
@@ -34,6 +34,12 @@ TEST_SUITE(test_cborattr_suite)
     test_cborattr_decode_object_array();
     test_cborattr_decode_unnamed_array();
     test_cborattr_decode_substring_key();
+    test_cborattr_decode_bytestring_ref();
+    test_cborattr_decode_chunked_bytestring_ref();
+    test_cborattr_decode_indexed();
+    test_cborattr_decode_chunked_key();
+    test_cborattr_decode_typed_array();
+    test_cborattr_encode_struct();
 }
 
 #if MYNEWT_VAL(SELFTEST)
@@ -50,6 +50,12 @@ TEST_CASE_DECL(test_cborattr_decode_string_array);
 TEST_CASE_DECL(test_cborattr_decode_object_array);
 TEST_CASE_DECL(test_cborattr_decode_unnamed_array);
 TEST_CASE_DECL(test_cborattr_decode_substring_key);
+TEST_CASE_DECL(test_cborattr_decode_bytestring_ref);
+TEST_CASE_DECL(test_cborattr_decode_chunked_bytestring_ref);
+TEST_CASE_DECL(test_cborattr_decode_indexed);
+TEST_CASE_DECL(test_cborattr_decode_chunked_key);
+TEST_CASE_DECL(test_cborattr_decode_typed_array);
+TEST_CASE_DECL(test_cborattr_encode_struct);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,138 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "test_cborattr.h"
+
+/*
+ * Where we collect cbor data.
+ */
+static uint8_t test_cbor_buf[1024];
+static int test_cbor_len;
+
+/*
+ * CBOR encoder data structures.
+ */
+static int test_cbor_wr(struct cbor_encoder_writer *, const char *, int);
+static CborEncoder test_encoder;
+static struct cbor_encoder_writer test_writer = {
+    .write = test_cbor_wr
+};
+
+static int
+test_cbor_wr(struct cbor_encoder_writer *cew, const char *data, int len)
+{
+    memcpy(test_cbor_buf + test_cbor_len, data, len);
+    test_cbor_len += len;
+
+    assert(test_cbor_len < sizeof(test_cbor_buf));
+    return 0;
+}
+
+static void
+test_encode_data(void)
+{
+    CborEncoder test_data;
+    uint8_t data[40];
+    int i;
+
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = i;
+    }
+
+    test_cbor_len = 0;
+    cbor_encoder_init(&test_encoder, &test_writer, 0);
+
+    cbor_encoder_create_map(&test_encoder, &test_data, CborIndefiniteLength);
+    /*
+     * a:0x00010203...27
+     */
+    cbor_encode_text_stringz(&test_data, "a");
+    cbor_encode_byte_string(&test_data, data, sizeof(data));
+
+    /*
+     * b:7
+     */
+    cbor_encode_text_stringz(&test_data, "b");
+    cbor_encode_uint(&test_data, 7);
+    cbor_encoder_close_container(&test_encoder, &test_data);
+}
+
+/*
+ * Byte strings decoded by reference.
+ */
+TEST_CASE(test_cborattr_decode_bytestring_ref)
+{
+    struct cbor_bytestring_ref a_ref;
+    uint64_t b_val = 0;
+    uint8_t chunk[8];
+    int rc;
+    int i;
+    struct cbor_attr_t test_attrs[] = {
+        [0] = {
+            .attribute = "a",
+            .type = CborAttrByteStringRefType,
+            .addr.bytestring_ref = &a_ref,
+        },
+        [1] = {
+            .attribute = "b",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &b_val,
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = NULL
+        }
+    };
+
+    test_encode_data();
+
+    rc = cbor_read_flat_attrs(test_cbor_buf, test_cbor_len, test_attrs);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(b_val == 7);
+    TEST_ASSERT(a_ref.len == 40);
+
+    /* Data from a flat buffer is referenced in place. */
+    TEST_ASSERT(a_ref.data > test_cbor_buf);
+    TEST_ASSERT(a_ref.data + a_ref.len < test_cbor_buf + test_cbor_len);
+    for (i = 0; i < a_ref.len; i++) {
+        TEST_ASSERT(a_ref.data[i] == i);
+    }
+
+    rc = cbor_bytestring_ref_copy(&a_ref, 32, chunk, sizeof(chunk));
+    TEST_ASSERT(rc == 0);
+    for (i = 0; i < sizeof(chunk); i++) {
+        TEST_ASSERT(chunk[i] == 32 + i);
+    }
+
+    /* Reads past the end of the byte string are rejected. */
+    rc = cbor_bytestring_ref_copy(&a_ref, 36, chunk, sizeof(chunk));
+    TEST_ASSERT(rc != 0);
+
+    /* An attribute length limits the accepted byte string size. */
+    test_attrs[0].len = 16;
+    rc = cbor_read_flat_attrs(test_cbor_buf, test_cbor_len, test_attrs);
+    TEST_ASSERT(rc != 0);
+
+    /* Omitted attributes decode as an empty reference. */
+    test_attrs[0].attribute = "c";
+    test_attrs[0].len = 0;
+    rc = cbor_read_flat_attrs(test_cbor_buf, test_cbor_len, test_attrs);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(a_ref.data == NULL);
+    TEST_ASSERT(a_ref.len == 0);
+}
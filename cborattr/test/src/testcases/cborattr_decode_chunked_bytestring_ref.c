@@ -0,0 +1,127 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "test_cborattr.h"
+
+/* { "a": (_ h'00..0f', h'10..27'), "b": 7 } */
+static uint8_t test_cbor[] = {
+    0xa2,
+    0x61, 'a', 0x5f,
+    0x50,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0x58, 0x18,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+    0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+    0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+    0xff,
+    0x61, 'b', 0x07,
+};
+
+struct test_pieces {
+    uint8_t data[40];
+    size_t len;
+    int cnt;
+    int stop_at;
+};
+
+static int
+test_piece(const uint8_t *data, size_t off, size_t len, void *arg)
+{
+    struct test_pieces *pieces = arg;
+
+    /* Pieces arrive in order; flat buffer data is passed in place. */
+    TEST_ASSERT(off == pieces->len);
+    TEST_ASSERT(len <= 10);
+    TEST_ASSERT(data > test_cbor && data + len < test_cbor + sizeof test_cbor);
+
+    memcpy(pieces->data + off, data, len);
+    pieces->len += len;
+    pieces->cnt++;
+
+    return pieces->cnt == pieces->stop_at ? 99 : 0;
+}
+
+/*
+ * Chunked byte strings decoded by reference.
+ */
+TEST_CASE(test_cborattr_decode_chunked_bytestring_ref)
+{
+    struct cbor_bytestring_ref a_ref;
+    struct test_pieces pieces;
+    unsigned long long b_val = 0;
+    uint8_t buf[10];
+    uint8_t chunk[8];
+    int rc;
+    int i;
+    struct cbor_attr_t test_attrs[] = {
+        [0] = {
+            .attribute = "a",
+            .type = CborAttrByteStringRefType,
+            .addr.bytestring_ref = &a_ref,
+        },
+        [1] = {
+            .attribute = "b",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &b_val,
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = NULL
+        }
+    };
+
+    rc = cbor_read_flat_attrs(test_cbor, sizeof test_cbor, test_attrs);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(b_val == 7);
+    TEST_ASSERT(a_ref.len == 40);
+    TEST_ASSERT(a_ref.data == NULL);
+
+    /* Copies can span chunks. */
+    rc = cbor_bytestring_ref_copy(&a_ref, 12, chunk, sizeof chunk);
+    TEST_ASSERT(rc == 0);
+    for (i = 0; i < sizeof chunk; i++) {
+        TEST_ASSERT(chunk[i] == 12 + i);
+    }
+    rc = cbor_bytestring_ref_copy(&a_ref, 36, chunk, sizeof chunk);
+    TEST_ASSERT(rc != 0);
+
+    /* Pieces are bounded by the buffer and by chunk boundaries. */
+    memset(&pieces, 0, sizeof pieces);
+    rc = cbor_bytestring_ref_foreach(&a_ref, buf, sizeof buf, test_piece,
+                                     &pieces);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(pieces.len == 40);
+    TEST_ASSERT(pieces.cnt == 5);
+    for (i = 0; i < 40; i++) {
+        TEST_ASSERT(pieces.data[i] == i);
+    }
+
+    /* A nonzero callback return stops the walk. */
+    memset(&pieces, 0, sizeof pieces);
+    pieces.stop_at = 2;
+    rc = cbor_bytestring_ref_foreach(&a_ref, buf, sizeof buf, test_piece,
+                                     &pieces);
+    TEST_ASSERT(rc == 99);
+    TEST_ASSERT(pieces.len == 16);
+
+    /* An attribute length limits the total size of a chunked string. */
+    test_attrs[0].len = 32;
+    rc = cbor_read_flat_attrs(test_cbor, sizeof test_cbor, test_attrs);
+    TEST_ASSERT(rc != 0);
+}
@@ -0,0 +1,63 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "test_cborattr.h"
+
+/*
+ * Keys held contiguously are matched in place; chunked ones get copied.
+ */
+TEST_CASE(test_cborattr_decode_chunked_key)
+{
+    /* { "ab": 1, (_ "a", "b"): 2, "b": 3 } */
+    static const uint8_t test_cbor[] = {
+        0xbf,
+        0x62, 'a', 'b', 0x01,
+        0x7f, 0x61, 'a', 0x61, 'b', 0xff, 0x02,
+        0x61, 'b', 0x03,
+        0xff,
+    };
+    unsigned long long ab_val;
+    unsigned long long b_val;
+    int rc;
+    struct cbor_attr_t test_attrs[] = {
+        [0] = {
+            .attribute = "ab",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &ab_val,
+            .nodefault = true
+        },
+        [1] = {
+            .attribute = "b",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &b_val,
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = NULL
+        }
+    };
+
+    ab_val = 0;
+    b_val = 0;
+    rc = cbor_read_flat_attrs(test_cbor, sizeof test_cbor, test_attrs);
+    TEST_ASSERT(rc == 0);
+
+    /* The chunked key matches too; its value is the last one seen. */
+    TEST_ASSERT(ab_val == 2);
+    TEST_ASSERT(b_val == 3);
+}
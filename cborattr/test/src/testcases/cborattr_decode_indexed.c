@@ -0,0 +1,160 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "test_cborattr.h"
+#include "tinycbor/cbor_buf_reader.h"
+
+/*
+ * Where we collect cbor data.
+ */
+static uint8_t test_cbor_buf[1024];
+static int test_cbor_len;
+
+/*
+ * CBOR encoder data structures.
+ */
+static int test_cbor_wr(struct cbor_encoder_writer *, const char *, int);
+static CborEncoder test_encoder;
+static struct cbor_encoder_writer test_writer = {
+    .write = test_cbor_wr
+};
+
+static int
+test_cbor_wr(struct cbor_encoder_writer *cew, const char *data, int len)
+{
+    memcpy(test_cbor_buf + test_cbor_len, data, len);
+    test_cbor_len += len;
+
+    assert(test_cbor_len < sizeof(test_cbor_buf));
+    return 0;
+}
+
+static void
+test_encode_data(uint64_t off, bool with_len)
+{
+    CborEncoder test_data;
+
+    test_cbor_len = 0;
+    cbor_encoder_init(&test_encoder, &test_writer, 0);
+
+    /*
+     * { "aa": off, "zz": 1, "a": "A", ["len": 3,] "aaa": true }
+     */
+    cbor_encoder_create_map(&test_encoder, &test_data, CborIndefiniteLength);
+    cbor_encode_text_stringz(&test_data, "aa");
+    cbor_encode_uint(&test_data, off);
+    cbor_encode_text_stringz(&test_data, "zz");
+    cbor_encode_uint(&test_data, 1);
+    cbor_encode_text_stringz(&test_data, "a");
+    cbor_encode_text_stringz(&test_data, "A");
+    if (with_len) {
+        cbor_encode_text_stringz(&test_data, "len");
+        cbor_encode_uint(&test_data, 3);
+    }
+    cbor_encode_text_stringz(&test_data, "aaa");
+    cbor_encode_boolean(&test_data, true);
+    cbor_encoder_close_container(&test_encoder, &test_data);
+}
+
+static int
+test_decode_indexed(const struct cbor_attr_t *attrs,
+                    struct cbor_attr_index *index)
+{
+    struct cbor_buf_reader reader;
+    struct CborParser parser;
+    struct CborValue value;
+    CborError err;
+
+    cbor_buf_reader_init(&reader, test_cbor_buf, test_cbor_len);
+    err = cbor_parser_init(&reader.r, 0, &parser, &value);
+    if (err != CborNoError) {
+        return -1;
+    }
+
+    return cbor_read_object_indexed(&value, attrs, index);
+}
+
+/*
+ * Maps decoded through a precomputed attribute index.
+ */
+TEST_CASE(test_cborattr_decode_indexed)
+{
+    struct cbor_attr_index index = { 0 };
+    unsigned long long aa_val;
+    unsigned long long len_val;
+    bool aaa_val;
+    char a_str[4];
+    int rc;
+    struct cbor_attr_t test_attrs[] = {
+        [0] = {
+            .attribute = "a",
+            .type = CborAttrTextStringType,
+            .addr.string = a_str,
+            .len = sizeof(a_str),
+        },
+        [1] = {
+            .attribute = "aa",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &aa_val,
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = "aaa",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &aaa_val,
+        },
+        [3] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &len_val,
+            .dflt.integer = 99,
+        },
+        [4] = {
+            .attribute = NULL
+        }
+    };
+
+    test_encode_data(5, true);
+    aa_val = 0;
+    rc = test_decode_indexed(test_attrs, &index);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(index.count == 4);
+    TEST_ASSERT(!strcmp(a_str, "A"));
+    TEST_ASSERT(aa_val == 5);
+    TEST_ASSERT(aaa_val == true);
+    TEST_ASSERT(len_val == 3);
+
+    /* The index is reused; only the missing attribute gets its default. */
+    test_encode_data(6, false);
+    rc = test_decode_indexed(test_attrs, &index);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(aa_val == 6);
+    TEST_ASSERT(aaa_val == true);
+    TEST_ASSERT(len_val == 99);
+
+    /* A key with the wrong value type is not matched. */
+    aa_val = 0;
+    test_attrs[1].type = CborAttrTextStringType;
+    test_attrs[1].addr.string = a_str;
+    test_attrs[1].len = sizeof(a_str);
+    test_encode_data(7, false);
+    strcpy(a_str, "x");
+    rc = test_decode_indexed(test_attrs, &index);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(!strcmp(a_str, "A"));
+}
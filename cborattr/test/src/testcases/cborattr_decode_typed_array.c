@@ -0,0 +1,141 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include "test_cborattr.h"
+
+/*
+ * Where we collect cbor data.
+ */
+static uint8_t test_cbor_buf[1024];
+static int test_cbor_len;
+
+/*
+ * CBOR encoder data structures.
+ */
+static int test_cbor_wr(struct cbor_encoder_writer *, const char *, int);
+static CborEncoder test_encoder;
+static struct cbor_encoder_writer test_writer = {
+    .write = test_cbor_wr
+};
+
+static int
+test_cbor_wr(struct cbor_encoder_writer *cew, const char *data, int len)
+{
+    memcpy(test_cbor_buf + test_cbor_len, data, len);
+    test_cbor_len += len;
+
+    assert(test_cbor_len < sizeof(test_cbor_buf));
+    return 0;
+}
+
+static void
+test_encode_typed_array(void)
+{
+    static const uint16_t a_vals[] = { 1, 0x1234, 0xffff };
+    static const uint8_t b_be[] = { 0x12, 0x34, 0x56, 0x78, 0, 0, 0, 1 };
+    CborEncoder data;
+
+    cbor_encoder_init(&test_encoder, &test_writer, 0);
+
+    cbor_encoder_create_map(&test_encoder, &data, CborIndefiniteLength);
+
+    /*
+     * a: uint16 typed array in host byte order
+     */
+    cbor_encode_text_stringz(&data, "a");
+    cbor_encode_typed_array(&data, CborAttrUint16Type, a_vals, 3);
+
+    /*
+     * b: 65([0x12345678, 1]) -- uint32 big endian
+     */
+    cbor_encode_text_stringz(&data, "b");
+    cbor_encode_tag(&data, CBORATTR_TAG_UINT32_BE);
+    cbor_encode_byte_string(&data, b_be, sizeof(b_be));
+
+    cbor_encoder_close_container(&test_encoder, &data);
+}
+
+/*
+ * RFC 8746 typed arrays
+ */
+TEST_CASE(test_cborattr_decode_typed_array)
+{
+    int rc;
+    uint16_t a_data[3];
+    uint32_t b_data[2];
+    int a_cnt = 0;
+    int b_cnt = 0;
+    struct cbor_attr_t test_attrs[] = {
+        [0] = {
+            .attribute = "a",
+            .type = CborAttrArrayType,
+            .addr.array.element_type = CborAttrUint16Type,
+            .addr.array.arr.uint16s.store = a_data,
+            .addr.array.count = &a_cnt,
+            .addr.array.maxlen = sizeof(a_data) / sizeof(a_data[0]),
+            .nodefault = true
+        },
+        [1] = {
+            .attribute = "b",
+            .type = CborAttrArrayType,
+            .addr.array.element_type = CborAttrUint32Type,
+            .addr.array.arr.uint32s.store = b_data,
+            .addr.array.count = &b_cnt,
+            .addr.array.maxlen = sizeof(b_data) / sizeof(b_data[0]),
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = NULL
+        }
+    };
+    struct cbor_attr_t test_attrs_small[] = {
+        [0] = {
+            .attribute = "a",
+            .type = CborAttrArrayType,
+            .addr.array.element_type = CborAttrUint16Type,
+            .addr.array.arr.uint16s.store = a_data,
+            .addr.array.count = &a_cnt,
+            .addr.array.maxlen = 2,
+            .nodefault = true
+        },
+        [1] = {
+            .attribute = NULL
+        }
+    };
+
+    test_encode_typed_array();
+
+    rc = cbor_read_flat_attrs(test_cbor_buf, test_cbor_len, test_attrs);
+    TEST_ASSERT(rc == 0);
+    TEST_ASSERT(a_cnt == 3);
+    TEST_ASSERT(a_data[0] == 1);
+    TEST_ASSERT(a_data[1] == 0x1234);
+    TEST_ASSERT(a_data[2] == 0xffff);
+    TEST_ASSERT(b_cnt == 2);
+    TEST_ASSERT(b_data[0] == 0x12345678);
+    TEST_ASSERT(b_data[1] == 1);
+
+    memset(a_data, 0, sizeof(a_data));
+
+    rc = cbor_read_flat_attrs(test_cbor_buf, test_cbor_len, test_attrs_small);
+    TEST_ASSERT(rc == CborErrorDataTooLarge);
+    TEST_ASSERT(a_cnt == 2);
+    TEST_ASSERT(a_data[0] == 1);
+    TEST_ASSERT(a_data[1] == 0x1234);
+    TEST_ASSERT(a_data[2] == 0);
+}
@@ -0,0 +1,162 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+#include <stddef.h>
+#include "test_cborattr.h"
+#include "tinycbor/cbor_buf_reader.h"
+
+/*
+ * Where we collect cbor data.
+ */
+static uint8_t test_cbor_buf[1024];
+static int test_cbor_len;
+
+/*
+ * CBOR encoder data structures.
+ */
+static int test_cbor_wr(struct cbor_encoder_writer *, const char *, int);
+static CborEncoder test_encoder;
+static struct cbor_encoder_writer test_writer = {
+    .write = test_cbor_wr
+};
+
+static int
+test_cbor_wr(struct cbor_encoder_writer *cew, const char *data, int len)
+{
+    memcpy(test_cbor_buf + test_cbor_len, data, len);
+    test_cbor_len += len;
+
+    assert(test_cbor_len < sizeof(test_cbor_buf));
+    return 0;
+}
+
+struct test_struct {
+    uint8_t u8;
+    int16_t i16;
+    uint32_t u32;
+    int64_t i64;
+    bool flag;
+    char name[8];
+};
+
+static const struct cbor_enc_attr_t test_struct_attrs[] = {
+    CBORATTR_ENC_FIELD("u8", CborAttrUnsignedIntegerType,
+                       struct test_struct, u8),
+    CBORATTR_ENC_FIELD("i16", CborAttrIntegerType,
+                       struct test_struct, i16),
+    CBORATTR_ENC_FIELD("u32", CborAttrUnsignedIntegerType,
+                       struct test_struct, u32),
+    CBORATTR_ENC_FIELD("i64", CborAttrIntegerType,
+                       struct test_struct, i64),
+    CBORATTR_ENC_FIELD("flag", CborAttrBooleanType,
+                       struct test_struct, flag),
+    CBORATTR_ENC_FIELD("name", CborAttrTextStringType,
+                       struct test_struct, name),
+};
+
+/*
+ * Struct fields encoded from a descriptor table.
+ */
+TEST_CASE(test_cborattr_encode_struct)
+{
+    struct cbor_buf_reader reader;
+    struct CborParser parser;
+    struct CborValue value;
+    struct test_struct ts = {
+        .u8 = 200,
+        .i16 = -300,
+        .u32 = 70000,
+        .i64 = -5000000000LL,
+        .flag = true,
+        .name = "abcdefgh", /* Fills the array; no terminator. */
+    };
+    CborEncoder map;
+    long long int i16_val;
+    long long int i64_val;
+    unsigned long long u8_val;
+    unsigned long long u32_val;
+    bool flag_val;
+    char name_str[16];
+    int rc;
+    struct cbor_attr_t test_attrs[] = {
+        [0] = {
+            .attribute = "u8",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &u8_val,
+            .nodefault = true
+        },
+        [1] = {
+            .attribute = "i16",
+            .type = CborAttrIntegerType,
+            .addr.integer = &i16_val,
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = "u32",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &u32_val,
+            .nodefault = true
+        },
+        [3] = {
+            .attribute = "i64",
+            .type = CborAttrIntegerType,
+            .addr.integer = &i64_val,
+            .nodefault = true
+        },
+        [4] = {
+            .attribute = "flag",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &flag_val,
+            .nodefault = true
+        },
+        [5] = {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = name_str,
+            .len = sizeof(name_str),
+        },
+        [6] = {
+            .attribute = NULL
+        }
+    };
+
+    test_cbor_len = 0;
+    cbor_encoder_init(&test_encoder, &test_writer, 0);
+    rc = cbor_encoder_create_map(&test_encoder, &map, CborIndefiniteLength);
+    TEST_ASSERT(rc == 0);
+    rc = cbor_write_struct(&map, test_struct_attrs,
+                           sizeof test_struct_attrs /
+                           sizeof test_struct_attrs[0],
+                           &ts);
+    TEST_ASSERT(rc == 0);
+    rc = cbor_encoder_close_container(&test_encoder, &map);
+    TEST_ASSERT(rc == 0);
+
+    cbor_buf_reader_init(&reader, test_cbor_buf, test_cbor_len);
+    rc = cbor_parser_init(&reader.r, 0, &parser, &value);
+    TEST_ASSERT(rc == 0);
+    rc = cbor_read_object(&value, test_attrs);
+    TEST_ASSERT(rc == 0);
+
+    TEST_ASSERT(u8_val == 200);
+    TEST_ASSERT(i16_val == -300);
+    TEST_ASSERT(u32_val == 70000);
+    TEST_ASSERT(i64_val == -5000000000LL);
+    TEST_ASSERT(flag_val == true);
+    TEST_ASSERT(!strcmp(name_str, "abcdefgh"));
+}
@@ -0,0 +1,47 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_CRASH_MGMT_
+#define H_CRASH_MGMT_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Command IDs for crash management group.  ID 0 is left unused; newtmgr
+ * uses it to trigger a test crash.
+ */
+#define CRASH_MGMT_ID_INFO      1
+#define CRASH_MGMT_ID_DUMP      2
+#define CRASH_MGMT_ID_CLEAR     3
+
+#define CRASH_MGMT_SHA256_LEN   32
+
+/**
+ * @brief Registers the crash management command handler group.
+ */
+void
+crash_mgmt_register_group(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H_CRASH_MGMT_ */
@@ -0,0 +1,61 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_CRASH_MGMT_CONFIG_
+#define H_CRASH_MGMT_CONFIG_
+
+#if defined MYNEWT
+
+#include "syscfg/syscfg.h"
+
+#define CRASH_MGMT_DL_CHUNK_SIZE    MYNEWT_VAL(CRASH_MGMT_DL_CHUNK_SIZE)
+#define CRASH_MGMT_DL_WIN_MAX       MYNEWT_VAL(CRASH_MGMT_DL_WIN_MAX)
+#define CRASH_MGMT_HASH_SHA256      MYNEWT_VAL(CRASH_MGMT_HASH_SHA256)
+
+#elif defined __ZEPHYR__
+
+/* Largest piece of the dump sent in one response. */
+#ifdef CONFIG_CRASH_MGMT_DL_CHUNK_SIZE
+#define CRASH_MGMT_DL_CHUNK_SIZE    CONFIG_CRASH_MGMT_DL_CHUNK_SIZE
+#else
+#define CRASH_MGMT_DL_CHUNK_SIZE    (CONFIG_MCUMGR_BUF_SIZE - 48)
+#endif
+
+/* Chunks sent in reply to a single download request. */
+#ifdef CONFIG_CRASH_MGMT_DL_WIN_MAX
+#define CRASH_MGMT_DL_WIN_MAX       CONFIG_CRASH_MGMT_DL_WIN_MAX
+#else
+#define CRASH_MGMT_DL_WIN_MAX       1
+#endif
+
+#ifdef CONFIG_CRASH_MGMT_HASH_SHA256
+#define CRASH_MGMT_HASH_SHA256      1
+#else
+#define CRASH_MGMT_HASH_SHA256      0
+#endif
+
+#else
+
+/* No direct support for this OS.  The application needs to define the above
+ * settings itself.
+ */
+
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Declares implementation-specific functions required by crash
+ *        management.  The default stubs can be overridden with functions that
+ *        are compatible with the host OS.
+ */
+
+#ifndef H_CRASH_MGMT_IMPL_
+#define H_CRASH_MGMT_IMPL_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Retrieves the size of the stored core dump.
+ *
+ * @param out_len               On success, the size of the dump, in bytes,
+ *                                  gets written here.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOENT if no dump is stored;
+ *                              MGMT_ERR_EBADSTATE if the dump is being
+ *                                  erased;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int crash_mgmt_impl_dump_len(size_t *out_len);
+
+/**
+ * @brief Reads a piece of the stored core dump.
+ *
+ * @param offset                The offset in the dump to read from.
+ * @param dst                   The buffer to read into.
+ * @param len                   The number of bytes to read; the dump must
+ *                                  extend at least this far.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_EBADSTATE if the dump is being
+ *                                  erased;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int crash_mgmt_impl_read(size_t offset, void *dst, size_t len);
+
+/**
+ * @brief Starts erasing the stored core dump in the background.  Until the
+ *        erase completes, the other functions report MGMT_ERR_EBADSTATE.
+ *
+ * @return                      0 if the erase was started or is already in
+ *                                  progress;
+ *                              MGMT_ERR_[...] code on failure.
+ */
+int crash_mgmt_impl_erase(void);
+
+/**
+ * @brief Starts a SHA-256 computation.  Only one computation is in progress
+ *        at a time.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int crash_mgmt_impl_sha256_start(void);
+
+/**
+ * @brief Feeds data to the SHA-256 computation started with
+ *        crash_mgmt_impl_sha256_start().
+ *
+ * @param data                  The data to hash.
+ * @param len                   The number of bytes to hash.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int crash_mgmt_impl_sha256_update(const void *data, size_t len);
+
+/**
+ * @brief Completes the SHA-256 computation.
+ *
+ * @param digest                On success, the CRASH_MGMT_SHA256_LEN-byte
+ *                                  digest gets written here.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int crash_mgmt_impl_sha256_finish(uint8_t *digest);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
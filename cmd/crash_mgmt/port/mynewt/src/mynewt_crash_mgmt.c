@@ -0,0 +1,193 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include "os/mynewt.h"
+#include "flash_map/flash_map.h"
+#include "coredump/coredump.h"
+#include "mgmt/mgmt.h"
+#include "crash_mgmt/crash_mgmt.h"
+#include "crash_mgmt/crash_mgmt_impl.h"
+#include "crash_mgmt/crash_mgmt_config.h"
+#if CRASH_MGMT_HASH_SHA256
+#include "mbedtls/sha256.h"
+#endif
+
+static void mynewt_crash_mgmt_erase_ev_cb(struct os_event *ev);
+
+static struct os_event mynewt_crash_mgmt_erase_ev = {
+    .ev_cb = mynewt_crash_mgmt_erase_ev_cb,
+};
+
+/* Set while the dump partition is being erased. */
+static volatile bool mynewt_crash_mgmt_erasing;
+
+/* The sector of the dump partition erased last; -1 before the first. */
+static int mynewt_crash_mgmt_erase_sector;
+
+static int
+mynewt_crash_mgmt_open(const struct flash_area **fa)
+{
+    if (mynewt_crash_mgmt_erasing) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    if (flash_area_open(MYNEWT_VAL(COREDUMP_FLASH_AREA), fa) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+crash_mgmt_impl_dump_len(size_t *out_len)
+{
+    const struct flash_area *fa;
+    struct coredump_header hdr;
+    int rc;
+
+    rc = mynewt_crash_mgmt_open(&fa);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = flash_area_read(fa, 0, &hdr, sizeof hdr);
+    flash_area_close(fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    /* The size in the header covers the header itself. */
+    if (hdr.ch_magic != COREDUMP_MAGIC || hdr.ch_size < sizeof hdr ||
+        hdr.ch_size > fa->fa_size) {
+
+        return MGMT_ERR_ENOENT;
+    }
+
+    *out_len = hdr.ch_size;
+    return 0;
+}
+
+int
+crash_mgmt_impl_read(size_t offset, void *dst, size_t len)
+{
+    const struct flash_area *fa;
+    int rc;
+
+    rc = mynewt_crash_mgmt_open(&fa);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = flash_area_read(fa, offset, dst, len);
+    flash_area_close(fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+/**
+ * Erases the next sector of the dump partition and reposts itself until the
+ * partition is erased.  Erasing a sector at a time keeps the default event
+ * queue responsive.
+ */
+static void
+mynewt_crash_mgmt_erase_ev_cb(struct os_event *ev)
+{
+    struct flash_area sector;
+    int rc;
+
+    rc = flash_area_getnext_sector(MYNEWT_VAL(COREDUMP_FLASH_AREA),
+                                   &mynewt_crash_mgmt_erase_sector, &sector);
+    if (rc == 0) {
+        rc = flash_area_erase(&sector, 0, sector.fa_size);
+    }
+
+    if (rc == 0) {
+        os_eventq_put(os_eventq_dflt_get(), ev);
+    } else {
+        /* Past the last sector, or failed; the header check catches a
+         * partially erased dump.
+         */
+        mynewt_crash_mgmt_erasing = false;
+    }
+}
+
+int
+crash_mgmt_impl_erase(void)
+{
+    if (mynewt_crash_mgmt_erasing) {
+        return 0;
+    }
+
+    mynewt_crash_mgmt_erasing = true;
+    mynewt_crash_mgmt_erase_sector = -1;
+    os_eventq_put(os_eventq_dflt_get(), &mynewt_crash_mgmt_erase_ev);
+
+    return 0;
+}
+
+#if CRASH_MGMT_HASH_SHA256
+static mbedtls_sha256_context mynewt_crash_mgmt_sha256;
+
+int
+crash_mgmt_impl_sha256_start(void)
+{
+    mbedtls_sha256_init(&mynewt_crash_mgmt_sha256);
+    if (mbedtls_sha256_starts_ret(&mynewt_crash_mgmt_sha256, 0) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+crash_mgmt_impl_sha256_update(const void *data, size_t len)
+{
+    if (mbedtls_sha256_update_ret(&mynewt_crash_mgmt_sha256, data, len) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+crash_mgmt_impl_sha256_finish(uint8_t *digest)
+{
+    int rc;
+
+    rc = mbedtls_sha256_finish_ret(&mynewt_crash_mgmt_sha256, digest);
+    mbedtls_sha256_free(&mynewt_crash_mgmt_sha256);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+#endif
+
+void
+crash_mgmt_module_init(void)
+{
+    /* Ensure this function only gets called by sysinit. */
+    SYSINIT_ASSERT_ACTIVE();
+
+    crash_mgmt_register_group();
+}
@@ -0,0 +1,146 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <zephyr.h>
+#include <debug/coredump.h>
+#include <mgmt/mgmt.h>
+#include <crash_mgmt/crash_mgmt.h>
+#include <crash_mgmt/crash_mgmt_impl.h>
+#include <crash_mgmt/crash_mgmt_config.h>
+#if CRASH_MGMT_HASH_SHA256
+#include <mbedtls/sha256.h>
+#endif
+
+static void zephyr_crash_mgmt_erase_work_fn(struct k_work *work);
+static K_WORK_DEFINE(zephyr_crash_mgmt_erase_work,
+                     zephyr_crash_mgmt_erase_work_fn);
+
+/* Set while the stored dump is being erased. */
+static volatile bool zephyr_crash_mgmt_erasing;
+
+int
+crash_mgmt_impl_dump_len(size_t *out_len)
+{
+    int rc;
+
+    if (zephyr_crash_mgmt_erasing) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    rc = coredump_query(COREDUMP_QUERY_HAS_STORED_DUMP, NULL);
+    if (rc < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+    if (rc == 0) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    rc = coredump_query(COREDUMP_QUERY_GET_STORED_DUMP_SIZE, NULL);
+    if (rc < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+    if (rc == 0) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    *out_len = rc;
+    return 0;
+}
+
+int
+crash_mgmt_impl_read(size_t offset, void *dst, size_t len)
+{
+    struct coredump_cmd_copy_arg copy;
+    int rc;
+
+    if (zephyr_crash_mgmt_erasing) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    copy = (struct coredump_cmd_copy_arg) {
+        .offset = offset,
+        .buffer = dst,
+        .length = len,
+    };
+    rc = coredump_cmd(COREDUMP_CMD_COPY_STORED_DUMP, &copy);
+    if (rc < 0 || (size_t)rc != len) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+static void
+zephyr_crash_mgmt_erase_work_fn(struct k_work *work)
+{
+    coredump_cmd(COREDUMP_CMD_ERASE_STORED_DUMP, NULL);
+    zephyr_crash_mgmt_erasing = false;
+}
+
+int
+crash_mgmt_impl_erase(void)
+{
+    if (zephyr_crash_mgmt_erasing) {
+        return 0;
+    }
+
+    zephyr_crash_mgmt_erasing = true;
+    k_work_submit(&zephyr_crash_mgmt_erase_work);
+
+    return 0;
+}
+
+#if CRASH_MGMT_HASH_SHA256
+static mbedtls_sha256_context zephyr_crash_mgmt_sha256;
+
+int
+crash_mgmt_impl_sha256_start(void)
+{
+    mbedtls_sha256_init(&zephyr_crash_mgmt_sha256);
+    if (mbedtls_sha256_starts_ret(&zephyr_crash_mgmt_sha256, 0) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+crash_mgmt_impl_sha256_update(const void *data, size_t len)
+{
+    if (mbedtls_sha256_update_ret(&zephyr_crash_mgmt_sha256, data, len) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+crash_mgmt_impl_sha256_finish(uint8_t *digest)
+{
+    int rc;
+
+    rc = mbedtls_sha256_finish_ret(&zephyr_crash_mgmt_sha256, digest);
+    mbedtls_sha256_free(&zephyr_crash_mgmt_sha256);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+#endif
@@ -0,0 +1,336 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "mgmt/mgmt.h"
+#include "cborattr/cborattr.h"
+#include "crash_mgmt/crash_mgmt.h"
+#include "crash_mgmt/crash_mgmt_impl.h"
+#include "crash_mgmt/crash_mgmt_config.h"
+
+/* Worst-case size of a download response body, excluding the dump data: map
+ * header, "off", "data" byte string header, "rc" and "len".
+ */
+#define CRASH_MGMT_DL_RSP_OVERHEAD  40
+
+static mgmt_handler_fn crash_mgmt_info;
+static mgmt_handler_fn crash_mgmt_dump;
+static mgmt_handler_fn crash_mgmt_clear;
+
+static const struct mgmt_handler crash_mgmt_handlers[] = {
+    [CRASH_MGMT_ID_INFO] = { crash_mgmt_info, NULL },
+    [CRASH_MGMT_ID_DUMP] = { crash_mgmt_dump, NULL },
+    [CRASH_MGMT_ID_CLEAR] = { NULL, crash_mgmt_clear },
+};
+
+#define CRASH_MGMT_HANDLER_CNT \
+    sizeof crash_mgmt_handlers / sizeof crash_mgmt_handlers[0]
+
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE_RES(crash_mgmt_group, crash_mgmt_handlers,
+                             MGMT_GROUP_ID_CRASH, MGMT_RES_CRASH);
+#else
+static struct mgmt_group crash_mgmt_group = {
+    .mg_handlers = crash_mgmt_handlers,
+    .mg_handlers_count = CRASH_MGMT_HANDLER_CNT,
+    .mg_group_id = MGMT_GROUP_ID_CRASH,
+    .mg_res = MGMT_RES_CRASH,
+};
+#endif
+
+/* Holds a piece of the dump being sent or hashed.  The group's handlers run
+ * one at a time, so a single buffer serves them all.
+ */
+static uint8_t crash_mgmt_buf[CRASH_MGMT_DL_CHUNK_SIZE];
+
+#if CRASH_MGMT_HASH_SHA256
+/* Digest of the stored dump, so that repeated info requests don't read the
+ * whole partition again.  Invalidated when the dump is cleared.
+ */
+static struct {
+    bool valid;
+    size_t len;
+    uint8_t digest[CRASH_MGMT_SHA256_LEN];
+} crash_mgmt_hash;
+
+/**
+ * Computes the SHA-256 digest of the first len bytes of the stored dump.
+ */
+static int
+crash_mgmt_hash_dump(size_t len, uint8_t *digest)
+{
+    size_t chunk_len;
+    size_t off;
+    int rc;
+
+    if (crash_mgmt_hash.valid && crash_mgmt_hash.len == len) {
+        memcpy(digest, crash_mgmt_hash.digest, sizeof crash_mgmt_hash.digest);
+        return 0;
+    }
+
+    rc = crash_mgmt_impl_sha256_start();
+    if (rc != 0) {
+        return rc;
+    }
+
+    for (off = 0; off < len; off += chunk_len) {
+        chunk_len = len - off;
+        if (chunk_len > sizeof crash_mgmt_buf) {
+            chunk_len = sizeof crash_mgmt_buf;
+        }
+
+        rc = crash_mgmt_impl_read(off, crash_mgmt_buf, chunk_len);
+        if (rc == 0) {
+            rc = crash_mgmt_impl_sha256_update(crash_mgmt_buf, chunk_len);
+        }
+        if (rc != 0) {
+            /* Release the hash context. */
+            crash_mgmt_impl_sha256_finish(digest);
+            return rc;
+        }
+    }
+
+    rc = crash_mgmt_impl_sha256_finish(digest);
+    if (rc != 0) {
+        return rc;
+    }
+
+    crash_mgmt_hash.valid = true;
+    crash_mgmt_hash.len = len;
+    memcpy(crash_mgmt_hash.digest, digest, sizeof crash_mgmt_hash.digest);
+
+    return 0;
+}
+#endif
+
+/**
+ * Command handler: crash info (read)
+ *
+ * Reports whether a core dump is stored ("present") and, if so, its size
+ * ("len") and, if supported, its SHA-256 digest ("sha256").  "erasing" is
+ * reported while a clear command is in progress.
+ */
+static int
+crash_mgmt_info(struct mgmt_ctxt *ctxt)
+{
+#if CRASH_MGMT_HASH_SHA256
+    uint8_t digest[CRASH_MGMT_SHA256_LEN];
+#endif
+    CborError err;
+    size_t len;
+    int rc;
+
+    rc = crash_mgmt_impl_dump_len(&len);
+    if (rc != 0 && rc != MGMT_ERR_ENOENT && rc != MGMT_ERR_EBADSTATE) {
+        return rc;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "present");
+    err |= cbor_encode_boolean(&ctxt->encoder, rc == 0);
+    if (rc == MGMT_ERR_EBADSTATE) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "erasing");
+        err |= cbor_encode_boolean(&ctxt->encoder, true);
+    }
+    if (rc == 0) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+        err |= cbor_encode_uint(&ctxt->encoder, len);
+
+#if CRASH_MGMT_HASH_SHA256
+        rc = crash_mgmt_hash_dump(len, digest);
+        if (rc != 0) {
+            return rc;
+        }
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "sha256");
+        err |= cbor_encode_byte_string(&ctxt->encoder, digest, sizeof digest);
+#endif
+    }
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the dump chunk at the specified offset and encodes it into the
+ * response.  The dump length is included if the offset is 0.
+ *
+ * @param chunk_len             The largest number of dump bytes to send.
+ * @param out_len               On success, the number of dump bytes sent.
+ */
+static int
+crash_mgmt_dump_chunk(struct mgmt_ctxt *ctxt, size_t dump_len, size_t off,
+                      size_t chunk_len, size_t *out_len)
+{
+    CborError err;
+    int rc;
+
+    if (chunk_len > dump_len - off) {
+        chunk_len = dump_len - off;
+    }
+
+    rc = crash_mgmt_impl_read(off, crash_mgmt_buf, chunk_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_uint(&ctxt->encoder, off);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "data");
+    err |= cbor_encode_byte_string(&ctxt->encoder, crash_mgmt_buf, chunk_len);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    if (off == 0) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+        err |= cbor_encode_uint(&ctxt->encoder, dump_len);
+    }
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    *out_len = chunk_len;
+    return 0;
+}
+
+/**
+ * Command handler: crash dump (read)
+ *
+ * Sends the stored dump from "off" on, like an fs file download: with "win",
+ * up to that many consecutive chunks are sent, each in its own response; the
+ * client requests the next window from the offset following the last chunk
+ * it got.
+ */
+static int
+crash_mgmt_dump(struct mgmt_ctxt *ctxt)
+{
+    unsigned long long win;
+    unsigned long long off;
+    size_t chunk_len;
+    size_t dump_len;
+    size_t sent;
+    int rc;
+
+    const struct cbor_attr_t dump_attr[] = {
+        {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+        },
+        {
+            .attribute = "win",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &win,
+            .nodefault = true,
+        },
+        { 0 },
+    };
+
+    win = 1;
+    off = ULLONG_MAX;
+    rc = cbor_read_object(&ctxt->it, dump_attr);
+    if (rc != 0 || off == ULLONG_MAX || win == 0) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (win > CRASH_MGMT_DL_WIN_MAX) {
+        win = CRASH_MGMT_DL_WIN_MAX;
+    }
+
+    rc = crash_mgmt_impl_dump_len(&dump_len);
+    if (rc != 0) {
+        return rc;
+    }
+    if (off > dump_len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    /* Fill the transport's packets rather than assume the smallest one. */
+    chunk_len = mgmt_rsp_chunk_size(ctxt, CRASH_MGMT_DL_RSP_OVERHEAD,
+                                    sizeof crash_mgmt_buf);
+
+    while (1) {
+        rc = crash_mgmt_dump_chunk(ctxt, dump_len, off, chunk_len, &sent);
+        if (rc != 0) {
+            return rc;
+        }
+        off += sent;
+
+        win--;
+        if (win == 0 || off == dump_len) {
+            return 0;
+        }
+
+        /* Send this chunk and continue with the next one in a new response.
+         * If the transport cannot do that, the client gets one chunk per
+         * request as usual.
+         */
+        rc = mgmt_flush_rsp(ctxt);
+        if (rc == MGMT_ERR_ENOTSUP) {
+            return 0;
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+}
+
+/**
+ * Command handler: crash clear (write)
+ *
+ * Starts erasing the stored dump and responds right away; info requests
+ * report "erasing" until the erase completes.
+ */
+static int
+crash_mgmt_clear(struct mgmt_ctxt *ctxt)
+{
+    CborError err;
+    int rc;
+
+#if CRASH_MGMT_HASH_SHA256
+    crash_mgmt_hash.valid = false;
+#endif
+
+    rc = crash_mgmt_impl_erase();
+    if (rc != 0) {
+        return rc;
+    }
+
+    err = cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+void
+crash_mgmt_register_group(void)
+{
+#if !MGMT_STATIC_GROUPS
+    mgmt_register_group(&crash_mgmt_group);
+#endif
+}
@@ -28,6 +28,17 @@ extern "C" {
  * Command IDs for file system management group.
  */
 #define FS_MGMT_ID_FILE     0
+#define FS_MGMT_ID_COMMIT   1
+#define FS_MGMT_ID_DIR      2
+#define FS_MGMT_ID_STAT     3
+#define FS_MGMT_ID_HASH     4
+#define FS_MGMT_ID_SUMS     5
+
+/* Hash types of the fs hash command. */
+#define FS_MGMT_HASH_TYPE_CRC32     0
+#define FS_MGMT_HASH_TYPE_SHA256    1
+
+#define FS_MGMT_SHA256_LEN      32
 
 /**
  * @brief Registers the file system management command handler group.
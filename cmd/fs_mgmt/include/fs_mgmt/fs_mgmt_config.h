@@ -27,6 +27,12 @@
 #define FS_MGMT_DL_CHUNK_SIZE   MYNEWT_VAL(FS_MGMT_DL_CHUNK_SIZE)
 #define FS_MGMT_PATH_SIZE       MYNEWT_VAL(FS_MGMT_PATH_SIZE)
 #define FS_MGMT_UL_CHUNK_SIZE   MYNEWT_VAL(FS_MGMT_UL_CHUNK_SIZE)
+#define FS_MGMT_UL_SYNC_BYTES   MYNEWT_VAL(FS_MGMT_UL_SYNC_BYTES)
+#define FS_MGMT_UL_COMP         MYNEWT_VAL(FS_MGMT_UL_COMP)
+#define FS_MGMT_DL_COMP         MYNEWT_VAL(FS_MGMT_DL_COMP)
+#define FS_MGMT_DL_WIN_MAX      MYNEWT_VAL(FS_MGMT_DL_WIN_MAX)
+#define FS_MGMT_UL_SESSIONS     MYNEWT_VAL(FS_MGMT_UL_SESSIONS)
+#define FS_MGMT_HASH_SHA256     MYNEWT_VAL(FS_MGMT_HASH_SHA256)
 
 #elif defined __ZEPHYR__
 
@@ -73,6 +79,61 @@
 #define FS_MGMT_PATH_SIZE       CONFIG_FS_MGMT_PATH_SIZE
 #define FS_MGMT_UL_CHUNK_SIZE   CONFIG_FS_MGMT_UL_CHUNK_SIZE
 
+#ifdef CONFIG_FS_MGMT_UL_SYNC_BYTES
+#define FS_MGMT_UL_SYNC_BYTES   CONFIG_FS_MGMT_UL_SYNC_BYTES
+#else
+#define FS_MGMT_UL_SYNC_BYTES   0
+#endif
+
+#ifdef CONFIG_FS_MGMT_UL_SYNC_INTERVAL_MS
+#define FS_MGMT_UL_SYNC_INTERVAL_MS CONFIG_FS_MGMT_UL_SYNC_INTERVAL_MS
+#else
+#define FS_MGMT_UL_SYNC_INTERVAL_MS 0
+#endif
+
+#ifdef CONFIG_FS_MGMT_UL_COMP
+#define FS_MGMT_UL_COMP         1
+#else
+#define FS_MGMT_UL_COMP         0
+#endif
+
+#ifdef CONFIG_FS_MGMT_DL_COMP
+#define FS_MGMT_DL_COMP         1
+#else
+#define FS_MGMT_DL_COMP         0
+#endif
+
+#ifdef CONFIG_FS_MGMT_DL_WIN_MAX
+#define FS_MGMT_DL_WIN_MAX      CONFIG_FS_MGMT_DL_WIN_MAX
+#else
+#define FS_MGMT_DL_WIN_MAX      1
+#endif
+
+/* Number of file uploads that can be in progress at the same time. */
+#ifdef CONFIG_FS_MGMT_UL_SESSIONS
+#define FS_MGMT_UL_SESSIONS     CONFIG_FS_MGMT_UL_SESSIONS
+#else
+#define FS_MGMT_UL_SESSIONS     1
+#endif
+
+#ifdef CONFIG_FS_MGMT_HASH_SHA256
+#define FS_MGMT_HASH_SHA256     1
+#else
+#define FS_MGMT_HASH_SHA256     0
+#endif
+
+#ifdef CONFIG_FS_MGMT_READ_CACHE_CNT
+#define FS_MGMT_READ_CACHE_CNT  CONFIG_FS_MGMT_READ_CACHE_CNT
+#else
+#define FS_MGMT_READ_CACHE_CNT  2
+#endif
+
+#ifdef CONFIG_FS_MGMT_READ_CACHE_IDLE_MS
+#define FS_MGMT_READ_CACHE_IDLE_MS  CONFIG_FS_MGMT_READ_CACHE_IDLE_MS
+#else
+#define FS_MGMT_READ_CACHE_IDLE_MS  5000
+#endif
+
 #else
 
 /* No direct support for this OS.  The application needs to define the above
@@ -27,10 +27,38 @@
 #ifndef H_FS_MGMT_IMPL_
 #define H_FS_MGMT_IMPL_
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * @brief An entry of a directory listing.
+ */
+struct fs_mgmt_dirent {
+    /** Name of the entry within its directory. */
+    const char *name;
+
+    /** Length of the file; 0 for directories. */
+    size_t size;
+
+    bool is_dir;
+};
+
+/** @typedef fs_mgmt_dirent_fn
+ * @brief Receives an entry of a directory listing.
+ *
+ * @param dirent                The entry; valid only during the call.
+ * @param arg                   Optional argument passed to
+ *                                  fs_mgmt_impl_readdir().
+ *
+ * @return                      0 to continue the listing; nonzero to stop.
+ */
+typedef int fs_mgmt_dirent_fn(const struct fs_mgmt_dirent *dirent, void *arg);
+
 /**
  * @brief Retrieves the length of the file at the specified path.
  *
@@ -70,6 +98,102 @@ int fs_mgmt_impl_read(const char *path, size_t offset, size_t len,
 int fs_mgmt_impl_write(const char *path, size_t offset, const void *data,
                        size_t len);
 
+/**
+ * @brief Writes the specified chunk of file data in place.  Unlike
+ * fs_mgmt_impl_write(), the existing contents of the file are kept and writes
+ * may arrive at any offset.  The file is created if it does not exist.
+ *
+ * @param path                  The path of the file to write to.
+ * @param offset                The byte offset to write to.
+ * @param data                  The data to write to the file.
+ * @param len                   The number of bytes to write.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int fs_mgmt_impl_patch(const char *path, size_t offset, const void *data,
+                       size_t len);
+
+/**
+ * @brief Cuts the specified file down to the specified length and makes the
+ * change durable.
+ *
+ * @param path                  The path of the file to truncate.
+ * @param len                   The length the file should have.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if the file is longer and
+ *                                  the file system cannot shorten it;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int fs_mgmt_impl_truncate(const char *path, size_t len);
+
+/**
+ * @brief Makes all data previously written to the specified file durable.
+ * Writes need not be durable until this is called.
+ *
+ * @param path                  The path of the file to sync.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int fs_mgmt_impl_sync(const char *path);
+
+/**
+ * @brief Renames a file, replacing any file already at the new path.  Data
+ * written to the file under its old path is made durable first.
+ *
+ * @param from                  The current path of the file.
+ * @param to                    The path the file should have.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int fs_mgmt_impl_rename(const char *from, const char *to);
+
+/**
+ * @brief Lists the entries of a directory, in the order the file system
+ * keeps them.
+ *
+ * @param path                  The path of the directory.
+ * @param skip                  Number of entries to skip before the first
+ *                                  one reported.
+ * @param cb                    Called for each entry after the skipped ones.
+ * @param arg                   Optional argument passed to the callback.
+ *
+ * @return                      0 if every entry was reported; the
+ *                                  callback's return value if it stopped the
+ *                                  listing; MGMT_ERR_[...] code on failure.
+ */
+int fs_mgmt_impl_readdir(const char *path, uint32_t skip,
+                         fs_mgmt_dirent_fn *cb, void *arg);
+
+/**
+ * @brief Starts computing the SHA-256 of file data.  Only one hash is
+ * computed at a time.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int fs_mgmt_impl_sha256_start(void);
+
+/**
+ * @brief Adds file data to the SHA-256 started with
+ *        fs_mgmt_impl_sha256_start().
+ *
+ * @param data                  The data to hash.
+ * @param len                   The number of bytes to hash.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int fs_mgmt_impl_sha256_update(const void *data, size_t len);
+
+/**
+ * @brief Completes a SHA-256 of file data.
+ *
+ * @param digest                On success, receives the FS_MGMT_SHA256_LEN-
+ *                                  byte digest.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int fs_mgmt_impl_sha256_finish(uint8_t *digest);
+
 #ifdef __cplusplus
 }
 #endif
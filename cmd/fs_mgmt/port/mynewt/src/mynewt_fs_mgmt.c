@@ -17,9 +17,16 @@
  * under the License.
  */
 
+#include <stdio.h>
+#include <string.h>
+
 #include "mgmt/mgmt.h"
+#include "fs_mgmt/fs_mgmt_config.h"
 #include "fs_mgmt/fs_mgmt_impl.h"
 #include "fs/fs.h"
+#if FS_MGMT_HASH_SHA256
+#include "mbedtls/sha256.h"
+#endif
 
 int
 fs_mgmt_impl_filelen(const char *path, size_t *out_len)
@@ -104,3 +111,174 @@ fs_mgmt_impl_write(const char *path, size_t offset, const void *data,
 
     return 0;
 }
+
+int
+fs_mgmt_impl_patch(const char *path, size_t offset, const void *data,
+                   size_t len)
+{
+    struct fs_file *file;
+    int rc;
+
+    rc = fs_open(path, FS_ACCESS_WRITE, &file);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = fs_seek(file, offset);
+    if (rc == 0) {
+        rc = fs_write(file, data, len);
+    }
+    fs_close(file);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_truncate(const char *path, size_t len)
+{
+    size_t file_len;
+    int rc;
+
+    rc = fs_mgmt_impl_filelen(path, &file_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    /* The file system API has no way to shorten a file in place. */
+    if (file_len > len) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_sync(const char *path)
+{
+    /* Every write closes the file, which flushes it. */
+    return 0;
+}
+
+int
+fs_mgmt_impl_rename(const char *from, const char *to)
+{
+    int rc;
+
+    /* Every write closes the file, so there is nothing to flush. */
+    rc = fs_rename(from, to);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_readdir(const char *path, uint32_t skip,
+                     fs_mgmt_dirent_fn *cb, void *arg)
+{
+    char full_path[FS_MGMT_PATH_SIZE + 1];
+    char name[FS_MGMT_PATH_SIZE + 1];
+    struct fs_mgmt_dirent ent;
+    struct fs_dirent *dirent;
+    struct fs_dir *dir;
+    struct fs_file *file;
+    const char *sep;
+    uint32_t file_len;
+    uint32_t idx;
+    uint8_t name_len;
+    int rc;
+
+    sep = path[0] != '\0' && path[strlen(path) - 1] == '/' ? "" : "/";
+
+    rc = fs_opendir(path, &dir);
+    if (rc != 0) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    for (idx = 0; ; idx++) {
+        rc = fs_readdir(dir, &dirent);
+        if (rc == FS_ENOENT) {
+            /* End of directory. */
+            rc = 0;
+            break;
+        }
+        if (rc != 0) {
+            rc = MGMT_ERR_EUNKNOWN;
+            break;
+        }
+        if (idx < skip) {
+            continue;
+        }
+
+        rc = fs_dirent_name(dirent, sizeof name, name, &name_len);
+        if (rc != 0) {
+            rc = MGMT_ERR_EUNKNOWN;
+            break;
+        }
+
+        ent.name = name;
+        ent.is_dir = fs_dirent_is_dir(dirent);
+        ent.size = 0;
+        if (!ent.is_dir &&
+            snprintf(full_path, sizeof full_path, "%s%s%s", path, sep, name) <
+            (int)sizeof full_path &&
+            fs_open(full_path, FS_ACCESS_READ, &file) == 0) {
+
+            if (fs_filelen(file, &file_len) == 0) {
+                ent.size = file_len;
+            }
+            fs_close(file);
+        }
+
+        rc = cb(&ent, arg);
+        if (rc != 0) {
+            break;
+        }
+    }
+
+    fs_closedir(dir);
+    return rc;
+}
+
+#if FS_MGMT_HASH_SHA256
+static mbedtls_sha256_context mynewt_fs_mgmt_sha256;
+
+int
+fs_mgmt_impl_sha256_start(void)
+{
+    mbedtls_sha256_init(&mynewt_fs_mgmt_sha256);
+    if (mbedtls_sha256_starts_ret(&mynewt_fs_mgmt_sha256, 0) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_sha256_update(const void *data, size_t len)
+{
+    if (mbedtls_sha256_update_ret(&mynewt_fs_mgmt_sha256, data, len) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_sha256_finish(uint8_t *digest)
+{
+    int rc;
+
+    rc = mbedtls_sha256_finish_ret(&mynewt_fs_mgmt_sha256, digest);
+    mbedtls_sha256_free(&mynewt_fs_mgmt_sha256);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+#endif
@@ -18,9 +18,206 @@
  */
 
 #include <zephyr.h>
+#include <string.h>
+#include <errno.h>
 #include <fs/fs.h>
 #include <mgmt/mgmt.h>
+#include <fs_mgmt/fs_mgmt_config.h>
 #include <fs_mgmt/fs_mgmt_impl.h>
+#if FS_MGMT_HASH_SHA256
+#include <mbedtls/sha256.h>
+#endif
+
+/**
+ * Hashes a path (FNV-1a).  Cached handles are looked up by hash so that a
+ * chunk request only compares the full path of a handle that likely matches.
+ */
+static uint32_t
+zephyr_fs_mgmt_path_hash(const char *path)
+{
+    uint32_t hash;
+
+    hash = 2166136261u;
+    while (*path != '\0') {
+        hash ^= (uint8_t)*path++;
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+#if FS_MGMT_READ_CACHE_CNT > 0
+/**
+ * An open file handle kept across download requests.  Consecutive chunk
+ * reads continue from the current position rather than reopening the file
+ * and seeking from the start.
+ */
+struct zephyr_fs_mgmt_read_handle {
+    struct fs_file_t file;
+    char path[FS_MGMT_PATH_SIZE + 1];
+    uint32_t path_hash;
+    size_t pos;
+    size_t size;
+    int64_t last_used;
+    bool open;
+};
+
+static struct zephyr_fs_mgmt_read_handle
+    zephyr_fs_mgmt_read_cache[FS_MGMT_READ_CACHE_CNT];
+
+static void zephyr_fs_mgmt_read_cache_timer_cb(struct k_timer *timer);
+static void zephyr_fs_mgmt_read_cache_work_handler(struct k_work *work);
+
+static K_TIMER_DEFINE(zephyr_fs_mgmt_read_cache_timer,
+                      zephyr_fs_mgmt_read_cache_timer_cb, NULL);
+
+K_WORK_DEFINE(zephyr_fs_mgmt_read_cache_work,
+              zephyr_fs_mgmt_read_cache_work_handler);
+
+static void
+zephyr_fs_mgmt_read_cache_close(struct zephyr_fs_mgmt_read_handle *handle)
+{
+    if (handle->open) {
+        fs_close(&handle->file);
+        handle->open = false;
+    }
+}
+
+static struct zephyr_fs_mgmt_read_handle *
+zephyr_fs_mgmt_read_cache_find(const char *path)
+{
+    uint32_t hash;
+    int i;
+
+    hash = zephyr_fs_mgmt_path_hash(path);
+    for (i = 0; i < FS_MGMT_READ_CACHE_CNT; i++) {
+        if (zephyr_fs_mgmt_read_cache[i].open &&
+            zephyr_fs_mgmt_read_cache[i].path_hash == hash &&
+            strcmp(zephyr_fs_mgmt_read_cache[i].path, path) == 0) {
+
+            return &zephyr_fs_mgmt_read_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Closes the cached handle for the specified path, if any.  Called before a
+ * file is modified so that readers never see stale data or a stale size.
+ */
+static void
+zephyr_fs_mgmt_read_cache_drop(const char *path)
+{
+    struct zephyr_fs_mgmt_read_handle *handle;
+
+    handle = zephyr_fs_mgmt_read_cache_find(path);
+    if (handle != NULL) {
+        zephyr_fs_mgmt_read_cache_close(handle);
+    }
+}
+
+/**
+ * Opens a file and adds it to the cache, evicting the least recently used
+ * handle if the cache is full.
+ */
+static struct zephyr_fs_mgmt_read_handle *
+zephyr_fs_mgmt_read_cache_open(const char *path)
+{
+    struct zephyr_fs_mgmt_read_handle *handle;
+    struct fs_dirent dirent;
+    int rc;
+    int i;
+
+    if (strlen(path) > FS_MGMT_PATH_SIZE) {
+        return NULL;
+    }
+
+    handle = &zephyr_fs_mgmt_read_cache[0];
+    for (i = 0; i < FS_MGMT_READ_CACHE_CNT; i++) {
+        if (!zephyr_fs_mgmt_read_cache[i].open) {
+            handle = &zephyr_fs_mgmt_read_cache[i];
+            break;
+        }
+        if (zephyr_fs_mgmt_read_cache[i].last_used < handle->last_used) {
+            handle = &zephyr_fs_mgmt_read_cache[i];
+        }
+    }
+    zephyr_fs_mgmt_read_cache_close(handle);
+
+    rc = fs_stat(path, &dirent);
+    if (rc != 0 || dirent.type != FS_DIR_ENTRY_FILE) {
+        return NULL;
+    }
+
+    fs_file_t_init(&handle->file);
+    rc = fs_open(&handle->file, path, FS_O_READ);
+    if (rc != 0) {
+        return NULL;
+    }
+
+    strcpy(handle->path, path);
+    handle->path_hash = zephyr_fs_mgmt_path_hash(path);
+    handle->pos = 0;
+    handle->size = dirent.size;
+    handle->open = true;
+
+    return handle;
+}
+
+static void
+zephyr_fs_mgmt_read_cache_work_handler(struct k_work *work)
+{
+    int64_t now;
+    bool any_open;
+    int i;
+
+    /* Requests may be processed in threads other than this one. */
+    mgmt_res_lock(MGMT_RES_FS);
+
+    now = k_uptime_get();
+    any_open = false;
+    for (i = 0; i < FS_MGMT_READ_CACHE_CNT; i++) {
+        if (!zephyr_fs_mgmt_read_cache[i].open) {
+            continue;
+        }
+
+        if (now - zephyr_fs_mgmt_read_cache[i].last_used >=
+            FS_MGMT_READ_CACHE_IDLE_MS) {
+
+            zephyr_fs_mgmt_read_cache_close(&zephyr_fs_mgmt_read_cache[i]);
+        } else {
+            any_open = true;
+        }
+    }
+
+    if (any_open) {
+        k_timer_start(&zephyr_fs_mgmt_read_cache_timer,
+                      K_MSEC(FS_MGMT_READ_CACHE_IDLE_MS), K_NO_WAIT);
+    }
+
+    mgmt_res_unlock(MGMT_RES_FS);
+}
+
+static void
+zephyr_fs_mgmt_read_cache_timer_cb(struct k_timer *timer)
+{
+    /* Close idle handles from the system workqueue thread rather than in
+     * interrupt context.
+     */
+    k_work_submit(&zephyr_fs_mgmt_read_cache_work);
+}
+
+static void
+zephyr_fs_mgmt_read_cache_touch(struct zephyr_fs_mgmt_read_handle *handle)
+{
+    handle->last_used = k_uptime_get();
+    if (k_timer_remaining_get(&zephyr_fs_mgmt_read_cache_timer) == 0) {
+        k_timer_start(&zephyr_fs_mgmt_read_cache_timer,
+                      K_MSEC(FS_MGMT_READ_CACHE_IDLE_MS), K_NO_WAIT);
+    }
+}
+#endif
 
 int
 fs_mgmt_impl_filelen(const char *path, size_t *out_len)
@@ -28,6 +225,16 @@ fs_mgmt_impl_filelen(const char *path, size_t *out_len)
     struct fs_dirent dirent;
     int rc;
 
+#if FS_MGMT_READ_CACHE_CNT > 0
+    struct zephyr_fs_mgmt_read_handle *handle;
+
+    handle = zephyr_fs_mgmt_read_cache_find(path);
+    if (handle != NULL) {
+        *out_len = handle->size;
+        return 0;
+    }
+#endif
+
     rc = fs_stat(path, &dirent);
     if (rc != 0) {
         return MGMT_ERR_EUNKNOWN;
@@ -42,6 +249,51 @@ fs_mgmt_impl_filelen(const char *path, size_t *out_len)
     return 0;
 }
 
+#if FS_MGMT_READ_CACHE_CNT > 0
+int
+fs_mgmt_impl_read(const char *path, size_t offset, size_t len,
+                  void *out_data, size_t *out_len)
+{
+    struct zephyr_fs_mgmt_read_handle *handle;
+    ssize_t bytes_read;
+    int rc;
+
+    handle = zephyr_fs_mgmt_read_cache_find(path);
+    if (handle == NULL) {
+        handle = zephyr_fs_mgmt_read_cache_open(path);
+        if (handle == NULL) {
+            return MGMT_ERR_ENOENT;
+        }
+    }
+
+    if (handle->pos != offset) {
+        rc = fs_seek(&handle->file, offset, FS_SEEK_SET);
+        if (rc != 0) {
+            zephyr_fs_mgmt_read_cache_close(handle);
+            return MGMT_ERR_EUNKNOWN;
+        }
+        handle->pos = offset;
+    }
+
+    bytes_read = fs_read(&handle->file, out_data, len);
+    if (bytes_read < 0) {
+        zephyr_fs_mgmt_read_cache_close(handle);
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    handle->pos += bytes_read;
+    *out_len = bytes_read;
+
+    if (handle->pos >= handle->size) {
+        /* Download complete; release the handle right away. */
+        zephyr_fs_mgmt_read_cache_close(handle);
+    } else {
+        zephyr_fs_mgmt_read_cache_touch(handle);
+    }
+
+    return 0;
+}
+#else
 int
 fs_mgmt_impl_read(const char *path, size_t offset, size_t len,
                   void *out_data, size_t *out_len)
@@ -77,6 +329,7 @@ done:
         return 0;
     }
 }
+#endif
 
 static int
 zephyr_fs_mgmt_truncate(const char *path)
@@ -107,68 +360,363 @@ zephyr_fs_mgmt_truncate(const char *path)
     return 0;
 }
 
-int
-fs_mgmt_impl_write(const char *path, size_t offset, const void *data,
-                   size_t len)
+#if FS_MGMT_UL_SYNC_INTERVAL_MS > 0
+static void zephyr_fs_mgmt_sync_timer_cb(struct k_timer *timer);
+static void zephyr_fs_mgmt_sync_work_handler(struct k_work *work);
+
+static K_TIMER_DEFINE(zephyr_fs_mgmt_sync_timer,
+                      zephyr_fs_mgmt_sync_timer_cb, NULL);
+
+K_WORK_DEFINE(zephyr_fs_mgmt_sync_work, zephyr_fs_mgmt_sync_work_handler);
+#endif
+
+/** A file open for writing; one per upload in progress. */
+struct zephyr_fs_mgmt_wr_handle {
+    struct fs_file_t file;
+    char path[FS_MGMT_PATH_SIZE + 1];
+    uint32_t path_hash;
+    uint32_t last_used;
+    bool open;
+};
+
+static struct zephyr_fs_mgmt_wr_handle
+    zephyr_fs_mgmt_wr_cache[FS_MGMT_UL_SESSIONS];
+static uint32_t zephyr_fs_mgmt_wr_count;
+
+static struct zephyr_fs_mgmt_wr_handle *
+zephyr_fs_mgmt_wr_find(const char *path)
+{
+    uint32_t hash;
+    int i;
+
+    hash = zephyr_fs_mgmt_path_hash(path);
+    for (i = 0; i < FS_MGMT_UL_SESSIONS; i++) {
+        if (zephyr_fs_mgmt_wr_cache[i].open &&
+            zephyr_fs_mgmt_wr_cache[i].path_hash == hash &&
+            strcmp(zephyr_fs_mgmt_wr_cache[i].path, path) == 0) {
+
+            return &zephyr_fs_mgmt_wr_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void
+zephyr_fs_mgmt_wr_close(struct zephyr_fs_mgmt_wr_handle *handle)
+{
+    if (handle->open) {
+        fs_close(&handle->file);
+        handle->open = false;
+    }
+}
+
+/**
+ * Opens a file for writing, closing the least recently written one if every
+ * handle is in use.
+ */
+static struct zephyr_fs_mgmt_wr_handle *
+zephyr_fs_mgmt_wr_open(const char *path)
 {
-    static struct fs_file_t file;
-    static char *previous_path = NULL;
+    struct zephyr_fs_mgmt_wr_handle *handle;
     int rc;
+    int i;
 
-    /* If this is the write of the first chunk or there isn't a previously-opened
-     * file path or this write is for a different file path than that previous one...
-     */
-    if (offset == 0 || previous_path == NULL || strcmp(path, previous_path) != 0) {
-        /* If there is a previously-opened file path, close the
-         * file and free the storage allocated for the file path
-         */
-        if (previous_path != NULL) {
-            fs_close(&file);
-            k_free(previous_path);
-            previous_path = NULL;
+    if (strlen(path) > FS_MGMT_PATH_SIZE) {
+        return NULL;
+    }
+
+    handle = &zephyr_fs_mgmt_wr_cache[0];
+    for (i = 0; i < FS_MGMT_UL_SESSIONS; i++) {
+        if (!zephyr_fs_mgmt_wr_cache[i].open) {
+            handle = &zephyr_fs_mgmt_wr_cache[i];
+            break;
+        }
+        if ((int32_t)(zephyr_fs_mgmt_wr_cache[i].last_used -
+                      handle->last_used) < 0) {
+            handle = &zephyr_fs_mgmt_wr_cache[i];
         }
+    }
+    zephyr_fs_mgmt_wr_close(handle);
 
-        /* Truncate the file before writing the first chunk.  This is done to
-         * properly handle an overwrite of an existing file.
-         *
-         */
-        if (offset == 0) {
-            rc = zephyr_fs_mgmt_truncate(path);
-            if (rc != 0) {
-                return rc;
-            }
+    fs_file_t_init(&handle->file);
+    rc = fs_open(&handle->file, path, FS_O_CREATE | FS_O_WRITE);
+    if (rc != 0) {
+        return NULL;
+    }
+
+    strcpy(handle->path, path);
+    handle->path_hash = zephyr_fs_mgmt_path_hash(path);
+    handle->open = true;
+
+    return handle;
+}
+
+/**
+ * Writes a chunk of file data through the file's write handle.  If `trunc`
+ * is set, a write to offset 0 replaces any existing file.
+ */
+static int
+zephyr_fs_mgmt_write(const char *path, size_t offset, const void *data,
+                     size_t len, bool trunc)
+{
+    struct zephyr_fs_mgmt_wr_handle *handle;
+    int rc;
+
+#if FS_MGMT_READ_CACHE_CNT > 0
+    zephyr_fs_mgmt_read_cache_drop(path);
+#endif
+
+    handle = zephyr_fs_mgmt_wr_find(path);
+
+    /* Truncate the file before writing the first chunk.  This is done to
+     * properly handle an overwrite of an existing file.
+     */
+    if (trunc && offset == 0) {
+        if (handle != NULL) {
+            zephyr_fs_mgmt_wr_close(handle);
+            handle = NULL;
         }
 
-        fs_file_t_init(&file);
-        rc = fs_open(&file, path, FS_O_CREATE | FS_O_WRITE);
+        rc = zephyr_fs_mgmt_truncate(path);
         if (rc != 0) {
-            return MGMT_ERR_EUNKNOWN;
+            return rc;
         }
+    }
 
-        /* Allocate storage for the opened file path and and duplicate it */
-        previous_path = k_malloc(strlen(path) + 1);
-        if (previous_path == NULL) {
-            fs_close(&file);
-            return MGMT_ERR_ENOMEM;
+    if (handle == NULL) {
+        handle = zephyr_fs_mgmt_wr_open(path);
+        if (handle == NULL) {
+            return MGMT_ERR_EUNKNOWN;
         }
-        strcpy(previous_path, path);
     }
+    handle->last_used = ++zephyr_fs_mgmt_wr_count;
 
-    rc = fs_seek(&file, offset, FS_SEEK_SET);
+    rc = fs_seek(&handle->file, offset, FS_SEEK_SET);
     if (rc != 0) {
-        goto done;
+        return MGMT_ERR_EUNKNOWN;
     }
 
-    rc = fs_write(&file, data, len);
+    rc = fs_write(&handle->file, data, len);
     if (rc < 0) {
-        goto done;
+        return MGMT_ERR_EUNKNOWN;
     }
 
-done:
-    rc = fs_sync(&file);
+#if FS_MGMT_UL_SYNC_INTERVAL_MS > 0
+    /* Bound the time that written data remains unsynced, even if the client
+     * stops sending.
+     */
+    if (k_timer_remaining_get(&zephyr_fs_mgmt_sync_timer) == 0) {
+        k_timer_start(&zephyr_fs_mgmt_sync_timer,
+                      K_MSEC(FS_MGMT_UL_SYNC_INTERVAL_MS), K_NO_WAIT);
+    }
+#endif
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_write(const char *path, size_t offset, const void *data,
+                   size_t len)
+{
+    return zephyr_fs_mgmt_write(path, offset, data, len, true);
+}
+
+int
+fs_mgmt_impl_patch(const char *path, size_t offset, const void *data,
+                   size_t len)
+{
+    return zephyr_fs_mgmt_write(path, offset, data, len, false);
+}
+
+int
+fs_mgmt_impl_truncate(const char *path, size_t len)
+{
+    struct zephyr_fs_mgmt_wr_handle *handle;
+    int rc;
+
+#if FS_MGMT_READ_CACHE_CNT > 0
+    zephyr_fs_mgmt_read_cache_drop(path);
+#endif
+
+    handle = zephyr_fs_mgmt_wr_find(path);
+    if (handle == NULL) {
+        handle = zephyr_fs_mgmt_wr_open(path);
+        if (handle == NULL) {
+            return MGMT_ERR_EUNKNOWN;
+        }
+    }
+    handle->last_used = ++zephyr_fs_mgmt_wr_count;
+
+    rc = fs_truncate(&handle->file, len);
+    if (rc == -ENOTSUP) {
+        return MGMT_ERR_ENOTSUP;
+    }
     if (rc != 0) {
         return MGMT_ERR_EUNKNOWN;
-    } else {
+    }
+
+    rc = fs_sync(&handle->file);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_sync(const char *path)
+{
+    struct zephyr_fs_mgmt_wr_handle *handle;
+    int rc;
+
+    handle = zephyr_fs_mgmt_wr_find(path);
+    if (handle == NULL) {
+        /* Nothing written through this file; nothing to sync. */
         return 0;
     }
+
+    rc = fs_sync(&handle->file);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_rename(const char *from, const char *to)
+{
+    struct zephyr_fs_mgmt_wr_handle *handle;
+    int rc;
+
+#if FS_MGMT_READ_CACHE_CNT > 0
+    zephyr_fs_mgmt_read_cache_drop(from);
+    zephyr_fs_mgmt_read_cache_drop(to);
+#endif
+
+    /* Closing a write handle flushes it. */
+    handle = zephyr_fs_mgmt_wr_find(from);
+    if (handle != NULL) {
+        zephyr_fs_mgmt_wr_close(handle);
+    }
+    handle = zephyr_fs_mgmt_wr_find(to);
+    if (handle != NULL) {
+        zephyr_fs_mgmt_wr_close(handle);
+    }
+
+    rc = fs_rename(from, to);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_readdir(const char *path, uint32_t skip,
+                     fs_mgmt_dirent_fn *cb, void *arg)
+{
+    struct fs_mgmt_dirent ent;
+    struct fs_dirent dirent;
+    struct fs_dir_t dir;
+    uint32_t idx;
+    int rc;
+
+    fs_dir_t_init(&dir);
+    rc = fs_opendir(&dir, path);
+    if (rc != 0) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    for (idx = 0; ; idx++) {
+        rc = fs_readdir(&dir, &dirent);
+        if (rc != 0) {
+            rc = MGMT_ERR_EUNKNOWN;
+            break;
+        }
+        if (dirent.name[0] == '\0') {
+            /* End of directory. */
+            break;
+        }
+        if (idx < skip) {
+            continue;
+        }
+
+        ent.name = dirent.name;
+        ent.is_dir = dirent.type == FS_DIR_ENTRY_DIR;
+        ent.size = ent.is_dir ? 0 : dirent.size;
+        rc = cb(&ent, arg);
+        if (rc != 0) {
+            break;
+        }
+    }
+
+    fs_closedir(&dir);
+    return rc;
+}
+
+#if FS_MGMT_HASH_SHA256
+static mbedtls_sha256_context zephyr_fs_mgmt_sha256;
+
+int
+fs_mgmt_impl_sha256_start(void)
+{
+    mbedtls_sha256_init(&zephyr_fs_mgmt_sha256);
+    if (mbedtls_sha256_starts_ret(&zephyr_fs_mgmt_sha256, 0) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_sha256_update(const void *data, size_t len)
+{
+    if (mbedtls_sha256_update_ret(&zephyr_fs_mgmt_sha256, data, len) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+fs_mgmt_impl_sha256_finish(uint8_t *digest)
+{
+    int rc;
+
+    rc = mbedtls_sha256_finish_ret(&zephyr_fs_mgmt_sha256, digest);
+    mbedtls_sha256_free(&zephyr_fs_mgmt_sha256);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+#endif
+
+#if FS_MGMT_UL_SYNC_INTERVAL_MS > 0
+static void
+zephyr_fs_mgmt_sync_work_handler(struct k_work *work)
+{
+    int i;
+
+    /* Requests may be processed in threads other than this one. */
+    mgmt_res_lock(MGMT_RES_FS);
+    for (i = 0; i < FS_MGMT_UL_SESSIONS; i++) {
+        if (zephyr_fs_mgmt_wr_cache[i].open) {
+            fs_sync(&zephyr_fs_mgmt_wr_cache[i].file);
+        }
+    }
+    mgmt_res_unlock(MGMT_RES_FS);
+}
+
+static void
+zephyr_fs_mgmt_sync_timer_cb(struct k_timer *timer)
+{
+    /* Sync from the system workqueue thread rather than in interrupt
+     * context.
+     */
+    k_work_submit(&zephyr_fs_mgmt_sync_work);
 }
+#endif
@@ -24,100 +24,389 @@
 #include "fs_mgmt/fs_mgmt.h"
 #include "fs_mgmt/fs_mgmt_impl.h"
 #include "fs_mgmt/fs_mgmt_config.h"
+#if FS_MGMT_UL_COMP || FS_MGMT_DL_COMP
+#include "util/mcumgr_hs.h"
+#endif
+
+/* Size of the stack buffers used to move file data in small pieces. */
+#define FS_MGMT_UL_BOUNCE_SIZE  64
+
+/* Worst-case size of a download response body, excluding the file data:
+ * map header, "off", "data" byte string header, "rc", "len" (or "foff" and
+ * "clen" for compressed downloads).
+ */
+#define FS_MGMT_DL_RSP_OVERHEAD 48
 
 static mgmt_handler_fn fs_mgmt_file_download;
 static mgmt_handler_fn fs_mgmt_file_upload;
+static mgmt_handler_fn fs_mgmt_file_commit;
+static mgmt_handler_fn fs_mgmt_dir_list;
+static mgmt_handler_fn fs_mgmt_stat;
+static mgmt_handler_fn fs_mgmt_hash;
+static mgmt_handler_fn fs_mgmt_sums;
+
+/* Worst-case size of a directory listing response body, excluding the
+ * entries: map header, "rc", "ents" array header and terminator, "next".
+ */
+#define FS_MGMT_DIR_RSP_OVERHEAD    32
+
+/* Worst-case size of a directory entry, excluding its name. */
+#define FS_MGMT_DIR_ENT_OVERHEAD    24
+
+/* Largest directory listing response body. */
+#define FS_MGMT_DIR_RSP_MAX         1024
+
+/* Most paths accepted by one stat request. */
+#define FS_MGMT_STAT_MAX_PATHS      16
+
+/* Size of the stack buffer that hashed file data is read into. */
+#define FS_MGMT_HASH_BUF_SIZE       256
+
+/* Range of block sizes accepted by the sums command. */
+#define FS_MGMT_SUMS_BS_MIN         64
+#define FS_MGMT_SUMS_BS_MAX         65536
+
+/* Bytes of each block's SHA-256 returned by the sums command. */
+#define FS_MGMT_SUMS_SHA256_LEN     16
+
+/* Worst-case size of a sums response body, excluding the checksums: map
+ * header, "rc", "len", "bs", "type", "sums" array header, "next".
+ */
+#define FS_MGMT_SUMS_RSP_OVERHEAD   64
+
+/* Largest sums response body. */
+#define FS_MGMT_SUMS_RSP_MAX        1024
+
+/**
+ * Path decoded from the request being handled.  The group's requests are
+ * handled one at a time (the group holds MGMT_RES_FS), so the handlers share
+ * this rather than each putting a path buffer on the stack.
+ */
+static char fs_mgmt_path[FS_MGMT_PATH_SIZE + 1];
+
+/** State of a client's file upload. */
+struct fs_mgmt_ul {
+    /** Session whose upload list holds this entry; NULL if unused. */
+    struct mgmt_session *owner;
+
+    /** Next upload of the same session. */
+    struct fs_mgmt_ul *next;
+
+    /** Upload ID chosen by the client; unique within its session. */
+    uint32_t sid;
+
+    /** Request count at last use; picks the entry to take over. */
+    uint32_t last_use;
 
-static struct {
     /** Whether an upload is currently in progress. */
     bool uploading;
 
+    /**
+     * Whether the upload patches the existing file in place.  If so, chunks
+     * may arrive at any offset and `off` is the end of the last one.
+     */
+    bool patch;
+
     /** Expected offset of next upload request. */
     size_t off;
 
     /** Total length of file currently being uploaded. */
     size_t len;
-} fs_mgmt_ctxt;
+
+    /** Number of bytes written since the file was last synced. */
+    size_t unsynced;
+
+    /** Path of file currently being uploaded. */
+    char path[FS_MGMT_PATH_SIZE + 1];
+
+#if FS_MGMT_UL_COMP
+    /**
+     * Whether the upload is compressed.  If so, `off` and `len` refer to the
+     * compressed stream.
+     */
+    bool comp;
+
+    /** Offset in the file of the next decompressed byte. */
+    size_t file_off;
+
+    struct mcumgr_hs_dec dec;
+#endif
+};
+
+static struct fs_mgmt_ul fs_mgmt_uls[FS_MGMT_UL_SESSIONS];
+static uint32_t fs_mgmt_ul_count;
+
+#if FS_MGMT_DL_COMP
+/** State of the compressed download in progress. */
+static struct {
+    /** Path of the file being downloaded; empty if there is none. */
+    char path[FS_MGMT_PATH_SIZE + 1];
+
+    /** Length of the file. */
+    size_t file_len;
+
+    /** Offset in the file of the next byte to compress. */
+    size_t file_off;
+
+    /** Offset in the compressed stream of the next chunk. */
+    size_t off;
+
+    /** Offset and contents of the last chunk sent, for retransmission. */
+    size_t prev_off;
+    size_t prev_len;
+    uint8_t prev_data[FS_MGMT_DL_CHUNK_SIZE];
+
+    struct mcumgr_hs_enc enc;
+} fs_mgmt_dl_comp;
+#endif
 
 static const struct mgmt_handler fs_mgmt_handlers[] = {
     [FS_MGMT_ID_FILE] = {
         .mh_read = fs_mgmt_file_download,
         .mh_write = fs_mgmt_file_upload,
     },
+    [FS_MGMT_ID_COMMIT] = {
+        .mh_read = NULL,
+        .mh_write = fs_mgmt_file_commit,
+    },
+    [FS_MGMT_ID_DIR] = {
+        .mh_read = fs_mgmt_dir_list,
+        .mh_write = NULL,
+    },
+    [FS_MGMT_ID_STAT] = {
+        .mh_read = fs_mgmt_stat,
+        .mh_write = NULL,
+    },
+    [FS_MGMT_ID_HASH] = {
+        .mh_read = fs_mgmt_hash,
+        .mh_write = NULL,
+    },
+    [FS_MGMT_ID_SUMS] = {
+        .mh_read = fs_mgmt_sums,
+        .mh_write = NULL,
+    },
 };
 
 #define FS_MGMT_HANDLER_CNT \
     (sizeof fs_mgmt_handlers / sizeof fs_mgmt_handlers[0])
 
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE_RES(fs_mgmt_group, fs_mgmt_handlers,
+                             MGMT_GROUP_ID_FS, MGMT_RES_FS);
+#else
 static struct mgmt_group fs_mgmt_group = {
     .mg_handlers = fs_mgmt_handlers,
     .mg_handlers_count = FS_MGMT_HANDLER_CNT,
     .mg_group_id = MGMT_GROUP_ID_FS,
+    .mg_res = MGMT_RES_FS,
 };
+#endif
 
 /**
- * Command handler: fs file (read)
+ * Removes an upload from its session's list.  An upload whose session was
+ * reset is no longer on the list.
+ */
+static void
+fs_mgmt_ul_unlink(struct fs_mgmt_ul *ul)
+{
+    struct fs_mgmt_ul **cur;
+
+    cur = (struct fs_mgmt_ul **)&ul->owner->state[MGMT_SESSION_SLOT_FS_UL];
+    while (*cur != NULL && *cur != ul) {
+        cur = &(*cur)->next;
+    }
+    if (*cur != NULL) {
+        *cur = ul->next;
+    }
+}
+
+/**
+ * Picks the entry for a new upload: an unused one if there is one, otherwise
+ * the least recently used, preferring finished uploads to ones in progress.
+ */
+static struct fs_mgmt_ul *
+fs_mgmt_ul_alloc(void)
+{
+    struct fs_mgmt_ul *best;
+    struct fs_mgmt_ul *cand;
+    int i;
+
+    best = NULL;
+    for (i = 0; i < FS_MGMT_UL_SESSIONS; i++) {
+        cand = &fs_mgmt_uls[i];
+        if (cand->owner == NULL) {
+            return cand;
+        }
+
+        if (best == NULL ||
+            (best->uploading && !cand->uploading) ||
+            (best->uploading == cand->uploading &&
+             (int32_t)(cand->last_use - best->last_use) < 0)) {
+
+            best = cand;
+        }
+    }
+
+    fs_mgmt_ul_unlink(best);
+    return best;
+}
+
+/**
+ * Retrieves the requesting client's upload with the specified ID.  If there
+ * is none and `create` is set, a new one is started, possibly abandoning
+ * another; see fs_mgmt_ul_alloc().
+ */
+static struct fs_mgmt_ul *
+fs_mgmt_ul_get(struct mgmt_ctxt *ctxt, uint32_t sid, bool create)
+{
+    struct mgmt_session *session;
+    struct fs_mgmt_ul *ul;
+
+    session = mgmt_ctxt_session(ctxt);
+    for (ul = session->state[MGMT_SESSION_SLOT_FS_UL];
+         ul != NULL;
+         ul = ul->next) {
+
+        if (ul->sid == sid) {
+            break;
+        }
+    }
+
+    if (ul == NULL && create) {
+        ul = fs_mgmt_ul_alloc();
+        memset(ul, 0, sizeof *ul);
+        ul->owner = session;
+        ul->sid = sid;
+        ul->next = session->state[MGMT_SESSION_SLOT_FS_UL];
+        session->state[MGMT_SESSION_SLOT_FS_UL] = ul;
+    }
+
+    if (ul != NULL) {
+        ul->last_use = ++fs_mgmt_ul_count;
+    }
+
+    return ul;
+}
+
+#if FS_MGMT_DL_COMP
+/**
+ * Produces the next chunk of the compressed download in progress.  File data
+ * is read through a small buffer and handed to the encoder until the chunk is
+ * full or the file has been compressed completely.
  */
 static int
-fs_mgmt_file_download(struct mgmt_ctxt *ctxt)
+fs_mgmt_file_download_comp_fill(size_t chunk_len)
 {
-    uint8_t file_data[FS_MGMT_DL_CHUNK_SIZE];
-    char path[FS_MGMT_PATH_SIZE + 1];
-    unsigned long long off;
-    CborError err;
+    uint8_t buf[FS_MGMT_UL_BOUNCE_SIZE];
     size_t bytes_read;
-    size_t file_len;
+    size_t produced;
+    size_t accepted;
+    size_t out_len;
+    bool eof;
     int rc;
 
-    const struct cbor_attr_t dload_attr[] = {
-        {
-            .attribute = "off",
-            .type = CborAttrUnsignedIntegerType,
-            .addr.uinteger = &off,
-        },
-        {
-            .attribute = "name",
-            .type = CborAttrTextStringType,
-            .addr.string = path,
-            .len = sizeof path,
-        },
-        { 0 },
-    };
+    out_len = 0;
+    while (out_len < chunk_len) {
+        eof = fs_mgmt_dl_comp.file_off == fs_mgmt_dl_comp.file_len;
+        produced = mcumgr_hs_enc_poll(&fs_mgmt_dl_comp.enc,
+                                      fs_mgmt_dl_comp.prev_data + out_len,
+                                      chunk_len - out_len, eof);
+        out_len += produced;
 
-    off = ULLONG_MAX;
-    rc = cbor_read_object(&ctxt->it, dload_attr);
-    if (rc != 0 || off == ULLONG_MAX) {
-        return MGMT_ERR_EINVAL;
+        if (eof) {
+            if (produced == 0 || mcumgr_hs_enc_done(&fs_mgmt_dl_comp.enc)) {
+                break;
+            }
+            continue;
+        }
+
+        rc = fs_mgmt_impl_read(fs_mgmt_dl_comp.path, fs_mgmt_dl_comp.file_off,
+                               sizeof buf, buf, &bytes_read);
+        if (rc != 0) {
+            return rc;
+        }
+        if (bytes_read == 0) {
+            /* The file shrank; end the stream here. */
+            fs_mgmt_dl_comp.file_len = fs_mgmt_dl_comp.file_off;
+            continue;
+        }
+
+        /* Whatever the encoder does not take is read again next time. */
+        accepted = mcumgr_hs_enc_sink(&fs_mgmt_dl_comp.enc, buf, bytes_read);
+        fs_mgmt_dl_comp.file_off += accepted;
+        if (accepted == 0 && produced == 0) {
+            break;
+        }
     }
 
-    /* Only the response to the first download request contains the total file
-     * length.
-     */
+    fs_mgmt_dl_comp.prev_off = fs_mgmt_dl_comp.off;
+    fs_mgmt_dl_comp.prev_len = out_len;
+    fs_mgmt_dl_comp.off += out_len;
+
+    return 0;
+}
+
+/**
+ * Handles a compressed download request.  "off" refers to the compressed
+ * stream; the response also carries "foff", the amount of the file that has
+ * been compressed, and, with the last chunk, "clen", the length of the
+ * compressed stream.  Only the next chunk or a retransmission of the last one
+ * can be requested.
+ */
+static int
+fs_mgmt_file_download_comp(struct mgmt_ctxt *ctxt, const char *path,
+                           unsigned long long off)
+{
+    CborError err;
+    bool done;
+    int rc;
+
     if (off == 0) {
-        rc = fs_mgmt_impl_filelen(path, &file_len);
+        rc = fs_mgmt_impl_filelen(path, &fs_mgmt_dl_comp.file_len);
         if (rc != 0) {
             return rc;
         }
+
+        strcpy(fs_mgmt_dl_comp.path, path);
+        fs_mgmt_dl_comp.file_off = 0;
+        fs_mgmt_dl_comp.off = 0;
+        mcumgr_hs_enc_init(&fs_mgmt_dl_comp.enc);
+    } else if (strcmp(path, fs_mgmt_dl_comp.path) != 0) {
+        return MGMT_ERR_EINVAL;
     }
 
-    /* Read the requested chunk from the file. */
-    rc = fs_mgmt_impl_read(path, off, FS_MGMT_DL_CHUNK_SIZE,
-                           file_data, &bytes_read);
-    if (rc != 0) {
-        return rc;
+    if (off == fs_mgmt_dl_comp.off) {
+        rc = fs_mgmt_file_download_comp_fill(
+            mgmt_rsp_chunk_size(ctxt, FS_MGMT_DL_RSP_OVERHEAD,
+                                sizeof fs_mgmt_dl_comp.prev_data));
+        if (rc != 0) {
+            fs_mgmt_dl_comp.path[0] = '\0';
+            return rc;
+        }
+    } else if (off != fs_mgmt_dl_comp.prev_off) {
+        return MGMT_ERR_EINVAL;
     }
 
-    /* Encode the response. */
+    done = fs_mgmt_dl_comp.file_off == fs_mgmt_dl_comp.file_len &&
+           mcumgr_hs_enc_done(&fs_mgmt_dl_comp.enc);
+
     err = 0;
     err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
     err |= cbor_encode_uint(&ctxt->encoder, off);
     err |= cbor_encode_text_stringz(&ctxt->encoder, "data");
-    err |= cbor_encode_byte_string(&ctxt->encoder, file_data, bytes_read);
+    err |= cbor_encode_byte_string(&ctxt->encoder, fs_mgmt_dl_comp.prev_data,
+                                   fs_mgmt_dl_comp.prev_len);
     err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
     err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "foff");
+    err |= cbor_encode_uint(&ctxt->encoder, fs_mgmt_dl_comp.file_off);
     if (off == 0) {
         err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
-        err |= cbor_encode_uint(&ctxt->encoder, file_len);
+        err |= cbor_encode_uint(&ctxt->encoder, fs_mgmt_dl_comp.file_len);
+    }
+    if (done) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "clen");
+        err |= cbor_encode_uint(&ctxt->encoder, fs_mgmt_dl_comp.off);
     }
 
     if (err != 0) {
@@ -126,125 +415,1185 @@ fs_mgmt_file_download(struct mgmt_ctxt *ctxt)
 
     return 0;
 }
+#endif
 
 /**
- * Encodes a file upload response.
+ * Reads the file chunk at the specified offset and encodes it into the
+ * response.  The file length is included if the offset is 0.
+ *
+ * @param chunk_len             The number of file bytes to send.
+ * @param out_len               On success, the number of file bytes sent.
  */
 static int
-fs_mgmt_file_upload_rsp(struct mgmt_ctxt *ctxt, int rc, unsigned long long off)
+fs_mgmt_file_download_chunk(struct mgmt_ctxt *ctxt, const char *path,
+                            unsigned long long off, size_t chunk_len,
+                            size_t *out_len)
 {
+    uint8_t file_data[FS_MGMT_DL_CHUNK_SIZE];
     CborError err;
+    size_t bytes_read;
+    size_t file_len;
+    int rc;
+
+    /* Only the response to the first download request contains the total file
+     * length.
+     */
+    if (off == 0) {
+        rc = fs_mgmt_impl_filelen(path, &file_len);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    /* Read the requested chunk from the file. */
+    rc = fs_mgmt_impl_read(path, off, chunk_len, file_data, &bytes_read);
+    if (rc != 0) {
+        return rc;
+    }
 
+    /* Encode the response. */
     err = 0;
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
-    err |= cbor_encode_int(&ctxt->encoder, rc);
     err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
     err |= cbor_encode_uint(&ctxt->encoder, off);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "data");
+    err |= cbor_encode_byte_string(&ctxt->encoder, file_data, bytes_read);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    if (off == 0) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+        err |= cbor_encode_uint(&ctxt->encoder, file_len);
+    }
 
     if (err != 0) {
         return MGMT_ERR_ENOMEM;
     }
 
+    *out_len = bytes_read;
     return 0;
 }
 
 /**
- * Command handler: fs file (write)
+ * Command handler: fs file (read)
+ *
+ * With "comp", the file is sent as a compressed stream.  With "win", up to
+ * that many consecutive chunks are sent, each in its own response; the client
+ * requests the next window from the offset following the last chunk it got.
  */
 static int
-fs_mgmt_file_upload(struct mgmt_ctxt *ctxt)
+fs_mgmt_file_download(struct mgmt_ctxt *ctxt)
 {
-    uint8_t file_data[FS_MGMT_UL_CHUNK_SIZE];
-    char file_name[FS_MGMT_PATH_SIZE + 1];
-    unsigned long long len;
+    char *path = fs_mgmt_path;
+    unsigned long long comp;
+    unsigned long long win;
     unsigned long long off;
-    size_t data_len;
-    size_t new_off;
+    size_t bytes_read;
+    size_t chunk_len;
     int rc;
 
-    const struct cbor_attr_t uload_attr[5] = {
-        [0] = {
+    const struct cbor_attr_t dload_attr[] = {
+        {
             .attribute = "off",
             .type = CborAttrUnsignedIntegerType,
             .addr.uinteger = &off,
-            .nodefault = true
         },
-        [1] = {
-            .attribute = "data",
-            .type = CborAttrByteStringType,
-            .addr.bytestring.data = file_data,
-            .addr.bytestring.len = &data_len,
-            .len = sizeof(file_data)
+        {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = path,
+            .len = sizeof fs_mgmt_path,
         },
-        [2] = {
-            .attribute = "len",
+        {
+            .attribute = "comp",
             .type = CborAttrUnsignedIntegerType,
-            .addr.uinteger = &len,
-            .nodefault = true
+            .addr.uinteger = &comp,
+            .nodefault = true,
         },
-        [3] = {
-            .attribute = "name",
-            .type = CborAttrTextStringType,
-            .addr.string = file_name,
-            .len = sizeof(file_name)
+        {
+            .attribute = "win",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &win,
+            .nodefault = true,
         },
-        [4] = { 0 },
+        { 0 },
     };
 
-    len = ULLONG_MAX;
+    comp = MGMT_COMP_NONE;
+    win = 1;
     off = ULLONG_MAX;
-    rc = cbor_read_object(&ctxt->it, uload_attr);
-    if (rc != 0 || off == ULLONG_MAX || file_name[0] == '\0') {
+    path[0] = '\0';
+    rc = cbor_read_object(&ctxt->it, dload_attr);
+    if (rc != 0 || off == ULLONG_MAX || path[0] == '\0') {
         return MGMT_ERR_EINVAL;
     }
 
-    if (off == 0) {
-        /* Total file length is a required field in the first chunk request. */
-        if (len == ULLONG_MAX) {
-            return MGMT_ERR_EINVAL;
-        }
-
-        fs_mgmt_ctxt.uploading = true;
-        fs_mgmt_ctxt.off = 0;
-        fs_mgmt_ctxt.len = len;
-    } else {
-        if (!fs_mgmt_ctxt.uploading) {
-            return MGMT_ERR_EINVAL;
-        }
-        
-        if (off != fs_mgmt_ctxt.off) {
-            /* Invalid offset.  Drop the data and send the expected offset. */
-            return fs_mgmt_file_upload_rsp(ctxt, MGMT_ERR_EINVAL,
-                                           fs_mgmt_ctxt.off);
+    if (comp != MGMT_COMP_NONE) {
+#if FS_MGMT_DL_COMP
+        if (comp == MGMT_COMP_HS) {
+            return fs_mgmt_file_download_comp(ctxt, path, off);
         }
+#endif
+        return MGMT_ERR_ENOTSUP;
     }
 
-    new_off = fs_mgmt_ctxt.off + data_len;
-    if (new_off > fs_mgmt_ctxt.len) {
-        /* Data exceeds image length. */
+    if (win == 0) {
         return MGMT_ERR_EINVAL;
     }
+    if (win > FS_MGMT_DL_WIN_MAX) {
+        win = FS_MGMT_DL_WIN_MAX;
+    }
 
-    if (data_len > 0) {
-        /* Write the data chunk to the file. */
-        rc = fs_mgmt_impl_write(file_name, off, file_data, data_len);
+    /* Fill the transport's packets rather than assume the smallest one. */
+    chunk_len = mgmt_rsp_chunk_size(ctxt, FS_MGMT_DL_RSP_OVERHEAD,
+                                    FS_MGMT_DL_CHUNK_SIZE);
+
+    while (1) {
+        rc = fs_mgmt_file_download_chunk(ctxt, path, off, chunk_len,
+                                         &bytes_read);
+        if (rc != 0) {
+            return rc;
+        }
+
+        /* A short chunk means the end of the file has been reached. */
+        win--;
+        if (win == 0 || bytes_read < chunk_len) {
+            return 0;
+        }
+
+        /* Send this chunk and continue with the next one in a new response.
+         * If the transport cannot do that, the client gets one chunk per
+         * request as usual.
+         */
+        rc = mgmt_flush_rsp(ctxt);
+        if (rc == MGMT_ERR_ENOTSUP) {
+            return 0;
+        }
         if (rc != 0) {
             return rc;
         }
-        fs_mgmt_ctxt.off = new_off;
+        off += bytes_read;
     }
+}
 
-    if (fs_mgmt_ctxt.off == fs_mgmt_ctxt.len) {
-        /* Upload complete. */
-        fs_mgmt_ctxt.uploading = false;
+/**
+ * Encodes a file upload response.
+ */
+static int
+fs_mgmt_file_upload_rsp(struct mgmt_ctxt *ctxt, int rc,
+                        unsigned long long off, unsigned long long sid)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, rc);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_uint(&ctxt->encoder, off);
+    if (sid != ULLONG_MAX) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "sid");
+        err |= cbor_encode_uint(&ctxt->encoder, sid);
     }
 
-    /* Send the response. */
-    return fs_mgmt_file_upload_rsp(ctxt, 0, fs_mgmt_ctxt.off);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/** Destination of the pieces of an uploaded chunk. */
+struct fs_mgmt_ul_piece {
+    struct fs_mgmt_ul *ul;
+    const char *path;
+    size_t off;
+};
+
+#if FS_MGMT_UL_COMP
+/**
+ * Decompresses a piece of a compressed upload and writes the result to the
+ * specified file.
+ */
+static int
+fs_mgmt_file_upload_decode(struct fs_mgmt_ul *ul, const char *path,
+                           const uint8_t *data, size_t len)
+{
+    uint8_t buf[FS_MGMT_UL_BOUNCE_SIZE];
+    size_t consumed;
+    size_t produced;
+    int rc;
+
+    do {
+        produced = mcumgr_hs_dec_run(&ul->dec, data, len, &consumed,
+                                     buf, sizeof buf);
+        data += consumed;
+        len -= consumed;
+
+        if (produced > 0) {
+            rc = fs_mgmt_impl_write(path, ul->file_off, buf,
+                                    produced);
+            if (rc != 0) {
+                return rc;
+            }
+            ul->file_off += produced;
+        }
+    } while (len > 0 || produced > 0);
+
+    return 0;
+}
+
+/** Decompresses a piece of a compressed upload chunk; see below. */
+static int
+fs_mgmt_file_upload_decode_piece(const uint8_t *data, size_t off, size_t len,
+                                 void *arg)
+{
+    struct fs_mgmt_ul_piece *piece = arg;
+
+    return fs_mgmt_file_upload_decode(piece->ul, piece->path, data, len);
+}
+#endif
+
+/** Writes a piece of an uploaded chunk; see fs_mgmt_file_upload_write(). */
+static int
+fs_mgmt_file_upload_write_piece(const uint8_t *data, size_t off, size_t len,
+                                void *arg)
+{
+    struct fs_mgmt_ul_piece *piece = arg;
+
+    if (piece->ul->patch) {
+        return fs_mgmt_impl_patch(piece->path, piece->off + off, data, len);
+    } else {
+        return fs_mgmt_impl_write(piece->path, piece->off + off, data, len);
+    }
+}
+
+/**
+ * Writes an uploaded chunk to the specified file.  The chunk is written
+ * directly from the request buffer if it is contiguous; otherwise it is
+ * written in pieces, each in place where possible and through a small bounce
+ * buffer where not.  A chunk can thus be larger than the bounce buffer, and
+ * may be sent as a chunked byte string.
+ */
+static int
+fs_mgmt_file_upload_write(struct fs_mgmt_ul *ul, const char *path,
+                          size_t off, const struct cbor_bytestring_ref *data)
+{
+    uint8_t buf[FS_MGMT_UL_BOUNCE_SIZE];
+    struct fs_mgmt_ul_piece piece = {
+        .ul = ul,
+        .path = path,
+        .off = off,
+    };
+    cbor_bytestring_chunk_fn *cb;
+
+    cb = fs_mgmt_file_upload_write_piece;
+#if FS_MGMT_UL_COMP
+    if (ul->comp) {
+        cb = fs_mgmt_file_upload_decode_piece;
+    }
+#endif
+
+    if (data->data != NULL) {
+        return cb(data->data, 0, data->len, &piece);
+    }
+
+    return cbor_bytestring_ref_foreach(data, buf, sizeof buf, cb, &piece);
+}
+
+/**
+ * Handles a request of a patch upload, which overwrites chunks of an existing
+ * file in place.  The first request starts the patch and must contain the
+ * final length of the file in "len".
+ */
+static int
+fs_mgmt_file_upload_patch(struct mgmt_ctxt *ctxt, const char *file_name,
+                          size_t off, unsigned long long len,
+                          unsigned long long sid,
+                          const struct cbor_bytestring_ref *file_data)
+{
+    struct fs_mgmt_ul *ul;
+    int rc;
+
+    ul = fs_mgmt_ul_get(ctxt, sid == ULLONG_MAX ? 0 : sid, true);
+    if (!ul->uploading || !ul->patch || strcmp(ul->path, file_name) != 0) {
+        if (len == ULLONG_MAX || len > SIZE_MAX) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        ul->uploading = true;
+        ul->patch = true;
+        ul->off = 0;
+        ul->len = len;
+        ul->unsynced = 0;
+        strcpy(ul->path, file_name);
+#if FS_MGMT_UL_COMP
+        ul->comp = false;
+#endif
+    } else if (len != ULLONG_MAX && len != ul->len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (off > ul->len || file_data->len > ul->len - off) {
+        /* Data exceeds file length. */
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (file_data->len > 0) {
+        rc = fs_mgmt_file_upload_write(ul, file_name, off, file_data);
+        if (rc != 0) {
+            return rc;
+        }
+        ul->off = off + file_data->len;
+        ul->unsynced += file_data->len;
+    }
+
+    if (ul->unsynced >= FS_MGMT_UL_SYNC_BYTES) {
+        rc = fs_mgmt_impl_sync(file_name);
+        if (rc != 0) {
+            return rc;
+        }
+        ul->unsynced = 0;
+    }
+
+    return fs_mgmt_file_upload_rsp(ctxt, 0, ul->off, sid);
+}
+
+/**
+ * Command handler: fs file (write)
+ *
+ * With "comp" in the first request, the file is uploaded compressed; "off"
+ * and "len" then describe the compressed stream.
+ *
+ * A client can have several uploads in progress by giving each an ID in
+ * "sid", which is then echoed in the responses.  Requests without one belong
+ * to upload 0.
+ *
+ * With "patch" set in every request, the upload keeps the existing contents
+ * of the file and writes each chunk at its "off", in any order; "len" is the
+ * final length of the file.  The patch is finished by a commit, which cuts
+ * the file down to that length.
+ */
+static int
+fs_mgmt_file_upload(struct mgmt_ctxt *ctxt)
+{
+    struct cbor_bytestring_ref file_data;
+    char *file_name = fs_mgmt_path;
+    struct fs_mgmt_ul *ul;
+    unsigned long long comp;
+    unsigned long long len;
+    unsigned long long off;
+    unsigned long long sid;
+    size_t data_len;
+    size_t new_off;
+    bool patch;
+    int rc;
+
+    const struct cbor_attr_t uload_attr[8] = {
+        [0] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+            .nodefault = true
+        },
+        [1] = {
+            .attribute = "data",
+            .type = CborAttrByteStringRefType,
+            .addr.bytestring_ref = &file_data,
+            .len = FS_MGMT_UL_CHUNK_SIZE
+        },
+        [2] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &len,
+            .nodefault = true
+        },
+        [3] = {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = file_name,
+            .len = sizeof fs_mgmt_path
+        },
+        [4] = {
+            .attribute = "comp",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &comp,
+            .nodefault = true
+        },
+        [5] = {
+            .attribute = "sid",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &sid,
+            .nodefault = true
+        },
+        [6] = {
+            .attribute = "patch",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &patch,
+            .nodefault = true
+        },
+        [7] = { 0 },
+    };
+    CBORATTR_INDEX_DEFINE(uload_attr_index);
+
+    comp = MGMT_COMP_NONE;
+    len = ULLONG_MAX;
+    off = ULLONG_MAX;
+    sid = ULLONG_MAX;
+    patch = false;
+    file_name[0] = '\0';
+    rc = cbor_read_object_indexed(&ctxt->it, uload_attr, &uload_attr_index);
+    if (rc != 0 || off == ULLONG_MAX || file_name[0] == '\0' ||
+        (sid != ULLONG_MAX && sid > UINT32_MAX)) {
+        return MGMT_ERR_EINVAL;
+    }
+    data_len = file_data.len;
+
+    if (patch) {
+        if (comp != MGMT_COMP_NONE) {
+            return MGMT_ERR_ENOTSUP;
+        }
+        if (off > SIZE_MAX) {
+            return MGMT_ERR_EINVAL;
+        }
+        return fs_mgmt_file_upload_patch(ctxt, file_name, off, len, sid,
+                                         &file_data);
+    }
+
+    if (off == 0) {
+        /* Total file length is a required field in the first chunk request. */
+        if (len == ULLONG_MAX) {
+            return MGMT_ERR_EINVAL;
+        }
+
+#if FS_MGMT_UL_COMP
+        if (comp != MGMT_COMP_NONE && comp != MGMT_COMP_HS) {
+            return MGMT_ERR_ENOTSUP;
+        }
+#else
+        if (comp != MGMT_COMP_NONE) {
+            return MGMT_ERR_ENOTSUP;
+        }
+#endif
+
+        ul = fs_mgmt_ul_get(ctxt, sid == ULLONG_MAX ? 0 : sid, true);
+        ul->uploading = true;
+        ul->patch = false;
+        ul->off = 0;
+        ul->len = len;
+        ul->unsynced = 0;
+        strcpy(ul->path, file_name);
+
+#if FS_MGMT_UL_COMP
+        ul->comp = comp != MGMT_COMP_NONE;
+        ul->file_off = 0;
+        mcumgr_hs_dec_init(&ul->dec);
+#endif
+    } else {
+        ul = fs_mgmt_ul_get(ctxt, sid == ULLONG_MAX ? 0 : sid, false);
+        if (ul == NULL || !ul->uploading || ul->patch) {
+            return MGMT_ERR_EINVAL;
+        }
+        
+        if (off != ul->off) {
+            /* Invalid offset.  Drop the data and send the expected offset. */
+            return fs_mgmt_file_upload_rsp(ctxt, MGMT_ERR_EINVAL,
+                                           ul->off, sid);
+        }
+    }
+
+    new_off = ul->off + data_len;
+    if (new_off > ul->len) {
+        /* Data exceeds image length. */
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (data_len > 0) {
+        /* Write the data chunk to the file. */
+        rc = fs_mgmt_file_upload_write(ul, file_name, off, &file_data);
+        if (rc != 0) {
+            return rc;
+        }
+        ul->off = new_off;
+        ul->unsynced += data_len;
+    }
+
+    if (ul->off == ul->len) {
+        /* Upload complete. */
+        ul->uploading = false;
+    }
+
+    if (ul->unsynced > 0 &&
+        (!ul->uploading ||
+         ul->unsynced >= FS_MGMT_UL_SYNC_BYTES)) {
+
+        rc = fs_mgmt_impl_sync(file_name);
+        if (rc != 0) {
+            return rc;
+        }
+        ul->unsynced = 0;
+    }
+
+    /* Send the response. */
+    return fs_mgmt_file_upload_rsp(ctxt, 0, ul->off, sid);
+}
+
+/**
+ * Command handler: fs commit (write)
+ *
+ * Syncs all data received so far for the upload in progress, or for the one
+ * named by "sid".  The response contains the offset up to which the file is
+ * durable.  A patch upload is finished by this: the file is cut down to its
+ * final length and the response contains that length.
+ */
+static int
+fs_mgmt_file_commit(struct mgmt_ctxt *ctxt)
+{
+    unsigned long long sid;
+    struct fs_mgmt_ul *ul;
+    int rc;
+
+    const struct cbor_attr_t commit_attr[2] = {
+        [0] = {
+            .attribute = "sid",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &sid,
+            .nodefault = true
+        },
+        [1] = { 0 },
+    };
+
+    sid = ULLONG_MAX;
+    rc = cbor_read_object(&ctxt->it, commit_attr);
+    if (rc != 0 || (sid != ULLONG_MAX && sid > UINT32_MAX)) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    ul = fs_mgmt_ul_get(ctxt, sid == ULLONG_MAX ? 0 : sid, false);
+    if (ul == NULL) {
+        return fs_mgmt_file_upload_rsp(ctxt, 0, 0, sid);
+    }
+
+    if (!ul->uploading) {
+        /* Completed uploads are synced already. */
+        return fs_mgmt_file_upload_rsp(ctxt, 0, ul->off, sid);
+    }
+
+    if (ul->unsynced > 0) {
+        rc = fs_mgmt_impl_sync(ul->path);
+        if (rc != 0) {
+            return rc;
+        }
+        ul->unsynced = 0;
+    }
+
+    if (ul->patch) {
+        rc = fs_mgmt_impl_truncate(ul->path, ul->len);
+        if (rc != 0) {
+            return rc;
+        }
+        ul->uploading = false;
+        ul->off = ul->len;
+    }
+
+    return fs_mgmt_file_upload_rsp(ctxt, 0, ul->off, sid);
+}
+
+/** State of a directory listing being encoded. */
+struct fs_mgmt_dir_ctxt {
+    struct CborEncoder ents;
+
+    /** Bytes of the response body that entries may take up. */
+    size_t budget;
+
+    /** Worst-case size of the entries encoded so far. */
+    size_t used;
+
+    uint32_t count;
+    bool more;
+};
+
+static int
+fs_mgmt_dir_list_cb(const struct fs_mgmt_dirent *dirent, void *arg)
+{
+    struct fs_mgmt_dir_ctxt *dc;
+    struct CborEncoder ent;
+    CborError err;
+    size_t len;
+
+    dc = arg;
+
+    len = FS_MGMT_DIR_ENT_OVERHEAD + strlen(dirent->name);
+    if (dc->used + len > dc->budget) {
+        dc->more = true;
+        return 1;
+    }
+
+    err = 0;
+    err |= cbor_encoder_create_map(&dc->ents, &ent, 3);
+    err |= cbor_encode_text_stringz(&ent, "n");
+    err |= cbor_encode_text_stringz(&ent, dirent->name);
+    err |= cbor_encode_text_stringz(&ent, "s");
+    err |= cbor_encode_uint(&ent, dirent->size);
+    err |= cbor_encode_text_stringz(&ent, "t");
+    err |= cbor_encode_uint(&ent, dirent->is_dir);
+    err |= cbor_encoder_close_container(&dc->ents, &ent);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    dc->used += len;
+    dc->count++;
+
+    return 0;
+}
+
+/**
+ * Command handler: fs dir (read)
+ *
+ * Lists the directory in "name".  The response carries the entries in
+ * "ents", each with its name ("n"), size ("s"), and type ("t": 0 for a file,
+ * 1 for a directory).  If they do not all fit, "next" is included; passing
+ * it as "cur" in the next request continues the listing.
+ */
+static int
+fs_mgmt_dir_list(struct mgmt_ctxt *ctxt)
+{
+    char *path = fs_mgmt_path;
+    struct fs_mgmt_dir_ctxt dc;
+    unsigned long long cur;
+    CborError err;
+    int rc;
+
+    const struct cbor_attr_t dir_attr[3] = {
+        [0] = {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = path,
+            .len = sizeof fs_mgmt_path,
+        },
+        [1] = {
+            .attribute = "cur",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &cur,
+        },
+        [2] = { 0 },
+    };
+
+    cur = 0;
+    path[0] = '\0';
+    rc = cbor_read_object(&ctxt->it, dir_attr);
+    if (rc != 0 || path[0] == '\0' || cur > UINT32_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    dc = (struct fs_mgmt_dir_ctxt) {
+        .budget = mgmt_rsp_chunk_size(ctxt, FS_MGMT_DIR_RSP_OVERHEAD,
+                                      FS_MGMT_DIR_RSP_MAX),
+    };
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "ents");
+    err |= cbor_encoder_create_array(&ctxt->encoder, &dc.ents,
+                                     CborIndefiniteLength);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    rc = fs_mgmt_impl_readdir(path, cur, fs_mgmt_dir_list_cb, &dc);
+    if (rc != 0 && !dc.more) {
+        return rc;
+    }
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &dc.ents);
+    if (dc.more) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "next");
+        err |= cbor_encode_uint(&ctxt->encoder, cur + dc.count);
+    }
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: fs stat (read)
+ *
+ * Retrieves the length of each file listed in "names".  The response holds
+ * one map per path in "st", in request order, with either the length ("len")
+ * or the error that occurred ("rc").
+ */
+static int
+fs_mgmt_stat(struct mgmt_ctxt *ctxt)
+{
+    char *path = fs_mgmt_path;
+    struct CborEncoder results;
+    struct CborEncoder result;
+    CborValue names;
+    CborValue name;
+    CborError err;
+    size_t file_len;
+    size_t len;
+    int count;
+    int rc;
+
+    if (cbor_value_map_find_value(&ctxt->it, "names", &names) != 0 ||
+        !cbor_value_is_array(&names)) {
+
+        return MGMT_ERR_EINVAL;
+    }
+
+    err = cbor_value_enter_container(&names, &name);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "st");
+    err |= cbor_encoder_create_array(&ctxt->encoder, &results,
+                                     CborIndefiniteLength);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    for (count = 0; !cbor_value_at_end(&name); count++) {
+        if (count >= FS_MGMT_STAT_MAX_PATHS ||
+            !cbor_value_is_text_string(&name)) {
+
+            return MGMT_ERR_EINVAL;
+        }
+
+        len = sizeof fs_mgmt_path;
+        err = cbor_value_copy_text_string(&name, path, &len, &name);
+        if (err != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        rc = fs_mgmt_impl_filelen(path, &file_len);
+
+        err |= cbor_encoder_create_map(&results, &result, 1);
+        if (rc == 0) {
+            err |= cbor_encode_text_stringz(&result, "len");
+            err |= cbor_encode_uint(&result, file_len);
+        } else {
+            err |= cbor_encode_text_stringz(&result, "rc");
+            err |= cbor_encode_int(&result, rc);
+        }
+        err |= cbor_encoder_close_container(&results, &result);
+        if (err != 0) {
+            return MGMT_ERR_ENOMEM;
+        }
+    }
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &results);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+static const uint32_t fs_mgmt_crc32_tbl[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+/**
+ * Adds data to an IEEE 802.3 CRC32 (as computed by zlib), a nibble at a
+ * time.  The CRC starts out as 0.
+ */
+static uint32_t
+fs_mgmt_crc32(uint32_t crc, const uint8_t *data, size_t len)
+{
+    size_t i;
+
+    crc = ~crc;
+    for (i = 0; i < len; i++) {
+        crc = fs_mgmt_crc32_tbl[(crc ^ data[i]) & 0x0f] ^ (crc >> 4);
+        crc = fs_mgmt_crc32_tbl[(crc ^ (data[i] >> 4)) & 0x0f] ^ (crc >> 4);
+    }
+
+    return ~crc;
+}
+
+static void
+fs_mgmt_put_le32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = val;
+    dst[1] = val >> 8;
+    dst[2] = val >> 16;
+    dst[3] = val >> 24;
+}
+
+/** Hashes of a range of a file. */
+struct fs_mgmt_hash_res {
+    /** Bytes hashed; fewer than requested if the file ended first. */
+    size_t len;
+
+    /** rsync rolling checksum: byte sum in the low half, weighted sum in the
+     *  high half.
+     */
+    uint32_t weak;
+
+    /** CRC32; only computed for FS_MGMT_HASH_TYPE_CRC32. */
+    uint32_t crc;
+
+#if FS_MGMT_HASH_SHA256
+    /** SHA-256; only computed for FS_MGMT_HASH_TYPE_SHA256. */
+    uint8_t sha256[FS_MGMT_SHA256_LEN];
+#endif
+};
+
+/**
+ * Parses the "type" of a hash request.  An empty name selects the default:
+ * SHA-256 if it is enabled, CRC32 otherwise.
+ */
+static int
+fs_mgmt_hash_type(const char *name, int *out_type)
+{
+    if (strcmp(name, "crc32") == 0 ||
+        (name[0] == '\0' && !FS_MGMT_HASH_SHA256)) {
+
+        *out_type = FS_MGMT_HASH_TYPE_CRC32;
+        return 0;
+    }
+
+    if (strcmp(name, "sha256") == 0 || name[0] == '\0') {
+#if FS_MGMT_HASH_SHA256
+        *out_type = FS_MGMT_HASH_TYPE_SHA256;
+        return 0;
+#else
+        return MGMT_ERR_ENOTSUP;
+#endif
+    }
+
+    return MGMT_ERR_EINVAL;
+}
+
+/**
+ * Hashes `len` bytes of a file starting at `off`, or up to its end if it is
+ * shorter.
+ */
+static int
+fs_mgmt_hash_range(const char *path, size_t off, size_t len, int type,
+                   struct fs_mgmt_hash_res *res)
+{
+    uint8_t buf[FS_MGMT_HASH_BUF_SIZE];
+    size_t chunk_len;
+    size_t bytes_read;
+    uint32_t a;
+    uint32_t b;
+    size_t i;
+    int rc;
+
+#if FS_MGMT_HASH_SHA256
+    if (type == FS_MGMT_HASH_TYPE_SHA256) {
+        rc = fs_mgmt_impl_sha256_start();
+        if (rc != 0) {
+            return rc;
+        }
+    }
+#endif
+
+    a = 0;
+    b = 0;
+    res->crc = 0;
+    rc = 0;
+    for (res->len = 0; res->len < len; res->len += bytes_read) {
+        chunk_len = sizeof buf;
+        if (len - res->len < chunk_len) {
+            chunk_len = len - res->len;
+        }
+
+        rc = fs_mgmt_impl_read(path, off + res->len, chunk_len, buf,
+                               &bytes_read);
+        if (rc != 0) {
+            break;
+        }
+        if (bytes_read == 0) {
+            /* End of file. */
+            break;
+        }
+
+        for (i = 0; i < bytes_read; i++) {
+            a += buf[i];
+            b += a;
+        }
+
+        if (type == FS_MGMT_HASH_TYPE_CRC32) {
+            res->crc = fs_mgmt_crc32(res->crc, buf, bytes_read);
+        } else {
+            rc = fs_mgmt_impl_sha256_update(buf, bytes_read);
+            if (rc != 0) {
+                break;
+            }
+        }
+    }
+    res->weak = (a & 0xffff) | (b << 16);
+
+#if FS_MGMT_HASH_SHA256
+    if (type == FS_MGMT_HASH_TYPE_SHA256) {
+        /* Always finish the hash so that its context is released. */
+        if (fs_mgmt_impl_sha256_finish(res->sha256) != 0 && rc == 0) {
+            rc = MGMT_ERR_EUNKNOWN;
+        }
+    }
+#endif
+
+    return rc;
+}
+
+/**
+ * Command handler: fs hash (read)
+ *
+ * Computes the hash of the file in "name", or of "len" bytes of it starting
+ * at "off".  "type" is "crc32" or, if FS_MGMT_HASH_SHA256 is enabled,
+ * "sha256", which is the default then.  The response carries the digest in
+ * "output", a byte string for SHA-256 and an integer for CRC32, along with
+ * the range that was actually hashed.
+ */
+static int
+fs_mgmt_hash(struct mgmt_ctxt *ctxt)
+{
+    struct fs_mgmt_hash_res res;
+    char *path = fs_mgmt_path;
+    char type_name[8];
+    unsigned long long off;
+    unsigned long long len;
+    CborError err;
+    int type;
+    int rc;
+
+    const struct cbor_attr_t hash_attr[5] = {
+        [0] = {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = path,
+            .len = sizeof fs_mgmt_path,
+        },
+        [1] = {
+            .attribute = "type",
+            .type = CborAttrTextStringType,
+            .addr.string = type_name,
+            .len = sizeof type_name,
+        },
+        [2] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+        },
+        [3] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &len,
+        },
+        [4] = { 0 },
+    };
+
+    type_name[0] = '\0';
+    off = 0;
+    len = SIZE_MAX;
+    path[0] = '\0';
+    rc = cbor_read_object(&ctxt->it, hash_attr);
+    if (rc != 0 || path[0] == '\0' || off > SIZE_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (len > SIZE_MAX) {
+        len = SIZE_MAX;
+    }
+
+    rc = fs_mgmt_hash_type(type_name, &type);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = fs_mgmt_hash_range(path, off, len, type, &res);
+    if (rc != 0) {
+        return rc;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "type");
+    err |= cbor_encode_text_stringz(&ctxt->encoder,
+                                    type == FS_MGMT_HASH_TYPE_CRC32 ?
+                                        "crc32" : "sha256");
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_uint(&ctxt->encoder, off);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+    err |= cbor_encode_uint(&ctxt->encoder, res.len);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "output");
+#if FS_MGMT_HASH_SHA256
+    if (type == FS_MGMT_HASH_TYPE_SHA256) {
+        err |= cbor_encode_byte_string(&ctxt->encoder, res.sha256,
+                                       sizeof res.sha256);
+    } else
+#endif
+    {
+        err |= cbor_encode_uint(&ctxt->encoder, res.crc);
+    }
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: fs sums (read)
+ *
+ * Returns the block checksums of the file in "name" for an rsync-style
+ * update: the file is cut into blocks of "bs" bytes and, for each block
+ * starting at block index "cur", "sums" holds a byte string with the rsync
+ * rolling checksum (4 bytes, little endian) followed by a strong checksum of
+ * the kind selected by "type": a little-endian CRC32, or the first
+ * FS_MGMT_SUMS_SHA256_LEN bytes of the SHA-256.  "next" is the index of the
+ * first block left out if the response could not hold them all.
+ *
+ * Changed blocks are then written with a patch upload (see
+ * fs_mgmt_file_upload()).
+ */
+static int
+fs_mgmt_sums(struct mgmt_ctxt *ctxt)
+{
+    struct fs_mgmt_hash_res res;
+    struct CborEncoder sums;
+    char *path = fs_mgmt_path;
+    char type_name[8];
+    uint8_t ent[4 + FS_MGMT_SUMS_SHA256_LEN];
+    unsigned long long cur;
+    unsigned long long bs;
+    size_t file_len;
+    size_t ent_len;
+    size_t count;
+    size_t off;
+    size_t i;
+    CborError err;
+    int type;
+    int rc;
+
+    const struct cbor_attr_t sums_attr[5] = {
+        [0] = {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = path,
+            .len = sizeof fs_mgmt_path,
+        },
+        [1] = {
+            .attribute = "type",
+            .type = CborAttrTextStringType,
+            .addr.string = type_name,
+            .len = sizeof type_name,
+        },
+        [2] = {
+            .attribute = "bs",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &bs,
+        },
+        [3] = {
+            .attribute = "cur",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &cur,
+        },
+        [4] = { 0 },
+    };
+
+    type_name[0] = '\0';
+    bs = 0;
+    cur = 0;
+    path[0] = '\0';
+    rc = cbor_read_object(&ctxt->it, sums_attr);
+    if (rc != 0 || path[0] == '\0' ||
+        bs < FS_MGMT_SUMS_BS_MIN || bs > FS_MGMT_SUMS_BS_MAX) {
+
+        return MGMT_ERR_EINVAL;
+    }
+
+    rc = fs_mgmt_hash_type(type_name, &type);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = fs_mgmt_impl_filelen(path, &file_len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    /* Fit as many blocks as the response has room for. */
+    ent_len = 4;
+    if (type == FS_MGMT_HASH_TYPE_CRC32) {
+        ent_len += 4;
+    } else {
+        ent_len += FS_MGMT_SUMS_SHA256_LEN;
+    }
+    count = mgmt_rsp_chunk_size(ctxt, FS_MGMT_SUMS_RSP_OVERHEAD,
+                                FS_MGMT_SUMS_RSP_MAX) / (ent_len + 1);
+    if (count == 0) {
+        count = 1;
+    }
+
+    if (cur >= (file_len + bs - 1) / bs) {
+        cur = (file_len + bs - 1) / bs;
+        count = 0;
+    } else if (count > (file_len + bs - 1) / bs - cur) {
+        count = (file_len + bs - 1) / bs - cur;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+    err |= cbor_encode_uint(&ctxt->encoder, file_len);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "bs");
+    err |= cbor_encode_uint(&ctxt->encoder, bs);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "type");
+    err |= cbor_encode_text_stringz(&ctxt->encoder,
+                                    type == FS_MGMT_HASH_TYPE_CRC32 ?
+                                        "crc32" : "sha256");
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "sums");
+    err |= cbor_encoder_create_array(&ctxt->encoder, &sums, count);
+
+    off = cur * bs;
+    for (i = 0; i < count; i++) {
+        rc = fs_mgmt_hash_range(path, off, bs, type, &res);
+        if (rc != 0) {
+            return rc;
+        }
+        off += res.len;
+
+        fs_mgmt_put_le32(ent, res.weak);
+#if FS_MGMT_HASH_SHA256
+        if (type == FS_MGMT_HASH_TYPE_SHA256) {
+            memcpy(ent + 4, res.sha256, FS_MGMT_SUMS_SHA256_LEN);
+        } else
+#endif
+        {
+            fs_mgmt_put_le32(ent + 4, res.crc);
+        }
+        err |= cbor_encode_byte_string(&sums, ent, ent_len);
+    }
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &sums);
+    if (off < file_len) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "next");
+        err |= cbor_encode_uint(&ctxt->encoder, cur + count);
+    }
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
 }
 
 void
 fs_mgmt_register_group(void)
 {
+#if !MGMT_STATIC_GROUPS
     mgmt_register_group(&fs_mgmt_group);
+#endif
 }
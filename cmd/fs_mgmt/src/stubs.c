@@ -44,3 +44,53 @@ fs_mgmt_impl_write(const char *path, size_t offset, const void *data,
 {
     return MGMT_ERR_ENOTSUP;
 }
+
+int __attribute__((weak))
+fs_mgmt_impl_patch(const char *path, size_t offset, const void *data,
+                   size_t len)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+fs_mgmt_impl_truncate(const char *path, size_t len)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+fs_mgmt_impl_sync(const char *path)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+fs_mgmt_impl_rename(const char *from, const char *to)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+fs_mgmt_impl_sha256_start(void)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+fs_mgmt_impl_sha256_update(const void *data, size_t len)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+fs_mgmt_impl_sha256_finish(uint8_t *digest)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
+int __attribute__((weak))
+fs_mgmt_impl_readdir(const char *path, uint32_t skip,
+                     fs_mgmt_dirent_fn *cb, void *arg)
+{
+    return MGMT_ERR_ENOTSUP;
+}
@@ -54,7 +54,7 @@ struct __attribute__((packed)) image_header {
     uint32_t ih_magic;
     uint64_t ih_load_addr;
     uint16_t ih_hdr_size; /* Size of image header (bytes). */
-    uint16_t _pad2;
+    uint16_t ih_protect_tlv_size; /* Size of protected TLV area (bytes). */
     uint32_t ih_img_size; /* Does not include header. */
     uint32_t ih_flags;    /* IMAGE_F_[...]. */
     struct image_version ih_ver;
@@ -23,6 +23,9 @@
 #include <inttypes.h>
 #include "img_mgmt_config.h"
 #include "mgmt/mgmt.h"
+#if IMG_MGMT_UL_COMP
+#include "util/mcumgr_hs.h"
+#endif
 
 struct image_version;
 
@@ -44,6 +47,12 @@ extern "C" {
 
 #define IMG_MGMT_VER_MAX_STR_LEN    25  /* 255.255.65535.4294967295\0 */
 
+/* The image the specified slot belongs to. */
+#define IMG_MGMT_SLOT_IMAGE(slot)               ((slot) / 2)
+
+/* The primary (0) or secondary (1) slot of the specified image. */
+#define IMG_MGMT_IMAGE_SLOT(image, secondary)   ((image) * 2 + (secondary))
+
 /*
  * Swap Types for image management state machine
  */
@@ -61,6 +70,10 @@ extern "C" {
 #define IMG_MGMT_ID_CORELIST        3
 #define IMG_MGMT_ID_CORELOAD        4
 #define IMG_MGMT_ID_ERASE           5
+#define IMG_MGMT_ID_DELTA           6
+#define IMG_MGMT_ID_VERIFY          7
+#define IMG_MGMT_ID_DOWNLOAD        8
+#define IMG_MGMT_ID_MCAST           9
 
 /*
  * IMG_MGMT_ID_UPLOAD statuses.
@@ -72,16 +85,27 @@ extern "C" {
 extern int boot_current_slot;
 extern struct img_mgmt_state g_img_mgmt_state;
 
+/* Epoch of the image state read; incremented whenever the slot metadata or
+ * state flags are invalidated.
+ */
+extern volatile uint32_t img_mgmt_state_epoch;
+
 /** Represents an individual upload request. */
 struct img_mgmt_upload_req {
     unsigned long long int image;   /* 0 by default */
     unsigned long long int off;     /* -1 if unspecified */
     unsigned long long int size;    /* -1 if unspecified */
+    unsigned long long int win;     /* 0 if unspecified */
+    unsigned long long int win_unit; /* 0 if unspecified */
     size_t data_len;
     size_t data_sha_len;
-    uint8_t img_data[IMG_MGMT_UL_CHUNK_SIZE];
+    const uint8_t *img_data;        /* Points into the request buffer. */
     uint8_t data_sha[IMG_MGMT_DATA_SHA_LEN];
     bool upgrade;                   /* Only allow greater version numbers. */
+#if IMG_MGMT_UL_COMP
+    unsigned long long int comp;    /* MGMT_COMP_NONE by default */
+    unsigned long long int dlen;    /* -1 if unspecified */
+#endif
 };
 
 /** Global state for upload in progress. */
@@ -99,8 +123,72 @@ struct img_mgmt_state {
     int sector_id;
     uint32_t sector_end;
 #endif
+#if IMG_MGMT_WRITE_ALIGN_MAX > 0
+    /** Received bytes ending at `off` that are not yet written to flash. */
+    uint8_t carry_len;
+    uint8_t carry[IMG_MGMT_WRITE_ALIGN_MAX];
+#endif
+#if IMG_MGMT_UL_COMP
+    /** Size of the compressed stream; 0 if the upload is not compressed. */
+    uint32_t comp_size;
+    /** Offset of the next expected chunk of the compressed stream. */
+    uint32_t comp_off;
+    struct mcumgr_hs_dec comp_dec;
+#endif
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+    /** Negotiated number of chunks buffered ahead of `off`; 0 if disabled. */
+    uint8_t win;
+    /** Chunk size that bits in the ack bitmap refer to, as given by the
+     * client with "wu".
+     */
+    uint32_t win_unit;
+#endif
+};
+
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+/**
+ * Persisted record of an upload in progress, from which the upload can be
+ * resumed after a reset.
+ */
+struct img_mgmt_journal {
+    /** Flash area being written. */
+    int32_t area_id;
+    /** Number of leading image bytes that are known to be in flash. */
+    uint32_t off;
+    /** Total size of image data. */
+    uint32_t size;
+    /** Hash of image data that the client identified the upload with. */
+    uint8_t data_sha_len;
+    uint8_t data_sha[IMG_MGMT_DATA_SHA_LEN];
+};
+#endif
+
+#if IMG_MGMT_DELTA
+/** Identifies a patch accepted by the image delta command ("MDLT"). */
+#define IMG_MGMT_DELTA_MAGIC    0x544c444d
+
+/**
+ * Patch header.  A patch is this header followed by a sequence of blocks,
+ * each of which is a control record followed by the diff bytes and then the
+ * extra bytes it announces.  All fields are little endian.
+ */
+struct img_mgmt_delta_hdr {
+    uint32_t magic;     /* IMG_MGMT_DELTA_MAGIC */
+    uint32_t size;      /* Size of the image the patch produces. */
 };
 
+/**
+ * Patch control record, with the semantics of a bsdiff control triple: each
+ * diff byte is added to the next byte of the running image, extra bytes are
+ * copied to the output, and the running image offset then moves by seek.
+ */
+struct img_mgmt_delta_ctrl {
+    uint32_t diff_len;
+    uint32_t extra_len;
+    int32_t seek;
+};
+#endif
+
 /** Describes what to do during processing of an upload request. */
 struct img_mgmt_upload_action {
     /** The total size of the image. */
@@ -136,6 +224,14 @@ void img_mgmt_unregister_group(void);
 int img_mgmt_read_info(int image_slot, struct image_version *ver,
                        uint8_t *hash, uint32_t *flags);
 
+/**
+ * @brief Discards the image metadata cached by img_mgmt_read_info().
+ *
+ * Image management calls this itself whenever it erases or writes a slot;
+ * code that modifies image slots by other means must call it too.
+ */
+void img_mgmt_meta_invalidate(void);
+
 /**
  * @brief Get the current running image version
  *
@@ -182,6 +278,13 @@ int img_mgmt_state_any_pending(void);
  */
 uint8_t img_mgmt_state_flags(int query_slot);
 
+/**
+ * @brief Discards the slot state flags cached by img_mgmt_state_flags().
+ *
+ * Must be called whenever a boot trailer is written or erased.
+ */
+void img_mgmt_state_invalidate(void);
+
 /**
  * @brief Sets the pending flag for the specified image slot.  That is, the system
  * will swap to the specified image on the next reboot.  If the permanent
@@ -203,6 +306,32 @@ int img_mgmt_state_set_pending(int slot, int permanent);
  */
 int img_mgmt_state_confirm(void);
 
+/**
+ * @brief Writes a chunk of an image as a chunk of a regular upload request
+ * would be, for command groups that carry image data in requests of their
+ * own.  The chunk goes through the same checks and the upload callback;
+ * the upload it starts is the one reported by the upload command.
+ *
+ * @param image                 The image number; selects the slot as the
+ *                                  upload command's "image" field does.
+ * @param off                   Offset of the chunk within the image.  Chunks
+ *                                  are written in order, starting at 0.
+ * @param size                  Total size of the image; only looked at with
+ *                                  the first chunk.
+ * @param data                  The chunk data.
+ * @param len                   Length of the chunk; at most
+ *                                  IMG_MGMT_UL_CHUNK_SIZE.
+ * @param errstr                On failure, may receive a description of the
+ *                                  error.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_EBADSTATE if off is not the offset
+ *                                  the upload in progress continues at;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_stage_chunk(int image, uint32_t off, uint32_t size,
+                         const void *data, size_t len, const char **errstr);
+
 /** @brief Generic callback function for events */
 typedef void (*img_mgmt_dfu_cb)(void);
 
@@ -249,6 +378,70 @@ typedef int img_mgmt_upload_fn(uint32_t offset, uint32_t size, void *arg);
  *                                  callback.
  */
 void img_mgmt_set_upload_cb(img_mgmt_upload_fn *cb, void *arg);
+
+/** @typedef img_mgmt_reset_fn
+ * @brief Application callback that schedules a system reset, requested by an
+ * image state write.  The reset must be delayed long enough for the response
+ * to be sent; os_mgmt_impl_reset() does so.
+ *
+ * @param arg                   Optional argument specified when the callback
+ *                                  was configured.
+ *
+ * @return                      0 if the reset was scheduled; MGMT_ERR_[...]
+ *                                  code on failure.
+ */
+typedef int img_mgmt_reset_fn(void *arg);
+
+/**
+ * @brief Configures the callback that image state writes use to reset the
+ * system once the requested state is written.  Without one, such requests
+ * are rejected with MGMT_ERR_ENOTSUP.
+ *
+ * @param cb                    The callback that schedules a reset.
+ * @param arg                   Optional argument that gets passed to the
+ *                                  callback.
+ */
+void img_mgmt_set_reset_cb(img_mgmt_reset_fn *cb, void *arg);
+
+/** @typedef img_mgmt_clock_fn
+ * @brief Reads a free-running clock used to time image uploads.
+ *
+ * @return                      The current time, in ticks of any unit.
+ */
+typedef uint32_t img_mgmt_clock_fn(void);
+
+/**
+ * @brief Time spent in each phase of image uploads.
+ *
+ * Times are in ticks of the clock passed to img_mgmt_set_ul_prof().  The
+ * totals accumulate across uploads; the application clears them as it sees
+ * fit, e.g., from its dfu_started_cb.  Erases done by the flash driver as a
+ * side effect of writing count as write time.
+ */
+struct img_mgmt_ul_prof {
+    /* Number of chunks written. */
+    uint32_t chunks;
+    /* Number of image bytes written. */
+    uint32_t bytes;
+
+    /* Decoding upload requests. */
+    uint32_t decode_ticks;
+    /* Erasing the slot ahead of the data. */
+    uint32_t erase_ticks;
+    /* Writing (and hashing) the data. */
+    uint32_t write_ticks;
+};
+
+/**
+ * @brief Starts or stops the timing of image uploads.
+ *
+ * @param prof                  The totals to accumulate into; NULL to stop
+ *                                  timing.
+ * @param clock_cb              The clock to time uploads with.
+ */
+void img_mgmt_set_ul_prof(struct img_mgmt_ul_prof *prof,
+                          img_mgmt_clock_fn *clock_cb);
+
 void img_mgmt_register_callbacks(const img_mgmt_dfu_callbacks_t *cb_struct);
 void img_mgmt_dfu_stopped(void);
 void img_mgmt_dfu_started(void);
@@ -266,6 +459,9 @@ extern const char *img_mgmt_err_str_flash_erase_failed;
 extern const char *img_mgmt_err_str_flash_write_failed;
 extern const char *img_mgmt_err_str_downgrade;
 extern const char *img_mgmt_err_str_image_bad_flash_addr;
+extern const char *img_mgmt_err_str_delta_src_mismatch;
+extern const char *img_mgmt_err_str_delta_malformed;
+extern const char *img_mgmt_err_str_comp_malformed;
 #else
 #define img_mgmt_error_rsp(ctxt, rc, rsn)             (rc)
 #define img_mgmt_err_str_app_reject                   NULL
@@ -277,6 +473,9 @@ extern const char *img_mgmt_err_str_image_bad_flash_addr;
 #define img_mgmt_err_str_flash_write_failed           NULL
 #define img_mgmt_err_str_downgrade                    NULL
 #define img_mgmt_err_str_image_bad_flash_addr         NULL
+#define img_mgmt_err_str_delta_src_mismatch           NULL
+#define img_mgmt_err_str_delta_malformed              NULL
+#define img_mgmt_err_str_comp_malformed               NULL
 #endif
 
 #ifdef __cplusplus
@@ -25,19 +25,166 @@
 #include "syscfg/syscfg.h"
 
 #define IMG_MGMT_UL_CHUNK_SIZE  MYNEWT_VAL(IMG_MGMT_UL_CHUNK_SIZE)
+#define IMG_MGMT_UL_FRAME_SIZE  MYNEWT_VAL(IMG_MGMT_UL_FRAME_SIZE)
 #define IMG_MGMT_VERBOSE_ERR    MYNEWT_VAL(IMG_MGMT_VERBOSE_ERR)
 #define IMG_MGMT_LAZY_ERASE     MYNEWT_VAL(IMG_MGMT_LAZY_ERASE)
 #define IMG_MGMT_DUMMY_HDR      MYNEWT_VAL(IMG_MGMT_DUMMY_HDR)
 #define IMG_MGMT_BOOT_CURR_SLOT boot_current_slot
+#define IMG_MGMT_UL_WINDOW_SIZE MYNEWT_VAL(IMG_MGMT_UL_WINDOW_SIZE)
+#define IMG_MGMT_ERASE_AHEAD    0
+#define IMG_MGMT_ERASE_ASYNC    0
+#define IMG_MGMT_EMPTY_SAMPLES  0
+#define IMG_MGMT_IMAGE_COUNT    1
+#define IMG_MGMT_DIRECT_WRITE_BUF 0
+#define IMG_MGMT_WRITE_ALIGN_MAX MYNEWT_VAL(IMG_MGMT_WRITE_ALIGN_MAX)
+#define IMG_MGMT_UL_SHA256      MYNEWT_VAL(IMG_MGMT_UL_SHA256)
+#define IMG_MGMT_UL_JOURNAL_KB  MYNEWT_VAL(IMG_MGMT_UL_JOURNAL_KB)
+#define IMG_MGMT_DELTA          MYNEWT_VAL(IMG_MGMT_DELTA)
+#define IMG_MGMT_UL_COMP        MYNEWT_VAL(IMG_MGMT_UL_COMP)
+#define IMG_MGMT_DECODE_BUF_SIZE MYNEWT_VAL(IMG_MGMT_DECODE_BUF_SIZE)
+#define IMG_MGMT_VERIFY_BUF_SIZE MYNEWT_VAL(IMG_MGMT_VERIFY_BUF_SIZE)
+#define IMG_MGMT_VERIFY_STEP    MYNEWT_VAL(IMG_MGMT_VERIFY_STEP)
+#define IMG_MGMT_DL_CHUNK_SIZE  MYNEWT_VAL(IMG_MGMT_DL_CHUNK_SIZE)
+#define IMG_MGMT_DL_WIN_MAX     MYNEWT_VAL(IMG_MGMT_DL_WIN_MAX)
+#define IMG_MGMT_DL_COMP        MYNEWT_VAL(IMG_MGMT_DL_COMP)
+#define IMG_MGMT_MCAST_CHUNKS   MYNEWT_VAL(IMG_MGMT_MCAST_CHUNKS)
 
 #elif defined __ZEPHYR__
 
 #define IMG_MGMT_UL_CHUNK_SIZE  CONFIG_IMG_MGMT_UL_CHUNK_SIZE
+
+#ifdef CONFIG_IMG_MGMT_UL_FRAME_SIZE
+#define IMG_MGMT_UL_FRAME_SIZE  CONFIG_IMG_MGMT_UL_FRAME_SIZE
+#else
+#define IMG_MGMT_UL_FRAME_SIZE  0
+#endif
+
 #define IMG_MGMT_VERBOSE_ERR    CONFIG_IMG_MGMT_VERBOSE_ERR
 #define IMG_MGMT_LAZY_ERASE     CONFIG_IMG_ERASE_PROGRESSIVELY
 #define IMG_MGMT_DUMMY_HDR      CONFIG_IMG_MGMT_DUMMY_HDR
 #define IMG_MGMT_BOOT_CURR_SLOT 0
 
+#ifdef CONFIG_IMG_MGMT_UL_WINDOW_SIZE
+#define IMG_MGMT_UL_WINDOW_SIZE CONFIG_IMG_MGMT_UL_WINDOW_SIZE
+#else
+#define IMG_MGMT_UL_WINDOW_SIZE 0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_ERASE_AHEAD
+#define IMG_MGMT_ERASE_AHEAD    CONFIG_IMG_MGMT_ERASE_AHEAD
+#else
+#define IMG_MGMT_ERASE_AHEAD    0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_ERASE_ASYNC
+#define IMG_MGMT_ERASE_ASYNC    1
+#else
+#define IMG_MGMT_ERASE_ASYNC    0
+#endif
+
+/* Stack size and priority of the work queue that the background eraser and
+ * the double-buffered writer run on.  Upload handlers wait for them, so it
+ * cannot be the system work queue that transports may process requests on.
+ */
+#ifdef CONFIG_IMG_MGMT_WORKQ_STACK_SIZE
+#define IMG_MGMT_WORKQ_STACK_SIZE CONFIG_IMG_MGMT_WORKQ_STACK_SIZE
+#else
+#define IMG_MGMT_WORKQ_STACK_SIZE 1024
+#endif
+
+#ifdef CONFIG_IMG_MGMT_WORKQ_PRIO
+#define IMG_MGMT_WORKQ_PRIO     CONFIG_IMG_MGMT_WORKQ_PRIO
+#else
+#define IMG_MGMT_WORKQ_PRIO     CONFIG_SYSTEM_WORKQUEUE_PRIORITY
+#endif
+
+#ifdef CONFIG_IMG_MGMT_DIRECT_WRITE_BUF
+#define IMG_MGMT_DIRECT_WRITE_BUF CONFIG_IMG_MGMT_DIRECT_WRITE_BUF
+#else
+#define IMG_MGMT_DIRECT_WRITE_BUF 0
+#endif
+
+/* flash_img and the direct writer buffer unaligned chunks themselves. */
+#define IMG_MGMT_WRITE_ALIGN_MAX 0
+
+#ifdef CONFIG_UPDATEABLE_IMAGE_NUMBER
+#define IMG_MGMT_IMAGE_COUNT    CONFIG_UPDATEABLE_IMAGE_NUMBER
+#else
+#define IMG_MGMT_IMAGE_COUNT    1
+#endif
+
+#ifdef CONFIG_IMG_MGMT_EMPTY_SAMPLES
+#define IMG_MGMT_EMPTY_SAMPLES  CONFIG_IMG_MGMT_EMPTY_SAMPLES
+#else
+#define IMG_MGMT_EMPTY_SAMPLES  16
+#endif
+
+#ifdef CONFIG_IMG_MGMT_UL_SHA256
+#define IMG_MGMT_UL_SHA256      1
+#else
+#define IMG_MGMT_UL_SHA256      0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_UL_JOURNAL_KB
+#define IMG_MGMT_UL_JOURNAL_KB  CONFIG_IMG_MGMT_UL_JOURNAL_KB
+#else
+#define IMG_MGMT_UL_JOURNAL_KB  0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_DELTA
+#define IMG_MGMT_DELTA          1
+#else
+#define IMG_MGMT_DELTA          0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_UL_COMP
+#define IMG_MGMT_UL_COMP        1
+#else
+#define IMG_MGMT_UL_COMP        0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_DECODE_BUF_SIZE
+#define IMG_MGMT_DECODE_BUF_SIZE CONFIG_IMG_MGMT_DECODE_BUF_SIZE
+#else
+#define IMG_MGMT_DECODE_BUF_SIZE 512
+#endif
+
+#ifdef CONFIG_IMG_MGMT_VERIFY_BUF_SIZE
+#define IMG_MGMT_VERIFY_BUF_SIZE CONFIG_IMG_MGMT_VERIFY_BUF_SIZE
+#else
+#define IMG_MGMT_VERIFY_BUF_SIZE 0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_VERIFY_STEP
+#define IMG_MGMT_VERIFY_STEP    CONFIG_IMG_MGMT_VERIFY_STEP
+#else
+#define IMG_MGMT_VERIFY_STEP    65536
+#endif
+
+#ifdef CONFIG_IMG_MGMT_DL_CHUNK_SIZE
+#define IMG_MGMT_DL_CHUNK_SIZE  CONFIG_IMG_MGMT_DL_CHUNK_SIZE
+#else
+#define IMG_MGMT_DL_CHUNK_SIZE  0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_DL_WIN_MAX
+#define IMG_MGMT_DL_WIN_MAX     CONFIG_IMG_MGMT_DL_WIN_MAX
+#else
+#define IMG_MGMT_DL_WIN_MAX     1
+#endif
+
+#ifdef CONFIG_IMG_MGMT_DL_COMP
+#define IMG_MGMT_DL_COMP        1
+#else
+#define IMG_MGMT_DL_COMP        0
+#endif
+
+#ifdef CONFIG_IMG_MGMT_MCAST_CHUNKS
+#define IMG_MGMT_MCAST_CHUNKS   CONFIG_IMG_MGMT_MCAST_CHUNKS
+#else
+#define IMG_MGMT_MCAST_CHUNKS   0
+#endif
+
 #else
 
 /* No direct support for this OS.  The application needs to define the above
@@ -46,4 +193,62 @@
 
 #endif
 
+#if IMG_MGMT_UL_WINDOW_SIZE > 32
+#error "IMG_MGMT_UL_WINDOW_SIZE must not exceed 32 (width of the ack bitmap)"
+#endif
+
+#if IMG_MGMT_WRITE_ALIGN_MAX > 255
+#error "IMG_MGMT_WRITE_ALIGN_MAX must fit the 8-bit carry length"
+#endif
+
+/* Each image has a primary and a secondary slot; slots 2n and 2n + 1 belong
+ * to image n.
+ */
+#define IMG_MGMT_SLOT_COUNT     (2 * IMG_MGMT_IMAGE_COUNT)
+
+/* Whether images can be produced on the device from what is uploaded. */
+#define IMG_MGMT_DECODE         (IMG_MGMT_DELTA || IMG_MGMT_UL_COMP)
+
+#if IMG_MGMT_DECODE && IMG_MGMT_DECODE_BUF_SIZE < 32
+#error "IMG_MGMT_DECODE_BUF_SIZE must hold the image header"
+#endif
+
+/* Whether slots can be verified against their hash TLV on request. */
+#define IMG_MGMT_VERIFY         (IMG_MGMT_VERIFY_BUF_SIZE > 0)
+
+/* Whether the port must provide the img_mgmt_impl_sha256_[...] hooks. */
+#define IMG_MGMT_SHA256         (IMG_MGMT_UL_SHA256 || IMG_MGMT_VERIFY)
+
+#if IMG_MGMT_VERIFY && IMG_MGMT_VERIFY_STEP == 0
+#error "IMG_MGMT_VERIFY_STEP must be nonzero"
+#endif
+
+/* Whether the contents of slots can be downloaded. */
+#define IMG_MGMT_DL             (IMG_MGMT_DL_CHUNK_SIZE > 0)
+
+#if IMG_MGMT_DL_COMP && !IMG_MGMT_DL
+#error "IMG_MGMT_DL_COMP compresses slot downloads; set IMG_MGMT_DL_CHUNK_SIZE"
+#endif
+
+#if IMG_MGMT_DL && IMG_MGMT_DL_WIN_MAX < 1
+#error "IMG_MGMT_DL_WIN_MAX must be at least 1"
+#endif
+
+/* Whether images can be uploaded to many devices at once, e.g., over UDP
+ * multicast.
+ */
+#define IMG_MGMT_MCAST          (IMG_MGMT_MCAST_CHUNKS > 0)
+
+#if IMG_MGMT_ERASE_AHEAD > 0 && IMG_MGMT_LAZY_ERASE
+#error "IMG_MGMT_ERASE_AHEAD replaces lazy erase; enable only one of them"
+#endif
+
+#if IMG_MGMT_DIRECT_WRITE_BUF > 0 && IMG_MGMT_LAZY_ERASE
+#error "IMG_MGMT_DIRECT_WRITE_BUF bypasses the progressive eraser of flash_img"
+#endif
+
+#if IMG_MGMT_ERASE_ASYNC && IMG_MGMT_ERASE_AHEAD == 0
+#error "IMG_MGMT_ERASE_ASYNC runs on the erase-ahead eraser; enable IMG_MGMT_ERASE_AHEAD"
+#endif
+
 #endif
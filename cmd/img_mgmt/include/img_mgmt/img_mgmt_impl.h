@@ -100,9 +100,11 @@ int img_mgmt_impl_write_image_data(unsigned int offset, const void *data,
  * @brief Indicates the type of swap operation that will occur on the next
  * reboot, if any.
  *
+ * @param slot                  A slot of the image to query.
+ *
  * @return                      An IMG_MGMT_SWAP_TYPE_[...] code.
  */
-int img_mgmt_impl_swap_type(void);
+int img_mgmt_impl_swap_type(int slot);
 
 /**
  * Collects information about the specified image slot.
@@ -128,6 +130,9 @@ int img_mgmt_impl_erase_image_data(unsigned int off, unsigned int num_bytes);
  * We could check for empty to increase efficiency, but instead we always erase
  *   for consistency and simplicity.
  *
+ * With IMG_MGMT_ERASE_AHEAD, this instead waits until the range has been
+ *   erased by the background eraser and moves the erase-ahead target forward.
+ *
  * @param off      Offset that is about to be written
  * @param len      Number of bytes to be written
  *
@@ -136,6 +141,63 @@ int img_mgmt_impl_erase_image_data(unsigned int off, unsigned int num_bytes);
  */
 int img_mgmt_impl_erase_if_needed(uint32_t off, uint32_t len);
 
+/**
+ * Starts erasing the upload slot in the background, keeping
+ * IMG_MGMT_ERASE_AHEAD sectors ahead of the sectors being written.  Called
+ * for the first chunk of an upload in place of erasing the whole image area.
+ *
+ * @param num_bytes             The size of the image being uploaded; 0 if
+ *                                  the slot is already empty.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_erase_ahead_start(unsigned int num_bytes);
+
+#if IMG_MGMT_ERASE_ASYNC
+/**
+ * @brief Progress of a background slot erase.
+ */
+struct img_mgmt_erase_status {
+    /* Identifies the erase job. */
+    uint32_t job;
+    /* Number of bytes erased from the start of the slot. */
+    uint32_t done;
+    /* Size of the slot. */
+    uint32_t total;
+    /* Whether the erase is still running. */
+    bool busy;
+    /* MGMT_ERR_[...] code of the first failed erase; 0 if none failed. */
+    int rc;
+};
+
+/**
+ * @brief Starts erasing the spare slot in the background, one erase page
+ *        at a time.  An upload into the slot that starts while the erase is
+ *        running writes behind the pages already erased.
+ *
+ * @param out_job               On success, the ID of the job gets written
+ *                                  here.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_erase_slot_start(uint32_t *out_job);
+
+/**
+ * @brief Reports the progress of the last erase started with
+ *        img_mgmt_impl_erase_slot_start().
+ *
+ * @param out_status            On success, the job's progress gets written
+ *                                  here.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOENT if no erase job was started
+ *                                  or an upload has taken the eraser over
+ *                                  since;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_erase_status(struct img_mgmt_erase_status *out_status);
+#endif
+
 /**
  * Verifies an upload request and indicates the actions that should be taken
  * during processing of the request.  This is a "read only" function in the
@@ -154,6 +216,126 @@ int img_mgmt_impl_upload_inspect(const struct img_mgmt_upload_req *req,
                                  struct img_mgmt_upload_action *action,
                                  const char **errstr);
 
+/**
+ * @brief Starts computing the SHA-256 of an uploaded image, or of the
+ *        image in a slot being verified.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_sha256_start(void);
+
+/**
+ * @brief Adds image data to the SHA-256 started with
+ *        img_mgmt_impl_sha256_start().
+ *
+ * @param data                  The data to hash.
+ * @param len                   The number of bytes to hash.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_sha256_update(const void *data, size_t len);
+
+/**
+ * @brief Completes the SHA-256 of an uploaded image.
+ *
+ * @param digest                On success, receives the IMAGE_HASH_LEN-byte
+ *                                  digest.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_sha256_finish(uint8_t *digest);
+
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+/**
+ * @brief Reads the persisted upload journal.
+ *
+ * @param journal               On success, receives the journal.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOENT if no journal is stored;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_journal_read(struct img_mgmt_journal *journal);
+
+/**
+ * @brief Persists the upload journal, replacing any stored one.
+ *
+ * @param journal               The journal to persist.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_journal_write(const struct img_mgmt_journal *journal);
+
+/**
+ * @brief Deletes the persisted upload journal.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_journal_clear(void);
+
+/**
+ * @brief Indicates how much of the upload in progress has reached flash.
+ * Written data that the port still holds in RAM is not included.
+ *
+ * @return                      The number of leading image bytes in flash.
+ */
+uint32_t img_mgmt_impl_durable_off(void);
+
+/**
+ * @brief Prepares the port to continue a journaled upload after a reset.
+ * Subsequent writes start at the specified offset of the upload slot
+ * described by g_img_mgmt_state; the data before it is left in place.
+ *
+ * @param off                   The offset the upload continues from.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_upload_resume(uint32_t off);
+#endif
+
+#if IMG_MGMT_DL
+/**
+ * @brief Retrieves the size of an image slot.
+ *
+ * @param slot                  The index of the slot.
+ * @param out_size              On success, the size of the slot in bytes.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_slot_size(int slot, uint32_t *out_size);
+#endif
+
+#if IMG_MGMT_MCAST
+/**
+ * @brief Prepares the spare slot of an image for a multicast upload by
+ * erasing enough of it for the image.  The chunks of a multicast upload
+ * arrive in any order, so the slot cannot be erased as the upload advances.
+ *
+ * @param image                 The image to upload.
+ * @param size                  The size of the image, in bytes.
+ * @param out_area_id           On success, the flash area to write to.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_mcast_begin(int image, uint32_t size, int *out_area_id);
+
+/**
+ * @brief Writes a chunk of a multicast upload to the slot prepared by
+ * img_mgmt_impl_mcast_begin().  Chunks are written in any order; each starts
+ * at a multiple of the chunk size, which the client picks as a multiple of
+ * the flash write alignment.  Only the last chunk of the image may be
+ * shorter.
+ *
+ * @param offset                The offset within the slot to write to.
+ * @param data                  The image data to write.
+ * @param num_bytes             The number of bytes to write.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int img_mgmt_impl_mcast_write(unsigned int offset, const void *data,
+                              unsigned int num_bytes);
+#endif
+
 #define ERASED_VAL_32(x) (((x) << 24) | ((x) << 16) | ((x) << 8) | (x))
 int img_mgmt_impl_erased_val(int slot, uint8_t *erased_val);
 
@@ -25,6 +25,12 @@
 #include "flash_map/flash_map.h"
 #include "sysflash/sysflash.h"
 #include "img_mgmt/image.h"
+#if IMG_MGMT_SHA256
+#include "mbedtls/sha256.h"
+#endif
+#if MYNEWT_VAL(IMG_MGMT_UL_JOURNAL_KB) > 0
+#include "config/config.h"
+#endif
 
 static int
 img_mgmt_find_best_area_id(void)
@@ -121,7 +127,6 @@ img_mgmt_impl_upload_inspect(const struct img_mgmt_upload_req *req,
     const struct image_header *hdr;
     const struct flash_area *fa;
     struct image_version cur_ver;
-    uint8_t rem_bytes;
     bool empty;
     int rc;
 
@@ -150,7 +155,7 @@ img_mgmt_impl_upload_inspect(const struct img_mgmt_upload_req *req,
         }
         action->size = req->size;
 
-        hdr = (struct image_header *)req->img_data;
+        hdr = (const struct image_header *)req->img_data;
         if (hdr->ih_magic != IMAGE_MAGIC) {
             *errstr = img_mgmt_err_str_magic_mismatch;
             return MGMT_ERR_EINVAL;
@@ -227,25 +232,10 @@ img_mgmt_impl_upload_inspect(const struct img_mgmt_upload_req *req,
         }
     }
 
-    /* Calculate size of flash write. */
+    /* The whole chunk is accepted; an unaligned tail is carried over to the
+     * next chunk by img_mgmt_impl_write_image_data().
+     */
     action->write_bytes = req->data_len;
-    if (req->off + req->data_len < action->size) {
-        /*
-         * Respect flash write alignment if not in the last block
-         */
-        rc = flash_area_open(action->area_id, &fa);
-        if (rc) {
-            *errstr = img_mgmt_err_str_flash_open_failed;
-            return MGMT_ERR_EUNKNOWN;
-        }
-
-        rem_bytes = req->data_len % flash_area_align(fa);
-        flash_area_close(fa);
-
-        if (rem_bytes) {
-            action->write_bytes -= rem_bytes;
-        }
-    }
 
     action->proceed = true;
     return 0;
@@ -387,6 +377,66 @@ img_mgmt_impl_read(int slot, unsigned int offset, void *dst,
     return 0;
 }
 
+/**
+ * Writes a chunk of image data that starts at the given image offset.  Bytes
+ * carried over from the previous chunk are written in front of it, and the
+ * tail that does not fill a whole flash write unit is carried over to the next
+ * chunk.  The last chunk is written in full.
+ */
+static int
+mynewt_img_mgmt_write_carry(const struct flash_area *fa, unsigned int offset,
+                            const uint8_t *data, unsigned int num_bytes,
+                            bool last)
+{
+    uint8_t *carry;
+    unsigned int align;
+    unsigned int tail;
+    unsigned int cnt;
+    int rc;
+
+    carry = g_img_mgmt_state.carry;
+    align = flash_area_align(fa);
+    if (align > sizeof g_img_mgmt_state.carry) {
+        return -1;
+    }
+
+    if (g_img_mgmt_state.carry_len != 0) {
+        /* Complete the carried write unit from the front of this chunk. */
+        cnt = align - g_img_mgmt_state.carry_len;
+        if (cnt > num_bytes) {
+            cnt = num_bytes;
+        }
+        memcpy(carry + g_img_mgmt_state.carry_len, data, cnt);
+        offset -= g_img_mgmt_state.carry_len;
+        g_img_mgmt_state.carry_len += cnt;
+        data += cnt;
+        num_bytes -= cnt;
+
+        if (g_img_mgmt_state.carry_len < align && !last) {
+            return 0;
+        }
+
+        rc = flash_area_write(fa, offset, carry, g_img_mgmt_state.carry_len);
+        if (rc != 0) {
+            return rc;
+        }
+        offset += g_img_mgmt_state.carry_len;
+        g_img_mgmt_state.carry_len = 0;
+    }
+
+    tail = last ? 0 : num_bytes % align;
+    if (num_bytes > tail) {
+        rc = flash_area_write(fa, offset, data, num_bytes - tail);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    memcpy(carry, data + num_bytes - tail, tail);
+    g_img_mgmt_state.carry_len = tail;
+    return 0;
+}
+
 #if MYNEWT_VAL(IMG_MGMT_LAZY_ERASE)
 int
 img_mgmt_impl_write_image_data(unsigned int offset, const void *data,
@@ -420,7 +470,7 @@ img_mgmt_impl_write_image_data(unsigned int offset, const void *data,
         g_img_mgmt_state.sector_end = 0;
     }
 
-    rc = flash_area_write(fa, offset, data, num_bytes);
+    rc = mynewt_img_mgmt_write_carry(fa, offset, data, num_bytes, last);
     flash_area_close(fa);
     if (rc != 0) {
         return MGMT_ERR_EUNKNOWN;
@@ -447,7 +497,7 @@ img_mgmt_impl_write_image_data(unsigned int offset, const void *data,
         return MGMT_ERR_EUNKNOWN;
     }
 
-    rc = flash_area_write(fa, offset, data, num_bytes);
+    rc = mynewt_img_mgmt_write_carry(fa, offset, data, num_bytes, last);
     flash_area_close(fa);
     if (rc != 0) {
         return MGMT_ERR_EUNKNOWN;
@@ -510,7 +560,7 @@ done:
 #endif
 
 int
-img_mgmt_impl_swap_type(void)
+img_mgmt_impl_swap_type(int slot)
 {
     switch (boot_swap_type()) {
     case BOOT_SWAP_TYPE_NONE:
@@ -544,6 +594,223 @@ img_mgmt_impl_erased_val(int slot, uint8_t *erased_val)
     return 0;
 }
 
+#if IMG_MGMT_DL
+int
+img_mgmt_impl_slot_size(int slot, uint32_t *out_size)
+{
+    const struct flash_area *fa;
+    int rc;
+
+    rc = flash_area_open(flash_area_id_from_image_slot(slot), &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_size = fa->fa_size;
+    flash_area_close(fa);
+
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_MCAST
+int
+img_mgmt_impl_mcast_begin(int image, uint32_t size, int *out_area_id)
+{
+    const struct flash_area *fa;
+    int rc;
+
+    if (image != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (img_mgmt_slot_in_use(1)) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    if (size > fa->fa_size) {
+        flash_area_close(fa);
+        return MGMT_ERR_EINVAL;
+    }
+
+    rc = flash_area_erase(fa, 0, size);
+    flash_area_close(fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_area_id = FLASH_AREA_IMAGE_1;
+    return 0;
+}
+
+int
+img_mgmt_impl_mcast_write(unsigned int offset, const void *data,
+                          unsigned int num_bytes)
+{
+    const struct flash_area *fa;
+    int rc;
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = flash_area_write(fa, offset, data, num_bytes);
+    flash_area_close(fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_SHA256
+static mbedtls_sha256_context mynewt_img_mgmt_sha256;
+
+int
+img_mgmt_impl_sha256_start(void)
+{
+    mbedtls_sha256_init(&mynewt_img_mgmt_sha256);
+    if (mbedtls_sha256_starts_ret(&mynewt_img_mgmt_sha256, 0) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_sha256_update(const void *data, size_t len)
+{
+    if (mbedtls_sha256_update_ret(&mynewt_img_mgmt_sha256, data, len) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_sha256_finish(uint8_t *digest)
+{
+    int rc;
+
+    rc = mbedtls_sha256_finish_ret(&mynewt_img_mgmt_sha256, digest);
+    mbedtls_sha256_free(&mynewt_img_mgmt_sha256);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+#endif
+
+#if MYNEWT_VAL(IMG_MGMT_UL_JOURNAL_KB) > 0
+#define MYNEWT_IMG_MGMT_JOURNAL_NAME    "img_mgmt/ul"
+#define MYNEWT_IMG_MGMT_JOURNAL_STR_LEN \
+    (CONF_STR_FROM_BYTES_LEN(sizeof(struct img_mgmt_journal)) + 1)
+
+int
+img_mgmt_impl_journal_read(struct img_mgmt_journal *journal)
+{
+    char buf[MYNEWT_IMG_MGMT_JOURNAL_STR_LEN];
+    int len;
+    int rc;
+
+    rc = conf_get_stored_value(MYNEWT_IMG_MGMT_JOURNAL_NAME, buf, sizeof buf);
+    if (rc != 0) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    len = sizeof *journal;
+    rc = conf_bytes_from_str(buf, journal, &len);
+    if (rc != 0 || len != sizeof *journal) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_journal_write(const struct img_mgmt_journal *journal)
+{
+    char buf[MYNEWT_IMG_MGMT_JOURNAL_STR_LEN];
+    int rc;
+
+    /* Cast away const. */
+    if (conf_str_from_bytes((void *)journal, sizeof *journal, buf,
+                            sizeof buf) == NULL) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = conf_save_one(MYNEWT_IMG_MGMT_JOURNAL_NAME, buf);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_journal_clear(void)
+{
+    int rc;
+
+    rc = conf_save_one(MYNEWT_IMG_MGMT_JOURNAL_NAME, NULL);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+uint32_t
+img_mgmt_impl_durable_off(void)
+{
+    /* Chunks are written straight to flash, except for the carried tail. */
+    return g_img_mgmt_state.off - g_img_mgmt_state.carry_len;
+}
+
+int
+img_mgmt_impl_upload_resume(uint32_t off)
+{
+#if MYNEWT_VAL(IMG_MGMT_LAZY_ERASE)
+    const struct flash_area *fa;
+    struct flash_area sector;
+    int rc;
+
+    rc = flash_area_open(FLASH_AREA_IMAGE_1, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    /* Skip the sectors that were erased before the reset; the one holding
+     * the last written byte is still erased past it.
+     */
+    g_img_mgmt_state.sector_id = -1;
+    g_img_mgmt_state.sector_end = 0;
+    while (fa->fa_off + off > g_img_mgmt_state.sector_end) {
+        rc = flash_area_getnext_sector(fa->fa_id, &g_img_mgmt_state.sector_id,
+                                       &sector);
+        if (rc != 0) {
+            flash_area_close(fa);
+            g_img_mgmt_state.sector_id = -1;
+            g_img_mgmt_state.sector_end = 0;
+            return MGMT_ERR_EUNKNOWN;
+        }
+        g_img_mgmt_state.sector_end = sector.fa_off + sector.fa_size;
+    }
+    flash_area_close(fa);
+#endif
+
+    return 0;
+}
+#endif
+
 void
 img_mgmt_module_init(void)
 {
@@ -34,109 +34,221 @@ LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 #include <img_mgmt/img_mgmt_impl.h>
 #include <img_mgmt/img_mgmt.h>
 #include <img_mgmt/image.h>
+#if IMG_MGMT_SHA256
+#include <mbedtls/sha256.h>
+#endif
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+#include <settings/settings.h>
+#endif
 #include "../../../src/img_mgmt_priv.h"
 
 /**
- * Determines if the specified area of flash is completely unwritten.
+ * Determines if the specified range of a flash area is completely unwritten.
  */
 static int
-zephyr_img_mgmt_flash_check_empty(uint8_t fa_id, bool *out_empty)
+zephyr_img_mgmt_range_empty(const struct flash_area *fa, off_t off,
+                            size_t len, bool *out_empty)
 {
-    const struct flash_area *fa;
     uint32_t data[16];
-    off_t addr;
+    uint32_t erased_val_32;
+    size_t bytes_to_read;
     off_t end;
-    int bytes_to_read;
     int rc;
     int i;
-    uint8_t erased_val;
-    uint32_t erased_val_32;
-
-    rc = flash_area_open(fa_id, &fa);
-    if (rc != 0) {
-        return MGMT_ERR_EUNKNOWN;
-    }
-
-    assert(fa->fa_size % 4 == 0);
-
-    erased_val = flash_area_erased_val(fa);
-    erased_val_32 = ERASED_VAL_32(erased_val);
 
-    end = fa->fa_size;
-
-#ifdef CONFIG_BOARD_SCORPIO
-    /* 
-     * Scanning the entire slot takes too long.
-     * Just looking at first sector is good enough.
-     */
-    end = MIN(512, fa->fa_size);
-#endif
+    erased_val_32 = ERASED_VAL_32(flash_area_erased_val(fa));
 
-    for (addr = 0; addr < end; addr += sizeof data) {
-        if (end - addr < sizeof data) {
-            bytes_to_read = end - addr;
+    for (end = off + len; off < end; off += bytes_to_read) {
+        if (end - off < sizeof data) {
+            bytes_to_read = end - off;
         } else {
             bytes_to_read = sizeof data;
         }
 
-        rc = flash_area_read(fa, addr, data, bytes_to_read);
+        rc = flash_area_read(fa, off, data, bytes_to_read);
         if (rc != 0) {
-            flash_area_close(fa);
             return MGMT_ERR_EUNKNOWN;
         }
 
         for (i = 0; i < bytes_to_read / 4; i++) {
             if (data[i] != erased_val_32) {
                 *out_empty = false;
-                flash_area_close(fa);
                 return 0;
             }
         }
     }
 
     *out_empty = true;
-    flash_area_close(fa);
     return 0;
 }
 
 /**
- * Get flash_area ID for a image number; actually the slots are images
- * for Zephyr, as slot 0 of image 0 is image_0, slot 0 of image 1 is
- * image_2 and so on. The function treats slot numbers as absolute
- * slot number starting at 0.
+ * Determines if the specified area of flash is unwritten.  Unless
+ * IMG_MGMT_EMPTY_SAMPLES is 0, only the start of that many evenly spaced
+ * erase pages and the image trailer are checked; pages that were not checked
+ * get verified as the upload reaches them.  An upload always writes its
+ * first page, so a slot holding any previous upload is reliably found
+ * non-empty.
  */
 static int
-zephyr_img_mgmt_flash_area_id(int slot)
+zephyr_img_mgmt_flash_check_empty(uint8_t fa_id, bool *out_empty)
+{
+    const struct flash_area *fa;
+#if IMG_MGMT_EMPTY_SAMPLES > 0
+    struct flash_pages_info page;
+    off_t stride;
+    int i;
+#endif
+    off_t off;
+    int rc;
+
+    rc = flash_area_open(fa_id, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    assert(fa->fa_size % 4 == 0);
+
+#if IMG_MGMT_EMPTY_SAMPLES > 0
+    stride = fa->fa_size / IMG_MGMT_EMPTY_SAMPLES;
+    for (i = 0; i < IMG_MGMT_EMPTY_SAMPLES; i++) {
+        rc = flash_get_page_info_by_offs(flash_area_get_device(fa),
+                                         fa->fa_off + i * stride, &page);
+        if (rc != 0) {
+            rc = MGMT_ERR_EUNKNOWN;
+            goto done;
+        }
+
+        off = page.start_offset - fa->fa_off;
+        rc = zephyr_img_mgmt_range_empty(fa, off,
+                                         MIN(64, fa->fa_size - off),
+                                         out_empty);
+        if (rc != 0 || !*out_empty) {
+            goto done;
+        }
+    }
+
+    /* A stale trailer would make the bootloader act on the new image. */
+    off = BOOT_TRAILER_IMG_STATUS_OFFS(fa);
+    rc = zephyr_img_mgmt_range_empty(fa, off, fa->fa_size - off, out_empty);
+#else
+    (void)off;
+    rc = zephyr_img_mgmt_range_empty(fa, 0, fa->fa_size, out_empty);
+#endif
+
+#if IMG_MGMT_EMPTY_SAMPLES > 0
+done:
+#endif
+    flash_area_close(fa);
+    return rc;
+}
+
+#if IMG_MGMT_EMPTY_SAMPLES > 0 && !IMG_MGMT_LAZY_ERASE
+/* Set when the upload slot has been erased in full (or is being erased
+ * ahead of the upload), so the pages need no verification.
+ */
+static bool zephyr_img_mgmt_slot_erased;
+
+/* Pages of the upload slot below this offset are known to be erased. */
+static uint32_t zephyr_img_mgmt_verified_end;
+
+/**
+ * Ensures the erase pages about to be written are unwritten.  A page that
+ * the sampled empty check passed over but that holds data is erased.
+ */
+static int
+zephyr_img_mgmt_verify_erased(const struct flash_area *fa, uint32_t end)
 {
-    uint8_t fa_id;
+    struct flash_pages_info page;
+    bool empty;
+    off_t off;
+    size_t len;
+    int rc;
+
+    while (zephyr_img_mgmt_verified_end < end) {
+        rc = flash_get_page_info_by_offs(flash_area_get_device(fa),
+                                         fa->fa_off +
+                                         zephyr_img_mgmt_verified_end,
+                                         &page);
+        if (rc != 0) {
+            return MGMT_ERR_EUNKNOWN;
+        }
+
+        off = zephyr_img_mgmt_verified_end;
+        len = page.start_offset + page.size - fa->fa_off - off;
 
-    switch (slot) {
-    case 0:
-        fa_id = FLASH_AREA_ID(image_0);
-        break;
+        rc = zephyr_img_mgmt_range_empty(fa, off, len, &empty);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (!empty) {
+            LOG_INF("Erasing unexpected data at 0x%lx", (long)off);
+            rc = flash_area_erase(fa, off, len);
+            if (rc != 0) {
+                return MGMT_ERR_EUNKNOWN;
+            }
+        }
 
-    case 1:
-        fa_id = FLASH_AREA_ID(image_1);
-        break;
+        zephyr_img_mgmt_verified_end = off + len;
+    }
 
-#if FLASH_AREA_LABEL_EXISTS(image_2)
-    case 2:
-        fa_id = FLASH_AREA_ID(image_2);
-        break;
+    return 0;
+}
 #endif
 
+/**
+ * Flash areas holding the primary and secondary slots of an image.
+ */
+struct zephyr_img_mgmt_slot_map {
+    uint8_t primary;
+    uint8_t secondary;
+};
+
+/**
+ * The slots of each image, indexed by image number.  Images beyond
+ * IMG_MGMT_IMAGE_COUNT are included if the flash map defines them, for
+ * direct access to their slots.
+ */
+static const struct zephyr_img_mgmt_slot_map zephyr_img_mgmt_slot_map[] = {
+    { FLASH_AREA_ID(image_0), FLASH_AREA_ID(image_1) },
 #if FLASH_AREA_LABEL_EXISTS(image_3)
-    case 3:
-        fa_id = FLASH_AREA_ID(image_3);
-        break;
+    { FLASH_AREA_ID(image_2), FLASH_AREA_ID(image_3) },
+#endif
+#if FLASH_AREA_LABEL_EXISTS(image_3) && FLASH_AREA_LABEL_EXISTS(image_5)
+    { FLASH_AREA_ID(image_4), FLASH_AREA_ID(image_5) },
 #endif
+};
 
-    default:
-        fa_id = -1;
-        break;
+#define ZEPHYR_IMG_MGMT_SLOT_MAP_CNT \
+    (int)(sizeof zephyr_img_mgmt_slot_map / sizeof zephyr_img_mgmt_slot_map[0])
+
+#if IMG_MGMT_IMAGE_COUNT > 3
+#error "The slot map covers at most three images"
+#elif IMG_MGMT_IMAGE_COUNT > 1 && !FLASH_AREA_LABEL_EXISTS(image_3)
+#error "Each updatable image needs a pair of image_<n> flash areas"
+#elif IMG_MGMT_IMAGE_COUNT > 2 && !FLASH_AREA_LABEL_EXISTS(image_5)
+#error "Each updatable image needs a pair of image_<n> flash areas"
+#endif
+
+/**
+ * Get flash_area ID for a slot.  The slot numbers are absolute: slot 0 of
+ * image 0 is image_0, slot 0 of image 1 is image_2 and so on.
+ *
+ * @return                      The flash area ID; -1 if there is no such
+ *                                  slot.
+ */
+static int
+zephyr_img_mgmt_flash_area_id(int slot)
+{
+    const struct zephyr_img_mgmt_slot_map *map;
+
+    if (slot < 0 || IMG_MGMT_SLOT_IMAGE(slot) >= ZEPHYR_IMG_MGMT_SLOT_MAP_CNT) {
+        return -1;
     }
 
-    return fa_id;
+    map = &zephyr_img_mgmt_slot_map[IMG_MGMT_SLOT_IMAGE(slot)];
+    return slot % 2 == 0 ? map->primary : map->secondary;
 }
 
 /**
@@ -164,9 +276,10 @@ img_mgmt_get_unused_slot_area_id(int slot)
         }
         return -1;
     }
-    /* Direct selection; the first two slots are checked for being available
-     * and unused; the all other slots are just checked for availability. */
-    if (slot < 2) {
+    /* Direct selection; the slots of managed images are checked for being
+     * available and unused; the all other slots are just checked for
+     * availability. */
+    if (slot < IMG_MGMT_SLOT_COUNT) {
         slot = img_mgmt_slot_in_use(slot) == 0 ? slot : -1;
     }
 
@@ -210,13 +323,19 @@ img_mgmt_vercmp(const struct image_version *a, const struct image_version *b)
     return 0;
 }
 
-int
-img_mgmt_impl_erase_slot(void)
+/**
+ * Selects the flash area an erase command erases.
+ *
+ * @return                      The flash area ID; -1 if there is no slot
+ *                                  that can be erased.
+ */
+static int
+zephyr_img_mgmt_erase_area_id(void)
 {
-    bool empty;
-    int rc;
     int best_id;    /* flash area id */
+#ifdef CONFIG_BOARD_SCORPIO
     int best_slot;  /* slot index */
+#endif
 
     /* Select a non-active, unconfirmed slot if possible */
     best_id = img_mgmt_get_unused_slot_area_id(-1);
@@ -258,10 +377,26 @@ img_mgmt_impl_erase_slot(void)
         best_id = zephyr_img_mgmt_flash_area_id(best_slot);
 #else
         printf("mcumgr: No unused slot to erase.\n");
-        return MGMT_ERR_EUNKNOWN;
+        return -1;
 #endif
     }
 
+    return best_id;
+}
+
+int
+img_mgmt_impl_erase_slot(void)
+{
+    bool empty;
+    int rc;
+    int best_id;    /* flash area id */
+    int best_slot;  /* slot index */
+
+    best_id = zephyr_img_mgmt_erase_area_id();
+    if (best_id < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
     /* Use best_slot for printing debug msgs */
     best_slot = (best_id == FLASH_AREA_ID(image_0)) ? 0 : 1;
 
@@ -289,11 +424,16 @@ img_mgmt_impl_write_pending(int slot, bool permanent)
 {
     int rc;
 
-    if (slot != 1) {
+    /* Only a secondary slot can be swapped in. */
+    if (slot % 2 != 1 || slot >= IMG_MGMT_SLOT_COUNT) {
         return MGMT_ERR_EINVAL;
     }
 
+#if IMG_MGMT_IMAGE_COUNT > 1
+    rc = boot_request_upgrade_multi(IMG_MGMT_SLOT_IMAGE(slot), permanent);
+#else
     rc = boot_request_upgrade(permanent);
+#endif
     if (rc != 0) {
         return MGMT_ERR_EUNKNOWN;
     }
@@ -365,6 +505,7 @@ int img_mgmt_impl_erase_trailer(int slot)
         ret = MGMT_ERR_EUNKNOWN;
     }
 
+    img_mgmt_state_invalidate();
     flash_area_close(fa);
     return ret;
 }
@@ -421,6 +562,8 @@ int img_mgmt_impl_write_trailer(int slot)
         {
             printf("boot_write_trailer_flag():image_ok failed, %d\n", ret);
         }
+
+        img_mgmt_state_invalidate();
     }
 
     flash_area_close(fa);
@@ -450,147 +593,881 @@ img_mgmt_impl_read(int slot, unsigned int offset, void *dst,
     return 0;
 }
 
-int
-img_mgmt_impl_write_image_data(unsigned int offset, const void *data,
-                               unsigned int num_bytes, bool last)
+#if IMG_MGMT_ERASE_AHEAD > 0 || IMG_MGMT_DIRECT_WRITE_BUF > 0
+/*
+ * Work queue of the background eraser and of the double-buffered writer.
+ * Upload handlers block until these have made progress, and transports may
+ * run handlers on the system work queue, so it gets a thread of its own.
+ */
+static K_THREAD_STACK_DEFINE(zephyr_img_mgmt_workq_stack,
+                             IMG_MGMT_WORKQ_STACK_SIZE);
+static struct k_work_q zephyr_img_mgmt_workq;
+
+static int
+zephyr_img_mgmt_workq_init(const struct device *dev)
 {
-	int rc;
-#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
-	static struct flash_img_context *ctx = NULL;
-#else
-	static struct flash_img_context ctx_data;
-#define ctx (&ctx_data)
-#endif
+    ARG_UNUSED(dev);
 
-#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
-	if (offset != 0 && ctx == NULL) {
-		return MGMT_ERR_EUNKNOWN;
-	}
-#endif
+    k_work_queue_start(&zephyr_img_mgmt_workq, zephyr_img_mgmt_workq_stack,
+                       K_THREAD_STACK_SIZEOF(zephyr_img_mgmt_workq_stack),
+                       IMG_MGMT_WORKQ_PRIO, NULL);
+    k_thread_name_set(&zephyr_img_mgmt_workq.thread, "img_mgmt");
 
-	if (offset == 0) {
-#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
-		if (ctx == NULL) {
-			ctx = k_malloc(sizeof(*ctx));
+    return 0;
+}
 
-			if (ctx == NULL) {
-				return MGMT_ERR_ENOMEM;
-			}
-		}
+SYS_INIT(zephyr_img_mgmt_workq_init, APPLICATION,
+         CONFIG_APPLICATION_INIT_PRIORITY);
 #endif
-		rc = flash_img_init_id(ctx, g_img_mgmt_state.area_id);
 
-		if (rc != 0) {
-			return MGMT_ERR_EUNKNOWN;
-		}
-	}
+#if IMG_MGMT_DIRECT_WRITE_BUF > 0
+/**
+ * Writer of the upload in progress.  Chunks are gathered into one of two
+ * staging buffers; a full buffer is written to flash by the image management
+ * work queue while the next chunks fill the other one.
+ */
+static struct {
+    uint8_t buf[2][IMG_MGMT_DIRECT_WRITE_BUF] __aligned(4);
+    /* Slot offset and number of data bytes of each buffer. */
+    uint32_t off[2];
+    uint32_t len[2];
 
-	if (offset != ctx->stream.bytes_written + ctx->stream.buf_bytes) {
-		return MGMT_ERR_EUNKNOWN;
-	}
+    /* Upload slot; NULL before the first upload. */
+    const struct flash_area *fa;
+    /* Write block size of the slot. */
+    uint32_t align;
+
+    /* The buffer being filled, and how much of it is. */
+    uint8_t cur;
+    uint32_t fill;
+    /* Upload bytes accepted so far. */
+    uint32_t staged;
+
+    /* The following are shared with the work queue; mutex protected. */
+
+    /* The oldest buffer handed to the work queue. */
+    uint8_t head;
+    /* Number of buffers handed to the work queue and not yet written. */
+    uint8_t pending;
+    /* The slot is written up to this offset. */
+    uint32_t written;
+    /* MGMT_ERR_[...] code of the first failed write. */
+    int rc;
+} zephyr_img_mgmt_dw;
 
-	/* Cast away const. */
-	rc = flash_img_buffered_write(ctx, (void *)data, num_bytes, last);
-	if (rc != 0) {
-		return MGMT_ERR_EUNKNOWN;
-	}
+static K_MUTEX_DEFINE(zephyr_img_mgmt_dw_mtx);
+static K_SEM_DEFINE(zephyr_img_mgmt_dw_sem, 0, 1);
 
-#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
-	if (last) {
-		k_free(ctx);
-		ctx = NULL;
-	}
-#endif
+static void zephyr_img_mgmt_dw_work_fn(struct k_work *work);
+static K_WORK_DEFINE(zephyr_img_mgmt_dw_work, zephyr_img_mgmt_dw_work_fn);
 
-	return 0;
+/**
+ * Writes the oldest pending staging buffer and resubmits itself while more
+ * are pending.
+ */
+static void
+zephyr_img_mgmt_dw_work_fn(struct k_work *work)
+{
+    uint32_t wlen;
+    uint32_t off;
+    uint32_t len;
+    bool more;
+    int rc;
+    int i;
+
+    k_mutex_lock(&zephyr_img_mgmt_dw_mtx, K_FOREVER);
+    if (zephyr_img_mgmt_dw.pending == 0) {
+        k_mutex_unlock(&zephyr_img_mgmt_dw_mtx);
+        return;
+    }
+    i = zephyr_img_mgmt_dw.head;
+    off = zephyr_img_mgmt_dw.off[i];
+    len = zephyr_img_mgmt_dw.len[i];
+    k_mutex_unlock(&zephyr_img_mgmt_dw_mtx);
+
+    /* A short final buffer was padded to the write block size. */
+    wlen = (len + zephyr_img_mgmt_dw.align - 1) / zephyr_img_mgmt_dw.align *
+           zephyr_img_mgmt_dw.align;
+    rc = flash_area_write(zephyr_img_mgmt_dw.fa, off,
+                          zephyr_img_mgmt_dw.buf[i], wlen);
+
+    k_mutex_lock(&zephyr_img_mgmt_dw_mtx, K_FOREVER);
+    if (rc != 0) {
+        LOG_ERR("image write at 0x%lx failed (err %d)", (long)off, rc);
+        if (zephyr_img_mgmt_dw.rc == 0) {
+            zephyr_img_mgmt_dw.rc = MGMT_ERR_EUNKNOWN;
+        }
+    } else if (zephyr_img_mgmt_dw.rc == 0) {
+        zephyr_img_mgmt_dw.written = off + len;
+    }
+    zephyr_img_mgmt_dw.head ^= 1;
+    zephyr_img_mgmt_dw.pending--;
+    more = zephyr_img_mgmt_dw.pending > 0;
+    k_mutex_unlock(&zephyr_img_mgmt_dw_mtx);
+
+    k_sem_give(&zephyr_img_mgmt_dw_sem);
+    if (more) {
+        k_work_submit_to_queue(&zephyr_img_mgmt_workq, work);
+    }
 }
 
-int
-img_mgmt_impl_erase_image_data(unsigned int off, unsigned int num_bytes)
+/**
+ * Waits until at most max_pending staging buffers are waiting to be
+ * written.
+ *
+ * @return                      0 on success; the MGMT_ERR_[...] code of the
+ *                                  first failed write otherwise.
+ */
+static int
+zephyr_img_mgmt_dw_wait(uint8_t max_pending)
 {
-    const struct flash_area *fa;
+    uint8_t pending;
     int rc;
 
-    if (off != 0) {
-        rc = MGMT_ERR_EINVAL;
-        goto end;
-    }
+    while (1) {
+        k_mutex_lock(&zephyr_img_mgmt_dw_mtx, K_FOREVER);
+        pending = zephyr_img_mgmt_dw.pending;
+        rc = zephyr_img_mgmt_dw.rc;
+        k_mutex_unlock(&zephyr_img_mgmt_dw_mtx);
 
-    printf("mcumgr: Uploading image, Clearing %s area (%d) for image\n",
-        g_img_mgmt_state.area_id == zephyr_img_mgmt_flash_area_id(0) ? "Primary" : "Secondary",
-        g_img_mgmt_state.area_id);
+        if (pending <= max_pending) {
+            return rc;
+        }
 
-    rc = flash_area_open(g_img_mgmt_state.area_id, &fa);
-    if (rc != 0) {
-        LOG_ERR("Can't bind to the flash area (err %d)", rc);
-        rc = MGMT_ERR_EUNKNOWN;
-        goto end;
+        k_sem_take(&zephyr_img_mgmt_dw_sem, K_FOREVER);
     }
+}
 
-    /* align requested erase size to the erase-block-size */
-    const struct device *dev = flash_area_get_device(fa);
-    struct flash_pages_info page;
-    off_t page_offset = fa->fa_off + num_bytes - 1;
+/**
+ * Hands the staging buffer being filled to the work queue and switches to
+ * the other one.
+ */
+static void
+zephyr_img_mgmt_dw_submit(void)
+{
+    uint8_t *buf;
+    uint32_t pad;
+    int i;
 
-    rc = flash_get_page_info_by_offs(dev, page_offset, &page);
-    if (rc != 0) {
-        LOG_ERR("bad offset (0x%lx)", (long)page_offset);
-        rc = MGMT_ERR_EUNKNOWN;
-        goto end_fa;
+    i = zephyr_img_mgmt_dw.cur;
+    buf = zephyr_img_mgmt_dw.buf[i];
+
+    pad = zephyr_img_mgmt_dw.fill % zephyr_img_mgmt_dw.align;
+    if (pad != 0) {
+        memset(buf + zephyr_img_mgmt_dw.fill,
+               flash_area_erased_val(zephyr_img_mgmt_dw.fa),
+               zephyr_img_mgmt_dw.align - pad);
     }
 
-    size_t erase_size = page.start_offset + page.size - fa->fa_off;
+    k_mutex_lock(&zephyr_img_mgmt_dw_mtx, K_FOREVER);
+    zephyr_img_mgmt_dw.off[i] = zephyr_img_mgmt_dw.staged -
+                                zephyr_img_mgmt_dw.fill;
+    zephyr_img_mgmt_dw.len[i] = zephyr_img_mgmt_dw.fill;
+    zephyr_img_mgmt_dw.pending++;
+    k_mutex_unlock(&zephyr_img_mgmt_dw_mtx);
 
-    rc = flash_area_erase(fa, 0, erase_size);
+    k_work_submit_to_queue(&zephyr_img_mgmt_workq, &zephyr_img_mgmt_dw_work);
 
-    if (rc != 0) {
-        LOG_ERR("image slot erase of 0x%zx bytes failed (err %d)", erase_size,
-                rc);
-        rc = MGMT_ERR_EUNKNOWN;
-        goto end_fa;
-    }
+    zephyr_img_mgmt_dw.cur ^= 1;
+    zephyr_img_mgmt_dw.fill = 0;
+}
 
-    LOG_INF("Erased 0x%zx bytes of image slot", erase_size);
+/**
+ * Sets up the writer to write the upload slot from the specified offset,
+ * once the writes of any previous upload are done.
+ */
+static int
+zephyr_img_mgmt_dw_start(uint32_t off)
+{
+    const struct flash_area *fa;
+    int rc;
 
-    /* erase the image trailer area if it was not erased */
-    off = BOOT_TRAILER_IMG_STATUS_OFFS(fa);
-    if (off >= erase_size) {
-        rc = flash_get_page_info_by_offs(dev, fa->fa_off + off, &page);
+    zephyr_img_mgmt_dw_wait(0);
 
-        off = page.start_offset - fa->fa_off;
-        erase_size = fa->fa_size - off;
+    if (zephyr_img_mgmt_dw.fa != NULL) {
+        flash_area_close(zephyr_img_mgmt_dw.fa);
+        zephyr_img_mgmt_dw.fa = NULL;
+    }
 
-        rc = flash_area_erase(fa, off, erase_size);
-        if (rc != 0) {
-            LOG_ERR("image slot trailer erase of 0x%zx bytes failed (err %d)",
-                    erase_size, rc);
-            rc = MGMT_ERR_EUNKNOWN;
-            goto end_fa;
-        }
+    rc = flash_area_open(g_img_mgmt_state.area_id, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
 
-        LOG_INF("Erased 0x%zx bytes of image slot trailer", erase_size);
+    if (IMG_MGMT_DIRECT_WRITE_BUF % flash_area_align(fa) != 0) {
+        LOG_ERR("IMG_MGMT_DIRECT_WRITE_BUF is not a multiple of %u",
+                (unsigned int)flash_area_align(fa));
+        flash_area_close(fa);
+        return MGMT_ERR_EUNKNOWN;
     }
 
-    rc = 0;
+    zephyr_img_mgmt_dw.fa = fa;
+    zephyr_img_mgmt_dw.align = flash_area_align(fa);
+    zephyr_img_mgmt_dw.cur = 0;
+    zephyr_img_mgmt_dw.fill = 0;
+    zephyr_img_mgmt_dw.staged = off;
 
-end_fa:
+    k_mutex_lock(&zephyr_img_mgmt_dw_mtx, K_FOREVER);
+    zephyr_img_mgmt_dw.head = 0;
+    zephyr_img_mgmt_dw.written = off;
+    zephyr_img_mgmt_dw.rc = 0;
+    k_mutex_unlock(&zephyr_img_mgmt_dw_mtx);
+
+    return 0;
+}
+
+/**
+ * Stages a chunk of the upload.  Only the final chunk waits for flash
+ * writes to complete, unless both staging buffers are in use.
+ */
+static int
+zephyr_img_mgmt_dw_write(unsigned int offset, const uint8_t *data,
+                         unsigned int num_bytes, bool last)
+{
+    uint32_t n;
+    int rc;
+
+    if (offset == 0) {
+        rc = zephyr_img_mgmt_dw_start(0);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    if (zephyr_img_mgmt_dw.fa == NULL ||
+        offset != zephyr_img_mgmt_dw.staged) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    while (num_bytes > 0) {
+        /* The buffer to fill may still be being written. */
+        rc = zephyr_img_mgmt_dw_wait(1);
+        if (rc != 0) {
+            return rc;
+        }
+
+        n = MIN(num_bytes, IMG_MGMT_DIRECT_WRITE_BUF - zephyr_img_mgmt_dw.fill);
+        memcpy(zephyr_img_mgmt_dw.buf[zephyr_img_mgmt_dw.cur] +
+               zephyr_img_mgmt_dw.fill, data, n);
+        zephyr_img_mgmt_dw.fill += n;
+        zephyr_img_mgmt_dw.staged += n;
+        data += n;
+        num_bytes -= n;
+
+        if (zephyr_img_mgmt_dw.fill == IMG_MGMT_DIRECT_WRITE_BUF) {
+            zephyr_img_mgmt_dw_submit();
+        }
+    }
+
+    if (!last) {
+        return 0;
+    }
+
+    /* The image must be in flash by the time the upload is reported
+     * complete.
+     */
+    if (zephyr_img_mgmt_dw.fill > 0) {
+        rc = zephyr_img_mgmt_dw_wait(1);
+        if (rc != 0) {
+            return rc;
+        }
+        zephyr_img_mgmt_dw_submit();
+    }
+
+    return zephyr_img_mgmt_dw_wait(0);
+}
+#else
+/* Writer of the upload in progress. */
+#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+static struct flash_img_context *ctx = NULL;
+#else
+static struct flash_img_context ctx_data;
+#define ctx (&ctx_data)
+#endif
+
+/**
+ * Sets up the writer to write the upload slot from its start.
+ */
+static int
+zephyr_img_mgmt_ctx_init(void)
+{
+	int rc;
+
+#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+	if (ctx == NULL) {
+		ctx = k_malloc(sizeof(*ctx));
+
+		if (ctx == NULL) {
+			return MGMT_ERR_ENOMEM;
+		}
+	}
+#endif
+	rc = flash_img_init_id(ctx, g_img_mgmt_state.area_id);
+
+	if (rc != 0) {
+		return MGMT_ERR_EUNKNOWN;
+	}
+
+	return 0;
+}
+#endif
+
+int
+img_mgmt_impl_write_image_data(unsigned int offset, const void *data,
+                               unsigned int num_bytes, bool last)
+{
+	int rc;
+
+#if IMG_MGMT_DIRECT_WRITE_BUF == 0
+#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+	if (offset != 0 && ctx == NULL) {
+		return MGMT_ERR_EUNKNOWN;
+	}
+#endif
+
+	if (offset == 0) {
+		rc = zephyr_img_mgmt_ctx_init();
+		if (rc != 0) {
+			return rc;
+		}
+	}
+
+	if (offset != ctx->stream.bytes_written + ctx->stream.buf_bytes) {
+		return MGMT_ERR_EUNKNOWN;
+	}
+#endif
+
+#if IMG_MGMT_EMPTY_SAMPLES > 0 && !IMG_MGMT_LAZY_ERASE
+	if (offset == 0) {
+		zephyr_img_mgmt_verified_end =
+			zephyr_img_mgmt_slot_erased ? UINT32_MAX : 0;
+		zephyr_img_mgmt_slot_erased = false;
+	}
+
+	/* The slot was only sampled; check pages before writing to them. */
+	if (zephyr_img_mgmt_verified_end < offset + num_bytes) {
+		const struct flash_area *fa;
+
+		rc = flash_area_open(g_img_mgmt_state.area_id, &fa);
+		if (rc != 0) {
+			return MGMT_ERR_EUNKNOWN;
+		}
+
+		rc = zephyr_img_mgmt_verify_erased(fa, offset + num_bytes);
+		flash_area_close(fa);
+		if (rc != 0) {
+			return rc;
+		}
+	}
+#endif
+
+#if IMG_MGMT_DIRECT_WRITE_BUF > 0
+	rc = zephyr_img_mgmt_dw_write(offset, data, num_bytes, last);
+	return rc;
+#else
+	/* Cast away const. */
+	rc = flash_img_buffered_write(ctx, (void *)data, num_bytes, last);
+	if (rc != 0) {
+		return MGMT_ERR_EUNKNOWN;
+	}
+
+#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+	if (last) {
+		k_free(ctx);
+		ctx = NULL;
+	}
+#endif
+
+	return 0;
+#endif
+}
+
+int
+img_mgmt_impl_erase_image_data(unsigned int off, unsigned int num_bytes)
+{
+    const struct flash_area *fa;
+    int rc;
+
+    if (off != 0) {
+        rc = MGMT_ERR_EINVAL;
+        goto end;
+    }
+
+    printf("mcumgr: Uploading image, Clearing %s area (%d) for image\n",
+        g_img_mgmt_state.area_id == zephyr_img_mgmt_flash_area_id(0) ? "Primary" : "Secondary",
+        g_img_mgmt_state.area_id);
+
+    rc = flash_area_open(g_img_mgmt_state.area_id, &fa);
+    if (rc != 0) {
+        LOG_ERR("Can't bind to the flash area (err %d)", rc);
+        rc = MGMT_ERR_EUNKNOWN;
+        goto end;
+    }
+
+    /* align requested erase size to the erase-block-size */
+    const struct device *dev = flash_area_get_device(fa);
+    struct flash_pages_info page;
+    off_t page_offset = fa->fa_off + num_bytes - 1;
+
+    rc = flash_get_page_info_by_offs(dev, page_offset, &page);
+    if (rc != 0) {
+        LOG_ERR("bad offset (0x%lx)", (long)page_offset);
+        rc = MGMT_ERR_EUNKNOWN;
+        goto end_fa;
+    }
+
+    size_t erase_size = page.start_offset + page.size - fa->fa_off;
+
+    rc = flash_area_erase(fa, 0, erase_size);
+
+    if (rc != 0) {
+        LOG_ERR("image slot erase of 0x%zx bytes failed (err %d)", erase_size,
+                rc);
+        rc = MGMT_ERR_EUNKNOWN;
+        goto end_fa;
+    }
+
+    LOG_INF("Erased 0x%zx bytes of image slot", erase_size);
+
+#if IMG_MGMT_EMPTY_SAMPLES > 0 && !IMG_MGMT_LAZY_ERASE
+    zephyr_img_mgmt_slot_erased = true;
+#endif
+
+    /* erase the image trailer area if it was not erased */
+    off = BOOT_TRAILER_IMG_STATUS_OFFS(fa);
+    if (off >= erase_size) {
+        rc = flash_get_page_info_by_offs(dev, fa->fa_off + off, &page);
+
+        off = page.start_offset - fa->fa_off;
+        erase_size = fa->fa_size - off;
+
+        rc = flash_area_erase(fa, off, erase_size);
+        if (rc != 0) {
+            LOG_ERR("image slot trailer erase of 0x%zx bytes failed (err %d)",
+                    erase_size, rc);
+            rc = MGMT_ERR_EUNKNOWN;
+            goto end_fa;
+        }
+
+        LOG_INF("Erased 0x%zx bytes of image slot trailer", erase_size);
+    }
+
+    rc = 0;
+
+end_fa:
     flash_area_close(fa);
 end:
     return rc;
 }
 
-#if IMG_MGMT_LAZY_ERASE
-int img_mgmt_impl_erase_if_needed(uint32_t off, uint32_t len)
+#if IMG_MGMT_LAZY_ERASE
+int img_mgmt_impl_erase_if_needed(uint32_t off, uint32_t len)
+{
+    /* This is done internally to the flash_img API. */
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_ERASE_AHEAD > 0
+/**
+ * State of the background eraser that runs ahead of an image upload.  The
+ * eraser works one erase page at a time from the start of the slot up to
+ * target_end, then erases the image trailer once the whole image area is
+ * done.
+ */
+static struct {
+    /* Slot being erased; NULL if there is nothing to erase. */
+    const struct flash_area *fa;
+    /* Incremented whenever a new upload restarts the eraser. */
+    uint32_t gen;
+    /* Size of the image being uploaded. */
+    uint32_t size;
+    /* End of the erase-page-aligned image area. */
+    uint32_t limit;
+    /* How far, in bytes, to stay ahead of the data being written. */
+    uint32_t ahead;
+    /* The slot is erased up to this offset. */
+    uint32_t erased_end;
+    /* The eraser idles once erased_end reaches this offset. */
+    uint32_t target_end;
+    /* Start of the erase page holding the image trailer. */
+    uint32_t trailer_off;
+    bool trailer_erased;
+    /* MGMT_ERR_[...] code of the first failed erase. */
+    int rc;
+#if IMG_MGMT_ERASE_ASYNC
+    /* Whether the eraser was started by an erase command rather than an
+     * upload; the whole slot gets erased.
+     */
+    bool job;
+#endif
+} zephyr_img_mgmt_ea;
+
+static K_MUTEX_DEFINE(zephyr_img_mgmt_ea_mtx);
+static K_SEM_DEFINE(zephyr_img_mgmt_ea_sem, 0, 1);
+
+static void zephyr_img_mgmt_ea_work_fn(struct k_work *work);
+static K_WORK_DEFINE(zephyr_img_mgmt_ea_work, zephyr_img_mgmt_ea_work_fn);
+
+/**
+ * Indicates whether the eraser has work left.  Must be called with the
+ * eraser mutex held.
+ */
+static bool
+zephyr_img_mgmt_ea_busy(void)
+{
+    if (zephyr_img_mgmt_ea.fa == NULL || zephyr_img_mgmt_ea.rc != 0) {
+        return false;
+    }
+
+    return zephyr_img_mgmt_ea.erased_end < zephyr_img_mgmt_ea.target_end ||
+           (zephyr_img_mgmt_ea.erased_end >= zephyr_img_mgmt_ea.limit &&
+            !zephyr_img_mgmt_ea.trailer_erased);
+}
+
+/**
+ * Erases the next erase page (or the trailer) and resubmits itself until the
+ * target is reached.  Erasing a page at a time keeps the work queue
+ * responsive.
+ */
+static void
+zephyr_img_mgmt_ea_work_fn(struct k_work *work)
+{
+    const struct flash_area *fa;
+    struct flash_pages_info page;
+    bool trailer;
+    uint32_t gen;
+    off_t off;
+    size_t len;
+#if IMG_MGMT_ERASE_ASYNC
+    bool job_done;
+#endif
+    bool more;
+    int rc;
+
+    k_mutex_lock(&zephyr_img_mgmt_ea_mtx, K_FOREVER);
+    if (!zephyr_img_mgmt_ea_busy()) {
+        k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+        return;
+    }
+
+    fa = zephyr_img_mgmt_ea.fa;
+    gen = zephyr_img_mgmt_ea.gen;
+    trailer = zephyr_img_mgmt_ea.erased_end >= zephyr_img_mgmt_ea.limit;
+    if (trailer) {
+        off = zephyr_img_mgmt_ea.trailer_off;
+    } else {
+        off = zephyr_img_mgmt_ea.erased_end;
+    }
+    k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+
+    /* The erase runs unlocked so that writes to already erased pages are
+     * not held up by it.
+     */
+    if (trailer) {
+        len = fa->fa_size - off;
+        rc = 0;
+    } else {
+        rc = flash_get_page_info_by_offs(flash_area_get_device(fa),
+                                         fa->fa_off + off, &page);
+        len = page.start_offset + page.size - fa->fa_off - off;
+    }
+    if (rc == 0) {
+        rc = flash_area_erase(fa, off, len);
+    }
+
+    k_mutex_lock(&zephyr_img_mgmt_ea_mtx, K_FOREVER);
+    more = false;
+#if IMG_MGMT_ERASE_ASYNC
+    job_done = false;
+#endif
+    if (gen == zephyr_img_mgmt_ea.gen) {
+        if (rc != 0) {
+            LOG_ERR("image slot erase-ahead at 0x%lx failed (err %d)",
+                    (long)off, rc);
+            zephyr_img_mgmt_ea.rc = MGMT_ERR_EUNKNOWN;
+        } else if (trailer) {
+            zephyr_img_mgmt_ea.trailer_erased = true;
+        } else {
+            zephyr_img_mgmt_ea.erased_end = off + len;
+        }
+        more = zephyr_img_mgmt_ea_busy();
+#if IMG_MGMT_ERASE_ASYNC
+        job_done = zephyr_img_mgmt_ea.job && !more;
+#endif
+    }
+    k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+
+#if IMG_MGMT_ERASE_ASYNC
+    if (job_done) {
+        /* Reads made while the job ran may have cached the old image
+         * header and trailer; the erase command only invalidated them
+         * when the job started.
+         */
+        img_mgmt_meta_invalidate();
+        img_mgmt_state_invalidate();
+    }
+#endif
+
+    k_sem_give(&zephyr_img_mgmt_ea_sem);
+    if (more) {
+        k_work_submit_to_queue(&zephyr_img_mgmt_workq, work);
+    }
+}
+
+/**
+ * Starts the background eraser for an upload of the specified size into the
+ * specified flash area.  The slot is taken to be erased up to erased_end
+ * already.  A job erases the whole area without waiting for writes; its size
+ * is clipped to that of the area.
+ */
+static int
+zephyr_img_mgmt_ea_start(int area_id, unsigned int num_bytes,
+                         uint32_t erased_end, bool job)
+{
+    const struct flash_area *fa;
+    struct flash_pages_info page;
+    const struct device *dev;
+    uint32_t limit;
+    int rc;
+
+    k_mutex_lock(&zephyr_img_mgmt_ea_mtx, K_FOREVER);
+
+    /* Abandon the previous upload's eraser, if any. */
+    if (zephyr_img_mgmt_ea.fa != NULL) {
+        flash_area_close(zephyr_img_mgmt_ea.fa);
+        zephyr_img_mgmt_ea.fa = NULL;
+    }
+    zephyr_img_mgmt_ea.gen++;
+
+    if (num_bytes == 0) {
+        rc = 0;
+        goto end;
+    }
+
+    rc = flash_area_open(area_id, &fa);
+    if (rc != 0) {
+        LOG_ERR("Can't bind to the flash area (err %d)", rc);
+        rc = MGMT_ERR_EUNKNOWN;
+        goto end;
+    }
+    dev = flash_area_get_device(fa);
+
+    if (num_bytes > fa->fa_size) {
+        num_bytes = fa->fa_size;
+    }
+
+    /* align the image area to the erase-block-size */
+    rc = flash_get_page_info_by_offs(dev, fa->fa_off + num_bytes - 1, &page);
+    if (rc != 0) {
+        goto err;
+    }
+    limit = page.start_offset + page.size - fa->fa_off;
+
+    rc = flash_get_page_info_by_offs(dev, fa->fa_off, &page);
+    if (rc != 0) {
+        goto err;
+    }
+    zephyr_img_mgmt_ea.ahead = page.size * IMG_MGMT_ERASE_AHEAD;
+
+    rc = flash_get_page_info_by_offs(dev,
+                                     fa->fa_off + BOOT_TRAILER_IMG_STATUS_OFFS(fa),
+                                     &page);
+    if (rc != 0) {
+        goto err;
+    }
+    zephyr_img_mgmt_ea.trailer_off = page.start_offset - fa->fa_off;
+
+    /* The trailer needs a separate erase only if the image does not reach
+     * it.
+     */
+    zephyr_img_mgmt_ea.trailer_erased = zephyr_img_mgmt_ea.trailer_off < limit;
+
+    zephyr_img_mgmt_ea.fa = fa;
+    zephyr_img_mgmt_ea.size = num_bytes;
+    zephyr_img_mgmt_ea.limit = limit;
+    zephyr_img_mgmt_ea.erased_end = MIN(erased_end, limit);
+    if (job) {
+        zephyr_img_mgmt_ea.target_end = limit;
+    } else {
+        zephyr_img_mgmt_ea.target_end =
+            MIN(erased_end + zephyr_img_mgmt_ea.ahead, limit);
+    }
+    zephyr_img_mgmt_ea.rc = 0;
+#if IMG_MGMT_ERASE_ASYNC
+    zephyr_img_mgmt_ea.job = job;
+#endif
+
+#if IMG_MGMT_EMPTY_SAMPLES > 0
+    zephyr_img_mgmt_slot_erased = true;
+#endif
+
+    k_sem_reset(&zephyr_img_mgmt_ea_sem);
+    k_work_submit_to_queue(&zephyr_img_mgmt_workq, &zephyr_img_mgmt_ea_work);
+    rc = 0;
+    goto end;
+
+err:
+    LOG_ERR("bad erase-ahead geometry (err %d)", rc);
+    flash_area_close(fa);
+    rc = MGMT_ERR_EUNKNOWN;
+end:
+    k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+    return rc;
+}
+
+int
+img_mgmt_impl_erase_ahead_start(unsigned int num_bytes)
+{
+    uint32_t erased_end;
+
+    erased_end = 0;
+
+#if IMG_MGMT_ERASE_ASYNC
+    /* An upload into a slot that an erase job is working on carries on
+     * from the pages the job has erased so far.
+     */
+    k_mutex_lock(&zephyr_img_mgmt_ea_mtx, K_FOREVER);
+    if (zephyr_img_mgmt_ea.job && zephyr_img_mgmt_ea.fa != NULL &&
+        zephyr_img_mgmt_ea.fa->fa_id == g_img_mgmt_state.area_id &&
+        zephyr_img_mgmt_ea.rc == 0) {
+
+        erased_end = zephyr_img_mgmt_ea.erased_end;
+    }
+    k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+#endif
+
+    return zephyr_img_mgmt_ea_start(g_img_mgmt_state.area_id, num_bytes,
+                                    erased_end, false);
+}
+
+#if IMG_MGMT_ERASE_ASYNC
+int
+img_mgmt_impl_erase_slot_start(uint32_t *out_job)
+{
+    bool empty;
+    int area_id;
+    int rc;
+
+    area_id = zephyr_img_mgmt_erase_area_id();
+    if (area_id < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = zephyr_img_mgmt_flash_check_empty(area_id, &empty);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    /* An empty slot gets a job that is complete from the start. */
+    rc = zephyr_img_mgmt_ea_start(area_id, UINT32_MAX,
+                                  empty ? UINT32_MAX : 0, true);
+    if (rc != 0) {
+        return rc;
+    }
+
+    k_mutex_lock(&zephyr_img_mgmt_ea_mtx, K_FOREVER);
+    *out_job = zephyr_img_mgmt_ea.gen;
+    k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+
+    return 0;
+}
+
+int
+img_mgmt_impl_erase_status(struct img_mgmt_erase_status *out_status)
+{
+    int rc;
+
+    k_mutex_lock(&zephyr_img_mgmt_ea_mtx, K_FOREVER);
+    if (!zephyr_img_mgmt_ea.job || zephyr_img_mgmt_ea.fa == NULL) {
+        rc = MGMT_ERR_ENOENT;
+    } else {
+        out_status->job = zephyr_img_mgmt_ea.gen;
+        out_status->done = zephyr_img_mgmt_ea.erased_end;
+        out_status->total = zephyr_img_mgmt_ea.limit;
+        out_status->busy = zephyr_img_mgmt_ea_busy();
+        out_status->rc = zephyr_img_mgmt_ea.rc;
+        rc = 0;
+    }
+    k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+
+    return rc;
+}
+#endif
+
+/**
+ * Indicates whether everything an upload needs erased before writing up to the
+ * specified offset has been erased.  Must be called with the eraser mutex
+ * held.
+ */
+static bool
+zephyr_img_mgmt_ea_ready(uint32_t end)
 {
-    /* This is done internally to the flash_img API. */
-    return 0;
+    if (zephyr_img_mgmt_ea.erased_end < MIN(end, zephyr_img_mgmt_ea.limit)) {
+        return false;
+    }
+
+    /* The last chunk also waits for the trailer. */
+    return end < zephyr_img_mgmt_ea.size || zephyr_img_mgmt_ea.trailer_erased;
+}
+
+int
+img_mgmt_impl_erase_if_needed(uint32_t off, uint32_t len)
+{
+    uint32_t target;
+    bool kick;
+    bool ready;
+    int rc;
+
+    k_mutex_lock(&zephyr_img_mgmt_ea_mtx, K_FOREVER);
+    if (zephyr_img_mgmt_ea.fa == NULL) {
+        /* The slot was empty to begin with. */
+        k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+        return 0;
+    }
+
+    /* Move the target forward.  The eraser is kicked even if it is running,
+     * as it may already have decided to idle.
+     */
+    target = MIN(off + len + zephyr_img_mgmt_ea.ahead,
+                 zephyr_img_mgmt_ea.limit);
+    kick = target > zephyr_img_mgmt_ea.target_end;
+    if (kick) {
+        zephyr_img_mgmt_ea.target_end = target;
+    }
+    k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+
+    if (kick) {
+        k_work_submit_to_queue(&zephyr_img_mgmt_workq,
+                               &zephyr_img_mgmt_ea_work);
+    }
+
+    /* Wait for the eraser to clear the pages about to be written.  This only
+     * blocks if the upload has caught up with it.
+     */
+    while (1) {
+        k_mutex_lock(&zephyr_img_mgmt_ea_mtx, K_FOREVER);
+        rc = zephyr_img_mgmt_ea.rc;
+        ready = zephyr_img_mgmt_ea_ready(off + len);
+        k_mutex_unlock(&zephyr_img_mgmt_ea_mtx);
+
+        if (rc != 0 || ready) {
+            return rc;
+        }
+
+        k_sem_take(&zephyr_img_mgmt_ea_sem, K_FOREVER);
+    }
 }
 #endif
 
 int
-img_mgmt_impl_swap_type(void)
+img_mgmt_impl_swap_type(int slot)
 {
+#if IMG_MGMT_IMAGE_COUNT > 1
+    int swap = mcuboot_swap_type_multi(IMG_MGMT_SLOT_IMAGE(slot));
+#else
     int swap = mcuboot_swap_type();
+#endif
     switch (swap) {
     case BOOT_SWAP_TYPE_NONE:
         return IMG_MGMT_SWAP_TYPE_NONE;
@@ -627,9 +1504,10 @@ img_mgmt_impl_upload_inspect(const struct img_mgmt_upload_req *req,
                              const char **errstr)
 {
     const struct image_header *hdr;
+#if defined(CONFIG_IMG_MGMT_REJECT_DIRECT_XIP_MISMATCHED_SLOT)
     const struct flash_area *fa;
+#endif
     struct image_version cur_ver;
-    uint8_t rem_bytes;
     bool empty;
     int rc;
 
@@ -658,7 +1536,7 @@ img_mgmt_impl_upload_inspect(const struct img_mgmt_upload_req *req,
         }
         action->size = req->size;
 
-        hdr = (struct image_header *)req->img_data;
+        hdr = (const struct image_header *)req->img_data;
         if (hdr->ih_magic != IMAGE_MAGIC) {
             *errstr = img_mgmt_err_str_magic_mismatch;
             return MGMT_ERR_EINVAL;
@@ -682,7 +1560,17 @@ img_mgmt_impl_upload_inspect(const struct img_mgmt_upload_req *req,
             }
         }
 
+#if IMG_MGMT_IMAGE_COUNT > 1
+        /* The image number selects the secondary slot of that image. */
+        if (req->image >= IMG_MGMT_IMAGE_COUNT) {
+            *errstr = img_mgmt_err_str_no_slot;
+            return MGMT_ERR_EINVAL;
+        }
+        action->area_id = img_mgmt_get_unused_slot_area_id(
+            IMG_MGMT_IMAGE_SLOT(req->image, 1));
+#else
         action->area_id = img_mgmt_get_unused_slot_area_id(req->image - 1);
+#endif
         if (action->area_id < 0) {
             /* No slot where to upload! */
             *errstr = img_mgmt_err_str_no_slot;
@@ -749,25 +1637,10 @@ img_mgmt_impl_upload_inspect(const struct img_mgmt_upload_req *req,
         }
     }
 
-    /* Calculate size of flash write. */
+    /* The whole chunk is accepted; the writer buffers up to the flash write
+     * alignment.
+     */
     action->write_bytes = req->data_len;
-    if (req->off + req->data_len < action->size) {
-        /*
-         * Respect flash write alignment if not in the last block
-         */
-        rc = flash_area_open(action->area_id, &fa);
-        if (rc) {
-            *errstr = img_mgmt_err_str_flash_open_failed;
-            return MGMT_ERR_EUNKNOWN;
-        }
-
-        rem_bytes = req->data_len % flash_area_align(fa);
-        flash_area_close(fa);
-
-        if (rem_bytes) {
-            action->write_bytes -= rem_bytes;
-        }
-    }
 
     action->proceed = true;
     return 0;
@@ -789,3 +1662,321 @@ img_mgmt_impl_erased_val(int slot, uint8_t *erased_val)
 
     return 0;
 }
+
+#if IMG_MGMT_DL
+int
+img_mgmt_impl_slot_size(int slot, uint32_t *out_size)
+{
+    const struct flash_area *fa;
+    int rc;
+
+    rc = flash_area_open(zephyr_img_mgmt_flash_area_id(slot), &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_size = fa->fa_size;
+    flash_area_close(fa);
+
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_MCAST
+int
+img_mgmt_impl_mcast_begin(int image, uint32_t size, int *out_area_id)
+{
+    const struct flash_area *fa;
+    int area_id;
+    int rc;
+
+#if IMG_MGMT_IMAGE_COUNT > 1
+    if (image < 0 || image >= IMG_MGMT_IMAGE_COUNT) {
+        return MGMT_ERR_EINVAL;
+    }
+    area_id = img_mgmt_get_unused_slot_area_id(IMG_MGMT_IMAGE_SLOT(image, 1));
+#else
+    area_id = img_mgmt_get_unused_slot_area_id(image - 1);
+#endif
+    if (area_id < 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    rc = flash_area_open(area_id, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+    rc = size > fa->fa_size ? MGMT_ERR_EINVAL : 0;
+    flash_area_close(fa);
+    if (rc != 0) {
+        return rc;
+    }
+
+    /* The eraser works on the area being uploaded to. */
+    g_img_mgmt_state.area_id = area_id;
+    rc = img_mgmt_impl_erase_image_data(0, size);
+    if (rc != 0) {
+        return rc;
+    }
+
+    *out_area_id = area_id;
+    return 0;
+}
+
+/* Largest flash write alignment that the end of a multicast upload can be
+ * padded to.
+ */
+#define ZEPHYR_IMG_MGMT_MCAST_ALIGN_MAX     32
+
+int
+img_mgmt_impl_mcast_write(unsigned int offset, const void *data,
+                          unsigned int num_bytes)
+{
+    uint8_t pad[ZEPHYR_IMG_MGMT_MCAST_ALIGN_MAX];
+    const struct flash_area *fa;
+    size_t align;
+    size_t body;
+    int rc;
+
+    rc = flash_area_open(g_img_mgmt_state.area_id, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    align = flash_area_align(fa);
+    if (align > sizeof pad || offset % align != 0) {
+        flash_area_close(fa);
+        return MGMT_ERR_EINVAL;
+    }
+
+    body = num_bytes - num_bytes % align;
+    if (body > 0) {
+        rc = flash_area_write(fa, offset, data, body);
+    }
+
+    /* Pad the end of the image out to a whole write unit. */
+    if (rc == 0 && body < num_bytes) {
+        memset(pad, flash_area_erased_val(fa), align);
+        memcpy(pad, (const uint8_t *)data + body, num_bytes - body);
+        rc = flash_area_write(fa, offset + body, pad, align);
+    }
+
+    flash_area_close(fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_SHA256
+static mbedtls_sha256_context zephyr_img_mgmt_sha256;
+
+int
+img_mgmt_impl_sha256_start(void)
+{
+    mbedtls_sha256_init(&zephyr_img_mgmt_sha256);
+    if (mbedtls_sha256_starts_ret(&zephyr_img_mgmt_sha256, 0) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_sha256_update(const void *data, size_t len)
+{
+    if (mbedtls_sha256_update_ret(&zephyr_img_mgmt_sha256, data, len) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_sha256_finish(uint8_t *digest)
+{
+    int rc;
+
+    rc = mbedtls_sha256_finish_ret(&zephyr_img_mgmt_sha256, digest);
+    mbedtls_sha256_free(&zephyr_img_mgmt_sha256);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+#define ZEPHYR_IMG_MGMT_JOURNAL_KEY "img_mgmt/ul"
+
+/** Destination of a journal being loaded from settings. */
+struct zephyr_img_mgmt_journal_arg {
+    struct img_mgmt_journal *journal;
+    bool found;
+};
+
+static int
+zephyr_img_mgmt_journal_load(const char *key, size_t len,
+                             settings_read_cb read_cb, void *cb_arg,
+                             void *param)
+{
+    struct zephyr_img_mgmt_journal_arg *arg;
+    ssize_t rc;
+
+    arg = param;
+
+    /* Only the key itself holds the journal. */
+    if (settings_name_next(key, NULL) != 0 || len != sizeof *arg->journal) {
+        return 0;
+    }
+
+    rc = read_cb(cb_arg, arg->journal, sizeof *arg->journal);
+    if (rc == sizeof *arg->journal) {
+        arg->found = true;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_journal_read(struct img_mgmt_journal *journal)
+{
+    struct zephyr_img_mgmt_journal_arg arg = {
+        .journal = journal,
+        .found = false,
+    };
+    int rc;
+
+    rc = settings_load_subtree_direct(ZEPHYR_IMG_MGMT_JOURNAL_KEY,
+                                      zephyr_img_mgmt_journal_load, &arg);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+    if (!arg.found) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_journal_write(const struct img_mgmt_journal *journal)
+{
+    int rc;
+
+    rc = settings_save_one(ZEPHYR_IMG_MGMT_JOURNAL_KEY, journal,
+                           sizeof *journal);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+img_mgmt_impl_journal_clear(void)
+{
+    int rc;
+
+    rc = settings_delete(ZEPHYR_IMG_MGMT_JOURNAL_KEY);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+uint32_t
+img_mgmt_impl_durable_off(void)
+{
+#if IMG_MGMT_DIRECT_WRITE_BUF > 0
+    uint32_t written;
+
+    /* Staged data would be lost in a reset. */
+    k_mutex_lock(&zephyr_img_mgmt_dw_mtx, K_FOREVER);
+    written = zephyr_img_mgmt_dw.written;
+    k_mutex_unlock(&zephyr_img_mgmt_dw_mtx);
+
+    return written;
+#else
+#if (CONFIG_HEAP_MEM_POOL_SIZE > 0)
+    if (ctx == NULL) {
+        return 0;
+    }
+#endif
+
+    /* Data still in the write buffer would be lost in a reset. */
+    return ctx->stream.bytes_written;
+#endif
+}
+
+int
+img_mgmt_impl_upload_resume(uint32_t off)
+{
+    const struct flash_area *fa;
+    struct flash_pages_info page;
+    int rc;
+
+#if IMG_MGMT_DIRECT_WRITE_BUF > 0
+    rc = zephyr_img_mgmt_dw_start(off);
+    if (rc != 0) {
+        return rc;
+    }
+#else
+    rc = zephyr_img_mgmt_ctx_init();
+    if (rc != 0) {
+        return rc;
+    }
+    ctx->stream.bytes_written = off;
+#endif
+
+    rc = flash_area_open(g_img_mgmt_state.area_id, &fa);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    /* The page holding the last written byte was erased before it was
+     * written to; the rest of it is still erased.
+     */
+    rc = flash_get_page_info_by_offs(flash_area_get_device(fa),
+                                     fa->fa_off + off - 1, &page);
+    if (rc != 0) {
+        flash_area_close(fa);
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+#if IMG_MGMT_LAZY_ERASE
+    /* flash_img tracks the erased page by its absolute offset. */
+    ctx->stream.last_erased_page_start_offset = page.start_offset;
+#endif
+
+    /* Make the page offset relative to the slot. */
+    page.start_offset -= fa->fa_off;
+    flash_area_close(fa);
+
+#if !IMG_MGMT_LAZY_ERASE && IMG_MGMT_ERASE_AHEAD > 0
+    /* It is not known how far the eraser got; erase the rest again. */
+    rc = zephyr_img_mgmt_ea_start(g_img_mgmt_state.area_id,
+                                  g_img_mgmt_state.size,
+                                  page.start_offset + page.size, false);
+    if (rc != 0) {
+        return rc;
+    }
+#endif
+
+#if IMG_MGMT_EMPTY_SAMPLES > 0 && !IMG_MGMT_LAZY_ERASE
+    /* Pages beyond the written data are checked as they are reached. */
+    zephyr_img_mgmt_slot_erased = false;
+#if IMG_MGMT_ERASE_AHEAD > 0
+    zephyr_img_mgmt_verified_end = UINT32_MAX;
+#else
+    zephyr_img_mgmt_verified_end = page.start_offset + page.size;
+#endif
+#endif
+
+    return 0;
+}
+#endif
@@ -29,39 +29,327 @@
 #include "img_mgmt/img_mgmt_impl.h"
 #include "img_mgmt_priv.h"
 #include "img_mgmt/img_mgmt_config.h"
+#if IMG_MGMT_DL_COMP
+#include "util/mcumgr_hs.h"
+#endif
 
 static mgmt_handler_fn img_mgmt_upload;
 static mgmt_handler_fn img_mgmt_erase;
+#if IMG_MGMT_ERASE_ASYNC
+static mgmt_handler_fn img_mgmt_erase_state;
+#endif
+#if IMG_MGMT_DELTA
+static mgmt_handler_fn img_mgmt_delta;
+#endif
+#if IMG_MGMT_VERIFY
+static mgmt_handler_fn img_mgmt_verify_read;
+static mgmt_handler_fn img_mgmt_verify_write;
+static void img_mgmt_verify_cancel(void);
+#endif
+#if IMG_MGMT_DL
+static mgmt_handler_fn img_mgmt_download;
+#endif
+#if IMG_MGMT_MCAST
+static mgmt_handler_fn img_mgmt_mcast_read;
+static mgmt_handler_fn img_mgmt_mcast_write;
+static void img_mgmt_mcast_cancel(void);
+#endif
 static img_mgmt_upload_fn *img_mgmt_upload_cb;
 static void *img_mgmt_upload_arg;
 
+static struct img_mgmt_ul_prof *img_mgmt_ul_prof;
+static img_mgmt_clock_fn *img_mgmt_ul_clock;
+
+/* Adds the time elapsed since `start_` to a field of the upload profile. */
+#define IMG_MGMT_PROF_ADD(field_, start_) do {                            \
+    if (img_mgmt_ul_prof != NULL) {                                       \
+        img_mgmt_ul_prof->field_ += img_mgmt_ul_clock() - (start_);       \
+    }                                                                     \
+} while (0)
+
+static uint32_t
+img_mgmt_prof_now(void)
+{
+    if (img_mgmt_ul_prof == NULL) {
+        return 0;
+    }
+
+    return img_mgmt_ul_clock();
+}
+
 const img_mgmt_dfu_callbacks_t *img_mgmt_dfu_callbacks_fn;
 
 struct img_mgmt_state g_img_mgmt_state;
 
+volatile uint32_t img_mgmt_state_epoch;
+
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+/** A chunk received ahead of the write cursor; free if `len` is 0. */
+struct img_mgmt_window_slot {
+    uint32_t off;
+    uint32_t len;
+    uint8_t data[IMG_MGMT_UL_CHUNK_SIZE];
+};
+
+static struct img_mgmt_window_slot img_mgmt_window[IMG_MGMT_UL_WINDOW_SIZE];
+#endif
+
+/**
+ * Holds chunk data that cannot be used in place, i.e., fragmented chunks and
+ * the first chunk (whose image header must be word aligned).
+ */
+static uint32_t img_mgmt_ul_buf[(IMG_MGMT_UL_CHUNK_SIZE + 3) / 4];
+
+/**
+ * The most image data an upload request may carry.  Data beyond a chunk is
+ * consumed in chunk-sized pieces, so this does not affect RAM use.
+ */
+#if IMG_MGMT_UL_FRAME_SIZE > IMG_MGMT_UL_CHUNK_SIZE
+#define IMG_MGMT_UL_DATA_MAX    IMG_MGMT_UL_FRAME_SIZE
+#else
+#define IMG_MGMT_UL_DATA_MAX    IMG_MGMT_UL_CHUNK_SIZE
+#endif
+
+/**
+ * Parsed image header and TLV hash of an image slot.  The cache doubles as
+ * the hash index that img_mgmt_find_by_hash() searches; it is filled when the
+ * group is registered and refreshed when an upload completes, so lookups done
+ * by image state writes do not touch flash.
+ */
+struct img_mgmt_meta {
+    /** Whether the entry holds the result of a read. */
+    bool valid;
+    /** Result of the read; 0 or MGMT_ERR_ENOENT (empty slot). */
+    int rc;
+    struct image_version ver;
+    uint8_t hash[IMAGE_HASH_LEN];
+    uint32_t flags;
+};
+
+static struct img_mgmt_meta img_mgmt_meta_cache[IMG_MGMT_SLOT_COUNT];
+
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+/** Upload offset recorded by the last journal write. */
+static uint32_t img_mgmt_journal_off;
+/** Whether a journal may be stored. */
+static bool img_mgmt_journal_valid;
+/** Whether the journal has been read since boot. */
+static bool img_mgmt_journal_loaded;
+#endif
+
+#if IMG_MGMT_DECODE
+/**
+ * Image being produced on the device from a patch or compressed stream, and
+ * written through the regular upload path.
+ */
+static struct {
+    /** Size of the produced image. */
+    uint32_t size;
+    /** Number of image bytes produced, including those in `buf`. */
+    uint32_t off;
+    /** Produced image bytes not yet written to flash. */
+    uint16_t buf_len;
+    uint8_t buf[IMG_MGMT_DECODE_BUF_SIZE];
+} img_mgmt_decode;
+#endif
+
+#if IMG_MGMT_DELTA
+/** Phases of applying a patch. */
+#define IMG_MGMT_DELTA_PHASE_HDR    0
+#define IMG_MGMT_DELTA_PHASE_CTRL   1
+#define IMG_MGMT_DELTA_PHASE_DIFF   2
+#define IMG_MGMT_DELTA_PHASE_EXTRA  3
+#define IMG_MGMT_DELTA_PHASE_DONE   4
+
+/** State of the patch being applied to the running image. */
+static struct {
+    /** Total size of the patch; 0 if no patch is being applied. */
+    uint32_t patch_size;
+    /** Offset of the next expected patch chunk. */
+    uint32_t patch_off;
+    /** Offset in the running image that the next diff byte applies to. */
+    uint32_t src_off;
+    /** Bytes left in the current diff or extra block. */
+    uint32_t remaining;
+    uint8_t phase;
+    /** Header or control record being assembled. */
+    union {
+        struct img_mgmt_delta_hdr hdr;
+        struct img_mgmt_delta_ctrl ctrl;
+        uint8_t bytes[sizeof(struct img_mgmt_delta_ctrl)];
+    } rec;
+    uint8_t rec_fill;
+} img_mgmt_delta_state;
+#endif
+
+#if IMG_MGMT_UL_SHA256
+/**
+ * Verification of an upload against its hash TLV.  The leading hash_len
+ * bytes of the image are hashed as they are written; the TLV area that
+ * follows is scanned for the expected hash.
+ */
+static struct {
+    /** Image bytes covered by the hash: header, body and protected TLVs. */
+    uint32_t hash_len;
+    /** End of the unprotected TLV area; 0 until its info header is seen. */
+    uint32_t tlv_end;
+    /** End of the value of the TLV being scanned. */
+    uint32_t val_end;
+    /** TLV info or TLV header being assembled. */
+    union {
+        struct image_tlv_info info;
+        struct image_tlv tlv;
+        uint8_t bytes[4];
+    } hdr;
+    uint8_t hdr_fill;
+    /** Whether the TLV being scanned is the SHA-256. */
+    bool in_hash;
+    uint8_t expected_fill;
+    uint8_t expected[IMAGE_HASH_LEN];
+    uint8_t digest[IMAGE_HASH_LEN];
+    /** Whether the digest is complete. */
+    bool digest_done;
+    /** Whether the scan has stopped; at the end of or on a bad TLV area. */
+    bool tlv_done;
+} img_mgmt_ul_hash;
+#endif
+
+#if IMG_MGMT_VERIFY
+/**
+ * Verification of the contents of a slot against its hash TLV.  The slot is
+ * hashed in steps of IMG_MGMT_VERIFY_STEP bytes, one step per verify request,
+ * so that no single request holds the transport for the whole slot.
+ */
+static struct {
+    /** Slot being verified; -1 if no verification was started. */
+    int slot;
+    /** Image bytes covered by the hash: header, body and protected TLVs. */
+    uint32_t len;
+    /** Number of bytes hashed so far. */
+    uint32_t off;
+    /** MGMT_ERR_[...] code of a failed read or hash; 0 if none failed. */
+    int rc;
+    /** Whether the slot is still being hashed. */
+    bool busy;
+    /** Whether the digest matches the hash TLV; valid once done. */
+    bool match;
+    uint8_t expected[IMAGE_HASH_LEN];
+} img_mgmt_verify_state = {
+    .slot = -1,
+};
+
+static uint32_t img_mgmt_verify_buf[(IMG_MGMT_VERIFY_BUF_SIZE + 3) / 4];
+#endif
+
+#if IMG_MGMT_DL
+/* Worst-case size of an image download response body, excluding the slot
+ * data: map header, "off", "data" byte string header, "rc", "rlen", "len".
+ */
+#define IMG_MGMT_DL_RSP_OVERHEAD    48
+
+/* Size of the stack buffer that slot data is compressed from. */
+#define IMG_MGMT_DL_COMP_PIECE      64
+
+/** Slot data, or its compressed form, of the download chunk being sent. */
+static uint32_t img_mgmt_dl_buf[(IMG_MGMT_DL_CHUNK_SIZE + 3) / 4];
+
+#if IMG_MGMT_DL_COMP
+static struct mcumgr_hs_enc img_mgmt_dl_enc;
+#endif
+#endif
+
+#if IMG_MGMT_MCAST
+/* Worst-case size of a multicast upload read response body, excluding the
+ * bitmap: map header, "sid", "len", "unit", "cnt", "rcvd", "rc", "start" and
+ * the "map" byte string header.
+ */
+#define IMG_MGMT_MCAST_RSP_OVERHEAD 64
+
+/* Most bytes of the received-chunk bitmap sent in one read response. */
+#define IMG_MGMT_MCAST_MAP_MAX      128
+
+/**
+ * State of the multicast upload in progress.  The chunks of an image are
+ * numbered from 0; chunk n starts at image offset n * unit.
+ */
+static struct {
+    /** Whether `sid` names an upload, in progress or ended. */
+    bool open;
+    /** Session ID the client gave the upload. */
+    uint32_t sid;
+    /** Result of the upload so far; the upload is abandoned if nonzero. */
+    int rc;
+    /** Total size of image data. */
+    uint32_t size;
+    /** Size of each chunk except the last. */
+    uint32_t unit;
+    /** Number of chunks in the image. */
+    uint32_t cnt;
+    /** Number of distinct chunks written. */
+    uint32_t rcvd;
+    /** Bit n % 8 of byte n / 8 is set once chunk n is written. */
+    uint8_t map[(IMG_MGMT_MCAST_CHUNKS + 7) / 8];
+} img_mgmt_mcast;
+#endif
+
 static const struct mgmt_handler img_mgmt_handlers[] = {
     [IMG_MGMT_ID_STATE] = {
         .mh_read = img_mgmt_state_read,
         .mh_write = img_mgmt_state_write,
+        .mh_read_epoch = &img_mgmt_state_epoch,
     },
     [IMG_MGMT_ID_UPLOAD] = {
         .mh_read = NULL,
         .mh_write = img_mgmt_upload
     },
     [IMG_MGMT_ID_ERASE] = {
+#if IMG_MGMT_ERASE_ASYNC
+        .mh_read = img_mgmt_erase_state,
+#else
         .mh_read = NULL,
+#endif
         .mh_write = img_mgmt_erase
     },
+#if IMG_MGMT_DELTA
+    [IMG_MGMT_ID_DELTA] = {
+        .mh_read = NULL,
+        .mh_write = img_mgmt_delta
+    },
+#endif
+#if IMG_MGMT_VERIFY
+    [IMG_MGMT_ID_VERIFY] = {
+        .mh_read = img_mgmt_verify_read,
+        .mh_write = img_mgmt_verify_write
+    },
+#endif
+#if IMG_MGMT_DL
+    [IMG_MGMT_ID_DOWNLOAD] = {
+        .mh_read = img_mgmt_download,
+        .mh_write = NULL
+    },
+#endif
+#if IMG_MGMT_MCAST
+    [IMG_MGMT_ID_MCAST] = {
+        .mh_read = img_mgmt_mcast_read,
+        .mh_write = img_mgmt_mcast_write
+    },
+#endif
 };
 
 #define IMG_MGMT_HANDLER_CNT \
     sizeof(img_mgmt_handlers) / sizeof(img_mgmt_handlers[0])
 
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE_RES(img_mgmt_group, img_mgmt_handlers,
+                             MGMT_GROUP_ID_IMAGE, MGMT_RES_IMG);
+#else
 static struct mgmt_group img_mgmt_group = {
-    .mg_handlers = (struct mgmt_handler *)img_mgmt_handlers,
+    .mg_handlers = img_mgmt_handlers,
     .mg_handlers_count = IMG_MGMT_HANDLER_CNT,
     .mg_group_id = MGMT_GROUP_ID_IMAGE,
+    .mg_res = MGMT_RES_IMG,
 };
+#endif
 
 #if IMG_MGMT_VERBOSE_ERR
 const char *img_mgmt_err_str_app_reject = "app reject";
@@ -73,6 +361,9 @@ const char *img_mgmt_err_str_flash_erase_failed = "fa erase fail";
 const char *img_mgmt_err_str_flash_write_failed = "fa write fail";
 const char *img_mgmt_err_str_downgrade = "downgrade";
 const char *img_mgmt_err_str_image_bad_flash_addr = "img addr mismatch";
+const char *img_mgmt_err_str_delta_src_mismatch = "src mismatch";
+const char *img_mgmt_err_str_delta_malformed = "patch malformed";
+const char *img_mgmt_err_str_comp_malformed = "comp malformed";
 #endif
 
 /**
@@ -105,9 +396,9 @@ img_mgmt_find_tlvs(int slot, size_t *start_off, size_t *end_off,
 /*
  * Reads the version and build hash from the specified image slot.
  */
-int
-img_mgmt_read_info(int image_slot, struct image_version *ver, uint8_t *hash,
-                   uint32_t *flags)
+static int
+img_mgmt_read_info_flash(int image_slot, struct image_version *ver,
+                         uint8_t *hash, uint32_t *flags)
 {
 
 #if IMG_MGMT_DUMMY_HDR
@@ -231,6 +522,92 @@ img_mgmt_read_info(int image_slot, struct image_version *ver, uint8_t *hash,
     return 0;
 }
 
+void
+img_mgmt_meta_invalidate(void)
+{
+    memset(img_mgmt_meta_cache, 0, sizeof img_mgmt_meta_cache);
+    img_mgmt_state_epoch++;
+}
+
+/**
+ * Discards the cached metadata of the secondary slots, which are the only
+ * ones that uploads and erases modify.
+ */
+static void
+img_mgmt_meta_invalidate_secondary(void)
+{
+#ifdef CONFIG_BOARD_SCORPIO
+    /* Scorpio uploads to whichever slot is not in use. */
+    img_mgmt_meta_invalidate();
+#else
+    int i;
+
+    for (i = 0; i < IMG_MGMT_IMAGE_COUNT; i++) {
+        img_mgmt_meta_cache[IMG_MGMT_IMAGE_SLOT(i, 1)].valid = false;
+    }
+    img_mgmt_state_epoch++;
+#endif
+}
+
+/**
+ * Reads the metadata of every slot that is not cached yet.
+ */
+static void
+img_mgmt_meta_load(void)
+{
+    int i;
+
+    for (i = 0; i < IMG_MGMT_SLOT_COUNT; i++) {
+        (void)img_mgmt_read_info(i, NULL, NULL, NULL);
+    }
+}
+
+/*
+ * Reads the version and build hash from the specified image slot, using the
+ * cached result of an earlier read if there is one.
+ */
+int
+img_mgmt_read_info(int image_slot, struct image_version *ver, uint8_t *hash,
+                   uint32_t *flags)
+{
+    struct img_mgmt_meta *meta;
+    int rc;
+
+    if (IMG_MGMT_DUMMY_HDR ||
+        image_slot < 0 || image_slot >= IMG_MGMT_SLOT_COUNT) {
+
+        return img_mgmt_read_info_flash(image_slot, ver, hash, flags);
+    }
+
+    meta = &img_mgmt_meta_cache[image_slot];
+    if (!meta->valid) {
+        rc = img_mgmt_read_info_flash(image_slot, &meta->ver, meta->hash,
+                                      &meta->flags);
+        if (rc != 0 && rc != MGMT_ERR_ENOENT) {
+            /* Corrupt image or read failure; not cached. */
+            return img_mgmt_read_info_flash(image_slot, ver, hash, flags);
+        }
+
+        meta->rc = rc;
+        meta->valid = true;
+    }
+
+    if (ver != NULL) {
+        memcpy(ver, &meta->ver, sizeof *ver);
+    }
+
+    if (meta->rc == 0) {
+        if (hash != NULL) {
+            memcpy(hash, meta->hash, IMAGE_HASH_LEN);
+        }
+        if (flags != NULL) {
+            *flags = meta->flags;
+        }
+    }
+
+    return meta->rc;
+}
+
 /*
  * Finds image given version number. Returns the slot number image is in,
  * or -1 if not found.
@@ -241,7 +618,7 @@ img_mgmt_find_by_ver(struct image_version *find, uint8_t *hash)
     int i;
     struct image_version ver;
 
-    for (i = 0; i < 2; i++) {
+    for (i = 0; i < IMG_MGMT_SLOT_COUNT; i++) {
         if (img_mgmt_read_info(i, &ver, hash, NULL) != 0) {
             continue;
         }
@@ -262,7 +639,7 @@ img_mgmt_find_by_hash(uint8_t *find, struct image_version *ver)
     int i;
     uint8_t hash[IMAGE_HASH_LEN];
 
-    for (i = 0; i < 2; i++) {
+    for (i = 0; i < IMG_MGMT_SLOT_COUNT; i++) {
         if (img_mgmt_read_info(i, ver, hash, NULL) != 0) {
             continue;
         }
@@ -288,6 +665,109 @@ img_mgmt_error_rsp(struct mgmt_ctxt *ctxt, int rc, const char *rsn)
 }
 #endif
 
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+/**
+ * Deletes the upload journal, if one may be stored.  A journal that has not
+ * been restored yet is stale once this is called, so it is dropped as well.
+ */
+static void
+img_mgmt_journal_clear(void)
+{
+    if (img_mgmt_journal_valid || !img_mgmt_journal_loaded) {
+        img_mgmt_impl_journal_clear();
+        img_mgmt_journal_valid = false;
+    }
+    img_mgmt_journal_loaded = true;
+}
+
+/**
+ * Restores the state of an upload that was interrupted by a reset.  This
+ * runs once, before the first upload request after boot is inspected, so
+ * that a first chunk carrying the journaled data hash resumes the upload.
+ */
+static void
+img_mgmt_journal_restore(void)
+{
+    struct img_mgmt_journal journal;
+    int rc;
+
+    if (img_mgmt_journal_loaded) {
+        return;
+    }
+    img_mgmt_journal_loaded = true;
+
+    rc = img_mgmt_impl_journal_read(&journal);
+    if (rc != 0) {
+        return;
+    }
+    img_mgmt_journal_valid = true;
+
+    if (journal.data_sha_len == 0 ||
+        journal.data_sha_len > IMG_MGMT_DATA_SHA_LEN ||
+        journal.off == 0 || journal.off >= journal.size) {
+
+        img_mgmt_journal_clear();
+        return;
+    }
+
+    g_img_mgmt_state.area_id = journal.area_id;
+    g_img_mgmt_state.off = journal.off;
+    g_img_mgmt_state.size = journal.size;
+#if IMG_MGMT_WRITE_ALIGN_MAX > 0
+    g_img_mgmt_state.carry_len = 0;
+#endif
+    g_img_mgmt_state.data_sha_len = journal.data_sha_len;
+    memcpy(g_img_mgmt_state.data_sha, journal.data_sha,
+           IMG_MGMT_DATA_SHA_LEN);
+
+    rc = img_mgmt_impl_upload_resume(journal.off);
+    if (rc != 0) {
+        g_img_mgmt_state.area_id = -1;
+        img_mgmt_journal_clear();
+        return;
+    }
+
+    img_mgmt_journal_off = journal.off;
+}
+
+/**
+ * Records the progress of the upload in the journal once another
+ * IMG_MGMT_UL_JOURNAL_KB has reached flash.  Uploads without a data hash
+ * cannot be recognised after a reset, so they are not journaled.
+ */
+static void
+img_mgmt_journal_update(void)
+{
+    struct img_mgmt_journal journal;
+    uint32_t off;
+
+    /* A finished upload has nothing left to resume. */
+    if (g_img_mgmt_state.data_sha_len == 0 ||
+        g_img_mgmt_state.off == g_img_mgmt_state.size) {
+
+        return;
+    }
+
+    off = img_mgmt_impl_durable_off();
+    if (off < img_mgmt_journal_off + IMG_MGMT_UL_JOURNAL_KB * 1024) {
+        return;
+    }
+
+    journal.area_id = g_img_mgmt_state.area_id;
+    journal.off = off;
+    journal.size = g_img_mgmt_state.size;
+    journal.data_sha_len = g_img_mgmt_state.data_sha_len;
+    memcpy(journal.data_sha, g_img_mgmt_state.data_sha,
+           IMG_MGMT_DATA_SHA_LEN);
+
+    /* A failed write leaves the previous record, which is still correct. */
+    img_mgmt_journal_valid = true;
+    if (img_mgmt_impl_journal_write(&journal) == 0) {
+        img_mgmt_journal_off = off;
+    }
+}
+#endif
+
 /**
  * Command handler: image erase
  */
@@ -297,6 +777,25 @@ img_mgmt_erase(struct mgmt_ctxt *ctxt)
     struct image_version ver;
     CborError err;
     int rc;
+#if IMG_MGMT_ERASE_ASYNC
+    uint32_t job;
+    bool async;
+
+    const struct cbor_attr_t erase_attr[] = {
+        [0] = {
+            .attribute = "async",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &async,
+            .dflt.boolean = false,
+        },
+        [1] = { 0 },
+    };
+
+    rc = cbor_read_object(&ctxt->it, erase_attr);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+#endif
 
     /*
      * First check if image info is valid.
@@ -319,7 +818,27 @@ img_mgmt_erase(struct mgmt_ctxt *ctxt)
     }
 #endif
     
+#if IMG_MGMT_ERASE_ASYNC
+    /* Respond right away; the client polls for progress with a read. */
+    if (async) {
+        rc = img_mgmt_impl_erase_slot_start(&job);
+    } else {
+        rc = img_mgmt_impl_erase_slot();
+    }
+#else
     rc = img_mgmt_impl_erase_slot();
+#endif
+    img_mgmt_meta_invalidate_secondary();
+    img_mgmt_state_invalidate();
+#if IMG_MGMT_VERIFY
+    img_mgmt_verify_cancel();
+#endif
+#if IMG_MGMT_MCAST
+    img_mgmt_mcast_cancel();
+#endif
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+    img_mgmt_journal_clear();
+#endif
 
     if (!rc) {
         img_mgmt_dfu_stopped();
@@ -328,6 +847,12 @@ img_mgmt_erase(struct mgmt_ctxt *ctxt)
     err = 0;
     err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
     err |= cbor_encode_int(&ctxt->encoder, rc);
+#if IMG_MGMT_ERASE_ASYNC
+    if (async && rc == 0) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "job");
+        err |= cbor_encode_uint(&ctxt->encoder, job);
+    }
+#endif
 
     if (err != 0) {
         return MGMT_ERR_ENOMEM;
@@ -336,15 +861,39 @@ img_mgmt_erase(struct mgmt_ctxt *ctxt)
     return 0;
 }
 
+#if IMG_MGMT_ERASE_ASYNC
+/**
+ * Command handler: image erase state
+ *
+ * Reports the progress of the last asynchronous erase.
+ */
 static int
-img_mgmt_upload_good_rsp(struct mgmt_ctxt *ctxt)
+img_mgmt_erase_state(struct mgmt_ctxt *ctxt)
 {
-    CborError err = CborNoError;
+    struct img_mgmt_erase_status st;
+    CborError err;
+    int rc;
 
+    rc = img_mgmt_impl_erase_status(&st);
+    if (rc != 0) {
+        return rc;
+    }
+
+    err = 0;
     err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
-    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_int(&ctxt->encoder, st.rc);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "job");
+    err |= cbor_encode_uint(&ctxt->encoder, st.job);
     err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
-    err |= cbor_encode_int(&ctxt->encoder, g_img_mgmt_state.off);
+    err |= cbor_encode_uint(&ctxt->encoder, st.done);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+    err |= cbor_encode_uint(&ctxt->encoder, st.total);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "pct");
+    err |= cbor_encode_uint(&ctxt->encoder,
+                            st.total == 0 ? 100 :
+                            (uint64_t)st.done * 100 / st.total);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "busy");
+    err |= cbor_encode_boolean(&ctxt->encoder, st.busy);
 
     if (err != 0) {
         return MGMT_ERR_ENOMEM;
@@ -352,229 +901,2402 @@ img_mgmt_upload_good_rsp(struct mgmt_ctxt *ctxt)
 
     return 0;
 }
+#endif
 
+#if IMG_MGMT_VERIFY
 /**
- * Logs an upload request if necessary.
- *
- * @param is_first              Whether the request includes the first chunk of
- *                                  the image.
- * @param is_last               Whether the request includes the last chunk of
- *                                  the image.
- * @param status                The result of processing the upload request
- *                                  (MGMT_ERR code).
- *
- * @return                      0 on success; nonzero on failure.
+ * Completes the digest of the verification in progress.  On a failure the
+ * digest is still completed, so that the hash context gets released.
  */
-static int
-img_mgmt_upload_log(bool is_first, bool is_last, int status)
+static void
+img_mgmt_verify_finish(int rc)
 {
-    uint8_t hash[IMAGE_HASH_LEN];
-    const uint8_t *hashp;
-    int rc;
+    uint8_t digest[IMAGE_HASH_LEN];
+    int finish_rc;
 
-    if (is_first) {
-        return img_mgmt_impl_log_upload_start(status);
+    finish_rc = img_mgmt_impl_sha256_finish(digest);
+    if (rc == 0) {
+        rc = finish_rc;
     }
 
-    if (is_last || status != 0) {
-        /* Log the image hash if we know it. */
-        rc = img_mgmt_read_info(1, NULL, hash, NULL);
-        if (rc != 0) {
-            hashp = NULL;
-        } else {
-            hashp = hash;
-        }
+    img_mgmt_verify_state.rc = rc;
+    img_mgmt_verify_state.match =
+        rc == 0 &&
+        memcmp(digest, img_mgmt_verify_state.expected, IMAGE_HASH_LEN) == 0;
+    img_mgmt_verify_state.busy = false;
+}
 
-        return img_mgmt_impl_log_upload_done(status, hashp);
+/**
+ * Abandons the verification in progress; called when the contents of a slot
+ * are about to change.
+ */
+static void
+img_mgmt_verify_cancel(void)
+{
+    if (img_mgmt_verify_state.busy) {
+        img_mgmt_verify_finish(MGMT_ERR_EBADSTATE);
     }
-
-    /* Nothing to log. */
-    return 0;
 }
 
-#ifdef CONFIG_BOARD_SCORPIO
-int img_mgmt_impl_write_trailer(int slot);
-#endif
-
 /**
- * Command handler: image upload
+ * Starts verifying the specified slot.  The hash context is shared with the
+ * upload verification; an upload that is still being hashed is written
+ * without being verified from here on.
  */
 static int
-img_mgmt_upload(struct mgmt_ctxt *ctxt)
+img_mgmt_verify_begin(int slot)
 {
-    struct mgmt_evt_op_cmd_status_arg cmd_status_arg;
-    struct img_mgmt_upload_req req = {
-        .off = -1,
-        .size = -1,
-        .data_len = 0,
-        .data_sha_len = 0,
-        .upgrade = false,
-        .image = 0,
+    struct image_header hdr;
+    int rc;
+
+    img_mgmt_verify_cancel();
+
+    rc = img_mgmt_read_info(slot, NULL, img_mgmt_verify_state.expected,
+                            NULL);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = img_mgmt_impl_read(slot, 0, &hdr, sizeof hdr);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+#if IMG_MGMT_UL_SHA256
+    img_mgmt_ul_hash.hash_len = 0;
+#endif
+
+    rc = img_mgmt_impl_sha256_start();
+    if (rc != 0) {
+        return rc;
+    }
+
+    img_mgmt_verify_state.slot = slot;
+    img_mgmt_verify_state.len = hdr.ih_hdr_size + hdr.ih_img_size +
+                                hdr.ih_protect_tlv_size;
+    img_mgmt_verify_state.off = 0;
+    img_mgmt_verify_state.rc = 0;
+    img_mgmt_verify_state.match = false;
+    img_mgmt_verify_state.busy = true;
+
+    return 0;
+}
+
+/**
+ * Hashes the next IMG_MGMT_VERIFY_STEP bytes of the slot being verified.
+ */
+static void
+img_mgmt_verify_step(void)
+{
+    uint32_t budget;
+    uint32_t n;
+    int rc;
+
+    budget = IMG_MGMT_VERIFY_STEP;
+    while (img_mgmt_verify_state.busy && budget > 0) {
+        n = img_mgmt_verify_state.len - img_mgmt_verify_state.off;
+        if (n > sizeof img_mgmt_verify_buf) {
+            n = sizeof img_mgmt_verify_buf;
+        }
+        if (n > budget) {
+            n = budget;
+        }
+
+        if (n > 0) {
+            rc = img_mgmt_impl_read(img_mgmt_verify_state.slot,
+                                    img_mgmt_verify_state.off,
+                                    img_mgmt_verify_buf, n);
+            if (rc != 0) {
+                img_mgmt_verify_finish(MGMT_ERR_EUNKNOWN);
+                return;
+            }
+
+            rc = img_mgmt_impl_sha256_update(img_mgmt_verify_buf, n);
+            if (rc != 0) {
+                img_mgmt_verify_finish(rc);
+                return;
+            }
+
+            img_mgmt_verify_state.off += n;
+            budget -= n;
+        }
+
+        if (img_mgmt_verify_state.off == img_mgmt_verify_state.len) {
+            img_mgmt_verify_finish(0);
+        }
+    }
+}
+
+/**
+ * Encodes the progress of the last verification.
+ */
+static int
+img_mgmt_verify_rsp(struct mgmt_ctxt *ctxt)
+{
+    CborError err;
+    uint32_t len;
+
+    len = img_mgmt_verify_state.len;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, img_mgmt_verify_state.rc);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "slot");
+    err |= cbor_encode_int(&ctxt->encoder, img_mgmt_verify_state.slot);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_uint(&ctxt->encoder, img_mgmt_verify_state.off);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+    err |= cbor_encode_uint(&ctxt->encoder, len);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "pct");
+    err |= cbor_encode_uint(&ctxt->encoder,
+                            len == 0 ? 100 :
+                            (uint64_t)img_mgmt_verify_state.off * 100 / len);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "busy");
+    err |= cbor_encode_boolean(&ctxt->encoder, img_mgmt_verify_state.busy);
+    if (!img_mgmt_verify_state.busy && img_mgmt_verify_state.rc == 0) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "match");
+        err |= cbor_encode_boolean(&ctxt->encoder,
+                                   img_mgmt_verify_state.match);
+    }
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: image verify (read)
+ *
+ * Continues the verification in progress by one step and reports its
+ * progress; once done, "match" tells whether the slot is intact.
+ */
+static int
+img_mgmt_verify_read(struct mgmt_ctxt *ctxt)
+{
+    if (img_mgmt_verify_state.slot < 0) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    img_mgmt_verify_step();
+    return img_mgmt_verify_rsp(ctxt);
+}
+
+/**
+ * Command handler: image verify (write)
+ *
+ * Starts hashing the specified slot, by default the secondary slot of the
+ * first image, and responds after the first step.
+ */
+static int
+img_mgmt_verify_write(struct mgmt_ctxt *ctxt)
+{
+    long long int slot;
+    int rc;
+
+    const struct cbor_attr_t verify_attr[] = {
+        [0] = {
+            .attribute = "slot",
+            .type = CborAttrIntegerType,
+            .addr.integer = &slot,
+            .dflt.integer = 1,
+        },
+        [1] = { 0 },
+    };
+
+    rc = cbor_read_object(&ctxt->it, verify_attr);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (slot < 0 || slot >= IMG_MGMT_SLOT_COUNT) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    rc = img_mgmt_verify_begin(slot);
+    if (rc != 0) {
+        return rc;
+    }
+
+    img_mgmt_verify_step();
+    return img_mgmt_verify_rsp(ctxt);
+}
+#endif
+
+#if IMG_MGMT_DL
+/**
+ * Determines the length of the image in the specified slot: its header, body
+ * and both TLV areas.
+ */
+static int
+img_mgmt_dl_image_len(int slot, uint32_t *out_len)
+{
+    struct image_header hdr;
+    size_t data_off;
+    size_t data_end;
+    int rc;
+
+    rc = img_mgmt_impl_read(slot, 0, &hdr, sizeof hdr);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+    if (hdr.ih_magic != IMAGE_MAGIC) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    /* The total length of a TLV area includes its info header, which
+     * img_mgmt_find_tlvs() skips.
+     */
+    data_off = hdr.ih_hdr_size + hdr.ih_img_size;
+    rc = img_mgmt_find_tlvs(slot, &data_off, &data_end,
+                            IMAGE_TLV_PROT_INFO_MAGIC);
+    if (rc == 0) {
+        data_off = data_end - sizeof(struct image_tlv_info);
+    }
+
+    rc = img_mgmt_find_tlvs(slot, &data_off, &data_end, IMAGE_TLV_INFO_MAGIC);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    *out_len = data_end - sizeof(struct image_tlv_info);
+    return 0;
+}
+
+#if IMG_MGMT_DL_COMP
+/**
+ * Compresses the slot data starting at `off` into the download buffer as a
+ * stream of its own, so that any chunk can be decompressed, and requested
+ * again, independently of the others.  As much data is taken as is certain
+ * to fit: a byte costs at most nine bits, when it ends up as a literal.
+ */
+static int
+img_mgmt_dl_comp_fill(int slot, uint32_t off, uint32_t end, size_t chunk_len,
+                      size_t *out_raw_len, size_t *out_data_len)
+{
+    uint8_t piece[IMG_MGMT_DL_COMP_PIECE];
+    uint8_t *out;
+    size_t data_len;
+    size_t raw_len;
+    size_t accepted;
+    size_t produced;
+    size_t pending;
+    size_t room;
+    size_t n;
+    int rc;
+
+    out = (uint8_t *)img_mgmt_dl_buf;
+    data_len = 0;
+    raw_len = 0;
+
+    mcumgr_hs_enc_init(&img_mgmt_dl_enc);
+    while (off + raw_len < end) {
+        /* Leave two bytes for the padding and the last item. */
+        pending = img_mgmt_dl_enc.end - img_mgmt_dl_enc.pos;
+        room = chunk_len - data_len;
+        if (room < 2 || (room - 2) * 8 / 9 <= pending) {
+            break;
+        }
+
+        n = (room - 2) * 8 / 9 - pending;
+        if (n > sizeof piece) {
+            n = sizeof piece;
+        }
+        if (n > end - off - raw_len) {
+            n = end - off - raw_len;
+        }
+
+        rc = img_mgmt_impl_read(slot, off + raw_len, piece, n);
+        if (rc != 0) {
+            return rc;
+        }
+
+        /* Whatever the encoder does not take is read again next time. */
+        accepted = mcumgr_hs_enc_sink(&img_mgmt_dl_enc, piece, n);
+        raw_len += accepted;
+
+        produced = mcumgr_hs_enc_poll(&img_mgmt_dl_enc, out + data_len,
+                                      chunk_len - data_len, false);
+        data_len += produced;
+
+        if (accepted == 0 && produced == 0) {
+            break;
+        }
+    }
+
+    do {
+        produced = mcumgr_hs_enc_poll(&img_mgmt_dl_enc, out + data_len,
+                                      chunk_len - data_len, true);
+        data_len += produced;
+    } while (produced > 0 && !mcumgr_hs_enc_done(&img_mgmt_dl_enc));
+
+    *out_raw_len = raw_len;
+    *out_data_len = data_len;
+    return 0;
+}
+#endif
+
+/**
+ * Reads the slot chunk at the specified offset and encodes it into the
+ * response.  The end of the download is included if `first` is set.
+ *
+ * @param chunk_len             The maximum number of bytes to send.
+ * @param out_raw_len           On success, the number of slot bytes sent.
+ */
+static int
+img_mgmt_dl_chunk(struct mgmt_ctxt *ctxt, int slot, uint32_t off,
+                  uint32_t end, size_t chunk_len, bool comp, bool first,
+                  size_t *out_raw_len)
+{
+    CborError err;
+    size_t data_len;
+    size_t raw_len;
+    int rc;
+
+#if IMG_MGMT_DL_COMP
+    if (comp) {
+        rc = img_mgmt_dl_comp_fill(slot, off, end, chunk_len, &raw_len,
+                                   &data_len);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+#endif
+
+    if (!comp) {
+        raw_len = end - off;
+        if (raw_len > chunk_len) {
+            raw_len = chunk_len;
+        }
+
+        /* One read per chunk; flash drivers are fastest with large reads. */
+        if (raw_len > 0) {
+            rc = img_mgmt_impl_read(slot, off, img_mgmt_dl_buf, raw_len);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+        data_len = raw_len;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_uint(&ctxt->encoder, off);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "data");
+    err |= cbor_encode_byte_string(&ctxt->encoder,
+                                   (const uint8_t *)img_mgmt_dl_buf, data_len);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    if (comp) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "rlen");
+        err |= cbor_encode_uint(&ctxt->encoder, raw_len);
+    }
+    if (first) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+        err |= cbor_encode_uint(&ctxt->encoder, end);
+    }
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    *out_raw_len = raw_len;
+    return 0;
+}
+
+/**
+ * Command handler: image download (read)
+ *
+ * Sends the contents of a slot, by default the secondary slot of the first
+ * image, from "off" up to "end".  Without "end", the download covers the
+ * whole slot, or with "img", the image in it from its header to the end of
+ * its TLVs.  The first response to each request carries "len", the end of
+ * the download; a response with no data means it has been reached.
+ *
+ * With "win", up to that many consecutive chunks are sent, each in its own
+ * response; the client requests the next window from the offset following
+ * the last chunk it got.  With "comp", each chunk is compressed on its own
+ * and "rlen" tells how many slot bytes it covers.
+ */
+static int
+img_mgmt_download(struct mgmt_ctxt *ctxt)
+{
+    unsigned long long comp;
+    unsigned long long win;
+    unsigned long long off;
+    unsigned long long end;
+    long long int slot;
+    size_t chunk_len;
+    size_t raw_len;
+    uint32_t len;
+    bool first;
+    bool img;
+    int rc;
+
+    const struct cbor_attr_t dl_attr[] = {
+        {
+            .attribute = "slot",
+            .type = CborAttrIntegerType,
+            .addr.integer = &slot,
+            .dflt.integer = 1,
+        },
+        {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+        },
+        {
+            .attribute = "end",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &end,
+            .nodefault = true,
+        },
+        {
+            .attribute = "img",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &img,
+            .nodefault = true,
+        },
+        {
+            .attribute = "comp",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &comp,
+            .nodefault = true,
+        },
+        {
+            .attribute = "win",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &win,
+            .nodefault = true,
+        },
+        { 0 },
+    };
+
+    comp = MGMT_COMP_NONE;
+    win = 1;
+    off = ULLONG_MAX;
+    end = ULLONG_MAX;
+    img = false;
+    rc = cbor_read_object(&ctxt->it, dl_attr);
+    if (rc != 0 || off == ULLONG_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (slot < 0 || slot >= IMG_MGMT_SLOT_COUNT || win == 0) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (win > IMG_MGMT_DL_WIN_MAX) {
+        win = IMG_MGMT_DL_WIN_MAX;
+    }
+
+    if (comp != MGMT_COMP_NONE) {
+#if IMG_MGMT_DL_COMP
+        if (comp != MGMT_COMP_HS) {
+            return MGMT_ERR_ENOTSUP;
+        }
+#else
+        return MGMT_ERR_ENOTSUP;
+#endif
+    }
+
+    if (img) {
+        rc = img_mgmt_dl_image_len(slot, &len);
+    } else {
+        rc = img_mgmt_impl_slot_size(slot, &len);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (end > len) {
+        end = len;
+    }
+    if (off > end) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    /* Fill the transport's packets rather than assume the smallest one. */
+    chunk_len = mgmt_rsp_chunk_size(ctxt, IMG_MGMT_DL_RSP_OVERHEAD,
+                                    IMG_MGMT_DL_CHUNK_SIZE);
+
+    first = true;
+    while (1) {
+        rc = img_mgmt_dl_chunk(ctxt, slot, off, end, chunk_len,
+                               comp != MGMT_COMP_NONE, first, &raw_len);
+        if (rc != 0) {
+            return rc;
+        }
+
+        off += raw_len;
+        win--;
+        if (win == 0 || off >= end || raw_len == 0) {
+            return 0;
+        }
+
+        /* Send this chunk and continue with the next one in a new response.
+         * If the transport cannot do that, the client gets one chunk per
+         * request as usual.
+         */
+        rc = mgmt_flush_rsp(ctxt);
+        if (rc == MGMT_ERR_ENOTSUP) {
+            return 0;
+        }
+        if (rc != 0) {
+            return rc;
+        }
+        first = false;
+    }
+}
+#endif
+
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+/**
+ * Discards all chunks buffered in the upload window.
+ */
+static void
+img_mgmt_window_reset(void)
+{
+    int i;
+
+    for (i = 0; i < IMG_MGMT_UL_WINDOW_SIZE; i++) {
+        img_mgmt_window[i].len = 0;
+    }
+}
+
+/**
+ * Finds the buffered chunk that starts at the specified image offset.
+ */
+static struct img_mgmt_window_slot *
+img_mgmt_window_find(uint32_t off)
+{
+    int i;
+
+    for (i = 0; i < IMG_MGMT_UL_WINDOW_SIZE; i++) {
+        if (img_mgmt_window[i].len != 0 && img_mgmt_window[i].off == off) {
+            return &img_mgmt_window[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Buffers a chunk that arrived ahead of the write cursor.  Chunks that fall
+ * outside the negotiated window, or that cannot be buffered, are silently
+ * dropped; the client retransmits anything not covered by the ack bitmap.
+ */
+static void
+img_mgmt_window_store(const struct img_mgmt_upload_req *req)
+{
+    struct img_mgmt_window_slot *slot;
+    uint32_t limit;
+    int i;
+
+    if (g_img_mgmt_state.area_id == -1 || g_img_mgmt_state.win == 0) {
+        return;
+    }
+
+    if (req->data_len == 0 || req->off <= g_img_mgmt_state.off ||
+        req->off + req->data_len > g_img_mgmt_state.size) {
+        return;
+    }
+
+    /* Only chunks on the window unit grid can be acked.  A chunk shorter
+     * than the unit is only expected at the end of the image.
+     */
+    if ((req->off - g_img_mgmt_state.off) % g_img_mgmt_state.win_unit != 0 ||
+        req->data_len > g_img_mgmt_state.win_unit ||
+        (req->data_len < g_img_mgmt_state.win_unit &&
+         req->off + req->data_len != g_img_mgmt_state.size)) {
+        return;
+    }
+
+    limit = g_img_mgmt_state.off +
+            g_img_mgmt_state.win * g_img_mgmt_state.win_unit;
+    if (req->off >= limit) {
+        return;
+    }
+
+    if (img_mgmt_window_find(req->off) != NULL) {
+        /* Duplicate. */
+        return;
+    }
+
+    slot = NULL;
+    for (i = 0; i < g_img_mgmt_state.win; i++) {
+        if (img_mgmt_window[i].len == 0) {
+            slot = &img_mgmt_window[i];
+            break;
+        }
+    }
+    if (slot == NULL) {
+        return;
+    }
+
+    slot->off = req->off;
+    slot->len = req->data_len;
+    memcpy(slot->data, req->img_data, req->data_len);
+}
+
+/**
+ * Builds the selective ack bitmap for the upload response.  Bit n is set if
+ * the chunk starting at `off + n * win_unit` is already buffered.
+ */
+static uint32_t
+img_mgmt_window_bitmap(void)
+{
+    uint32_t delta;
+    uint32_t map;
+    int i;
+
+    map = 0;
+    for (i = 0; i < IMG_MGMT_UL_WINDOW_SIZE; i++) {
+        if (img_mgmt_window[i].len == 0 ||
+            img_mgmt_window[i].off <= g_img_mgmt_state.off) {
+            continue;
+        }
+
+        delta = img_mgmt_window[i].off - g_img_mgmt_state.off;
+        if (delta % g_img_mgmt_state.win_unit == 0 &&
+            delta / g_img_mgmt_state.win_unit < 32) {
+            map |= 1UL << (delta / g_img_mgmt_state.win_unit);
+        }
+    }
+
+    return map;
+}
+#endif
+
+#if IMG_MGMT_UL_SHA256
+/**
+ * Prepares to verify an upload from the image header in its first chunk.  An
+ * upload without a complete header is written without being verified.
+ */
+static int
+img_mgmt_ul_hash_start(const struct img_mgmt_upload_req *req)
+{
+    struct image_header hdr;
+
+    memset(&img_mgmt_ul_hash, 0, sizeof img_mgmt_ul_hash);
+    if (req->data_len < sizeof hdr) {
+        img_mgmt_ul_hash.tlv_done = true;
+        return 0;
+    }
+
+    memcpy(&hdr, req->img_data, sizeof hdr);
+    img_mgmt_ul_hash.hash_len = hdr.ih_hdr_size + hdr.ih_img_size +
+                                hdr.ih_protect_tlv_size;
+
+    return img_mgmt_impl_sha256_start();
+}
+
+/**
+ * Scans uploaded TLV-area bytes for the image's SHA-256 TLV.
+ */
+static void
+img_mgmt_ul_hash_scan(const uint8_t *data, uint32_t off, uint32_t len)
+{
+    uint32_t n;
+
+    while (len > 0 && !img_mgmt_ul_hash.tlv_done) {
+        if (off < img_mgmt_ul_hash.val_end) {
+            /* Inside a TLV value; keep it if it is the hash. */
+            n = img_mgmt_ul_hash.val_end - off;
+            if (n > len) {
+                n = len;
+            }
+            if (img_mgmt_ul_hash.in_hash) {
+                memcpy(img_mgmt_ul_hash.expected +
+                       img_mgmt_ul_hash.expected_fill, data, n);
+                img_mgmt_ul_hash.expected_fill += n;
+            }
+        } else {
+            n = 1;
+            img_mgmt_ul_hash.hdr.bytes[img_mgmt_ul_hash.hdr_fill++] = *data;
+            if (img_mgmt_ul_hash.hdr_fill == sizeof img_mgmt_ul_hash.hdr) {
+                img_mgmt_ul_hash.hdr_fill = 0;
+
+                if (img_mgmt_ul_hash.tlv_end == 0) {
+                    if (img_mgmt_ul_hash.hdr.info.it_magic !=
+                        IMAGE_TLV_INFO_MAGIC) {
+
+                        img_mgmt_ul_hash.tlv_done = true;
+                        return;
+                    }
+                    img_mgmt_ul_hash.tlv_end =
+                        off + 1 - sizeof img_mgmt_ul_hash.hdr.info +
+                        img_mgmt_ul_hash.hdr.info.it_tlv_tot;
+                } else {
+                    img_mgmt_ul_hash.val_end =
+                        off + 1 + img_mgmt_ul_hash.hdr.tlv.it_len;
+                    img_mgmt_ul_hash.in_hash =
+                        img_mgmt_ul_hash.hdr.tlv.it_type == IMAGE_TLV_SHA256 &&
+                        img_mgmt_ul_hash.hdr.tlv.it_len == IMAGE_HASH_LEN &&
+                        img_mgmt_ul_hash.expected_fill == 0;
+                }
+            }
+        }
+
+        data += n;
+        off += n;
+        len -= n;
+
+        if (img_mgmt_ul_hash.tlv_end != 0 &&
+            off >= img_mgmt_ul_hash.tlv_end) {
+
+            img_mgmt_ul_hash.tlv_done = true;
+        }
+    }
+}
+
+/**
+ * Feeds a chunk that was just written to flash into the upload verification.
+ */
+static int
+img_mgmt_ul_hash_update(const uint8_t *data, uint32_t off, uint32_t len)
+{
+    uint32_t n;
+    int rc;
+
+    /* Nothing to verify against if the start of the upload was not seen. */
+    if (img_mgmt_ul_hash.hash_len == 0) {
+        return 0;
+    }
+
+    if (off < img_mgmt_ul_hash.hash_len) {
+        n = img_mgmt_ul_hash.hash_len - off;
+        if (n > len) {
+            n = len;
+        }
+
+        rc = img_mgmt_impl_sha256_update(data, n);
+        if (rc != 0) {
+            return rc;
+        }
+
+        data += n;
+        off += n;
+        len -= n;
+
+        if (off == img_mgmt_ul_hash.hash_len) {
+            rc = img_mgmt_impl_sha256_finish(img_mgmt_ul_hash.digest);
+            if (rc != 0) {
+                return rc;
+            }
+            img_mgmt_ul_hash.digest_done = true;
+        }
+    }
+
+    img_mgmt_ul_hash_scan(data, off, len);
+    return 0;
+}
+
+/**
+ * Indicates whether the completed upload matches its hash TLV.
+ *
+ * @return                      1 on a match; 0 on a mismatch; -1 if the
+ *                                  upload could not be checked.
+ */
+static int
+img_mgmt_ul_hash_match(void)
+{
+    if (!img_mgmt_ul_hash.digest_done ||
+        img_mgmt_ul_hash.expected_fill != IMAGE_HASH_LEN) {
+
+        return -1;
+    }
+
+    return memcmp(img_mgmt_ul_hash.digest, img_mgmt_ul_hash.expected,
+                  IMAGE_HASH_LEN) == 0;
+}
+#endif
+
+static int
+img_mgmt_upload_good_rsp(struct mgmt_ctxt *ctxt)
+{
+    CborError err = CborNoError;
+
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_int(&ctxt->encoder, g_img_mgmt_state.off);
+
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+    if (g_img_mgmt_state.win != 0) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "win");
+        err |= cbor_encode_uint(&ctxt->encoder, g_img_mgmt_state.win);
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "ack");
+        err |= cbor_encode_uint(&ctxt->encoder, img_mgmt_window_bitmap());
+    }
+#endif
+
+#if IMG_MGMT_UL_SHA256
+    /* Report the result of verification with the last chunk. */
+    if (g_img_mgmt_state.size != 0 &&
+        g_img_mgmt_state.off == g_img_mgmt_state.size &&
+        img_mgmt_ul_hash_match() >= 0) {
+
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "match");
+        err |= cbor_encode_boolean(&ctxt->encoder,
+                                   img_mgmt_ul_hash_match() == 1);
+    }
+#endif
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Logs an upload request if necessary.
+ *
+ * @param is_first              Whether the request includes the first chunk of
+ *                                  the image.
+ * @param is_last               Whether the request includes the last chunk of
+ *                                  the image.
+ * @param status                The result of processing the upload request
+ *                                  (MGMT_ERR code).
+ *
+ * @return                      0 on success; nonzero on failure.
+ */
+static int
+img_mgmt_upload_log(bool is_first, bool is_last, int status)
+{
+    uint8_t hash[IMAGE_HASH_LEN];
+    const uint8_t *hashp;
+    int rc;
+
+    if (is_first) {
+        return img_mgmt_impl_log_upload_start(status);
+    }
+
+    if (is_last || status != 0) {
+        /* Log the image hash if we know it. */
+        rc = img_mgmt_read_info(1, NULL, hash, NULL);
+        if (rc != 0) {
+            hashp = NULL;
+        } else {
+            hashp = hash;
+        }
+
+        return img_mgmt_impl_log_upload_done(status, hashp);
+    }
+
+    /* Nothing to log. */
+    return 0;
+}
+
+#ifdef CONFIG_BOARD_SCORPIO
+int img_mgmt_impl_write_trailer(int slot);
+#endif
+
+/**
+ * Sets up a new upload from its first chunk.  The application has already
+ * accepted the upload.
+ */
+static int
+img_mgmt_upload_begin(const struct img_mgmt_upload_req *req,
+                      const struct img_mgmt_upload_action *action,
+                      const char **errstr)
+{
+    uint32_t start;
+    int rc;
+
+    g_img_mgmt_state.area_id = action->area_id;
+    g_img_mgmt_state.size = action->size;
+    g_img_mgmt_state.off = 0;
+#if IMG_MGMT_WRITE_ALIGN_MAX > 0
+    g_img_mgmt_state.carry_len = 0;
+#endif
+    img_mgmt_meta_invalidate_secondary();
+    img_mgmt_state_invalidate();
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+    img_mgmt_journal_clear();
+    img_mgmt_journal_off = 0;
+#endif
+#if IMG_MGMT_VERIFY
+    img_mgmt_verify_cancel();
+#endif
+#if IMG_MGMT_MCAST
+    img_mgmt_mcast_cancel();
+#endif
+
+    img_mgmt_dfu_started();
+
+    /*
+     * We accept SHA trimmed to any length by client since it's up to client
+     * to make sure provided data are good enough to avoid collisions when
+     * resuming upload.
+     */
+    g_img_mgmt_state.data_sha_len = req->data_sha_len;
+    memcpy(g_img_mgmt_state.data_sha, req->data_sha, req->data_sha_len);
+    memset(&g_img_mgmt_state.data_sha[req->data_sha_len], 0,
+           IMG_MGMT_DATA_SHA_LEN - req->data_sha_len);
+
+#if IMG_MGMT_UL_SHA256
+    rc = img_mgmt_ul_hash_start(req);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+#endif
+
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+    /* Negotiate the upload window.  The client states the size of the
+     * chunks that follow with "wu"; the first chunk cannot define it, as it
+     * is usually shortened by the upload's other fields.  Without a usable
+     * unit the upload is not windowed.
+     */
+    img_mgmt_window_reset();
+    g_img_mgmt_state.win = req->win < IMG_MGMT_UL_WINDOW_SIZE ?
+                           req->win : IMG_MGMT_UL_WINDOW_SIZE;
+    g_img_mgmt_state.win_unit = req->win_unit;
+    if (req->win_unit == 0 || req->win_unit > IMG_MGMT_UL_CHUNK_SIZE) {
+        g_img_mgmt_state.win = 0;
+    }
+#endif
+
+#if IMG_MGMT_LAZY_ERASE
+    /* setup for lazy sector by sector erase */
+    g_img_mgmt_state.sector_id = -1;
+    g_img_mgmt_state.sector_end = 0;
+    (void)rc;
+    (void)start;
+#elif IMG_MGMT_ERASE_AHEAD > 0
+    /* erase in the background, ahead of the chunks being written */
+    start = img_mgmt_prof_now();
+    rc = img_mgmt_impl_erase_ahead_start(action->erase ? action->size : 0);
+    IMG_MGMT_PROF_ADD(erase_ticks, start);
+    if (rc != 0) {
+        *errstr = img_mgmt_err_str_flash_erase_failed;
+        return MGMT_ERR_EUNKNOWN;
+    }
+#else
+    /* erase the entire image size all at once */
+    if (action->erase) {
+        start = img_mgmt_prof_now();
+        rc = img_mgmt_impl_erase_image_data(0, action->size);
+        IMG_MGMT_PROF_ADD(erase_ticks, start);
+        if (rc != 0) {
+            *errstr = img_mgmt_err_str_flash_erase_failed;
+            return MGMT_ERR_EUNKNOWN;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+/**
+ * Completes an upload once all of its data has been written.
+ */
+static void
+img_mgmt_upload_finish(int area_id)
+{
+    /* Index the new image right away. */
+    img_mgmt_meta_invalidate_secondary();
+    img_mgmt_meta_load();
+    img_mgmt_state_invalidate();
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+    img_mgmt_journal_clear();
+#endif
+#ifdef CONFIG_BOARD_SCORPIO
+    img_mgmt_impl_write_trailer(area_id - 1);
+#else
+    (void)area_id;
+#endif
+    img_mgmt_dfu_pending();
+    g_img_mgmt_state.area_id = -1;
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+    img_mgmt_window_reset();
+    g_img_mgmt_state.win = 0;
+#endif
+}
+
+/**
+ * Writes the chunk described by an upload request and action to flash and
+ * advances the upload offset.
+ */
+static int
+img_mgmt_upload_write(const struct img_mgmt_upload_req *req,
+                      const struct img_mgmt_upload_action *action,
+                      const char **errstr)
+{
+    bool last = false;
+    uint32_t start;
+    int rc;
+
+#if IMG_MGMT_LAZY_ERASE || IMG_MGMT_ERASE_AHEAD > 0
+    /* erase as we cross sector boundaries */
+    start = img_mgmt_prof_now();
+    rc = img_mgmt_impl_erase_if_needed(req->off, action->write_bytes);
+    IMG_MGMT_PROF_ADD(erase_ticks, start);
+    if (rc != 0) {
+        *errstr = img_mgmt_err_str_flash_erase_failed;
+        return MGMT_ERR_EUNKNOWN;
+    }
+#endif
+    /* If this is the last chunk */
+    if (g_img_mgmt_state.off + req->data_len == g_img_mgmt_state.size) {
+        last = true;
+    }
+
+    start = img_mgmt_prof_now();
+    rc = img_mgmt_impl_write_image_data(req->off, req->img_data,
+                                        action->write_bytes, last);
+    if (rc != 0) {
+        *errstr = img_mgmt_err_str_flash_write_failed;
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+#if IMG_MGMT_UL_SHA256
+    rc = img_mgmt_ul_hash_update(req->img_data, req->off,
+                                 action->write_bytes);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+#endif
+    IMG_MGMT_PROF_ADD(write_ticks, start);
+
+    if (img_mgmt_ul_prof != NULL) {
+        img_mgmt_ul_prof->chunks++;
+        img_mgmt_ul_prof->bytes += action->write_bytes;
+    }
+
+    g_img_mgmt_state.off += action->write_bytes;
+    return 0;
+}
+
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+/**
+ * Commits buffered chunks that have become contiguous with the write cursor.
+ * The request object is reused to describe each drained chunk.
+ */
+static int
+img_mgmt_window_drain(struct img_mgmt_upload_req *req,
+                      struct img_mgmt_upload_action *action,
+                      const char **errstr)
+{
+    struct img_mgmt_window_slot *slot;
+    int rc;
+    int i;
+
+    while ((slot = img_mgmt_window_find(g_img_mgmt_state.off)) != NULL) {
+        req->off = slot->off;
+        req->data_len = slot->len;
+        req->img_data = slot->data;
+        slot->len = 0;
+
+        rc = img_mgmt_impl_upload_inspect(req, action, errstr);
+        if (rc != 0) {
+            return rc;
+        }
+        if (!action->proceed) {
+            break;
+        }
+
+        rc = img_mgmt_upload_write(req, action, errstr);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    /* Release chunks that were overtaken by the write cursor. */
+    for (i = 0; i < IMG_MGMT_UL_WINDOW_SIZE; i++) {
+        if (img_mgmt_window[i].off < g_img_mgmt_state.off) {
+            img_mgmt_window[i].len = 0;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_DECODE
+/**
+ * Writes the produced image bytes held in the decode buffer to the upload
+ * slot, as a regular upload of the produced image would.  Bytes that
+ * do not satisfy the slot's write alignment are kept for the next flush.
+ */
+static int
+img_mgmt_decode_flush(const char **errstr)
+{
+    struct img_mgmt_upload_action action;
+    struct img_mgmt_upload_req req = {
+        .image = 0,
+        .off = img_mgmt_decode.off - img_mgmt_decode.buf_len,
+        .size = img_mgmt_decode.size,
+        .win = 0,
+        .data_len = img_mgmt_decode.buf_len,
+        .data_sha_len = 0,
+        .img_data = img_mgmt_decode.buf,
+        .upgrade = false,
+    };
+    int rc;
+
+    rc = img_mgmt_impl_upload_inspect(&req, &action, errstr);
+    if (rc != 0) {
+        return rc;
+    }
+    if (!action.proceed) {
+        /* Another upload took over the slot. */
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    if (img_mgmt_upload_cb != NULL) {
+        rc = img_mgmt_upload_cb(req.off, action.size, img_mgmt_upload_arg);
+        if (rc != 0) {
+            *errstr = img_mgmt_err_str_app_reject;
+            return rc;
+        }
+    }
+
+    if (req.off == 0) {
+        rc = img_mgmt_upload_begin(&req, &action, errstr);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    rc = img_mgmt_upload_write(&req, &action, errstr);
+    if (rc != 0) {
+        return rc;
+    }
+
+    img_mgmt_decode.buf_len -= action.write_bytes;
+    memmove(img_mgmt_decode.buf,
+            img_mgmt_decode.buf + action.write_bytes,
+            img_mgmt_decode.buf_len);
+
+    if (g_img_mgmt_state.off == g_img_mgmt_state.size) {
+        img_mgmt_upload_finish(action.area_id);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Encodes the response to a chunk of a patch or compressed upload.  The
+ * offset refers to the uploaded stream rather than to the produced image.
+ */
+static int
+img_mgmt_decode_rsp(struct mgmt_ctxt *ctxt, uint32_t off)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_uint(&ctxt->encoder, off);
+
+#if IMG_MGMT_UL_SHA256
+    /* Report whether the produced image matches its hash. */
+    if (img_mgmt_decode.size != 0 &&
+        img_mgmt_decode.off == img_mgmt_decode.size &&
+        img_mgmt_ul_hash_match() >= 0) {
+
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "match");
+        err |= cbor_encode_boolean(&ctxt->encoder,
+                                   img_mgmt_ul_hash_match() == 1);
+    }
+#endif
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+#endif
+
+#if IMG_MGMT_UL_COMP
+/**
+ * Decompresses a chunk of a compressed upload into the decode buffer,
+ * flushing it whenever it fills up.
+ */
+static int
+img_mgmt_upload_comp_apply(const uint8_t *data, size_t len,
+                           const char **errstr)
+{
+    size_t consumed;
+    size_t produced;
+    int rc;
+
+    do {
+        produced = mcumgr_hs_dec_run(&g_img_mgmt_state.comp_dec, data, len,
+                                     &consumed,
+                                     img_mgmt_decode.buf +
+                                     img_mgmt_decode.buf_len,
+                                     sizeof img_mgmt_decode.buf -
+                                     img_mgmt_decode.buf_len);
+        data += consumed;
+        len -= consumed;
+
+        if (produced > img_mgmt_decode.size - img_mgmt_decode.off) {
+            /* The stream expands to more than the stated image size. */
+            *errstr = img_mgmt_err_str_comp_malformed;
+            return MGMT_ERR_EINVAL;
+        }
+        img_mgmt_decode.buf_len += produced;
+        img_mgmt_decode.off += produced;
+
+        if (img_mgmt_decode.buf_len == sizeof img_mgmt_decode.buf ||
+            (img_mgmt_decode.off == img_mgmt_decode.size &&
+             img_mgmt_decode.buf_len > 0)) {
+
+            rc = img_mgmt_decode_flush(errstr);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+    } while (len > 0 || produced > 0);
+
+    return 0;
+}
+
+/**
+ * Processes a chunk of a compressed upload.  "off" and "len" describe the
+ * compressed stream, so that an interrupted upload resumes from the
+ * compressed offset; "dlen" is the size of the image.
+ */
+static int
+img_mgmt_upload_comp(struct mgmt_ctxt *ctxt,
+                     const struct img_mgmt_upload_req *req)
+{
+    const char *errstr = NULL;
+    int rc;
+
+    if (req->off == 0) {
+        if (req->comp != MGMT_COMP_HS) {
+            return MGMT_ERR_ENOTSUP;
+        }
+        if (req->size == -1 || req->size == 0 ||
+            req->dlen == -1 || req->dlen == 0) {
+
+            return MGMT_ERR_EINVAL;
+        }
+
+        g_img_mgmt_state.comp_size = req->size;
+        g_img_mgmt_state.comp_off = 0;
+        mcumgr_hs_dec_init(&g_img_mgmt_state.comp_dec);
+        memset(&img_mgmt_decode, 0, sizeof img_mgmt_decode);
+        img_mgmt_decode.size = req->dlen;
+    }
+
+    if (req->off == g_img_mgmt_state.comp_off && req->data_len > 0) {
+        if (req->off + req->data_len > g_img_mgmt_state.comp_size) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        rc = img_mgmt_upload_comp_apply(req->img_data, req->data_len,
+                                        &errstr);
+        if (rc == 0) {
+            g_img_mgmt_state.comp_off += req->data_len;
+            if (g_img_mgmt_state.comp_off == g_img_mgmt_state.comp_size &&
+                img_mgmt_decode.off != img_mgmt_decode.size) {
+
+                /* The stream ended before the image was complete. */
+                errstr = img_mgmt_err_str_comp_malformed;
+                rc = MGMT_ERR_EINVAL;
+            }
+        }
+        if (rc != 0) {
+            /* The stream cannot be continued; it has to be sent again. */
+            g_img_mgmt_state.comp_size = 0;
+            img_mgmt_dfu_stopped();
+            return img_mgmt_error_rsp(ctxt, rc, errstr);
+        }
+    }
+
+    return img_mgmt_decode_rsp(ctxt, g_img_mgmt_state.comp_off);
+}
+#endif
+
+/**
+ * Writes an inspected upload chunk: gives the application a chance to reject
+ * it, starts the upload with the first chunk and finishes it with the last.
+ */
+static int
+img_mgmt_upload_chunk(struct img_mgmt_upload_req *req,
+                      struct img_mgmt_upload_action *action,
+                      struct mgmt_evt_op_cmd_status_arg *cmd_status_arg,
+                      const char **errstr)
+{
+    int rc;
+
+    /* Request is valid.  Give the application a chance to reject this upload
+     * request.
+     */
+    if (img_mgmt_upload_cb != NULL) {
+        rc = img_mgmt_upload_cb(req->off, action->size, img_mgmt_upload_arg);
+        if (rc != 0) {
+            *errstr = img_mgmt_err_str_app_reject;
+            return rc;
+        }
+    }
+
+    /* Remember flash area ID and image size for subsequent upload requests. */
+    g_img_mgmt_state.area_id = action->area_id;
+    g_img_mgmt_state.size = action->size;
+
+    if (req->off == 0) {
+        cmd_status_arg->status = IMG_MGMT_ID_UPLOAD_STATUS_START;
+        rc = img_mgmt_upload_begin(req, action, errstr);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    /* Write the image data to flash. */
+    if (req->data_len != 0) {
+        rc = img_mgmt_upload_write(req, action, errstr);
+        if (rc != 0) {
+            return rc;
+        }
+
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+        rc = img_mgmt_window_drain(req, action, errstr);
+        if (rc != 0) {
+            return rc;
+        }
+#endif
+
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+        img_mgmt_journal_update();
+#endif
+
+        if (g_img_mgmt_state.off == g_img_mgmt_state.size) {
+            /* Done */
+            img_mgmt_upload_finish(action->area_id);
+            cmd_status_arg->status = IMG_MGMT_ID_UPLOAD_STATUS_ONGOING;
+        }
+    }
+
+    return 0;
+}
+
+#if IMG_MGMT_UL_DATA_MAX > IMG_MGMT_UL_CHUNK_SIZE
+/** Progress of an upload request carrying more than one chunk of data. */
+struct img_mgmt_upload_frame {
+    struct img_mgmt_upload_req *req;
+    struct mgmt_evt_op_cmd_status_arg *cmd_status_arg;
+    const char *errstr;
+    uint32_t base;
+    bool written;
+    bool skipped;
+};
+
+/**
+ * Processes one chunk-sized piece of a large upload request as if it had
+ * arrived in a request of its own.
+ */
+static int
+img_mgmt_upload_piece(const uint8_t *data, size_t off, size_t len, void *arg)
+{
+    struct img_mgmt_upload_frame *frame = arg;
+    struct img_mgmt_upload_action action;
+    struct img_mgmt_upload_req *req;
+    int rc;
+
+    req = frame->req;
+    req->off = frame->base + off;
+    req->data_len = len;
+    req->img_data = data;
+
+    /* The image header in the first piece must be word aligned. */
+    if (req->off == 0 && data != (const uint8_t *)img_mgmt_ul_buf) {
+        memcpy(img_mgmt_ul_buf, data, len);
+        req->img_data = (const uint8_t *)img_mgmt_ul_buf;
+    }
+
+    rc = img_mgmt_impl_upload_inspect(req, &action, &frame->errstr);
+    if (rc != 0) {
+        return rc;
+    }
+    if (!action.proceed) {
+        /* Out of place, either from the start or because drained window
+         * chunks overtook the rest of the request.
+         */
+        frame->skipped = true;
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = img_mgmt_upload_chunk(req, &action, frame->cmd_status_arg,
+                               &frame->errstr);
+    if (rc != 0) {
+        return rc;
+    }
+
+    frame->written = true;
+    return 0;
+}
+
+/**
+ * Processes an upload request that carries more data than fits in a chunk.
+ * The data is consumed a chunk at a time, directly from the request buffer
+ * where it is contiguous and through the chunk buffer where it is not, so
+ * the RAM needed does not grow with the transport MTU.
+ */
+static int
+img_mgmt_upload_frame(struct mgmt_ctxt *ctxt, struct img_mgmt_upload_req *req,
+                      const struct cbor_bytestring_ref *data_ref)
+{
+    struct mgmt_evt_op_cmd_status_arg cmd_status_arg;
+    struct img_mgmt_upload_frame frame = {
+        .req = req,
+        .cmd_status_arg = &cmd_status_arg,
+        .errstr = NULL,
+        .base = req->off,
+        .written = false,
+        .skipped = false,
+    };
+    bool first;
+    int rc;
+
+    if (req->off == -1) {
+        return MGMT_ERR_EINVAL;
+    }
+
+#if IMG_MGMT_UL_COMP
+    if (req->off == 0 ? req->comp != MGMT_COMP_NONE :
+                        g_img_mgmt_state.comp_size != 0) {
+        return MGMT_ERR_EMSGSIZE;
+    }
+    if (req->off == 0) {
+        g_img_mgmt_state.comp_size = 0;
+    }
+#endif
+
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+    img_mgmt_journal_restore();
+#endif
+
+    first = req->off == 0;
+    cmd_status_arg.status = IMG_MGMT_ID_UPLOAD_STATUS_ONGOING;
+
+    rc = cbor_bytestring_ref_foreach(data_ref, img_mgmt_ul_buf,
+                                     IMG_MGMT_UL_CHUNK_SIZE,
+                                     img_mgmt_upload_piece, &frame);
+    if (frame.skipped) {
+        /* Incorrect offset; respond with the correct one. */
+        if (!frame.written) {
+            return img_mgmt_upload_good_rsp(ctxt);
+        }
+        rc = 0;
+    }
+
+    img_mgmt_upload_log(first, g_img_mgmt_state.off == g_img_mgmt_state.size,
+                        rc);
+    mgmt_evt(MGMT_EVT_OP_CMD_STATUS, MGMT_GROUP_ID_IMAGE, IMG_MGMT_ID_UPLOAD,
+             &cmd_status_arg);
+
+    if (rc != 0) {
+        img_mgmt_dfu_stopped();
+        return img_mgmt_error_rsp(ctxt, rc, frame.errstr);
+    }
+
+    return img_mgmt_upload_good_rsp(ctxt);
+}
+#endif
+
+/**
+ * Command handler: image upload
+ */
+static int
+img_mgmt_upload(struct mgmt_ctxt *ctxt)
+{
+    struct mgmt_evt_op_cmd_status_arg cmd_status_arg;
+    struct cbor_bytestring_ref data_ref;
+    struct img_mgmt_upload_req req = {
+        .off = -1,
+        .size = -1,
+        .data_len = 0,
+        .data_sha_len = 0,
+        .upgrade = false,
+        .image = 0,
+        .win = 0,
+        .win_unit = 0,
+#if IMG_MGMT_UL_COMP
+        .comp = MGMT_COMP_NONE,
+        .dlen = -1,
+#endif
+    };
+
+    const struct cbor_attr_t off_attr[] = {
+        [0] = {
+            .attribute = "image",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &req.image,
+            .nodefault = true
+        },
+        [1] = {
+            .attribute = "data",
+            .type = CborAttrByteStringRefType,
+            .addr.bytestring_ref = &data_ref,
+            .len = IMG_MGMT_UL_DATA_MAX
+        },
+        [2] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &req.size,
+            .nodefault = true
+        },
+        [3] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &req.off,
+            .nodefault = true
+        },
+        [4] = {
+            .attribute = "sha",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = req.data_sha,
+            .addr.bytestring.len = &req.data_sha_len,
+            .len = sizeof(req.data_sha)
+        },
+        [5] = {
+            .attribute = "upgrade",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &req.upgrade,
+            .dflt.boolean = false,
+        },
+        [6] = {
+            .attribute = "win",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &req.win,
+            .nodefault = true
+        },
+        [7] = {
+            .attribute = "wu",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &req.win_unit,
+            .nodefault = true
+        },
+#if IMG_MGMT_UL_COMP
+        [8] = {
+            .attribute = "comp",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &req.comp,
+            .nodefault = true
+        },
+        [9] = {
+            .attribute = "dlen",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &req.dlen,
+            .nodefault = true
+        },
+#endif
+        { 0 },
+    };
+    CBORATTR_INDEX_DEFINE(off_attr_index);
+    int rc;
+    const char *errstr = NULL;
+    struct img_mgmt_upload_action action;
+    uint32_t start;
+    bool first;
+
+    start = img_mgmt_prof_now();
+
+    /* Decoded once per chunk; look the keys up through an index. */
+    rc = cbor_read_object_indexed(&ctxt->it, off_attr, &off_attr_index);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+#if IMG_MGMT_UL_DATA_MAX > IMG_MGMT_UL_CHUNK_SIZE
+    if (data_ref.len > IMG_MGMT_UL_CHUNK_SIZE) {
+        IMG_MGMT_PROF_ADD(decode_ticks, start);
+        return img_mgmt_upload_frame(ctxt, &req, &data_ref);
+    }
+#endif
+
+    /* Use the chunk in place where possible. */
+    req.data_len = data_ref.len;
+    if (data_ref.data != NULL && req.off != 0) {
+        req.img_data = data_ref.data;
+    } else {
+        rc = cbor_bytestring_ref_copy(&data_ref, 0, img_mgmt_ul_buf,
+                                      data_ref.len);
+        if (rc != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+        req.img_data = (const uint8_t *)img_mgmt_ul_buf;
+    }
+
+    IMG_MGMT_PROF_ADD(decode_ticks, start);
+
+#if IMG_MGMT_UL_COMP
+    /* Chunks of a compressed upload carry "comp" with the first chunk. */
+    if (req.off == 0 ? req.comp != MGMT_COMP_NONE :
+                       g_img_mgmt_state.comp_size != 0) {
+        return img_mgmt_upload_comp(ctxt, &req);
+    }
+    if (req.off == 0) {
+        g_img_mgmt_state.comp_size = 0;
+    }
+#endif
+
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+    img_mgmt_journal_restore();
+#endif
+
+    /* Determine what actions to take as a result of this request. */
+    rc = img_mgmt_impl_upload_inspect(&req, &action, &errstr);
+    if (rc != 0) {
+        img_mgmt_dfu_stopped();
+        return rc;
+    }
+
+    if (!action.proceed) {
+        /* Request specifies incorrect offset.  Respond with a success code and
+         * the correct offset.  In windowed mode the chunk is retained if it
+         * lies ahead of the write cursor.
+         */
+#if IMG_MGMT_UL_WINDOW_SIZE > 0
+        img_mgmt_window_store(&req);
+#endif
+        return img_mgmt_upload_good_rsp(ctxt);
+    }
+
+    first = req.off == 0;
+
+    rc = img_mgmt_upload_chunk(&req, &action, &cmd_status_arg, &errstr);
+
+    img_mgmt_upload_log(first, g_img_mgmt_state.off == g_img_mgmt_state.size, rc);
+    mgmt_evt(MGMT_EVT_OP_CMD_STATUS, MGMT_GROUP_ID_IMAGE, IMG_MGMT_ID_UPLOAD,
+             &cmd_status_arg);
+
+    if (rc != 0) {
+        img_mgmt_dfu_stopped();
+        return img_mgmt_error_rsp(ctxt, rc, errstr);
+    }
+
+    return img_mgmt_upload_good_rsp(ctxt);
+}
+
+int
+img_mgmt_stage_chunk(int image, uint32_t off, uint32_t size,
+                     const void *data, size_t len, const char **errstr)
+{
+    struct mgmt_evt_op_cmd_status_arg cmd_status_arg;
+    struct img_mgmt_upload_action action;
+    struct img_mgmt_upload_req req = {
+        .image = image,
+        .off = off,
+        .size = size,
+        .win = 0,
+        .data_len = len,
+        .data_sha_len = 0,
+        .img_data = data,
+        .upgrade = false,
+#if IMG_MGMT_UL_COMP
+        .comp = MGMT_COMP_NONE,
+        .dlen = -1,
+#endif
+    };
+    int rc;
+
+    if (len > IMG_MGMT_UL_CHUNK_SIZE) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (off == 0) {
+        /* The image header must be word aligned. */
+        memcpy(img_mgmt_ul_buf, data, len);
+        req.img_data = (const uint8_t *)img_mgmt_ul_buf;
+#if IMG_MGMT_UL_COMP
+        g_img_mgmt_state.comp_size = 0;
+#endif
+    } else if (g_img_mgmt_state.area_id == -1 ||
+               g_img_mgmt_state.off != off) {
+        /* The upload was finished or taken over by another client. */
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    rc = img_mgmt_impl_upload_inspect(&req, &action, errstr);
+    if (rc != 0) {
+        img_mgmt_dfu_stopped();
+        return rc;
+    }
+    if (!action.proceed) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    cmd_status_arg.status = IMG_MGMT_ID_UPLOAD_STATUS_ONGOING;
+    rc = img_mgmt_upload_chunk(&req, &action, &cmd_status_arg, errstr);
+
+    img_mgmt_upload_log(off == 0, g_img_mgmt_state.off == g_img_mgmt_state.size,
+                        rc);
+    mgmt_evt(MGMT_EVT_OP_CMD_STATUS, MGMT_GROUP_ID_IMAGE, IMG_MGMT_ID_UPLOAD,
+             &cmd_status_arg);
+
+    if (rc != 0) {
+        img_mgmt_dfu_stopped();
+        return rc;
+    }
+
+    return 0;
+}
+
+#if IMG_MGMT_MCAST
+/**
+ * Starts the multicast upload named by a chunk whose session ID is new.  A
+ * failed start is remembered under the session ID too, so that the rest of
+ * the session's chunks do not retry it.
+ */
+static void
+img_mgmt_mcast_begin(uint32_t sid, int image, uint32_t size, uint32_t unit)
+{
+    uint32_t start;
+    int area_id;
+    int rc;
+
+    memset(&img_mgmt_mcast, 0, sizeof img_mgmt_mcast);
+    img_mgmt_mcast.open = true;
+    img_mgmt_mcast.sid = sid;
+    img_mgmt_mcast.size = size;
+    img_mgmt_mcast.unit = unit;
+
+    /* The image header must fit in the first chunk. */
+    if (size == 0 || unit < sizeof(struct image_header) ||
+        unit > IMG_MGMT_UL_CHUNK_SIZE) {
+
+        img_mgmt_mcast.rc = MGMT_ERR_EINVAL;
+        return;
+    }
+
+    img_mgmt_mcast.cnt = size / unit + (size % unit != 0);
+    if (img_mgmt_mcast.cnt > IMG_MGMT_MCAST_CHUNKS) {
+        /* The client has to use larger chunks. */
+        img_mgmt_mcast.rc = MGMT_ERR_ENOMEM;
+        return;
+    }
+
+    /* Take over from any regular upload. */
+    g_img_mgmt_state.area_id = -1;
+    g_img_mgmt_state.size = size;
+    g_img_mgmt_state.off = 0;
+    g_img_mgmt_state.data_sha_len = 0;
+#if IMG_MGMT_WRITE_ALIGN_MAX > 0
+    g_img_mgmt_state.carry_len = 0;
+#endif
+    img_mgmt_meta_invalidate_secondary();
+    img_mgmt_state_invalidate();
+#if IMG_MGMT_UL_JOURNAL_KB > 0
+    img_mgmt_journal_clear();
+#endif
+#if IMG_MGMT_VERIFY
+    img_mgmt_verify_cancel();
+#endif
+
+    img_mgmt_dfu_started();
+
+    start = img_mgmt_prof_now();
+    rc = img_mgmt_impl_mcast_begin(image, size, &area_id);
+    IMG_MGMT_PROF_ADD(erase_ticks, start);
+    img_mgmt_upload_log(true, false, rc);
+    if (rc != 0) {
+        img_mgmt_mcast.rc = rc;
+        img_mgmt_dfu_stopped();
+        return;
+    }
+
+    g_img_mgmt_state.area_id = area_id;
+}
+
+/**
+ * Abandons the multicast upload in progress, e.g., when a regular upload
+ * takes over the slot.  The session ID is kept, so that stray chunks of the
+ * session are turned away rather than starting it over.
+ */
+static void
+img_mgmt_mcast_cancel(void)
+{
+    if (img_mgmt_mcast.open && img_mgmt_mcast.rc == 0 &&
+        img_mgmt_mcast.rcvd < img_mgmt_mcast.cnt) {
+
+        img_mgmt_mcast.rc = MGMT_ERR_EBADSTATE;
+    }
+}
+
+/**
+ * Writes a chunk of the multicast upload in progress, unless it has been
+ * written already, and completes the upload with its last missing chunk.
+ */
+static int
+img_mgmt_mcast_chunk(uint32_t idx, const uint8_t *data, uint32_t len,
+                     const char **errstr)
+{
+    const struct image_header *hdr;
+    uint32_t start;
+    uint32_t off;
+    int rc;
+
+    off = idx * img_mgmt_mcast.unit;
+    if (img_mgmt_mcast.map[idx / 8] & (1 << (idx % 8))) {
+        /* Duplicate, e.g., a repair that crossed a multicast chunk. */
+        return 0;
+    }
+
+    if (img_mgmt_upload_cb != NULL) {
+        rc = img_mgmt_upload_cb(off, img_mgmt_mcast.size, img_mgmt_upload_arg);
+        if (rc != 0) {
+            *errstr = img_mgmt_err_str_app_reject;
+            return rc;
+        }
+    }
+
+    if (idx == 0) {
+        hdr = (const struct image_header *)data;
+        if (hdr->ih_magic != IMAGE_MAGIC) {
+            *errstr = img_mgmt_err_str_magic_mismatch;
+            rc = MGMT_ERR_EINVAL;
+            goto fail;
+        }
+    }
+
+    start = img_mgmt_prof_now();
+    rc = img_mgmt_impl_mcast_write(off, data, len);
+    IMG_MGMT_PROF_ADD(write_ticks, start);
+    if (rc != 0) {
+        *errstr = img_mgmt_err_str_flash_write_failed;
+        goto fail;
+    }
+
+    if (img_mgmt_ul_prof != NULL) {
+        img_mgmt_ul_prof->chunks++;
+        img_mgmt_ul_prof->bytes += len;
+    }
+
+    img_mgmt_mcast.map[idx / 8] |= 1 << (idx % 8);
+    img_mgmt_mcast.rcvd++;
+
+    if (img_mgmt_mcast.rcvd == img_mgmt_mcast.cnt) {
+        g_img_mgmt_state.off = img_mgmt_mcast.size;
+        img_mgmt_upload_log(false, true, 0);
+        img_mgmt_upload_finish(g_img_mgmt_state.area_id);
+    }
+
+    return 0;
+
+fail:
+    /* The slot cannot be completed; the upload has to start over. */
+    img_mgmt_mcast.rc = rc;
+    img_mgmt_upload_log(false, false, rc);
+    img_mgmt_dfu_stopped();
+    return rc;
+}
+
+/**
+ * Encodes the progress of the multicast upload, without the bitmap.
+ */
+static int
+img_mgmt_mcast_rsp(struct mgmt_ctxt *ctxt)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, img_mgmt_mcast.rc);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "sid");
+    err |= cbor_encode_uint(&ctxt->encoder, img_mgmt_mcast.sid);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "cnt");
+    err |= cbor_encode_uint(&ctxt->encoder, img_mgmt_mcast.cnt);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rcvd");
+    err |= cbor_encode_uint(&ctxt->encoder, img_mgmt_mcast.rcvd);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: image multicast upload (read)
+ *
+ * Reports the progress of the multicast upload, for the repair phase: "map"
+ * holds the received-chunk bitmap from chunk "start" on, as much of it as
+ * fits in a response.  Bit n % 8 of byte n / 8 stands for chunk start + n.
+ * The client sends the chunks whose bits are clear again, over unicast.
+ */
+static int
+img_mgmt_mcast_read(struct mgmt_ctxt *ctxt)
+{
+    unsigned long long start;
+    CborError err;
+    size_t map_len;
+    size_t len;
+    int rc;
+
+    const struct cbor_attr_t mcast_attr[] = {
+        [0] = {
+            .attribute = "start",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &start,
+            .dflt.uinteger = 0,
+        },
+        [1] = { 0 },
     };
 
-    const struct cbor_attr_t off_attr[] = {
+    rc = cbor_read_object(&ctxt->it, mcast_attr);
+    if (rc != 0 || start % 8 != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (!img_mgmt_mcast.open) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    rc = img_mgmt_mcast_rsp(ctxt);
+    if (rc != 0) {
+        return rc;
+    }
+
+    map_len = (img_mgmt_mcast.cnt + 7) / 8;
+    len = 0;
+    if (start / 8 < map_len) {
+        len = mgmt_rsp_chunk_size(ctxt, IMG_MGMT_MCAST_RSP_OVERHEAD,
+                                  IMG_MGMT_MCAST_MAP_MAX);
+        if (len > map_len - start / 8) {
+            len = map_len - start / 8;
+        }
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "len");
+    err |= cbor_encode_uint(&ctxt->encoder, img_mgmt_mcast.size);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "unit");
+    err |= cbor_encode_uint(&ctxt->encoder, img_mgmt_mcast.unit);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "start");
+    err |= cbor_encode_uint(&ctxt->encoder, start);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "map");
+    err |= cbor_encode_byte_string(&ctxt->encoder,
+                                   len == 0 ? img_mgmt_mcast.map :
+                                              img_mgmt_mcast.map + start / 8,
+                                   len);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: image multicast upload (write)
+ *
+ * Uploads an image to many devices at once: the client sends each chunk
+ * once, e.g., to a UDP multicast group, and every device writes the chunks it
+ * receives in whatever order they arrive.  Each device then reports the
+ * chunks it is missing (see img_mgmt_mcast_read()) and the client sends
+ * just those to it.  Total update time thus grows with the image size rather
+ * than with the number of devices.
+ *
+ * Since any chunk may be lost, every request describes the whole upload:
+ * "sid" is an ID the client picks for it, "image" the image to upload, "len"
+ * its size and "unit" the chunk size, which must be a multiple of the flash
+ * write alignment.  "off" and "data" carry the chunk; all chunks but the last
+ * are "unit" bytes long.  A request with a new session ID starts a new
+ * upload, which erases the spare slot.
+ *
+ * Chunks are not hashed as they are written; the client checks the result
+ * with the image verify command where it is available.
+ */
+static int
+img_mgmt_mcast_write(struct mgmt_ctxt *ctxt)
+{
+    struct cbor_bytestring_ref data_ref;
+    unsigned long long image;
+    unsigned long long unit;
+    unsigned long long size;
+    unsigned long long sid;
+    unsigned long long off;
+    const uint8_t *data;
+    const char *errstr;
+    uint32_t start;
+    uint32_t idx;
+    uint32_t len;
+    int rc;
+
+    const struct cbor_attr_t mcast_attr[] = {
         [0] = {
-            .attribute = "image",
+            .attribute = "sid",
             .type = CborAttrUnsignedIntegerType,
-            .addr.uinteger = &req.image,
+            .addr.uinteger = &sid,
             .nodefault = true
         },
         [1] = {
-            .attribute = "data",
-            .type = CborAttrByteStringType,
-            .addr.bytestring.data = req.img_data,
-            .addr.bytestring.len = &req.data_len,
-            .len = sizeof(req.img_data)
+            .attribute = "image",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &image,
+            .nodefault = true
         },
         [2] = {
             .attribute = "len",
             .type = CborAttrUnsignedIntegerType,
-            .addr.uinteger = &req.size,
+            .addr.uinteger = &size,
             .nodefault = true
         },
         [3] = {
-            .attribute = "off",
+            .attribute = "unit",
             .type = CborAttrUnsignedIntegerType,
-            .addr.uinteger = &req.off,
+            .addr.uinteger = &unit,
             .nodefault = true
         },
         [4] = {
-            .attribute = "sha",
-            .type = CborAttrByteStringType,
-            .addr.bytestring.data = req.data_sha,
-            .addr.bytestring.len = &req.data_sha_len,
-            .len = sizeof(req.data_sha)
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+            .nodefault = true
         },
         [5] = {
-            .attribute = "upgrade",
-            .type = CborAttrBooleanType,
-            .addr.boolean = &req.upgrade,
-            .dflt.boolean = false,
+            .attribute = "data",
+            .type = CborAttrByteStringRefType,
+            .addr.bytestring_ref = &data_ref,
+            .len = IMG_MGMT_UL_CHUNK_SIZE
         },
         [6] = { 0 },
     };
-    int rc;
-    const char *errstr = NULL;
-    struct img_mgmt_upload_action action;
-    bool last = false;
 
-    rc = cbor_read_object(&ctxt->it, off_attr);
-    if (rc != 0) {
+    start = img_mgmt_prof_now();
+
+    sid = ULLONG_MAX;
+    image = 0;
+    size = ULLONG_MAX;
+    unit = ULLONG_MAX;
+    off = ULLONG_MAX;
+    data_ref.data = NULL;
+    data_ref.len = 0;
+    rc = cbor_read_object(&ctxt->it, mcast_attr);
+    if (rc != 0 || sid > UINT32_MAX || size > UINT32_MAX ||
+        unit > UINT32_MAX || off == ULLONG_MAX) {
+
         return MGMT_ERR_EINVAL;
     }
 
-    /* Determine what actions to take as a result of this request. */
-    rc = img_mgmt_impl_upload_inspect(&req, &action, &errstr);
-    if (rc != 0) {
-        img_mgmt_dfu_stopped();
-        return rc;
+    if (!img_mgmt_mcast.open || img_mgmt_mcast.sid != sid) {
+        img_mgmt_mcast_begin(sid, image, size, unit);
+    } else if (img_mgmt_mcast.size != size || img_mgmt_mcast.unit != unit) {
+        return MGMT_ERR_EINVAL;
     }
 
-    if (!action.proceed) {
-        /* Request specifies incorrect offset.  Respond with a success code and
-         * the correct offset.
-         */
-        return img_mgmt_upload_good_rsp(ctxt);
+    if (img_mgmt_mcast.rc != 0) {
+        return img_mgmt_mcast_rsp(ctxt);
     }
 
-    /* Request is valid.  Give the application a chance to reject this upload
-     * request.
+    /* The chunk must be a whole one, in place. */
+    if (off % img_mgmt_mcast.unit != 0 || off >= img_mgmt_mcast.size) {
+        return MGMT_ERR_EINVAL;
+    }
+    idx = off / img_mgmt_mcast.unit;
+    len = idx == img_mgmt_mcast.cnt - 1 ? img_mgmt_mcast.size - off :
+                                          img_mgmt_mcast.unit;
+    if (data_ref.len != len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    /* Use the chunk in place where possible; the image header must be word
+     * aligned.
      */
-    if (img_mgmt_upload_cb != NULL) {
-        rc = img_mgmt_upload_cb(req.off, action.size, img_mgmt_upload_arg);
+    if (data_ref.data != NULL && idx != 0) {
+        data = data_ref.data;
+    } else {
+        rc = cbor_bytestring_ref_copy(&data_ref, 0, img_mgmt_ul_buf, len);
         if (rc != 0) {
-            errstr = img_mgmt_err_str_app_reject;
-            goto end;
+            return MGMT_ERR_EINVAL;
         }
+        data = (const uint8_t *)img_mgmt_ul_buf;
     }
 
-    /* Remember flash area ID and image size for subsequent upload requests. */
-    g_img_mgmt_state.area_id = action.area_id;
-    g_img_mgmt_state.size = action.size;
+    IMG_MGMT_PROF_ADD(decode_ticks, start);
 
-    if (req.off == 0) {
-        /*
-         * New upload.
-         */
-        g_img_mgmt_state.off = 0;
+    errstr = NULL;
+    rc = img_mgmt_mcast_chunk(idx, data, len, &errstr);
+    if (rc != 0) {
+        return img_mgmt_error_rsp(ctxt, rc, errstr);
+    }
 
-        img_mgmt_dfu_started();
-        cmd_status_arg.status = IMG_MGMT_ID_UPLOAD_STATUS_START;
+    return img_mgmt_mcast_rsp(ctxt);
+}
+#endif
 
-        /*
-         * We accept SHA trimmed to any length by client since it's up to client
-         * to make sure provided data are good enough to avoid collisions when
-         * resuming upload.
-         */
-        g_img_mgmt_state.data_sha_len = req.data_sha_len;
-        memcpy(g_img_mgmt_state.data_sha, req.data_sha, req.data_sha_len);
-        memset(&g_img_mgmt_state.data_sha[req.data_sha_len], 0,
-               IMG_MGMT_DATA_SHA_LEN - req.data_sha_len);
+#if IMG_MGMT_DELTA
+/**
+ * Applies a chunk of patch data.  Diff bytes are added to the corresponding
+ * bytes of the running image and extra bytes are copied; in both cases the
+ * result goes into the output buffer, which is flushed whenever it fills up.
+ */
+static int
+img_mgmt_delta_apply(const uint8_t *data, uint32_t len, const char **errstr)
+{
+    uint32_t room;
+    uint32_t n;
+    uint32_t i;
+    uint8_t *dst;
+    int rc;
 
-#if IMG_MGMT_LAZY_ERASE
-        /* setup for lazy sector by sector erase */
-        g_img_mgmt_state.sector_id = -1;
-        g_img_mgmt_state.sector_end = 0;
-#else
-        /* erase the entire req.size all at once */
-        if (action.erase) {
-            rc = img_mgmt_impl_erase_image_data(0, req.size);
+    while (len > 0 || img_mgmt_delta_state.phase != IMG_MGMT_DELTA_PHASE_DONE) {
+        switch (img_mgmt_delta_state.phase) {
+        case IMG_MGMT_DELTA_PHASE_HDR:
+        case IMG_MGMT_DELTA_PHASE_CTRL:
+            if (len == 0) {
+                return 0;
+            }
+
+            n = (img_mgmt_delta_state.phase == IMG_MGMT_DELTA_PHASE_HDR ?
+                 sizeof img_mgmt_delta_state.rec.hdr :
+                 sizeof img_mgmt_delta_state.rec.ctrl) -
+                img_mgmt_delta_state.rec_fill;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(img_mgmt_delta_state.rec.bytes +
+                   img_mgmt_delta_state.rec_fill, data, n);
+            img_mgmt_delta_state.rec_fill += n;
+            data += n;
+            len -= n;
+
+            if (img_mgmt_delta_state.phase == IMG_MGMT_DELTA_PHASE_HDR) {
+                if (img_mgmt_delta_state.rec_fill <
+                    sizeof img_mgmt_delta_state.rec.hdr) {
+                    break;
+                }
+                if (img_mgmt_delta_state.rec.hdr.magic !=
+                    IMG_MGMT_DELTA_MAGIC ||
+                    img_mgmt_delta_state.rec.hdr.size == 0) {
+
+                    *errstr = img_mgmt_err_str_delta_malformed;
+                    return MGMT_ERR_EINVAL;
+                }
+                img_mgmt_decode.size =
+                    img_mgmt_delta_state.rec.hdr.size;
+                img_mgmt_delta_state.phase = IMG_MGMT_DELTA_PHASE_CTRL;
+            } else {
+                if (img_mgmt_delta_state.rec_fill <
+                    sizeof img_mgmt_delta_state.rec.ctrl) {
+                    break;
+                }
+                img_mgmt_delta_state.remaining =
+                    img_mgmt_delta_state.rec.ctrl.diff_len;
+                img_mgmt_delta_state.phase = IMG_MGMT_DELTA_PHASE_DIFF;
+            }
+            img_mgmt_delta_state.rec_fill = 0;
+            break;
+
+        case IMG_MGMT_DELTA_PHASE_DIFF:
+        case IMG_MGMT_DELTA_PHASE_EXTRA:
+            if (img_mgmt_delta_state.remaining == 0) {
+                if (img_mgmt_delta_state.phase == IMG_MGMT_DELTA_PHASE_DIFF) {
+                    img_mgmt_delta_state.remaining =
+                        img_mgmt_delta_state.rec.ctrl.extra_len;
+                    img_mgmt_delta_state.phase = IMG_MGMT_DELTA_PHASE_EXTRA;
+                } else {
+                    img_mgmt_delta_state.src_off +=
+                        img_mgmt_delta_state.rec.ctrl.seek;
+                    img_mgmt_delta_state.phase = IMG_MGMT_DELTA_PHASE_CTRL;
+                }
+                break;
+            }
+            if (len == 0) {
+                return 0;
+            }
+
+            n = img_mgmt_delta_state.remaining;
+            if (n > len) {
+                n = len;
+            }
+            room = sizeof img_mgmt_decode.buf -
+                   img_mgmt_decode.buf_len;
+            if (n > room) {
+                n = room;
+            }
+            if (n > img_mgmt_decode.size -
+                    img_mgmt_decode.off) {
+
+                /* The patch produces more than the stated image size. */
+                *errstr = img_mgmt_err_str_delta_malformed;
+                return MGMT_ERR_EINVAL;
+            }
+
+            dst = img_mgmt_decode.buf + img_mgmt_decode.buf_len;
+            if (img_mgmt_delta_state.phase == IMG_MGMT_DELTA_PHASE_DIFF) {
+                rc = img_mgmt_impl_read(IMG_MGMT_BOOT_CURR_SLOT,
+                                        img_mgmt_delta_state.src_off, dst, n);
+                if (rc != 0) {
+                    return rc;
+                }
+                for (i = 0; i < n; i++) {
+                    dst[i] += data[i];
+                }
+                img_mgmt_delta_state.src_off += n;
+            } else {
+                memcpy(dst, data, n);
+            }
+
+            img_mgmt_decode.buf_len += n;
+            img_mgmt_decode.off += n;
+            img_mgmt_delta_state.remaining -= n;
+            data += n;
+            len -= n;
+            break;
+
+        default:
+            /* Data beyond the end of the produced image. */
+            *errstr = img_mgmt_err_str_delta_malformed;
+            return MGMT_ERR_EINVAL;
+        }
+
+        if (img_mgmt_decode.size != 0 &&
+            img_mgmt_decode.off == img_mgmt_decode.size) {
+
+            img_mgmt_delta_state.phase = IMG_MGMT_DELTA_PHASE_DONE;
+        }
+
+        if (img_mgmt_decode.buf_len == sizeof img_mgmt_decode.buf ||
+            (img_mgmt_delta_state.phase == IMG_MGMT_DELTA_PHASE_DONE &&
+             img_mgmt_decode.buf_len > 0)) {
+
+            rc = img_mgmt_decode_flush(errstr);
             if (rc != 0) {
-                rc = MGMT_ERR_EUNKNOWN;
-                errstr = img_mgmt_err_str_flash_erase_failed;
-                goto end;
+                return rc;
             }
         }
-#endif
     }
 
-    /* Write the image data to flash. */
-    if (req.data_len != 0) {
-#if IMG_MGMT_LAZY_ERASE
-        /* erase as we cross sector boundaries */
-        if (img_mgmt_impl_erase_if_needed(req.off, action.write_bytes) != 0) {
-            rc = MGMT_ERR_EUNKNOWN;
-            errstr = img_mgmt_err_str_flash_erase_failed;
-            goto end;
-        }
-#endif
-        /* If this is the last chunk */
-        if (g_img_mgmt_state.off + req.data_len == g_img_mgmt_state.size) {
-            last = true;
+    return 0;
+}
+
+/**
+ * Applies a piece of a patch chunk.  Chunks are consumed a piece at a time so
+ * that they need not fit in the chunk buffer.
+ */
+static int
+img_mgmt_delta_piece(const uint8_t *data, size_t off, size_t len, void *arg)
+{
+    return img_mgmt_delta_apply(data, len, arg);
+}
+
+/**
+ * Command handler: image delta
+ *
+ * Uploads an image as a patch against the running image: the new image is
+ * produced on the device and written to the spare slot through the regular
+ * upload path.  The request carries the same "off", "len" and "data" fields
+ * as an upload, where these describe the patch, plus "src" with the first
+ * chunk: the hash of the image the patch was made against.
+ */
+static int
+img_mgmt_delta(struct mgmt_ctxt *ctxt)
+{
+    uint8_t cur_hash[IMAGE_HASH_LEN];
+    uint8_t src[IMAGE_HASH_LEN];
+    struct cbor_bytestring_ref data_ref;
+    unsigned long long off = -1;
+    unsigned long long size = -1;
+    size_t src_len = 0;
+    const char *errstr = NULL;
+    int rc;
+
+    const struct cbor_attr_t delta_attr[] = {
+        [0] = {
+            .attribute = "data",
+            .type = CborAttrByteStringRefType,
+            .addr.bytestring_ref = &data_ref,
+            .len = IMG_MGMT_UL_DATA_MAX
+        },
+        [1] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &size,
+            .nodefault = true
+        },
+        [2] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+            .nodefault = true
+        },
+        [3] = {
+            .attribute = "src",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = src,
+            .addr.bytestring.len = &src_len,
+            .len = sizeof src
+        },
+        [4] = { 0 },
+    };
+
+    data_ref.data = NULL;
+    data_ref.len = 0;
+
+    rc = cbor_read_object(&ctxt->it, delta_attr);
+    if (rc != 0 || off == -1) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (off == 0) {
+        /* New patch; it must have been made against the running image. */
+        if (size == -1 || size == 0 || src_len != IMAGE_HASH_LEN) {
+            return MGMT_ERR_EINVAL;
         }
 
-        rc = img_mgmt_impl_write_image_data(req.off, req.img_data, action.write_bytes, last);
+        rc = img_mgmt_read_info(IMG_MGMT_BOOT_CURR_SLOT, NULL, cur_hash,
+                                NULL);
         if (rc != 0) {
-            rc = MGMT_ERR_EUNKNOWN;
-            errstr = img_mgmt_err_str_flash_write_failed;
-            goto end;
-        } else {
-            g_img_mgmt_state.off += action.write_bytes;
-            if (g_img_mgmt_state.off == g_img_mgmt_state.size) {
-                /* Done */
-#ifdef CONFIG_BOARD_SCORPIO
-                img_mgmt_impl_write_trailer(action.area_id - 1);
-#endif
-                img_mgmt_dfu_pending();
-                cmd_status_arg.status = IMG_MGMT_ID_UPLOAD_STATUS_ONGOING;
-                g_img_mgmt_state.area_id = -1;
-            }
+            return MGMT_ERR_EUNKNOWN;
+        }
+        if (memcmp(src, cur_hash, IMAGE_HASH_LEN) != 0) {
+            return img_mgmt_error_rsp(ctxt, MGMT_ERR_EBADSTATE,
+                                      img_mgmt_err_str_delta_src_mismatch);
         }
+
+        memset(&img_mgmt_delta_state, 0, sizeof img_mgmt_delta_state);
+        memset(&img_mgmt_decode, 0, sizeof img_mgmt_decode);
+        img_mgmt_delta_state.patch_size = size;
     }
 
-end:
+    if (img_mgmt_delta_state.patch_size == 0) {
+        return MGMT_ERR_EBADSTATE;
+    }
 
-    img_mgmt_upload_log(req.off == 0, g_img_mgmt_state.off == g_img_mgmt_state.size, rc);
-    mgmt_evt(MGMT_EVT_OP_CMD_STATUS, MGMT_GROUP_ID_IMAGE, IMG_MGMT_ID_UPLOAD,
-             &cmd_status_arg);
+    if (off == img_mgmt_delta_state.patch_off && data_ref.len > 0) {
+        if (off + data_ref.len > img_mgmt_delta_state.patch_size) {
+            return MGMT_ERR_EINVAL;
+        }
 
-    if (rc != 0) {
-        img_mgmt_dfu_stopped();
-        return img_mgmt_error_rsp(ctxt, rc, errstr);
+        rc = cbor_bytestring_ref_foreach(&data_ref, img_mgmt_ul_buf,
+                                         IMG_MGMT_UL_CHUNK_SIZE,
+                                         img_mgmt_delta_piece, &errstr);
+        if (rc == 0) {
+            img_mgmt_delta_state.patch_off += data_ref.len;
+            if (img_mgmt_delta_state.patch_off ==
+                    img_mgmt_delta_state.patch_size &&
+                img_mgmt_delta_state.phase != IMG_MGMT_DELTA_PHASE_DONE) {
+
+                /* The patch ended before the image was complete. */
+                errstr = img_mgmt_err_str_delta_malformed;
+                rc = MGMT_ERR_EINVAL;
+            }
+        }
+        if (rc != 0) {
+            /* The patch cannot be continued; it has to be sent again. */
+            img_mgmt_delta_state.patch_size = 0;
+            img_mgmt_dfu_stopped();
+            return img_mgmt_error_rsp(ctxt, rc, errstr);
+        }
     }
 
-    return img_mgmt_upload_good_rsp(ctxt);
+    /* As with an upload, a chunk at the wrong offset is answered with the
+     * expected offset.
+     */
+    return img_mgmt_decode_rsp(ctxt, img_mgmt_delta_state.patch_off);
 }
+#endif
 
 void
 img_mgmt_dfu_stopped(void)
@@ -615,6 +3337,14 @@ img_mgmt_set_upload_cb(img_mgmt_upload_fn *cb, void *arg)
     img_mgmt_upload_arg = arg;
 }
 
+void
+img_mgmt_set_ul_prof(struct img_mgmt_ul_prof *prof,
+                     img_mgmt_clock_fn *clock_cb)
+{
+    img_mgmt_ul_clock = clock_cb;
+    img_mgmt_ul_prof = prof;
+}
+
 void
 img_mgmt_register_callbacks(const img_mgmt_dfu_callbacks_t *cb_struct)
 {
@@ -631,11 +3361,18 @@ img_mgmt_my_version(struct image_version *ver)
 void
 img_mgmt_register_group(void)
 {
+#if !MGMT_STATIC_GROUPS
     mgmt_register_group(&img_mgmt_group);
+#endif
+
+    /* Index the images present at boot. */
+    img_mgmt_meta_load();
 }
 
 void
 img_mgmt_unregister_group(void)
 {
+#if !MGMT_STATIC_GROUPS
     mgmt_unregister_group(&img_mgmt_group);
+#endif
 }
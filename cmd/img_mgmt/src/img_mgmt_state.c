@@ -29,16 +29,42 @@
 
 #include "bootutil/bootutil_public.h"
 
+/* Number of key-value pairs in each entry of an image state response; the
+ * image number is only reported if there is more than one image.
+ */
+#define IMG_MGMT_STATE_IMAGE_FIELDS     (8 + (IMG_MGMT_IMAGE_COUNT > 1))
+
+/* Maximum number of operations in one image state write. */
+#define IMG_MGMT_STATE_OPS_MAX          4
+
+/** One operation of an image state write. */
+struct img_mgmt_state_op {
+    struct cbor_bytestring_ref hash;
+    bool confirm;
+
+    /* Slot the operation applies to; resolved before anything is written. */
+    int slot;
+};
+
+static img_mgmt_reset_fn *img_mgmt_reset_cb;
+static void *img_mgmt_reset_arg;
+
 /**
- * Collects information about the specified image slot.
+ * State flags of both image slots, derived from the boot trailers; only
+ * valid if img_mgmt_state_cached is set.
  */
-uint8_t
-img_mgmt_state_flags(int query_slot)
+static uint8_t img_mgmt_state_cache[IMG_MGMT_SLOT_COUNT];
+static bool img_mgmt_state_cached;
+
+/**
+ * Collects information about the specified image slot from the boot
+ * trailers.
+ */
+static uint8_t
+img_mgmt_state_flags_read(int query_slot)
 {
     uint8_t flags;
 
-    assert(query_slot == 0 || query_slot == 1);
-
     flags = 0;
 
     /* Determine if this is is pending or confirmed (only applicable for
@@ -67,17 +93,19 @@ img_mgmt_state_flags(int query_slot)
         }
     }
 #else
-    int swap_type = img_mgmt_impl_swap_type();
+    /* Whether the slot is the one its image runs from. */
+    bool curr = query_slot % 2 == IMG_MGMT_BOOT_CURR_SLOT;
+    int swap_type = img_mgmt_impl_swap_type(query_slot);
     switch (swap_type) {
     case IMG_MGMT_SWAP_TYPE_NONE:
-        if (query_slot == IMG_MGMT_BOOT_CURR_SLOT) {
+        if (curr) {
             flags |= IMG_MGMT_STATE_F_CONFIRMED;
             flags |= IMG_MGMT_STATE_F_ACTIVE;
         }
         break;
 
     case IMG_MGMT_SWAP_TYPE_TEST:
-        if (query_slot == IMG_MGMT_BOOT_CURR_SLOT) {
+        if (curr) {
             flags |= IMG_MGMT_STATE_F_CONFIRMED;
         } else {
             flags |= IMG_MGMT_STATE_F_PENDING;
@@ -85,7 +113,7 @@ img_mgmt_state_flags(int query_slot)
         break;
 
     case IMG_MGMT_SWAP_TYPE_PERM:
-        if (query_slot == IMG_MGMT_BOOT_CURR_SLOT) {
+        if (curr) {
             flags |= IMG_MGMT_STATE_F_CONFIRMED;
         } else {
             flags |= IMG_MGMT_STATE_F_PENDING | IMG_MGMT_STATE_F_PERMANENT;
@@ -93,7 +121,7 @@ img_mgmt_state_flags(int query_slot)
         break;
 
     case IMG_MGMT_SWAP_TYPE_REVERT:
-        if (query_slot == IMG_MGMT_BOOT_CURR_SLOT) {
+        if (curr) {
             flags |= IMG_MGMT_STATE_F_ACTIVE;
         } else {
             flags |= IMG_MGMT_STATE_F_CONFIRMED;
@@ -102,13 +130,41 @@ img_mgmt_state_flags(int query_slot)
 
     default:
         printf("%s: Unknown swap type 0x%x, slot %s\n", __FUNCTION__,
-            swap_type, query_slot == IMG_MGMT_BOOT_CURR_SLOT ? "Primary" : "Secondary");
+            swap_type, curr ? "Primary" : "Secondary");
         break;
     }
 #endif // CONFIG_BOARD_SCORPIO
     return flags;
 }
 
+void
+img_mgmt_state_invalidate(void)
+{
+    img_mgmt_state_cached = false;
+    img_mgmt_state_epoch++;
+}
+
+/**
+ * Collects information about the specified image slot.  The boot trailers are
+ * only read the first time after the state was invalidated.
+ */
+uint8_t
+img_mgmt_state_flags(int query_slot)
+{
+    int i;
+
+    assert(query_slot >= 0 && query_slot < IMG_MGMT_SLOT_COUNT);
+
+    if (!img_mgmt_state_cached) {
+        for (i = 0; i < IMG_MGMT_SLOT_COUNT; i++) {
+            img_mgmt_state_cache[i] = img_mgmt_state_flags_read(i);
+        }
+        img_mgmt_state_cached = true;
+    }
+
+    return img_mgmt_state_cache[query_slot];
+}
+
 /**
  * Indicates whether any image slot is pending (i.e., whether a test swap will
  * happen on the next reboot.
@@ -160,6 +216,7 @@ img_mgmt_state_set_pending(int slot, int permanent)
     }
 
     rc = img_mgmt_impl_write_pending(slot, permanent);
+    img_mgmt_state_invalidate();
     if (rc != 0) {
         rc = MGMT_ERR_EUNKNOWN;
     }
@@ -197,6 +254,7 @@ img_mgmt_state_confirm(void)
     }
 
     rc = img_mgmt_impl_write_confirmed();
+    img_mgmt_state_invalidate();
     if (rc != 0) {
         rc = MGMT_ERR_EUNKNOWN;
     }
@@ -215,8 +273,9 @@ img_mgmt_state_read(struct mgmt_ctxt *ctxt)
     char vers_str[IMG_MGMT_VER_MAX_STR_LEN];
     uint8_t hash[IMAGE_HASH_LEN]; /* SHA256 hash */
     struct image_version ver;
-    CborEncoder images;
+    struct mgmt_counted images;
     CborEncoder image;
+    size_t count;
     CborError err;
     uint32_t flags;
     uint8_t state_flags;
@@ -225,10 +284,17 @@ img_mgmt_state_read(struct mgmt_ctxt *ctxt)
 
     err = 0;
     err |= cbor_encode_text_stringz(&ctxt->encoder, "images");
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    rc = mgmt_open_counted_array(ctxt, &ctxt->encoder, &images);
+    if (rc != 0) {
+        return rc;
+    }
 
-    err |= cbor_encoder_create_array(&ctxt->encoder, &images,
-                                       CborIndefiniteLength);
-    for (i = 0; i < 2; i++) {
+    count = 0;
+    for (i = 0; i < IMG_MGMT_SLOT_COUNT; i++) {
         rc = img_mgmt_read_info(i, &ver, hash, &flags);
         if (rc != 0) {
             continue;
@@ -236,8 +302,12 @@ img_mgmt_state_read(struct mgmt_ctxt *ctxt)
 
         state_flags = img_mgmt_state_flags(i);
 
-        err |= cbor_encoder_create_map(&images, &image,
-                                         CborIndefiniteLength);
+        err |= cbor_encoder_create_map(&images.encoder, &image,
+                                       IMG_MGMT_STATE_IMAGE_FIELDS);
+#if IMG_MGMT_IMAGE_COUNT > 1
+        err |= cbor_encode_text_stringz(&image, "image");
+        err |= cbor_encode_int(&image, IMG_MGMT_SLOT_IMAGE(i));
+#endif
         err |= cbor_encode_text_stringz(&image, "slot");
         err |= cbor_encode_int(&image, i);
 
@@ -267,10 +337,14 @@ img_mgmt_state_read(struct mgmt_ctxt *ctxt)
         err |= cbor_encode_boolean(&image,
                                      state_flags & IMG_MGMT_STATE_F_PERMANENT);
 
-        err |= cbor_encoder_close_container(&images, &image);
+        err |= cbor_encoder_close_container(&images.encoder, &image);
+        count++;
     }
 
-    err |= cbor_encoder_close_container(&ctxt->encoder, &images);
+    rc = mgmt_close_counted(ctxt, &ctxt->encoder, &images, count);
+    if (rc != 0) {
+        return rc;
+    }
 
     err |= cbor_encode_text_stringz(&ctxt->encoder, "splitStatus");
     err |= cbor_encode_int(&ctxt->encoder, 0);
@@ -282,8 +356,96 @@ img_mgmt_state_read(struct mgmt_ctxt *ctxt)
     return 0;
 }
 
+/**
+ * Determines which slot an image state operation applies to: the slot holding
+ * the image with the given hash, or the running image if a confirm has no
+ * hash.
+ *
+ * @return                      The slot number on success; MGMT_ERR_EINVAL if
+ *                                  no image matches.
+ */
+static int
+img_mgmt_state_op_slot(const uint8_t *hash, size_t hash_len, bool confirm)
+{
+    int slot;
+
+    if (hash_len == 0) {
+        if (confirm) {
+            return IMG_MGMT_BOOT_CURR_SLOT;
+        }
+        /* A 'test' without a hash is invalid. */
+        return -MGMT_ERR_EINVAL;
+    }
+
+    slot = img_mgmt_find_by_hash((uint8_t *)hash, NULL);
+    if (slot < 0) {
+        return -MGMT_ERR_EINVAL;
+    }
+
+    return slot;
+}
+
+/**
+ * Applies an image state operation to its resolved slot: confirming the
+ * running image, or marking another image pending for the next reboot.
+ */
+static int
+img_mgmt_state_op_apply(int slot, bool confirm)
+{
+    if (slot == IMG_MGMT_BOOT_CURR_SLOT && confirm) {
+        /* Confirm current setup. */
+        return img_mgmt_state_confirm();
+    }
+
+    return img_mgmt_state_set_pending(slot, confirm);
+}
+
+/**
+ * Resolves the slots of a list of image state operations.  No operation is
+ * applied unless all of them name an image; the image headers that slots are
+ * matched against are read once and cached for the remaining lookups.
+ */
+static int
+img_mgmt_state_ops_resolve(struct img_mgmt_state_op *ops, int count)
+{
+    uint8_t hash[IMAGE_HASH_LEN];
+    const uint8_t *hashp;
+    int rc;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        hashp = ops[i].hash.data;
+        if (ops[i].hash.len != 0) {
+            if (ops[i].hash.len != IMAGE_HASH_LEN) {
+                return MGMT_ERR_EINVAL;
+            }
+            if (hashp == NULL) {
+                rc = cbor_bytestring_ref_copy(&ops[i].hash, 0, hash,
+                                              sizeof hash);
+                if (rc != 0) {
+                    return MGMT_ERR_EINVAL;
+                }
+                hashp = hash;
+            }
+        }
+
+        ops[i].slot = img_mgmt_state_op_slot(hashp, ops[i].hash.len,
+                                             ops[i].confirm);
+        if (ops[i].slot < 0) {
+            return -ops[i].slot;
+        }
+    }
+
+    return 0;
+}
+
 /**
  * Command handler: image state write
+ *
+ * Besides a single `hash`/`confirm` pair, the request can carry a list of
+ * such operations under `ops`, which are applied in order, and a `reset`
+ * flag that schedules a system reset once they are written.  The response
+ * holds the state that results from all of them.
  */
 int
 img_mgmt_state_write(struct mgmt_ctxt *ctxt)
@@ -293,10 +455,30 @@ img_mgmt_state_write(struct mgmt_ctxt *ctxt)
      * a null character at the end of the buffer.
      */
     uint8_t hash[IMAGE_HASH_LEN + 1];
+    struct img_mgmt_state_op ops[IMG_MGMT_STATE_OPS_MAX];
     size_t hash_len;
     bool confirm;
+    bool reset;
+    int num_ops;
     int slot;
     int rc;
+    int i;
+
+    const struct cbor_attr_t op_attr[] = {
+        [0] = {
+            .attribute = "hash",
+            .type = CborAttrByteStringRefType,
+            CBORATTR_STRUCT_OBJECT(struct img_mgmt_state_op, hash),
+            .len = IMAGE_HASH_LEN,
+        },
+        [1] = {
+            .attribute = "confirm",
+            .type = CborAttrBooleanType,
+            CBORATTR_STRUCT_OBJECT(struct img_mgmt_state_op, confirm),
+            .dflt.boolean = false,
+        },
+        [2] = { 0 },
+    };
 
     const struct cbor_attr_t write_attr[] = {
         [0] = {
@@ -312,38 +494,72 @@ img_mgmt_state_write(struct mgmt_ctxt *ctxt)
             .addr.boolean = &confirm,
             .dflt.boolean = false,
         },
-        [2] = { 0 },
+        [2] = {
+            .attribute = "ops",
+            .type = CborAttrArrayType,
+            CBORATTR_STRUCT_ARRAY(ops, op_attr, &num_ops),
+            .nodefault = true,
+        },
+        [3] = {
+            .attribute = "reset",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &reset,
+            .dflt.boolean = false,
+        },
+        [4] = { 0 },
     };
 
     hash_len = 0;
+    num_ops = 0;
     rc = cbor_read_object(&ctxt->it, write_attr);
     if (rc != 0) {
         return MGMT_ERR_EINVAL;
     }
 
-    /* Determine which slot is being operated on. */
-    if (hash_len == 0) {
-        if (confirm) {
-            slot = IMG_MGMT_BOOT_CURR_SLOT;
-        } else {
-            /* A 'test' without a hash is invalid. */
+    if (reset && img_mgmt_reset_cb == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    if (num_ops == 0) {
+        /* A single operation, specified at the top level. */
+        if (hash_len == 0 && !confirm && !reset) {
             return MGMT_ERR_EINVAL;
         }
+        if (hash_len != 0 || confirm) {
+            slot = img_mgmt_state_op_slot(hash, hash_len, confirm);
+            if (slot < 0) {
+                return -slot;
+            }
+
+            rc = img_mgmt_state_op_apply(slot, confirm);
+            if (rc != 0) {
+                return rc;
+            }
+        }
     } else {
-        slot = img_mgmt_find_by_hash(hash, NULL);
-        if (slot < 0) {
+        /* Top-level and listed operations cannot be mixed. */
+        if (hash_len != 0 || confirm) {
             return MGMT_ERR_EINVAL;
         }
-    }
 
-    if (slot == IMG_MGMT_BOOT_CURR_SLOT && confirm) {
-        /* Confirm current setup. */
-        rc = img_mgmt_state_confirm();
-    } else {
-        rc = img_mgmt_state_set_pending(slot, confirm);
+        rc = img_mgmt_state_ops_resolve(ops, num_ops);
+        if (rc != 0) {
+            return rc;
+        }
+
+        for (i = 0; i < num_ops; i++) {
+            rc = img_mgmt_state_op_apply(ops[i].slot, ops[i].confirm);
+            if (rc != 0) {
+                return rc;
+            }
+        }
     }
-    if (rc != 0) {
-        return rc;
+
+    if (reset) {
+        rc = img_mgmt_reset_cb(img_mgmt_reset_arg);
+        if (rc != 0) {
+            return rc;
+        }
     }
 
     /* Send the current image state in the response. */
@@ -354,3 +570,10 @@ img_mgmt_state_write(struct mgmt_ctxt *ctxt)
 
     return 0;
 }
+
+void
+img_mgmt_set_reset_cb(img_mgmt_reset_fn *cb, void *arg)
+{
+    img_mgmt_reset_cb = cb;
+    img_mgmt_reset_arg = arg;
+}
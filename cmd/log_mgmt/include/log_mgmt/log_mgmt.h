@@ -24,6 +24,9 @@
 extern "C" {
 #endif
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "log_mgmt_config.h"
 
 /**
@@ -51,6 +54,8 @@ extern "C" {
 #define LOG_MGMT_ID_MODULE_LIST 3
 #define LOG_MGMT_ID_LEVEL_LIST  4
 #define LOG_MGMT_ID_LOGS_LIST   5
+#define LOG_MGMT_ID_TAIL        6
+#define LOG_MGMT_ID_EXPORT      7
 
 /** @brief Log output is streamed without retention (e.g., console). */
 #define LOG_MGMT_TYPE_STREAM     0
@@ -69,6 +74,32 @@ extern "C" {
 #define LOG_MGMT_ETYPE_CBOR           1
 #define LOG_MGMT_ETYPE_BINARY         2
 
+/* @brief Size of a module mask: one bit per module. */
+#define LOG_MGMT_MODULE_MASK_LEN      32
+
+/* @brief Longest byte pattern an entry body can be matched against. */
+#define LOG_MGMT_MATCH_MAX            32
+
+/**
+ * @brief Version of the record format of log export responses.
+ *
+ * Each record consists of the following fields, in little-endian byte order:
+ *     index    4 bytes
+ *     ts       8 bytes (signed)
+ *     module   1 byte
+ *     level    1 byte
+ *     type     1 byte  (LOG_MGMT_ETYPE_[...])
+ *     flags    1 byte  (LOG_MGMT_FLAGS_[...], LOG_MGMT_EXPORT_F_TRUNC)
+ *     len      2 bytes (length of the body that follows)
+ *     imghash  LOG_MGMT_IMG_HASHLEN bytes; only if LOG_MGMT_FLAGS_IMG_HASH
+ *     body     len bytes
+ */
+#define LOG_MGMT_EXPORT_VERSION       1
+#define LOG_MGMT_EXPORT_HDR_LEN       18
+
+/* @brief Record flag: the entry's body was cut short to fit a response. */
+#define LOG_MGMT_EXPORT_F_TRUNC       (1 << 7)
+
 
 /** @brief Generic descriptor for an OS-specific log. */
 struct log_mgmt_log {
@@ -79,6 +110,24 @@ struct log_mgmt_log {
 #endif
 };
 
+/**
+ * @brief Position of an entry within a log.  Handed to clients as an opaque
+ *        token so that a later walk can resume directly after the entry
+ *        instead of rescanning the log from the start.
+ */
+struct log_mgmt_cursor {
+    /* Index of the entry at this position; used to validate the cursor. */
+    uint32_t index;
+    /* Implementation-defined physical location of the entry; all zeros if
+     * the implementation cannot seek.
+     */
+    uint32_t loc[3];
+    /* If nonzero, the entry was cut short: the offset in its body at which
+     * the walk resumes.  Absent from tokens issued by older versions.
+     */
+    uint32_t offset;
+};
+
 /** @brief Generic descriptor for an OS-specific log entry. */
 struct log_mgmt_entry {
     int64_t ts;
@@ -93,6 +142,8 @@ struct log_mgmt_entry {
     size_t offset;
     size_t chunklen;
     void *ctxt;
+    /* Position of this entry, for resuming a later walk after it. */
+    struct log_mgmt_cursor cursor;
 };
 
 /** @brief Indicates which log entries to operate on. */
@@ -105,6 +156,30 @@ struct log_mgmt_filter {
 
     /* Only access entries whose index >= min_index. */
     uint32_t min_index;
+
+    /* If non-NULL, the walk may start directly after the entry at this
+     * position or, if the cursor's offset is nonzero, at that offset in the
+     * entry's body; chunks before it need not be delivered.  Implementations
+     * ignore cursors they cannot validate, so min_index must still exclude
+     * the entries before it.
+     */
+    const struct log_mgmt_cursor *cursor;
+
+    /* Only access entries whose level >= min_level. */
+    uint8_t min_level;
+
+    /* If modules_len != 0: Only access entries whose module has its bit set
+     * in this mask; module n is bit (n % 8) of byte n / 8.  Modules beyond
+     * the end of the mask are excluded.
+     */
+    const uint8_t *modules;
+    size_t modules_len;
+
+    /* If match_len != 0: Only access entries whose body contains these
+     * bytes.
+     */
+    const uint8_t *match;
+    size_t match_len;
 };
 
 /**
@@ -112,6 +187,47 @@ struct log_mgmt_filter {
  */
 void log_mgmt_register_group(void);
 
+/**
+ * @brief Sends the response to the outstanding log tail request, if any.
+ *
+ * Called by the implementation, from the thread that processes management
+ * requests, some time after entries have been appended to the log being
+ * watched (see log_mgmt_impl_tail_watch()).  The delay lets several entries
+ * go out in one response.
+ */
+void log_mgmt_tail_push(void);
+
+/**
+ * @brief Clears the next log of the asynchronous clear in progress.
+ *
+ * Called by the implementation, from the thread that processes management
+ * requests, after log_mgmt_impl_clear_defer().  Defers itself again while
+ * logs remain to be cleared.
+ */
+void log_mgmt_clear_step(void);
+
+/**
+ * @brief Writes the read watermark held back by coalescing, if any.
+ *
+ * Called by the implementation, from the thread that processes management
+ * requests, LOG_MGMT_WATERMARK_DELAY_MS after log_mgmt_impl_watermark_defer().
+ */
+void log_mgmt_watermark_flush(void);
+
+/**
+ * @brief Indicates whether an entry with the specified module and level
+ *        passes a filter.  Implementations check this before reading the
+ *        entry's body; the body pattern is not considered.
+ *
+ * @param filter                The filter to apply.
+ * @param module                The module of the entry.
+ * @param level                 The level of the entry.
+ *
+ * @return                      true if the entry passes the filter.
+ */
+bool log_mgmt_filter_accepts(const struct log_mgmt_filter *filter,
+                             uint8_t module, uint8_t level);
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,8 @@
 #define LOG_MGMT_READ_WATERMARK_UPDATE MYNEWT_VAL(LOG_READ_WATERMARK_UPDATE)
 #define LOG_MGMT_GLOBAL_IDX MYNEWT_VAL(LOG_GLOBAL_IDX)
 #define LOG_MGMT_IMG_HASHLEN 4
+#define LOG_MGMT_CLEAR_ASYNC MYNEWT_VAL(LOG_MGMT_CLEAR_ASYNC)
+#define LOG_MGMT_WATERMARK_DELAY_MS MYNEWT_VAL(LOG_MGMT_WATERMARK_DELAY_MS)
 
 #elif defined __ZEPHYR__
 
@@ -39,6 +41,20 @@
 #define LOG_MGMT_READ_WATERMARK_UPDATE CONFIG_LOG_READ_WATERMARK_UPDATE
 #define LOG_MGMT_GLOBAL_IDX CONFIG_LOG_GLOBAL_IDX
 
+/* Clears logs in the background when a clear request asks for it. */
+#ifdef CONFIG_LOG_MGMT_CLEAR_ASYNC
+#define LOG_MGMT_CLEAR_ASYNC 1
+#else
+#define LOG_MGMT_CLEAR_ASYNC 0
+#endif
+
+/* Read watermarks are persisted at most this often; 0 for every read. */
+#ifdef CONFIG_LOG_MGMT_WATERMARK_DELAY_MS
+#define LOG_MGMT_WATERMARK_DELAY_MS CONFIG_LOG_MGMT_WATERMARK_DELAY_MS
+#else
+#define LOG_MGMT_WATERMARK_DELAY_MS 0
+#endif
+
 #else
 
 /* No direct support for this OS.  The application needs to define the above
@@ -124,6 +124,34 @@ int log_mgmt_impl_clear(const char *log_name);
 int
 log_mgmt_impl_set_watermark(const struct log_mgmt_log *log, int index);
 
+/**
+ * @brief Arranges for log_mgmt_clear_step() to be called soon.  Clearing a
+ * log a step at a time keeps the thread that processes management requests
+ * responsive.
+ */
+void log_mgmt_impl_clear_defer(void);
+
+/**
+ * @brief Arranges for log_mgmt_watermark_flush() to be called
+ * LOG_MGMT_WATERMARK_DELAY_MS from now, unless a call is already pending.
+ * A pending call is not pushed back, so that a steady stream of reads still
+ * gets its watermark written once per interval.
+ */
+void log_mgmt_impl_watermark_defer(void);
+
+/**
+ * @brief Starts watching the specified log for new entries, in place of the
+ * log watched so far.  Whenever entries get appended to the watched log, the
+ * implementation must arrange for log_mgmt_tail_push() to be called shortly
+ * after.
+ *
+ * @param log_name              The name of the log to watch; NULL to stop
+ *                                  watching.
+ *
+ * @return                      0 on success; MGMT_ERR_[...] code on failure.
+ */
+int log_mgmt_impl_tail_watch(const char *log_name);
+
 #ifdef __cplusplus
 }
 #endif
@@ -17,18 +17,44 @@
  * under the License.
  */
 
+#include <string.h>
+
 #include "log/log.h"
+#if MYNEWT_VAL(LOG_FCB)
+#include "fcb/fcb.h"
+#endif
 #include "mgmt/mgmt.h"
 #include "log_mgmt/log_mgmt.h"
 #include "log_mgmt/log_mgmt_impl.h"
 #include "log_mgmt/log_mgmt_config.h"
 
+#if LOG_MGMT_CHUNK_LEN < 2 * LOG_MGMT_MATCH_MAX
+#error "LOG_MGMT_CHUNK_LEN is too small to search entry bodies"
+#endif
+
 struct mynewt_log_mgmt_walk_arg {
     log_mgmt_foreach_entry_fn *cb;
+    const struct log_mgmt_filter *filter;
     uint8_t chunk[LOG_MGMT_CHUNK_LEN];
     void *arg;
 };
 
+/* The log being tailed; NULL if none. */
+static struct log *mynewt_log_mgmt_tail_log;
+static struct os_callout mynewt_log_mgmt_tail_callout;
+
+#if LOG_MGMT_CLEAR_ASYNC
+static void mynewt_log_mgmt_clear_ev_cb(struct os_event *ev);
+
+static struct os_event mynewt_log_mgmt_clear_ev = {
+    .ev_cb = mynewt_log_mgmt_clear_ev_cb,
+};
+#endif
+
+#if LOG_MGMT_READ_WATERMARK_UPDATE && LOG_MGMT_WATERMARK_DELAY_MS > 0
+static struct os_callout mynewt_log_mgmt_watermark_callout;
+#endif
+
 static struct log *
 mynewt_log_mgmt_find_log(const char *log_name)
 {
@@ -47,6 +73,74 @@ mynewt_log_mgmt_find_log(const char *log_name)
     }
 }
 
+/**
+ * Records the physical location of an entry so that a later walk can resume
+ * after it.  Only FCB-backed logs can be seeked; for other logs the location
+ * is left zeroed and the entry index alone is used.
+ */
+static void
+mynewt_log_mgmt_fill_cursor(const struct log *log, const void *dptr,
+                            uint32_t index, struct log_mgmt_cursor *cursor)
+{
+#if MYNEWT_VAL(LOG_FCB)
+    const struct fcb_entry *loc;
+    const struct fcb_log *fcb_log;
+#endif
+
+    memset(cursor, 0, sizeof *cursor);
+    cursor->index = index;
+
+#if MYNEWT_VAL(LOG_FCB)
+    if (log->l_log == &log_fcb_handler) {
+        fcb_log = log->l_arg;
+        loc = dptr;
+
+        /* Sector numbers are stored off by one so that zero means "none". */
+        cursor->loc[0] = loc->fe_area - fcb_log->fl_fcb.f_sectors + 1;
+        cursor->loc[1] = loc->fe_elem_off;
+        cursor->loc[2] = ((loc->fe_data_off - loc->fe_elem_off) << 16) |
+                         loc->fe_data_len;
+    }
+#endif
+}
+
+#if MYNEWT_VAL(LOG_FCB)
+/**
+ * Converts a cursor back into an FCB location.  Fails if the log has been
+ * rotated or cleared since the cursor was issued, i.e., if the entry at that
+ * location is no longer the one the cursor refers to.
+ */
+static int
+mynewt_log_mgmt_seek(struct log *log, const struct log_mgmt_cursor *cursor,
+                     struct fcb_entry *loc)
+{
+    struct log_entry_hdr hdr;
+    struct fcb_log *fcb_log;
+    int rc;
+
+    if (log->l_log != &log_fcb_handler) {
+        return SYS_ENOTSUP;
+    }
+    fcb_log = log->l_arg;
+
+    if (cursor->loc[0] == 0 || cursor->loc[0] > fcb_log->fl_fcb.f_sector_cnt) {
+        return SYS_EINVAL;
+    }
+
+    loc->fe_area = &fcb_log->fl_fcb.f_sectors[cursor->loc[0] - 1];
+    loc->fe_elem_off = cursor->loc[1];
+    loc->fe_data_off = loc->fe_elem_off + (cursor->loc[2] >> 16);
+    loc->fe_data_len = cursor->loc[2] & 0xffff;
+
+    rc = log_read_hdr(log, loc, &hdr);
+    if (rc != 0 || hdr.ue_index != cursor->index) {
+        return SYS_ENOENT;
+    }
+
+    return 0;
+}
+#endif
+
 __attribute__((__unused__)) static int
 log_mgmt_mynewt_err_map(int mynewt_os_err)
 {
@@ -154,15 +248,66 @@ log_mgmt_impl_get_next_idx(uint32_t *out_idx)
 }
 #endif
 
+/**
+ * Searches an entry's body for a byte pattern, reading it in pieces through
+ * the specified buffer of LOG_MGMT_CHUNK_LEN bytes.  The end of each piece is
+ * carried over to the next so that matches spanning two pieces are found.
+ *
+ * @return                      1 if the body contains the pattern; 0 if not;
+ *                              negative on read failure.
+ */
+static int
+mynewt_log_mgmt_body_contains(struct log *log, const void *dptr,
+                              uint16_t len, const uint8_t *pat,
+                              size_t pat_len, uint8_t *buf)
+{
+    size_t avail;
+    size_t keep;
+    size_t i;
+    int read_len;
+    int offset;
+    int rc;
+
+    keep = 0;
+    for (offset = 0; offset < len; offset += read_len) {
+        read_len = LOG_MGMT_CHUNK_LEN - keep;
+        if (len - offset < read_len) {
+            read_len = len - offset;
+        }
+
+        rc = log_read_body(log, dptr, buf + keep, offset, read_len);
+        if (rc < 0) {
+            return rc;
+        }
+        avail = keep + read_len;
+
+        for (i = 0; i + pat_len <= avail; i++) {
+            if (memcmp(buf + i, pat, pat_len) == 0) {
+                return 1;
+            }
+        }
+
+        keep = pat_len - 1;
+        if (keep > avail) {
+            keep = avail;
+        }
+        memmove(buf, buf + avail - keep, keep);
+    }
+
+    return 0;
+}
+
 static int
 mynewt_log_mgmt_walk_cb(struct log *log, struct log_offset *log_offset,
                         const struct log_entry_hdr *leh,
                         const void *dptr, uint16_t len)
 {
     struct mynewt_log_mgmt_walk_arg *mynewt_log_mgmt_walk_arg;
+    const struct log_mgmt_cursor *cursor;
     struct log_mgmt_entry entry;
     int read_len;
     int offset;
+    int start;
     int rc;
 
     rc = 0;
@@ -187,6 +332,36 @@ mynewt_log_mgmt_walk_cb(struct log *log, struct log_offset *log_offset,
         return 0;
     }
 
+    /* Skip filtered entries before reading any of their body. */
+    if (!log_mgmt_filter_accepts(mynewt_log_mgmt_walk_arg->filter,
+                                 leh->ue_module, leh->ue_level)) {
+        return 0;
+    }
+
+    /* Continue an entry that was cut short without rereading the part of
+     * its body that has been delivered; it has been matched already.
+     */
+    start = 0;
+    cursor = mynewt_log_mgmt_walk_arg->filter->cursor;
+    if (cursor != NULL && cursor->offset != 0 &&
+        cursor->index == leh->ue_index) {
+
+        start = cursor->offset;
+    }
+
+    if (start == 0 && mynewt_log_mgmt_walk_arg->filter->match_len != 0) {
+        rc = mynewt_log_mgmt_body_contains(
+            log, dptr, len, mynewt_log_mgmt_walk_arg->filter->match,
+            mynewt_log_mgmt_walk_arg->filter->match_len,
+            mynewt_log_mgmt_walk_arg->chunk);
+        if (rc < 0) {
+            return LOG_MGMT_ERR_EUNKNOWN;
+        }
+        if (rc == 0) {
+            return 0;
+        }
+    }
+
     entry.ts = leh->ue_ts;
     entry.index = leh->ue_index;
     entry.module = leh->ue_module;
@@ -198,8 +373,9 @@ mynewt_log_mgmt_walk_cb(struct log *log, struct log_offset *log_offset,
         leh->ue_imghash : NULL;
     entry.len = len;
     entry.data = mynewt_log_mgmt_walk_arg->chunk;
+    mynewt_log_mgmt_fill_cursor(log, dptr, leh->ue_index, &entry.cursor);
 
-    for (offset = 0; offset < len; offset += LOG_MGMT_CHUNK_LEN) {
+    for (offset = start; offset < len; offset += LOG_MGMT_CHUNK_LEN) {
         if (len - offset < LOG_MGMT_CHUNK_LEN) {
             read_len = len - offset;
         } else {
@@ -230,9 +406,15 @@ log_mgmt_impl_foreach_entry(const char *log_name,
     struct mynewt_log_mgmt_walk_arg walk_arg;
     struct log_offset offset;
     struct log *log;
+#if MYNEWT_VAL(LOG_FCB)
+    struct log_entry_hdr hdr;
+    struct fcb_entry loc;
+    int rc;
+#endif
 
     walk_arg = (struct mynewt_log_mgmt_walk_arg) {
         .cb = cb,
+        .filter = filter,
         .arg = arg,
     };
 
@@ -247,6 +429,40 @@ log_mgmt_impl_foreach_entry(const char *log_name,
         offset.lo_index = filter->min_index;
         offset.lo_data_len = 0;
 
+#if MYNEWT_VAL(LOG_FCB)
+        /* Resume directly after the cursor if it is still valid, so that
+         * only new entries get read from flash.  An entry that was cut short
+         * is continued first.
+         */
+        if (filter->cursor != NULL &&
+            mynewt_log_mgmt_seek(log, filter->cursor, &loc) == 0) {
+
+            rc = 0;
+            if (filter->cursor->offset == 0) {
+                rc = fcb_getnext(&((struct fcb_log *)log->l_arg)->fl_fcb,
+                                 &loc);
+            }
+            while (rc == 0) {
+                rc = log_read_hdr(log, &loc, &hdr);
+                if (rc != 0) {
+                    return LOG_MGMT_ERR_EUNKNOWN;
+                }
+
+                rc = mynewt_log_mgmt_walk_cb(log, &offset, &hdr, &loc,
+                                             loc.fe_data_len -
+                                             log_hdr_len(&hdr));
+                if (rc != 0) {
+                    return rc;
+                }
+
+                rc = fcb_getnext(&((struct fcb_log *)log->l_arg)->fl_fcb,
+                                 &loc);
+            }
+
+            return 0;
+        }
+#endif
+
         return log_walk_body(log, mynewt_log_mgmt_walk_cb, &offset);
     }
 
@@ -272,11 +488,95 @@ log_mgmt_impl_clear(const char *log_name)
     return 0;
 }
 
+static void
+mynewt_log_mgmt_tail_timer_cb(struct os_event *ev)
+{
+    log_mgmt_tail_push();
+}
+
+static void
+mynewt_log_mgmt_append_cb(struct log *log, uint32_t idx)
+{
+    /* Entries appended until the timer expires share one response. */
+    if (log == mynewt_log_mgmt_tail_log &&
+        !os_callout_queued(&mynewt_log_mgmt_tail_callout)) {
+
+        os_callout_reset(&mynewt_log_mgmt_tail_callout,
+                         os_time_ms_to_ticks32(
+                             MYNEWT_VAL(LOG_MGMT_TAIL_DELAY_MS)));
+    }
+}
+
+int
+log_mgmt_impl_tail_watch(const char *log_name)
+{
+    struct log *log;
+
+    if (mynewt_log_mgmt_tail_log != NULL) {
+        log_set_append_cb(mynewt_log_mgmt_tail_log, NULL);
+        mynewt_log_mgmt_tail_log = NULL;
+        os_callout_stop(&mynewt_log_mgmt_tail_callout);
+    }
+
+    if (log_name == NULL) {
+        return 0;
+    }
+
+    log = mynewt_log_mgmt_find_log(log_name);
+    if (log == NULL) {
+        return LOG_MGMT_ERR_ENOENT;
+    }
+
+    log_set_append_cb(log, mynewt_log_mgmt_append_cb);
+    mynewt_log_mgmt_tail_log = log;
+
+    return 0;
+}
+
+#if LOG_MGMT_CLEAR_ASYNC
+static void
+mynewt_log_mgmt_clear_ev_cb(struct os_event *ev)
+{
+    log_mgmt_clear_step();
+}
+
+void
+log_mgmt_impl_clear_defer(void)
+{
+    /* One log per event keeps the default event queue responsive. */
+    os_eventq_put(os_eventq_dflt_get(), &mynewt_log_mgmt_clear_ev);
+}
+#endif
+
+#if LOG_MGMT_READ_WATERMARK_UPDATE && LOG_MGMT_WATERMARK_DELAY_MS > 0
+static void
+mynewt_log_mgmt_watermark_timer_cb(struct os_event *ev)
+{
+    log_mgmt_watermark_flush();
+}
+
+void
+log_mgmt_impl_watermark_defer(void)
+{
+    if (!os_callout_queued(&mynewt_log_mgmt_watermark_callout)) {
+        os_callout_reset(&mynewt_log_mgmt_watermark_callout,
+                         os_time_ms_to_ticks32(LOG_MGMT_WATERMARK_DELAY_MS));
+    }
+}
+#endif
+
 void
 log_mgmt_module_init(void)
 {
     /* Ensure this function only gets called by sysinit. */
     SYSINIT_ASSERT_ACTIVE();
 
+    os_callout_init(&mynewt_log_mgmt_tail_callout, os_eventq_dflt_get(),
+                    mynewt_log_mgmt_tail_timer_cb, NULL);
+#if LOG_MGMT_READ_WATERMARK_UPDATE && LOG_MGMT_WATERMARK_DELAY_MS > 0
+    os_callout_init(&mynewt_log_mgmt_watermark_callout, os_eventq_dflt_get(),
+                    mynewt_log_mgmt_watermark_timer_cb, NULL);
+#endif
+
     log_mgmt_register_group();
 }
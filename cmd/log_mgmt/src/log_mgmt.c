@@ -18,7 +18,6 @@
  */
 
 #include <string.h>
-#include <stdio.h>
 
 #include "mgmt/mgmt.h"
 #include "cborattr/cborattr.h"
@@ -28,28 +27,95 @@
 #include "log_mgmt/log_mgmt_config.h"
 #include "log/log.h"
 
-/* Log mgmt encoder context used for multiple calls of the
- * entry encode function since the function gets called twice,
- * once for counter encoder and the second time for the actual
- * encoding
+/* Log mgmt encoder context holding the open containers of the entry being
+ * encoded, since an entry's body is encoded over several calls, one per
+ * chunk.
  */
 struct log_mgmt_enc_ctxt {
     CborEncoder mapenc;
     CborEncoder msgenc;
 };
 
+/**
+ * State of a log show response that may be split across several packets.
+ * The response encoders live here so that a full response can be closed,
+ * transmitted and reopened from within a log walk.
+ */
+struct log_show_ctxt {
+    struct mgmt_ctxt *mc;
+    /* The "logs" array in the root map. */
+    CborEncoder logs;
+    /* The map of the log currently being encoded. */
+    CborEncoder log_map;
+    /* Value of the "next_index" field in each response. */
+    uint32_t next_idx;
+    /* Whether the client accepts multiple responses. */
+    bool stream;
+    /* Nonzero if a flush failed; the response must not be written to. */
+    int flush_rc;
+    /* Client-supplied position to resume the walk from; NULL if none. */
+    const struct log_mgmt_cursor *cursor;
+    /* A response carries at least one entry, but further entries must end
+     * within this many bytes; at most LOG_MGMT_MAX_RSP_LEN.
+     */
+    size_t max_len;
+    /* Level, module and body criteria of the entries to encode; the other
+     * fields are unused.
+     */
+    struct log_mgmt_filter sel;
+};
+
+/** The outstanding log tail request, whose response is held back. */
+struct log_mgmt_tail {
+    struct mgmt_async async;
+    /* Whether a response is held back. */
+    bool active;
+    char name[LOG_MGMT_NAME_LEN];
+    uint32_t index;
+    struct log_mgmt_cursor cursor;
+    bool has_cursor;
+    uint8_t min_level;
+    uint8_t modules[LOG_MGMT_MODULE_MASK_LEN];
+    size_t modules_len;
+    uint8_t match[LOG_MGMT_MATCH_MAX];
+    size_t match_len;
+};
+
+/* Worst-case size of a log tail response around its entries: "next_index",
+ * the "logs" array, the log's "name" and "type", "cursor", and "rc".
+ */
+#define LOG_MGMT_TAIL_RSP_OVERHEAD  (64 + LOG_MGMT_NAME_LEN)
+
+/* Encoded size of an empty "entries" array and its key: a one-byte text
+ * header, seven characters, and the array's start and break codes.
+ */
+#define LOG_MGMT_ENTRIES_HDR_LEN    (1 + 7 + 2)
+
 /** Context used during walks. */
 struct log_walk_ctxt {
     /* last encoded index */
     uint32_t last_enc_index;
-    /* The number of bytes encoded to the response so far. */
-    size_t rsp_len;
     /* The encoder to use to write the current log entry. */
     struct CborEncoder *enc;
     /* Counter per encoder to understand if we are encoding the first chunk */
     uint32_t counter;
     /* Log management encode context containing map and msg encoder */
     struct log_mgmt_enc_ctxt lmec;
+    /* The show response being written to. */
+    struct log_show_ctxt *show;
+    /* The log being walked. */
+    const struct log_mgmt_log *log;
+    /* Position of the last encoded entry. */
+    struct log_mgmt_cursor last_cursor;
+    /* Index of the entry being split across responses, and the offset in its
+     * body at which its next part starts; part_off is 0 if there is none.
+     */
+    uint32_t part_index;
+    size_t part_off;
+    /* Whether the entry being encoded is split into parts. */
+    bool part;
+    /* Body bytes encoded in the current part. */
+    size_t part_len;
 };
 
 static mgmt_handler_fn log_mgmt_show;
@@ -57,307 +123,1469 @@ static mgmt_handler_fn log_mgmt_clear;
 static mgmt_handler_fn log_mgmt_module_list;
 static mgmt_handler_fn log_mgmt_level_list;
 static mgmt_handler_fn log_mgmt_logs_list;
+static mgmt_handler_fn log_mgmt_tail;
+static mgmt_handler_fn log_mgmt_export;
+#if LOG_MGMT_CLEAR_ASYNC
+static mgmt_handler_fn log_mgmt_clear_state;
+#endif
+
+static struct log_mgmt_tail log_mgmt_tail_req;
+
+#if LOG_MGMT_CLEAR_ASYNC
+/** The last asynchronous clear; one log is cleared per step. */
+static struct {
+    /* Identifies the job; 0 if none was started. */
+    uint32_t job;
+    /* The log to clear; empty to clear every log. */
+    char name[LOG_MGMT_NAME_LEN];
+    /* Index of the next log to look at. */
+    int idx;
+    /* Number of logs cleared so far, and in all. */
+    uint32_t done;
+    uint32_t total;
+    /* LOG_MGMT_ERR_[...] code of the failed clear; 0 if none failed. */
+    int rc;
+    bool busy;
+} log_mgmt_clear_job;
+#endif
+
+#if LOG_MGMT_READ_WATERMARK_UPDATE && LOG_MGMT_WATERMARK_DELAY_MS > 0
+/**
+ * Read watermark not yet written to flash.  Only one log's watermark is
+ * held back at a time; that of the log being polled.
+ */
+static struct {
+    struct log_mgmt_log log;
+    int index;
+    bool pending;
+} log_mgmt_watermark;
+#endif
 
-static struct mgmt_handler log_mgmt_handlers[] = {
+static const struct mgmt_handler log_mgmt_handlers[] = {
     [LOG_MGMT_ID_SHOW] =        { log_mgmt_show, NULL },
+#if LOG_MGMT_CLEAR_ASYNC
+    [LOG_MGMT_ID_CLEAR] =       { log_mgmt_clear_state, log_mgmt_clear },
+#else
     [LOG_MGMT_ID_CLEAR] =       { NULL, log_mgmt_clear },
-    [LOG_MGMT_ID_MODULE_LIST] = { log_mgmt_module_list, NULL },
-    [LOG_MGMT_ID_LEVEL_LIST] =  { log_mgmt_level_list, NULL },
+#endif
+    [LOG_MGMT_ID_MODULE_LIST] = { log_mgmt_module_list, NULL, 0,
+                                  &mgmt_const_epoch },
+    [LOG_MGMT_ID_LEVEL_LIST] =  { log_mgmt_level_list, NULL, 0,
+                                  &mgmt_const_epoch },
     [LOG_MGMT_ID_LOGS_LIST] =   { log_mgmt_logs_list, NULL },
+    [LOG_MGMT_ID_TAIL] =        { log_mgmt_tail, NULL },
+    [LOG_MGMT_ID_EXPORT] =      { log_mgmt_export, NULL },
 };
 
 #define LOG_MGMT_HANDLER_CNT \
     sizeof log_mgmt_handlers / sizeof log_mgmt_handlers[0]
 
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE(log_mgmt_group, log_mgmt_handlers, MGMT_GROUP_ID_LOG);
+#else
 static struct mgmt_group log_mgmt_group = {
     .mg_handlers = log_mgmt_handlers,
     .mg_handlers_count = LOG_MGMT_HANDLER_CNT,
     .mg_group_id = MGMT_GROUP_ID_LOG,
 };
+#endif
+
+/**
+ * Opens the fields shared by every log show response: "next_index" and the
+ * "logs" array.
+ */
+static int
+log_mgmt_show_open(struct log_show_ctxt *show)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&show->mc->encoder, "next_index");
+    err |= cbor_encode_uint(&show->mc->encoder, show->next_idx);
+    err |= cbor_encode_text_stringz(&show->mc->encoder, "logs");
+    err |= cbor_encoder_create_array(&show->mc->encoder, &show->logs,
+                                     CborIndefiniteLength);
+
+    return err;
+}
+
+/** Opens the map describing a single log within the "logs" array. */
+static int
+log_mgmt_show_open_log(struct log_show_ctxt *show,
+                       const struct log_mgmt_log *log)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encoder_create_map(&show->logs, &show->log_map,
+                                   CborIndefiniteLength);
+    err |= cbor_encode_text_stringz(&show->log_map, "name");
+    err |= cbor_encode_text_stringz(&show->log_map, log->name);
+    err |= cbor_encode_text_stringz(&show->log_map, "type");
+    err |= cbor_encode_uint(&show->log_map, log->type);
+
+    return err;
+}
+
+/**
+ * Checks the length of a resume token decoded into the specified cursor.
+ * Tokens issued before entries could be split lack an offset, which is then
+ * zero.
+ */
+static bool
+log_mgmt_cursor_valid(struct log_mgmt_cursor *cursor, size_t len)
+{
+    if (len == offsetof(struct log_mgmt_cursor, offset)) {
+        cursor->offset = 0;
+        return true;
+    }
+
+    return len == sizeof *cursor;
+}
+
+/**
+ * Restricts a filter to the entries not yet read according to a cursor: the
+ * entries after it, and the entry itself if it was cut short.
+ */
+static void
+log_mgmt_filter_resume(struct log_mgmt_filter *filter,
+                       const struct log_mgmt_cursor *cursor)
+{
+    filter->cursor = cursor;
+    if (cursor->index >= filter->min_index) {
+        filter->min_index = cursor->index;
+        if (cursor->offset == 0) {
+            filter->min_index++;
+        }
+    }
+}
+
+/**
+ * Encodes the resume token for the last entry written to the response.  The
+ * client hands it back in a later request to skip the entries it has seen.
+ */
+static int
+log_mgmt_encode_cursor(CborEncoder *enc, const struct log_mgmt_cursor *cursor)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(enc, "cursor");
+    err |= cbor_encode_byte_string(enc, (const uint8_t *)cursor,
+                                   sizeof *cursor);
+
+    return err;
+}
+
+/**
+ * Completes the current log show response with a "more" indication,
+ * transmits it, and begins the next one.  The "logs" array must be the only
+ * open container.
+ */
+static int
+log_mgmt_show_flush(struct log_show_ctxt *show)
+{
+    CborError err;
+    int rc;
+
+    err = 0;
+    err |= cbor_encoder_close_container(&show->mc->encoder, &show->logs);
+    err |= cbor_encode_text_stringz(&show->mc->encoder, "rc");
+    err |= cbor_encode_int(&show->mc->encoder, LOG_MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&show->mc->encoder, "more");
+    err |= cbor_encode_boolean(&show->mc->encoder, true);
+    if (err != 0) {
+        rc = LOG_MGMT_ERR_ENOMEM;
+        goto err;
+    }
+
+    rc = mgmt_flush_rsp(show->mc);
+    if (rc != 0) {
+        goto err;
+    }
+
+    if (log_mgmt_show_open(show) != 0) {
+        rc = LOG_MGMT_ERR_ENOMEM;
+        goto err;
+    }
+
+    return 0;
 
+err:
+    show->flush_rc = rc;
+    return rc;
+}
+
+/**
+ * Sends the full response from within a log walk and reopens the current
+ * log's "entries" array in the next response, so that the walk can carry on
+ * where it stopped.
+ */
+static int
+log_mgmt_walk_flush(struct log_walk_ctxt *ctxt)
+{
+    struct log_show_ctxt *show;
+    CborError err;
+    int rc;
+
+    show = ctxt->show;
+
+    err = 0;
+    err |= cbor_encoder_close_container(&show->log_map, ctxt->enc);
+    err |= log_mgmt_encode_cursor(&show->log_map, &ctxt->last_cursor);
+    err |= cbor_encoder_close_container(&show->logs, &show->log_map);
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    rc = log_mgmt_show_flush(show);
+    if (rc != 0) {
+        return rc;
+    }
+
+    err |= log_mgmt_show_open_log(show, ctxt->log);
+    err |= cbor_encode_text_stringz(&show->log_map, "entries");
+    err |= cbor_encoder_create_array(&show->log_map, ctxt->enc,
+                                     CborIndefiniteLength);
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    ctxt->counter = 0;
+
+    return 0;
+}
+
+/**
+ * Encodes everything in an entry that precedes its body: the entry map, its
+ * fixed fields, and the start of the indefinite-length "msg" byte string.
+ * A part of a split entry additionally carries the offset of the part in the
+ * body ("off") and the length of the whole body ("len").
+ */
 static int
-log_mgmt_encode_entry(CborEncoder *enc, const struct log_mgmt_entry *entry,
-                      size_t *out_len, struct log_mgmt_enc_ctxt *lmec)
+log_mgmt_encode_entry_hdr(CborEncoder *enc, const struct log_mgmt_entry *entry,
+                          bool part, struct log_mgmt_enc_ctxt *lmec)
 {
     CborError err = CborNoError;
-    uint16_t chunklen;
-    uint16_t len;
-    int off;
-    uint16_t bytes_encoded;
 
-    len = cbor_encode_bytes_written(enc);
+    err |= cbor_encoder_create_map(enc, &lmec->mapenc, CborIndefiniteLength);
+
+    switch (entry->type) {
+    case LOG_MGMT_ETYPE_CBOR:
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "type");
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "cbor");
+        break;
+    case LOG_MGMT_ETYPE_BINARY:
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "type");
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "bin");
+        break;
+    case LOG_MGMT_ETYPE_STRING:
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "type");
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "str");
+        break;
+    default:
+        return LOG_MGMT_ERR_ECORRUPT;
+    }
+    err |= cbor_encode_text_stringz(&lmec->mapenc, "ts");
+    err |= cbor_encode_int(&lmec->mapenc, entry->ts);
+    err |= cbor_encode_text_stringz(&lmec->mapenc, "level");
+    err |= cbor_encode_uint(&lmec->mapenc, entry->level);
+    err |= cbor_encode_text_stringz(&lmec->mapenc, "index");
+    err |= cbor_encode_uint(&lmec->mapenc, entry->index);
+    err |= cbor_encode_text_stringz(&lmec->mapenc, "module");
+    err |= cbor_encode_uint(&lmec->mapenc, entry->module);
+    if (entry->flags & LOG_MGMT_FLAGS_IMG_HASH) {
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "imghash");
+        err |= cbor_encode_byte_string(&lmec->mapenc, entry->imghash,
+                                       LOG_MGMT_IMG_HASHLEN);
+    }
+    if (part) {
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "off");
+        err |= cbor_encode_uint(&lmec->mapenc, entry->offset);
+        err |= cbor_encode_text_stringz(&lmec->mapenc, "len");
+        err |= cbor_encode_uint(&lmec->mapenc, entry->len);
+    }
+
+    err |= cbor_encode_text_stringz(&lmec->mapenc, "msg");
 
-    bytes_encoded = 0;
-    /* If offset is 0, we encode the keys for maps and other fields which are
-     * necessary per entry since only the keys need to be encoded only in the
-     * for the first offset
+    /*
+     * Write entry data as byte string. Since this may not fit into single
+     * chunk of data we will write as indefinite-length byte string which is
+     * basically a indefinite-length container with definite-length strings
+     * inside.
      */
-    if (entry->offset == 0) {
-        err |= cbor_encoder_create_map(enc, &lmec->mapenc, CborIndefiniteLength);
+    err |= cbor_encoder_create_indef_byte_string(&lmec->mapenc, &lmec->msgenc);
 
-        switch (entry->type) {
-        case LOG_MGMT_ETYPE_CBOR:
-            err |= cbor_encode_text_stringz(&lmec->mapenc, "type");
-            err |= cbor_encode_text_stringz(&lmec->mapenc, "cbor");
-            break;
-        case LOG_MGMT_ETYPE_BINARY:
-            err |= cbor_encode_text_stringz(&lmec->mapenc, "type");
-            err |= cbor_encode_text_stringz(&lmec->mapenc, "bin");
-            break;
-        case LOG_MGMT_ETYPE_STRING:
-            err |= cbor_encode_text_stringz(&lmec->mapenc, "type");
-            err |= cbor_encode_text_stringz(&lmec->mapenc, "str");
-            break;
-        default:
-            return LOG_MGMT_ERR_ECORRUPT;
-        }
-        err |= cbor_encode_text_stringz(&lmec->mapenc, "ts");
-        err |= cbor_encode_int(&lmec->mapenc, entry->ts);
-        err |= cbor_encode_text_stringz(&lmec->mapenc, "level");
-        err |= cbor_encode_uint(&lmec->mapenc, entry->level);
-        err |= cbor_encode_text_stringz(&lmec->mapenc, "index");
-        err |= cbor_encode_uint(&lmec->mapenc, entry->index);
-        err |= cbor_encode_text_stringz(&lmec->mapenc, "module");
-        err |= cbor_encode_uint(&lmec->mapenc, entry->module);
-        if (entry->flags & LOG_MGMT_FLAGS_IMG_HASH) {
-            err |= cbor_encode_text_stringz(&lmec->mapenc, "imghash");
-            err |= cbor_encode_byte_string(&lmec->mapenc, entry->imghash,
-                                           LOG_MGMT_IMG_HASHLEN);
-        }
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
 
-        err |= cbor_encode_text_stringz(&lmec->mapenc, "msg");
+    return LOG_MGMT_ERR_EOK;
+}
 
-        /*
-         * Write entry data as byte string. Since this may not fit into single
-         * chunk of data we will write as indefinite-length byte string which is
-         * basically a indefinite-length container with definite-length strings
-         * inside.
-         */
-        err |= cbor_encoder_create_indef_byte_string(&lmec->mapenc, &lmec->msgenc);
-        if (out_len != NULL) {
-            for (off = 0; off < entry->len; off += entry->chunklen) {
-                chunklen = entry->chunklen;
-                if (entry->chunklen > entry->len - off) {
-                    chunklen = entry->len - off;
-                }
-                err |= cbor_encode_byte_string(&lmec->msgenc, entry->data, chunklen);
-                bytes_encoded += chunklen;
-            }
-        } else {
-            err |= cbor_encode_byte_string(&lmec->msgenc, entry->data, entry->chunklen);
-            bytes_encoded = entry->chunklen;
-        }
-    } else {
-        /*
-         * The else case is executed for non-first chunks of data to be encoded
-         *
-         * Write entry data as byte string. Since this may not fit into single
-         * chunk of data we will write as indefinite-length byte string which is
-         * basically a indefinite-length container with definite-length strings
-         * inside.
-         */
-        err |= cbor_encode_byte_string(&lmec->msgenc, entry->data, entry->chunklen);
-        bytes_encoded = entry->chunklen;
-   }
+/**
+ * Encodes a piece of an entry's body.  The entry's containers get closed
+ * along with the last piece of the entry or of the part being encoded.
+ */
+static int
+log_mgmt_encode_entry_chunk(CborEncoder *enc, const void *data, size_t len,
+                            bool last, struct log_mgmt_enc_ctxt *lmec)
+{
+    CborError err = CborNoError;
+
+    err |= cbor_encode_byte_string(&lmec->msgenc, data, len);
+
+    if (last) {
+        err |= cbor_encoder_close_container(&lmec->mapenc, &lmec->msgenc);
+        err |= cbor_encoder_close_container(enc, &lmec->mapenc);
+    }
+
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    return LOG_MGMT_ERR_EOK;
+}
+
+/**
+ * Upper bound on the encoded size of the rest of an entry's body, from the
+ * current chunk on: the data itself, a header of at most three bytes per
+ * chunk, and the break codes closing the "msg" byte string and the entry map.
+ */
+static size_t
+log_mgmt_entry_body_len(const struct log_mgmt_entry *entry)
+{
+    size_t chunks;
+    size_t len;
+
+    len = entry->len - entry->offset;
+    chunks = 1;
+    if (entry->chunklen != 0) {
+        chunks = (len + entry->chunklen - 1) / entry->chunklen;
+    }
+
+    return len + chunks * 3 + 2;
+}
+
+/**
+ * Indicates whether an entry of the specified encoded size, starting at the
+ * specified offset in the response, fits in the response.
+ */
+static bool
+log_mgmt_entry_fits(const struct log_walk_ctxt *ctxt, size_t start,
+                    size_t len)
+{
+    /* `+ 1` to account for the CBOR array terminator. */
+    if (start + len + 1 > LOG_MGMT_MAX_RSP_LEN) {
+        return false;
+    }
 
-   /*
-    * Containers need to get closed when encoding is done, the only way to know at
-    * this point in the code that encoding is done is using the number of bytes
-    * that got encoded and comparing it to the length of the entry
-    */
-   if (entry->offset + bytes_encoded >= entry->len) {
-       err |= cbor_encoder_close_container(&lmec->mapenc, &lmec->msgenc);
-       err |= cbor_encoder_close_container(enc, &lmec->mapenc);
-   }
+    return ctxt->counter == 0 || start + len + 1 <= ctxt->show->max_len;
+}
 
-   if (out_len) {
-       *out_len = cbor_encode_bytes_written(enc) - len;
-   }
+bool
+log_mgmt_filter_accepts(const struct log_mgmt_filter *filter,
+                        uint8_t module, uint8_t level)
+{
+    if (level < filter->min_level) {
+        return false;
+    }
 
-   if (err != 0) {
-       return LOG_MGMT_ERR_ENOMEM;
-   }
+    if (filter->modules_len != 0) {
+        if (module / 8 >= filter->modules_len) {
+            return false;
+        }
+        if (!(filter->modules[module / 8] & (1 << (module % 8)))) {
+            return false;
+        }
+    }
 
-   return LOG_MGMT_ERR_EOK;
+    return true;
 }
 
+/**
+ * Starts encoding an entry if the rest of the entry is guaranteed to fit in
+ * the response.  The entry header is encoded directly into the response and
+ * rolled back if the entry turns out to be too large; transports that cannot
+ * discard data fall back to measuring the header with a counting encoder.
+ *
+ * @return                      0 if the header was encoded;
+ *                              LOG_MGMT_ERR_EMSGSIZE if the entry does not
+ *                                  fit (nothing is encoded);
+ *                              Other LOG_MGMT_ERR_[...] code on failure.
+ */
 static int
-log_mgmt_cb_encode(struct log_mgmt_entry *entry, void *arg)
+log_mgmt_begin_entry(struct log_walk_ctxt *ctxt,
+                     const struct log_mgmt_entry *entry)
 {
     struct CborCntWriter cnt_writer;
-    struct log_mgmt_enc_ctxt *lmec;
-    struct log_walk_ctxt *ctxt;
+    struct mgmt_checkpoint cp;
     CborEncoder cnt_encoder;
-    size_t entry_len;
+    size_t start;
+    size_t len;
     int rc;
 
-    ctxt = arg;
-    lmec = &ctxt->lmec;
+    start = cbor_encode_bytes_written(ctxt->enc);
 
-    if (entry->offset == 0) {
-        /*
-         * First, determine if this entry would fit using
-         * a counter encoder
-         */
+    /* The rest of an entry that was cut short is its last part. */
+    ctxt->part = entry->offset != 0;
+    ctxt->part_len = 0;
 
-        cbor_cnt_writer_init(&cnt_writer);
+    if (mgmt_can_rollback(ctxt->show->mc)) {
+        mgmt_checkpoint(ctxt->enc, &cp);
+        rc = log_mgmt_encode_entry_hdr(ctxt->enc, entry, ctxt->part,
+                                       &ctxt->lmec);
+        if (rc == LOG_MGMT_ERR_ENOMEM) {
+            /* Ran out of buffer; the entry certainly doesn't fit. */
+            len = LOG_MGMT_MAX_RSP_LEN;
+        } else if (rc != 0) {
+            mgmt_rollback(ctxt->show->mc, ctxt->enc, &cp);
+            return rc;
+        } else {
+            len = cbor_encode_bytes_written(ctxt->enc) - start;
+        }
+        len += log_mgmt_entry_body_len(entry);
+
+        if (!log_mgmt_entry_fits(ctxt, start, len)) {
+            rc = mgmt_rollback(ctxt->show->mc, ctxt->enc, &cp);
+            if (rc != 0) {
+                return rc;
+            }
+            return LOG_MGMT_ERR_EMSGSIZE;
+        }
+
+        return 0;
+    }
+
+    cbor_cnt_writer_init(&cnt_writer);
 #ifdef __ZEPHYR__
-        cbor_encoder_cust_writer_init(&cnt_encoder, &cnt_writer.enc, 0);
+    cbor_encoder_cust_writer_init(&cnt_encoder, &cnt_writer.enc, 0);
 #else
-        cbor_encoder_init(&cnt_encoder, &cnt_writer.enc, 0);
+    cbor_encoder_init(&cnt_encoder, &cnt_writer.enc, 0);
 #endif
-        rc = log_mgmt_encode_entry(&cnt_encoder, entry, &entry_len, lmec);
+    rc = log_mgmt_encode_entry_hdr(&cnt_encoder, entry, ctxt->part,
+                                   &ctxt->lmec);
+    if (rc != 0) {
+        return rc;
+    }
+    len = cbor_encode_bytes_written(&cnt_encoder) +
+          log_mgmt_entry_body_len(entry);
+
+    if (!log_mgmt_entry_fits(ctxt, start, len)) {
+        return LOG_MGMT_ERR_EMSGSIZE;
+    }
+
+    return log_mgmt_encode_entry_hdr(ctxt->enc, entry, ctxt->part,
+                                     &ctxt->lmec);
+}
+
+/**
+ * Starts encoding a part of an entry too large for a single response,
+ * beginning at the current chunk.
+ */
+static int
+log_mgmt_begin_part(struct log_walk_ctxt *ctxt,
+                    const struct log_mgmt_entry *entry)
+{
+    ctxt->part = true;
+    ctxt->part_len = 0;
+
+    return log_mgmt_encode_entry_hdr(ctxt->enc, entry, true, &ctxt->lmec);
+}
+
+/**
+ * Number of bytes of a chunk that fit in the current part of a split entry,
+ * leaving room for the chunk's header, the breaks closing the entry, and the
+ * "entries" array terminator.  A part ends within the response's soft limit,
+ * but the first piece of a part may extend to LOG_MGMT_MAX_RSP_LEN so that
+ * every part makes progress.
+ */
+static size_t
+log_mgmt_part_room(const struct log_walk_ctxt *ctxt, size_t chunklen)
+{
+    size_t limit;
+    size_t used;
+
+    limit = ctxt->show->max_len;
+    if (ctxt->part_len == 0) {
+        limit = LOG_MGMT_MAX_RSP_LEN;
+    }
+
+    used = cbor_encode_bytes_written(ctxt->enc) + 3 + 2 + 1;
+    if (used >= limit) {
+        return 0;
+    }
+    if (limit - used < chunklen) {
+        return limit - used;
+    }
+
+    return chunklen;
+}
+
+/**
+ * Encodes a chunk of the entry whose header has been encoded.  Pieces of a
+ * split entry that do not fit go in the next part: in the next response if
+ * the client accepts several, otherwise in the response to the client's next
+ * request, which resumes from the cursor.
+ */
+static int
+log_mgmt_encode_body(struct log_walk_ctxt *ctxt,
+                     const struct log_mgmt_entry *entry)
+{
+    struct log_mgmt_entry piece;
+    size_t len;
+    bool last;
+    int rc;
+
+    piece = *entry;
+
+    while (1) {
+        len = piece.chunklen;
+        if (ctxt->part) {
+            len = log_mgmt_part_room(ctxt, piece.chunklen);
+            if (len == 0 && ctxt->part_len == 0) {
+                return LOG_MGMT_ERR_EMSGSIZE;
+            }
+        }
+        last = len < piece.chunklen || piece.offset + len >= piece.len;
+
+        rc = log_mgmt_encode_entry_chunk(ctxt->enc, piece.data, len, last,
+                                         &ctxt->lmec);
         if (rc != 0) {
             return rc;
         }
 
-        /*
-         * Check if the response is too long. If more than one entry is in the
-         * response we will not add the current one and will return ENOMEM. If this
-         * is just a single entry we add the generic too long message text.
-         */
-        /* `+ 1` to account for the CBOR array terminator. */
-        if (ctxt->rsp_len + entry_len + 1 > LOG_MGMT_MAX_RSP_LEN) {
-            /*
-             * Is this just a single entry? If so, encode the generic error
-             * message in the "msg" field of the response
-             */
-            if (ctxt->counter == 0) {
-                entry->type = LOG_ETYPE_STRING;
-                snprintf((char *)entry->data, LOG_MGMT_MAX_RSP_LEN,
-                         "error: entry too large (%zu bytes)", entry_len);
+        ctxt->counter++;
+        ctxt->part_len += len;
+
+        if (len == piece.chunklen) {
+            if (last) {
+                ctxt->part_off = 0;
+                ctxt->last_enc_index = piece.index;
+                ctxt->last_cursor = piece.cursor;
+                ctxt->last_cursor.offset = 0;
             }
+            return 0;
+        }
+
+        /* The response is full; the rest of the entry is its next part. */
+        piece.data = (const uint8_t *)piece.data + len;
+        piece.offset += len;
+        piece.chunklen -= len;
+
+        ctxt->part_index = piece.index;
+        ctxt->part_off = piece.offset;
+        ctxt->last_cursor = piece.cursor;
+        ctxt->last_cursor.offset = piece.offset;
+
+        if (!ctxt->show->stream) {
+            /* We want a negative error code here */
+            return -1 * LOG_MGMT_ERR_EUNKNOWN;
+        }
+
+        rc = log_mgmt_walk_flush(ctxt);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rc = log_mgmt_begin_part(ctxt, &piece);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+}
+
+static int
+log_mgmt_cb_encode(struct log_mgmt_entry *entry, void *arg)
+{
+    struct log_walk_ctxt *ctxt;
+    struct log_mgmt_entry rest;
+    size_t start;
+    size_t skip;
+    int rc;
+
+    ctxt = arg;
+
+    /* Skip the part of a split entry sent in earlier responses; the walk may
+     * deliver it from the start.
+     */
+    start = 0;
+    if (ctxt->part_off != 0 && entry->index == ctxt->part_index) {
+        start = ctxt->part_off;
+    }
+    if (entry->offset + entry->chunklen <= start) {
+        return 0;
+    }
+    if (entry->offset < start) {
+        skip = start - entry->offset;
+        rest = *entry;
+        rest.data = (const uint8_t *)entry->data + skip;
+        rest.offset = start;
+        rest.chunklen -= skip;
+        entry = &rest;
+    }
+
+    if (entry->offset == start) {
+        rc = log_mgmt_begin_entry(ctxt, entry);
+
+        /* If the client accepts multiple responses, send the entries encoded
+         * so far and continue the walk in a new response.
+         */
+        if (rc == LOG_MGMT_ERR_EMSGSIZE && ctxt->show->stream &&
+            ctxt->counter > 0) {
+
+            rc = log_mgmt_walk_flush(ctxt);
+            if (rc != 0) {
+                return rc;
+            }
+            rc = log_mgmt_begin_entry(ctxt, entry);
+        }
+
+        if (rc == LOG_MGMT_ERR_EMSGSIZE) {
+            /* If other entries are in the response, leave this one for the
+             * next.  Otherwise it is too large for any response; split it.
+             */
+            if (ctxt->counter > 0) {
+                /* We want a negative error code here */
+                return -1 * LOG_MGMT_ERR_EUNKNOWN;
+            }
+            rc = log_mgmt_begin_part(ctxt, entry);
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return log_mgmt_encode_body(ctxt, entry);
+}
+
+#if LOG_MGMT_READ_WATERMARK_UPDATE
+#if LOG_MGMT_WATERMARK_DELAY_MS > 0
+void
+log_mgmt_watermark_flush(void)
+{
+    if (log_mgmt_watermark.pending) {
+        log_mgmt_watermark.pending = false;
+        log_mgmt_impl_set_watermark(&log_mgmt_watermark.log,
+                                    log_mgmt_watermark.index);
+    }
+}
+
+/**
+ * Forgets the held back watermark of a log that has been cleared; the
+ * clear resets the log's watermark.
+ */
+static void
+log_mgmt_watermark_drop(const char *log_name)
+{
+    if (log_mgmt_watermark.pending &&
+        strcmp(log_mgmt_watermark.log.name, log_name) == 0) {
+
+        log_mgmt_watermark.pending = false;
+    }
+}
+#endif
+
+/**
+ * Records how far a log has been read.  With LOG_MGMT_WATERMARK_DELAY_MS,
+ * the watermark is held in RAM and written once the interval expires, so
+ * that polling a log does not write flash on every read.
+ */
+static void
+log_mgmt_set_watermark(const struct log_mgmt_log *log, int index)
+{
+#if LOG_MGMT_WATERMARK_DELAY_MS > 0
+    if (log_mgmt_watermark.pending &&
+        strcmp(log_mgmt_watermark.log.name, log->name) != 0) {
+
+        log_mgmt_watermark_flush();
+    }
+
+    log_mgmt_watermark.log = *log;
+    log_mgmt_watermark.index = index;
+    log_mgmt_watermark.pending = true;
+    log_mgmt_impl_watermark_defer();
+#else
+    log_mgmt_impl_set_watermark(log, index);
+#endif
+}
+#endif
+
+static int
+log_encode_entries(struct log_show_ctxt *show, const struct log_mgmt_log *log,
+                   int64_t timestamp, uint32_t index)
+{
+    struct log_mgmt_filter filter;
+    struct log_walk_ctxt ctxt;
+    CborEncoder entries;
+    CborEncoder *enc;
+    CborError err;
+    int rc;
+
+    enc = &show->log_map;
+    err = 0;
+    ctxt = (struct log_walk_ctxt) {
+        .enc = &entries,
+        .show = show,
+        .log = log,
+    };
+    if (show->cursor != NULL) {
+        ctxt.part_index = show->cursor->index;
+        ctxt.part_off = show->cursor->offset;
+    }
+
+    if (cbor_encode_bytes_written(enc) + LOG_MGMT_ENTRIES_HDR_LEN >
+        LOG_MGMT_MAX_RSP_LEN) {
+        rc = LOG_MGMT_ERR_EUNKNOWN;
+        goto err;
+    }
+
+    err |= cbor_encode_text_stringz(enc, "entries");
+    err |= cbor_encoder_create_array(enc, &entries, CborIndefiniteLength);
+
+    filter = show->sel;
+    filter.min_timestamp = timestamp;
+    filter.min_index = index;
+    if (show->cursor != NULL) {
+        log_mgmt_filter_resume(&filter, show->cursor);
+    }
+
+    rc = log_mgmt_impl_foreach_entry(log->name, &filter,
+                                     log_mgmt_cb_encode, &ctxt);
+    if (show->flush_rc != 0) {
+        return show->flush_rc;
+    }
+    if (rc < 0) {
+        /*
+         * If we receive negative error code from the walk function,
+         * make sure it gets converted to a positive error code
+         */
+        rc = -1 * rc;
+    }
+
+    err |= cbor_encoder_close_container(enc, &entries);
+    if (ctxt.counter > 0) {
+        err |= log_mgmt_encode_cursor(enc, &ctxt.last_cursor);
+    }
+
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+err:
+#if LOG_MGMT_READ_WATERMARK_UPDATE
+    if (!rc || rc == LOG_MGMT_ERR_EUNKNOWN) {
+        log_mgmt_set_watermark(log, ctxt.last_enc_index);
+    }
+#endif
+    return rc;
+}
+
+static int
+log_encode(struct log_show_ctxt *show, const struct log_mgmt_log *log,
+           int64_t timestamp, uint32_t index)
+{
+    CborError err;
+    int rc;
+
+    err = 0;
+    err |= log_mgmt_show_open_log(show, log);
+
+    rc = log_encode_entries(show, log, timestamp, index);
+    if (show->flush_rc != 0) {
+        return rc;
+    }
+    if (rc != 0) {
+        cbor_encoder_close_container(&show->logs, &show->log_map);
+        return rc;
+    }
+
+    err |= cbor_encoder_close_container(&show->logs, &show->log_map);
+
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: log show
+ *
+ * Besides the timestamp and index criteria, entries can be restricted to a
+ * minimum "level", to the modules set in the "modules" mask, and to those
+ * whose body contains the bytes in "match".
+ *
+ * An entry too large for a response is split into parts, each carrying the
+ * offset of the part in the body ("off") and the body's length ("len").  The
+ * cursor of a response that ends with a part resumes within the entry.
+ */
+static int
+log_mgmt_show(struct mgmt_ctxt *ctxt)
+{
+    char name[LOG_MGMT_NAME_LEN];
+    uint8_t modules[LOG_MGMT_MODULE_MASK_LEN];
+    uint8_t match[LOG_MGMT_MATCH_MAX];
+    struct log_mgmt_cursor cursor;
+    struct log_show_ctxt show;
+    struct log_mgmt_log log;
+    CborError err;
+    uint64_t index;
+    uint32_t next_idx;
+    int64_t timestamp;
+    unsigned long long level;
+    bool stream;
+    bool encoded;
+    size_t cursor_len;
+    size_t modules_len;
+    size_t match_len;
+    int name_len;
+    int log_idx;
+    int rc;
+
+    const struct cbor_attr_t attr[] = {
+        {
+            .attribute = "log_name",
+            .type = CborAttrTextStringType,
+            .addr.string = name,
+            .len = sizeof(name),
+        },
+        {
+            .attribute = "ts",
+            .type = CborAttrIntegerType,
+            .addr.integer = &timestamp,
+        },
+        {
+            .attribute = "index",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &index,
+        },
+        {
+            .attribute = "stream",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &stream,
+        },
+        {
+            .attribute = "cursor",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = (uint8_t *)&cursor,
+            .addr.bytestring.len = &cursor_len,
+            .len = sizeof(cursor),
+        },
+        {
+            .attribute = "level",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &level,
+        },
+        {
+            .attribute = "modules",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = modules,
+            .addr.bytestring.len = &modules_len,
+            .len = sizeof(modules),
+        },
+        {
+            .attribute = "match",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = match,
+            .addr.bytestring.len = &match_len,
+            .len = sizeof(match),
+        },
+        {
+            .attribute = NULL,
+        },
+    };
+
+    name[0] = '\0';
+    stream = false;
+    cursor_len = 0;
+    modules_len = 0;
+    match_len = 0;
+    rc = cbor_read_object(&ctxt->it, attr);
+    if (rc != 0 || level > UINT8_MAX) {
+        return LOG_MGMT_ERR_EINVAL;
+    }
+    name_len = strlen(name);
+
+    err = 0;
+#if LOG_MGMT_GLOBAL_IDX
+    /* Determine the index that the next log entry would use. */
+    rc = log_mgmt_impl_get_next_idx(&next_idx);
+    if (rc != 0) {
+        return LOG_MGMT_ERR_EUNKNOWN;
+    }
+#else
+    /* This field is deprecated.  Set it to 0 until it gets removed. */
+    next_idx = 0;
+#endif
+
+    /* Only split the response if the transport can send more than one. */
+    show = (struct log_show_ctxt) {
+        .mc = ctxt,
+        .next_idx = next_idx,
+        .stream = stream && ctxt->flush_cb != NULL,
+        .max_len = LOG_MGMT_MAX_RSP_LEN,
+        .sel = {
+            .min_level = level,
+            .modules = modules,
+            .modules_len = modules_len,
+            .match = match,
+            .match_len = match_len,
+        },
+    };
+
+    /* A cursor identifies a position in one particular log. */
+    if (cursor_len != 0) {
+        if (!log_mgmt_cursor_valid(&cursor, cursor_len) || name_len == 0) {
+            return LOG_MGMT_ERR_EINVAL;
+        }
+        show.cursor = &cursor;
+    }
+    encoded = false;
+
+    err |= log_mgmt_show_open(&show);
+
+    /* Iterate list of logs, encoding each that matches the client request. */
+    for (log_idx = 0; ; log_idx++) {
+        rc = log_mgmt_impl_get_log(log_idx, &log);
+        if (rc == LOG_MGMT_ERR_ENOENT) {
+            /* Log list fully iterated. */
+            if (name_len != 0) {
+                /* Client specified log name, but the log wasn't found. */
+                cbor_encoder_close_container(&ctxt->encoder, &show.logs);
+                return LOG_MGMT_ERR_ENOENT;
+            } else {
+                break;
+            }
+        } else if (rc != 0) {
+            goto err;
+        }
+
+        /* Stream logs cannot be read. */
+        if (log.type != LOG_MGMT_TYPE_STREAM) {
+            if (name_len == 0 || strcmp(name, log.name) == 0) {
+                /* When streaming, each log starts in a fresh response. */
+                if (show.stream && encoded) {
+                    rc = log_mgmt_show_flush(&show);
+                    if (rc) {
+                        return rc;
+                    }
+                }
+
+                rc = log_encode(&show, &log, timestamp, index);
+                if (show.flush_rc != 0) {
+                    return show.flush_rc;
+                }
+                if (rc) {
+                    goto err;
+                }
+                encoded = true;
+
+                /* If the client specified this log, he isn't interested in the
+                 * remaining ones.
+                 */
+                if (name_len > 0) {
+                    break;
+                }
+            }
+        }
+    }
+
+err:
+    err |= cbor_encoder_close_container(&ctxt->encoder, &show.logs);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, rc);
+    if (show.stream) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "more");
+        err |= cbor_encode_boolean(&ctxt->encoder, false);
+    }
+
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Retrieves the readable log with the specified name.
+ */
+static int
+log_mgmt_find_log(const char *name, struct log_mgmt_log *out_log)
+{
+    int log_idx;
+    int rc;
+
+    for (log_idx = 0; ; log_idx++) {
+        rc = log_mgmt_impl_get_log(log_idx, out_log);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (out_log->type != LOG_MGMT_TYPE_STREAM &&
+            strcmp(out_log->name, name) == 0) {
+
+            return 0;
+        }
+    }
+}
+
+static int
+log_mgmt_tail_match_cb(struct log_mgmt_entry *entry, void *arg)
+{
+    /* Stop the walk at the first matching entry. */
+    return 1;
+}
+
+/**
+ * Builds the filter of the entries a tail request is waiting for.
+ */
+static void
+log_mgmt_tail_filter(const struct log_mgmt_tail *tail,
+                     struct log_mgmt_filter *filter)
+{
+    *filter = (struct log_mgmt_filter) {
+        .min_index = tail->index,
+        .min_level = tail->min_level,
+        .modules = tail->modules,
+        .modules_len = tail->modules_len,
+        .match = tail->match,
+        .match_len = tail->match_len,
+    };
+
+    if (tail->has_cursor) {
+        log_mgmt_filter_resume(filter, &tail->cursor);
+    }
+}
+
+/**
+ * Encodes the response to a tail request: the matching entries that fit in a
+ * single packet, in the format of a log show response.
+ */
+static int
+log_mgmt_tail_encode(struct mgmt_ctxt *ctxt, void *arg)
+{
+    struct log_mgmt_tail *tail;
+    struct log_show_ctxt show;
+    struct log_mgmt_log log;
+    CborError err;
+    uint32_t next_idx;
+    int rc;
+
+    tail = arg;
+
+#if LOG_MGMT_GLOBAL_IDX
+    rc = log_mgmt_impl_get_next_idx(&next_idx);
+    if (rc != 0) {
+        return LOG_MGMT_ERR_EUNKNOWN;
+    }
+#else
+    next_idx = 0;
+#endif
+
+    show = (struct log_show_ctxt) {
+        .mc = ctxt,
+        .next_idx = next_idx,
+        .cursor = tail->has_cursor ? &tail->cursor : NULL,
+        .max_len = mgmt_rsp_chunk_size(ctxt, LOG_MGMT_TAIL_RSP_OVERHEAD,
+                                       LOG_MGMT_MAX_RSP_LEN),
+    };
+    log_mgmt_tail_filter(tail, &show.sel);
+
+    err = 0;
+    err |= log_mgmt_show_open(&show);
+
+    rc = log_mgmt_find_log(tail->name, &log);
+    if (rc == 0) {
+        rc = log_encode(&show, &log, 0, tail->index);
+    }
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &show.logs);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, rc);
+
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Sends the response to the outstanding tail request, if any, and stops
+ * watching its log.
+ */
+static void
+log_mgmt_tail_complete(void)
+{
+    if (!log_mgmt_tail_req.active) {
+        return;
+    }
+
+    log_mgmt_tail_req.active = false;
+    log_mgmt_impl_tail_watch(NULL);
+    mgmt_complete_async(&log_mgmt_tail_req.async, MGMT_ERR_EOK,
+                        log_mgmt_tail_encode, &log_mgmt_tail_req);
+}
+
+void
+log_mgmt_tail_push(void)
+{
+    log_mgmt_tail_complete();
+}
+
+/**
+ * Command handler: log tail (read)
+ *
+ * Waits for new entries of the log in "log_name", starting with the entry at
+ * "index" or the one after "cursor".  Entries can be restricted as in a log
+ * show request, by "level", "modules" and "match".  If matching entries
+ * exist, they are returned right away; otherwise the response is held back
+ * until some are appended.  Either way, the response is a log show response
+ * holding as many entries as fit in one packet.
+ *
+ * A client keeps one tail request outstanding, sending the next one after
+ * the cursor of the last response.  A new tail request, from any client,
+ * completes the outstanding one first.  Transports that cannot defer
+ * responses always get a response right away.
+ */
+static int
+log_mgmt_tail(struct mgmt_ctxt *ctxt)
+{
+    struct log_mgmt_filter filter;
+    struct log_mgmt_tail tail;
+    struct log_mgmt_log log;
+    unsigned long long index;
+    unsigned long long level;
+    size_t cursor_len;
+    int rc;
+
+    const struct cbor_attr_t attr[] = {
+        {
+            .attribute = "log_name",
+            .type = CborAttrTextStringType,
+            .addr.string = tail.name,
+            .len = sizeof(tail.name),
+        },
+        {
+            .attribute = "index",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &index,
+        },
+        {
+            .attribute = "level",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &level,
+        },
+        {
+            .attribute = "modules",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = tail.modules,
+            .addr.bytestring.len = &tail.modules_len,
+            .len = sizeof(tail.modules),
+        },
+        {
+            .attribute = "match",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = tail.match,
+            .addr.bytestring.len = &tail.match_len,
+            .len = sizeof(tail.match),
+        },
+        {
+            .attribute = "cursor",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = (uint8_t *)&tail.cursor,
+            .addr.bytestring.len = &cursor_len,
+            .len = sizeof(tail.cursor),
+        },
+        {
+            .attribute = NULL,
+        },
+    };
+
+    tail.name[0] = '\0';
+    tail.modules_len = 0;
+    tail.match_len = 0;
+    cursor_len = 0;
+    rc = cbor_read_object(&ctxt->it, attr);
+    if (rc != 0 || tail.name[0] == '\0' || index > UINT32_MAX ||
+        level > UINT8_MAX ||
+        (cursor_len != 0 &&
+         !log_mgmt_cursor_valid(&tail.cursor, cursor_len))) {
+
+        return LOG_MGMT_ERR_EINVAL;
+    }
+
+    rc = log_mgmt_find_log(tail.name, &log);
+    if (rc != 0) {
+        return rc;
+    }
+
+    tail.active = false;
+    tail.index = index;
+    tail.has_cursor = cursor_len != 0;
+    tail.min_level = level;
+
+    /* Only one request is held back at a time. */
+    log_mgmt_tail_complete();
+
+    /* Watch the log before looking for entries, so that none appended in
+     * between goes unnoticed.  If the log can't be watched, or matching
+     * entries exist already, respond right away.
+     */
+    if (ctxt->defer_cb != NULL && log_mgmt_impl_tail_watch(log.name) == 0) {
+        log_mgmt_tail_filter(&tail, &filter);
+        rc = log_mgmt_impl_foreach_entry(log.name, &filter,
+                                         log_mgmt_tail_match_cb, NULL);
+        if (rc == 0 && mgmt_defer(ctxt, &log_mgmt_tail_req.async) == 0) {
+            /* Nothing to send yet. */
+            tail.async = log_mgmt_tail_req.async;
+            tail.active = true;
+            log_mgmt_tail_req = tail;
+            return MGMT_ERR_EPENDING;
+        }
+
+        log_mgmt_impl_tail_watch(NULL);
+    }
+
+    return log_mgmt_tail_encode(ctxt, &tail);
+}
+
+/** State of a log export response. */
+struct log_export_ctxt {
+    struct mgmt_ctxt *mc;
+    /* The "recs" byte string in the root map. */
+    CborEncoder recs;
+    /* Whether the client accepts multiple responses. */
+    bool stream;
+    /* Number of records in the current response. */
+    uint32_t count;
+    /* Bytes of the current entry's body that go into its record. */
+    size_t body_len;
+    /* Position of the last record encoded. */
+    struct log_mgmt_cursor last_cursor;
+    /* Set if the walk stopped because the response was full. */
+    bool full;
+    /* Nonzero if encoding failed. */
+    int rc;
+};
+
+/* Room left at the end of a log export response for closing "recs" and for
+ * "cursor", "rc" and "more".
+ */
+#define LOG_MGMT_EXPORT_RSP_TAIL_LEN    48
+
+/* Worst-case CBOR header of one byte string chunk within "recs". */
+#define LOG_MGMT_EXPORT_CHUNK_HDR_LEN   3
+
+static void
+log_mgmt_put_le(uint8_t *dst, uint64_t val, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        dst[i] = val >> (i * 8);
+    }
+}
+
+/**
+ * Opens the fields every log export response starts with: "v" and the
+ * "recs" byte string.
+ */
+static int
+log_mgmt_export_open(struct log_export_ctxt *ex)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ex->mc->encoder, "v");
+    err |= cbor_encode_uint(&ex->mc->encoder, LOG_MGMT_EXPORT_VERSION);
+    err |= cbor_encode_text_stringz(&ex->mc->encoder, "recs");
+    err |= cbor_encoder_create_indef_byte_string(&ex->mc->encoder,
+                                                 &ex->recs);
+
+    return err;
+}
+
+/**
+ * Closes "recs" and encodes the remaining fields of a log export response.
+ */
+static int
+log_mgmt_export_close(struct log_export_ctxt *ex, int rc, bool more)
+{
+    CborError err;
 
-            /* We want a negative error code here */
-            return -1 * LOG_MGMT_ERR_EUNKNOWN;
-        }
-        ctxt->rsp_len += entry_len;
+    err = 0;
+    err |= cbor_encoder_close_container(&ex->mc->encoder, &ex->recs);
+    if (ex->count > 0) {
+        err |= log_mgmt_encode_cursor(&ex->mc->encoder, &ex->last_cursor);
     }
-
-    /*** The entry fits. Now encode it. */
-    rc = log_mgmt_encode_entry(ctxt->enc, entry, NULL, lmec);
-    if (rc != 0) {
-        return rc;
+    err |= cbor_encode_text_stringz(&ex->mc->encoder, "rc");
+    err |= cbor_encode_int(&ex->mc->encoder, rc);
+    if (ex->stream) {
+        err |= cbor_encode_text_stringz(&ex->mc->encoder, "more");
+        err |= cbor_encode_boolean(&ex->mc->encoder, more);
     }
 
-    ctxt->counter++;
-    ctxt->last_enc_index = entry->index;
-
-    return 0;
+    return err;
 }
 
+/**
+ * Starts the record of an entry, sending the current response first if the
+ * record doesn't fit and the client accepts several.  A record too large for
+ * an empty response gets its body cut short.
+ *
+ * @return                      0 if the record header was encoded;
+ *                              1 if the response is full;
+ *                              LOG_MGMT_ERR_[...] code on failure.
+ */
 static int
-log_encode_entries(const struct log_mgmt_log *log, CborEncoder *enc,
-                   int64_t timestamp, uint32_t index)
+log_mgmt_export_begin(struct log_export_ctxt *ex,
+                      const struct log_mgmt_entry *entry)
 {
-    struct CborCntWriter cnt_writer;
-    struct log_mgmt_filter filter;
-    struct log_walk_ctxt ctxt;
-    CborEncoder cnt_encoder;
-    CborEncoder entries;
-    CborError err;
-    int rsp_len;
+    uint8_t hdr[LOG_MGMT_EXPORT_HDR_LEN + LOG_MGMT_IMG_HASHLEN];
+    size_t hdr_len;
+    size_t room;
+    size_t used;
+    size_t chunks;
+    uint8_t flags;
     int rc;
 
-    err = 0;
-    rsp_len = 0;
-    /* this code counts how long the message would be if we encoded
-     * this outer structure using cbor. */
-    cbor_cnt_writer_init(&cnt_writer);
-    cbor_encoder_init(&cnt_encoder, &cnt_writer.enc, 0);
-    err |= cbor_encode_text_stringz(&cnt_encoder, "entries");
-    err |= cbor_encoder_create_array(&cnt_encoder, &entries,
-                                       CborIndefiniteLength);
-    err |= cbor_encoder_close_container(&cnt_encoder, &entries);
-    rsp_len = cbor_encode_bytes_written(enc) +
-              cbor_encode_bytes_written(&cnt_encoder);
-    if (rsp_len > LOG_MGMT_MAX_RSP_LEN) {
-        rc = LOG_MGMT_ERR_EUNKNOWN;
-        goto err;
+    hdr_len = LOG_MGMT_EXPORT_HDR_LEN;
+    if (entry->flags & LOG_MGMT_FLAGS_IMG_HASH) {
+        hdr_len += LOG_MGMT_IMG_HASHLEN;
     }
 
-    err |= cbor_encode_text_stringz(enc, "entries");
-    err |= cbor_encoder_create_array(enc, &entries, CborIndefiniteLength);
+    chunks = 1;
+    if (entry->chunklen != 0) {
+        chunks += (entry->len + entry->chunklen - 1) / entry->chunklen;
+    }
 
-    filter = (struct log_mgmt_filter) {
-        .min_timestamp = timestamp,
-        .min_index = index,
-    };
-    ctxt = (struct log_walk_ctxt) {
-        .enc = &entries,
-        .rsp_len = cbor_encode_bytes_written(enc),
-    };
+    used = cbor_encode_bytes_written(&ex->recs);
+    if (used + hdr_len + entry->len + chunks * LOG_MGMT_EXPORT_CHUNK_HDR_LEN +
+        LOG_MGMT_EXPORT_RSP_TAIL_LEN > LOG_MGMT_MAX_RSP_LEN) {
 
-    rc = log_mgmt_impl_foreach_entry(log->name, &filter,
-                                     log_mgmt_cb_encode, &ctxt);
-    if (rc < 0) {
-        /*
-         * If we receive negative error code from the walk function,
-         * make sure it gets converted to a positive error code
-         */
-        rc = -1 * rc;
+        if (ex->count > 0) {
+            if (!ex->stream) {
+                return 1;
+            }
+
+            if (log_mgmt_export_close(ex, LOG_MGMT_ERR_EOK, true) != 0) {
+                return LOG_MGMT_ERR_ENOMEM;
+            }
+            rc = mgmt_flush_rsp(ex->mc);
+            if (rc != 0) {
+                return rc;
+            }
+            if (log_mgmt_export_open(ex) != 0) {
+                return LOG_MGMT_ERR_ENOMEM;
+            }
+            ex->count = 0;
+            used = cbor_encode_bytes_written(&ex->recs);
+        }
     }
 
-    err |= cbor_encoder_close_container(enc, &entries);
+    /* Cut the body short if it doesn't fit even on its own. */
+    room = LOG_MGMT_MAX_RSP_LEN - LOG_MGMT_EXPORT_RSP_TAIL_LEN;
+    if (used + hdr_len + chunks * LOG_MGMT_EXPORT_CHUNK_HDR_LEN > room) {
+        return LOG_MGMT_ERR_EMSGSIZE;
+    }
+    room -= used + hdr_len + chunks * LOG_MGMT_EXPORT_CHUNK_HDR_LEN;
 
-    if (err != 0) {
-        return LOG_MGMT_ERR_ENOMEM;
+    flags = entry->flags;
+    ex->body_len = entry->len;
+    if (ex->body_len > room) {
+        ex->body_len = room;
+        flags |= LOG_MGMT_EXPORT_F_TRUNC;
     }
 
-err:
-#if LOG_MGMT_READ_WATERMARK_UPDATE
-    if (!rc || rc == LOG_MGMT_ERR_EUNKNOWN) {
-        log_mgmt_impl_set_watermark(log, ctxt.last_enc_index);
+    log_mgmt_put_le(hdr + 0, entry->index, 4);
+    log_mgmt_put_le(hdr + 4, entry->ts, 8);
+    hdr[12] = entry->module;
+    hdr[13] = entry->level;
+    hdr[14] = entry->type;
+    hdr[15] = flags;
+    log_mgmt_put_le(hdr + 16, ex->body_len, 2);
+    if (entry->flags & LOG_MGMT_FLAGS_IMG_HASH) {
+        memcpy(hdr + LOG_MGMT_EXPORT_HDR_LEN, entry->imghash,
+               LOG_MGMT_IMG_HASHLEN);
     }
-#endif
-    return rc;
+
+    if (cbor_encode_byte_string(&ex->recs, hdr, hdr_len) != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
 }
 
 static int
-log_encode(const struct log_mgmt_log *log, CborEncoder *ctxt,
-           int64_t timestamp, uint32_t index)
+log_mgmt_export_cb(struct log_mgmt_entry *entry, void *arg)
 {
-    CborEncoder logs;
-    CborError err;
+    struct log_export_ctxt *ex;
+    size_t len;
     int rc;
 
-    err = 0;
-    err |= cbor_encoder_create_map(ctxt, &logs, CborIndefiniteLength);
-    err |= cbor_encode_text_stringz(&logs, "name");
-    err |= cbor_encode_text_stringz(&logs, log->name);
-    err |= cbor_encode_text_stringz(&logs, "type");
-    err |= cbor_encode_uint(&logs, log->type);
+    ex = arg;
 
-    rc = log_encode_entries(log, &logs, timestamp, index);
-    if (rc != 0) {
-        cbor_encoder_close_container(ctxt, &logs);
-        return rc;
+    if (entry->offset == 0) {
+        rc = log_mgmt_export_begin(ex, entry);
+        if (rc == 1) {
+            ex->full = true;
+            return 1;
+        }
+        if (rc != 0) {
+            ex->rc = rc;
+            return rc;
+        }
     }
 
-    err |= cbor_encoder_close_container(ctxt, &logs);
+    /* Body data is copied as is; only a cut-short record drops some. */
+    if (entry->offset < ex->body_len) {
+        len = entry->chunklen;
+        if (len > ex->body_len - entry->offset) {
+            len = ex->body_len - entry->offset;
+        }
+        if (cbor_encode_byte_string(&ex->recs, entry->data, len) != 0) {
+            ex->rc = LOG_MGMT_ERR_ENOMEM;
+            return ex->rc;
+        }
+    }
 
-    if (err != 0) {
-        return LOG_MGMT_ERR_ENOMEM;
+    if (entry->offset + entry->chunklen >= entry->len) {
+        ex->count++;
+        ex->last_cursor = entry->cursor;
     }
 
     return 0;
 }
 
 /**
- * Command handler: log show
+ * Command handler: log export (read)
+ *
+ * Returns the entries of the log in "log_name" as packed binary records
+ * rather than as CBOR maps; see LOG_MGMT_EXPORT_VERSION for the format.
+ * "index", "cursor" and the filters of log show select the entries.  The
+ * records are concatenated in the "recs" byte string, which holds as many as
+ * fit in the response; a client that sets "stream" gets the rest in further
+ * responses, the last of which has "more" set to false.  Otherwise, the
+ * client continues from the returned "cursor".
  */
 static int
-log_mgmt_show(struct mgmt_ctxt *ctxt)
+log_mgmt_export(struct mgmt_ctxt *ctxt)
 {
     char name[LOG_MGMT_NAME_LEN];
+    uint8_t modules[LOG_MGMT_MODULE_MASK_LEN];
+    uint8_t match[LOG_MGMT_MATCH_MAX];
+    struct log_mgmt_cursor cursor;
+    struct log_mgmt_filter filter;
+    struct log_export_ctxt ex;
     struct log_mgmt_log log;
-    CborEncoder logs;
-    CborError err;
-    uint64_t index;
-    uint32_t next_idx;
-    int64_t timestamp;
-    int name_len;
-    int log_idx;
+    unsigned long long index;
+    unsigned long long level;
+    size_t cursor_len;
+    size_t modules_len;
+    size_t match_len;
+    bool stream;
     int rc;
 
     const struct cbor_attr_t attr[] = {
@@ -367,87 +1595,108 @@ log_mgmt_show(struct mgmt_ctxt *ctxt)
             .addr.string = name,
             .len = sizeof(name),
         },
-        {
-            .attribute = "ts",
-            .type = CborAttrIntegerType,
-            .addr.integer = &timestamp,
-        },
         {
             .attribute = "index",
             .type = CborAttrUnsignedIntegerType,
             .addr.uinteger = &index,
         },
+        {
+            .attribute = "stream",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &stream,
+        },
+        {
+            .attribute = "cursor",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = (uint8_t *)&cursor,
+            .addr.bytestring.len = &cursor_len,
+            .len = sizeof(cursor),
+        },
+        {
+            .attribute = "level",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &level,
+        },
+        {
+            .attribute = "modules",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = modules,
+            .addr.bytestring.len = &modules_len,
+            .len = sizeof(modules),
+        },
+        {
+            .attribute = "match",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = match,
+            .addr.bytestring.len = &match_len,
+            .len = sizeof(match),
+        },
         {
             .attribute = NULL,
         },
     };
 
     name[0] = '\0';
+    stream = false;
+    cursor_len = 0;
+    modules_len = 0;
+    match_len = 0;
     rc = cbor_read_object(&ctxt->it, attr);
-    if (rc != 0) {
+    if (rc != 0 || name[0] == '\0' || index > UINT32_MAX ||
+        level > UINT8_MAX ||
+        (cursor_len != 0 && !log_mgmt_cursor_valid(&cursor, cursor_len))) {
+
         return LOG_MGMT_ERR_EINVAL;
     }
-    name_len = strlen(name);
 
-    err = 0;
-#if LOG_MGMT_GLOBAL_IDX
-    /* Determine the index that the next log entry would use. */
-    rc = log_mgmt_impl_get_next_idx(&next_idx);
+    rc = log_mgmt_find_log(name, &log);
     if (rc != 0) {
-        return LOG_MGMT_ERR_EUNKNOWN;
+        return rc;
     }
-#else
-    /* This field is deprecated.  Set it to 0 until it gets removed. */
-    next_idx = 0;
-#endif
-
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "next_index");
-    err |= cbor_encode_uint(&ctxt->encoder, next_idx);
-
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "logs");
-    err |= cbor_encoder_create_array(&ctxt->encoder, &logs,
-                                     CborIndefiniteLength);
 
-    /* Iterate list of logs, encoding each that matches the client request. */
-    for (log_idx = 0; ; log_idx++) {
-        rc = log_mgmt_impl_get_log(log_idx, &log);
-        if (rc == LOG_MGMT_ERR_ENOENT) {
-            /* Log list fully iterated. */
-            if (name_len != 0) {
-                /* Client specified log name, but the log wasn't found. */
-                cbor_encoder_close_container(&ctxt->encoder, &logs);
-                return LOG_MGMT_ERR_ENOENT;
-            } else {
-                break;
-            }
-        } else if (rc != 0) {
-            goto err;
+    filter = (struct log_mgmt_filter) {
+        .min_index = index,
+        .min_level = level,
+        .modules = modules,
+        .modules_len = modules_len,
+        .match = match,
+        .match_len = match_len,
+    };
+    if (cursor_len != 0) {
+        if (cursor.offset == 0) {
+            log_mgmt_filter_resume(&filter, &cursor);
+        } else if (cursor.index > filter.min_index) {
+            /* Records are never split; an entry cut short by log show is
+             * exported whole.
+             */
+            filter.min_index = cursor.index;
         }
+    }
 
-        /* Stream logs cannot be read. */
-        if (log.type != LOG_MGMT_TYPE_STREAM) {
-            if (name_len == 0 || strcmp(name, log.name) == 0) {
-                rc = log_encode(&log, &logs, timestamp, index);
-                if (rc) {
-                    goto err;
-                }
+    ex = (struct log_export_ctxt) {
+        .mc = ctxt,
+        .stream = stream && ctxt->flush_cb != NULL,
+    };
 
-                /* If the client specified this log, he isn't interested in the
-                 * remaining ones.
-                 */
-                if (name_len > 0) {
-                    break;
-                }
-            }
-        }
+    if (log_mgmt_export_open(&ex) != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
     }
 
-err:
-    err |= cbor_encoder_close_container(&ctxt->encoder, &logs);
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
-    err |= cbor_encode_int(&ctxt->encoder, rc);
+    rc = log_mgmt_impl_foreach_entry(log.name, &filter, log_mgmt_export_cb,
+                                     &ex);
+    if (ex.full) {
+        rc = 0;
+    } else if (ex.rc != 0) {
+        rc = ex.rc;
+    } else if (rc < 0) {
+        rc = -1 * rc;
+    }
+    if (rc == LOG_MGMT_ERR_EMSGSIZE) {
+        /* Nothing more fits; the client resumes from the cursor. */
+        rc = 0;
+    }
 
-    if (err != 0) {
+    if (log_mgmt_export_close(&ex, rc, false) != 0) {
         return LOG_MGMT_ERR_ENOMEM;
     }
 
@@ -585,8 +1834,167 @@ log_mgmt_level_list(struct mgmt_ctxt *ctxt)
     return 0;
 }
 
+/**
+ * Clears a log, discarding any read watermark held back for it.
+ */
+static int
+log_mgmt_clear_log(const char *log_name)
+{
+#if LOG_MGMT_READ_WATERMARK_UPDATE && LOG_MGMT_WATERMARK_DELAY_MS > 0
+    log_mgmt_watermark_drop(log_name);
+#endif
+    return log_mgmt_impl_clear(log_name);
+}
+
+#if LOG_MGMT_CLEAR_ASYNC
+/**
+ * Finds the first log at or after *idx that a clear of the named log (of
+ * every log if the name is empty) applies to.  Stream logs cannot be
+ * cleared.
+ */
+static int
+log_mgmt_clear_find(const char *name, int *idx, struct log_mgmt_log *out_log)
+{
+    int rc;
+
+    for (; ; (*idx)++) {
+        rc = log_mgmt_impl_get_log(*idx, out_log);
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (out_log->type != LOG_MGMT_TYPE_STREAM &&
+            (name[0] == '\0' || strcmp(out_log->name, name) == 0)) {
+
+            return 0;
+        }
+    }
+}
+
+void
+log_mgmt_clear_step(void)
+{
+    struct log_mgmt_log log;
+    int rc;
+
+    if (!log_mgmt_clear_job.busy) {
+        return;
+    }
+
+    rc = log_mgmt_clear_find(log_mgmt_clear_job.name, &log_mgmt_clear_job.idx,
+                             &log);
+    if (rc == LOG_MGMT_ERR_ENOENT) {
+        /* Past the last log. */
+        log_mgmt_clear_job.busy = false;
+        return;
+    }
+    if (rc == 0) {
+        rc = log_mgmt_clear_log(log.name);
+    }
+    if (rc != 0) {
+        log_mgmt_clear_job.rc = rc;
+        log_mgmt_clear_job.busy = false;
+        return;
+    }
+
+    log_mgmt_clear_job.idx++;
+    log_mgmt_clear_job.done++;
+    log_mgmt_impl_clear_defer();
+}
+
+/**
+ * Starts clearing the named log, or every log, in the background.
+ */
+static int
+log_mgmt_clear_start(struct mgmt_ctxt *ctxt, const char *name)
+{
+    struct log_mgmt_log log;
+    CborError err;
+    uint32_t total;
+    int idx;
+    int rc;
+
+    if (log_mgmt_clear_job.busy) {
+        return LOG_MGMT_ERR_EBADSTATE;
+    }
+
+    total = 0;
+    idx = 0;
+    while ((rc = log_mgmt_clear_find(name, &idx, &log)) == 0) {
+        total++;
+        idx++;
+    }
+    if (rc != LOG_MGMT_ERR_ENOENT) {
+        return rc;
+    }
+    if (name[0] != '\0' && total == 0) {
+        return LOG_MGMT_ERR_ENOENT;
+    }
+
+    log_mgmt_clear_job.job++;
+    if (log_mgmt_clear_job.job == 0) {
+        log_mgmt_clear_job.job = 1;
+    }
+    strcpy(log_mgmt_clear_job.name, name);
+    log_mgmt_clear_job.idx = 0;
+    log_mgmt_clear_job.done = 0;
+    log_mgmt_clear_job.total = total;
+    log_mgmt_clear_job.rc = 0;
+    log_mgmt_clear_job.busy = total > 0;
+    if (log_mgmt_clear_job.busy) {
+        log_mgmt_impl_clear_defer();
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, LOG_MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "job");
+    err |= cbor_encode_uint(&ctxt->encoder, log_mgmt_clear_job.job);
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: log clear state
+ *
+ * Reports the progress of the last asynchronous clear.
+ */
+static int
+log_mgmt_clear_state(struct mgmt_ctxt *ctxt)
+{
+    CborError err;
+
+    if (log_mgmt_clear_job.job == 0) {
+        return LOG_MGMT_ERR_ENOENT;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, log_mgmt_clear_job.rc);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "job");
+    err |= cbor_encode_uint(&ctxt->encoder, log_mgmt_clear_job.job);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "done");
+    err |= cbor_encode_uint(&ctxt->encoder, log_mgmt_clear_job.done);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "total");
+    err |= cbor_encode_uint(&ctxt->encoder, log_mgmt_clear_job.total);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "busy");
+    err |= cbor_encode_boolean(&ctxt->encoder, log_mgmt_clear_job.busy);
+    if (err != 0) {
+        return LOG_MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+#endif
+
 /**
  * Command handler: log clear
+ *
+ * With "async" set, the logs are cleared in the background and the
+ * response carries the ID of the job; a read reports its progress.
  */
 static int
 log_mgmt_clear(struct mgmt_ctxt *ctxt)
@@ -596,6 +2004,9 @@ log_mgmt_clear(struct mgmt_ctxt *ctxt)
     int name_len;
     int log_idx;
     int rc;
+#if LOG_MGMT_CLEAR_ASYNC
+    bool async;
+#endif
 
     const struct cbor_attr_t attr[] = {
         {
@@ -604,6 +2015,14 @@ log_mgmt_clear(struct mgmt_ctxt *ctxt)
             .addr.string = name,
             .len = sizeof(name)
         },
+#if LOG_MGMT_CLEAR_ASYNC
+        {
+            .attribute = "async",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &async,
+            .dflt.boolean = false,
+        },
+#endif
         {
             .attribute = NULL
         },
@@ -616,6 +2035,12 @@ log_mgmt_clear(struct mgmt_ctxt *ctxt)
     }
     name_len = strlen(name);
 
+#if LOG_MGMT_CLEAR_ASYNC
+    if (async) {
+        return log_mgmt_clear_start(ctxt, name);
+    }
+#endif
+
     for (log_idx = 0; ; log_idx++) {
         rc = log_mgmt_impl_get_log(log_idx, &log);
         if (rc == LOG_MGMT_ERR_ENOENT) {
@@ -627,7 +2052,7 @@ log_mgmt_clear(struct mgmt_ctxt *ctxt)
 
         if (log.type != LOG_MGMT_TYPE_STREAM) {
             if (name_len == 0 || strcmp(log.name, name) == 0) {
-                rc = log_mgmt_impl_clear(log.name);
+                rc = log_mgmt_clear_log(log.name);
                 if (rc != 0) {
                     return rc;
                 }
@@ -649,5 +2074,7 @@ log_mgmt_clear(struct mgmt_ctxt *ctxt)
 void
 log_mgmt_register_group(void)
 {
+#if !MGMT_STATIC_GROUPS
     mgmt_register_group(&log_mgmt_group);
+#endif
 }
@@ -23,6 +23,7 @@
  */
 
 #include "mgmt/mgmt.h"
+#include "log_mgmt/log_mgmt.h"
 #include "log_mgmt/log_mgmt_impl.h"
 
 int __attribute__((weak))
@@ -69,3 +70,30 @@ log_mgmt_impl_set_watermark(const struct log_mgmt_log *log, int index)
 {
     return MGMT_ERR_ENOTSUP;
 }
+
+#if LOG_MGMT_CLEAR_ASYNC
+void __attribute__((weak))
+log_mgmt_impl_clear_defer(void)
+{
+    /* No background context; clear right away. */
+    log_mgmt_clear_step();
+}
+#endif
+
+#if LOG_MGMT_READ_WATERMARK_UPDATE && LOG_MGMT_WATERMARK_DELAY_MS > 0
+void __attribute__((weak))
+log_mgmt_impl_watermark_defer(void)
+{
+    log_mgmt_watermark_flush();
+}
+#endif
+
+int __attribute__((weak))
+log_mgmt_impl_tail_watch(const char *log_name)
+{
+    if (log_name == NULL) {
+        return 0;
+    }
+
+    return MGMT_ERR_ENOTSUP;
+}
@@ -20,6 +20,9 @@
 #ifndef H_OS_MGMT_
 #define H_OS_MGMT_
 
+#include <stdint.h>
+#include "os_mgmt/os_mgmt_config.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -33,8 +36,17 @@ extern "C" {
 #define OS_MGMT_ID_MPSTAT           3
 #define OS_MGMT_ID_DATETIME_STR     4
 #define OS_MGMT_ID_RESET            5
+#define OS_MGMT_ID_MCUMGR_PARAMS    6
+#define OS_MGMT_ID_SMP_TRACE        7
+#define OS_MGMT_ID_BENCH            8
 
 #define OS_MGMT_TASK_NAME_LEN       32
+#define OS_MGMT_MPOOL_NAME_LEN      32
+
+/* Value of an os_mgmt_mpool_info field the OS does not track; the field is
+ * left out of the mpstat response.
+ */
+#define OS_MGMT_MPOOL_UNKNOWN       UINT32_MAX
 
 struct os_mgmt_task_info {
     uint8_t oti_prio;
@@ -46,15 +58,95 @@ struct os_mgmt_task_info {
     uint32_t oti_runtime;
     uint32_t oti_last_checkin;
     uint32_t oti_next_checkin;
+    /* Age of the stack usage figure in ms; 0 if sampled just now.  Only
+     * reported if OS_MGMT_STACK_SAMPLE_MS is nonzero.
+     */
+    uint32_t oti_stkage;
 
     char oti_name[OS_MGMT_TASK_NAME_LEN];
 };
 
+/* Statistics of one memory pool; for pools that are not made of blocks
+ * (e.g., heaps), blocks are bytes.
+ */
+struct os_mgmt_mpool_info {
+    uint32_t omi_block_size;
+    uint32_t omi_num_blocks;
+    uint32_t omi_num_free;
+    /* Fewest free blocks since boot. */
+    uint32_t omi_min_free;
+    /* Allocations that found the pool empty. */
+    uint32_t omi_alloc_fail;
+
+    char omi_name[OS_MGMT_MPOOL_NAME_LEN];
+};
+
 /**
  * @brief Registers the OS management command handler group.
  */ 
 void os_mgmt_register_group(void);
 
+#if OS_MGMT_MPSTAT && defined __ZEPHYR__
+struct sys_heap;
+
+/**
+ * @brief Adds a heap to the pools reported by the mpstat command.  Heaps
+ *        have no registry on Zephyr; slabs and net_buf pools are found
+ *        without registration.  Requires CONFIG_SYS_HEAP_RUNTIME_STATS.
+ *
+ * @param name                  Name to report the heap under; must remain
+ *                                  valid.
+ * @param heap                  The heap to report.
+ *
+ * @return                      0 on success; MGMT_ERR_ENOMEM if
+ *                                  OS_MGMT_MPSTAT_HEAP_CNT heaps are
+ *                                  registered already.
+ */
+int os_mgmt_mpstat_register_heap(const char *name, struct sys_heap *heap);
+#endif
+
+#if OS_MGMT_SMP_TRACE
+struct smp_trace;
+
+/* Size of one entry in an smp_trace response. */
+#define OS_MGMT_SMP_TRACE_ENTRY_SIZE    22
+
+/**
+ * @brief Makes an SMP streamer's trace ring readable with the smp_trace
+ *        command.
+ *
+ * The command takes an optional "since", the index of the first entry to
+ * return.  It responds with "first", the index of the first entry returned,
+ * "head", the number of requests recorded so far, and "t", a byte string
+ * holding the entries.  Each entry is OS_MGMT_SMP_TRACE_ENTRY_SIZE bytes,
+ * little endian: timestamp (4), group (2), id (1), seq (1), request length
+ * (2), response length (2), rc (1), flags (1), handler ticks (4), and
+ * buffer allocation ticks (4).  Clients page through the ring by passing the
+ * previous "first" plus the number of entries received as the next "since".
+ *
+ * @param trace                 The ring to expose.
+ */
+void os_mgmt_register_smp_trace(const struct smp_trace *trace);
+#endif
+
+#if OS_MGMT_BENCH
+/*
+ * The bench command (OS_MGMT_ID_BENCH) takes optional "n", the number of
+ * responses to send (default 1, at most 256), "len", the payload length of
+ * each, and "d", a byte string to upload.  The uploaded data is discarded
+ * after its CRC-16 (mcumgr_crc16()) is computed.
+ *
+ * Each response holds "seq", its index, and "d", a generated payload whose
+ * byte i is i mod 256; it is shorter than "len" if OS_MGMT_BENCH_MAX_LEN or
+ * the transport MTU is.  The first also holds "rlen" and "crc" of the
+ * upload.  If the SMP streamer has a trace clock, responses also carry its
+ * ticks: "rx", from the arrival of the request header to the handler (first
+ * response only); "hdl", spent in the handler so far; and "tx", the duration
+ * of the latest transmit callback, i.e., of the previous response.
+ * Several responses require a transport that can split responses.
+ */
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,14 +26,83 @@
 
 #define OS_MGMT_RESET_MS    MYNEWT_VAL(OS_MGMT_RESET_MS)
 #define OS_MGMT_TASKSTAT    MYNEWT_VAL(OS_MGMT_TASKSTAT)
+#define OS_MGMT_MPSTAT      MYNEWT_VAL(OS_MGMT_MPSTAT)
 #define OS_MGMT_ECHO        MYNEWT_VAL(OS_MGMT_ECHO)
+#define OS_MGMT_STACK_SAMPLE_MS 0
+#define OS_MGMT_MCUMGR_PARAMS   MYNEWT_VAL(OS_MGMT_MCUMGR_PARAMS)
+#define OS_MGMT_MCUMGR_BUF_SIZE MYNEWT_VAL(OS_MGMT_MCUMGR_BUF_SIZE)
+#define OS_MGMT_MCUMGR_BUF_COUNT MYNEWT_VAL(OS_MGMT_MCUMGR_BUF_COUNT)
+#define OS_MGMT_SMP_TRACE       MYNEWT_VAL(OS_MGMT_SMP_TRACE)
+#define OS_MGMT_BENCH           MYNEWT_VAL(OS_MGMT_BENCH)
+#define OS_MGMT_BENCH_MAX_LEN   MYNEWT_VAL(OS_MGMT_BENCH_MAX_LEN)
 
 #elif defined __ZEPHYR__
 
 #define OS_MGMT_RESET_MS    CONFIG_OS_MGMT_RESET_MS
 #define OS_MGMT_TASKSTAT    CONFIG_OS_MGMT_TASKSTAT
+
+#ifdef CONFIG_OS_MGMT_MPSTAT
+#define OS_MGMT_MPSTAT      1
+#else
+#define OS_MGMT_MPSTAT      0
+#endif
+
+/* Number of heaps that can be registered for mpstat. */
+#ifdef CONFIG_OS_MGMT_MPSTAT_HEAP_CNT
+#define OS_MGMT_MPSTAT_HEAP_CNT CONFIG_OS_MGMT_MPSTAT_HEAP_CNT
+#else
+#define OS_MGMT_MPSTAT_HEAP_CNT 2
+#endif
 #define OS_MGMT_ECHO        CONFIG_OS_MGMT_ECHO
 
+/* Period of the background stack high-water-mark sampler; 0 disables it and
+ * stacks get scanned on each taskstat request.  The sampler needs the thread
+ * monitor and stack fill patterns; without them it is compiled out.
+ */
+#if defined(CONFIG_OS_MGMT_STACK_SAMPLE_MS) &&                          \
+    defined(CONFIG_THREAD_MONITOR) && defined(CONFIG_INIT_STACKS) &&    \
+    defined(CONFIG_THREAD_STACK_INFO) && !defined(CONFIG_STACK_GROWS_UP)
+#define OS_MGMT_STACK_SAMPLE_MS CONFIG_OS_MGMT_STACK_SAMPLE_MS
+#else
+#define OS_MGMT_STACK_SAMPLE_MS 0
+#endif
+
+/* Number of threads whose stack usage the sampler tracks. */
+#ifdef CONFIG_OS_MGMT_STACK_SAMPLE_CNT
+#define OS_MGMT_STACK_SAMPLE_CNT CONFIG_OS_MGMT_STACK_SAMPLE_CNT
+#else
+#define OS_MGMT_STACK_SAMPLE_CNT 32
+#endif
+
+#ifdef CONFIG_OS_MGMT_MCUMGR_PARAMS
+#define OS_MGMT_MCUMGR_PARAMS   1
+#else
+#define OS_MGMT_MCUMGR_PARAMS   0
+#endif
+
+/* Reported by the parameters command if the transport does not say. */
+#define OS_MGMT_MCUMGR_BUF_SIZE CONFIG_MCUMGR_BUF_SIZE
+#define OS_MGMT_MCUMGR_BUF_COUNT CONFIG_MCUMGR_BUF_COUNT
+
+#ifdef CONFIG_OS_MGMT_SMP_TRACE
+#define OS_MGMT_SMP_TRACE       1
+#else
+#define OS_MGMT_SMP_TRACE       0
+#endif
+
+#ifdef CONFIG_OS_MGMT_BENCH
+#define OS_MGMT_BENCH           1
+#else
+#define OS_MGMT_BENCH           0
+#endif
+
+/* Largest generated payload in one bench response. */
+#ifdef CONFIG_OS_MGMT_BENCH_MAX_LEN
+#define OS_MGMT_BENCH_MAX_LEN   CONFIG_OS_MGMT_BENCH_MAX_LEN
+#else
+#define OS_MGMT_BENCH_MAX_LEN   512
+#endif
+
 #else
 
 /* No direct support for this OS.  The application needs to define the above
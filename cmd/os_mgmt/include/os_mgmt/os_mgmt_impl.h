@@ -32,10 +32,19 @@ extern "C" {
 #endif
 
 struct os_mgmt_task_info;
+struct os_mgmt_mpool_info;
+
+typedef int os_mgmt_foreach_task_fn(const struct os_mgmt_task_info *info,
+                                    void *arg);
+typedef int os_mgmt_foreach_mpool_fn(const struct os_mgmt_mpool_info *info,
+                                     void *arg);
 
 /**
  * @brief Retrieves information about the specified task.  
  *
+ * Enumerating all tasks through this function is quadratic in the number of
+ * tasks on most OSes; os_mgmt_impl_foreach_task() should be preferred.
+ *
  * @param idx                   The index of the task to query.
  * @param out_info              On success, the requested information gets
  *                                  written here.
@@ -46,6 +55,39 @@ struct os_mgmt_task_info;
  */
 int os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info);
 
+/**
+ * @brief Applies a function to every task, walking the task list once.  The
+ *        default implementation is built on os_mgmt_impl_task_info(), so
+ *        ports which only provide that keep working.
+ *
+ * @param cb                    The callback to apply to each task.  A nonzero
+ *                                  return value stops the walk.
+ * @param arg                   An optional argument to pass to the callback.
+ *
+ * @return                      0 on success;
+ *                              The callback's return code if it stopped the
+ *                                  walk;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int os_mgmt_impl_foreach_task(os_mgmt_foreach_task_fn *cb, void *arg);
+
+/**
+ * @brief Applies a function to every memory pool the OS can enumerate.
+ *        Fields the OS does not track are set to OS_MGMT_MPOOL_UNKNOWN.
+ *
+ * @param cb                    The callback to apply to each pool.  A nonzero
+ *                                  return value stops the walk.
+ * @param arg                   An optional argument to pass to the callback.
+ *
+ * @return                      0 on success;
+ *                              The callback's return code if it stopped the
+ *                                  walk;
+ *                              MGMT_ERR_ENOTSUP if pools cannot be
+ *                                  enumerated;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int os_mgmt_impl_foreach_mpool(os_mgmt_foreach_mpool_fn *cb, void *arg);
+
 /**
  * @brief Schedules a near-immediate system reset.  There must be a slight
  * delay before the reset occurs to allow time for the mgmt response to be
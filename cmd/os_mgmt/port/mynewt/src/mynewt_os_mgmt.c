@@ -69,16 +69,10 @@ mynewt_os_mgmt_task_at(int idx)
     return task;
 }
 
-int
-os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
+static void
+mynewt_os_mgmt_fill_info(const struct os_task *task,
+                         struct os_mgmt_task_info *out_info)
 {
-    const struct os_task *task;
-
-    task = mynewt_os_mgmt_task_at(idx);
-    if (task == NULL) {
-        return MGMT_ERR_ENOENT;
-    }
-
     out_info->oti_prio = task->t_prio;
     out_info->oti_taskid = task->t_taskid;
     out_info->oti_state = task->t_state;
@@ -89,12 +83,75 @@ os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
     out_info->oti_last_checkin = task->t_sanity_check.sc_checkin_last;
     out_info->oti_next_checkin = task->t_sanity_check.sc_checkin_last +
                                  task->t_sanity_check.sc_checkin_itvl;
+    out_info->oti_stkage = 0;
     strncpy(out_info->oti_name, task->t_name, sizeof out_info->oti_name - 1);
     out_info->oti_name[sizeof out_info->oti_name - 1] = '\0';
+}
+
+int
+os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
+{
+    const struct os_task *task;
+
+    task = mynewt_os_mgmt_task_at(idx);
+    if (task == NULL) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    mynewt_os_mgmt_fill_info(task, out_info);
+    return 0;
+}
+
+int
+os_mgmt_impl_foreach_task(os_mgmt_foreach_task_fn *cb, void *arg)
+{
+    struct os_mgmt_task_info task_info;
+    const struct os_task *task;
+    int rc;
+
+    STAILQ_FOREACH(task, &g_os_task_list, t_os_task_list) {
+        mynewt_os_mgmt_fill_info(task, &task_info);
+
+        rc = cb(&task_info, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
 
     return 0;
 }
 
+int
+os_mgmt_impl_foreach_mpool(os_mgmt_foreach_mpool_fn *cb, void *arg)
+{
+    struct os_mgmt_mpool_info mpool_info;
+    struct os_mempool_info omi;
+    const struct os_mempool *mp;
+    int rc;
+
+    mp = NULL;
+    while (1) {
+        mp = os_mempool_info_get_next(mp, &omi);
+        if (mp == NULL) {
+            return 0;
+        }
+
+        mpool_info.omi_block_size = omi.omi_block_size;
+        mpool_info.omi_num_blocks = omi.omi_num_blocks;
+        mpool_info.omi_num_free = omi.omi_num_free;
+        mpool_info.omi_min_free = omi.omi_min_free;
+        mpool_info.omi_alloc_fail = OS_MGMT_MPOOL_UNKNOWN;
+        strncpy(mpool_info.omi_name, omi.omi_name,
+                sizeof mpool_info.omi_name - 1);
+        mpool_info.omi_name[sizeof mpool_info.omi_name - 1] = '\0';
+
+        rc = cb(&mpool_info, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+}
+
 int
 os_mgmt_impl_reset(unsigned int delay_ms)
 {
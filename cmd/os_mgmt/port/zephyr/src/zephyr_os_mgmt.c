@@ -21,10 +21,17 @@
 #include <power/reboot.h>
 #include <debug/object_tracing.h>
 #include <kernel_structs.h>
+#include <string.h>
 #include <mgmt/mgmt.h>
 #include <util/mcumgr_util.h>
 #include <os_mgmt/os_mgmt.h>
 #include <os_mgmt/os_mgmt_impl.h>
+#include <os_mgmt/os_mgmt_config.h>
+
+#if OS_MGMT_MPSTAT
+#include <net/buf.h>
+#include <sys/sys_heap.h>
+#endif
 
 static void zephyr_os_mgmt_reset_cb(struct k_timer *timer);
 static void zephyr_os_mgmt_reset_work_handler(struct k_work *work);
@@ -34,6 +41,204 @@ static K_TIMER_DEFINE(zephyr_os_mgmt_reset_timer,
 
 K_WORK_DEFINE(zephyr_os_mgmt_reset_work, zephyr_os_mgmt_reset_work_handler);
 
+#if OS_MGMT_STACK_SAMPLE_MS > 0
+/*
+ * Background stack high-water-mark sampler.  Scanning a stack for its
+ * untouched fill pattern is proportional to the stack size, so rather than
+ * doing it for every thread on each taskstat request, a timer periodically
+ * refreshes a cache of per-thread watermarks from the system workqueue.
+ *
+ * Stack usage only ever grows, so a refresh scans downward from the last
+ * known watermark and stops at the first run of intact fill bytes.  An
+ * untouched local buffer larger than that run could hide deeper usage, so
+ * every stack is rescanned in full once every few sweeps.
+ */
+
+/* Consecutive fill bytes which end an incremental scan. */
+#define ZEPHYR_OS_MGMT_STACK_GUARD      32
+
+/* Every this many sweeps, watermarks are recomputed from scratch. */
+#define ZEPHYR_OS_MGMT_STACK_FULL_ITVL  16
+
+struct zephyr_os_mgmt_stack_sample {
+    const struct k_thread *thread;
+    int64_t sampled_at;
+    size_t unused;
+    bool seen;
+};
+
+static struct zephyr_os_mgmt_stack_sample
+    zephyr_os_mgmt_stack_samples[OS_MGMT_STACK_SAMPLE_CNT];
+static unsigned int zephyr_os_mgmt_stack_sweeps;
+static bool zephyr_os_mgmt_stack_started;
+
+static K_MUTEX_DEFINE(zephyr_os_mgmt_stack_mtx);
+
+static void zephyr_os_mgmt_stack_cb(struct k_timer *timer);
+static void zephyr_os_mgmt_stack_work_handler(struct k_work *work);
+
+static K_TIMER_DEFINE(zephyr_os_mgmt_stack_timer,
+                      zephyr_os_mgmt_stack_cb, NULL);
+
+K_WORK_DEFINE(zephyr_os_mgmt_stack_work, zephyr_os_mgmt_stack_work_handler);
+
+static struct zephyr_os_mgmt_stack_sample *
+zephyr_os_mgmt_stack_find(const struct k_thread *thread)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(zephyr_os_mgmt_stack_samples); i++) {
+        if (zephyr_os_mgmt_stack_samples[i].thread == thread) {
+            return &zephyr_os_mgmt_stack_samples[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Lowers a thread's unused-stack figure to account for any growth below the
+ * previous watermark.
+ */
+static size_t
+zephyr_os_mgmt_stack_unused(const struct k_thread *thread, size_t unused)
+{
+    const uint8_t *start;
+    size_t run;
+    size_t i;
+
+    start = (const uint8_t *)thread->stack_info.start;
+    run = 0;
+    i = unused;
+    while (i > 0 && run < ZEPHYR_OS_MGMT_STACK_GUARD) {
+        i--;
+        if (start[i] == 0xaa) {
+            run++;
+        } else {
+            run = 0;
+            unused = i;
+        }
+    }
+
+    return unused;
+}
+
+static void
+zephyr_os_mgmt_stack_sweep(void)
+{
+    struct zephyr_os_mgmt_stack_sample *sample;
+    const struct k_thread *thread;
+    bool full;
+    size_t unused;
+    int i;
+
+    k_mutex_lock(&zephyr_os_mgmt_stack_mtx, K_FOREVER);
+
+    for (i = 0; i < ARRAY_SIZE(zephyr_os_mgmt_stack_samples); i++) {
+        zephyr_os_mgmt_stack_samples[i].seen = false;
+    }
+
+    full = zephyr_os_mgmt_stack_sweeps % ZEPHYR_OS_MGMT_STACK_FULL_ITVL == 0;
+    zephyr_os_mgmt_stack_sweeps++;
+
+    for (thread = SYS_THREAD_MONITOR_HEAD;
+         thread != NULL;
+         thread = SYS_THREAD_MONITOR_NEXT(thread)) {
+
+        sample = zephyr_os_mgmt_stack_find(thread);
+        if (sample == NULL) {
+            /* New thread; untracked if the cache is full. */
+            sample = zephyr_os_mgmt_stack_find(NULL);
+            if (sample == NULL) {
+                continue;
+            }
+            sample->thread = thread;
+            sample->unused = 0;
+            full = true;
+        }
+
+        if (full || sample->unused == 0) {
+            if (k_thread_stack_space_get(thread, &unused) != 0) {
+                unused = thread->stack_info.size;
+            }
+        } else {
+            unused = zephyr_os_mgmt_stack_unused(thread, sample->unused);
+        }
+
+        sample->unused = unused;
+        sample->sampled_at = k_uptime_get();
+        sample->seen = true;
+    }
+
+    /* Forget threads which have exited. */
+    for (i = 0; i < ARRAY_SIZE(zephyr_os_mgmt_stack_samples); i++) {
+        if (!zephyr_os_mgmt_stack_samples[i].seen) {
+            zephyr_os_mgmt_stack_samples[i].thread = NULL;
+        }
+    }
+
+    k_mutex_unlock(&zephyr_os_mgmt_stack_mtx);
+}
+
+static void
+zephyr_os_mgmt_stack_work_handler(struct k_work *work)
+{
+    zephyr_os_mgmt_stack_sweep();
+}
+
+static void
+zephyr_os_mgmt_stack_cb(struct k_timer *timer)
+{
+    k_work_submit(&zephyr_os_mgmt_stack_work);
+}
+
+/**
+ * Starts the sampler on first use.  The first sweep runs synchronously so
+ * that the request which started the sampler gets fresh figures.
+ */
+static void
+zephyr_os_mgmt_stack_start(void)
+{
+    if (!zephyr_os_mgmt_stack_started) {
+        zephyr_os_mgmt_stack_started = true;
+        zephyr_os_mgmt_stack_sweep();
+        k_timer_start(&zephyr_os_mgmt_stack_timer,
+                      K_MSEC(OS_MGMT_STACK_SAMPLE_MS),
+                      K_MSEC(OS_MGMT_STACK_SAMPLE_MS));
+    }
+}
+
+/**
+ * Fills in a thread's stack usage from the sampler's cache.
+ *
+ * @return                      0 on success; -ENOENT if the thread is not
+ *                                  tracked.
+ */
+static int
+zephyr_os_mgmt_stack_cached(const struct k_thread *thread,
+                            struct os_mgmt_task_info *out_info)
+{
+    const struct zephyr_os_mgmt_stack_sample *sample;
+    int rc;
+
+    k_mutex_lock(&zephyr_os_mgmt_stack_mtx, K_FOREVER);
+
+    sample = zephyr_os_mgmt_stack_find(thread);
+    if (sample == NULL) {
+        rc = -ENOENT;
+    } else {
+        out_info->oti_stkusage =
+            (thread->stack_info.size - sample->unused) / 4;
+        out_info->oti_stkage = k_uptime_get() - sample->sampled_at;
+        rc = 0;
+    }
+
+    k_mutex_unlock(&zephyr_os_mgmt_stack_mtx);
+
+    return rc;
+}
+#endif /* OS_MGMT_STACK_SAMPLE_MS > 0 */
+
 #ifdef CONFIG_THREAD_MONITOR
 static const struct k_thread *
 zephyr_os_mgmt_task_at(int idx)
@@ -52,19 +257,14 @@ zephyr_os_mgmt_task_at(int idx)
     return thread;
 }
 
-int
-os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
+static void
+zephyr_os_mgmt_fill_info(const struct k_thread *thread, int idx,
+                         struct os_mgmt_task_info *out_info)
 {
-    const struct k_thread *thread;
 #if defined(CONFIG_INIT_STACKS) && defined(CONFIG_THREAD_STACK_INFO)
     size_t unused;
 #endif
 
-    thread = zephyr_os_mgmt_task_at(idx);
-    if (thread == NULL) {
-        return MGMT_ERR_ENOENT;
-    }
-
     *out_info = (struct os_mgmt_task_info){ 0 };
 
 #ifdef CONFIG_THREAD_NAME
@@ -80,6 +280,11 @@ os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
 #ifdef CONFIG_THREAD_STACK_INFO
     out_info->oti_stksize = thread->stack_info.size / 4;
 #ifdef CONFIG_INIT_STACKS
+#if OS_MGMT_STACK_SAMPLE_MS > 0
+    if (zephyr_os_mgmt_stack_cached(thread, out_info) == 0) {
+        return;
+    }
+#endif
     if (k_thread_stack_space_get(thread, &unused) == 0) {
         out_info->oti_stkusage = (thread->stack_info.size - unused) / 4;
     } else {
@@ -87,11 +292,228 @@ os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
     }
 #endif
 #endif
+}
+
+int
+os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
+{
+    const struct k_thread *thread;
+
+    thread = zephyr_os_mgmt_task_at(idx);
+    if (thread == NULL) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    zephyr_os_mgmt_fill_info(thread, idx, out_info);
+    return 0;
+}
+
+int
+os_mgmt_impl_foreach_task(os_mgmt_foreach_task_fn *cb, void *arg)
+{
+    struct os_mgmt_task_info task_info;
+    const struct k_thread *thread;
+    int idx;
+    int rc;
+
+#if OS_MGMT_STACK_SAMPLE_MS > 0
+    zephyr_os_mgmt_stack_start();
+#endif
+
+    idx = 0;
+    for (thread = SYS_THREAD_MONITOR_HEAD;
+         thread != NULL;
+         thread = SYS_THREAD_MONITOR_NEXT(thread)) {
+
+        zephyr_os_mgmt_fill_info(thread, idx, &task_info);
+
+        rc = cb(&task_info, arg);
+        if (rc != 0) {
+            return rc;
+        }
+        idx++;
+    }
 
     return 0;
 }
 #endif /* CONFIG_THREAD_MONITOR */
 
+#if OS_MGMT_MPSTAT
+/*
+ * Memory pool statistics.  Slabs are found through object tracing and
+ * net_buf pools through their linker section; heaps have no registry, so
+ * the application registers the ones it wants reported.  The kernel keeps
+ * no count of failed allocations, and only some configurations keep
+ * watermarks; the fields it lacks are reported as unknown.
+ */
+
+struct zephyr_os_mgmt_heap {
+    const char *name;
+    struct sys_heap *heap;
+};
+
+static struct zephyr_os_mgmt_heap
+    zephyr_os_mgmt_heaps[OS_MGMT_MPSTAT_HEAP_CNT];
+
+/* Defined by the linker; the pools of NET_BUF_POOL_DEFINE(). */
+extern struct net_buf_pool _net_buf_pool_list[];
+extern struct net_buf_pool _net_buf_pool_list_end[];
+
+int
+os_mgmt_mpstat_register_heap(const char *name, struct sys_heap *heap)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(zephyr_os_mgmt_heaps); i++) {
+        if (zephyr_os_mgmt_heaps[i].heap == NULL) {
+            zephyr_os_mgmt_heaps[i].name = name;
+            zephyr_os_mgmt_heaps[i].heap = heap;
+            return 0;
+        }
+    }
+
+    return MGMT_ERR_ENOMEM;
+}
+
+static void
+zephyr_os_mgmt_mpool_init(struct os_mgmt_mpool_info *info, const char *name,
+                          const char *prefix, int idx)
+{
+    size_t len;
+
+    info->omi_block_size = OS_MGMT_MPOOL_UNKNOWN;
+    info->omi_num_blocks = OS_MGMT_MPOOL_UNKNOWN;
+    info->omi_num_free = OS_MGMT_MPOOL_UNKNOWN;
+    info->omi_min_free = OS_MGMT_MPOOL_UNKNOWN;
+    info->omi_alloc_fail = OS_MGMT_MPOOL_UNKNOWN;
+
+    if (name != NULL) {
+        strncpy(info->omi_name, name, sizeof info->omi_name - 1);
+        info->omi_name[sizeof info->omi_name - 1] = '\0';
+    } else {
+        /* Unnamed; identified by its index among pools of its kind. */
+        len = strlen(prefix);
+        memcpy(info->omi_name, prefix, len);
+        ll_to_s(idx, sizeof info->omi_name - len, info->omi_name + len);
+    }
+}
+
+#ifdef CONFIG_OBJECT_TRACING
+static int
+zephyr_os_mgmt_foreach_slab(os_mgmt_foreach_mpool_fn *cb, void *arg)
+{
+    struct os_mgmt_mpool_info info;
+    struct k_mem_slab *slab;
+    int idx;
+    int rc;
+
+    idx = 0;
+    for (slab = SYS_TRACING_HEAD(struct k_mem_slab, k_mem_slab);
+         slab != NULL;
+         slab = SYS_TRACING_NEXT(struct k_mem_slab, k_mem_slab, slab)) {
+
+        zephyr_os_mgmt_mpool_init(&info, NULL, "slab", idx++);
+        info.omi_block_size = slab->block_size;
+        info.omi_num_blocks = slab->num_blocks;
+        info.omi_num_free = slab->num_blocks - slab->num_used;
+#ifdef CONFIG_MEM_SLAB_TRACE_MAX_UTILIZATION
+        info.omi_min_free = slab->num_blocks - slab->max_used;
+#endif
+
+        rc = cb(&info, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+#endif
+
+static int
+zephyr_os_mgmt_foreach_net_buf_pool(os_mgmt_foreach_mpool_fn *cb, void *arg)
+{
+    struct os_mgmt_mpool_info info;
+    struct net_buf_pool *pool;
+    int rc;
+
+    for (pool = _net_buf_pool_list; pool < _net_buf_pool_list_end; pool++) {
+#ifdef CONFIG_NET_BUF_POOL_USAGE
+        zephyr_os_mgmt_mpool_init(&info, pool->name, NULL, 0);
+        info.omi_block_size = pool->pool_size / pool->buf_count;
+        info.omi_num_free = atomic_get(&pool->avail_count);
+#else
+        zephyr_os_mgmt_mpool_init(&info, NULL, "net_buf",
+                                  pool - _net_buf_pool_list);
+#endif
+        info.omi_num_blocks = pool->buf_count;
+
+        rc = cb(&info, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+static int
+zephyr_os_mgmt_foreach_heap(os_mgmt_foreach_mpool_fn *cb, void *arg)
+{
+#ifdef CONFIG_SYS_HEAP_RUNTIME_STATS
+    struct os_mgmt_mpool_info info;
+    struct sys_memory_stats stats;
+    size_t size;
+    int rc;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(zephyr_os_mgmt_heaps); i++) {
+        if (zephyr_os_mgmt_heaps[i].heap == NULL ||
+            sys_heap_runtime_stats_get(zephyr_os_mgmt_heaps[i].heap,
+                                       &stats) != 0) {
+            continue;
+        }
+
+        /* A heap is reported as a pool of single-byte blocks. */
+        size = stats.free_bytes + stats.allocated_bytes;
+        zephyr_os_mgmt_mpool_init(&info, zephyr_os_mgmt_heaps[i].name,
+                                  "heap", i);
+        info.omi_block_size = 1;
+        info.omi_num_blocks = size;
+        info.omi_num_free = stats.free_bytes;
+        info.omi_min_free = size - stats.max_allocated_bytes;
+
+        rc = cb(&info, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+int
+os_mgmt_impl_foreach_mpool(os_mgmt_foreach_mpool_fn *cb, void *arg)
+{
+    int rc;
+
+#ifdef CONFIG_OBJECT_TRACING
+    rc = zephyr_os_mgmt_foreach_slab(cb, arg);
+    if (rc != 0) {
+        return rc;
+    }
+#endif
+
+    rc = zephyr_os_mgmt_foreach_net_buf_pool(cb, arg);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return zephyr_os_mgmt_foreach_heap(cb, arg);
+}
+#endif /* OS_MGMT_MPSTAT */
+
 static void
 zephyr_os_mgmt_reset_work_handler(struct k_work *work)
 {
@@ -18,6 +18,8 @@
  */
 
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 
 #include "tinycbor/cbor.h"
@@ -27,6 +29,14 @@
 #include "os_mgmt/os_mgmt_impl.h"
 #include "os_mgmt/os_mgmt_config.h"
 
+#if OS_MGMT_SMP_TRACE || OS_MGMT_BENCH
+#include "smp/smp.h"
+#endif
+
+#if OS_MGMT_BENCH
+#include "util/mcumgr_cobs.h"
+#endif
+
 #if OS_MGMT_ECHO
 static mgmt_handler_fn os_mgmt_echo;
 #endif
@@ -37,30 +47,71 @@ static mgmt_handler_fn os_mgmt_reset;
 static mgmt_handler_fn os_mgmt_taskstat_read;
 #endif
 
+#if OS_MGMT_MPSTAT
+static mgmt_handler_fn os_mgmt_mpstat_read;
+#endif
+
+#if OS_MGMT_MCUMGR_PARAMS
+static mgmt_handler_fn os_mgmt_mcumgr_params;
+#endif
+
+#if OS_MGMT_SMP_TRACE
+static mgmt_handler_fn os_mgmt_smp_trace_read;
+#endif
+
+#if OS_MGMT_BENCH
+static mgmt_handler_fn os_mgmt_bench;
+#endif
+
 static const struct mgmt_handler os_mgmt_group_handlers[] = {
 #if OS_MGMT_ECHO
     [OS_MGMT_ID_ECHO] = {
-        os_mgmt_echo, os_mgmt_echo
+        os_mgmt_echo, os_mgmt_echo, MGMT_HANDLER_F_HIPRI
     },
 #endif
 #if OS_MGMT_TASKSTAT
     [OS_MGMT_ID_TASKSTAT] = {
         os_mgmt_taskstat_read, NULL
     },
+#endif
+#if OS_MGMT_MPSTAT
+    [OS_MGMT_ID_MPSTAT] = {
+        os_mgmt_mpstat_read, NULL
+    },
 #endif
     [OS_MGMT_ID_RESET] = {
-        NULL, os_mgmt_reset
+        NULL, os_mgmt_reset, MGMT_HANDLER_F_HIPRI
+    },
+#if OS_MGMT_MCUMGR_PARAMS
+    [OS_MGMT_ID_MCUMGR_PARAMS] = {
+        os_mgmt_mcumgr_params, NULL
     },
+#endif
+#if OS_MGMT_SMP_TRACE
+    [OS_MGMT_ID_SMP_TRACE] = {
+        os_mgmt_smp_trace_read, NULL
+    },
+#endif
+#if OS_MGMT_BENCH
+    [OS_MGMT_ID_BENCH] = {
+        os_mgmt_bench, os_mgmt_bench
+    },
+#endif
 };
 
 #define OS_MGMT_GROUP_SZ    \
     (sizeof os_mgmt_group_handlers / sizeof os_mgmt_group_handlers[0])
 
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE(os_mgmt_group, os_mgmt_group_handlers,
+                         MGMT_GROUP_ID_OS);
+#else
 static struct mgmt_group os_mgmt_group = {
     .mg_handlers = os_mgmt_group_handlers,
     .mg_handlers_count = OS_MGMT_GROUP_SZ,
     .mg_group_id = MGMT_GROUP_ID_OS,
 };
+#endif
 
 /**
  * Command handler: os echo
@@ -104,6 +155,35 @@ os_mgmt_echo(struct mgmt_ctxt *ctxt)
 #endif
 
 #if OS_MGMT_TASKSTAT
+/* Per-task fields of a taskstat response, in encoding order. */
+static const struct cbor_enc_attr_t os_mgmt_task_info_attrs[] = {
+    CBORATTR_ENC_FIELD("prio", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_prio),
+    CBORATTR_ENC_FIELD("tid", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_taskid),
+    CBORATTR_ENC_FIELD("state", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_state),
+    CBORATTR_ENC_FIELD("stkuse", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_stkusage),
+    CBORATTR_ENC_FIELD("stksiz", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_stksize),
+    CBORATTR_ENC_FIELD("cswcnt", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_cswcnt),
+    CBORATTR_ENC_FIELD("runtime", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_runtime),
+    CBORATTR_ENC_FIELD("last_checkin", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_last_checkin),
+    CBORATTR_ENC_FIELD("next_checkin", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_next_checkin),
+#if OS_MGMT_STACK_SAMPLE_MS > 0
+    CBORATTR_ENC_FIELD("stkage", CborAttrUnsignedIntegerType,
+                       struct os_mgmt_task_info, oti_stkage),
+#endif
+};
+
+#define OS_MGMT_TASK_INFO_ATTRS_COUNT \
+    (int)(sizeof os_mgmt_task_info_attrs / sizeof os_mgmt_task_info_attrs[0])
+
 /**
  * Encodes a single taskstat entry.
  */
@@ -116,25 +196,10 @@ os_mgmt_taskstat_encode_one(struct CborEncoder *encoder,
 
     err = 0;
     err |= cbor_encode_text_stringz(encoder, task_info->oti_name);
-    err |= cbor_encoder_create_map(encoder, &task_map, CborIndefiniteLength);
-    err |= cbor_encode_text_stringz(&task_map, "prio");
-    err |= cbor_encode_uint(&task_map, task_info->oti_prio);
-    err |= cbor_encode_text_stringz(&task_map, "tid");
-    err |= cbor_encode_uint(&task_map, task_info->oti_taskid);
-    err |= cbor_encode_text_stringz(&task_map, "state");
-    err |= cbor_encode_uint(&task_map, task_info->oti_state);
-    err |= cbor_encode_text_stringz(&task_map, "stkuse");
-    err |= cbor_encode_uint(&task_map, task_info->oti_stkusage);
-    err |= cbor_encode_text_stringz(&task_map, "stksiz");
-    err |= cbor_encode_uint(&task_map, task_info->oti_stksize);
-    err |= cbor_encode_text_stringz(&task_map, "cswcnt");
-    err |= cbor_encode_uint(&task_map, task_info->oti_cswcnt);
-    err |= cbor_encode_text_stringz(&task_map, "runtime");
-    err |= cbor_encode_uint(&task_map, task_info->oti_runtime);
-    err |= cbor_encode_text_stringz(&task_map, "last_checkin");
-    err |= cbor_encode_uint(&task_map, task_info->oti_last_checkin);
-    err |= cbor_encode_text_stringz(&task_map, "next_checkin");
-    err |= cbor_encode_uint(&task_map, task_info->oti_next_checkin);
+    err |= cbor_encoder_create_map(encoder, &task_map,
+                                   OS_MGMT_TASK_INFO_ATTRS_COUNT);
+    err |= cbor_write_struct(&task_map, os_mgmt_task_info_attrs,
+                             OS_MGMT_TASK_INFO_ATTRS_COUNT, task_info);
     err |= cbor_encoder_close_container(encoder, &task_map);
 
     if (err != 0) {
@@ -144,44 +209,182 @@ os_mgmt_taskstat_encode_one(struct CborEncoder *encoder,
     return 0;
 }
 
+struct os_mgmt_taskstat_arg {
+    struct CborEncoder *enc;
+    size_t count;
+};
+
+static int
+os_mgmt_taskstat_cb(const struct os_mgmt_task_info *task_info, void *arg)
+{
+    struct os_mgmt_taskstat_arg *ta;
+    int rc;
+
+    ta = arg;
+
+    rc = os_mgmt_taskstat_encode_one(ta->enc, task_info);
+    if (rc == 0) {
+        ta->count++;
+    }
+
+    return rc;
+}
+
 /**
  * Command handler: os taskstat
  */
 static int
 os_mgmt_taskstat_read(struct mgmt_ctxt *ctxt)
 {
-    struct os_mgmt_task_info task_info;
-    struct CborEncoder tasks_map;
+    struct os_mgmt_taskstat_arg ta;
+    struct mgmt_counted tasks_map;
     CborError err;
-    int task_idx;
     int rc;
 
-    err = 0;
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "tasks");
-    err |= cbor_encoder_create_map(&ctxt->encoder, &tasks_map,
-                                   CborIndefiniteLength);
+    err = cbor_encode_text_stringz(&ctxt->encoder, "tasks");
     if (err != 0) {
         return MGMT_ERR_ENOMEM;
     }
 
+    /* The task count is patched into the map header afterwards. */
+    rc = mgmt_open_counted_map(ctxt, &ctxt->encoder, &tasks_map);
+    if (rc != 0) {
+        return rc;
+    }
+
     /* Iterate the list of tasks, encoding each. */
-    for (task_idx = 0; ; task_idx++) {
-        rc = os_mgmt_impl_task_info(task_idx, &task_info);
-        if (rc == MGMT_ERR_ENOENT) {
-            /* No more tasks to encode. */
-            break;
-        } else if (rc != 0) {
-            return rc;
+    ta.enc = &tasks_map.encoder;
+    ta.count = 0;
+    rc = os_mgmt_impl_foreach_task(os_mgmt_taskstat_cb, &ta);
+    if (rc != 0) {
+        mgmt_close_counted(ctxt, &ctxt->encoder, &tasks_map, ta.count);
+        return rc;
+    }
+
+    return mgmt_close_counted(ctxt, &ctxt->encoder, &tasks_map, ta.count);
+}
+#endif
+
+#if OS_MGMT_MPSTAT
+struct os_mgmt_mpstat_field {
+    const char *key;
+    size_t off;
+};
+
+/* Per-pool fields of an mpstat response, in encoding order. */
+static const struct os_mgmt_mpstat_field os_mgmt_mpstat_fields[] = {
+    { "blksiz", offsetof(struct os_mgmt_mpool_info, omi_block_size) },
+    { "nblks", offsetof(struct os_mgmt_mpool_info, omi_num_blocks) },
+    { "nfree", offsetof(struct os_mgmt_mpool_info, omi_num_free) },
+    { "min", offsetof(struct os_mgmt_mpool_info, omi_min_free) },
+    { "fail", offsetof(struct os_mgmt_mpool_info, omi_alloc_fail) },
+};
+
+#define OS_MGMT_MPSTAT_FIELD_COUNT \
+    (sizeof os_mgmt_mpstat_fields / sizeof os_mgmt_mpstat_fields[0])
+
+struct os_mgmt_mpstat_arg {
+    struct CborEncoder *enc;
+    size_t count;
+};
+
+static uint32_t
+os_mgmt_mpstat_field_val(const struct os_mgmt_mpool_info *info, size_t i)
+{
+    uint32_t val;
+
+    memcpy(&val, (const uint8_t *)info + os_mgmt_mpstat_fields[i].off,
+           sizeof val);
+    return val;
+}
+
+/**
+ * Encodes a single mpstat entry, leaving out the fields the OS does not
+ * track.
+ */
+static int
+os_mgmt_mpstat_cb(const struct os_mgmt_mpool_info *info, void *arg)
+{
+    struct os_mgmt_mpstat_arg *ma;
+    CborEncoder pool_map;
+    CborError err;
+    uint32_t val;
+    size_t count;
+    size_t i;
+
+    ma = arg;
+
+    count = 0;
+    for (i = 0; i < OS_MGMT_MPSTAT_FIELD_COUNT; i++) {
+        if (os_mgmt_mpstat_field_val(info, i) != OS_MGMT_MPOOL_UNKNOWN) {
+            count++;
         }
+    }
 
-        rc = os_mgmt_taskstat_encode_one(&tasks_map, &task_info);
-        if (rc != 0) {
-            cbor_encoder_close_container(&ctxt->encoder, &tasks_map);
-            return rc;
+    err = 0;
+    err |= cbor_encode_text_stringz(ma->enc, info->omi_name);
+    err |= cbor_encoder_create_map(ma->enc, &pool_map, count);
+    for (i = 0; i < OS_MGMT_MPSTAT_FIELD_COUNT; i++) {
+        val = os_mgmt_mpstat_field_val(info, i);
+        if (val != OS_MGMT_MPOOL_UNKNOWN) {
+            err |= cbor_encode_text_stringz(&pool_map,
+                                            os_mgmt_mpstat_fields[i].key);
+            err |= cbor_encode_uint(&pool_map, val);
         }
     }
+    err |= cbor_encoder_close_container(ma->enc, &pool_map);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    ma->count++;
+    return 0;
+}
+
+/**
+ * Command handler: os mpstat
+ *
+ * Also reports "rsp_fail", the number of response buffers the transports
+ * could not allocate; a nonzero value means some pool feeding them is too
+ * small.
+ */
+static int
+os_mgmt_mpstat_read(struct mgmt_ctxt *ctxt)
+{
+    struct os_mgmt_mpstat_arg ma;
+    struct mgmt_counted pools_map;
+    CborError err;
+    int rc;
+
+    err = cbor_encode_text_stringz(&ctxt->encoder, "mpools");
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    /* The pool count is patched into the map header afterwards. */
+    rc = mgmt_open_counted_map(ctxt, &ctxt->encoder, &pools_map);
+    if (rc != 0) {
+        return rc;
+    }
+
+    ma.enc = &pools_map.encoder;
+    ma.count = 0;
+    rc = os_mgmt_impl_foreach_mpool(os_mgmt_mpstat_cb, &ma);
+    if (rc != 0) {
+        mgmt_close_counted(ctxt, &ctxt->encoder, &pools_map, ma.count);
+        return rc;
+    }
+
+    rc = mgmt_close_counted(ctxt, &ctxt->encoder, &pools_map, ma.count);
+    if (rc != 0) {
+        return rc;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rsp_fail");
+    err |= cbor_encode_uint(&ctxt->encoder, mgmt_alloc_rsp_failures());
 
-    err = cbor_encoder_close_container(&ctxt->encoder, &tasks_map);
     if (err != 0) {
         return MGMT_ERR_ENOMEM;
     }
@@ -199,10 +402,345 @@ os_mgmt_reset(struct mgmt_ctxt *ctxt)
     return os_mgmt_impl_reset(OS_MGMT_RESET_MS);
 }
 
+#if OS_MGMT_MCUMGR_PARAMS
+/**
+ * Command handler: os mcumgr_params
+ *
+ * Reports the buffer size and count of the transport the request came in on,
+ * falling back to the configured defaults for whatever the transport does not
+ * supply.
+ */
+static int
+os_mgmt_mcumgr_params(struct mgmt_ctxt *ctxt)
+{
+    uint32_t buf_count;
+    uint32_t buf_size;
+    CborError err;
+
+    buf_size = OS_MGMT_MCUMGR_BUF_SIZE;
+    buf_count = OS_MGMT_MCUMGR_BUF_COUNT;
+    if (ctxt->streamer != NULL) {
+        if (ctxt->streamer->mtu != 0) {
+            buf_size = ctxt->streamer->mtu;
+        }
+        if (ctxt->streamer->buf_count != 0) {
+            buf_count = ctxt->streamer->buf_count;
+        }
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "buf_size");
+    err |= cbor_encode_uint(&ctxt->encoder, buf_size);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "buf_count");
+    err |= cbor_encode_uint(&ctxt->encoder, buf_count);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+#endif
+
+#if OS_MGMT_SMP_TRACE
+/* Most entries sent in one smp_trace response. */
+#define OS_MGMT_SMP_TRACE_RSP_MAX       16
+
+/* Response bytes besides the entries: "first", "head", and the "t" key and
+ * byte string header.
+ */
+#define OS_MGMT_SMP_TRACE_RSP_OVERHEAD  32
+
+static const struct smp_trace *os_mgmt_smp_trace;
+
+static uint8_t *
+os_mgmt_smp_trace_put(uint8_t *dst, uint32_t val, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        *dst++ = val >> (8 * i);
+    }
+
+    return dst;
+}
+
+static void
+os_mgmt_smp_trace_pack(uint8_t *dst, const struct smp_trace_entry *te)
+{
+    dst = os_mgmt_smp_trace_put(dst, te->timestamp, 4);
+    dst = os_mgmt_smp_trace_put(dst, te->group, 2);
+    dst = os_mgmt_smp_trace_put(dst, te->id, 1);
+    dst = os_mgmt_smp_trace_put(dst, te->seq, 1);
+    dst = os_mgmt_smp_trace_put(dst, te->req_len, 2);
+    dst = os_mgmt_smp_trace_put(dst, te->rsp_len, 2);
+    dst = os_mgmt_smp_trace_put(dst, te->rc, 1);
+    dst = os_mgmt_smp_trace_put(dst, te->flags, 1);
+    dst = os_mgmt_smp_trace_put(dst, te->handler_ticks, 4);
+    os_mgmt_smp_trace_put(dst, te->alloc_ticks, 4);
+}
+
+/**
+ * Command handler: os smp_trace
+ *
+ * Entries overwritten before they are read are skipped; "first" tells the
+ * client how many were lost.
+ */
+static int
+os_mgmt_smp_trace_read(struct mgmt_ctxt *ctxt)
+{
+    uint8_t buf[OS_MGMT_SMP_TRACE_RSP_MAX * OS_MGMT_SMP_TRACE_ENTRY_SIZE];
+    struct smp_trace_entry te;
+    unsigned long long since;
+    uint32_t first;
+    uint32_t head;
+    uint32_t idx;
+    size_t max;
+    size_t len;
+    CborError err;
+
+    const struct cbor_attr_t attrs[2] = {
+        [0] = {
+            .attribute = "since",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &since,
+        },
+        [1] = {
+            .attribute = NULL
+        }
+    };
+
+    if (os_mgmt_smp_trace == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    since = 0;
+    err = cbor_read_object(&ctxt->it, attrs);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    max = mgmt_rsp_chunk_size(ctxt, OS_MGMT_SMP_TRACE_RSP_OVERHEAD,
+                              sizeof buf);
+    max -= max % OS_MGMT_SMP_TRACE_ENTRY_SIZE;
+
+    head = __atomic_load_n(&os_mgmt_smp_trace->head, __ATOMIC_ACQUIRE);
+    first = since;
+    if (since > head) {
+        first = head;
+    } else if (head - first > os_mgmt_smp_trace->entry_count) {
+        first = head - os_mgmt_smp_trace->entry_count;
+    }
+
+    len = 0;
+    for (idx = first; idx != head && len < max; idx++) {
+        if (smp_trace_get(os_mgmt_smp_trace, idx, &te) != 0) {
+            /* Overwritten while being read; restart past it. */
+            first = idx + 1;
+            len = 0;
+            continue;
+        }
+        os_mgmt_smp_trace_pack(buf + len, &te);
+        len += OS_MGMT_SMP_TRACE_ENTRY_SIZE;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "first");
+    err |= cbor_encode_uint(&ctxt->encoder, first);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "head");
+    err |= cbor_encode_uint(&ctxt->encoder, head);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "t");
+    err |= cbor_encode_byte_string(&ctxt->encoder, buf, len);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+void
+os_mgmt_register_smp_trace(const struct smp_trace *trace)
+{
+    os_mgmt_smp_trace = trace;
+}
+#endif
+
+#if OS_MGMT_BENCH
+/* Most responses generated for one bench request. */
+#define OS_MGMT_BENCH_COUNT_MAX         256
+
+/* Response bytes besides the payload: "seq", the timing and upload fields,
+ * and the "d" key and byte string header.
+ */
+#define OS_MGMT_BENCH_RSP_OVERHEAD      64
+
+/* Generated payload; byte i holds i mod 256. */
+static uint8_t os_mgmt_bench_buf[OS_MGMT_BENCH_MAX_LEN];
+static bool os_mgmt_bench_buf_ready;
+
+static int
+os_mgmt_bench_crc(const uint8_t *data, size_t off, size_t len, void *arg)
+{
+    uint16_t *crc;
+
+    crc = arg;
+    *crc = mcumgr_crc16(*crc, data, len);
+
+    return 0;
+}
+
+/**
+ * Encodes the server-side timing of the request: "rx", the ticks from the
+ * arrival of the header to the start of the handler, "hdl", the ticks spent
+ * in the handler so far, and "tx", the duration of the latest transmit
+ * callback.  Omitted if the streamer has no trace clock.
+ */
+static CborError
+os_mgmt_bench_timing(struct mgmt_ctxt *ctxt, bool first)
+{
+    struct smp_streamer *ss;
+    CborError err;
+    uint32_t now;
+
+    ss = smp_ctxt_streamer(ctxt);
+    if (ss == NULL || ss->trace == NULL) {
+        return 0;
+    }
+
+    now = ss->trace->clock_cb();
+
+    err = 0;
+    if (first) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "rx");
+        err |= cbor_encode_uint(&ctxt->encoder,
+                                ss->timing.dispatch_ts - ss->timing.rx_ts);
+    }
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "hdl");
+    err |= cbor_encode_uint(&ctxt->encoder, now - ss->timing.dispatch_ts);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "tx");
+    err |= cbor_encode_uint(&ctxt->encoder, ss->timing.tx_ticks);
+
+    return err;
+}
+
+/**
+ * Command handler: os bench
+ *
+ * Measures the link without touching flash.  An uploaded "d" is checksummed
+ * and discarded; "n" responses of up to "len" generated bytes each are sent
+ * back.  Each carries the server's timing so that clients can tell link time
+ * from processing time.
+ */
+static int
+os_mgmt_bench(struct mgmt_ctxt *ctxt)
+{
+    uint8_t stage[64];
+    struct cbor_bytestring_ref data;
+    unsigned long long count;
+    unsigned long long len;
+    uint16_t crc;
+    size_t max;
+    CborError err;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t attrs[4] = {
+        [0] = {
+            .attribute = "n",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &count,
+        },
+        [1] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &len,
+        },
+        [2] = {
+            .attribute = "d",
+            .type = CborAttrByteStringRefType,
+            .addr.bytestring_ref = &data,
+            .len = SIZE_MAX,
+        },
+        [3] = {
+            .attribute = NULL
+        }
+    };
+
+    count = 1;
+    len = 0;
+    memset(&data, 0, sizeof data);
+
+    err = cbor_read_object(&ctxt->it, attrs);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (count == 0 || count > OS_MGMT_BENCH_COUNT_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (count > 1 && ctxt->flush_cb == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    crc = 0;
+    if (data.len > 0) {
+        rc = cbor_bytestring_ref_foreach(&data, stage, sizeof stage,
+                                         os_mgmt_bench_crc, &crc);
+        if (rc != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+    }
+
+    if (!os_mgmt_bench_buf_ready) {
+        for (i = 0; i < OS_MGMT_BENCH_MAX_LEN; i++) {
+            os_mgmt_bench_buf[i] = i;
+        }
+        os_mgmt_bench_buf_ready = true;
+    }
+
+    max = mgmt_rsp_chunk_size(ctxt, OS_MGMT_BENCH_RSP_OVERHEAD,
+                              OS_MGMT_BENCH_MAX_LEN);
+    if (len < max) {
+        max = len;
+    }
+
+    for (i = 0; i < (int)count; i++) {
+        if (i > 0) {
+            rc = mgmt_flush_rsp(ctxt);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+
+        err = 0;
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "seq");
+        err |= cbor_encode_uint(&ctxt->encoder, i);
+        if (i == 0) {
+            err |= cbor_encode_text_stringz(&ctxt->encoder, "rlen");
+            err |= cbor_encode_uint(&ctxt->encoder, data.len);
+            err |= cbor_encode_text_stringz(&ctxt->encoder, "crc");
+            err |= cbor_encode_uint(&ctxt->encoder, crc);
+        }
+        err |= os_mgmt_bench_timing(ctxt, i == 0);
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "d");
+        err |= cbor_encode_byte_string(&ctxt->encoder, os_mgmt_bench_buf,
+                                       max);
+        if (err != 0) {
+            return MGMT_ERR_ENOMEM;
+        }
+    }
+
+    return 0;
+}
+#endif
+
 void
 os_mgmt_register_group(void)
 {
+#if !MGMT_STATIC_GROUPS
     mgmt_register_group(&os_mgmt_group);
+#endif
 }
 
 void
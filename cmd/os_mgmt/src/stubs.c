@@ -23,6 +23,7 @@
  */
 
 #include "mgmt/mgmt.h"
+#include "os_mgmt/os_mgmt.h"
 #include "os_mgmt/os_mgmt_impl.h"
 
 int __attribute__((weak))
@@ -31,6 +32,34 @@ os_mgmt_impl_task_info(int idx, struct os_mgmt_task_info *out_info)
     return MGMT_ERR_ENOTSUP;
 }
 
+int __attribute__((weak))
+os_mgmt_impl_foreach_task(os_mgmt_foreach_task_fn *cb, void *arg)
+{
+    struct os_mgmt_task_info task_info;
+    int task_idx;
+    int rc;
+
+    for (task_idx = 0; ; task_idx++) {
+        rc = os_mgmt_impl_task_info(task_idx, &task_info);
+        if (rc == MGMT_ERR_ENOENT) {
+            return 0;
+        } else if (rc != 0) {
+            return rc;
+        }
+
+        rc = cb(&task_info, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+}
+
+int __attribute__((weak))
+os_mgmt_impl_foreach_mpool(os_mgmt_foreach_mpool_fn *cb, void *arg)
+{
+    return MGMT_ERR_ENOTSUP;
+}
+
 int __attribute__((weak))
 os_mgmt_impl_reset(unsigned int delay_ms)
 {
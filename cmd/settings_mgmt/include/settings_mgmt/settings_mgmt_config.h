@@ -0,0 +1,68 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_SETTINGS_MGMT_CONFIG_
+#define H_SETTINGS_MGMT_CONFIG_
+
+#if defined MYNEWT
+
+#include "syscfg/syscfg.h"
+
+#define SETTINGS_MGMT_NAME_LEN      MYNEWT_VAL(SETTINGS_MGMT_NAME_LEN)
+#define SETTINGS_MGMT_VAL_LEN       MYNEWT_VAL(SETTINGS_MGMT_VAL_LEN)
+#define SETTINGS_MGMT_MAX_RSP_LEN   MYNEWT_VAL(SETTINGS_MGMT_MAX_RSP_LEN)
+
+/* Config values are strings. */
+#define SETTINGS_MGMT_VAL_TEXT      1
+
+#elif defined __ZEPHYR__
+
+/* Longest setting name, including the terminator. */
+#ifdef CONFIG_SETTINGS_MGMT_NAME_LEN
+#define SETTINGS_MGMT_NAME_LEN      CONFIG_SETTINGS_MGMT_NAME_LEN
+#else
+#define SETTINGS_MGMT_NAME_LEN      64
+#endif
+
+/* Longest setting value. */
+#ifdef CONFIG_SETTINGS_MGMT_VAL_LEN
+#define SETTINGS_MGMT_VAL_LEN       CONFIG_SETTINGS_MGMT_VAL_LEN
+#else
+#define SETTINGS_MGMT_VAL_LEN       64
+#endif
+
+/* Size at which a list response gets split. */
+#ifdef CONFIG_SETTINGS_MGMT_MAX_RSP_LEN
+#define SETTINGS_MGMT_MAX_RSP_LEN   CONFIG_SETTINGS_MGMT_MAX_RSP_LEN
+#else
+#define SETTINGS_MGMT_MAX_RSP_LEN   CONFIG_MCUMGR_BUF_SIZE
+#endif
+
+/* Settings values are binary. */
+#define SETTINGS_MGMT_VAL_TEXT      0
+
+#else
+
+/* No direct support for this OS.  The application needs to define the above
+ * settings itself.
+ */
+
+#endif
+
+#endif
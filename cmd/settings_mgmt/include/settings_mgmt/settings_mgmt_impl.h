@@ -0,0 +1,113 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Declares implementation-specific functions required by settings
+ *        management.  The default stubs can be overridden with functions that
+ *        are compatible with the host OS.
+ */
+
+#ifndef H_SETTINGS_MGMT_IMPL_
+#define H_SETTINGS_MGMT_IMPL_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Function applied to each setting by settings_mgmt_impl_foreach().
+ *
+ * @param name                  The full name of the setting.
+ * @param val                   The setting's value.
+ * @param len                   The length of the value, in bytes.
+ * @param arg                   The argument passed to
+ *                                  settings_mgmt_impl_foreach().
+ *
+ * @return                      0 to continue the walk; nonzero to stop it.
+ */
+typedef int settings_mgmt_foreach_fn(const char *name, const void *val,
+                                     size_t len, void *arg);
+
+/**
+ * @brief Reads the current value of a setting.
+ *
+ * @param name                  The name of the setting.
+ * @param buf                   The buffer to read the value into.
+ * @param len                   On input, the size of the buffer.  On
+ *                                  success, the length of the value.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOENT if there is no such setting;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int settings_mgmt_impl_get(const char *name, void *buf, size_t *len);
+
+/**
+ * @brief Sets a setting in memory.  The new value takes effect with the next
+ *        call to settings_mgmt_impl_commit(), and is persisted with the next
+ *        call to settings_mgmt_impl_save().
+ *
+ * @param name                  The name of the setting.
+ * @param val                   The value, followed by a terminator that is
+ *                                  not counted in len.
+ * @param len                   The length of the value, in bytes.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOENT if there is no such setting;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int settings_mgmt_impl_set(const char *name, const void *val, size_t len);
+
+/**
+ * @brief Lets the settings' owners apply the values set since the last
+ *        commit.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int settings_mgmt_impl_commit(void);
+
+/**
+ * @brief Writes the current values of all settings to persistent storage.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int settings_mgmt_impl_save(void);
+
+/**
+ * @brief Applies a function to every setting whose name starts with the
+ *        specified prefix, in the same order on every call as long as no
+ *        setting is added or removed.
+ *
+ * @param prefix                The name prefix; "" for all settings.
+ * @param cb                    The function to apply.
+ * @param arg                   Optional argument passed to the function.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int settings_mgmt_impl_foreach(const char *prefix, settings_mgmt_foreach_fn *cb,
+                               void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,182 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "os/mynewt.h"
+#include "config/config.h"
+#include "mgmt/mgmt.h"
+#include "settings_mgmt/settings_mgmt.h"
+#include "settings_mgmt/settings_mgmt_impl.h"
+#include "settings_mgmt/settings_mgmt_config.h"
+
+/* State of a settings_mgmt_impl_foreach() walk; conf_export() passes no
+ * argument to its callback.
+ */
+static struct {
+    const char *prefix;
+    size_t prefix_len;
+    settings_mgmt_foreach_fn *cb;
+    void *arg;
+    bool done;
+} mynewt_settings_mgmt_walk;
+
+/**
+ * Copies a setting name into a writable buffer; sys/config splits names in
+ * place.
+ */
+static int
+mynewt_settings_mgmt_name(const char *name, char *buf)
+{
+    size_t len;
+
+    len = strlen(name);
+    if (len >= SETTINGS_MGMT_NAME_LEN) {
+        return MGMT_ERR_EINVAL;
+    }
+    memcpy(buf, name, len + 1);
+
+    return 0;
+}
+
+int
+settings_mgmt_impl_get(const char *name, void *buf, size_t *len)
+{
+    char name_buf[SETTINGS_MGMT_NAME_LEN];
+    char *val;
+    size_t val_len;
+    int rc;
+
+    rc = mynewt_settings_mgmt_name(name, name_buf);
+    if (rc != 0) {
+        return rc;
+    }
+
+    val = conf_get_value(name_buf, buf, *len);
+    if (val == NULL) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    /* The value may be returned in the handler's own storage. */
+    val_len = strlen(val);
+    if (val_len > *len) {
+        return MGMT_ERR_EMSGSIZE;
+    }
+    if (val != buf) {
+        memcpy(buf, val, val_len);
+    }
+
+    *len = val_len;
+    return 0;
+}
+
+int
+settings_mgmt_impl_set(const char *name, const void *val, size_t len)
+{
+    char name_buf[SETTINGS_MGMT_NAME_LEN];
+    int rc;
+
+    rc = mynewt_settings_mgmt_name(name, name_buf);
+    if (rc != 0) {
+        return rc;
+    }
+
+    /* val is terminated.  sys/config does not modify it. */
+    /* OS_INVALID_PARM indicates that no handler owns the name; other errors
+     * come from the handler rejecting the value.
+     */
+    rc = conf_set_value(name_buf, (char *)val);
+    if (rc == OS_INVALID_PARM) {
+        return MGMT_ERR_ENOENT;
+    }
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    return 0;
+}
+
+int
+settings_mgmt_impl_commit(void)
+{
+    if (conf_commit(NULL) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+settings_mgmt_impl_save(void)
+{
+    if (conf_save() != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+static void
+mynewt_settings_mgmt_export_cb(char *name, char *val)
+{
+    if (mynewt_settings_mgmt_walk.done ||
+        strncmp(name, mynewt_settings_mgmt_walk.prefix,
+                mynewt_settings_mgmt_walk.prefix_len) != 0) {
+
+        return;
+    }
+
+    if (val == NULL) {
+        val = "";
+    }
+
+    if (mynewt_settings_mgmt_walk.cb(name, val, strlen(val),
+                                     mynewt_settings_mgmt_walk.arg) != 0) {
+        mynewt_settings_mgmt_walk.done = true;
+    }
+}
+
+int
+settings_mgmt_impl_foreach(const char *prefix, settings_mgmt_foreach_fn *cb,
+                           void *arg)
+{
+    int rc;
+
+    mynewt_settings_mgmt_walk.prefix = prefix;
+    mynewt_settings_mgmt_walk.prefix_len = strlen(prefix);
+    mynewt_settings_mgmt_walk.cb = cb;
+    mynewt_settings_mgmt_walk.arg = arg;
+    mynewt_settings_mgmt_walk.done = false;
+
+    rc = conf_export(mynewt_settings_mgmt_export_cb, CONF_EXPORT_SHOW);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+void
+settings_mgmt_module_init(void)
+{
+    /* Ensure this function only gets called by sysinit. */
+    SYSINIT_ASSERT_ACTIVE();
+
+    settings_mgmt_register_group();
+}
@@ -0,0 +1,160 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#include <zephyr.h>
+#include <settings/settings.h>
+#include <mgmt/mgmt.h>
+#include <settings_mgmt/settings_mgmt.h>
+#include <settings_mgmt/settings_mgmt_impl.h>
+#include <settings_mgmt/settings_mgmt_config.h>
+
+/** State of a settings_mgmt_impl_foreach() walk. */
+struct zephyr_settings_mgmt_walk {
+    const char *prefix;
+    settings_mgmt_foreach_fn *cb;
+    void *arg;
+    bool done;
+    int rc;
+};
+
+int
+settings_mgmt_impl_get(const char *name, void *buf, size_t *len)
+{
+    int rc;
+
+    rc = settings_runtime_get(name, buf, *len);
+    if (rc < 0) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    *len = rc;
+    return 0;
+}
+
+int
+settings_mgmt_impl_set(const char *name, const void *val, size_t len)
+{
+    int rc;
+
+    rc = settings_runtime_set(name, val, len);
+    if (rc == -EINVAL) {
+        /* No handler owns the name. */
+        return MGMT_ERR_ENOENT;
+    }
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    return 0;
+}
+
+int
+settings_mgmt_impl_commit(void)
+{
+    if (settings_commit() != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+int
+settings_mgmt_impl_save(void)
+{
+    if (settings_save() != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+/**
+ * Passes a stored setting of the walked subtree to the walk's callback.  The
+ * key is relative to the subtree, so the full name is rebuilt first.
+ */
+static int
+zephyr_settings_mgmt_load_cb(const char *key, size_t len,
+                             settings_read_cb read_cb, void *cb_arg,
+                             void *param)
+{
+    struct zephyr_settings_mgmt_walk *walk;
+    char name[SETTINGS_MGMT_NAME_LEN];
+    uint8_t val[SETTINGS_MGMT_VAL_LEN];
+    ssize_t val_len;
+    int name_len;
+
+    walk = param;
+    if (walk->done) {
+        return 0;
+    }
+
+    if (key == NULL) {
+        name_len = snprintf(name, sizeof name, "%s", walk->prefix);
+    } else if (walk->prefix[0] == '\0') {
+        name_len = snprintf(name, sizeof name, "%s", key);
+    } else {
+        name_len = snprintf(name, sizeof name, "%s/%s", walk->prefix, key);
+    }
+    if (name_len < 0 || name_len >= sizeof name || len > sizeof val) {
+        /* Cannot be represented; skip it. */
+        return 0;
+    }
+
+    val_len = read_cb(cb_arg, val, len);
+    if (val_len < 0) {
+        walk->rc = MGMT_ERR_EUNKNOWN;
+        walk->done = true;
+        return 0;
+    }
+
+    if (walk->cb(name, val, val_len, walk->arg) != 0) {
+        walk->done = true;
+    }
+
+    return 0;
+}
+
+/* Stored values are walked, since the settings subsystem cannot enumerate
+ * runtime ones; they differ only while a batch is set but not saved.
+ */
+int
+settings_mgmt_impl_foreach(const char *prefix, settings_mgmt_foreach_fn *cb,
+                           void *arg)
+{
+    struct zephyr_settings_mgmt_walk walk;
+    int rc;
+
+    walk = (struct zephyr_settings_mgmt_walk) {
+        .prefix = prefix,
+        .cb = cb,
+        .arg = arg,
+    };
+
+    rc = settings_load_subtree_direct(prefix[0] == '\0' ? NULL : prefix,
+                                      zephyr_settings_mgmt_load_cb, &walk);
+    if (rc != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return walk.rc;
+}
@@ -0,0 +1,482 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "mgmt/mgmt.h"
+#include "cborattr/cborattr.h"
+#include "settings_mgmt/settings_mgmt.h"
+#include "settings_mgmt/settings_mgmt_impl.h"
+#include "settings_mgmt/settings_mgmt_config.h"
+
+/* Worst-case size of a list response around its settings: "vals", "rc",
+ * "next" and "more".
+ */
+#define SETTINGS_MGMT_LIST_RSP_OVERHEAD 32
+
+/* Worst-case size of a setting's name and value headers in a list
+ * response.
+ */
+#define SETTINGS_MGMT_LIST_ENTRY_OVERHEAD   6
+
+static mgmt_handler_fn settings_mgmt_val_read;
+static mgmt_handler_fn settings_mgmt_val_write;
+static mgmt_handler_fn settings_mgmt_list;
+
+static const struct mgmt_handler settings_mgmt_handlers[] = {
+    [SETTINGS_MGMT_ID_VAL] = {
+        .mh_read = settings_mgmt_val_read,
+        .mh_write = settings_mgmt_val_write,
+    },
+    [SETTINGS_MGMT_ID_LIST] = {
+        .mh_read = settings_mgmt_list,
+        .mh_write = NULL,
+    },
+};
+
+#define SETTINGS_MGMT_HANDLER_CNT \
+    sizeof settings_mgmt_handlers / sizeof settings_mgmt_handlers[0]
+
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE(settings_mgmt_group, settings_mgmt_handlers,
+                         MGMT_GROUP_ID_CONFIG);
+#else
+static struct mgmt_group settings_mgmt_group = {
+    .mg_handlers = settings_mgmt_handlers,
+    .mg_handlers_count = SETTINGS_MGMT_HANDLER_CNT,
+    .mg_group_id = MGMT_GROUP_ID_CONFIG,
+};
+#endif
+
+/** State of a list response that may be split across several packets. */
+struct settings_mgmt_list_ctxt {
+    struct mgmt_ctxt *mc;
+    /* The "vals" map in the root map. */
+    CborEncoder vals;
+    /* Settings before this one have been sent in earlier requests. */
+    uint32_t skip;
+    /* Index of the setting being walked. */
+    uint32_t idx;
+    /* Number of settings in the current response. */
+    uint32_t count;
+    /* Size at which the response gets split. */
+    size_t max_len;
+    /* Whether the client accepts multiple responses. */
+    bool stream;
+    /* Whether the walk stopped at a setting that did not fit. */
+    bool full;
+    /* Nonzero if encoding or sending a response failed. */
+    int rc;
+};
+
+/**
+ * Encodes a setting's value in the form of the platform's settings: a text
+ * string if values are strings, otherwise a byte string.
+ */
+static CborError
+settings_mgmt_encode_val(CborEncoder *enc, const void *val, size_t len)
+{
+#if SETTINGS_MGMT_VAL_TEXT
+    return cbor_encode_text_string(enc, val, len);
+#else
+    return cbor_encode_byte_string(enc, val, len);
+#endif
+}
+
+/**
+ * Copies a value, given either as a text or as a byte string, out of a
+ * request and terminates it.  The buffer must hold SETTINGS_MGMT_VAL_LEN + 1
+ * bytes.  On success, the iterator is advanced past the value.
+ */
+static int
+settings_mgmt_copy_val(CborValue *it, uint8_t *buf, size_t *out_len)
+{
+    CborError err;
+    size_t len;
+
+    len = SETTINGS_MGMT_VAL_LEN;
+    if (cbor_value_is_text_string(it)) {
+        err = cbor_value_copy_text_string(it, (char *)buf, &len, it);
+    } else if (cbor_value_is_byte_string(it)) {
+        err = cbor_value_copy_byte_string(it, buf, &len, it);
+    } else {
+        return MGMT_ERR_EINVAL;
+    }
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    buf[len] = '\0';
+    *out_len = len;
+    return 0;
+}
+
+/**
+ * Command handler: settings val (read)
+ *
+ * Reads the settings listed in "names".  The response's "vals" map holds
+ * each setting's value by name, or null for settings that do not exist.
+ */
+static int
+settings_mgmt_val_read(struct mgmt_ctxt *ctxt)
+{
+    char name[SETTINGS_MGMT_NAME_LEN];
+    uint8_t val[SETTINGS_MGMT_VAL_LEN];
+    CborEncoder vals;
+    CborValue names;
+    CborValue it;
+    CborError err;
+    size_t len;
+    int rc;
+
+    if (cbor_value_map_find_value(&ctxt->it, "names", &names) != 0 ||
+        !cbor_value_is_array(&names)) {
+
+        return MGMT_ERR_EINVAL;
+    }
+
+    err = cbor_value_enter_container(&names, &it);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "vals");
+    err |= cbor_encoder_create_map(&ctxt->encoder, &vals,
+                                   CborIndefiniteLength);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    while (!cbor_value_at_end(&it)) {
+        if (!cbor_value_is_text_string(&it)) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        len = sizeof name;
+        err = cbor_value_copy_text_string(&it, name, &len, &it);
+        if (err != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        err |= cbor_encode_text_string(&vals, name, len);
+
+        len = sizeof val;
+        rc = settings_mgmt_impl_get(name, val, &len);
+        if (rc == 0) {
+            err |= settings_mgmt_encode_val(&vals, val, len);
+        } else if (rc == MGMT_ERR_ENOENT) {
+            err |= cbor_encode_null(&vals);
+        } else {
+            return rc;
+        }
+
+        if (err != 0) {
+            return MGMT_ERR_ENOMEM;
+        }
+    }
+
+    err |= cbor_encoder_close_container(&ctxt->encoder, &vals);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: settings val (write)
+ *
+ * Sets each setting in the "vals" map to its value, given as a text or byte
+ * string.  The new values take effect together once all are set, and if
+ * "save" is true, are persisted together, so that a batch costs a single
+ * commit.  The first setting that cannot be set ends the batch: its name is
+ * returned along with the error, and the settings before it take effect but
+ * are not saved.
+ */
+static int
+settings_mgmt_val_write(struct mgmt_ctxt *ctxt)
+{
+    char name[SETTINGS_MGMT_NAME_LEN];
+    uint8_t val[SETTINGS_MGMT_VAL_LEN + 1];
+    CborValue save_val;
+    CborValue vals;
+    CborValue it;
+    CborError err;
+    size_t len;
+    bool failed;
+    bool save;
+    int count;
+    int rc;
+
+    save = false;
+    if (cbor_value_map_find_value(&ctxt->it, "save", &save_val) != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (cbor_value_is_boolean(&save_val)) {
+        cbor_value_get_boolean(&save_val, &save);
+    }
+
+    if (cbor_value_map_find_value(&ctxt->it, "vals", &vals) != 0 ||
+        !cbor_value_is_map(&vals)) {
+
+        return MGMT_ERR_EINVAL;
+    }
+
+    err = cbor_value_enter_container(&vals, &it);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    rc = 0;
+    failed = false;
+    for (count = 0; !cbor_value_at_end(&it); count++) {
+        if (!cbor_value_is_text_string(&it)) {
+            rc = MGMT_ERR_EINVAL;
+            break;
+        }
+
+        len = sizeof name;
+        err = cbor_value_copy_text_string(&it, name, &len, &it);
+        if (err != 0) {
+            rc = MGMT_ERR_EINVAL;
+            break;
+        }
+
+        rc = settings_mgmt_copy_val(&it, val, &len);
+        if (rc == 0) {
+            rc = settings_mgmt_impl_set(name, val, len);
+        }
+        if (rc != 0) {
+            failed = true;
+            break;
+        }
+    }
+
+    /* Apply what has been set even if the batch failed part way, so that no
+     * value is left pending for an unrelated commit later on.
+     */
+    if (count > 0) {
+        if (settings_mgmt_impl_commit() != 0 && rc == 0) {
+            rc = MGMT_ERR_EUNKNOWN;
+        }
+    }
+    if (rc == 0 && save) {
+        rc = settings_mgmt_impl_save();
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, rc);
+    if (failed) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "name");
+        err |= cbor_encode_text_stringz(&ctxt->encoder, name);
+    }
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Opens the "vals" map of a list response.
+ */
+static int
+settings_mgmt_list_open(struct settings_mgmt_list_ctxt *list)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&list->mc->encoder, "vals");
+    err |= cbor_encoder_create_map(&list->mc->encoder, &list->vals,
+                                   CborIndefiniteLength);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    list->count = 0;
+    return 0;
+}
+
+/**
+ * Completes the current list response with a "more" indication, transmits
+ * it, and begins the next one.
+ */
+static int
+settings_mgmt_list_flush(struct settings_mgmt_list_ctxt *list)
+{
+    CborError err;
+    int rc;
+
+    err = 0;
+    err |= cbor_encoder_close_container(&list->mc->encoder, &list->vals);
+    err |= cbor_encode_text_stringz(&list->mc->encoder, "rc");
+    err |= cbor_encode_int(&list->mc->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&list->mc->encoder, "more");
+    err |= cbor_encode_boolean(&list->mc->encoder, true);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    rc = mgmt_flush_rsp(list->mc);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return settings_mgmt_list_open(list);
+}
+
+static int
+settings_mgmt_list_cb(const char *name, const void *val, size_t len,
+                      void *arg)
+{
+    struct settings_mgmt_list_ctxt *list;
+    CborError err;
+    size_t need;
+    int rc;
+
+    list = arg;
+
+    if (list->idx < list->skip) {
+        list->idx++;
+        return 0;
+    }
+
+    /* A response holds at least one setting; further ones must fit. */
+    need = cbor_encode_bytes_written(&list->mc->encoder) + strlen(name) +
+           len + SETTINGS_MGMT_LIST_ENTRY_OVERHEAD;
+    if (list->count > 0 && need > list->max_len) {
+        if (!list->stream) {
+            list->full = true;
+            return 1;
+        }
+
+        rc = settings_mgmt_list_flush(list);
+        if (rc != 0) {
+            list->rc = rc;
+            return 1;
+        }
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&list->vals, name);
+    err |= settings_mgmt_encode_val(&list->vals, val, len);
+    if (err != 0) {
+        list->rc = MGMT_ERR_ENOMEM;
+        return 1;
+    }
+
+    list->count++;
+    list->idx++;
+    return 0;
+}
+
+/**
+ * Command handler: settings list (read)
+ *
+ * Reads all settings whose name starts with "prefix" ("" or absent for all
+ * of them) into the "vals" map, skipping the first "skip" of them.  If the
+ * client sets "stream" and the transport supports it, the settings are sent
+ * in as many responses as needed, all but the last carrying "more".
+ * Otherwise, a response that cannot hold all settings carries "next", the
+ * "skip" value of the request for the rest.
+ */
+static int
+settings_mgmt_list(struct mgmt_ctxt *ctxt)
+{
+    char prefix[SETTINGS_MGMT_NAME_LEN];
+    struct settings_mgmt_list_ctxt list;
+    unsigned long long skip;
+    CborError err;
+    bool stream;
+    int rc;
+
+    const struct cbor_attr_t list_attr[] = {
+        {
+            .attribute = "prefix",
+            .type = CborAttrTextStringType,
+            .addr.string = prefix,
+            .len = sizeof prefix,
+        },
+        {
+            .attribute = "skip",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &skip,
+        },
+        {
+            .attribute = "stream",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &stream,
+        },
+        { 0 },
+    };
+
+    prefix[0] = '\0';
+    skip = 0;
+    stream = false;
+    rc = cbor_read_object(&ctxt->it, list_attr);
+    if (rc != 0 || skip > UINT32_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    list = (struct settings_mgmt_list_ctxt) {
+        .mc = ctxt,
+        .skip = skip,
+        .max_len = mgmt_rsp_chunk_size(ctxt, SETTINGS_MGMT_LIST_RSP_OVERHEAD,
+                                       SETTINGS_MGMT_MAX_RSP_LEN),
+        .stream = stream && ctxt->flush_cb != NULL,
+    };
+
+    rc = settings_mgmt_list_open(&list);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = settings_mgmt_impl_foreach(prefix, settings_mgmt_list_cb, &list);
+    if (list.rc != 0) {
+        return list.rc;
+    }
+
+    err = 0;
+    err |= cbor_encoder_close_container(&ctxt->encoder, &list.vals);
+    if (list.full) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "next");
+        err |= cbor_encode_uint(&ctxt->encoder, list.idx);
+    }
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, rc);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+void
+settings_mgmt_register_group(void)
+{
+#if !MGMT_STATIC_GROUPS
+    mgmt_register_group(&settings_mgmt_group);
+#endif
+}
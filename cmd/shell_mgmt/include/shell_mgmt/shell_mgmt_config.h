@@ -26,12 +26,19 @@
 
 #define SHELL_MGMT_MAX_LINE_LEN     MYNEWT_VAL(SHELL_BRIDGE_MAX_IN_LEN)
 #define SHELL_MGMT_MAX_ARGC         MYNEWT_VAL(SHELL_CMD_ARGC_MAX)
+#define SHELL_MGMT_STREAM_BUF_SIZE  0
 
 #elif defined __ZEPHYR__
 
 #define SHELL_MGMT_MAX_LINE_LEN     CONFIG_SHELL_CMD_BUFF_SIZE
 #define SHELL_MGMT_MAX_ARGC         CONFIG_SHELL_ARGC_MAX
 
+#ifdef CONFIG_SHELL_MGMT_STREAM_BUF_SIZE
+#define SHELL_MGMT_STREAM_BUF_SIZE  CONFIG_SHELL_MGMT_STREAM_BUF_SIZE
+#else
+#define SHELL_MGMT_STREAM_BUF_SIZE  0
+#endif
+
 #else
 
 /* No direct support for this OS.  The application needs to define the above
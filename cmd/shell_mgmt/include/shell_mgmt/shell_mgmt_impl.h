@@ -27,6 +27,8 @@
 #ifndef H_SHELL_MGMT_IMPL_
 #define H_SHELL_MGMT_IMPL_
 
+#include <stddef.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -50,6 +52,30 @@ shell_mgmt_impl_exec(const char *line);
 const char *
 shell_mgmt_impl_get_output();
 
+/** @typedef shell_mgmt_out_fn
+ * @brief Receives shell output as the command produces it.
+ *
+ * @param data : output bytes; not NUL-terminated
+ * @param len : number of bytes at data
+ * @param arg : argument passed to shell_mgmt_impl_exec_stream()
+ */
+typedef void shell_mgmt_out_fn(const char *data, size_t len, void *arg);
+
+/**
+ * @brief Execute `line` as a shell command, passing its output to `out_cb`
+ * while it runs rather than collecting it in a buffer
+ *
+ * @param line : shell command to be executed
+ * @param out_cb : receives the output
+ * @param arg : passed to out_cb
+ * @param out_rc : on success, the command's status: 0 or -errno
+ * @return int : 0 if the command was run, MGMT_ERR_ENOTSUP if the backend
+ * cannot stream its output
+ */
+int
+shell_mgmt_impl_exec_stream(const char *line, shell_mgmt_out_fn *out_cb,
+                            void *arg, int *out_rc);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,9 +18,12 @@
  */
 
 #include <sys/util.h>
+#include <init.h>
 #include <shell/shell.h>
 #include <mgmt/mgmt.h>
 #include <shell_mgmt/shell_mgmt.h>
+#include <shell_mgmt/shell_mgmt_impl.h>
+#include <shell_mgmt/shell_mgmt_config.h>
 #include <shell/shell_dummy.h>
 
 int
@@ -39,3 +42,94 @@ shell_mgmt_impl_get_output(){
         &len
     );
 }
+
+#if SHELL_MGMT_STREAM_BUF_SIZE > 0
+/*
+ * Shell backend whose transport hands output to the command being executed
+ * as the shell writes it, instead of appending it to the dummy backend's
+ * buffer.  Commands run in the caller's thread, so the sink only needs to be
+ * set for the duration of shell_execute_cmd().
+ */
+static shell_mgmt_out_fn *zephyr_shell_mgmt_sink;
+static void *zephyr_shell_mgmt_sink_arg;
+
+static int
+zephyr_shell_mgmt_tr_init(const struct shell_transport *transport,
+                          const void *config,
+                          shell_transport_handler_t evt_handler,
+                          void *context)
+{
+    return 0;
+}
+
+static int
+zephyr_shell_mgmt_tr_uninit(const struct shell_transport *transport)
+{
+    return 0;
+}
+
+static int
+zephyr_shell_mgmt_tr_enable(const struct shell_transport *transport,
+                            bool blocking)
+{
+    return 0;
+}
+
+static int
+zephyr_shell_mgmt_tr_write(const struct shell_transport *transport,
+                           const void *data, size_t length, size_t *cnt)
+{
+    if (zephyr_shell_mgmt_sink != NULL) {
+        zephyr_shell_mgmt_sink(data, length, zephyr_shell_mgmt_sink_arg);
+    }
+
+    /* Output written outside of a command, e.g. the prompt, is dropped. */
+    *cnt = length;
+    return 0;
+}
+
+static int
+zephyr_shell_mgmt_tr_read(const struct shell_transport *transport,
+                          void *data, size_t length, size_t *cnt)
+{
+    *cnt = 0;
+    return 0;
+}
+
+static const struct shell_transport_api zephyr_shell_mgmt_tr_api = {
+    .init = zephyr_shell_mgmt_tr_init,
+    .uninit = zephyr_shell_mgmt_tr_uninit,
+    .enable = zephyr_shell_mgmt_tr_enable,
+    .write = zephyr_shell_mgmt_tr_write,
+    .read = zephyr_shell_mgmt_tr_read,
+};
+
+static struct shell_transport zephyr_shell_mgmt_tr = {
+    .api = &zephyr_shell_mgmt_tr_api,
+};
+
+SHELL_DEFINE(zephyr_shell_mgmt_stream_shell, "", &zephyr_shell_mgmt_tr, 1, 0,
+             SHELL_FLAG_OLF_CRLF);
+
+static int
+zephyr_shell_mgmt_stream_init(const struct device *dev)
+{
+    ARG_UNUSED(dev);
+
+    return shell_init(&zephyr_shell_mgmt_stream_shell, NULL, false, false, 0);
+}
+
+SYS_INIT(zephyr_shell_mgmt_stream_init, POST_KERNEL, 0);
+
+int
+shell_mgmt_impl_exec_stream(const char *line, shell_mgmt_out_fn *out_cb,
+                            void *arg, int *out_rc)
+{
+    zephyr_shell_mgmt_sink = out_cb;
+    zephyr_shell_mgmt_sink_arg = arg;
+    *out_rc = shell_execute_cmd(&zephyr_shell_mgmt_stream_shell, line);
+    zephyr_shell_mgmt_sink = NULL;
+
+    return 0;
+}
+#endif
@@ -27,31 +27,351 @@
 
 static mgmt_handler_fn shell_mgmt_exec;
 
-static struct mgmt_handler shell_mgmt_handlers[] = {
+static const struct mgmt_handler shell_mgmt_handlers[] = {
     [SHELL_MGMT_ID_EXEC] = { NULL, shell_mgmt_exec },
 };
 
 #define SHELL_MGMT_HANDLER_CNT \
     sizeof shell_mgmt_handlers / sizeof shell_mgmt_handlers[0]
 
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE_RES(shell_mgmt_group, shell_mgmt_handlers,
+                             MGMT_GROUP_ID_SHELL, MGMT_RES_SHELL);
+#else
 static struct mgmt_group shell_mgmt_group = {
     .mg_handlers = shell_mgmt_handlers,
     .mg_handlers_count = SHELL_MGMT_HANDLER_CNT,
     .mg_group_id = MGMT_GROUP_ID_SHELL,
+    .mg_res = MGMT_RES_SHELL,
 };
+#endif
+
+/* Worst-case size of a shell exec response body, excluding the output. */
+#define SHELL_MGMT_RSP_OVERHEAD     32
+
+/* Command line being executed; holds the arguments joined by spaces.  Shared
+ * by all transports; the group's resource lock serializes its use.
+ */
+static char shell_mgmt_line[SHELL_MGMT_MAX_LINE_LEN + 1];
+
+/**
+ * Encodes part of a command's output.  `idx` is the command's position in a
+ * batch, or -1 for a single command.
+ */
+static CborError
+shell_mgmt_encode_output(struct mgmt_ctxt *cb, int idx, const char *data,
+                         size_t len)
+{
+    CborError err;
+
+    err = 0;
+    if (idx >= 0) {
+        /* Key="i"; value=<command-index> */
+        err |= cbor_encode_text_stringz(&cb->encoder, "i");
+        err |= cbor_encode_int(&cb->encoder, idx);
+    }
+
+    /* Key="o"; value=<command-output> */
+    err |= cbor_encode_text_stringz(&cb->encoder, "o");
+    err |= cbor_encode_text_string(&cb->encoder, data, len);
+
+    return err;
+}
+
+/**
+ * Sends part of a command's output in a partial response with a "more"
+ * indication.
+ */
+static int
+shell_mgmt_send_output(struct mgmt_ctxt *cb, int idx, const char *data,
+                       size_t len)
+{
+    CborError err;
+
+    err = shell_mgmt_encode_output(cb, idx, data, len);
+    err |= cbor_encode_text_stringz(&cb->encoder, "more");
+    err |= cbor_encode_boolean(&cb->encoder, true);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return mgmt_flush_rsp(cb);
+}
+
+/**
+ * Encodes the last part of a command's output and the command's status into
+ * the current response.
+ */
+static int
+shell_mgmt_encode_result(struct mgmt_ctxt *cb, int idx, const char *data,
+                         size_t len, int cmd_rc)
+{
+    CborError err;
+
+    err = shell_mgmt_encode_output(cb, idx, data, len);
+
+    /* Key="rc"; value=<status> */
+    err |= cbor_encode_text_stringz(&cb->encoder, "rc");
+    err |= cbor_encode_int(&cb->encoder, cmd_rc);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+#if SHELL_MGMT_STREAM_BUF_SIZE > 0
+/** Output of a streamed command that has not been sent yet. */
+struct shell_mgmt_stream {
+    struct mgmt_ctxt *ctxt;
+    int idx;
+    /* Amount of output sent in each partial response. */
+    size_t chunk_len;
+    size_t len;
+    /* Status of the first failed flush; output is dropped after one. */
+    int rc;
+    char buf[SHELL_MGMT_STREAM_BUF_SIZE];
+};
+
+static struct shell_mgmt_stream shell_mgmt_stream;
+
+static void
+shell_mgmt_stream_out(const char *data, size_t len, void *arg)
+{
+    struct shell_mgmt_stream *st;
+    size_t cnt;
+
+    st = arg;
+    while (len > 0 && st->rc == 0) {
+        cnt = st->chunk_len - st->len;
+        if (cnt > len) {
+            cnt = len;
+        }
+        memcpy(st->buf + st->len, data, cnt);
+        st->len += cnt;
+        data += cnt;
+        len -= cnt;
+
+        if (st->len == st->chunk_len) {
+            st->rc = shell_mgmt_send_output(st->ctxt, st->idx, st->buf,
+                                            st->len);
+            st->len = 0;
+        }
+    }
+}
+
+/**
+ * Runs a command with its output sent in partial responses as it is
+ * produced; the remainder of the output and the command's status are left in
+ * the current response.
+ *
+ * @return                      0 on success; MGMT_ERR_ENOTSUP if the backend
+ *                                  cannot stream, before anything is run;
+ *                                  other MGMT_ERR_[...] code on failure.
+ */
+static int
+shell_mgmt_exec_stream(struct mgmt_ctxt *cb, int idx, const char *line,
+                       int *out_rc)
+{
+    struct shell_mgmt_stream *st;
+    int rc;
+
+    st = &shell_mgmt_stream;
+    st->ctxt = cb;
+    st->idx = idx;
+    st->chunk_len = mgmt_rsp_chunk_size(cb, SHELL_MGMT_RSP_OVERHEAD,
+                                        sizeof st->buf);
+    st->len = 0;
+    st->rc = 0;
+
+    rc = shell_mgmt_impl_exec_stream(line, shell_mgmt_stream_out, st, out_rc);
+    if (rc != 0) {
+        return rc;
+    }
+    if (st->rc != 0) {
+        return st->rc;
+    }
+
+    return shell_mgmt_encode_result(cb, idx, st->buf, st->len, *out_rc);
+}
+#endif
+
+/**
+ * Runs a command to completion and sends its buffered output in partial
+ * responses that fit the transport's MTU; the last part and the command's
+ * status are left in the current response.
+ */
+static int
+shell_mgmt_exec_sliced(struct mgmt_ctxt *cb, int idx, const char *line,
+                       int *out_rc)
+{
+    const char *out;
+    size_t chunk_len;
+    size_t len;
+    int rc;
+
+    *out_rc = shell_mgmt_impl_exec(line);
+
+    out = shell_mgmt_impl_get_output();
+    len = strlen(out);
+    chunk_len = mgmt_rsp_chunk_size(cb, SHELL_MGMT_RSP_OVERHEAD, len);
+
+    while (chunk_len > 0 && len > chunk_len) {
+        rc = shell_mgmt_send_output(cb, idx, out, chunk_len);
+        if (rc != 0) {
+            return rc;
+        }
+        out += chunk_len;
+        len -= chunk_len;
+    }
+
+    return shell_mgmt_encode_result(cb, idx, out, len, *out_rc);
+}
+
+/**
+ * Decodes one argv array of a batch into a command line, with the arguments
+ * separated by spaces.
+ */
+static int
+shell_mgmt_read_line(CborValue *cmd, char *line, size_t size)
+{
+    CborValue arg;
+    CborError err;
+    size_t off;
+    size_t len;
+    int argc;
+
+    if (!cbor_value_is_array(cmd)) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    err = cbor_value_enter_container(cmd, &arg);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    off = 0;
+    line[0] = '\0';
+    for (argc = 0; !cbor_value_at_end(&arg); argc++) {
+        if (!cbor_value_is_text_string(&arg) || argc >= SHELL_MGMT_MAX_ARGC) {
+            return MGMT_ERR_EINVAL;
+        }
+        if (argc > 0) {
+            if (off + 1 >= size) {
+                return MGMT_ERR_EINVAL;
+            }
+            line[off++] = ' ';
+        }
+
+        len = size - off;
+        err = cbor_value_copy_text_string(&arg, line + off, &len, &arg);
+        if (err != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+        off += len;
+    }
+
+    err = cbor_value_leave_container(cmd, &arg);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    return 0;
+}
+
+/**
+ * Runs the commands of a batch in order.  Each command's output and status
+ * are sent in responses that carry the command's index in "i"; all but the
+ * final response carry "more".  With `stop` set, the batch ends at the first
+ * command that fails.
+ */
+static int
+shell_mgmt_exec_batch(struct mgmt_ctxt *cb, const CborValue *cmds, bool stop)
+{
+    CborValue cmd;
+    CborError err;
+    int cmd_rc;
+    int idx;
+    int rc;
+
+    if (!cbor_value_is_array(cmds)) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    /* The results of a batch do not fit in a single response. */
+    if (cb->flush_cb == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    err = cbor_value_enter_container(cmds, &cmd);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    for (idx = 0; !cbor_value_at_end(&cmd); idx++) {
+        if (idx > 0) {
+            /* Send the previous command's result. */
+            err = cbor_encode_text_stringz(&cb->encoder, "more");
+            err |= cbor_encode_boolean(&cb->encoder, true);
+            if (err != 0) {
+                return MGMT_ERR_ENOMEM;
+            }
+            rc = mgmt_flush_rsp(cb);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+
+        rc = shell_mgmt_read_line(&cmd, shell_mgmt_line,
+                                  sizeof shell_mgmt_line);
+        if (rc != 0) {
+            return rc;
+        }
+
+#if SHELL_MGMT_STREAM_BUF_SIZE > 0
+        rc = shell_mgmt_exec_stream(cb, idx, shell_mgmt_line, &cmd_rc);
+        if (rc == MGMT_ERR_ENOTSUP) {
+            rc = shell_mgmt_exec_sliced(cb, idx, shell_mgmt_line, &cmd_rc);
+        }
+#else
+        rc = shell_mgmt_exec_sliced(cb, idx, shell_mgmt_line, &cmd_rc);
+#endif
+        if (rc != 0) {
+            return rc;
+        }
+
+        if (stop && cmd_rc != 0) {
+            break;
+        }
+    }
+
+    return 0;
+}
 
 /**
  * Command handler: shell exec
+ *
+ * If the request sets "stream" and the transport can send several responses
+ * to one request, the output is sent as it is produced, in responses that
+ * carry "more"; otherwise it is collected and sent in a single response.
+ *
+ * Instead of "argv", the request can hold a batch of argv arrays in "cmds";
+ * see shell_mgmt_exec_batch().
  */
 static int
 shell_mgmt_exec(struct mgmt_ctxt *cb)
 {
-    static char line[SHELL_MGMT_MAX_LINE_LEN + 1] = {0};
     CborEncoder str_encoder;
+    CborValue cmds;
     CborError err;
     int rc;
     char *argv[SHELL_MGMT_MAX_ARGC];
     int argc;
+    bool stream;
+    bool stop;
+    int cmd_rc;
+    int i;
 
     const struct cbor_attr_t attrs[] = {
         {
@@ -60,25 +380,68 @@ shell_mgmt_exec(struct mgmt_ctxt *cb)
             .addr.array = {
                 .element_type = CborAttrTextStringType,
                 .arr.strings.ptrs = argv,
-                .arr.strings.store = line,
-                .arr.strings.storelen = sizeof line,
+                .arr.strings.store = shell_mgmt_line,
+                .arr.strings.storelen = sizeof shell_mgmt_line,
                 .count = &argc,
                 .maxlen = sizeof argv / sizeof argv[0],
             },
         },
+        {
+            .attribute = "stream",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &stream,
+            .dflt.boolean = false,
+        },
+        {
+            .attribute = "stop",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &stop,
+            .dflt.boolean = false,
+        },
         { 0 },
     };
 
+    if (cbor_value_map_find_value(&cb->it, "cmds", &cmds) != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (cbor_value_is_valid(&cmds)) {
+        /* cborattr cannot hold the nested arrays; only the flags are read. */
+        argc = 0;
+        err = cbor_read_object(&cb->it, attrs + 1);
+        if (err != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+        return shell_mgmt_exec_batch(cb, &cmds, stop);
+    }
+
+    argc = 0;
     err = cbor_read_object(&cb->it, attrs);
     if (err != 0) {
         return MGMT_ERR_EINVAL;
     }
 
+    /* The arguments are stored back to back; join them into one line. */
+    for (i = 0; i < argc - 1; i++) {
+        argv[i][strlen(argv[i])] = ' ';
+    }
+
+#if SHELL_MGMT_STREAM_BUF_SIZE > 0
+    if (stream && cb->flush_cb != NULL) {
+        rc = shell_mgmt_exec_stream(cb, -1, shell_mgmt_line, &cmd_rc);
+        if (rc != MGMT_ERR_ENOTSUP) {
+            return rc;
+        }
+    }
+#else
+    (void)stream;
+    (void)cmd_rc;
+#endif
+
     /* Key="o"; value=<command-output> */
     err |= cbor_encode_text_stringz(&cb->encoder, "o");
     err |= cbor_encoder_create_indef_text_string(&cb->encoder, &str_encoder);
 
-    rc = shell_mgmt_impl_exec(line);
+    rc = shell_mgmt_impl_exec(shell_mgmt_line);
 
     err |= cbor_encode_text_stringz(&str_encoder,
         shell_mgmt_impl_get_output());
@@ -99,5 +462,7 @@ shell_mgmt_exec(struct mgmt_ctxt *cb)
 void
 shell_mgmt_register_group(void)
 {
+#if !MGMT_STATIC_GROUPS
     mgmt_register_group(&shell_mgmt_group);
+#endif
 }
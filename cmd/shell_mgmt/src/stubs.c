@@ -36,3 +36,10 @@ shell_mgmt_impl_get_output()
 {
     return "";
 }
+
+int __attribute__((weak))
+shell_mgmt_impl_exec_stream(const char *line, shell_mgmt_out_fn *out_cb,
+                            void *arg, int *out_rc)
+{
+    return MGMT_ERR_ENOTSUP;
+}
@@ -20,6 +20,8 @@
 #ifndef H_STAT_MGMT_
 #define H_STAT_MGMT_
 
+#include "stat_mgmt/stat_mgmt_config.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,6 +31,9 @@ extern "C" {
  */
 #define STAT_MGMT_ID_SHOW   0
 #define STAT_MGMT_ID_LIST   1
+#define STAT_MGMT_ID_SHOW_ALL   2
+#define STAT_MGMT_ID_SCHEMA     3
+#define STAT_MGMT_ID_HIST       4
 
 /**
  * @brief Represents a single value in a statistics group.
@@ -38,6 +43,84 @@ struct stat_mgmt_entry {
     uint64_t value;
 };
 
+struct stat_mgmt_src;
+
+/** @typedef stat_mgmt_src_foreach_fn
+ * @brief Applies a function to every entry of a stat source.
+ *
+ * @param src                   The source to walk.
+ * @param cb                    The callback to apply to each entry; a nonzero
+ *                                  return value stops the walk.
+ * @param cb_arg                Argument to pass to the callback.
+ *
+ * @return                      0 on success;
+ *                              The callback's return code if it stopped the
+ *                                  walk.
+ */
+typedef int stat_mgmt_src_foreach_fn(struct stat_mgmt_src *src,
+                                     int (*cb)(struct stat_mgmt_entry *entry,
+                                               void *arg),
+                                     void *cb_arg);
+
+/**
+ * @brief A stat group served by mcumgr itself rather than the OS's
+ *        statistics facility.
+ */
+struct stat_mgmt_src {
+    struct stat_mgmt_src *next;
+    const char *name;
+    stat_mgmt_src_foreach_fn *foreach_entry;
+    void *arg;
+};
+
+/**
+ * @brief Adds a stat group that is listed and shown along with the OS's
+ *        groups.  A source with the same name as an OS group hides it.
+ *
+ * @param src                   The source to register.
+ */
+void stat_mgmt_register_src(struct stat_mgmt_src *src);
+
+#if STAT_MGMT_SMP_LAT
+struct smp_lat;
+
+/**
+ * @brief Exposes an SMP streamer's latency histograms as the "smp_lat" stat
+ *        group.  For each command, the group has "<group>_<id>_cnt",
+ *        "<group>_<id>_max", and "<group>_<id>_b<n>" for each log2 bucket,
+ *        followed by "untracked" at the end.
+ *
+ * @param lat                   The histograms to expose.
+ */
+void stat_mgmt_register_smp_lat(struct smp_lat *lat);
+#endif
+
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+/**
+ * @brief Starts recording the history of a stat group.  Every
+ *        STAT_MGMT_HIST_SAMPLE_MS, the group's values are appended to a RAM
+ *        ring which clients read with the stat hist command.
+ *
+ * @param group_name            The name of the group to record.
+ *
+ * @return                      0 on success, or if the group is already
+ *                                  being recorded;
+ *                              MGMT_ERR_ENOMEM if STAT_MGMT_HIST_GROUP_CNT
+ *                                  groups are already being recorded;
+ *                              MGMT_ERR_EINVAL if the name is too long.
+ */
+int stat_mgmt_hist_track(const char *group_name);
+
+/**
+ * @brief Appends a sample of every recorded group to its history.
+ *
+ * Called by the implementation, from the thread that processes management
+ * requests, every STAT_MGMT_HIST_SAMPLE_MS once a group is being recorded
+ * (see stat_mgmt_impl_hist_start()).
+ */
+void stat_mgmt_hist_sample(void);
+#endif
+
 /**
  * @brief Registers the statistics management command handler group.
  */ 
@@ -25,11 +25,83 @@
 #include "syscfg/syscfg.h"
 
 #define STAT_MGMT_MAX_NAME_LEN  MYNEWT_VAL(STAT_MGMT_MAX_NAME_LEN)
+#define STAT_MGMT_MAX_RSP_LEN   MYNEWT_VAL(STAT_MGMT_MAX_RSP_LEN)
+#define STAT_MGMT_DELTA_CNT     MYNEWT_VAL(STAT_MGMT_DELTA_CNT)
+#define STAT_MGMT_DELTA_MAX_FIELDS  MYNEWT_VAL(STAT_MGMT_DELTA_MAX_FIELDS)
+#define STAT_MGMT_SMP_LAT       MYNEWT_VAL(STAT_MGMT_SMP_LAT)
+#define STAT_MGMT_HIST_GROUP_CNT    MYNEWT_VAL(STAT_MGMT_HIST_GROUP_CNT)
+#define STAT_MGMT_HIST_BUF_SIZE     MYNEWT_VAL(STAT_MGMT_HIST_BUF_SIZE)
+#define STAT_MGMT_HIST_MAX_FIELDS   MYNEWT_VAL(STAT_MGMT_HIST_MAX_FIELDS)
+#define STAT_MGMT_HIST_SAMPLE_MS    MYNEWT_VAL(STAT_MGMT_HIST_SAMPLE_MS)
 
 #elif defined __ZEPHYR__
 
 #define STAT_MGMT_MAX_NAME_LEN  CONFIG_STAT_MGMT_MAX_NAME_LEN
 
+/* Size at which a show-all response gets split. */
+#ifdef CONFIG_STAT_MGMT_MAX_RSP_LEN
+#define STAT_MGMT_MAX_RSP_LEN   CONFIG_STAT_MGMT_MAX_RSP_LEN
+#else
+#define STAT_MGMT_MAX_RSP_LEN   CONFIG_MCUMGR_BUF_SIZE
+#endif
+
+/* Number of snapshots kept for delta stat show requests; 0 disables delta
+ * mode.
+ */
+#ifdef CONFIG_STAT_MGMT_DELTA_CNT
+#define STAT_MGMT_DELTA_CNT     CONFIG_STAT_MGMT_DELTA_CNT
+#else
+#define STAT_MGMT_DELTA_CNT     0
+#endif
+
+/* Number of fields per group tracked by a delta snapshot. */
+#ifdef CONFIG_STAT_MGMT_DELTA_MAX_FIELDS
+#define STAT_MGMT_DELTA_MAX_FIELDS  CONFIG_STAT_MGMT_DELTA_MAX_FIELDS
+#else
+#define STAT_MGMT_DELTA_MAX_FIELDS  32
+#endif
+
+/* Number of stat groups indexed by name; 0 disables the index. */
+#ifdef CONFIG_STAT_MGMT_GROUP_INDEX_CNT
+#define STAT_MGMT_GROUP_INDEX_CNT   CONFIG_STAT_MGMT_GROUP_INDEX_CNT
+#else
+#define STAT_MGMT_GROUP_INDEX_CNT   32
+#endif
+
+#ifdef CONFIG_STAT_MGMT_SMP_LAT
+#define STAT_MGMT_SMP_LAT       1
+#else
+#define STAT_MGMT_SMP_LAT       0
+#endif
+
+/* Number of stat groups whose history can be recorded; 0 disables history. */
+#ifdef CONFIG_STAT_MGMT_HIST_GROUP_CNT
+#define STAT_MGMT_HIST_GROUP_CNT    CONFIG_STAT_MGMT_HIST_GROUP_CNT
+#else
+#define STAT_MGMT_HIST_GROUP_CNT    0
+#endif
+
+/* Size, in bytes, of each recorded group's sample ring. */
+#ifdef CONFIG_STAT_MGMT_HIST_BUF_SIZE
+#define STAT_MGMT_HIST_BUF_SIZE     CONFIG_STAT_MGMT_HIST_BUF_SIZE
+#else
+#define STAT_MGMT_HIST_BUF_SIZE     1024
+#endif
+
+/* Number of fields per group recorded in its history. */
+#ifdef CONFIG_STAT_MGMT_HIST_MAX_FIELDS
+#define STAT_MGMT_HIST_MAX_FIELDS   CONFIG_STAT_MGMT_HIST_MAX_FIELDS
+#else
+#define STAT_MGMT_HIST_MAX_FIELDS   16
+#endif
+
+/* Interval between history samples, in milliseconds. */
+#ifdef CONFIG_STAT_MGMT_HIST_SAMPLE_MS
+#define STAT_MGMT_HIST_SAMPLE_MS    CONFIG_STAT_MGMT_HIST_SAMPLE_MS
+#else
+#define STAT_MGMT_HIST_SAMPLE_MS    1000
+#endif
+
 #else
 
 /* No direct support for this OS.  The application needs to define the above
@@ -35,6 +35,7 @@ struct stat_mgmt_entry;
 
 typedef int stat_mgmt_foreach_entry_fn(struct stat_mgmt_entry *entry,
                                        void *arg);
+typedef int stat_mgmt_foreach_group_fn(const char *group_name, void *arg);
 
 /**
  * @brief Retrieves the name of the stat group at the specified index.
@@ -50,6 +51,23 @@ typedef int stat_mgmt_foreach_entry_fn(struct stat_mgmt_entry *entry,
  */
 int stat_mgmt_impl_get_group(int idx, const char **out_name);
 
+/**
+ * @brief Applies a function to the name of every stat group, walking the
+ *        group list once.  The default implementation is built on
+ *        stat_mgmt_impl_get_group(), so ports which only provide that keep
+ *        working.
+ *
+ * @param cb                    The callback to apply to each group.  A nonzero
+ *                                  return value stops the walk.
+ * @param arg                   An optional argument to pass to the callback.
+ *
+ * @return                      0 on success;
+ *                              The callback's return code if it stopped the
+ *                                  walk;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int stat_mgmt_impl_foreach_group(stat_mgmt_foreach_group_fn *cb, void *arg);
+
 /**
  * @brief Applies a function to every entry in the specified stat group.
  *
@@ -63,6 +81,20 @@ int stat_mgmt_impl_foreach_entry(const char *group_name,
                                  stat_mgmt_foreach_entry_fn *cb,
                                  void *arg);
 
+/**
+ * @brief Starts calling stat_mgmt_hist_sample() every
+ *        STAT_MGMT_HIST_SAMPLE_MS, from the thread that processes management
+ *        requests.  Called when the first group's history starts being
+ *        recorded.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if the implementation has no
+ *                                  timer, in which case the application calls
+ *                                  stat_mgmt_hist_sample() itself;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int stat_mgmt_impl_hist_start(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -18,6 +18,7 @@
  */
 
 
+#include "os/mynewt.h"
 #include "stats/stats.h"
 #include "mgmt/mgmt.h"
 #include "sysinit/sysinit.h"
@@ -30,6 +31,10 @@ struct mynewt_stat_mgmt_walk_arg {
     void *arg;
 };
 
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+static struct os_callout mynewt_stat_mgmt_hist_callout;
+#endif
+
 int
 stat_mgmt_impl_get_group(int idx, const char **out_name)
 {
@@ -56,6 +61,22 @@ stat_mgmt_impl_get_group(int idx, const char **out_name)
     return rc;
 }
 
+int
+stat_mgmt_impl_foreach_group(stat_mgmt_foreach_group_fn *cb, void *arg)
+{
+    const struct stats_hdr *cur;
+    int rc;
+
+    STAILQ_FOREACH(cur, &g_stats_registry, s_next) {
+        rc = cb(cur->s_name, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
 static int
 mynewt_stat_mgmt_walk_cb(struct stats_hdr *hdr, void *arg,
                          char *name, uint16_t off)
@@ -106,11 +127,34 @@ stat_mgmt_impl_foreach_entry(const char *group_name,
     return stats_walk(hdr, mynewt_stat_mgmt_walk_cb, &walk_arg);
 }
 
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+static void
+mynewt_stat_mgmt_hist_timer_cb(struct os_event *ev)
+{
+    os_callout_reset(&mynewt_stat_mgmt_hist_callout,
+                     os_time_ms_to_ticks32(STAT_MGMT_HIST_SAMPLE_MS));
+    stat_mgmt_hist_sample();
+}
+
+int
+stat_mgmt_impl_hist_start(void)
+{
+    os_callout_reset(&mynewt_stat_mgmt_hist_callout,
+                     os_time_ms_to_ticks32(STAT_MGMT_HIST_SAMPLE_MS));
+    return 0;
+}
+#endif
+
 void
 stat_mgmt_module_init(void)
 {
     /* Ensure this function only gets called by sysinit. */
     SYSINIT_ASSERT_ACTIVE();
 
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+    os_callout_init(&mynewt_stat_mgmt_hist_callout, os_eventq_dflt_get(),
+                    mynewt_stat_mgmt_hist_timer_cb, NULL);
+#endif
+
     stat_mgmt_register_group();
 }
@@ -17,17 +17,137 @@
  * under the License.
  */
 
+#include <string.h>
+#include <zephyr.h>
 #include <sys/util.h>
 #include <stats/stats.h>
 #include <mgmt/mgmt.h>
 #include <stat_mgmt/stat_mgmt.h>
 #include <stat_mgmt/stat_mgmt_impl.h>
+#include <stat_mgmt/stat_mgmt_config.h>
 
 struct zephyr_stat_mgmt_walk_arg {
     stat_mgmt_foreach_entry_fn *cb;
     void *arg;
 };
 
+#if STAT_MGMT_GROUP_INDEX_CNT > 0
+/*
+ * Stat groups sorted by name, for lookups by binary search rather than a
+ * string compare against every registered group.  Groups can be registered
+ * at any time, so the index is built on first use and rebuilt when a lookup
+ * misses and the number of registered groups has changed.
+ */
+static struct stats_hdr *zephyr_stat_mgmt_index[STAT_MGMT_GROUP_INDEX_CNT];
+static int zephyr_stat_mgmt_index_cnt;
+
+/* Number of registered groups when the index was built; -1 if never built. */
+static int zephyr_stat_mgmt_registered = -1;
+
+static int
+zephyr_stat_mgmt_count(void)
+{
+    struct stats_hdr *cur;
+    int cnt;
+
+    cnt = 0;
+    for (cur = stats_group_get_next(NULL);
+         cur != NULL;
+         cur = stats_group_get_next(cur)) {
+        cnt++;
+    }
+
+    return cnt;
+}
+
+static void
+zephyr_stat_mgmt_index_build(int registered)
+{
+    struct stats_hdr *cur;
+    int i;
+
+    zephyr_stat_mgmt_index_cnt = 0;
+    for (cur = stats_group_get_next(NULL);
+         cur != NULL;
+         cur = stats_group_get_next(cur)) {
+
+        if (zephyr_stat_mgmt_index_cnt >= STAT_MGMT_GROUP_INDEX_CNT) {
+            break;
+        }
+
+        /* Insertion sort; group counts are small. */
+        i = zephyr_stat_mgmt_index_cnt;
+        while (i > 0 &&
+               strcmp(zephyr_stat_mgmt_index[i - 1]->s_name,
+                      cur->s_name) > 0) {
+            zephyr_stat_mgmt_index[i] = zephyr_stat_mgmt_index[i - 1];
+            i--;
+        }
+        zephyr_stat_mgmt_index[i] = cur;
+        zephyr_stat_mgmt_index_cnt++;
+    }
+
+    zephyr_stat_mgmt_registered = registered;
+}
+
+static struct stats_hdr *
+zephyr_stat_mgmt_index_find(const char *name)
+{
+    int lo;
+    int hi;
+    int mid;
+    int cmp;
+
+    lo = 0;
+    hi = zephyr_stat_mgmt_index_cnt - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        cmp = strcmp(name, zephyr_stat_mgmt_index[mid]->s_name);
+        if (cmp == 0) {
+            return zephyr_stat_mgmt_index[mid];
+        } else if (cmp < 0) {
+            hi = mid - 1;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return NULL;
+}
+
+static struct stats_hdr *
+zephyr_stat_mgmt_find(const char *name)
+{
+    struct stats_hdr *hdr;
+    int registered;
+
+    if (zephyr_stat_mgmt_registered >= 0) {
+        hdr = zephyr_stat_mgmt_index_find(name);
+        if (hdr != NULL) {
+            return hdr;
+        }
+    }
+
+    registered = zephyr_stat_mgmt_count();
+    if (registered != zephyr_stat_mgmt_registered) {
+        zephyr_stat_mgmt_index_build(registered);
+        hdr = zephyr_stat_mgmt_index_find(name);
+        if (hdr != NULL) {
+            return hdr;
+        }
+    }
+
+    /* Not indexed; the group may not fit in the index. */
+    if (registered > zephyr_stat_mgmt_index_cnt) {
+        return stats_group_find(name);
+    }
+
+    return NULL;
+}
+#else
+#define zephyr_stat_mgmt_find(name) stats_group_find(name)
+#endif
+
 int
 stat_mgmt_impl_get_group(int idx, const char **out_name)
 {
@@ -46,6 +166,25 @@ stat_mgmt_impl_get_group(int idx, const char **out_name)
     return 0;
 }
 
+int
+stat_mgmt_impl_foreach_group(stat_mgmt_foreach_group_fn *cb, void *arg)
+{
+    struct stats_hdr *cur;
+    int rc;
+
+    for (cur = stats_group_get_next(NULL);
+         cur != NULL;
+         cur = stats_group_get_next(cur)) {
+
+        rc = cb(cur->s_name, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
 static int
 zephyr_stat_mgmt_walk_cb(struct stats_hdr *hdr, void *arg,
                          const char *name, uint16_t off)
@@ -83,7 +222,7 @@ stat_mgmt_impl_foreach_entry(const char *group_name,
     struct zephyr_stat_mgmt_walk_arg walk_arg;
     struct stats_hdr *hdr;
 
-    hdr = stats_group_find(group_name);
+    hdr = zephyr_stat_mgmt_find(group_name);
     if (hdr == NULL) {
         return MGMT_ERR_ENOENT;
     }
@@ -95,3 +234,35 @@ stat_mgmt_impl_foreach_entry(const char *group_name,
 
     return stats_walk(hdr, zephyr_stat_mgmt_walk_cb, &walk_arg);
 }
+
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+static void zephyr_stat_mgmt_hist_cb(struct k_timer *timer);
+static void zephyr_stat_mgmt_hist_work_handler(struct k_work *work);
+
+static K_TIMER_DEFINE(zephyr_stat_mgmt_hist_timer,
+                      zephyr_stat_mgmt_hist_cb, NULL);
+
+K_WORK_DEFINE(zephyr_stat_mgmt_hist_work, zephyr_stat_mgmt_hist_work_handler);
+
+static void
+zephyr_stat_mgmt_hist_work_handler(struct k_work *work)
+{
+    stat_mgmt_hist_sample();
+}
+
+static void
+zephyr_stat_mgmt_hist_cb(struct k_timer *timer)
+{
+    /* Sample from the system workqueue, which processes mcumgr requests. */
+    k_work_submit(&zephyr_stat_mgmt_hist_work);
+}
+
+int
+stat_mgmt_impl_hist_start(void)
+{
+    k_timer_start(&zephyr_stat_mgmt_hist_timer,
+                  K_MSEC(STAT_MGMT_HIST_SAMPLE_MS),
+                  K_MSEC(STAT_MGMT_HIST_SAMPLE_MS));
+    return 0;
+}
+#endif
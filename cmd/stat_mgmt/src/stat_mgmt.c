@@ -25,23 +25,227 @@
 #include "stat_mgmt/stat_mgmt.h"
 #include "stat_mgmt/stat_mgmt_impl.h"
 #include "stat_mgmt/stat_mgmt_config.h"
+#if STAT_MGMT_SMP_LAT
+#include "smp/smp.h"
+#endif
 
 static mgmt_handler_fn stat_mgmt_show;
 static mgmt_handler_fn stat_mgmt_list;
+static mgmt_handler_fn stat_mgmt_show_all;
+static mgmt_handler_fn stat_mgmt_schema;
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+static mgmt_handler_fn stat_mgmt_hist;
+#endif
 
-static struct mgmt_handler stat_mgmt_handlers[] = {
-    [STAT_MGMT_ID_SHOW] = { stat_mgmt_show, NULL },
-    [STAT_MGMT_ID_LIST] = { stat_mgmt_list, NULL },
+static const struct mgmt_handler stat_mgmt_handlers[] = {
+    [STAT_MGMT_ID_SHOW] = { stat_mgmt_show, NULL, MGMT_HANDLER_F_HIPRI },
+    [STAT_MGMT_ID_LIST] = { stat_mgmt_list, NULL, MGMT_HANDLER_F_HIPRI },
+    [STAT_MGMT_ID_SHOW_ALL] = { stat_mgmt_show_all, NULL },
+    [STAT_MGMT_ID_SCHEMA] = { stat_mgmt_schema, NULL },
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+    [STAT_MGMT_ID_HIST] = { stat_mgmt_hist, NULL },
+#endif
+};
+
+/* Room reserved after the "groups" map of a show-all response for its
+ * terminator and the "more" and "rc" fields.
+ */
+#define STAT_MGMT_SHOW_ALL_TAIL_LEN 16
+
+/** State of a show-all response that may be split across several packets. */
+struct stat_mgmt_show_all_ctxt {
+    struct mgmt_ctxt *ctxt;
+    /* The "groups" map in the root map. */
+    CborEncoder groups;
+    /* Number of groups encoded in the current response. */
+    int count;
 };
 
 #define STAT_MGMT_HANDLER_CNT \
     sizeof stat_mgmt_handlers / sizeof stat_mgmt_handlers[0]
 
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE(stat_mgmt_group, stat_mgmt_handlers,
+                         MGMT_GROUP_ID_STAT);
+#else
 static struct mgmt_group stat_mgmt_group = {
     .mg_handlers = stat_mgmt_handlers,
     .mg_handlers_count = STAT_MGMT_HANDLER_CNT,
     .mg_group_id = MGMT_GROUP_ID_STAT,
 };
+#endif
+
+/** Stat groups served by mcumgr itself. */
+static struct stat_mgmt_src *stat_mgmt_srcs;
+
+static struct stat_mgmt_src *
+stat_mgmt_find_src(const char *group_name)
+{
+    struct stat_mgmt_src *src;
+
+    for (src = stat_mgmt_srcs; src != NULL; src = src->next) {
+        if (strcmp(src->name, group_name) == 0) {
+            return src;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Applies a function to every entry in the specified stat group, whether
+ * registered with stat_mgmt_register_src() or provided by the OS.
+ */
+static int
+stat_mgmt_foreach_entry(const char *group_name,
+                        stat_mgmt_foreach_entry_fn *cb, void *arg)
+{
+    struct stat_mgmt_src *src;
+
+    src = stat_mgmt_find_src(group_name);
+    if (src != NULL) {
+        return src->foreach_entry(src, cb, arg);
+    }
+
+    return stat_mgmt_impl_foreach_entry(group_name, cb, arg);
+}
+
+/**
+ * Applies a function to the name of every stat group: the OS's groups
+ * followed by those registered with stat_mgmt_register_src().
+ */
+static int
+stat_mgmt_foreach_group(stat_mgmt_foreach_group_fn *cb, void *arg)
+{
+    struct stat_mgmt_src *src;
+    int rc;
+
+    rc = stat_mgmt_impl_foreach_group(cb, arg);
+    if (rc != 0) {
+        return rc;
+    }
+
+    for (src = stat_mgmt_srcs; src != NULL; src = src->next) {
+        rc = cb(src->name, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    return 0;
+}
+
+#if STAT_MGMT_DELTA_CNT > 0
+/**
+ * The values of a stat group as last reported to a client.  The snapshot is
+ * named by a generation token handed to the client; a later request carrying
+ * the token gets only the fields which changed since.  Fields are matched by
+ * position, as a group's field list is fixed.
+ */
+struct stat_mgmt_snapshot {
+    char group[STAT_MGMT_MAX_NAME_LEN];
+    /* Generation token; 0 if the slot is unused. */
+    uint32_t gen;
+    uint16_t count;
+    uint64_t values[STAT_MGMT_DELTA_MAX_FIELDS];
+};
+
+static struct stat_mgmt_snapshot stat_mgmt_snapshots[STAT_MGMT_DELTA_CNT];
+static uint32_t stat_mgmt_gen;
+
+struct stat_mgmt_delta_arg {
+    CborEncoder *enc;
+    struct stat_mgmt_snapshot *snap;
+    /* Whether snap holds the client's previous values. */
+    bool valid;
+    /* Whether fields are keyed by index rather than name. */
+    bool compact;
+    int idx;
+};
+
+/**
+ * Finds the snapshot a delta request refers to.  If there is none, the
+ * least recently issued snapshot is reclaimed and marked invalid.
+ */
+static struct stat_mgmt_snapshot *
+stat_mgmt_snapshot_get(const char *group, uint32_t gen, bool *out_valid)
+{
+    struct stat_mgmt_snapshot *oldest;
+    struct stat_mgmt_snapshot *snap;
+    int i;
+
+    oldest = NULL;
+    for (i = 0; i < STAT_MGMT_DELTA_CNT; i++) {
+        snap = &stat_mgmt_snapshots[i];
+        if (gen != 0 && snap->gen == gen && strcmp(snap->group, group) == 0) {
+            *out_valid = true;
+            return snap;
+        }
+
+        /* Generations are issued in increasing order; wrap-safe compare. */
+        if (oldest == NULL || snap->gen == 0 ||
+            (oldest->gen != 0 && (int32_t)(snap->gen - oldest->gen) < 0)) {
+            oldest = snap;
+        }
+    }
+
+    strncpy(oldest->group, group, sizeof oldest->group - 1);
+    oldest->group[sizeof oldest->group - 1] = '\0';
+    oldest->gen = 0;
+    oldest->count = 0;
+
+    *out_valid = false;
+    return oldest;
+}
+
+static uint32_t
+stat_mgmt_next_gen(void)
+{
+    stat_mgmt_gen++;
+    if (stat_mgmt_gen == 0) {
+        stat_mgmt_gen++;
+    }
+
+    return stat_mgmt_gen;
+}
+
+static int
+stat_mgmt_cb_encode_delta(struct stat_mgmt_entry *entry, void *arg)
+{
+    struct stat_mgmt_delta_arg *delta;
+    struct stat_mgmt_snapshot *snap;
+    CborError err;
+
+    delta = arg;
+    snap = delta->snap;
+
+    if (delta->idx < STAT_MGMT_DELTA_MAX_FIELDS) {
+        if (delta->valid && delta->idx < snap->count &&
+            snap->values[delta->idx] == entry->value) {
+
+            /* Unchanged since the client's last report. */
+            delta->idx++;
+            return 0;
+        }
+        snap->values[delta->idx] = entry->value;
+    }
+    delta->idx++;
+
+    err = 0;
+    if (delta->compact) {
+        err |= cbor_encode_uint(delta->enc, delta->idx - 1);
+    } else {
+        err |= cbor_encode_text_stringz(delta->enc, entry->name);
+    }
+    err |= cbor_encode_uint(delta->enc, entry->value);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+#endif
 
 static int
 stat_mgmt_cb_encode(struct stat_mgmt_entry *entry, void *arg)
@@ -62,6 +266,136 @@ stat_mgmt_cb_encode(struct stat_mgmt_entry *entry, void *arg)
     return 0;
 }
 
+/**
+ * Encodes only a field's value; its position in the array identifies it
+ * (see stat schema).
+ */
+static int
+stat_mgmt_cb_encode_compact(struct stat_mgmt_entry *entry, void *arg)
+{
+    CborError err;
+
+    err = cbor_encode_uint(arg, entry->value);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+static int
+stat_mgmt_cb_encode_name(struct stat_mgmt_entry *entry, void *arg)
+{
+    CborError err;
+
+    err = cbor_encode_text_stringz(arg, entry->name);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+struct stat_mgmt_count_arg {
+    stat_mgmt_foreach_entry_fn *cb;
+    void *arg;
+    size_t count;
+};
+
+static int
+stat_mgmt_cb_count(struct stat_mgmt_entry *entry, void *arg)
+{
+    struct stat_mgmt_count_arg *ca;
+    int rc;
+
+    ca = arg;
+
+    rc = ca->cb(entry, ca->arg);
+    if (rc == 0) {
+        ca->count++;
+    }
+
+    return rc;
+}
+
+/**
+ * Encodes each of a group's fields with the specified callback into a
+ * definite-length map or array in the root of the response.
+ */
+static int
+stat_mgmt_encode_counted(struct mgmt_ctxt *ctxt, const char *group_name,
+                         bool is_map, stat_mgmt_foreach_entry_fn *cb)
+{
+    struct stat_mgmt_count_arg ca;
+    struct mgmt_counted cnt;
+    int close_rc;
+    int rc;
+
+    if (is_map) {
+        rc = mgmt_open_counted_map(ctxt, &ctxt->encoder, &cnt);
+    } else {
+        rc = mgmt_open_counted_array(ctxt, &ctxt->encoder, &cnt);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    ca = (struct stat_mgmt_count_arg) {
+        .cb = cb,
+        .arg = &cnt.encoder,
+    };
+    rc = stat_mgmt_foreach_entry(group_name, stat_mgmt_cb_count, &ca);
+
+    close_rc = mgmt_close_counted(ctxt, &ctxt->encoder, &cnt, ca.count);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return close_rc;
+}
+
+/**
+ * Command handler: stat schema
+ *
+ * Lists a group's field names in field order.  A field's index in this list
+ * is its ID in compact stat show responses.
+ */
+static int
+stat_mgmt_schema(struct mgmt_ctxt *ctxt)
+{
+    char stat_name[STAT_MGMT_MAX_NAME_LEN];
+    CborError err;
+
+    struct cbor_attr_t attrs[] = {
+        {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = stat_name,
+            .len = sizeof(stat_name)
+        },
+        { NULL },
+    };
+
+    err = cbor_read_object(&ctxt->it, attrs);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "name");
+    err |= cbor_encode_text_stringz(&ctxt->encoder, stat_name);
+
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "fields");
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return stat_mgmt_encode_counted(ctxt, stat_name, false,
+                                    stat_mgmt_cb_encode_name);
+}
+
 /**
  * Command handler: stat show
  */
@@ -69,9 +403,14 @@ static int
 stat_mgmt_show(struct mgmt_ctxt *ctxt)
 {
     char stat_name[STAT_MGMT_MAX_NAME_LEN];
-    CborEncoder map_enc;
     CborError err;
+    bool compact;
+#if STAT_MGMT_DELTA_CNT > 0
+    struct stat_mgmt_delta_arg delta;
+    CborEncoder map_enc;
     int rc;
+    unsigned long long int gen;
+#endif
 
     struct cbor_attr_t attrs[] = {
         {
@@ -80,9 +419,28 @@ stat_mgmt_show(struct mgmt_ctxt *ctxt)
             .addr.string = stat_name,
             .len = sizeof(stat_name)
         },
+        {
+            .attribute = "compact",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &compact,
+        },
+#if STAT_MGMT_DELTA_CNT > 0
+        {
+            .attribute = "gen",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &gen,
+            .nodefault = 1,
+        },
+#endif
         { NULL },
     };
 
+#if STAT_MGMT_DELTA_CNT > 0
+    /* Left untouched if the request is not in delta mode. */
+    gen = UINT64_MAX;
+#endif
+
+    compact = false;
     err = cbor_read_object(&ctxt->it, attrs);
     if (err != 0) {
         return MGMT_ERR_EINVAL;
@@ -94,66 +452,835 @@ stat_mgmt_show(struct mgmt_ctxt *ctxt)
     err |= cbor_encode_text_stringz(&ctxt->encoder, "name");
     err |= cbor_encode_text_stringz(&ctxt->encoder, stat_name);
 
+    /* Compact mode: the values alone, in field order. */
+    if (compact
+#if STAT_MGMT_DELTA_CNT > 0
+        && gen == UINT64_MAX
+#endif
+        ) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "values");
+        if (err != 0) {
+            return MGMT_ERR_ENOMEM;
+        }
+
+        return stat_mgmt_encode_counted(ctxt, stat_name, false,
+                                        stat_mgmt_cb_encode_compact);
+    }
+
     err |= cbor_encode_text_stringz(&ctxt->encoder, "fields");
-    err |= cbor_encoder_create_map(&ctxt->encoder, &map_enc,
-                                   CborIndefiniteLength);
 
-    rc = stat_mgmt_impl_foreach_entry(stat_name, stat_mgmt_cb_encode,
-                                      &map_enc);
+#if STAT_MGMT_DELTA_CNT > 0
+    if (gen != UINT64_MAX) {
+        /* Delta mode: only report fields which changed since the snapshot
+         * named by the client's token (all fields if gen is 0 or unknown),
+         * and hand out a token for the values just reported.
+         */
+        err |= cbor_encoder_create_map(&ctxt->encoder, &map_enc,
+                                       CborIndefiniteLength);
+        delta = (struct stat_mgmt_delta_arg) {
+            .enc = &map_enc,
+            .compact = compact,
+        };
+        delta.snap = stat_mgmt_snapshot_get(stat_name, gen, &delta.valid);
+
+        rc = stat_mgmt_foreach_entry(stat_name,
+                                          stat_mgmt_cb_encode_delta, &delta);
+        err |= cbor_encoder_close_container(&ctxt->encoder, &map_enc);
+
+        if (rc == 0 && err == 0) {
+            if (delta.idx < STAT_MGMT_DELTA_MAX_FIELDS) {
+                delta.snap->count = delta.idx;
+            } else {
+                delta.snap->count = STAT_MGMT_DELTA_MAX_FIELDS;
+            }
+            delta.snap->gen = stat_mgmt_next_gen();
+
+            err |= cbor_encode_text_stringz(&ctxt->encoder, "gen");
+            err |= cbor_encode_uint(&ctxt->encoder, delta.snap->gen);
+        } else {
+            /* The snapshot is only partially updated; discard it. */
+            delta.snap->gen = 0;
+        }
+
+        if (err != 0) {
+            rc = MGMT_ERR_ENOMEM;
+        }
+
+        return rc;
+    }
+#endif
 
-    err |= cbor_encoder_close_container(&ctxt->encoder, &map_enc);
     if (err != 0) {
-        rc = MGMT_ERR_ENOMEM;
+        return MGMT_ERR_ENOMEM;
     }
 
-    return rc;
+    return stat_mgmt_encode_counted(ctxt, stat_name, true,
+                                    stat_mgmt_cb_encode);
 }
 
 /**
- * Command handler: stat list
+ * Encodes a group's name followed by a map of its fields.
  */
 static int
-stat_mgmt_list(struct mgmt_ctxt *ctxt)
+stat_mgmt_encode_group(CborEncoder *enc, const char *group_name)
 {
-    const char *group_name;
-    CborEncoder arr_enc;
+    CborEncoder map_enc;
     CborError err;
     int rc;
-    int i;
 
-    err = CborNoError;
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
-    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
-    err |= cbor_encode_text_stringz(&ctxt->encoder, "stat_list");
-    err |= cbor_encoder_create_array(&ctxt->encoder, &arr_enc,
-                                     CborIndefiniteLength);
+    err = 0;
+    err |= cbor_encode_text_stringz(enc, group_name);
+    err |= cbor_encoder_create_map(enc, &map_enc, CborIndefiniteLength);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
 
-    /* Iterate the list of stat groups, encoding each group's name in the CBOR
-     * array.
-     */
-    for (i = 0; ; i++) {
-        rc = stat_mgmt_impl_get_group(i, &group_name);
-        if (rc == MGMT_ERR_ENOENT) {
-            /* No more stat groups. */
-            break;
-        } else if (rc != 0) {
-            /* Error. */
-            cbor_encoder_close_container(&ctxt->encoder, &arr_enc);
-            return rc;
-        }
+    rc = stat_mgmt_foreach_entry(group_name, stat_mgmt_cb_encode,
+                                      &map_enc);
 
-        err |= cbor_encode_text_stringz(&ctxt->encoder, group_name);
+    err |= cbor_encoder_close_container(enc, &map_enc);
+    if (rc != 0) {
+        return rc;
     }
-    err |= cbor_encoder_close_container(&ctxt->encoder, &arr_enc);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+static int
+stat_mgmt_show_all_open(struct stat_mgmt_show_all_ctxt *sa)
+{
+    CborError err;
 
+    err = 0;
+    err |= cbor_encode_text_stringz(&sa->ctxt->encoder, "groups");
+    err |= cbor_encoder_create_map(&sa->ctxt->encoder, &sa->groups,
+                                   CborIndefiniteLength);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    sa->count = 0;
+    return 0;
+}
+
+static int
+stat_mgmt_show_all_close(struct stat_mgmt_show_all_ctxt *sa, bool more,
+                         int status)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encoder_close_container(&sa->ctxt->encoder, &sa->groups);
+    err |= cbor_encode_text_stringz(&sa->ctxt->encoder, "more");
+    err |= cbor_encode_boolean(&sa->ctxt->encoder, more);
+    err |= cbor_encode_text_stringz(&sa->ctxt->encoder, "rc");
+    err |= cbor_encode_int(&sa->ctxt->encoder, status);
     if (err != 0) {
         return MGMT_ERR_ENOMEM;
     }
+
     return 0;
 }
 
+static int
+stat_mgmt_show_all_cb(const char *group_name, void *arg)
+{
+    struct stat_mgmt_show_all_ctxt *sa;
+    struct mgmt_checkpoint cp;
+    int rc;
+
+    sa = arg;
+
+    /* Without rollback, the response is limited only by the buffer. */
+    if (!mgmt_can_rollback(sa->ctxt)) {
+        return stat_mgmt_encode_group(&sa->groups, group_name);
+    }
+
+    mgmt_checkpoint(&sa->groups, &cp);
+    rc = stat_mgmt_encode_group(&sa->groups, group_name);
+    if (rc == 0 &&
+        cbor_encode_bytes_written(&sa->groups) +
+        STAT_MGMT_SHOW_ALL_TAIL_LEN <= STAT_MGMT_MAX_RSP_LEN) {
+
+        sa->count++;
+        return 0;
+    }
+    if (rc != 0 && rc != MGMT_ERR_ENOMEM) {
+        return rc;
+    }
+
+    /* The group doesn't fit.  Back it out and, if the transport allows it,
+     * send the groups encoded so far and start a new response with it.
+     */
+    rc = mgmt_rollback(sa->ctxt, &sa->groups, &cp);
+    if (rc != 0) {
+        return rc;
+    }
+    if (sa->count == 0 || sa->ctxt->flush_cb == NULL) {
+        return MGMT_ERR_EMSGSIZE;
+    }
+
+    rc = stat_mgmt_show_all_close(sa, true, MGMT_ERR_EOK);
+    if (rc != 0) {
+        return rc;
+    }
+    rc = mgmt_flush_rsp(sa->ctxt);
+    if (rc != 0) {
+        return rc;
+    }
+    rc = stat_mgmt_show_all_open(sa);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = stat_mgmt_encode_group(&sa->groups, group_name);
+    if (rc != 0) {
+        return rc;
+    }
+    sa->count++;
+
+    return 0;
+}
+
+/**
+ * Command handler: stat show_all
+ *
+ * Encodes the fields of every stat group.  The response is split into
+ * several, each with "more" set in all but the last, if it exceeds
+ * STAT_MGMT_MAX_RSP_LEN.
+ */
+static int
+stat_mgmt_show_all(struct mgmt_ctxt *ctxt)
+{
+    struct stat_mgmt_show_all_ctxt sa;
+    int rc;
+
+    sa = (struct stat_mgmt_show_all_ctxt) {
+        .ctxt = ctxt,
+    };
+
+    rc = stat_mgmt_show_all_open(&sa);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = stat_mgmt_foreach_group(stat_mgmt_show_all_cb, &sa);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return stat_mgmt_show_all_close(&sa, false, MGMT_ERR_EOK);
+}
+
+static int
+stat_mgmt_list_cb(const char *group_name, void *arg)
+{
+    CborError err;
+
+    err = cbor_encode_text_stringz(arg, group_name);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: stat list
+ */
+static int
+stat_mgmt_list(struct mgmt_ctxt *ctxt)
+{
+    CborEncoder arr_enc;
+    CborError err;
+    int rc;
+
+    err = CborNoError;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "stat_list");
+    err |= cbor_encoder_create_array(&ctxt->encoder, &arr_enc,
+                                     CborIndefiniteLength);
+
+    /* Iterate the list of stat groups, encoding each group's name in the CBOR
+     * array.
+     */
+    rc = stat_mgmt_foreach_group(stat_mgmt_list_cb, &arr_enc);
+    if (rc != 0) {
+        cbor_encoder_close_container(&ctxt->encoder, &arr_enc);
+        return rc;
+    }
+    err |= cbor_encoder_close_container(&ctxt->encoder, &arr_enc);
+
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+    return 0;
+}
+
+void
+stat_mgmt_register_src(struct stat_mgmt_src *src)
+{
+    src->next = stat_mgmt_srcs;
+    stat_mgmt_srcs = src;
+}
+
+#if STAT_MGMT_SMP_LAT
+/**
+ * Walks the entries of the "smp_lat" group.  Every bucket is reported, even
+ * if empty, so that a command's fields stay in place for delta requests.
+ */
+static int
+stat_mgmt_smp_lat_foreach(struct stat_mgmt_src *src,
+                          stat_mgmt_foreach_entry_fn *cb, void *cb_arg)
+{
+    const struct smp_lat_entry *lat_entry;
+    struct stat_mgmt_entry entry;
+    const struct smp_lat *lat;
+    char name[24];
+    int rc;
+    int i;
+    int j;
+
+    lat = src->arg;
+    entry.name = name;
+
+    for (i = 0; i < lat->entry_count; i++) {
+        lat_entry = &lat->entries[i];
+        if (!lat_entry->used) {
+            break;
+        }
+
+        snprintf(name, sizeof name, "%u_%u_cnt",
+                 lat_entry->group, lat_entry->id);
+        entry.value = lat_entry->count;
+        rc = cb(&entry, cb_arg);
+        if (rc != 0) {
+            return rc;
+        }
+
+        snprintf(name, sizeof name, "%u_%u_max",
+                 lat_entry->group, lat_entry->id);
+        entry.value = lat_entry->max;
+        rc = cb(&entry, cb_arg);
+        if (rc != 0) {
+            return rc;
+        }
+
+        for (j = 0; j < SMP_LAT_BUCKETS; j++) {
+            snprintf(name, sizeof name, "%u_%u_b%d",
+                     lat_entry->group, lat_entry->id, j);
+            entry.value = lat_entry->buckets[j];
+            rc = cb(&entry, cb_arg);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+    }
+
+    entry.name = "untracked";
+    entry.value = lat->untracked;
+    return cb(&entry, cb_arg);
+}
+
+void
+stat_mgmt_register_smp_lat(struct smp_lat *lat)
+{
+    static struct stat_mgmt_src src = {
+        .name = "smp_lat",
+        .foreach_entry = stat_mgmt_smp_lat_foreach,
+    };
+
+    src.arg = lat;
+    stat_mgmt_register_src(&src);
+}
+#endif
+
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+/* Room reserved after the "samples" array of a hist response for its
+ * terminator and the "next", "more" and "rc" fields.
+ */
+#define STAT_MGMT_HIST_TAIL_LEN     24
+
+/* Longest varint-packed sample. */
+#define STAT_MGMT_HIST_REC_MAX_LEN  (STAT_MGMT_HIST_MAX_FIELDS * 10)
+
+/**
+ * The recorded history of a stat group.  Each sample is stored as one
+ * record: for every field, the change since the previous sample, zigzag
+ * encoded and packed as a little-endian base-128 varint.  When the ring is
+ * full, the oldest records are folded into base.
+ */
+struct stat_mgmt_hist_group {
+    /* Empty if the slot is unused. */
+    char group[STAT_MGMT_MAX_NAME_LEN];
+    /* Values preceding the oldest record. */
+    uint64_t base[STAT_MGMT_HIST_MAX_FIELDS];
+    /* Values of the newest sample. */
+    uint64_t last[STAT_MGMT_HIST_MAX_FIELDS];
+    /* Sample number of the oldest record. */
+    uint32_t first;
+    /* Sample number the next record gets. */
+    uint32_t next;
+    /* Fields per record; fixed by the first sample. */
+    uint16_t field_cnt;
+    /* Offset of the oldest record and number of bytes in use. */
+    size_t tail;
+    size_t len;
+    uint8_t ring[STAT_MGMT_HIST_BUF_SIZE];
+};
+
+/** A read position in a history ring. */
+struct stat_mgmt_hist_cursor {
+    const struct stat_mgmt_hist_group *hg;
+    size_t off;
+};
+
+struct stat_mgmt_hist_collect_arg {
+    uint64_t *values;
+    int idx;
+};
+
+static struct stat_mgmt_hist_group
+    stat_mgmt_hist_groups[STAT_MGMT_HIST_GROUP_CNT];
+static bool stat_mgmt_hist_started;
+
+/* Scratch space for sampling and for replaying records.  Both happen in the
+ * thread that processes management requests.
+ */
+static uint64_t stat_mgmt_hist_values[STAT_MGMT_HIST_MAX_FIELDS];
+static uint8_t stat_mgmt_hist_rec[STAT_MGMT_HIST_REC_MAX_LEN];
+
+static struct stat_mgmt_hist_group *
+stat_mgmt_hist_find(const char *group_name)
+{
+    int i;
+
+    for (i = 0; i < STAT_MGMT_HIST_GROUP_CNT; i++) {
+        if (strcmp(stat_mgmt_hist_groups[i].group, group_name) == 0) {
+            return &stat_mgmt_hist_groups[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int64_t
+stat_mgmt_hist_get_varint(struct stat_mgmt_hist_cursor *cur)
+{
+    uint64_t zz;
+    uint8_t b;
+    int shift;
+
+    zz = 0;
+    shift = 0;
+    do {
+        b = cur->hg->ring[cur->off];
+        cur->off = (cur->off + 1) % STAT_MGMT_HIST_BUF_SIZE;
+
+        zz |= (uint64_t)(b & 0x7f) << shift;
+        shift += 7;
+    } while ((b & 0x80) && shift < 64);
+
+    return (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+}
+
+static size_t
+stat_mgmt_hist_put_varint(uint8_t *dst, int64_t delta)
+{
+    uint64_t zz;
+    size_t len;
+
+    zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+
+    len = 0;
+    while (zz >= 0x80) {
+        dst[len++] = (zz & 0x7f) | 0x80;
+        zz >>= 7;
+    }
+    dst[len++] = zz;
+
+    return len;
+}
+
+/**
+ * Applies the record at a cursor to a set of values and advances the cursor
+ * past it.
+ */
+static void
+stat_mgmt_hist_replay(struct stat_mgmt_hist_cursor *cur, uint64_t *values)
+{
+    int i;
+
+    for (i = 0; i < cur->hg->field_cnt; i++) {
+        values[i] += stat_mgmt_hist_get_varint(cur);
+    }
+}
+
+/** Folds the oldest record into the group's base values. */
+static void
+stat_mgmt_hist_evict(struct stat_mgmt_hist_group *hg)
+{
+    struct stat_mgmt_hist_cursor cur;
+    size_t rec_len;
+
+    cur = (struct stat_mgmt_hist_cursor) {
+        .hg = hg,
+        .off = hg->tail,
+    };
+    stat_mgmt_hist_replay(&cur, hg->base);
+
+    rec_len = (cur.off + STAT_MGMT_HIST_BUF_SIZE - hg->tail) %
+              STAT_MGMT_HIST_BUF_SIZE;
+    if (rec_len == 0) {
+        /* The record filled the whole ring. */
+        rec_len = hg->len;
+    }
+
+    hg->tail = cur.off;
+    hg->len -= rec_len;
+    hg->first++;
+}
+
+static int
+stat_mgmt_hist_collect_cb(struct stat_mgmt_entry *entry, void *arg)
+{
+    struct stat_mgmt_hist_collect_arg *ca;
+
+    ca = arg;
+
+    if (ca->idx < STAT_MGMT_HIST_MAX_FIELDS) {
+        ca->values[ca->idx] = entry->value;
+    }
+    ca->idx++;
+
+    return 0;
+}
+
+static void
+stat_mgmt_hist_sample_group(struct stat_mgmt_hist_group *hg)
+{
+    struct stat_mgmt_hist_collect_arg ca;
+    size_t rec_len;
+    size_t off;
+    size_t i;
+    int rc;
+
+    memset(stat_mgmt_hist_values, 0, sizeof stat_mgmt_hist_values);
+    ca = (struct stat_mgmt_hist_collect_arg) {
+        .values = stat_mgmt_hist_values,
+    };
+    rc = stat_mgmt_foreach_entry(hg->group, stat_mgmt_hist_collect_cb, &ca);
+    if (rc != 0) {
+        /* The group is not registered (yet); no sample. */
+        return;
+    }
+
+    if (hg->field_cnt == 0) {
+        if (ca.idx == 0) {
+            return;
+        }
+        if (ca.idx < STAT_MGMT_HIST_MAX_FIELDS) {
+            hg->field_cnt = ca.idx;
+        } else {
+            hg->field_cnt = STAT_MGMT_HIST_MAX_FIELDS;
+        }
+    }
+
+    rec_len = 0;
+    for (i = 0; i < hg->field_cnt; i++) {
+        rec_len += stat_mgmt_hist_put_varint(
+            stat_mgmt_hist_rec + rec_len,
+            (int64_t)(stat_mgmt_hist_values[i] - hg->last[i]));
+        hg->last[i] = stat_mgmt_hist_values[i];
+    }
+
+    if (rec_len > STAT_MGMT_HIST_BUF_SIZE) {
+        /* Can never fit; fold the sample straight into base. */
+        while (hg->len > 0) {
+            stat_mgmt_hist_evict(hg);
+        }
+        memcpy(hg->base, hg->last, sizeof hg->base);
+        hg->next++;
+        hg->first = hg->next;
+        return;
+    }
+
+    while (STAT_MGMT_HIST_BUF_SIZE - hg->len < rec_len) {
+        stat_mgmt_hist_evict(hg);
+    }
+
+    off = (hg->tail + hg->len) % STAT_MGMT_HIST_BUF_SIZE;
+    for (i = 0; i < rec_len; i++) {
+        hg->ring[off] = stat_mgmt_hist_rec[i];
+        off = (off + 1) % STAT_MGMT_HIST_BUF_SIZE;
+    }
+    hg->len += rec_len;
+    hg->next++;
+}
+
+void
+stat_mgmt_hist_sample(void)
+{
+    int i;
+
+    for (i = 0; i < STAT_MGMT_HIST_GROUP_CNT; i++) {
+        if (stat_mgmt_hist_groups[i].group[0] != '\0') {
+            stat_mgmt_hist_sample_group(&stat_mgmt_hist_groups[i]);
+        }
+    }
+}
+
+int
+stat_mgmt_hist_track(const char *group_name)
+{
+    struct stat_mgmt_hist_group *hg;
+    int rc;
+
+    if (strlen(group_name) >= STAT_MGMT_MAX_NAME_LEN ||
+        group_name[0] == '\0') {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (stat_mgmt_hist_find(group_name) != NULL) {
+        return 0;
+    }
+
+    hg = stat_mgmt_hist_find("");
+    if (hg == NULL) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    memset(hg, 0, sizeof *hg);
+    strcpy(hg->group, group_name);
+
+    if (!stat_mgmt_hist_started) {
+        rc = stat_mgmt_impl_hist_start();
+        if (rc != 0 && rc != MGMT_ERR_ENOTSUP) {
+            hg->group[0] = '\0';
+            return rc;
+        }
+        stat_mgmt_hist_started = true;
+    }
+
+    return 0;
+}
+
+static int
+stat_mgmt_hist_open(struct mgmt_ctxt *ctxt, const char *group_name,
+                    uint32_t start, CborEncoder *samples)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "name");
+    err |= cbor_encode_text_stringz(&ctxt->encoder, group_name);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "itvl");
+    err |= cbor_encode_uint(&ctxt->encoder, STAT_MGMT_HIST_SAMPLE_MS);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "start");
+    err |= cbor_encode_uint(&ctxt->encoder, start);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "samples");
+    err |= cbor_encoder_create_array(&ctxt->encoder, samples,
+                                     CborIndefiniteLength);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+static int
+stat_mgmt_hist_close(struct mgmt_ctxt *ctxt, CborEncoder *samples,
+                     uint32_t next, bool more)
+{
+    CborError err;
+
+    err = 0;
+    err |= cbor_encoder_close_container(&ctxt->encoder, samples);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "next");
+    err |= cbor_encode_uint(&ctxt->encoder, next);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "more");
+    err |= cbor_encode_boolean(&ctxt->encoder, more);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Encodes one sample as an array of its field values if it is the first in
+ * its response, or of the changes since the previous sample otherwise.  The
+ * cursor is positioned at the sample's record.
+ */
+static int
+stat_mgmt_hist_encode_sample(CborEncoder *samples,
+                             struct stat_mgmt_hist_cursor cur,
+                             const uint64_t *values, bool absolute)
+{
+    CborEncoder arr;
+    CborError err;
+    int i;
+
+    err = 0;
+    err |= cbor_encoder_create_array(samples, &arr, cur.hg->field_cnt);
+    for (i = 0; i < cur.hg->field_cnt; i++) {
+        if (absolute) {
+            err |= cbor_encode_uint(&arr, values[i]);
+        } else {
+            err |= cbor_encode_int(&arr, stat_mgmt_hist_get_varint(&cur));
+        }
+    }
+    err |= cbor_encoder_close_container(samples, &arr);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: stat hist
+ *
+ * Reports a recorded group's samples numbered "since" and later.  The first
+ * sample of each response holds the field values; the others hold the change
+ * since the sample before.  If samples have been dropped, "start" is past
+ * "since".  A request with "since" set to a response's "next" continues where
+ * it left off.  The samples are split across several responses, each with
+ * "more" set in all but the last, if they exceed STAT_MGMT_MAX_RSP_LEN; a
+ * transport that can only send one response gets the first, with "more" set.
+ */
+static int
+stat_mgmt_hist(struct mgmt_ctxt *ctxt)
+{
+    char stat_name[STAT_MGMT_MAX_NAME_LEN];
+    struct stat_mgmt_hist_cursor rec;
+    struct stat_mgmt_hist_cursor cur;
+    struct stat_mgmt_hist_group *hg;
+    struct mgmt_checkpoint cp;
+    unsigned long long int since;
+    CborEncoder samples;
+    CborError err;
+    uint32_t seq;
+    int count;
+    int rc;
+
+    struct cbor_attr_t attrs[] = {
+        {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            .addr.string = stat_name,
+            .len = sizeof(stat_name)
+        },
+        {
+            .attribute = "since",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &since,
+        },
+        { NULL },
+    };
+
+    since = 0;
+    err = cbor_read_object(&ctxt->it, attrs);
+    if (err != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    hg = stat_mgmt_hist_find(stat_name);
+    if (hg == NULL || stat_name[0] == '\0') {
+        return MGMT_ERR_ENOENT;
+    }
+
+    /* Replay the records preceding the first one reported. */
+    memcpy(stat_mgmt_hist_values, hg->base, sizeof stat_mgmt_hist_values);
+    cur = (struct stat_mgmt_hist_cursor) {
+        .hg = hg,
+        .off = hg->tail,
+    };
+    seq = hg->first;
+    while (seq != hg->next && (int32_t)(seq - (uint32_t)since) < 0) {
+        stat_mgmt_hist_replay(&cur, stat_mgmt_hist_values);
+        seq++;
+    }
+
+    rc = stat_mgmt_hist_open(ctxt, stat_name, seq, &samples);
+    if (rc != 0) {
+        return rc;
+    }
+
+    for (count = 0; seq != hg->next; seq++, count++) {
+        rec = cur;
+        stat_mgmt_hist_replay(&cur, stat_mgmt_hist_values);
+
+        if (!mgmt_can_rollback(ctxt)) {
+            rc = stat_mgmt_hist_encode_sample(&samples, rec,
+                                              stat_mgmt_hist_values,
+                                              count == 0);
+            if (rc != 0) {
+                return rc;
+            }
+            continue;
+        }
+
+        mgmt_checkpoint(&samples, &cp);
+        rc = stat_mgmt_hist_encode_sample(&samples, rec,
+                                          stat_mgmt_hist_values, count == 0);
+        if (rc == 0 &&
+            cbor_encode_bytes_written(&samples) +
+            STAT_MGMT_HIST_TAIL_LEN <= STAT_MGMT_MAX_RSP_LEN) {
+
+            continue;
+        }
+        if (rc != 0 && rc != MGMT_ERR_ENOMEM) {
+            return rc;
+        }
+
+        /* The sample doesn't fit.  Back it out and, if the transport allows
+         * it, send the samples encoded so far and start a new response with
+         * this one.
+         */
+        rc = mgmt_rollback(ctxt, &samples, &cp);
+        if (rc != 0) {
+            return rc;
+        }
+        if (count == 0) {
+            return MGMT_ERR_EMSGSIZE;
+        }
+
+        rc = stat_mgmt_hist_close(ctxt, &samples, seq, true);
+        if (rc != 0 || ctxt->flush_cb == NULL) {
+            return rc;
+        }
+        rc = mgmt_flush_rsp(ctxt);
+        if (rc != 0) {
+            return rc;
+        }
+        rc = stat_mgmt_hist_open(ctxt, stat_name, seq, &samples);
+        if (rc != 0) {
+            return rc;
+        }
+
+        rc = stat_mgmt_hist_encode_sample(&samples, rec,
+                                          stat_mgmt_hist_values, true);
+        if (rc != 0) {
+            return rc;
+        }
+        count = 0;
+    }
+
+    return stat_mgmt_hist_close(ctxt, &samples, seq, false);
+}
+#endif
+
 void
 stat_mgmt_register_group(void)
 {
+#if !MGMT_STATIC_GROUPS
     mgmt_register_group(&stat_mgmt_group);
+#endif
 }
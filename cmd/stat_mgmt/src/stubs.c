@@ -31,6 +31,28 @@ stat_mgmt_impl_get_group(int idx, const char **out_name)
     return MGMT_ERR_ENOTSUP;
 }
 
+int __attribute__((weak))
+stat_mgmt_impl_foreach_group(stat_mgmt_foreach_group_fn *cb, void *arg)
+{
+    const char *group_name;
+    int rc;
+    int i;
+
+    for (i = 0; ; i++) {
+        rc = stat_mgmt_impl_get_group(i, &group_name);
+        if (rc == MGMT_ERR_ENOENT) {
+            return 0;
+        } else if (rc != 0) {
+            return rc;
+        }
+
+        rc = cb(group_name, arg);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+}
+
 int __attribute__((weak))
 stat_mgmt_impl_foreach_entry(const char *stat_name,
                              stat_mgmt_foreach_entry_fn *cb,
@@ -38,3 +60,9 @@ stat_mgmt_impl_foreach_entry(const char *stat_name,
 {
     return MGMT_ERR_ENOTSUP;
 }
+
+int __attribute__((weak))
+stat_mgmt_impl_hist_start(void)
+{
+    return MGMT_ERR_ENOTSUP;
+}
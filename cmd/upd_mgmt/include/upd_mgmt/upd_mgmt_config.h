@@ -0,0 +1,62 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_UPD_MGMT_CONFIG_
+#define H_UPD_MGMT_CONFIG_
+
+#if defined MYNEWT
+
+#include "syscfg/syscfg.h"
+
+#define UPD_MGMT_ART_MAX        MYNEWT_VAL(UPD_MGMT_ART_MAX)
+#define UPD_MGMT_CHUNK_SIZE     MYNEWT_VAL(UPD_MGMT_CHUNK_SIZE)
+#define UPD_MGMT_STAGE_SUFFIX   MYNEWT_VAL(UPD_MGMT_STAGE_SUFFIX)
+
+#elif defined __ZEPHYR__
+
+/* Maximum number of artifacts in a transaction. */
+#ifdef CONFIG_UPD_MGMT_ART_MAX
+#define UPD_MGMT_ART_MAX        CONFIG_UPD_MGMT_ART_MAX
+#else
+#define UPD_MGMT_ART_MAX        8
+#endif
+
+/* Size of the buffer that artifact data goes through. */
+#ifdef CONFIG_UPD_MGMT_CHUNK_SIZE
+#define UPD_MGMT_CHUNK_SIZE     CONFIG_UPD_MGMT_CHUNK_SIZE
+#else
+#define UPD_MGMT_CHUNK_SIZE     512
+#endif
+
+/* Appended to a file artifact's path while it is staged. */
+#ifdef CONFIG_UPD_MGMT_STAGE_SUFFIX
+#define UPD_MGMT_STAGE_SUFFIX   CONFIG_UPD_MGMT_STAGE_SUFFIX
+#else
+#define UPD_MGMT_STAGE_SUFFIX   ".upd"
+#endif
+
+#else
+
+/* No direct support for this OS.  The application needs to define the above
+ * settings itself.
+ */
+
+#endif
+
+#endif
@@ -0,0 +1,682 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * Update transactions: a client names every artifact of a release (images
+ * and files) in a manifest, sends their data in chunks that may interleave,
+ * and commits them together.  Nothing is made live until every artifact has
+ * been received and verified.
+ */
+
+#include <limits.h>
+#include <string.h>
+
+#include "tinycbor/cbor.h"
+#include "cborattr/cborattr.h"
+#include "mgmt/mgmt.h"
+#include "img_mgmt/img_mgmt.h"
+#include "img_mgmt/img_mgmt_config.h"
+#include "img_mgmt/image.h"
+#include "fs_mgmt/fs_mgmt.h"
+#include "fs_mgmt/fs_mgmt_config.h"
+#include "fs_mgmt/fs_mgmt_impl.h"
+#include "upd_mgmt/upd_mgmt.h"
+#include "upd_mgmt/upd_mgmt_config.h"
+
+/* Both image hashes and file hashes are SHA-256. */
+#define UPD_MGMT_SHA_LEN        32
+
+/* Image data is passed to img_mgmt in pieces no larger than its chunks. */
+#if UPD_MGMT_CHUNK_SIZE > IMG_MGMT_UL_CHUNK_SIZE
+#define UPD_MGMT_IMG_PIECE      IMG_MGMT_UL_CHUNK_SIZE
+#else
+#define UPD_MGMT_IMG_PIECE      UPD_MGMT_CHUNK_SIZE
+#endif
+
+static mgmt_handler_fn upd_mgmt_txn_read;
+static mgmt_handler_fn upd_mgmt_txn_write;
+static mgmt_handler_fn upd_mgmt_chunk;
+static mgmt_handler_fn upd_mgmt_commit;
+
+static const struct mgmt_handler upd_mgmt_handlers[] = {
+    [UPD_MGMT_ID_TXN] = {
+        .mh_read = upd_mgmt_txn_read,
+        .mh_write = upd_mgmt_txn_write,
+    },
+    [UPD_MGMT_ID_CHUNK] = {
+        .mh_read = NULL,
+        .mh_write = upd_mgmt_chunk,
+    },
+    [UPD_MGMT_ID_COMMIT] = {
+        .mh_read = NULL,
+        .mh_write = upd_mgmt_commit,
+    },
+};
+
+#define UPD_MGMT_HANDLER_CNT \
+    sizeof upd_mgmt_handlers / sizeof upd_mgmt_handlers[0]
+
+/* The handlers hold MGMT_RES_IMG, which serializes them with each other and
+ * with img_mgmt, and guards upd_mgmt_txn and upd_mgmt_buf.  File system
+ * calls additionally take MGMT_RES_FS, always after MGMT_RES_IMG.
+ */
+#if MGMT_STATIC_GROUPS
+static MGMT_GROUP_DEFINE_RES(upd_mgmt_group, upd_mgmt_handlers,
+                             MGMT_GROUP_ID_UPDATE, MGMT_RES_IMG);
+#else
+static struct mgmt_group upd_mgmt_group = {
+    .mg_handlers = upd_mgmt_handlers,
+    .mg_handlers_count = UPD_MGMT_HANDLER_CNT,
+    .mg_group_id = MGMT_GROUP_ID_UPDATE,
+    .mg_res = MGMT_RES_IMG,
+};
+#endif
+
+/** An artifact named by the manifest of a transaction. */
+struct upd_mgmt_art {
+    /* Decoded from the manifest.  A file artifact has no image number. */
+    unsigned long long int image;   /* ULLONG_MAX for a file */
+    unsigned long long int len;
+    struct cbor_bytestring_ref sha_ref;
+    char name[FS_MGMT_PATH_SIZE + 1];
+
+    /* Image hash of an image; SHA-256 of the contents of a file. */
+    uint8_t sha[UPD_MGMT_SHA_LEN];
+    /* Number of leading bytes staged so far. */
+    uint32_t off;
+};
+
+/** The open transaction; at most one at a time. */
+static struct {
+    /* Client-chosen ID; 0 if no transaction is open. */
+    uint32_t txn;
+    int cnt;
+    struct upd_mgmt_art art[UPD_MGMT_ART_MAX];
+} upd_mgmt_txn;
+
+/* Artifact data that is not contiguous in the request, or is read back for
+ * verification, goes through this buffer.
+ */
+static uint8_t upd_mgmt_buf[UPD_MGMT_CHUNK_SIZE];
+
+/** Progress of a chunk request. */
+struct upd_mgmt_chunk_ctxt {
+    struct upd_mgmt_art *art;
+    const char *errstr;
+};
+
+static bool
+upd_mgmt_art_is_image(const struct upd_mgmt_art *art)
+{
+    return art->image != ULLONG_MAX;
+}
+
+static int
+upd_mgmt_art_slot(const struct upd_mgmt_art *art)
+{
+    return IMG_MGMT_IMAGE_SLOT((int)art->image, 1);
+}
+
+/**
+ * Builds the path a file artifact is staged at.  The manifest check makes
+ * sure it fits.
+ */
+static void
+upd_mgmt_stage_path(const struct upd_mgmt_art *art, char *path)
+{
+    strcpy(path, art->name);
+    strcat(path, UPD_MGMT_STAGE_SUFFIX);
+}
+
+/**
+ * Checks an artifact of a new manifest against the ones before it and
+ * against the state of the device.
+ */
+static int
+upd_mgmt_art_check(int idx)
+{
+    struct upd_mgmt_art *art;
+    int rc;
+    int i;
+
+    art = &upd_mgmt_txn.art[idx];
+    if (art->len == 0 || art->len > UINT32_MAX ||
+        art->sha_ref.len != UPD_MGMT_SHA_LEN) {
+
+        return MGMT_ERR_EINVAL;
+    }
+
+    rc = cbor_bytestring_ref_copy(&art->sha_ref, 0, art->sha,
+                                  UPD_MGMT_SHA_LEN);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (upd_mgmt_art_is_image(art)) {
+        if (art->name[0] != '\0' || art->image >= IMG_MGMT_IMAGE_COUNT) {
+            return MGMT_ERR_EINVAL;
+        }
+        for (i = 0; i < idx; i++) {
+            if (upd_mgmt_txn.art[i].image == art->image) {
+                return MGMT_ERR_EINVAL;
+            }
+        }
+
+        /* The slot must be free to receive the image. */
+        if (img_mgmt_slot_in_use(upd_mgmt_art_slot(art))) {
+            return MGMT_ERR_EBADSTATE;
+        }
+    } else {
+#if !FS_MGMT_HASH_SHA256
+        /* Staged files could not be verified. */
+        return MGMT_ERR_ENOTSUP;
+#endif
+        if (art->name[0] == '\0' ||
+            strlen(art->name) + strlen(UPD_MGMT_STAGE_SUFFIX) >
+            FS_MGMT_PATH_SIZE) {
+
+            return MGMT_ERR_EINVAL;
+        }
+        for (i = 0; i < idx; i++) {
+            if (strcmp(upd_mgmt_txn.art[i].name, art->name) == 0) {
+                return MGMT_ERR_EINVAL;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: update transaction (read).  Reports the open transaction
+ * and how much of each artifact has been staged.
+ */
+static int
+upd_mgmt_txn_read(struct mgmt_ctxt *ctxt)
+{
+    CborEncoder offs;
+    CborError err;
+    int i;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "txn");
+    err |= cbor_encode_uint(&ctxt->encoder, upd_mgmt_txn.txn);
+    if (upd_mgmt_txn.txn != 0) {
+        err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+        err |= cbor_encoder_create_array(&ctxt->encoder, &offs,
+                                         upd_mgmt_txn.cnt);
+        for (i = 0; i < upd_mgmt_txn.cnt; i++) {
+            err |= cbor_encode_uint(&offs, upd_mgmt_txn.art[i].off);
+        }
+        err |= cbor_encoder_close_container(&ctxt->encoder, &offs);
+    }
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: update transaction (write).  Opens a transaction from a
+ * manifest, abandoning any transaction already open.  The device state is
+ * checked here once for the whole release rather than for every chunk.
+ */
+static int
+upd_mgmt_txn_write(struct mgmt_ctxt *ctxt)
+{
+    unsigned long long int txn;
+    CborError err;
+    int cnt;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t art_attr[] = {
+        [0] = {
+            .attribute = "image",
+            .type = CborAttrUnsignedIntegerType,
+            CBORATTR_STRUCT_OBJECT(struct upd_mgmt_art, image),
+            .nodefault = true,
+        },
+        [1] = {
+            .attribute = "name",
+            .type = CborAttrTextStringType,
+            CBORATTR_STRUCT_OBJECT(struct upd_mgmt_art, name),
+            .len = sizeof upd_mgmt_txn.art[0].name,
+        },
+        [2] = {
+            .attribute = "len",
+            .type = CborAttrUnsignedIntegerType,
+            CBORATTR_STRUCT_OBJECT(struct upd_mgmt_art, len),
+            .nodefault = true,
+        },
+        [3] = {
+            .attribute = "sha",
+            .type = CborAttrByteStringRefType,
+            CBORATTR_STRUCT_OBJECT(struct upd_mgmt_art, sha_ref),
+            .len = UPD_MGMT_SHA_LEN,
+        },
+        [4] = { 0 },
+    };
+
+    const struct cbor_attr_t txn_attr[] = {
+        [0] = {
+            .attribute = "txn",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &txn,
+            .nodefault = true,
+        },
+        [1] = {
+            .attribute = "art",
+            .type = CborAttrArrayType,
+            CBORATTR_STRUCT_ARRAY(upd_mgmt_txn.art, art_attr, &cnt),
+            .nodefault = true,
+        },
+        [2] = { 0 },
+    };
+
+    /* The manifest is decoded in place of the open transaction. */
+    upd_mgmt_txn.txn = 0;
+    upd_mgmt_txn.cnt = 0;
+    memset(upd_mgmt_txn.art, 0, sizeof upd_mgmt_txn.art);
+    for (i = 0; i < UPD_MGMT_ART_MAX; i++) {
+        upd_mgmt_txn.art[i].image = ULLONG_MAX;
+        upd_mgmt_txn.art[i].len = 0;
+    }
+
+    txn = 0;
+    cnt = 0;
+    rc = cbor_read_object(&ctxt->it, txn_attr);
+    if (rc != 0 || txn == 0 || txn > UINT32_MAX || cnt == 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    for (i = 0; i < cnt; i++) {
+        rc = upd_mgmt_art_check(i);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    upd_mgmt_txn.txn = txn;
+    upd_mgmt_txn.cnt = cnt;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "txn");
+    err |= cbor_encode_uint(&ctxt->encoder, upd_mgmt_txn.txn);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Stages a piece of a chunk request's data at the end of its artifact.
+ */
+static int
+upd_mgmt_stage_piece(const uint8_t *data, size_t off, size_t len, void *arg)
+{
+    char path[FS_MGMT_PATH_SIZE + 1];
+    struct upd_mgmt_chunk_ctxt *cc;
+    struct upd_mgmt_art *art;
+    int rc;
+
+    cc = arg;
+    art = cc->art;
+
+    if (upd_mgmt_art_is_image(art)) {
+        rc = img_mgmt_stage_chunk(art->image, art->off, art->len, data, len,
+                                  &cc->errstr);
+    } else {
+        upd_mgmt_stage_path(art, path);
+        mgmt_res_lock(MGMT_RES_FS);
+        rc = fs_mgmt_impl_write(path, art->off, data, len);
+        mgmt_res_unlock(MGMT_RES_FS);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    art->off += len;
+    return 0;
+}
+
+/**
+ * Command handler: update chunk.  Appends data to an artifact of the open
+ * transaction.  A chunk that is not at the artifact's staged length is
+ * ignored, and the response tells the client where to continue.
+ */
+static int
+upd_mgmt_chunk(struct mgmt_ctxt *ctxt)
+{
+    struct cbor_bytestring_ref data_ref;
+    struct upd_mgmt_chunk_ctxt cc;
+    unsigned long long int txn;
+    unsigned long long int idx;
+    unsigned long long int off;
+    struct upd_mgmt_art *art;
+    CborError err;
+    size_t piece;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t chunk_attr[] = {
+        [0] = {
+            .attribute = "txn",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &txn,
+            .nodefault = true,
+        },
+        [1] = {
+            .attribute = "art",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &idx,
+            .nodefault = true,
+        },
+        [2] = {
+            .attribute = "off",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &off,
+            .nodefault = true,
+        },
+        [3] = {
+            .attribute = "data",
+            .type = CborAttrByteStringRefType,
+            .addr.bytestring_ref = &data_ref,
+            .len = UINT16_MAX,
+        },
+        [4] = { 0 },
+    };
+
+    txn = 0;
+    idx = ULLONG_MAX;
+    off = ULLONG_MAX;
+    rc = cbor_read_object(&ctxt->it, chunk_attr);
+    if (rc != 0 || off == ULLONG_MAX) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (upd_mgmt_txn.txn == 0 || txn != upd_mgmt_txn.txn) {
+        return MGMT_ERR_EBADSTATE;
+    }
+    if (idx >= (unsigned long long int)upd_mgmt_txn.cnt) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    art = &upd_mgmt_txn.art[idx];
+    if (off == art->off && data_ref.len != 0) {
+        if (data_ref.len > art->len - art->off) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        if (upd_mgmt_art_is_image(art)) {
+            /* img_mgmt takes one image at a time; another image's upload
+             * has to complete first.
+             */
+            for (i = 0; i < upd_mgmt_txn.cnt; i++) {
+                if (&upd_mgmt_txn.art[i] != art &&
+                    upd_mgmt_art_is_image(&upd_mgmt_txn.art[i]) &&
+                    upd_mgmt_txn.art[i].off != 0 &&
+                    upd_mgmt_txn.art[i].off < upd_mgmt_txn.art[i].len) {
+
+                    return MGMT_ERR_EBADSTATE;
+                }
+            }
+            piece = UPD_MGMT_IMG_PIECE;
+        } else {
+            piece = UPD_MGMT_CHUNK_SIZE;
+        }
+
+        cc.art = art;
+        cc.errstr = NULL;
+        rc = cbor_bytestring_ref_foreach(&data_ref, upd_mgmt_buf, piece,
+                                         upd_mgmt_stage_piece, &cc);
+        if (rc != 0) {
+            /* What was staged cannot be trusted; start the artifact over. */
+            art->off = 0;
+            if (cc.errstr != NULL) {
+                return img_mgmt_error_rsp(ctxt, rc, cc.errstr);
+            }
+            return rc;
+        }
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "art");
+    err |= cbor_encode_uint(&ctxt->encoder, idx);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "off");
+    err |= cbor_encode_uint(&ctxt->encoder, art->off);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Hashes a staged file and compares the digest with the manifest's.  Called
+ * with MGMT_RES_FS held.
+ */
+static int
+upd_mgmt_verify_file(const struct upd_mgmt_art *art)
+{
+    uint8_t digest[FS_MGMT_SHA256_LEN];
+    char path[FS_MGMT_PATH_SIZE + 1];
+    size_t file_len;
+    size_t len;
+    size_t off;
+    int rc;
+
+    upd_mgmt_stage_path(art, path);
+
+    rc = fs_mgmt_impl_sync(path);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = fs_mgmt_impl_filelen(path, &file_len);
+    if (rc != 0) {
+        return rc;
+    }
+    if (file_len != art->len) {
+        return MGMT_ERR_ECORRUPT;
+    }
+
+    rc = fs_mgmt_impl_sha256_start();
+    if (rc != 0) {
+        return rc;
+    }
+
+    for (off = 0; off < art->len; off += len) {
+        rc = fs_mgmt_impl_read(path, off, sizeof upd_mgmt_buf, upd_mgmt_buf,
+                               &len);
+        if (rc == 0 && len == 0) {
+            rc = MGMT_ERR_ECORRUPT;
+        }
+        if (rc == 0) {
+            rc = fs_mgmt_impl_sha256_update(upd_mgmt_buf, len);
+        }
+        if (rc != 0) {
+            break;
+        }
+    }
+
+    /* Always finish the hash so that its context is released. */
+    if (fs_mgmt_impl_sha256_finish(digest) != 0 && rc == 0) {
+        rc = MGMT_ERR_EUNKNOWN;
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (memcmp(digest, art->sha, UPD_MGMT_SHA_LEN) != 0) {
+        return MGMT_ERR_ECORRUPT;
+    }
+
+    return 0;
+}
+
+/**
+ * Checks a staged image's hash against the manifest's.  MCUboot validates
+ * the rest of the image before it swaps it in.
+ */
+static int
+upd_mgmt_verify_image(const struct upd_mgmt_art *art)
+{
+    uint8_t hash[IMAGE_HASH_LEN];
+    int rc;
+
+    rc = img_mgmt_read_info(upd_mgmt_art_slot(art), NULL, hash, NULL);
+    if (rc != 0) {
+        return MGMT_ERR_ECORRUPT;
+    }
+
+    if (memcmp(hash, art->sha, UPD_MGMT_SHA_LEN) != 0) {
+        return MGMT_ERR_ECORRUPT;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: update commit.  Verifies every artifact of the open
+ * transaction, then moves the staged files into place and marks the staged
+ * images pending.  An artifact that fails verification is started over and
+ * the transaction stays open.
+ */
+static int
+upd_mgmt_commit(struct mgmt_ctxt *ctxt)
+{
+    char path[FS_MGMT_PATH_SIZE + 1];
+    unsigned long long int txn;
+    struct upd_mgmt_art *art;
+    CborError err;
+    bool confirm;
+    int rc;
+    int i;
+
+    const struct cbor_attr_t commit_attr[] = {
+        [0] = {
+            .attribute = "txn",
+            .type = CborAttrUnsignedIntegerType,
+            .addr.uinteger = &txn,
+            .nodefault = true,
+        },
+        [1] = {
+            .attribute = "confirm",
+            .type = CborAttrBooleanType,
+            .addr.boolean = &confirm,
+            .dflt.boolean = false,
+        },
+        [2] = { 0 },
+    };
+
+    txn = 0;
+    rc = cbor_read_object(&ctxt->it, commit_attr);
+    if (rc != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (upd_mgmt_txn.txn == 0 || txn != upd_mgmt_txn.txn) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    for (i = 0; i < upd_mgmt_txn.cnt; i++) {
+        if (upd_mgmt_txn.art[i].off != upd_mgmt_txn.art[i].len) {
+            return MGMT_ERR_EBADSTATE;
+        }
+    }
+
+    for (i = 0; i < upd_mgmt_txn.cnt; i++) {
+        art = &upd_mgmt_txn.art[i];
+        if (upd_mgmt_art_is_image(art)) {
+            rc = upd_mgmt_verify_image(art);
+        } else {
+            mgmt_res_lock(MGMT_RES_FS);
+            rc = upd_mgmt_verify_file(art);
+            mgmt_res_unlock(MGMT_RES_FS);
+        }
+        if (rc != 0) {
+            art->off = 0;
+            return rc;
+        }
+    }
+
+    /* Past this point the staged data is consumed; a failure leaves the
+     * artifacts applied so far in place and the client has to start over.
+     * Images are marked pending last, so that the new firmware never boots
+     * without its files.
+     */
+    upd_mgmt_txn.txn = 0;
+
+    rc = 0;
+    mgmt_res_lock(MGMT_RES_FS);
+    for (i = 0; i < upd_mgmt_txn.cnt; i++) {
+        art = &upd_mgmt_txn.art[i];
+        if (!upd_mgmt_art_is_image(art)) {
+            upd_mgmt_stage_path(art, path);
+            rc = fs_mgmt_impl_rename(path, art->name);
+            if (rc != 0) {
+                break;
+            }
+        }
+    }
+    mgmt_res_unlock(MGMT_RES_FS);
+    if (rc != 0) {
+        return rc;
+    }
+
+    for (i = 0; i < upd_mgmt_txn.cnt; i++) {
+        art = &upd_mgmt_txn.art[i];
+        if (upd_mgmt_art_is_image(art)) {
+            rc = img_mgmt_state_set_pending(upd_mgmt_art_slot(art), confirm);
+            if (rc != 0) {
+                return rc;
+            }
+        }
+    }
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+void
+upd_mgmt_register_group(void)
+{
+#if !MGMT_STATIC_GROUPS
+    mgmt_register_group(&upd_mgmt_group);
+#endif
+}
+
+void
+upd_mgmt_module_init(void)
+{
+    upd_mgmt_register_group();
+}
@@ -22,6 +22,7 @@
 
 #include <inttypes.h>
 #include "tinycbor/cbor.h"
+#include "mgmt/mgmt_config.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,6 +51,8 @@ extern "C" {
 #define MGMT_GROUP_ID_RUN       7
 #define MGMT_GROUP_ID_FS        8
 #define MGMT_GROUP_ID_SHELL     9
+#define MGMT_GROUP_ID_AUTH      10
+#define MGMT_GROUP_ID_UPDATE    11
 #define MGMT_GROUP_ID_PERUSER   64
 
 /**
@@ -65,10 +68,23 @@ extern "C" {
 #define MGMT_ERR_EMSGSIZE       7       /* Response too large. */
 #define MGMT_ERR_ENOTSUP        8       /* Command not supported. */
 #define MGMT_ERR_ECORRUPT       9       /* Corrupt */
+#define MGMT_ERR_EACCESSDENIED  10      /* Not authenticated. */
 #define MGMT_ERR_EPERUSER       256
 
+/**
+ * Returned by a handler that has deferred its response with mgmt_defer();
+ * never sent to the client.
+ */
+#define MGMT_ERR_EPENDING       (-1)
+
 #define MGMT_HDR_SIZE           8
 
+/**
+ * Compression schemes of the "comp" field of transfer requests.
+ */
+#define MGMT_COMP_NONE          0
+#define MGMT_COMP_HS            1       /* heatshrink, window 8, lookahead 4 */
+
 /*
  * MGMT event opcodes.
  */
@@ -76,6 +92,13 @@ extern "C" {
 #define MGMT_EVT_OP_CMD_STATUS          0x02
 #define MGMT_EVT_OP_CMD_DONE            0x03
 
+/* Event mask bit for the specified MGMT_EVT_OP_[...] code. */
+#define MGMT_EVT_MASK(op_)              (1u << (op_))
+#define MGMT_EVT_MASK_ALL               0xff
+
+/* Subscribes to the events of every command group. */
+#define MGMT_EVT_GROUP_ALL              0xffff
+
 struct mgmt_hdr {
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
     uint8_t  nh_op:3;           /* MGMT_OP_[...] */
@@ -121,6 +144,41 @@ struct mgmt_evt_op_cmd_done_arg {
 typedef void mgmt_on_evt_cb(uint8_t opcode, uint16_t group, uint8_t id,
                             void *arg);
 
+/** @typedef mgmt_evt_sub_fn
+ * @brief Function to be called on an MGMT event a subscriber is interested
+ *        in.
+ *
+ * @param opcode                MGMT_EVT_OP_[...].
+ * @param group                 MGMT_GROUP_ID_[...].
+ * @param id                    Message ID within group.
+ * @param arg                   Optional event argument.
+ * @param cb_arg                The subscriber's argument.
+ *
+ * @return                      For MGMT_EVT_OP_CMD_RECV, 0 to let the command
+ *                                  run, or a MGMT_ERR_[...] code to reject it
+ *                                  with that status;
+ *                              Ignored for other events.
+ */
+typedef int mgmt_evt_sub_fn(uint8_t opcode, uint16_t group, uint8_t id,
+                            void *arg, void *cb_arg);
+
+/**
+ * @brief A subscriber to MGMT events.
+ */
+struct mgmt_evt_sub {
+    mgmt_evt_sub_fn *cb;
+    void *cb_arg;
+
+    /* MGMT_EVT_MASK() bits of the events to receive. */
+    uint8_t evt_mask;
+
+    /* The command group to receive events for, or MGMT_EVT_GROUP_ALL. */
+    uint16_t group;
+
+    /* Points to the next subscriber in the list. */
+    struct mgmt_evt_sub *next;
+};
+
 /** @typedef mgmt_alloc_rsp_fn
  * @brief Allocates a buffer suitable for holding a response.
  *
@@ -174,6 +232,18 @@ typedef void mgmt_reset_buf_fn(void *buf, void *arg);
 typedef int mgmt_write_at_fn(struct cbor_encoder_writer *writer, size_t offset,
                              const void *data, size_t len, void *arg);
 
+/** @typedef mgmt_truncate_fn
+ * @brief Discards data written to a CBOR encoder past the specified length.
+ *
+ * @param writer                The encoder to truncate.
+ * @param len                   The number of bytes to keep.
+ * @param arg                   Optional streamer argument.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int mgmt_truncate_fn(struct cbor_encoder_writer *writer, size_t len,
+                             void *arg);
+
 /** @typedef mgmt_init_reader_fn
  * @brief Initializes a CBOR reader with the specified buffer.
  *
@@ -206,6 +276,43 @@ typedef int mgmt_init_writer_fn(struct cbor_encoder_writer *writer, void *buf,
  */
 typedef void mgmt_free_buf_fn(void *buf, void *arg);
 
+/**
+ * @brief A contiguous segment of a possibly fragmented buffer, e.g., one
+ *        mbuf of an mbuf chain.
+ */
+struct mgmt_span {
+    /* Data of the segment. */
+    const uint8_t *data;
+    /* Offset of the segment's first byte within the buffer. */
+    size_t off;
+    /* Length of the segment; 0 if there is no segment at the offset. */
+    size_t len;
+    /* Transport-defined handle of the segment, e.g., its mbuf. */
+    void *seg;
+};
+
+/** @typedef mgmt_get_span_fn
+ * @brief Finds the contiguous segment of a buffer that holds the specified
+ *        offset.
+ *
+ * On entry, the span describes the segment found by the previous call for
+ * the same buffer, or has a length of 0 if there was none.  A chained buffer
+ * can walk on from that segment rather than from the start of the chain, so
+ * that sequential accesses take constant time.
+ *
+ * @param buf                   The buffer to look into.
+ * @param off                   The offset to find.
+ * @param span                  The previous segment on entry; on success,
+ *                                  the segment holding the offset, or one of
+ *                                  length 0 if the offset is past the end of
+ *                                  the buffer.
+ * @param arg                   Optional streamer argument.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int mgmt_get_span_fn(void *buf, size_t off, struct mgmt_span *span,
+                             void *arg);
+
 /**
  * @brief Configuration for constructing a mgmt_streamer object.
  */
@@ -217,6 +324,36 @@ struct mgmt_streamer_cfg {
     mgmt_init_reader_fn *init_reader;
     mgmt_init_writer_fn *init_writer;
     mgmt_free_buf_fn *free_buf;
+
+    /* Optional; required for mgmt_rollback(). */
+    mgmt_truncate_fn *truncate;
+
+    /* Optional; for transports with fragmented request buffers.  If set,
+     * the streamer's reader must be a struct mgmt_sg_reader, which mgmt
+     * initializes over the buffer's segments in place of init_reader.
+     */
+    mgmt_get_span_fn *get_span;
+};
+
+/* Slots of struct mgmt_session; one per command group that keeps state across
+ * requests.
+ */
+#define MGMT_SESSION_SLOT_FS_UL     0
+#define MGMT_SESSION_SLOT_COUNT     1
+
+/**
+ * @brief State that command groups keep between the requests of one client.
+ *
+ * Each group owns one slot and manages what it points to.  A transport that
+ * processes requests concurrently with other transports gives each of its
+ * streamers a session so that, e.g., a file upload over one transport is not
+ * disturbed by requests arriving on another.  Streamers without a session
+ * share a default one.  Sessions must be zero-initialized, and a transport
+ * that hands a session over to a new client clears it with
+ * mgmt_session_reset() first.
+ */
+struct mgmt_session {
+    void *state[MGMT_SESSION_SLOT_COUNT];
 };
 
 /**
@@ -227,8 +364,102 @@ struct mgmt_streamer {
     void *cb_arg;
     struct cbor_decoder_reader *reader;
     struct cbor_encoder_writer *writer;
+
+    /* Largest packet, including the mcumgr header, that the transport can
+     * currently carry; 0 if not known.  Transports whose MTU changes at
+     * runtime (e.g., BLE) keep this up to date.
+     */
+    uint16_t mtu;
+
+    /* Number of request buffers the transport can have in flight; 0 if not
+     * known.
+     */
+    uint8_t buf_count;
+
+    /* Optional; state kept for the client of this streamer. */
+    struct mgmt_session *session;
 };
 
+struct mgmt_ctxt;
+
+struct mgmt_async;
+
+/** @typedef mgmt_async_encode_fn
+ * @brief Writes the body of a deferred response.
+ *
+ * The encoder of the supplied context writes into the open root map of the
+ * response; the callback must encode the "rc" field along with any others.
+ *
+ * @param ctxt                  The mcumgr context to encode into.
+ * @param arg                   Optional argument passed to
+ *                                  mgmt_complete_async().
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int mgmt_async_encode_fn(struct mgmt_ctxt *ctxt, void *arg);
+
+/** @typedef mgmt_async_complete_fn
+ * @brief Encodes and transmits a deferred response.
+ *
+ * @param async                 The deferred response to complete.
+ * @param status                MGMT_ERR_EOK to send the response written by
+ *                                  encode_cb; otherwise, the status to send
+ *                                  in an error response.
+ * @param encode_cb             Writes the response body; may be NULL.
+ * @param arg                   Optional argument passed to encode_cb.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int mgmt_async_complete_fn(struct mgmt_async *async, int status,
+                                   mgmt_async_encode_fn *encode_cb,
+                                   void *arg);
+
+/** @typedef mgmt_defer_fn
+ * @brief Prepares a deferred response to the request being processed.
+ *
+ * @param ctxt                  The mcumgr context of the request.
+ * @param async                 The deferred response to fill in.
+ * @param arg                   Optional transport-specific argument.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int mgmt_defer_fn(struct mgmt_ctxt *ctxt, struct mgmt_async *async,
+                          void *arg);
+
+/**
+ * @brief A response that a handler completes after it has returned.
+ *
+ * The storage belongs to the handler and must remain valid until
+ * mgmt_complete_async() is called; the fields are filled in by the transport.
+ */
+struct mgmt_async {
+    mgmt_async_complete_fn *complete_cb;
+
+    /* Transport state the response is completed with (for SMP, the
+     * streamer the request arrived on); must outlive the response.
+     */
+    void *complete_arg;
+
+    /* Header of the request being responded to (host-byte order). */
+    struct mgmt_hdr req_hdr;
+
+    /* Buffer the response gets written to. */
+    void *rsp;
+};
+
+/** @typedef mgmt_flush_rsp_fn
+ * @brief Transmits the response encoded so far and starts a new one.
+ *
+ * On return, the context's encoder writes into the root map of a fresh
+ * response to the same request.
+ *
+ * @param ctxt                  The mcumgr context to flush.
+ * @param arg                   Optional transport-specific argument.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int mgmt_flush_rsp_fn(struct mgmt_ctxt *ctxt, void *arg);
+
 /**
  * @brief Context required by command handlers for parsing requests and writing
  *        responses.
@@ -237,6 +468,46 @@ struct mgmt_ctxt {
     struct CborEncoder encoder;
     struct CborParser parser;
     struct CborValue it;
+
+    /* Set by transports that can split one response across several packets;
+     * NULL otherwise.
+     */
+    mgmt_flush_rsp_fn *flush_cb;
+    void *flush_arg;
+
+    /* Set by transports that can send a response after the handler has
+     * returned; NULL otherwise.
+     */
+    mgmt_defer_fn *defer_cb;
+    void *defer_arg;
+
+    /* The streamer the response is written with; NULL if not known. */
+    struct mgmt_streamer *streamer;
+};
+
+/**
+ * @brief A position in a response that encoding can be rolled back to.
+ */
+struct mgmt_checkpoint {
+    struct CborEncoder encoder;
+    size_t len;
+};
+
+/**
+ * @brief A definite-length map or array whose element count is only known
+ *        once its contents have been encoded.
+ *
+ * The container header is written with a two-byte count which gets patched
+ * when the container is closed.
+ */
+struct mgmt_counted {
+    /* Encodes the elements of the container. */
+    struct CborEncoder encoder;
+
+    /* Response offset of the container header; SIZE_MAX if the container
+     * fell back to indefinite length.
+     */
+    size_t hdr_off;
 };
 
 /** @typedef mgmt_handler_fn
@@ -244,21 +515,58 @@ struct mgmt_ctxt {
  *
  * A separate handler is required for each supported op-ID pair.
  *
+ * A handler that cannot respond right away can call mgmt_defer() and return
+ * MGMT_ERR_EPENDING; the transport then carries on with other requests, and
+ * the handler sends its response later with mgmt_complete_async().
+ *
  * @param ctxt                  The mcumgr context to use.
  *
  * @return                      0 if a response was successfully encoded,
- *                                  MGMT_ERR_[...] code on failure.
+ *                              MGMT_ERR_EPENDING if the response was
+ *                                  deferred,
+ *                              MGMT_ERR_[...] code on failure.
  */
 typedef int mgmt_handler_fn(struct mgmt_ctxt *ctxt);
 
+/* mgmt_handler flags. */
+
+/* Latency-sensitive command (e.g., a heartbeat); transports that queue
+ * requests serve it ahead of others.  See smp_sched.
+ */
+#define MGMT_HANDLER_F_HIPRI    0x01
+
 /**
  * @brief Read handler and write handler for a single command ID.
  */
 struct mgmt_handler {
     mgmt_handler_fn *mh_read;
     mgmt_handler_fn *mh_write;
+
+    /* MGMT_HANDLER_F_[...] */
+    uint8_t mh_flags;
+
+    /* Optional; marks the read handler as idempotent.  Its response depends
+     * only on the request payload and on the state this counter versions;
+     * whatever changes that state increments the counter.  Transports may
+     * then answer repeated reads from a cache until the counter changes.
+     */
+    const volatile uint32_t *mh_read_epoch;
 };
 
+/* Epoch of read handlers whose responses never change, e.g., lists of
+ * compile-time constants.
+ */
+extern const uint32_t mgmt_const_epoch;
+
+/* Shared resources that handlers running on different transports' threads
+ * take turns using; see mgmt_set_res_lock().
+ */
+#define MGMT_RES_NONE           0
+#define MGMT_RES_IMG            1   /* Image slots. */
+#define MGMT_RES_FS             2   /* File system and its open files. */
+#define MGMT_RES_SHELL          3   /* Shell and its output buffer. */
+#define MGMT_RES_CRASH          4   /* Core dump partition. */
+
 /**
  * @brief A collection of handlers for an entire command group.
  */
@@ -272,8 +580,53 @@ struct mgmt_group {
 
     /* The numeric ID of this group. */
     uint16_t mg_group_id;
+
+    /* Resource (MGMT_RES_[...]) held while one of the group's handlers
+     * runs; MGMT_RES_NONE if the handlers may run concurrently.
+     */
+    uint8_t mg_res;
 };
 
+#if MGMT_STATIC_GROUPS
+/**
+ * @brief Defines a command group at build time.
+ *
+ * The group is placed in a dedicated linker section in read-only memory and
+ * is found by mgmt_find_handler() without a call to mgmt_register_group().
+ * Statically defined groups cannot be unregistered.  The bundled command
+ * groups are defined this way when MGMT_STATIC_GROUPS is set; their
+ * [...]_register_group() functions then link nothing at runtime.
+ *
+ * @param name_                 Name of the group object.
+ * @param handlers_             Array of handlers (struct mgmt_handler).
+ * @param group_id_             The numeric ID of the group.
+ *
+ * Groups that need a shared resource held while their handlers run are
+ * defined with MGMT_GROUP_DEFINE_RES() instead.
+ */
+#define MGMT_GROUP_DEFINE(name_, handlers_, group_id_)                  \
+    MGMT_GROUP_DEFINE_RES(name_, handlers_, group_id_, MGMT_RES_NONE)
+
+/**
+ * @brief Defines a command group at build time whose handlers use a shared
+ *        resource.
+ *
+ * @param name_                 Name of the group object.
+ * @param handlers_             Array of handlers (struct mgmt_handler).
+ * @param group_id_             The numeric ID of the group.
+ * @param res_                  The resource; MGMT_RES_[...].
+ */
+#define MGMT_GROUP_DEFINE_RES(name_, handlers_, group_id_, res_)        \
+    const struct mgmt_group name_                                       \
+    __attribute__((__section__("._mgmt_group.static." #name_), used)) = \
+    {                                                                   \
+        .mg_handlers = (handlers_),                                     \
+        .mg_handlers_count = sizeof (handlers_) / sizeof (handlers_)[0], \
+        .mg_group_id = (group_id_),                                     \
+        .mg_res = (res_),                                               \
+    }
+#endif
+
 /**
  * @brief Uses the specified streamer to allocates a response buffer.
  *
@@ -289,6 +642,13 @@ struct mgmt_group {
 void *mgmt_streamer_alloc_rsp(struct mgmt_streamer *streamer,
                               const void *src_buf);
 
+/**
+ * @brief Returns the number of times a transport failed to allocate a
+ *        response buffer, across all streamers.  Each failure costs the
+ *        client an ENOMEM response or a lost request.
+ */
+uint32_t mgmt_alloc_rsp_failures(void);
+
 /**
  * @brief Uses the specified streamer to trim data from the front of a buffer.
  *
@@ -359,6 +719,20 @@ int mgmt_streamer_init_writer(struct mgmt_streamer *streamer, void *buf);
  */
 void mgmt_streamer_free_buf(struct mgmt_streamer *streamer, void *buf);
 
+/**
+ * @brief Uses the specified streamer to discard response data past the
+ *        specified length.
+ *
+ * @param streamer              The streamer providing the callback.
+ * @param len                   The number of bytes to keep.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if the streamer has no
+ *                                  truncate callback;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int mgmt_streamer_truncate(struct mgmt_streamer *streamer, size_t len);
+
 /**
  * @brief Registers a full command group.
  *
@@ -366,6 +740,69 @@ void mgmt_streamer_free_buf(struct mgmt_streamer *streamer, void *buf);
  */
 void mgmt_register_group(struct mgmt_group *group);
 
+/** @typedef mgmt_res_lock_fn
+ * @brief Acquires or releases a shared resource.
+ *
+ * @param res                   The resource; MGMT_RES_[...].
+ * @param arg                   Optional argument passed to
+ *                                  mgmt_set_res_lock().
+ */
+typedef void mgmt_res_lock_fn(int res, void *arg);
+
+/**
+ * @brief Sets the callbacks that serialize access to shared resources.
+ *
+ * Required if requests from different transports are processed in different
+ * threads; otherwise, no locking is done.  Each resource needs its own lock
+ * (e.g., a mutex), so that only requests competing for the same resource
+ * wait for each other.
+ *
+ * @param lock_cb               Acquires the specified resource.
+ * @param unlock_cb             Releases the specified resource.
+ * @param arg                   Optional argument passed to the callbacks.
+ */
+void mgmt_set_res_lock(mgmt_res_lock_fn *lock_cb,
+                       mgmt_res_lock_fn *unlock_cb, void *arg);
+
+/**
+ * @brief Acquires a shared resource.  Handlers are called with their group's
+ *        resource held already; this is for work done outside of a handler,
+ *        e.g., in a timer.
+ *
+ * @param res                   The resource; MGMT_RES_[...].
+ */
+void mgmt_res_lock(int res);
+
+/**
+ * @brief Releases a shared resource acquired with mgmt_res_lock().
+ *
+ * @param res                   The resource; MGMT_RES_[...].
+ */
+void mgmt_res_unlock(int res);
+
+/**
+ * @brief Clears a session, so that its next client does not pick up the state
+ *        of the previous one.  The state the session pointed to is
+ *        abandoned; groups reclaim it as they would any stale entry.
+ *
+ * Takes the resource of each slot's group in turn, so it must not be called
+ * from a handler or with a resource held.
+ *
+ * @param session               The session to clear.
+ */
+void mgmt_session_reset(struct mgmt_session *session);
+
+/**
+ * @brief Retrieves the session of the client that sent the request being
+ *        processed.
+ *
+ * @param ctxt                  The mcumgr context of the request.
+ *
+ * @return                      The streamer's session if it has one; the
+ *                                  default session otherwise.
+ */
+struct mgmt_session *mgmt_ctxt_session(const struct mgmt_ctxt *ctxt);
+
 /**
  * @brief Unregisters a full command group.
  *
@@ -386,6 +823,61 @@ mgmt_unregister_group(struct mgmt_group *group);
 const struct mgmt_handler *mgmt_find_handler(uint16_t group_id,
                                              uint16_t command_id);
 
+/**
+ * @brief Converts a request opcode to its corresponding response opcode.
+ *
+ * @param req_op                MGMT_OP_READ or MGMT_OP_WRITE.
+ *
+ * @return                      MGMT_OP_READ_RSP or MGMT_OP_WRITE_RSP.
+ */
+uint8_t mgmt_rsp_op(uint8_t req_op);
+
+/**
+ * @brief Checks that a request has a handler, without running it.  This lets
+ *        a transport reject unsupported requests before it spends a response
+ *        buffer on them.
+ *
+ * @param req_hdr               The request header (host-byte order).
+ *
+ * @return                      0 if mgmt_dispatch() would find a handler;
+ *                              MGMT_ERR_ENOTSUP if there is no such command;
+ *                              MGMT_ERR_EINVAL if the operation is invalid.
+ */
+int mgmt_check_req(const struct mgmt_hdr *req_hdr);
+
+/**
+ * @brief Runs the command handler for a request.  This is the dispatch core
+ *        shared by all transports: it looks the handler up, lets event
+ *        subscribers reject the command (MGMT_EVT_OP_CMD_RECV), and calls the
+ *        handler with the context positioned at the request payload.
+ *
+ * @param ctxt                  The management context of the request.
+ * @param req_hdr               The request header (host-byte order).
+ * @param out_handler_found     On return, whether the command has a handler
+ *                                  for the request's operation.  If so, the
+ *                                  caller reports completion with
+ *                                  mgmt_dispatch_done().
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if there is no such command;
+ *                              MGMT_ERR_EINVAL if the operation is invalid;
+ *                              MGMT_ERR_EPENDING if the response was
+ *                                  deferred;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int mgmt_dispatch(struct mgmt_ctxt *ctxt, const struct mgmt_hdr *req_hdr,
+                  bool *out_handler_found);
+
+/**
+ * @brief Reports the completion of a request that mgmt_dispatch() found a
+ *        handler for (MGMT_EVT_OP_CMD_DONE).
+ *
+ * @param req_hdr               The request header (host-byte order).
+ * @param status                The MGMT_ERR_[...] code the request completed
+ *                                  with.
+ */
+void mgmt_dispatch_done(const struct mgmt_hdr *req_hdr, int status);
+
 /**
  * @brief Encodes a response status into the specified management context.
  *
@@ -396,6 +888,157 @@ const struct mgmt_handler *mgmt_find_handler(uint16_t group_id,
  */
 int mgmt_write_rsp_status(struct mgmt_ctxt *ctxt, int status);
 
+/**
+ * @brief Transmits the partial response in the specified management context
+ *        and begins a new one.  Handlers that produce more data than fits in
+ *        a single packet use this to emit a sequence of responses.  Any open
+ *        containers must be closed before calling this.
+ *
+ * @param ctxt                  The management context to flush.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if the transport cannot send
+ *                                  multiple responses to one request;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int mgmt_flush_rsp(struct mgmt_ctxt *ctxt);
+
+/**
+ * @brief Defers the response to the request being processed.  The request
+ *        must be fully decoded before the handler returns, as the request
+ *        buffer does not outlive the call.  On success, the handler returns
+ *        MGMT_ERR_EPENDING and must eventually call mgmt_complete_async().
+ *
+ * @param ctxt                  The management context of the request.
+ * @param async                 Handler-owned storage for the deferred
+ *                                  response.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if the transport cannot
+ *                                  defer responses;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int mgmt_defer(struct mgmt_ctxt *ctxt, struct mgmt_async *async);
+
+/**
+ * @brief Encodes and transmits a response deferred with mgmt_defer().  May
+ *        be called from any thread.
+ *
+ * @param async                 The deferred response to complete.
+ * @param status                MGMT_ERR_EOK to send the response written by
+ *                                  encode_cb; otherwise, the status to send
+ *                                  in an error response.
+ * @param encode_cb             Writes the response body, including "rc";
+ *                                  NULL to send only a status of 0.
+ * @param arg                   Optional argument passed to encode_cb.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int mgmt_complete_async(struct mgmt_async *async, int status,
+                        mgmt_async_encode_fn *encode_cb, void *arg);
+
+/**
+ * @brief Indicates whether the transport allows encoded response data to be
+ *        discarded with mgmt_rollback().
+ *
+ * @param ctxt                  The management context to query.
+ *
+ * @return                      true if rollback is supported; false otherwise.
+ */
+bool mgmt_can_rollback(const struct mgmt_ctxt *ctxt);
+
+/**
+ * @brief Calculates how much bulk data (e.g., a file chunk) fits in one
+ *        response, based on the MTU of the transport the request came from.
+ *
+ * @param ctxt                  The management context of the request.
+ * @param overhead              Worst-case size of the rest of the response
+ *                                  body, excluding the mcumgr header.
+ * @param max                   The largest chunk the caller can handle.
+ *
+ * @return                      The chunk size to use; max if the MTU is not
+ *                                  known or leaves room for more.
+ */
+size_t mgmt_rsp_chunk_size(const struct mgmt_ctxt *ctxt, size_t overhead,
+                           size_t max);
+
+/**
+ * @brief Records the state of an encoder so that anything subsequently
+ *        written through it can be undone.
+ *
+ * @param enc                   The encoder to checkpoint; the root encoder of
+ *                                  the context or any open container.
+ * @param cp                    The checkpoint to fill in.
+ */
+void mgmt_checkpoint(struct CborEncoder *enc, struct mgmt_checkpoint *cp);
+
+/**
+ * @brief Discards everything encoded since the specified checkpoint and
+ *        restores the encoder to its checkpointed state.  Containers opened
+ *        after the checkpoint are abandoned.
+ *
+ * This lets a handler encode an item directly into the response and back it
+ * out if it turns out not to fit, rather than encoding it twice.
+ *
+ * @param ctxt                  The management context being written.
+ * @param enc                   The encoder that was checkpointed.
+ * @param cp                    The checkpoint to roll back to.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOTSUP if the transport cannot
+ *                                  truncate responses;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int mgmt_rollback(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+                  const struct mgmt_checkpoint *cp);
+
+/**
+ * @brief Opens a definite-length map whose pair count is supplied when it is
+ *        closed with mgmt_close_counted().
+ *
+ * If the transport cannot overwrite response data, the map is opened with
+ * indefinite length instead.  The response must not be flushed while the
+ * map is open.
+ *
+ * @param ctxt                  The management context being written.
+ * @param enc                   The encoder to open the map in.
+ * @param cnt                   The container object to initialize.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int mgmt_open_counted_map(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+                          struct mgmt_counted *cnt);
+
+/**
+ * @brief Opens a definite-length array whose element count is supplied when
+ *        it is closed with mgmt_close_counted().
+ *
+ * See mgmt_open_counted_map().
+ *
+ * @param ctxt                  The management context being written.
+ * @param enc                   The encoder to open the array in.
+ * @param cnt                   The container object to initialize.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int mgmt_open_counted_array(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+                            struct mgmt_counted *cnt);
+
+/**
+ * @brief Closes a container opened with mgmt_open_counted_map() or
+ *        mgmt_open_counted_array() and back-patches its element count.
+ *
+ * @param ctxt                  The management context being written.
+ * @param enc                   The encoder the container was opened in.
+ * @param cnt                   The container to close.
+ * @param count                 The number of elements encoded; key-value
+ *                                  pairs for a map.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int mgmt_close_counted(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+                       struct mgmt_counted *cnt, size_t count);
+
 /**
  * @brief Initializes a management context object with the specified streamer.
  *
@@ -431,21 +1074,46 @@ void mgmt_ntoh_hdr(struct mgmt_hdr *hdr);
 void mgmt_hton_hdr(struct mgmt_hdr *hdr);
 
 /**
- * @brief Register event callback function.
+ * @brief Register event callback function.  This subscribes the callback to
+ *        every event; a later call replaces the callback, and NULL removes
+ *        it.  Prefer mgmt_evt_subscribe(), which allows several subscribers.
  *
  * @param cb                    Callback function.
  */
 void mgmt_register_evt_cb(mgmt_on_evt_cb *cb);
 
 /**
- * @brief This function is called to notify about mgmt event.
+ * @brief Adds a subscriber to MGMT events.  Subscribers are called in the
+ *        order they were added.
+ *
+ * @param sub                   The subscriber to add.  The storage must
+ *                                  remain valid while it is subscribed.
+ */
+void mgmt_evt_subscribe(struct mgmt_evt_sub *sub);
+
+/**
+ * @brief Removes a subscriber to MGMT events.
+ *
+ * @param sub                   The subscriber to remove.
+ */
+void mgmt_evt_unsubscribe(struct mgmt_evt_sub *sub);
+
+/**
+ * @brief This function is called to notify about mgmt event.  Only the
+ *        subscribers interested in the event and group are called.
  *
  * @param opcode                MGMT_EVT_OP_[...].
  * @param group                 MGMT_GROUP_ID_[...].
  * @param id                    Message ID within group.
  * @param arg                   Optional event argument.
+ *
+ * @return                      0 if the event was accepted;
+ *                              For MGMT_EVT_OP_CMD_RECV, the MGMT_ERR_[...]
+ *                                  code of the first subscriber that
+ *                                  rejected the command.  The remaining
+ *                                  subscribers are not called.
  */
-void mgmt_evt(uint8_t opcode, uint16_t group, uint8_t id, void *arg);
+int mgmt_evt(uint8_t opcode, uint16_t group, uint8_t id, void *arg);
 
 #ifdef __cplusplus
 }
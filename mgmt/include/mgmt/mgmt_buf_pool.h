@@ -0,0 +1,165 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_MGMT_BUF_POOL_
+#define H_MGMT_BUF_POOL_
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct mgmt_buf_pool;
+
+/** @typedef mgmt_buf_pool_lock_fn
+ * @brief Locks or unlocks a buffer pool shared between threads.
+ *
+ * @param pool                  The pool being accessed.
+ * @param arg                   The pool's lock argument.
+ */
+typedef void mgmt_buf_pool_lock_fn(struct mgmt_buf_pool *pool, void *arg);
+
+/**
+ * @brief A pool of fixed-size buffers for mcumgr packets.
+ *
+ * Buffers are handed out through quotas, one per transport.  Each quota can
+ * reserve buffers that no other quota can take and can be limited to a
+ * maximum number of buffers, so that one busy transport cannot starve the
+ * others.  Free buffers are reused most-recently-freed first.
+ *
+ * Define pools with MGMT_BUF_POOL_DEFINE().
+ */
+struct mgmt_buf_pool {
+    /* Buffer storage; slab_count buffers of slab_size bytes each. */
+    void *storage;
+    size_t slab_size;
+    uint16_t slab_count;
+
+    /* Number of buffers never handed out; these are carved from the end of
+     * the storage before the free list is used.
+     */
+    uint16_t untouched;
+
+    /* Number of buffers currently free. */
+    uint16_t free_count;
+
+    /* Sum of the quotas' reservations, and the part of it not currently in
+     * use.  The latter many free buffers are off limits to quotas that have
+     * used up their own reservation.
+     */
+    uint16_t reserved_total;
+    uint16_t reserved_unused;
+
+    /* Singly-linked list of freed buffers, threaded through their first
+     * bytes.
+     */
+    void *free_head;
+
+    /* Optional; required if the pool is used from more than one thread. */
+    mgmt_buf_pool_lock_fn *lock_cb;
+    mgmt_buf_pool_lock_fn *unlock_cb;
+    void *lock_arg;
+};
+
+/**
+ * @brief One transport's share of a buffer pool.
+ */
+struct mgmt_buf_quota {
+    struct mgmt_buf_pool *pool;
+
+    /* Buffers held back for this quota. */
+    uint16_t reserved;
+
+    /* Most buffers this quota can hold at once; 0 for no limit. */
+    uint16_t max;
+
+    /* Buffers currently held. */
+    uint16_t in_use;
+
+    /* Number of allocations refused. */
+    uint32_t failures;
+};
+
+/* Rounds a buffer size up so that every buffer is pointer-aligned. */
+#define MGMT_BUF_POOL_SLAB_WORDS(size_)                                   \
+    (((size_) + sizeof (void *) - 1) / sizeof (void *))
+
+/**
+ * @brief Defines a buffer pool with static storage.
+ *
+ * @param name_                 Name of the pool object.
+ * @param count_                Number of buffers.
+ * @param size_                 Size of each buffer, in bytes.
+ */
+#define MGMT_BUF_POOL_DEFINE(name_, count_, size_)                        \
+    static void *name_##_storage[(count_) *                               \
+                                 MGMT_BUF_POOL_SLAB_WORDS(size_)];        \
+    static struct mgmt_buf_pool name_ = {                                 \
+        .storage = name_##_storage,                                       \
+        .slab_size = MGMT_BUF_POOL_SLAB_WORDS(size_) * sizeof (void *),   \
+        .slab_count = (count_),                                           \
+        .untouched = (count_),                                            \
+        .free_count = (count_),                                           \
+    }
+
+/**
+ * @brief Attaches a quota to a buffer pool.
+ *
+ * @param quota                 The quota to initialize.
+ * @param pool                  The pool to draw buffers from.
+ * @param reserved              Number of buffers to reserve for the quota.
+ * @param max                   Most buffers the quota can hold at once; 0
+ *                                  for no limit.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_EINVAL if max is below reserved;
+ *                              MGMT_ERR_ENOMEM if the pool cannot cover the
+ *                                  reservation.
+ */
+int mgmt_buf_quota_init(struct mgmt_buf_quota *quota,
+                        struct mgmt_buf_pool *pool, uint16_t reserved,
+                        uint16_t max);
+
+/**
+ * @brief Takes a buffer from a quota's pool.  A quota below its reservation
+ *        always gets a buffer; beyond that, it competes for the unreserved
+ *        buffers up to its maximum.
+ *
+ * @param quota                 The quota to charge.
+ *
+ * @return                      A buffer of pool->slab_size bytes on success;
+ *                              NULL if the quota or pool is exhausted.
+ */
+void *mgmt_buf_alloc(struct mgmt_buf_quota *quota);
+
+/**
+ * @brief Returns a buffer to a quota's pool.
+ *
+ * @param quota                 The quota the buffer was allocated from.
+ * @param buf                   The buffer to free.
+ */
+void mgmt_buf_free(struct mgmt_buf_quota *quota, void *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* H_MGMT_BUF_POOL_ */
@@ -0,0 +1,55 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_MGMT_CONFIG_
+#define H_MGMT_CONFIG_
+
+#if defined MYNEWT
+
+#include "syscfg/syscfg.h"
+
+#define MGMT_PERUSER_GROUP_MAX  MYNEWT_VAL(MGMT_PERUSER_GROUP_MAX)
+/* Groups are registered from sysinit; BSP linker scripts have no section for
+ * statically defined groups.
+ */
+#define MGMT_STATIC_GROUPS      0
+
+#elif defined __ZEPHYR__
+
+#ifdef CONFIG_MGMT_PERUSER_GROUP_MAX
+#define MGMT_PERUSER_GROUP_MAX  CONFIG_MGMT_PERUSER_GROUP_MAX
+#else
+#define MGMT_PERUSER_GROUP_MAX  8
+#endif
+
+#ifdef CONFIG_MGMT_STATIC_GROUPS
+#define MGMT_STATIC_GROUPS      1
+#else
+#define MGMT_STATIC_GROUPS      0
+#endif
+
+#else
+
+/* No direct support for this OS.  The application needs to define the above
+ * settings itself.
+ */
+
+#endif
+
+#endif
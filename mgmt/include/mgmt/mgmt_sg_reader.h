@@ -0,0 +1,101 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef H_MGMT_SG_READER_
+#define H_MGMT_SG_READER_
+
+#include <stddef.h>
+#include "tinycbor/cbor.h"
+#include "mgmt/mgmt.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief A CBOR reader over a buffer made of several contiguous segments.
+ *
+ * The reader caches the segment of the last access; an access inside it
+ * takes no call to the transport, and one past it lets the transport walk on
+ * from there.  Sequential decoding thus costs constant time per access
+ * regardless of the number of segments, where a reader that locates every
+ * offset from the start of the chain costs time linear in it.
+ */
+struct mgmt_sg_reader {
+    struct cbor_decoder_reader r;
+
+    mgmt_get_span_fn *get_span;
+    void *buf;
+    void *arg;
+
+    /* Cached cursor; the segment of the last access. */
+    struct mgmt_span span;
+};
+
+/**
+ * @brief Initializes a scatter-gather reader over the specified buffer.
+ *
+ * @param sr                    The reader to initialize.
+ * @param buf                   The buffer to read.
+ * @param get_span              Finds the segments of the buffer.
+ * @param arg                   Optional argument passed to get_span.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int mgmt_sg_reader_init(struct mgmt_sg_reader *sr, void *buf,
+                        mgmt_get_span_fn *get_span, void *arg);
+
+/**
+ * @brief Accounts for bytes removed from the front of the reader's buffer.
+ *
+ * @param sr                    The reader whose buffer was trimmed.
+ * @param len                   The number of bytes removed.
+ */
+void mgmt_sg_reader_trim(struct mgmt_sg_reader *sr, size_t len);
+
+/**
+ * @brief Returns a pointer to `len` contiguous bytes at the specified offset
+ *        of a reader, or NULL if they span segments or the reader is not a
+ *        scatter-gather reader.
+ *
+ * Matches cbor_attr_span_fn, so that it can be passed to
+ * cbor_attr_set_span_fn() for in-place byte string references.
+ */
+const uint8_t *mgmt_sg_reader_span(struct cbor_decoder_reader *d, int offset,
+                                   size_t len);
+
+#if defined MYNEWT
+/**
+ * @brief mgmt_get_span_fn for os_mbuf chains.
+ */
+int mgmt_sg_mbuf_span(void *buf, size_t off, struct mgmt_span *span,
+                      void *arg);
+#elif defined __ZEPHYR__
+/**
+ * @brief mgmt_get_span_fn for net_buf fragment chains.
+ */
+int mgmt_sg_net_buf_span(void *buf, size_t off, struct mgmt_span *span,
+                         void *arg);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,26 +17,64 @@
  * under the License.
  */
 
+#include <stdbool.h>
 #include <string.h>
 
 #include "tinycbor/cbor.h"
 #include "mgmt/endian.h"
 #include "mgmt/mgmt.h"
+#include "mgmt/mgmt_sg_reader.h"
+
+/* Placeholder count of a counted container; large enough that the header
+ * gets a two-byte count field for mgmt_close_counted() to patch.
+ */
+#define MGMT_COUNTED_PLACEHOLDER    0xffff
 
 static mgmt_on_evt_cb *evt_cb;
+static struct mgmt_evt_sub *evt_subs;
 static struct mgmt_group *mgmt_group_list;
 static struct mgmt_group *mgmt_group_list_end;
 
+static mgmt_res_lock_fn *mgmt_res_lock_cb;
+static mgmt_res_lock_fn *mgmt_res_unlock_cb;
+static void *mgmt_res_lock_arg;
+
+/* Session of the streamers that do not have their own. */
+static struct mgmt_session mgmt_default_session;
+
+const uint32_t mgmt_const_epoch;
+
+/* Response buffers the transports could not allocate. */
+static uint32_t mgmt_alloc_rsp_fail;
+
 void *
 mgmt_streamer_alloc_rsp(struct mgmt_streamer *streamer, const void *req)
 {
-    return streamer->cfg->alloc_rsp(req, streamer->cb_arg);
+    void *rsp;
+
+    rsp = streamer->cfg->alloc_rsp(req, streamer->cb_arg);
+    if (rsp == NULL) {
+        __atomic_fetch_add(&mgmt_alloc_rsp_fail, 1, __ATOMIC_RELAXED);
+    }
+
+    return rsp;
+}
+
+uint32_t
+mgmt_alloc_rsp_failures(void)
+{
+    return __atomic_load_n(&mgmt_alloc_rsp_fail, __ATOMIC_RELAXED);
 }
 
 void
 mgmt_streamer_trim_front(struct mgmt_streamer *streamer, void *buf, size_t len)
 {
     streamer->cfg->trim_front(buf, len, streamer->cb_arg);
+
+    if (streamer->cfg->get_span != NULL) {
+        /* The segments the reader has cached moved. */
+        mgmt_sg_reader_trim((struct mgmt_sg_reader *)streamer->reader, len);
+    }
 }
 
 void
@@ -56,6 +94,12 @@ mgmt_streamer_write_at(struct mgmt_streamer *streamer, size_t offset,
 int
 mgmt_streamer_init_reader(struct mgmt_streamer *streamer, void *buf)
 {
+    if (streamer->cfg->get_span != NULL) {
+        return mgmt_sg_reader_init((struct mgmt_sg_reader *)streamer->reader,
+                                   buf, streamer->cfg->get_span,
+                                   streamer->cb_arg);
+    }
+
     return streamer->cfg->init_reader(streamer->reader, buf, streamer->cb_arg);
 }
 
@@ -71,39 +115,225 @@ mgmt_streamer_free_buf(struct mgmt_streamer *streamer, void *buf)
     streamer->cfg->free_buf(buf, streamer->cb_arg);
 }
 
+int
+mgmt_streamer_truncate(struct mgmt_streamer *streamer, size_t len)
+{
+    if (streamer->cfg->truncate == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    return streamer->cfg->truncate(streamer->writer, len, streamer->cb_arg);
+}
+
+/*
+ * Dispatch index.  The group list holds every registered group in
+ * registration order; the index maps a group ID to the first group in the
+ * list with that ID.  Core IDs are indexed directly, per-user IDs through a
+ * table sorted by ID.
+ */
+static const struct mgmt_group *mgmt_group_index[MGMT_GROUP_ID_PERUSER];
+
+#if MGMT_PERUSER_GROUP_MAX > 0
+static const struct mgmt_group *mgmt_peruser_index[MGMT_PERUSER_GROUP_MAX];
+static int mgmt_peruser_count;
+#endif
+
+/* Set if a per-user group could not be indexed. */
+static bool mgmt_peruser_overflow;
+
+#if MGMT_STATIC_GROUPS
+extern const struct mgmt_group _mgmt_group_list_start[];
+extern const struct mgmt_group _mgmt_group_list_end[];
+
+static bool mgmt_static_indexed;
+#endif
+
+#if MGMT_PERUSER_GROUP_MAX > 0
+/**
+ * Returns the position of the specified per-user ID in the sorted index, or
+ * the position it would be inserted at.
+ */
+static int
+mgmt_peruser_index_find(uint16_t group_id)
+{
+    int lo;
+    int hi;
+    int mid;
+
+    lo = 0;
+    hi = mgmt_peruser_count;
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (mgmt_peruser_index[mid]->mg_group_id < group_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+#endif
+
+static const struct mgmt_group *
+mgmt_index_get(uint16_t group_id)
+{
+#if MGMT_PERUSER_GROUP_MAX > 0
+    int idx;
+#endif
+
+    if (group_id < MGMT_GROUP_ID_PERUSER) {
+        return mgmt_group_index[group_id];
+    }
+
+#if MGMT_PERUSER_GROUP_MAX > 0
+    idx = mgmt_peruser_index_find(group_id);
+    if (idx < mgmt_peruser_count &&
+        mgmt_peruser_index[idx]->mg_group_id == group_id) {
+
+        return mgmt_peruser_index[idx];
+    }
+#endif
+
+    return NULL;
+}
+
+/**
+ * Sets the index entry for the specified group's ID.  If `replace` is false,
+ * an existing entry is left untouched.  A NULL `group` removes the entry for
+ * `group_id`.
+ */
+static void
+mgmt_index_set(uint16_t group_id, const struct mgmt_group *group,
+               bool replace)
+{
+#if MGMT_PERUSER_GROUP_MAX > 0
+    int idx;
+#endif
+
+    if (group_id < MGMT_GROUP_ID_PERUSER) {
+        if (replace || mgmt_group_index[group_id] == NULL) {
+            mgmt_group_index[group_id] = group;
+        }
+        return;
+    }
+
+#if MGMT_PERUSER_GROUP_MAX > 0
+    idx = mgmt_peruser_index_find(group_id);
+    if (idx < mgmt_peruser_count &&
+        mgmt_peruser_index[idx]->mg_group_id == group_id) {
+
+        if (!replace) {
+            return;
+        }
+
+        if (group != NULL) {
+            mgmt_peruser_index[idx] = group;
+        } else {
+            mgmt_peruser_count--;
+            memmove(&mgmt_peruser_index[idx], &mgmt_peruser_index[idx + 1],
+                    (mgmt_peruser_count - idx) *
+                    sizeof mgmt_peruser_index[0]);
+        }
+        return;
+    }
+
+    if (group == NULL) {
+        return;
+    }
+
+    if (mgmt_peruser_count < MGMT_PERUSER_GROUP_MAX) {
+        memmove(&mgmt_peruser_index[idx + 1], &mgmt_peruser_index[idx],
+                (mgmt_peruser_count - idx) * sizeof mgmt_peruser_index[0]);
+        mgmt_peruser_index[idx] = group;
+        mgmt_peruser_count++;
+        return;
+    }
+#endif
+
+    if (group != NULL) {
+        mgmt_peruser_overflow = true;
+    }
+}
+
+#if MGMT_STATIC_GROUPS
+/**
+ * Adds statically defined groups to the dispatch index.  Groups registered
+ * at runtime keep precedence for IDs they share with a static group.
+ */
+static void
+mgmt_static_index_init(void)
+{
+    const struct mgmt_group *group;
+
+    for (group = _mgmt_group_list_start; group < _mgmt_group_list_end;
+         group++) {
+
+        mgmt_index_set(group->mg_group_id, group, false);
+    }
+
+    mgmt_static_indexed = true;
+}
+#endif
+
 void
 mgmt_unregister_group(struct mgmt_group *group)
 {
     struct mgmt_group *curr = mgmt_group_list, *prev = NULL;
+    struct mgmt_group *next;
 
     if (!group) {
         return;
     }
 
-    if (curr == group) {
-        mgmt_group_list = curr->mg_next;
-        return;
-    }
-
     while (curr && curr != group) {
         prev = curr;
         curr = curr->mg_next;
     }
 
-    if (!prev || !curr) {
+    if (!curr) {
         return;
     }
 
-    prev->mg_next = curr->mg_next;
-    if (curr->mg_next == NULL) {
-        mgmt_group_list_end = curr;
+    if (prev) {
+        prev->mg_next = curr->mg_next;
+    } else {
+        mgmt_group_list = curr->mg_next;
+    }
+    if (mgmt_group_list_end == curr) {
+        mgmt_group_list_end = prev;
     }
+
+    if (mgmt_index_get(group->mg_group_id) == group) {
+        /* Promote the next group with the same ID, if any. */
+        for (next = group->mg_next; next != NULL; next = next->mg_next) {
+            if (next->mg_group_id == group->mg_group_id) {
+                break;
+            }
+        }
+        mgmt_index_set(group->mg_group_id, next, true);
+    }
+
+    group->mg_next = NULL;
 }
 
-static struct mgmt_group *
+static const struct mgmt_group *
 mgmt_find_group(uint16_t group_id, uint16_t command_id)
 {
-    struct mgmt_group *group;
+    const struct mgmt_group *group;
+
+#if MGMT_STATIC_GROUPS
+    if (!mgmt_static_indexed) {
+        mgmt_static_index_init();
+    }
+#endif
+
+    group = mgmt_index_get(group_id);
+    if (group == NULL && mgmt_peruser_overflow &&
+        group_id >= MGMT_GROUP_ID_PERUSER) {
+
+        group = mgmt_group_list;
+    }
 
     /*
      * Find the group with the specified group id, if one exists
@@ -111,7 +341,7 @@ mgmt_find_group(uint16_t group_id, uint16_t command_id)
      * that is not NULL. If that is not set, look for the group
      * with a command id that is set
      */
-    for (group = mgmt_group_list; group != NULL; group = group->mg_next) {
+    for (; group != NULL; group = group->mg_next) {
         if (group->mg_group_id == group_id) {
             if (command_id >= group->mg_handlers_count) {
                 return NULL;
@@ -122,22 +352,92 @@ mgmt_find_group(uint16_t group_id, uint16_t command_id)
                 continue;
             }
 
-            break;
+            return group;
+        }
+    }
+
+#if MGMT_STATIC_GROUPS
+    /* Static groups that share an ID with an indexed group. */
+    for (group = _mgmt_group_list_start; group < _mgmt_group_list_end;
+         group++) {
+
+        if (group->mg_group_id == group_id &&
+            command_id < group->mg_handlers_count &&
+            (group->mg_handlers[command_id].mh_read ||
+             group->mg_handlers[command_id].mh_write)) {
+
+            return group;
         }
     }
+#endif
 
-    return group;
+    return NULL;
 }
 
 void
 mgmt_register_group(struct mgmt_group *group)
 {
+    group->mg_next = NULL;
     if (mgmt_group_list_end == NULL) {
         mgmt_group_list = group;
     } else {
         mgmt_group_list_end->mg_next = group;
     }
     mgmt_group_list_end = group;
+
+    mgmt_index_set(group->mg_group_id, group, false);
+}
+
+void
+mgmt_set_res_lock(mgmt_res_lock_fn *lock_cb,
+                  mgmt_res_lock_fn *unlock_cb, void *arg)
+{
+    mgmt_res_lock_cb = lock_cb;
+    mgmt_res_unlock_cb = unlock_cb;
+    mgmt_res_lock_arg = arg;
+}
+
+void
+mgmt_res_lock(int res)
+{
+    if (res != MGMT_RES_NONE && mgmt_res_lock_cb != NULL) {
+        mgmt_res_lock_cb(res, mgmt_res_lock_arg);
+    }
+}
+
+void
+mgmt_res_unlock(int res)
+{
+    if (res != MGMT_RES_NONE && mgmt_res_unlock_cb != NULL) {
+        mgmt_res_unlock_cb(res, mgmt_res_lock_arg);
+    }
+}
+
+/* Resource held while a group uses its session slot. */
+static const uint8_t mgmt_session_slot_res[MGMT_SESSION_SLOT_COUNT] = {
+    [MGMT_SESSION_SLOT_FS_UL] = MGMT_RES_FS,
+};
+
+void
+mgmt_session_reset(struct mgmt_session *session)
+{
+    int i;
+
+    for (i = 0; i < MGMT_SESSION_SLOT_COUNT; i++) {
+        mgmt_res_lock(mgmt_session_slot_res[i]);
+        session->state[i] = NULL;
+        mgmt_res_unlock(mgmt_session_slot_res[i]);
+    }
+}
+
+struct mgmt_session *
+mgmt_ctxt_session(const struct mgmt_ctxt *ctxt)
+{
+    if (ctxt->streamer == NULL || ctxt->streamer->session == NULL) {
+        return &mgmt_default_session;
+    }
+
+    return ctxt->streamer->session;
 }
 
 const struct mgmt_handler *
@@ -192,10 +492,258 @@ mgmt_ctxt_init(struct mgmt_ctxt *ctxt, struct mgmt_streamer *streamer)
     }
 
     cbor_encoder_init(&ctxt->encoder, streamer->writer, 0);
+    ctxt->flush_cb = NULL;
+    ctxt->flush_arg = NULL;
+    ctxt->defer_cb = NULL;
+    ctxt->defer_arg = NULL;
+    ctxt->streamer = streamer;
+
+    return 0;
+}
+
+bool
+mgmt_can_rollback(const struct mgmt_ctxt *ctxt)
+{
+    return ctxt->streamer != NULL && ctxt->streamer->cfg->truncate != NULL;
+}
+
+size_t
+mgmt_rsp_chunk_size(const struct mgmt_ctxt *ctxt, size_t overhead, size_t max)
+{
+    size_t room;
+
+    if (ctxt->streamer == NULL || ctxt->streamer->mtu == 0) {
+        return max;
+    }
+
+    if (ctxt->streamer->mtu <= MGMT_HDR_SIZE + overhead) {
+        /* Let the response fail with a proper error rather than send empty
+         * chunks forever.
+         */
+        return 1;
+    }
+
+    room = ctxt->streamer->mtu - MGMT_HDR_SIZE - overhead;
+    return room < max ? room : max;
+}
+
+void
+mgmt_checkpoint(struct CborEncoder *enc, struct mgmt_checkpoint *cp)
+{
+    cp->encoder = *enc;
+    cp->len = cbor_encode_bytes_written(enc);
+}
 
+int
+mgmt_rollback(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+              const struct mgmt_checkpoint *cp)
+{
+    int rc;
+
+    if (!mgmt_can_rollback(ctxt)) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    rc = mgmt_streamer_truncate(ctxt->streamer, cp->len);
+    if (rc != 0) {
+        return rc;
+    }
+
+    *enc = cp->encoder;
     return 0;
 }
 
+static int
+mgmt_open_counted(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+                  struct mgmt_counted *cnt, bool is_map)
+{
+    size_t len;
+    int rc;
+
+    if (ctxt->streamer != NULL && ctxt->streamer->cfg->write_at != NULL) {
+        cnt->hdr_off = cbor_encode_bytes_written(enc);
+        len = MGMT_COUNTED_PLACEHOLDER;
+    } else {
+        cnt->hdr_off = SIZE_MAX;
+        len = CborIndefiniteLength;
+    }
+
+    if (is_map) {
+        rc = cbor_encoder_create_map(enc, &cnt->encoder, len);
+    } else {
+        rc = cbor_encoder_create_array(enc, &cnt->encoder, len);
+    }
+
+    return mgmt_err_from_cbor(rc);
+}
+
+int
+mgmt_open_counted_map(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+                      struct mgmt_counted *cnt)
+{
+    return mgmt_open_counted(ctxt, enc, cnt, true);
+}
+
+int
+mgmt_open_counted_array(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+                        struct mgmt_counted *cnt)
+{
+    return mgmt_open_counted(ctxt, enc, cnt, false);
+}
+
+int
+mgmt_close_counted(struct mgmt_ctxt *ctxt, struct CborEncoder *enc,
+                   struct mgmt_counted *cnt, size_t count)
+{
+    uint16_t count16;
+    int rc;
+
+    rc = cbor_encoder_close_container(enc, &cnt->encoder);
+    if (rc != 0) {
+        return mgmt_err_from_cbor(rc);
+    }
+
+    if (cnt->hdr_off == SIZE_MAX) {
+        return 0;
+    }
+
+    if (count > MGMT_COUNTED_PLACEHOLDER) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    /* Skip the initial byte; it holds the major type. */
+    count16 = htons(count);
+    rc = mgmt_streamer_write_at(ctxt->streamer, cnt->hdr_off + 1, &count16,
+                                sizeof count16);
+    return rc;
+}
+
+uint8_t
+mgmt_rsp_op(uint8_t req_op)
+{
+    if (req_op == MGMT_OP_READ) {
+        return MGMT_OP_READ_RSP;
+    } else {
+        return MGMT_OP_WRITE_RSP;
+    }
+}
+
+/**
+ * Looks up the handler function for the command and operation of a request.
+ */
+static int
+mgmt_find_handler_fn(const struct mgmt_hdr *req_hdr,
+                     const struct mgmt_group **out_group,
+                     mgmt_handler_fn **out_fn)
+{
+    const struct mgmt_handler *handler;
+    const struct mgmt_group *group;
+    mgmt_handler_fn *handler_fn;
+
+    group = mgmt_find_group(req_hdr->nh_group, req_hdr->nh_id);
+    if (group == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+    handler = &group->mg_handlers[req_hdr->nh_id];
+
+    switch (req_hdr->nh_op) {
+    case MGMT_OP_READ:
+        handler_fn = handler->mh_read;
+        break;
+
+    case MGMT_OP_WRITE:
+        handler_fn = handler->mh_write;
+        break;
+
+    default:
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (handler_fn == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    *out_group = group;
+    *out_fn = handler_fn;
+    return 0;
+}
+
+int
+mgmt_check_req(const struct mgmt_hdr *req_hdr)
+{
+    const struct mgmt_group *group;
+    mgmt_handler_fn *handler_fn;
+
+    return mgmt_find_handler_fn(req_hdr, &group, &handler_fn);
+}
+
+int
+mgmt_dispatch(struct mgmt_ctxt *ctxt, const struct mgmt_hdr *req_hdr,
+              bool *out_handler_found)
+{
+    const struct mgmt_group *group;
+    mgmt_handler_fn *handler_fn;
+    int rc;
+
+    *out_handler_found = false;
+
+    rc = mgmt_find_handler_fn(req_hdr, &group, &handler_fn);
+    if (rc != 0) {
+        return rc;
+    }
+    *out_handler_found = true;
+
+    /* A subscriber may reject the command, e.g., to limit its rate. */
+    rc = mgmt_evt(MGMT_EVT_OP_CMD_RECV, req_hdr->nh_group, req_hdr->nh_id,
+                  NULL);
+    if (rc != 0) {
+        return rc;
+    }
+
+    mgmt_res_lock(group->mg_res);
+    rc = handler_fn(ctxt);
+    mgmt_res_unlock(group->mg_res);
+
+    return rc;
+}
+
+void
+mgmt_dispatch_done(const struct mgmt_hdr *req_hdr, int status)
+{
+    struct mgmt_evt_op_cmd_done_arg cmd_done_arg;
+
+    cmd_done_arg.err = status;
+    mgmt_evt(MGMT_EVT_OP_CMD_DONE, req_hdr->nh_group, req_hdr->nh_id,
+             &cmd_done_arg);
+}
+
+int
+mgmt_flush_rsp(struct mgmt_ctxt *ctxt)
+{
+    if (ctxt->flush_cb == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    return ctxt->flush_cb(ctxt, ctxt->flush_arg);
+}
+
+int
+mgmt_defer(struct mgmt_ctxt *ctxt, struct mgmt_async *async)
+{
+    if (ctxt->defer_cb == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    return ctxt->defer_cb(ctxt, async, ctxt->defer_arg);
+}
+
+int
+mgmt_complete_async(struct mgmt_async *async, int status,
+                    mgmt_async_encode_fn *encode_cb, void *arg)
+{
+    return async->complete_cb(async, status, encode_cb, arg);
+}
+
 void
 mgmt_ntoh_hdr(struct mgmt_hdr *hdr)
 {
@@ -211,15 +759,83 @@ mgmt_hton_hdr(struct mgmt_hdr *hdr)
 }
 
 void
-mgmt_register_evt_cb(mgmt_on_evt_cb *cb)
+mgmt_evt_subscribe(struct mgmt_evt_sub *sub)
 {
-    evt_cb = cb;
+    struct mgmt_evt_sub **cur;
+
+    for (cur = &evt_subs; *cur != NULL; cur = &(*cur)->next) {
+        if (*cur == sub) {
+            return;
+        }
+    }
+
+    sub->next = NULL;
+    *cur = sub;
 }
 
 void
-mgmt_evt(uint8_t opcode, uint16_t group, uint8_t id, void *arg)
+mgmt_evt_unsubscribe(struct mgmt_evt_sub *sub)
+{
+    struct mgmt_evt_sub **cur;
+
+    for (cur = &evt_subs; *cur != NULL; cur = &(*cur)->next) {
+        if (*cur == sub) {
+            *cur = sub->next;
+            sub->next = NULL;
+            return;
+        }
+    }
+}
+
+/**
+ * Passes events on to the callback set with mgmt_register_evt_cb().
+ */
+static int
+mgmt_evt_legacy(uint8_t opcode, uint16_t group, uint8_t id, void *arg,
+                void *cb_arg)
 {
     if (evt_cb) {
         evt_cb(opcode, group, id, arg);
     }
+
+    return 0;
+}
+
+void
+mgmt_register_evt_cb(mgmt_on_evt_cb *cb)
+{
+    static struct mgmt_evt_sub legacy_sub = {
+        .cb = mgmt_evt_legacy,
+        .evt_mask = MGMT_EVT_MASK_ALL,
+        .group = MGMT_EVT_GROUP_ALL,
+    };
+
+    evt_cb = cb;
+    if (cb != NULL) {
+        mgmt_evt_subscribe(&legacy_sub);
+    } else {
+        mgmt_evt_unsubscribe(&legacy_sub);
+    }
+}
+
+int
+mgmt_evt(uint8_t opcode, uint16_t group, uint8_t id, void *arg)
+{
+    struct mgmt_evt_sub *sub;
+    int rc;
+
+    for (sub = evt_subs; sub != NULL; sub = sub->next) {
+        if (!(sub->evt_mask & MGMT_EVT_MASK(opcode)) ||
+            (sub->group != MGMT_EVT_GROUP_ALL && sub->group != group)) {
+
+            continue;
+        }
+
+        rc = sub->cb(opcode, group, id, arg, sub->cb_arg);
+        if (rc != 0 && opcode == MGMT_EVT_OP_CMD_RECV) {
+            return rc;
+        }
+    }
+
+    return 0;
 }
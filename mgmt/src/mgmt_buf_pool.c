@@ -0,0 +1,141 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "mgmt/mgmt.h"
+#include "mgmt/mgmt_buf_pool.h"
+
+static void
+mgmt_buf_pool_lock(struct mgmt_buf_pool *pool)
+{
+    if (pool->lock_cb != NULL) {
+        pool->lock_cb(pool, pool->lock_arg);
+    }
+}
+
+static void
+mgmt_buf_pool_unlock(struct mgmt_buf_pool *pool)
+{
+    if (pool->unlock_cb != NULL) {
+        pool->unlock_cb(pool, pool->lock_arg);
+    }
+}
+
+int
+mgmt_buf_quota_init(struct mgmt_buf_quota *quota,
+                    struct mgmt_buf_pool *pool, uint16_t reserved,
+                    uint16_t max)
+{
+    int rc;
+
+    if (max != 0 && max < reserved) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    mgmt_buf_pool_lock(pool);
+
+    if (pool->reserved_total + reserved > pool->slab_count ||
+        pool->reserved_unused + reserved > pool->free_count) {
+
+        rc = MGMT_ERR_ENOMEM;
+    } else {
+        pool->reserved_total += reserved;
+        pool->reserved_unused += reserved;
+        rc = 0;
+    }
+
+    mgmt_buf_pool_unlock(pool);
+
+    if (rc != 0) {
+        return rc;
+    }
+
+    quota->pool = pool;
+    quota->reserved = reserved;
+    quota->max = max;
+    quota->in_use = 0;
+    quota->failures = 0;
+
+    return 0;
+}
+
+void *
+mgmt_buf_alloc(struct mgmt_buf_quota *quota)
+{
+    struct mgmt_buf_pool *pool;
+    uint8_t *buf;
+    bool from_reserve;
+
+    pool = quota->pool;
+
+    mgmt_buf_pool_lock(pool);
+
+    from_reserve = quota->in_use < quota->reserved;
+    if (!from_reserve) {
+        if ((quota->max != 0 && quota->in_use >= quota->max) ||
+            pool->free_count <= pool->reserved_unused) {
+
+            quota->failures++;
+            mgmt_buf_pool_unlock(pool);
+            return NULL;
+        }
+    }
+
+    if (pool->free_head != NULL) {
+        buf = pool->free_head;
+        memcpy(&pool->free_head, buf, sizeof pool->free_head);
+    } else {
+        buf = (uint8_t *)pool->storage +
+              (size_t)(pool->slab_count - pool->untouched) * pool->slab_size;
+        pool->untouched--;
+    }
+
+    pool->free_count--;
+    if (from_reserve) {
+        pool->reserved_unused--;
+    }
+    quota->in_use++;
+
+    mgmt_buf_pool_unlock(pool);
+
+    return buf;
+}
+
+void
+mgmt_buf_free(struct mgmt_buf_quota *quota, void *buf)
+{
+    struct mgmt_buf_pool *pool;
+
+    pool = quota->pool;
+
+    mgmt_buf_pool_lock(pool);
+
+    memcpy(buf, &pool->free_head, sizeof pool->free_head);
+    pool->free_head = buf;
+    pool->free_count++;
+
+    quota->in_use--;
+    if (quota->in_use < quota->reserved) {
+        pool->reserved_unused++;
+    }
+
+    mgmt_buf_pool_unlock(pool);
+}
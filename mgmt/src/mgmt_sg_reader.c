@@ -0,0 +1,318 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+
+#include "mgmt/mgmt.h"
+#include "mgmt/mgmt_sg_reader.h"
+
+#if defined MYNEWT
+#include "os/os.h"
+#elif defined __ZEPHYR__
+#include <net/buf.h>
+#endif
+
+/**
+ * Points the reader's cursor at the segment holding the specified offset.
+ *
+ * @return                      The data at the offset; NULL if the offset is
+ *                                  past the end of the buffer.
+ */
+static const uint8_t *
+mgmt_sg_reader_seek(struct mgmt_sg_reader *sr, size_t off, size_t *out_len)
+{
+    struct mgmt_span *span;
+    int rc;
+
+    span = &sr->span;
+    if (span->len == 0 || off < span->off || off >= span->off + span->len) {
+        rc = sr->get_span(sr->buf, off, span, sr->arg);
+        if (rc != 0 || span->len == 0 ||
+            off < span->off || off >= span->off + span->len) {
+
+            span->len = 0;
+            return NULL;
+        }
+    }
+
+    *out_len = span->off + span->len - off;
+    return span->data + (off - span->off);
+}
+
+/**
+ * Copies data that may span segments out of the reader's buffer.
+ *
+ * @return                      The number of bytes copied.
+ */
+static size_t
+mgmt_sg_reader_copy(struct mgmt_sg_reader *sr, uint8_t *dst, size_t off,
+                    size_t len)
+{
+    const uint8_t *src;
+    size_t copied;
+    size_t n;
+
+    copied = 0;
+    while (copied < len) {
+        src = mgmt_sg_reader_seek(sr, off + copied, &n);
+        if (src == NULL) {
+            break;
+        }
+        if (n > len - copied) {
+            n = len - copied;
+        }
+
+        memcpy(dst + copied, src, n);
+        copied += n;
+    }
+
+    return copied;
+}
+
+/**
+ * Reads a big-endian integer of the specified width.
+ */
+static uint64_t
+mgmt_sg_reader_get_be(struct cbor_decoder_reader *d, int offset, size_t size)
+{
+    struct mgmt_sg_reader *sr;
+    const uint8_t *p;
+    uint8_t bytes[8];
+    uint64_t val;
+    size_t n;
+    size_t i;
+
+    sr = (struct mgmt_sg_reader *)d;
+
+    p = mgmt_sg_reader_seek(sr, offset, &n);
+    if (p == NULL) {
+        return 0;
+    }
+    if (n < size) {
+        /* Straddles two segments. */
+        memset(bytes, 0, sizeof bytes);
+        mgmt_sg_reader_copy(sr, bytes, offset, size);
+        p = bytes;
+    }
+
+    val = 0;
+    for (i = 0; i < size; i++) {
+        val = (val << 8) | p[i];
+    }
+
+    return val;
+}
+
+static uint8_t
+mgmt_sg_reader_get8(struct cbor_decoder_reader *d, int offset)
+{
+    return mgmt_sg_reader_get_be(d, offset, 1);
+}
+
+static uint16_t
+mgmt_sg_reader_get16(struct cbor_decoder_reader *d, int offset)
+{
+    return mgmt_sg_reader_get_be(d, offset, 2);
+}
+
+static uint32_t
+mgmt_sg_reader_get32(struct cbor_decoder_reader *d, int offset)
+{
+    return mgmt_sg_reader_get_be(d, offset, 4);
+}
+
+static uint64_t
+mgmt_sg_reader_get64(struct cbor_decoder_reader *d, int offset)
+{
+    return mgmt_sg_reader_get_be(d, offset, 8);
+}
+
+static uintptr_t
+mgmt_sg_reader_cmp(struct cbor_decoder_reader *d, char *buf, int offset,
+                   size_t len)
+{
+    struct mgmt_sg_reader *sr;
+    const uint8_t *src;
+    size_t done;
+    size_t n;
+    int rc;
+
+    sr = (struct mgmt_sg_reader *)d;
+
+    done = 0;
+    while (done < len) {
+        src = mgmt_sg_reader_seek(sr, offset + done, &n);
+        if (src == NULL) {
+            return 1;
+        }
+        if (n > len - done) {
+            n = len - done;
+        }
+
+        rc = memcmp(buf + done, src, n);
+        if (rc != 0) {
+            return rc;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+static uintptr_t
+mgmt_sg_reader_cpy(struct cbor_decoder_reader *d, char *buf, int offset,
+                   size_t len)
+{
+    mgmt_sg_reader_copy((struct mgmt_sg_reader *)d, (uint8_t *)buf, offset,
+                        len);
+    return (uintptr_t)buf;
+}
+
+int
+mgmt_sg_reader_init(struct mgmt_sg_reader *sr, void *buf,
+                    mgmt_get_span_fn *get_span, void *arg)
+{
+    size_t len;
+    int rc;
+
+    memset(sr, 0, sizeof *sr);
+    sr->r.get8 = mgmt_sg_reader_get8;
+    sr->r.get16 = mgmt_sg_reader_get16;
+    sr->r.get32 = mgmt_sg_reader_get32;
+    sr->r.get64 = mgmt_sg_reader_get64;
+    sr->r.cmp = mgmt_sg_reader_cmp;
+    sr->r.cpy = mgmt_sg_reader_cpy;
+    sr->get_span = get_span;
+    sr->buf = buf;
+    sr->arg = arg;
+
+    /* Measure the buffer; each step walks on from the previous segment. */
+    len = 0;
+    while (1) {
+        rc = get_span(buf, len, &sr->span, arg);
+        if (rc != 0) {
+            return rc;
+        }
+        if (sr->span.len == 0) {
+            break;
+        }
+        len = sr->span.off + sr->span.len;
+    }
+    sr->r.message_size = len;
+
+    return 0;
+}
+
+void
+mgmt_sg_reader_trim(struct mgmt_sg_reader *sr, size_t len)
+{
+    if (len > sr->r.message_size) {
+        len = sr->r.message_size;
+    }
+    sr->r.message_size -= len;
+
+    /* Offsets have shifted; the cached segment no longer applies. */
+    memset(&sr->span, 0, sizeof sr->span);
+}
+
+const uint8_t *
+mgmt_sg_reader_span(struct cbor_decoder_reader *d, int offset, size_t len)
+{
+    const uint8_t *p;
+    size_t n;
+
+    if (d->get8 != mgmt_sg_reader_get8) {
+        return NULL;
+    }
+
+    p = mgmt_sg_reader_seek((struct mgmt_sg_reader *)d, offset, &n);
+    if (p == NULL || n < len) {
+        return NULL;
+    }
+
+    return p;
+}
+
+#if defined MYNEWT
+int
+mgmt_sg_mbuf_span(void *buf, size_t off, struct mgmt_span *span, void *arg)
+{
+    struct os_mbuf *om;
+    size_t om_off;
+
+    /* Walk on from the previous segment if the offset lies beyond it. */
+    if (span->len != 0 && off >= span->off) {
+        om = span->seg;
+        om_off = span->off;
+    } else {
+        om = buf;
+        om_off = 0;
+    }
+
+    while (om != NULL && off >= om_off + om->om_len) {
+        om_off += om->om_len;
+        om = SLIST_NEXT(om, om_next);
+    }
+
+    if (om == NULL) {
+        memset(span, 0, sizeof *span);
+        return 0;
+    }
+
+    span->data = om->om_data;
+    span->off = om_off;
+    span->len = om->om_len;
+    span->seg = om;
+
+    return 0;
+}
+#elif defined __ZEPHYR__
+int
+mgmt_sg_net_buf_span(void *buf, size_t off, struct mgmt_span *span, void *arg)
+{
+    struct net_buf *nb;
+    size_t nb_off;
+
+    /* Walk on from the previous fragment if the offset lies beyond it. */
+    if (span->len != 0 && off >= span->off) {
+        nb = span->seg;
+        nb_off = span->off;
+    } else {
+        nb = buf;
+        nb_off = 0;
+    }
+
+    while (nb != NULL && off >= nb_off + nb->len) {
+        nb_off += nb->len;
+        nb = nb->frags;
+    }
+
+    if (nb == NULL) {
+        memset(span, 0, sizeof *span);
+        return 0;
+    }
+
+    span->data = nb->data;
+    span->off = nb_off;
+    span->len = nb->len;
+    span->seg = nb;
+
+    return 0;
+}
+#endif
@@ -33,11 +33,22 @@
  * sequentially from the start of the packet to the end.  Each response is sent
  * individually in its own packet.  If a request elicits an error response,
  * processing of the packet is aborted.
+ *
+ * An OMP payload is normally a single request map.  A payload that is an
+ * array of request maps is a batch: the requests are processed in order and
+ * the response payload is an array holding one response map per request,
+ * each with its own "_h" and, on failure, "rc".
+ *
+ * Read requests can be observed: the request is re-evaluated periodically and
+ * the observer is notified only when its response changes, so that the OIC
+ * layer can push a CoAP Observe notification instead of being polled.
  */
 
 #ifndef H_OMP_
 #define H_OMP_
 
+#include <stdbool.h>
+#include <stdint.h>
 #include "mgmt/mgmt.h"
 
 #ifdef __cplusplus
@@ -46,6 +57,10 @@ extern "C" {
 
 struct omp_streamer;
 struct mgmt_hdr;
+struct omp_observer;
+
+/* Size of the argument map of an observed request. */
+#define OMP_OBSERVE_REQ_MAX     32
 
 /**
  * @brief Transmits an OMP response.
@@ -102,6 +117,95 @@ int omp_impl_process_request_packet(struct omp_state *omgr_st, void *req);
  */ 
 int omp_read_hdr(struct CborValue *cv, struct mgmt_hdr *out_hdr);
 
+/**
+ * @brief Processes a batch payload: an array of request maps.  One response
+ *        map per request is appended to the response array; a failed
+ *        request gets an error response and does not stop the batch.
+ *
+ * @param rsp_enc               Encoder of the response payload.
+ * @param ctxt                  Management context, whose iterator points to
+ *                                  the request array.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code if the
+ *                                  batch could not be decoded or encoded.
+ */
+int omp_process_batch(struct CborEncoder *rsp_enc, struct mgmt_ctxt *ctxt);
+
+/** @typedef omp_observe_fn
+ * @brief Called when the response to an observed request has changed.  The
+ *        OIC glue typically notifies the observers of the CoAP resource, which
+ *        then get the new response through the usual request path.
+ *
+ * @param obs                   The observer whose request changed.
+ * @param arg                   Argument passed to omp_observe_start().
+ */
+typedef void omp_observe_fn(struct omp_observer *obs, void *arg);
+
+/**
+ * @brief An observed read request.  Allocated by the caller; the fields are
+ *        set by omp_observe_start().
+ */
+struct omp_observer {
+    /* Header of the observed request; always a read. */
+    struct mgmt_hdr hdr;
+
+    /* CBOR map holding the request's arguments. */
+    uint8_t req[OMP_OBSERVE_REQ_MAX];
+    uint8_t req_len;
+
+    omp_observe_fn *cb;
+    void *arg;
+
+    /* Private. */
+    uint32_t digest;
+    bool digest_valid;
+    struct omp_observer *next;
+};
+
+/**
+ * @brief Starts observing a read request.  The current response is
+ *        recorded right away; the callback is only invoked for changes after
+ *        that.
+ *
+ * @param obs                   Caller-owned observer; must stay valid until
+ *                                  omp_observe_stop().
+ * @param group                 Management group of the request.
+ * @param id                    Command ID of the request.
+ * @param req                   CBOR map with the request's arguments; NULL
+ *                                  for none.
+ * @param req_len               Length of req.
+ * @param cb                    Called when the response changes.
+ * @param arg                   Passed to cb.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_ENOENT if the command does not exist;
+ *                              MGMT_ERR_EINVAL if the arguments are too long.
+ */
+int omp_observe_start(struct omp_observer *obs, uint16_t group, uint8_t id,
+                      const void *req, size_t req_len, omp_observe_fn *cb,
+                      void *arg);
+
+/**
+ * @brief Stops observing a request.
+ *
+ * @param obs                   The observer to remove.
+ */
+void omp_observe_stop(struct omp_observer *obs);
+
+/**
+ * @brief Re-evaluates all observed requests and notifies the observers whose
+ *        response changed.  Called periodically by the port.
+ *
+ * @return                      true if any request is still observed.
+ */
+bool omp_observe_poll(void);
+
+/**
+ * @brief Ensures that omp_observe_poll() gets called periodically while there
+ *        are observers.  Implemented by the port.
+ */
+void omp_impl_observe_arm(void);
+
 #ifdef __cplusplus
 }
 #endif
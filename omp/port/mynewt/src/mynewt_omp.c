@@ -29,6 +29,37 @@
 #include "omp/omp.h"
 #include "omp/omp_priv.h"
 
+#if MYNEWT_VAL(OMP_OBSERVE_INTERVAL_MS) > 0
+static struct os_callout mynewt_omp_observe_callout;
+
+static void
+mynewt_omp_observe_tmo(struct os_event *ev)
+{
+    /* Stop polling once nothing is observed; the next observer rearms. */
+    if (omp_observe_poll()) {
+        os_callout_reset(&mynewt_omp_observe_callout,
+                         MYNEWT_VAL(OMP_OBSERVE_INTERVAL_MS) *
+                         OS_TICKS_PER_SEC / 1000);
+    }
+}
+#endif
+
+void
+omp_impl_observe_arm(void)
+{
+#if MYNEWT_VAL(OMP_OBSERVE_INTERVAL_MS) > 0
+    if (mynewt_omp_observe_callout.c_ev.ev_cb == NULL) {
+        os_callout_init(&mynewt_omp_observe_callout, os_eventq_dflt_get(),
+                        mynewt_omp_observe_tmo, NULL);
+    }
+    if (!os_callout_queued(&mynewt_omp_observe_callout)) {
+        os_callout_reset(&mynewt_omp_observe_callout,
+                         MYNEWT_VAL(OMP_OBSERVE_INTERVAL_MS) *
+                         OS_TICKS_PER_SEC / 1000);
+    }
+#endif
+}
+
 int
 omp_impl_process_request_packet(struct omp_state *omgr_st, void *req_buf)
 {
@@ -44,6 +75,13 @@ omp_impl_process_request_packet(struct omp_state *omgr_st, void *req_buf)
     streamer = &omgr_st->omp_stmr;
     omgr_st->m_ctxt = &ctxt;
 
+    /* OMP responses are a single CoAP payload; no partial responses. */
+    ctxt.flush_cb = NULL;
+    ctxt.flush_arg = NULL;
+    ctxt.defer_cb = NULL;
+    ctxt.defer_arg = NULL;
+    ctxt.streamer = NULL;
+
     req_m = (struct os_mbuf *) req_buf;
 
     rc = mgmt_streamer_init_reader(&streamer->mgmt_stmr, req_m);
@@ -53,6 +91,16 @@ omp_impl_process_request_packet(struct omp_state *omgr_st, void *req_buf)
 
     }
 
+    if (cbor_value_is_array(&ctxt.it)) {
+        rc = omp_process_batch(streamer->rsp_encoder, &ctxt);
+        if (rc != 0) {
+            return MGMT_ERR_EINVAL;
+        }
+
+        streamer->tx_rsp_cb(streamer, rc, NULL);
+        return 0;
+    }
+
     rc = omp_read_hdr(&ctxt.it, &req_hdr);
     if (rc != 0) {
         rc = MGMT_ERR_EINVAL;
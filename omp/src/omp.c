@@ -25,9 +25,26 @@
 #include <mgmt/mgmt.h>
 #include <cborattr/cborattr.h>
 #include <tinycbor/cbor.h>
+#include <tinycbor/cbor_buf_reader.h>
 
+#include "omp/omp.h"
 #include "omp/omp_priv.h"
 
+/* FNV-1a parameters for the digest of observed responses. */
+#define OMP_DIGEST_INIT     0x811c9dc5u
+#define OMP_DIGEST_PRIME    0x01000193u
+
+/** Writer that digests a response instead of storing it. */
+struct omp_digest_writer {
+    struct cbor_encoder_writer enc;
+    uint32_t digest;
+};
+
+static struct omp_observer *omp_observers;
+
+/* Argument map of observed requests that have none. */
+static const uint8_t omp_empty_map[] = { 0xa0 };
+
 int
 omp_encode_mgmt_hdr(struct CborEncoder *enc, struct mgmt_hdr hdr)
 {
@@ -109,49 +126,228 @@ omp_process_mgmt_hdr(struct mgmt_hdr *req_hdr,
                      struct mgmt_hdr *rsp_hdr,
                      struct mgmt_ctxt *ctxt)
 {
-    int rc = 0;
-    const struct mgmt_handler *handler;
-    mgmt_handler_fn *handler_fn = NULL;
+    bool handler_found;
+    int rc;
 
-    handler = mgmt_find_handler(req_hdr->nh_group, req_hdr->nh_id);
-    if (handler == NULL) {
-        rc = MGMT_ERR_ENOENT;
+    rsp_hdr->nh_op = mgmt_rsp_op(req_hdr->nh_op);
+    rc = mgmt_dispatch(ctxt, req_hdr, &handler_found);
+    if (!handler_found) {
         return rc;
     }
+    mgmt_dispatch_done(req_hdr, rc);
 
-    switch (req_hdr->nh_op) {
-    case MGMT_OP_READ:
-        rsp_hdr->nh_op = MGMT_OP_READ_RSP;
-        handler_fn = handler->mh_read;
-        break;
-
-    case MGMT_OP_WRITE:
-        rsp_hdr->nh_op = MGMT_OP_WRITE_RSP;
-        handler_fn = handler->mh_write;
-        break;
-
-    default:
-        rc = MGMT_ERR_EINVAL;
-    }
+    /* Encode the MGMT header in the response. */
 
-    if (handler_fn) {
-        rc = handler_fn(ctxt);
+    if (rc != 0) {
+        rc = omp_send_err_rsp(&ctxt->encoder, rsp_hdr, rc);
     } else {
-        rc = MGMT_ERR_ENOTSUP;
+        rc = omp_encode_mgmt_hdr(&ctxt->encoder, *rsp_hdr);
+        if (rc != 0) {
+            rc = MGMT_ERR_ENOMEM;
+        }
     }
 
-    /* Encode the MGMT header in the response. */
+    return mgmt_err_from_cbor(rc);
+}
 
+int
+omp_process_batch(struct CborEncoder *rsp_enc, struct mgmt_ctxt *ctxt)
+{
+    struct mgmt_hdr req_hdr;
+    struct mgmt_hdr rsp_hdr;
+    CborEncoder rsps;
+    CborValue reqs;
+    int rc;
+
+    if (cbor_value_enter_container(&ctxt->it, &reqs) != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    rc = cbor_encoder_create_array(rsp_enc, &rsps, CborIndefiniteLength);
     if (rc != 0) {
-        if (handler_fn) {
-            rc = omp_send_err_rsp(&ctxt->encoder, rsp_hdr, rc);
+        return MGMT_ERR_ENOMEM;
+    }
+
+    while (!cbor_value_at_end(&reqs)) {
+        rc = omp_read_hdr(&reqs, &req_hdr);
+        if (rc != 0) {
+            break;
         }
-    } else {
-        rc = omp_encode_mgmt_hdr(&ctxt->encoder, *rsp_hdr);
+        memcpy(&rsp_hdr, &req_hdr, sizeof rsp_hdr);
+
+        /* Each request map is the root of its own request. */
+        ctxt->it = reqs;
+        rc = cbor_encoder_create_map(&rsps, &ctxt->encoder,
+                                     CborIndefiniteLength);
         if (rc != 0) {
             rc = MGMT_ERR_ENOMEM;
+            break;
+        }
+
+        rc = omp_process_mgmt_hdr(&req_hdr, &rsp_hdr, ctxt);
+        if (rc == MGMT_ERR_ENOTSUP || rc == MGMT_ERR_EINVAL) {
+            /* No handler for the request; nothing was encoded for it yet. */
+            rc = omp_send_err_rsp(&ctxt->encoder, &rsp_hdr, rc);
+        }
+
+        if (cbor_encoder_close_container(&rsps, &ctxt->encoder) != 0) {
+            rc = MGMT_ERR_ENOMEM;
+        }
+        if (rc != 0) {
+            break;
+        }
+
+        if (cbor_value_advance(&reqs) != 0) {
+            rc = MGMT_ERR_EINVAL;
+            break;
         }
     }
 
-    return mgmt_err_from_cbor(rc);
+    if (cbor_encoder_close_container(rsp_enc, &rsps) != 0 && rc == 0) {
+        rc = MGMT_ERR_ENOMEM;
+    }
+
+    return rc;
+}
+
+static int
+omp_digest_write(struct cbor_encoder_writer *w, const char *data, int len)
+{
+    struct omp_digest_writer *dw;
+    int i;
+
+    dw = (struct omp_digest_writer *)w;
+    for (i = 0; i < len; i++) {
+        dw->digest = (dw->digest ^ (uint8_t)data[i]) * OMP_DIGEST_PRIME;
+    }
+    dw->enc.bytes_written += len;
+
+    return CborNoError;
+}
+
+/**
+ * Runs the read handler of an observed request against a writer that only
+ * digests the response.
+ */
+static int
+omp_observe_digest(const struct omp_observer *obs, uint32_t *out_digest)
+{
+    const struct mgmt_handler *handler;
+    struct omp_digest_writer writer;
+    struct cbor_buf_reader reader;
+    struct mgmt_ctxt ctxt;
+    CborEncoder root;
+    int rc;
+
+    handler = mgmt_find_handler(obs->hdr.nh_group, obs->hdr.nh_id);
+    if (handler == NULL || handler->mh_read == NULL) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    cbor_buf_reader_init(&reader, obs->req, obs->req_len);
+    if (cbor_parser_init(&reader.r, 0, &ctxt.parser, &ctxt.it) != 0) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    writer.enc.write = omp_digest_write;
+    writer.enc.bytes_written = 0;
+    writer.digest = OMP_DIGEST_INIT;
+    cbor_encoder_init(&root, &writer.enc, 0);
+
+    /* Observations are evaluated outside of any transport. */
+    ctxt.flush_cb = NULL;
+    ctxt.flush_arg = NULL;
+    ctxt.defer_cb = NULL;
+    ctxt.defer_arg = NULL;
+    ctxt.streamer = NULL;
+
+    rc = cbor_encoder_create_map(&root, &ctxt.encoder, CborIndefiniteLength);
+    if (rc != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    rc = handler->mh_read(&ctxt);
+    cbor_encoder_close_container(&root, &ctxt.encoder);
+    if (rc != 0) {
+        return rc;
+    }
+
+    *out_digest = writer.digest;
+    return 0;
+}
+
+int
+omp_observe_start(struct omp_observer *obs, uint16_t group, uint8_t id,
+                  const void *req, size_t req_len, omp_observe_fn *cb,
+                  void *arg)
+{
+    if (mgmt_find_handler(group, id) == NULL) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    if (req == NULL) {
+        req = omp_empty_map;
+        req_len = sizeof omp_empty_map;
+    }
+    if (req_len > sizeof obs->req) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    memset(&obs->hdr, 0, sizeof obs->hdr);
+    obs->hdr.nh_op = MGMT_OP_READ;
+    obs->hdr.nh_group = group;
+    obs->hdr.nh_id = id;
+    memcpy(obs->req, req, req_len);
+    obs->req_len = req_len;
+    obs->cb = cb;
+    obs->arg = arg;
+
+    /* The observer already holds the current response. */
+    obs->digest_valid = omp_observe_digest(obs, &obs->digest) == 0;
+
+    obs->next = omp_observers;
+    omp_observers = obs;
+    omp_impl_observe_arm();
+
+    return 0;
+}
+
+void
+omp_observe_stop(struct omp_observer *obs)
+{
+    struct omp_observer **cur;
+
+    for (cur = &omp_observers; *cur != NULL; cur = &(*cur)->next) {
+        if (*cur == obs) {
+            *cur = obs->next;
+            break;
+        }
+    }
+}
+
+bool
+omp_observe_poll(void)
+{
+    struct omp_observer *obs;
+    struct omp_observer *next;
+    uint32_t digest;
+    bool changed;
+
+    for (obs = omp_observers; obs != NULL; obs = next) {
+        /* The callback may stop the observation. */
+        next = obs->next;
+
+        if (omp_observe_digest(obs, &digest) != 0) {
+            continue;
+        }
+
+        changed = !obs->digest_valid || digest != obs->digest;
+        obs->digest = digest;
+        obs->digest_valid = true;
+        if (changed) {
+            obs->cb(obs, obs->arg);
+        }
+    }
+
+    return omp_observers != NULL;
 }
@@ -0,0 +1,336 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * DFU throughput benchmark.
+ *
+ * Times every image upload received over the enabled transports and splits
+ * the time into:
+ *     o rx:     between one upload response and the next request; covers
+ *               the transport in both directions and the client.
+ *     o decode: decoding the upload requests.
+ *     o erase:  erasing the slot ahead of the data.
+ *     o write:  writing the data to flash.
+ *     o other:  the rest of the upload handler and the SMP core.
+ *
+ * The results of the last completed upload are kept in the `dfu_bench`
+ * statistics group and printed to the console.
+ */
+
+#include <assert.h>
+#include <zephyr.h>
+#include <string.h>
+#include <stats/stats.h>
+
+#include "mgmt/mgmt.h"
+#include "os_mgmt/os_mgmt.h"
+#include "img_mgmt/img_mgmt.h"
+#include "stat_mgmt/stat_mgmt.h"
+
+#ifdef CONFIG_MCUMGR_SMP_BT
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+#include <mgmt/smp_bt.h>
+#endif
+
+/* Results of the last completed upload, readable with `mcumgr stat`. */
+STATS_SECT_START(dfu_bench_stats)
+STATS_SECT_ENTRY(uploads)
+STATS_SECT_ENTRY(chunks)
+STATS_SECT_ENTRY(bytes)
+STATS_SECT_ENTRY(bytes_per_sec)
+STATS_SECT_ENTRY(total_ms)
+STATS_SECT_ENTRY(rx_ms)
+STATS_SECT_ENTRY(decode_us)
+STATS_SECT_ENTRY(erase_us)
+STATS_SECT_ENTRY(write_us)
+STATS_SECT_ENTRY(other_us)
+STATS_SECT_END;
+
+STATS_NAME_START(dfu_bench_stats)
+STATS_NAME(dfu_bench_stats, uploads)
+STATS_NAME(dfu_bench_stats, chunks)
+STATS_NAME(dfu_bench_stats, bytes)
+STATS_NAME(dfu_bench_stats, bytes_per_sec)
+STATS_NAME(dfu_bench_stats, total_ms)
+STATS_NAME(dfu_bench_stats, rx_ms)
+STATS_NAME(dfu_bench_stats, decode_us)
+STATS_NAME(dfu_bench_stats, erase_us)
+STATS_NAME(dfu_bench_stats, write_us)
+STATS_NAME(dfu_bench_stats, other_us)
+STATS_NAME_END(dfu_bench_stats);
+
+STATS_SECT_DECL(dfu_bench_stats) dfu_bench_stats;
+
+/* Phase totals accumulated by img_mgmt, in cycles. */
+static struct img_mgmt_ul_prof dfu_bench_prof;
+
+/* Copy of dfu_bench_prof taken as each upload request arrives. */
+static struct img_mgmt_ul_prof dfu_bench_snap;
+
+/* dfu_bench_snap as of the first request of the current upload. */
+static struct img_mgmt_ul_prof dfu_bench_base;
+
+static int64_t dfu_bench_start_ms;
+static int64_t dfu_bench_recv_ms;
+static uint32_t dfu_bench_recv_cyc;
+static uint32_t dfu_bench_done_cyc;
+static uint64_t dfu_bench_rx_cyc;
+static uint64_t dfu_bench_handler_cyc;
+static bool dfu_bench_active;
+static bool dfu_bench_complete;
+
+static uint32_t dfu_bench_clock(void)
+{
+	return k_cycle_get_32();
+}
+
+static void dfu_bench_report(void)
+{
+	struct img_mgmt_ul_prof p;
+	uint32_t total_ms;
+	uint32_t rx_ms;
+	uint32_t bps;
+	uint64_t other;
+
+	p.chunks = dfu_bench_prof.chunks - dfu_bench_base.chunks;
+	p.bytes = dfu_bench_prof.bytes - dfu_bench_base.bytes;
+	p.decode_ticks = dfu_bench_prof.decode_ticks -
+			 dfu_bench_base.decode_ticks;
+	p.erase_ticks = dfu_bench_prof.erase_ticks -
+			dfu_bench_base.erase_ticks;
+	p.write_ticks = dfu_bench_prof.write_ticks -
+			dfu_bench_base.write_ticks;
+
+	other = dfu_bench_handler_cyc;
+	other -= MIN(other, (uint64_t)p.decode_ticks + p.erase_ticks +
+			    p.write_ticks);
+
+	total_ms = k_uptime_get() - dfu_bench_start_ms;
+	rx_ms = k_cyc_to_ms_floor64(dfu_bench_rx_cyc);
+	bps = total_ms == 0 ? 0 : (uint64_t)p.bytes * 1000 / total_ms;
+
+	STATS_INC(dfu_bench_stats, uploads);
+	STATS_SET(dfu_bench_stats, chunks, p.chunks);
+	STATS_SET(dfu_bench_stats, bytes, p.bytes);
+	STATS_SET(dfu_bench_stats, bytes_per_sec, bps);
+	STATS_SET(dfu_bench_stats, total_ms, total_ms);
+	STATS_SET(dfu_bench_stats, rx_ms, rx_ms);
+	STATS_SET(dfu_bench_stats, decode_us,
+		  k_cyc_to_us_floor32(p.decode_ticks));
+	STATS_SET(dfu_bench_stats, erase_us,
+		  k_cyc_to_us_floor32(p.erase_ticks));
+	STATS_SET(dfu_bench_stats, write_us,
+		  k_cyc_to_us_floor32(p.write_ticks));
+	STATS_SET(dfu_bench_stats, other_us, k_cyc_to_us_floor64(other));
+
+	printk("Upload complete: %u bytes in %u chunks (%u B/chunk)\n",
+	       p.bytes, p.chunks, p.chunks == 0 ? 0 : p.bytes / p.chunks);
+	printk("  total  %8u ms  %8u B/s\n", total_ms, bps);
+	printk("  rx     %8u ms\n", rx_ms);
+	printk("  decode %8u us\n", k_cyc_to_us_floor32(p.decode_ticks));
+	printk("  erase  %8u us\n", k_cyc_to_us_floor32(p.erase_ticks));
+	printk("  write  %8u us\n", k_cyc_to_us_floor32(p.write_ticks));
+	printk("  other  %8u us\n", (uint32_t)k_cyc_to_us_floor64(other));
+}
+
+static int dfu_bench_on_evt(uint8_t opcode, uint16_t group, uint8_t id,
+			    void *arg, void *cb_arg)
+{
+	uint32_t now;
+
+	if (id != IMG_MGMT_ID_UPLOAD) {
+		return 0;
+	}
+
+	now = k_cycle_get_32();
+
+	switch (opcode) {
+	case MGMT_EVT_OP_CMD_RECV:
+		if (dfu_bench_active) {
+			dfu_bench_rx_cyc += now - dfu_bench_done_cyc;
+		}
+		dfu_bench_recv_cyc = now;
+		dfu_bench_recv_ms = k_uptime_get();
+		dfu_bench_snap = dfu_bench_prof;
+		break;
+
+	case MGMT_EVT_OP_CMD_DONE:
+		if (dfu_bench_active) {
+			dfu_bench_handler_cyc += now - dfu_bench_recv_cyc;
+		}
+		dfu_bench_done_cyc = now;
+
+		/* The last chunk's handler has returned; the upload is
+		 * fully accounted for.
+		 */
+		if (dfu_bench_complete) {
+			dfu_bench_complete = false;
+			dfu_bench_active = false;
+			dfu_bench_report();
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static struct mgmt_evt_sub dfu_bench_sub = {
+	.cb = dfu_bench_on_evt,
+	.evt_mask = MGMT_EVT_MASK(MGMT_EVT_OP_CMD_RECV) |
+		    MGMT_EVT_MASK(MGMT_EVT_OP_CMD_DONE),
+	.group = MGMT_GROUP_ID_IMAGE,
+};
+
+/* Called while the first chunk of an upload is being handled. */
+static void dfu_bench_started(void)
+{
+	dfu_bench_base = dfu_bench_snap;
+	dfu_bench_start_ms = dfu_bench_recv_ms;
+	dfu_bench_rx_cyc = 0;
+	dfu_bench_handler_cyc = 0;
+	dfu_bench_complete = false;
+	dfu_bench_active = true;
+}
+
+static void dfu_bench_stopped(void)
+{
+	if (dfu_bench_active) {
+		printk("Upload aborted\n");
+	}
+	dfu_bench_active = false;
+	dfu_bench_complete = false;
+}
+
+static void dfu_bench_pending(void)
+{
+	dfu_bench_complete = dfu_bench_active;
+}
+
+static const img_mgmt_dfu_callbacks_t dfu_bench_dfu_callbacks = {
+	.dfu_started_cb = dfu_bench_started,
+	.dfu_stopped_cb = dfu_bench_stopped,
+	.dfu_pending_cb = dfu_bench_pending,
+};
+
+#ifdef CONFIG_MCUMGR_SMP_BT
+static struct k_work advertise_work;
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL,
+		      0x84, 0xaa, 0x60, 0x74, 0x52, 0x8a, 0x8b, 0x86,
+		      0xd3, 0x4c, 0xb7, 0x1d, 0x1d, 0xdc, 0x53, 0x8d),
+};
+
+static void advertise(struct k_work *work)
+{
+	int rc;
+
+	bt_le_adv_stop();
+
+	rc = bt_le_adv_start(BT_LE_ADV_CONN_NAME, ad, ARRAY_SIZE(ad), NULL, 0);
+	if (rc) {
+		printk("Advertising failed to start (rc %d)\n", rc);
+		return;
+	}
+
+	printk("Advertising successfully started\n");
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		printk("Connection failed (err 0x%02x)\n", err);
+	} else {
+		printk("Connected\n");
+	}
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	printk("Disconnected (reason 0x%02x)\n", reason);
+	k_work_submit(&advertise_work);
+}
+
+static struct bt_conn_cb conn_callbacks = {
+	.connected = connected,
+	.disconnected = disconnected,
+};
+
+static void bt_ready(int err)
+{
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return;
+	}
+
+	printk("Bluetooth initialized\n");
+
+	k_work_submit(&advertise_work);
+}
+#endif
+
+void main(void)
+{
+	int rc;
+
+	rc = STATS_INIT_AND_REG(dfu_bench_stats, STATS_SIZE_32, "dfu_bench");
+	assert(rc == 0);
+
+	/* Register the mcumgr command handlers needed for an upload. */
+	os_mgmt_register_group();
+	img_mgmt_register_group();
+	stat_mgmt_register_group();
+
+	img_mgmt_register_callbacks(&dfu_bench_dfu_callbacks);
+	img_mgmt_set_ul_prof(&dfu_bench_prof, dfu_bench_clock);
+	mgmt_evt_subscribe(&dfu_bench_sub);
+
+	printk("DFU benchmark: chunk size %d, %s erase\n",
+	       CONFIG_IMG_MGMT_UL_CHUNK_SIZE,
+	       IS_ENABLED(CONFIG_IMG_ERASE_PROGRESSIVELY) ?
+	       "progressive" : "up-front");
+
+#ifdef CONFIG_MCUMGR_SMP_BT
+	k_work_init(&advertise_work, advertise);
+
+	/* Enable Bluetooth. */
+	rc = bt_enable(bt_ready);
+	if (rc != 0) {
+		printk("Bluetooth init failed (err %d)\n", rc);
+		return;
+	}
+	bt_conn_cb_register(&conn_callbacks);
+
+	/* Initialize the Bluetooth mcumgr transport. */
+	smp_bt_register();
+#endif
+
+	/* The system work queue handles all incoming mcumgr requests.  Let the
+	 * main thread idle while the mcumgr server runs.
+	 */
+	while (1) {
+		k_sleep(K_MSEC(1000));
+	}
+}
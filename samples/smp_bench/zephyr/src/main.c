@@ -0,0 +1,804 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/*
+ * SMP throughput benchmark.
+ *
+ * Requests are encoded into flat RAM buffers and handed straight to
+ * smp_process_request_packet(); responses come back through the same kind of
+ * buffer and are decoded just far enough to drive the next request.  No
+ * transport is involved, so the figures reported are the cost of the mcumgr
+ * core and of the command handlers alone.
+ */
+
+#include <assert.h>
+#include <zephyr.h>
+#include <string.h>
+#include <sys/byteorder.h>
+#include <stats/stats.h>
+#include <device.h>
+#include <fs/fs.h>
+#include <fs/littlefs.h>
+#include <storage/flash_map.h>
+
+#include "tinycbor/cbor.h"
+#include "cborattr/cborattr.h"
+#include "mgmt/mgmt.h"
+#include "smp/smp.h"
+#include "os_mgmt/os_mgmt.h"
+#include "img_mgmt/img_mgmt.h"
+#include "img_mgmt/image.h"
+#include "stat_mgmt/stat_mgmt.h"
+#include "fs_mgmt/fs_mgmt.h"
+
+#ifdef CONFIG_BOARD_NATIVE_POSIX
+#include "native_rtc.h"
+#endif
+
+/* Size of each request and response buffer, header included. */
+#define SMP_BENCH_BUF_SIZE      1024
+#define SMP_BENCH_BUF_COUNT     4
+
+/* Number of data bytes carried by each upload request. */
+#define SMP_BENCH_CHUNK_SIZE    512
+
+#define SMP_BENCH_ECHO_COUNT    2000
+#define SMP_BENCH_STAT_COUNT    2000
+#define SMP_BENCH_IMAGE_SIZE    (64 * 1024)
+#define SMP_BENCH_FILE_SIZE     (16 * 1024)
+#define SMP_BENCH_FILE_NAME     "/lfs/bench.bin"
+
+/* Define a stats group for the `stat show` workload to read. */
+STATS_SECT_START(smp_bench_stats)
+STATS_SECT_ENTRY(reqs)
+STATS_SECT_ENTRY(errs)
+STATS_SECT_ENTRY(rsp_bytes)
+STATS_SECT_END;
+
+STATS_NAME_START(smp_bench_stats)
+STATS_NAME(smp_bench_stats, reqs)
+STATS_NAME(smp_bench_stats, errs)
+STATS_NAME(smp_bench_stats, rsp_bytes)
+STATS_NAME_END(smp_bench_stats);
+
+STATS_SECT_DECL(smp_bench_stats) smp_bench_stats;
+
+FS_LITTLEFS_DECLARE_DEFAULT_CONFIG(cstorage);
+static struct fs_mount_t littlefs_mnt = {
+	.type = FS_LITTLEFS,
+	.fs_data = &cstorage,
+	.storage_dev = (void *)FLASH_AREA_ID(storage),
+	.mnt_point = "/lfs"
+};
+
+/**
+ * A flat RAM buffer.  Trimming the front advances `off` rather than moving
+ * the data.
+ */
+struct smp_bench_buf {
+	uint8_t data[SMP_BENCH_BUF_SIZE];
+	uint16_t off;
+	uint16_t len;
+	bool used;
+};
+
+struct smp_bench_reader {
+	struct cbor_decoder_reader r;
+	struct smp_bench_buf *buf;
+};
+
+struct smp_bench_writer {
+	struct cbor_encoder_writer enc;
+	struct smp_bench_buf *buf;
+};
+
+/** Totals for one command of the request mix. */
+struct smp_bench_cmd {
+	const char *name;
+	uint8_t op;
+	uint16_t group;
+	uint8_t id;
+
+	uint32_t reqs;
+	uint32_t errs;
+	uint64_t req_bytes;
+	uint64_t rsp_bytes;
+	uint64_t ticks;
+};
+
+/** Fields of the most recent response that the workloads act upon. */
+struct smp_bench_rsp {
+	long long int rc;
+	long long unsigned int off;
+	struct cbor_bytestring_ref data;
+	bool received;
+};
+
+static struct smp_bench_buf smp_bench_bufs[SMP_BENCH_BUF_COUNT];
+static struct smp_bench_reader smp_bench_reader;
+static struct smp_bench_writer smp_bench_writer;
+static struct smp_bench_cmd *smp_bench_cur;
+static struct smp_bench_rsp smp_bench_rsp;
+static uint8_t smp_bench_seq;
+
+static uint8_t smp_bench_image[SMP_BENCH_IMAGE_SIZE];
+
+static struct smp_bench_cmd smp_bench_echo = {
+	.name = "echo",
+	.op = MGMT_OP_WRITE,
+	.group = MGMT_GROUP_ID_OS,
+	.id = OS_MGMT_ID_ECHO,
+};
+
+static struct smp_bench_cmd smp_bench_stat_show = {
+	.name = "stat show",
+	.op = MGMT_OP_READ,
+	.group = MGMT_GROUP_ID_STAT,
+	.id = STAT_MGMT_ID_SHOW,
+};
+
+static struct smp_bench_cmd smp_bench_img_upload = {
+	.name = "image upload",
+	.op = MGMT_OP_WRITE,
+	.group = MGMT_GROUP_ID_IMAGE,
+	.id = IMG_MGMT_ID_UPLOAD,
+};
+
+static struct smp_bench_cmd smp_bench_fs_upload = {
+	.name = "fs upload",
+	.op = MGMT_OP_WRITE,
+	.group = MGMT_GROUP_ID_FS,
+	.id = FS_MGMT_ID_FILE,
+};
+
+static struct smp_bench_cmd smp_bench_fs_download = {
+	.name = "fs download",
+	.op = MGMT_OP_READ,
+	.group = MGMT_GROUP_ID_FS,
+	.id = FS_MGMT_ID_FILE,
+};
+
+static struct smp_bench_cmd *const smp_bench_cmds[] = {
+	&smp_bench_echo,
+	&smp_bench_stat_show,
+	&smp_bench_img_upload,
+	&smp_bench_fs_upload,
+	&smp_bench_fs_download,
+};
+
+/*
+ * On native_posix the kernel's cycle counter only advances with simulated
+ * time, which stands still while code runs; time the host instead.
+ */
+static uint32_t smp_bench_clock(void)
+{
+#ifdef CONFIG_BOARD_NATIVE_POSIX
+	return (uint32_t)native_rtc_gettime_us(RTC_CLOCK_PSEUDOHOSTREALTIME);
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+static uint32_t smp_bench_clock_rate(void)
+{
+#ifdef CONFIG_BOARD_NATIVE_POSIX
+	return 1000000;
+#else
+	return sys_clock_hw_cycles_per_sec();
+#endif
+}
+
+#ifdef CONFIG_BOARD_NATIVE_POSIX
+#define SMP_BENCH_TICK_UNIT     "us"
+#else
+#define SMP_BENCH_TICK_UNIT     "cycles"
+#endif
+
+SMP_LAT_DEFINE(smp_bench_lat, ARRAY_SIZE(smp_bench_cmds), smp_bench_clock);
+
+/*
+ * Loopback streamer.
+ */
+
+static const uint8_t *smp_bench_reader_ptr(struct cbor_decoder_reader *d,
+					   int offset)
+{
+	struct smp_bench_reader *rd;
+
+	rd = CONTAINER_OF(d, struct smp_bench_reader, r);
+	return rd->buf->data + rd->buf->off + offset;
+}
+
+static uint8_t smp_bench_get8(struct cbor_decoder_reader *d, int offset)
+{
+	return *smp_bench_reader_ptr(d, offset);
+}
+
+static uint16_t smp_bench_get16(struct cbor_decoder_reader *d, int offset)
+{
+	return sys_get_be16(smp_bench_reader_ptr(d, offset));
+}
+
+static uint32_t smp_bench_get32(struct cbor_decoder_reader *d, int offset)
+{
+	return sys_get_be32(smp_bench_reader_ptr(d, offset));
+}
+
+static uint64_t smp_bench_get64(struct cbor_decoder_reader *d, int offset)
+{
+	return sys_get_be64(smp_bench_reader_ptr(d, offset));
+}
+
+static uintptr_t smp_bench_cmp(struct cbor_decoder_reader *d, char *dst,
+			       int offset, size_t len)
+{
+	return memcmp(dst, smp_bench_reader_ptr(d, offset), len);
+}
+
+static uintptr_t smp_bench_cpy(struct cbor_decoder_reader *d, char *dst,
+			       int offset, size_t len)
+{
+	return (uintptr_t)memcpy(dst, smp_bench_reader_ptr(d, offset), len);
+}
+
+static int smp_bench_write(struct cbor_encoder_writer *writer,
+			   const char *data, int len)
+{
+	struct smp_bench_writer *wr;
+	struct smp_bench_buf *buf;
+
+	wr = CONTAINER_OF(writer, struct smp_bench_writer, enc);
+	buf = wr->buf;
+
+	if (buf->off + buf->len + len > SMP_BENCH_BUF_SIZE) {
+		return CborErrorOutOfMemory;
+	}
+
+	memcpy(buf->data + buf->off + buf->len, data, len);
+	buf->len += len;
+	writer->bytes_written += len;
+
+	return CborNoError;
+}
+
+static void smp_bench_writer_init(struct smp_bench_writer *wr,
+				  struct smp_bench_buf *buf)
+{
+	wr->enc.write = smp_bench_write;
+	wr->enc.bytes_written = buf->len;
+	wr->buf = buf;
+}
+
+static void *smp_bench_alloc_rsp(const void *src_buf, void *arg)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(smp_bench_bufs); i++) {
+		if (!smp_bench_bufs[i].used) {
+			smp_bench_bufs[i].used = true;
+			smp_bench_bufs[i].off = 0;
+			smp_bench_bufs[i].len = 0;
+			return &smp_bench_bufs[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void smp_bench_trim_front(void *buf, size_t len, void *arg)
+{
+	struct smp_bench_buf *sb = buf;
+
+	if (len > sb->len) {
+		len = sb->len;
+	}
+	sb->off += len;
+	sb->len -= len;
+
+	if (smp_bench_reader.buf == sb) {
+		smp_bench_reader.r.message_size = sb->len;
+	}
+}
+
+static void smp_bench_reset_buf(void *buf, void *arg)
+{
+	struct smp_bench_buf *sb = buf;
+
+	sb->off = 0;
+	sb->len = 0;
+}
+
+static int smp_bench_write_at(struct cbor_encoder_writer *writer,
+			      size_t offset, const void *data, size_t len,
+			      void *arg)
+{
+	struct smp_bench_buf *sb;
+
+	sb = CONTAINER_OF(writer, struct smp_bench_writer, enc)->buf;
+
+	if (offset > sb->len) {
+		return MGMT_ERR_EINVAL;
+	}
+	if (sb->off + offset + len > SMP_BENCH_BUF_SIZE) {
+		return MGMT_ERR_ENOMEM;
+	}
+
+	memcpy(sb->data + sb->off + offset, data, len);
+	if (offset + len > sb->len) {
+		sb->len = offset + len;
+		writer->bytes_written = sb->len;
+	}
+
+	return 0;
+}
+
+static int smp_bench_truncate(struct cbor_encoder_writer *writer, size_t len,
+			      void *arg)
+{
+	struct smp_bench_buf *sb;
+
+	sb = CONTAINER_OF(writer, struct smp_bench_writer, enc)->buf;
+
+	if (len > sb->len) {
+		return MGMT_ERR_EINVAL;
+	}
+
+	sb->len = len;
+	writer->bytes_written = len;
+
+	return 0;
+}
+
+static int smp_bench_init_reader(struct cbor_decoder_reader *reader,
+				 void *buf, void *arg)
+{
+	struct smp_bench_reader *rd;
+
+	rd = CONTAINER_OF(reader, struct smp_bench_reader, r);
+	rd->r = (struct cbor_decoder_reader) {
+		.get8 = smp_bench_get8,
+		.get16 = smp_bench_get16,
+		.get32 = smp_bench_get32,
+		.get64 = smp_bench_get64,
+		.cmp = smp_bench_cmp,
+		.cpy = smp_bench_cpy,
+		.message_size = ((struct smp_bench_buf *)buf)->len,
+	};
+	rd->buf = buf;
+
+	return 0;
+}
+
+static int smp_bench_init_writer(struct cbor_encoder_writer *writer,
+				 void *buf, void *arg)
+{
+	smp_bench_writer_init(
+		CONTAINER_OF(writer, struct smp_bench_writer, enc), buf);
+	return 0;
+}
+
+static void smp_bench_free_buf(void *buf, void *arg)
+{
+	if (buf != NULL) {
+		((struct smp_bench_buf *)buf)->used = false;
+	}
+}
+
+static const struct mgmt_streamer_cfg smp_bench_cbor_cfg = {
+	.alloc_rsp = smp_bench_alloc_rsp,
+	.trim_front = smp_bench_trim_front,
+	.reset_buf = smp_bench_reset_buf,
+	.write_at = smp_bench_write_at,
+	.init_reader = smp_bench_init_reader,
+	.init_writer = smp_bench_init_writer,
+	.free_buf = smp_bench_free_buf,
+	.truncate = smp_bench_truncate,
+};
+
+/**
+ * Accounts for a response and records the fields the workloads need.  Freeing
+ * a buffer only marks it unused, so the recorded data reference stays valid
+ * until the next request is built.
+ */
+static int smp_bench_tx_rsp(struct smp_streamer *ss, void *buf, void *arg)
+{
+	struct smp_bench_buf *sb = buf;
+	const struct cbor_attr_t attrs[] = {
+		{
+			.attribute = "rc",
+			.type = CborAttrIntegerType,
+			.addr.integer = &smp_bench_rsp.rc,
+			.nodefault = true,
+		},
+		{
+			.attribute = "off",
+			.type = CborAttrUnsignedIntegerType,
+			.addr.uinteger = &smp_bench_rsp.off,
+			.nodefault = true,
+		},
+		{
+			.attribute = "data",
+			.type = CborAttrByteStringRefType,
+			.addr.bytestring_ref = &smp_bench_rsp.data,
+			.nodefault = true,
+		},
+		{ 0 },
+	};
+	int rc;
+
+	smp_bench_cur->rsp_bytes += sb->len;
+	STATS_INCN(smp_bench_stats, rsp_bytes, sb->len);
+
+	smp_bench_rsp.received = true;
+	if (sb->len < MGMT_HDR_SIZE) {
+		rc = MGMT_ERR_EMSGSIZE;
+	} else {
+		rc = cbor_read_flat_attrs(sb->data + sb->off + MGMT_HDR_SIZE,
+					  sb->len - MGMT_HDR_SIZE, attrs);
+	}
+	if (rc != 0) {
+		smp_bench_rsp.rc = MGMT_ERR_EUNKNOWN;
+	}
+
+	smp_bench_free_buf(buf, arg);
+	return 0;
+}
+
+static struct smp_streamer smp_bench_streamer = {
+	.mgmt_stmr = {
+		.cfg = &smp_bench_cbor_cfg,
+		.reader = &smp_bench_reader.r,
+		.writer = &smp_bench_writer.enc,
+		.mtu = SMP_BENCH_BUF_SIZE,
+		.buf_count = SMP_BENCH_BUF_COUNT,
+	},
+	.tx_rsp_cb = smp_bench_tx_rsp,
+	.lat = &smp_bench_lat,
+};
+
+/*
+ * Driver.
+ */
+
+typedef int smp_bench_encode_fn(CborEncoder *map, void *arg);
+
+/**
+ * Builds one request for the specified command, runs it through the SMP
+ * core, and adds the time taken to the command's totals.
+ *
+ * @return                      The response's "rc" on success (0 if the
+ *                              response carried none), or
+ *                              MGMT_ERR_[...] if no response was produced.
+ */
+static int smp_bench_run(struct smp_bench_cmd *cmd,
+			 smp_bench_encode_fn *encode_cb, void *arg)
+{
+	struct smp_bench_writer req_writer;
+	struct smp_bench_buf *req;
+	struct mgmt_hdr hdr;
+	CborEncoder enc;
+	CborEncoder map;
+	uint32_t start;
+	int rc;
+
+	req = smp_bench_alloc_rsp(NULL, NULL);
+	if (req == NULL) {
+		return MGMT_ERR_ENOMEM;
+	}
+
+	/* Leave room for the header; it is filled in once the length is
+	 * known.
+	 */
+	req->len = MGMT_HDR_SIZE;
+	smp_bench_writer_init(&req_writer, req);
+	cbor_encoder_init(&enc, &req_writer.enc, 0);
+
+	rc = cbor_encoder_create_map(&enc, &map, CborIndefiniteLength);
+	if (rc == 0) {
+		rc = encode_cb(&map, arg);
+	}
+	if (rc == 0) {
+		rc = cbor_encoder_close_container(&enc, &map);
+	}
+	if (rc != 0) {
+		smp_bench_free_buf(req, NULL);
+		return MGMT_ERR_ENOMEM;
+	}
+
+	hdr = (struct mgmt_hdr) {
+		.nh_op = cmd->op,
+		.nh_len = req->len - MGMT_HDR_SIZE,
+		.nh_group = cmd->group,
+		.nh_seq = smp_bench_seq++,
+		.nh_id = cmd->id,
+	};
+	mgmt_hton_hdr(&hdr);
+	memcpy(req->data, &hdr, sizeof hdr);
+
+	cmd->req_bytes += req->len;
+	smp_bench_cur = cmd;
+	smp_bench_rsp = (struct smp_bench_rsp) { 0 };
+
+	start = smp_bench_clock();
+	smp_process_request_packet(&smp_bench_streamer, req);
+	cmd->ticks += smp_bench_clock() - start;
+	cmd->reqs++;
+	STATS_INC(smp_bench_stats, reqs);
+
+	if (!smp_bench_rsp.received) {
+		rc = MGMT_ERR_EUNKNOWN;
+	} else {
+		rc = smp_bench_rsp.rc;
+	}
+	if (rc != 0) {
+		cmd->errs++;
+		STATS_INC(smp_bench_stats, errs);
+	}
+
+	return rc;
+}
+
+static int smp_bench_encode_echo(CborEncoder *map, void *arg)
+{
+	int err = 0;
+
+	err |= cbor_encode_text_stringz(map, "d");
+	err |= cbor_encode_text_stringz(map, "mcumgr benchmark echo payload");
+
+	return err;
+}
+
+static int smp_bench_encode_stat_show(CborEncoder *map, void *arg)
+{
+	int err = 0;
+
+	err |= cbor_encode_text_stringz(map, "name");
+	err |= cbor_encode_text_stringz(map, "smp_bench_stats");
+
+	return err;
+}
+
+/** One chunk of an image or file upload. */
+struct smp_bench_chunk {
+	const char *name;
+	const uint8_t *data;
+	size_t total;
+	size_t off;
+	size_t len;
+};
+
+static int smp_bench_encode_chunk(CborEncoder *map, void *arg)
+{
+	const struct smp_bench_chunk *chunk = arg;
+	int err = 0;
+
+	if (chunk->name != NULL) {
+		err |= cbor_encode_text_stringz(map, "name");
+		err |= cbor_encode_text_stringz(map, chunk->name);
+	}
+	err |= cbor_encode_text_stringz(map, "off");
+	err |= cbor_encode_uint(map, chunk->off);
+	if (chunk->off == 0 && chunk->data != NULL) {
+		err |= cbor_encode_text_stringz(map, "len");
+		err |= cbor_encode_uint(map, chunk->total);
+	}
+	if (chunk->data != NULL) {
+		err |= cbor_encode_text_stringz(map, "data");
+		err |= cbor_encode_byte_string(map, chunk->data + chunk->off,
+					       chunk->len);
+	}
+
+	return err;
+}
+
+/**
+ * Uploads `total` bytes of `data` in SMP_BENCH_CHUNK_SIZE pieces, resuming
+ * from whatever offset the server reports after each one.
+ */
+static int smp_bench_upload(struct smp_bench_cmd *cmd, const char *name,
+			    const uint8_t *data, size_t total)
+{
+	struct smp_bench_chunk chunk = {
+		.name = name,
+		.data = data,
+		.total = total,
+	};
+	int rc;
+
+	while (chunk.off < total) {
+		chunk.len = MIN(SMP_BENCH_CHUNK_SIZE, total - chunk.off);
+		rc = smp_bench_run(cmd, smp_bench_encode_chunk, &chunk);
+		if (rc != 0) {
+			return rc;
+		}
+		if (smp_bench_rsp.off <= chunk.off) {
+			return MGMT_ERR_EUNKNOWN;
+		}
+		chunk.off = smp_bench_rsp.off;
+	}
+
+	return 0;
+}
+
+static int smp_bench_download(struct smp_bench_cmd *cmd, const char *name,
+			      size_t total)
+{
+	struct smp_bench_chunk chunk = {
+		.name = name,
+		.total = total,
+	};
+	int rc;
+
+	while (chunk.off < total) {
+		rc = smp_bench_run(cmd, smp_bench_encode_chunk, &chunk);
+		if (rc != 0) {
+			return rc;
+		}
+		if (smp_bench_rsp.data.len == 0) {
+			return MGMT_ERR_EUNKNOWN;
+		}
+		chunk.off += smp_bench_rsp.data.len;
+	}
+
+	return 0;
+}
+
+/**
+ * Fills the benchmark image with a header, a patterned body, and the minimal
+ * TLV trailer img_mgmt needs to parse it once the upload completes.
+ */
+static void smp_bench_image_build(void)
+{
+	struct image_header *hdr;
+	struct image_tlv_info *info;
+	struct image_tlv *tlv;
+	size_t trailer_len;
+	size_t body_len;
+	size_t i;
+
+	trailer_len = sizeof *info + sizeof *tlv + IMAGE_HASH_LEN;
+	body_len = SMP_BENCH_IMAGE_SIZE - IMAGE_HEADER_SIZE - trailer_len;
+
+	for (i = 0; i < SMP_BENCH_IMAGE_SIZE; i++) {
+		smp_bench_image[i] = i;
+	}
+
+	hdr = (struct image_header *)smp_bench_image;
+	memset(hdr, 0, sizeof *hdr);
+	hdr->ih_magic = IMAGE_MAGIC;
+	hdr->ih_hdr_size = IMAGE_HEADER_SIZE;
+	hdr->ih_img_size = body_len;
+	hdr->ih_ver.iv_major = 1;
+
+	info = (struct image_tlv_info *)
+		(smp_bench_image + IMAGE_HEADER_SIZE + body_len);
+	info->it_magic = IMAGE_TLV_INFO_MAGIC;
+	info->it_tlv_tot = trailer_len;
+
+	tlv = (struct image_tlv *)(info + 1);
+	tlv->it_type = IMAGE_TLV_SHA256;
+	tlv->_pad = 0;
+	tlv->it_len = IMAGE_HASH_LEN;
+}
+
+static void smp_bench_report(uint32_t wall_ticks)
+{
+	const struct smp_bench_cmd *cmd;
+	const struct smp_lat_entry *lat;
+	uint64_t rate;
+	uint64_t bps;
+	uint32_t max;
+	int i;
+	int j;
+
+	rate = smp_bench_clock_rate();
+
+	printk("\n%-14s %8s %6s %10s %12s %12s %10s\n",
+	       "command", "reqs", "errs", "req/s", "bytes/s",
+	       SMP_BENCH_TICK_UNIT "/req", "max");
+
+	for (i = 0; i < ARRAY_SIZE(smp_bench_cmds); i++) {
+		cmd = smp_bench_cmds[i];
+		if (cmd->reqs == 0 || cmd->ticks == 0) {
+			continue;
+		}
+
+		/* The same command can appear twice in the mix (fs upload
+		 * and download share an ID), so the histogram's maximum is
+		 * per ID rather than per workload.
+		 */
+		max = 0;
+		for (j = 0; j < smp_bench_lat.entry_count; j++) {
+			lat = &smp_bench_lat.entries[j];
+			if (lat->used && lat->group == cmd->group &&
+			    lat->id == cmd->id) {
+				max = lat->max;
+			}
+		}
+
+		bps = (cmd->req_bytes + cmd->rsp_bytes) * rate / cmd->ticks;
+		printk("%-14s %8u %6u %10u %12u %12u %10u\n",
+		       cmd->name, cmd->reqs, cmd->errs,
+		       (uint32_t)(cmd->reqs * rate / cmd->ticks),
+		       (uint32_t)bps,
+		       (uint32_t)(cmd->ticks / cmd->reqs), max);
+	}
+
+	printk("\ntotal: %u %s\n", wall_ticks, SMP_BENCH_TICK_UNIT);
+}
+
+void main(void)
+{
+	uint32_t start;
+	int rc;
+	int i;
+
+	rc = STATS_INIT_AND_REG(smp_bench_stats, STATS_SIZE_32,
+				"smp_bench_stats");
+	assert(rc == 0);
+
+	rc = fs_mount(&littlefs_mnt);
+	if (rc < 0) {
+		printk("Error mounting littlefs [%d]\n", rc);
+	}
+
+	fs_mgmt_register_group();
+	os_mgmt_register_group();
+	img_mgmt_register_group();
+	stat_mgmt_register_group();
+
+	smp_bench_image_build();
+
+	start = smp_bench_clock();
+
+	for (i = 0; i < SMP_BENCH_ECHO_COUNT; i++) {
+		smp_bench_run(&smp_bench_echo, smp_bench_encode_echo, NULL);
+	}
+
+	for (i = 0; i < SMP_BENCH_STAT_COUNT; i++) {
+		smp_bench_run(&smp_bench_stat_show, smp_bench_encode_stat_show,
+			      NULL);
+	}
+
+	rc = smp_bench_upload(&smp_bench_img_upload, NULL, smp_bench_image,
+			      SMP_BENCH_IMAGE_SIZE);
+	if (rc != 0) {
+		printk("Image upload failed (rc %d)\n", rc);
+	}
+
+	rc = smp_bench_upload(&smp_bench_fs_upload, SMP_BENCH_FILE_NAME,
+			      smp_bench_image, SMP_BENCH_FILE_SIZE);
+	if (rc != 0) {
+		printk("File upload failed (rc %d)\n", rc);
+	} else {
+		rc = smp_bench_download(&smp_bench_fs_download,
+					SMP_BENCH_FILE_NAME,
+					SMP_BENCH_FILE_SIZE);
+		if (rc != 0) {
+			printk("File download failed (rc %d)\n", rc);
+		}
+	}
+
+	smp_bench_report(smp_bench_clock() - start);
+
+	if (smp_bench_lat.untracked != 0) {
+		printk("%u requests not timed by the streamer\n",
+		       smp_bench_lat.untracked);
+	}
+}
@@ -38,6 +38,12 @@
 #endif
 #ifdef CONFIG_MCUMGR_CMD_STAT_MGMT
 #include "stat_mgmt/stat_mgmt.h"
+#ifdef CONFIG_MCUMGR_CMD_CRASH_MGMT
+#include "crash_mgmt/crash_mgmt.h"
+#endif
+#ifdef CONFIG_MCUMGR_CMD_SETTINGS_MGMT
+#include "settings_mgmt/settings_mgmt.h"
+#endif
 #endif
 
 #ifdef CONFIG_MCUMGR_SMP_BT
@@ -45,6 +51,16 @@
 #include <bluetooth/conn.h>
 #include <bluetooth/gatt.h>
 #include <mgmt/smp_bt.h>
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF
+#include "smp/smp_bt_perf.h"
+#endif
+#ifdef CONFIG_MCUMGR_SMP_L2CAP
+#include "smp/smp_l2cap.h"
+#endif
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_NET
+#include "smp/smp_net.h"
 #endif
 
 /* Define an example stats group; approximates seconds since boot. */
@@ -152,6 +168,15 @@ void main(void)
 #endif
 #ifdef CONFIG_MCUMGR_CMD_STAT_MGMT
 	stat_mgmt_register_group();
+#if STAT_MGMT_HIST_GROUP_CNT > 0
+	stat_mgmt_hist_track("smp_svr_stats");
+#endif
+#endif
+#ifdef CONFIG_MCUMGR_CMD_CRASH_MGMT
+	crash_mgmt_register_group();
+#endif
+#ifdef CONFIG_MCUMGR_CMD_SETTINGS_MGMT
+	settings_mgmt_register_group();
 #endif
 
 #ifdef CONFIG_MCUMGR_SMP_BT
@@ -167,6 +192,25 @@ void main(void)
 
 	/* Initialize the Bluetooth mcumgr transport. */
 	smp_bt_register();
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF
+	/* Speed the link up for uploads. */
+	smp_bt_perf_init();
+#endif
+#ifdef CONFIG_MCUMGR_SMP_L2CAP
+	/* Accept requests over an L2CAP channel as well. */
+	rc = smp_l2cap_register();
+	if (rc != 0) {
+		printk("SMP L2CAP transport init failed (err %d)\n", rc);
+	}
+#endif
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_NET
+	/* Serve requests over UDP as well. */
+	rc = smp_net_open();
+	if (rc != 0) {
+		printk("SMP UDP transport init failed (err %d)\n", rc);
+	}
 #endif
 
 	/* The system work queue handles all incoming mcumgr requests.  Let the
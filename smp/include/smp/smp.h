@@ -31,13 +31,37 @@
  * request must start at an offset that is a multiple of 4, so padding should
  * be inserted between requests as necessary.  Requests are processed
  * sequentially from the start of the packet to the end.  Each response is sent
- * individually in its own packet.  If a request elicits an error response,
- * processing of the packet is aborted.
+ * individually in its own packet, unless the transport enables coalescing, in
+ * which case responses are concatenated the same way requests are.  If a
+ * request elicits an error response, processing of the packet is aborted,
+ * unless the streamer continues past errors (see smp_streamer.err_continue).
+ *
+ * A handler may defer its response (see mgmt_defer()); processing moves on to
+ * the next request, and the deferred response is sent in its own packet when
+ * the handler completes it.  The deferred response refers to the streamer the
+ * request arrived on, and is completed through its writer and transmit
+ * callback.  That streamer must therefore remain valid until every response
+ * deferred on it has been completed, so transports keep their streamers in
+ * static or per-connection storage rather than on the stack.
+ *
+ * A streamer may keep a replay cache of recent responses.  A request that
+ * matches a cached one (same op, group, ID, sequence number and payload) is
+ * taken to be a retransmission and is answered with the cached response
+ * without invoking its handler again.
+ *
+ * A streamer may also keep a response cache for idempotent reads, i.e., read
+ * handlers with an epoch (see mgmt_handler.mh_read_epoch).  A read that
+ * matches a cached one (same group, ID and payload) made in the same epoch is
+ * answered by copying the cached payload behind a fresh header.
+ *
+ * A streamer may require its requests to be authenticated (see smp_auth.h).
+ * Each request's tag is checked before it is dispatched.
  */
 
 #ifndef H_SMP_
 #define H_SMP_
 
+#include <stdbool.h>
 #include "mgmt/mgmt.h"
 
 #ifdef __cplusplus
@@ -45,6 +69,7 @@ extern "C" {
 #endif
 
 struct smp_streamer;
+struct smp_auth;
 struct mgmt_hdr;
 
 /** @typedef smp_tx_rsp_fn
@@ -58,12 +83,356 @@ struct mgmt_hdr;
  */
 typedef int smp_tx_rsp_fn(struct smp_streamer *ss, void *buf, void *arg);
 
+/** @typedef smp_lock_fn
+ * @brief Acquires or releases exclusive use of an SMP streamer.
+ *
+ * @param ss                    The streamer to lock or unlock.
+ * @param arg                   Optional streamer argument.
+ */
+typedef void smp_lock_fn(struct smp_streamer *ss, void *arg);
+
+/** @typedef smp_clock_fn
+ * @brief Reads a free-running clock used to time requests.
+ *
+ * @return                      The current time, in arbitrary ticks; may
+ *                                  wrap.
+ */
+typedef uint32_t smp_clock_fn(void);
+
+/* Number of log2 buckets in a latency histogram. */
+#define SMP_LAT_BUCKETS         24
+
+/**
+ * @brief Latency histogram of one command.
+ *
+ * Bucket 0 counts requests that took 0 ticks; bucket i > 0 counts those that
+ * took 2^(i-1) to 2^i - 1 ticks.  The last bucket also takes everything
+ * slower.
+ */
+struct smp_lat_entry {
+    uint16_t group;
+    uint8_t id;
+    bool used;
+
+    uint32_t count;
+    uint32_t max;
+    uint32_t buckets[SMP_LAT_BUCKETS];
+};
+
+/**
+ * @brief Per-command latency histograms kept by an SMP streamer.
+ *
+ * Each request is timed from the arrival of its header until its response
+ * has been handed to the transport.  Deferred responses and replays are not
+ * timed.  Use SMP_LAT_DEFINE() to allocate one.
+ */
+struct smp_lat {
+    smp_clock_fn *clock_cb;
+
+    /* Tracked commands, in order of first use. */
+    struct smp_lat_entry *entries;
+    uint8_t entry_count;
+
+    /* Requests not recorded because every entry was taken. */
+    uint32_t untracked;
+};
+
+/**
+ * @brief Defines a set of latency histograms.
+ *
+ * @param name_                 Name of the histogram set object.
+ * @param count_                Number of commands to track.
+ * @param clock_                The smp_clock_fn to time requests with.
+ */
+#define SMP_LAT_DEFINE(name_, count_, clock_)                             \
+    static struct smp_lat_entry name_##_entries[(count_)];                \
+    static struct smp_lat name_ = {                                       \
+        .clock_cb = (clock_),                                             \
+        .entries = name_##_entries,                                       \
+        .entry_count = (count_),                                          \
+    }
+
+/**
+ * @brief A response held in an SMP replay cache.
+ */
+struct smp_replay_entry {
+    /* Header of the request (host-byte order). */
+    struct mgmt_hdr req_hdr;
+
+    /* Hash of the request payload. */
+    uint32_t req_hash;
+
+    /* Length of the cached response; 0 if the entry is unused. */
+    uint16_t rsp_len;
+};
+
+/**
+ * @brief The most recent responses sent by an SMP streamer.
+ *
+ * Only complete, successful responses of at most rsp_max bytes are cached;
+ * responses that were flushed in parts or deferred are not.  Use
+ * SMP_REPLAY_CACHE_DEFINE() to allocate one.
+ */
+struct smp_replay_cache {
+    struct smp_replay_entry *entries;
+
+    /* Response data; entry_count buffers of rsp_max bytes each. */
+    uint8_t *rsp_bufs;
+
+    uint16_t rsp_max;
+    uint8_t entry_count;
+
+    /* Index of the entry to replace next. */
+    uint8_t next;
+
+    /* Key of the request being processed, if it is to be cached. */
+    struct smp_replay_entry cur;
+    bool cur_valid;
+};
+
+/**
+ * @brief Defines a static SMP replay cache.
+ *
+ * @param name_                 Name of the cache object.
+ * @param count_                Number of responses to keep.
+ * @param rsp_max_              Maximum size of a cached response, including
+ *                                  the SMP header.
+ */
+#define SMP_REPLAY_CACHE_DEFINE(name_, count_, rsp_max_)                  \
+    static struct smp_replay_entry name_##_entries[(count_)];             \
+    static uint8_t name_##_bufs[(count_) * (rsp_max_)];                   \
+    static struct smp_replay_cache name_ = {                              \
+        .entries = name_##_entries,                                       \
+        .rsp_bufs = name_##_bufs,                                         \
+        .rsp_max = (rsp_max_),                                            \
+        .entry_count = (count_),                                          \
+    }
+
+/**
+ * @brief A payload held in an SMP response cache.
+ */
+struct smp_rsp_cache_entry {
+    uint16_t group;
+    uint8_t id;
+
+    /* Length and hash of the request payload. */
+    uint16_t req_len;
+    uint32_t req_hash;
+
+    /* Epoch of the handler when the response was encoded. */
+    uint32_t epoch;
+
+    /* Length of the cached response payload; 0 if the entry is unused. */
+    uint16_t rsp_len;
+};
+
+/**
+ * @brief Recent responses to the idempotent reads of an SMP streamer.
+ *
+ * Only complete, successful responses whose payload is at most rsp_max bytes
+ * are cached.  The payload is stored without its header, which is rebuilt
+ * for each request.  Use SMP_RSP_CACHE_DEFINE() to allocate one.
+ */
+struct smp_rsp_cache {
+    struct smp_rsp_cache_entry *entries;
+
+    /* Payload data; entry_count buffers of rsp_max bytes each. */
+    uint8_t *rsp_bufs;
+
+    uint16_t rsp_max;
+    uint8_t entry_count;
+
+    /* Index of the entry to replace next. */
+    uint8_t next;
+
+    /* Key of the request being processed, if it is to be cached. */
+    struct smp_rsp_cache_entry cur;
+    bool cur_valid;
+};
+
+/**
+ * @brief Defines a static SMP response cache.
+ *
+ * @param name_                 Name of the cache object.
+ * @param count_                Number of responses to keep.
+ * @param rsp_max_              Maximum size of a cached response payload.
+ */
+#define SMP_RSP_CACHE_DEFINE(name_, count_, rsp_max_)                     \
+    static struct smp_rsp_cache_entry name_##_entries[(count_)];          \
+    static uint8_t name_##_bufs[(count_) * (rsp_max_)];                   \
+    static struct smp_rsp_cache name_ = {                                 \
+        .entries = name_##_entries,                                       \
+        .rsp_bufs = name_##_bufs,                                         \
+        .rsp_max = (rsp_max_),                                            \
+        .entry_count = (count_),                                          \
+    }
+
+/* smp_trace_entry flags. */
+#define SMP_TRACE_F_REPLAY      0x01    /* Answered from the replay cache. */
+#define SMP_TRACE_F_DEFERRED    0x02    /* Response sent later. */
+#define SMP_TRACE_F_IN_PLACE    0x04    /* Answered in the request buffer. */
+#define SMP_TRACE_F_COALESCED   0x08    /* Appended to earlier responses. */
+#define SMP_TRACE_F_CACHED      0x10    /* Answered from the response cache. */
+
+/**
+ * @brief One request recorded in an SMP trace ring.
+ *
+ * Times are in ticks of the ring's clock.
+ */
+struct smp_trace_entry {
+    /* Arrival of the request header. */
+    uint32_t timestamp;
+
+    /* Time spent in the command handler. */
+    uint32_t handler_ticks;
+
+    /* Time spent waiting for a response buffer. */
+    uint32_t alloc_ticks;
+
+    uint16_t group;
+    uint16_t req_len;
+    uint16_t rsp_len;
+    uint8_t id;
+    uint8_t seq;
+
+    /* MGMT_ERR_[...] status of the request. */
+    uint8_t rc;
+
+    /* SMP_TRACE_F_[...] */
+    uint8_t flags;
+};
+
+/**
+ * @brief The most recent requests processed by an SMP streamer.
+ *
+ * The streamer is the only writer; it overwrites the oldest entry without
+ * taking a lock.  Readers use smp_trace_get(), which detects entries that
+ * were overwritten while being copied.  Use SMP_TRACE_DEFINE() to allocate
+ * one.
+ */
+struct smp_trace {
+    smp_clock_fn *clock_cb;
+
+    struct smp_trace_entry *entries;
+    uint16_t entry_count;
+
+    /* Number of requests ever recorded; the next is stored at
+     * head % entry_count.
+     */
+    uint32_t head;
+};
+
+/**
+ * @brief Defines a static SMP trace ring.
+ *
+ * @param name_                 Name of the ring object.
+ * @param count_                Number of requests to keep.
+ * @param clock_                The smp_clock_fn to time requests with.
+ */
+#define SMP_TRACE_DEFINE(name_, count_, clock_)                           \
+    static struct smp_trace_entry name_##_entries[(count_)];              \
+    static struct smp_trace name_ = {                                     \
+        .clock_cb = (clock_),                                             \
+        .entries = name_##_entries,                                       \
+        .entry_count = (count_),                                          \
+    }
+
+/**
+ * @brief Timing of the request an SMP streamer is processing, for handlers
+ *        that report it (e.g., a link benchmark).
+ *
+ * All values are in ticks of the streamer's trace clock, and stay zero if
+ * the streamer has no trace.
+ */
+struct smp_timing {
+    /* When the request's header was read. */
+    uint32_t rx_ts;
+
+    /* When the request's handler was called. */
+    uint32_t dispatch_ts;
+
+    /* Duration of the latest tx_rsp_cb call, of this request or an earlier
+     * one.
+     */
+    uint32_t tx_ticks;
+};
+
+/* Largest request payload that gets copied aside so that the request buffer
+ * can hold the response; see smp_streamer.rsp_in_place.
+ */
+#define SMP_IN_PLACE_REQ_MAX    64
+
 /**
  * @brief Decodes, encodes, and transmits SMP packets.
  */
 struct smp_streamer {
     struct mgmt_streamer mgmt_stmr;
     smp_tx_rsp_fn *tx_rsp_cb;
+
+    /* If nonzero, responses to the requests in one packet are packed into
+     * response packets of at most this many bytes.  A response that does
+     * not fit is sent in a packet of its own.  Requires the streamer to
+     * provide a truncate callback; ignored otherwise.
+     */
+    uint16_t coalesce_mtu;
+
+    /* Room that must remain below coalesce_mtu for another response to be
+     * appended to the coalesced ones; 0 for half of coalesce_mtu.  Appended
+     * responses are written after the coalesced ones in the same buffer, so
+     * this should cover the largest response expected; a response that
+     * overflows the buffer fails with MGMT_ERR_ENOMEM after its request has
+     * been executed.
+     */
+    uint16_t coalesce_reserve;
+
+    /* Optional; required if deferred responses are completed from a thread
+     * other than the one processing requests.  Serialize use of the
+     * streamer's reader and writer.
+     */
+    smp_lock_fn *lock_cb;
+    smp_lock_fn *unlock_cb;
+
+    /* Optional; answers retransmitted requests without re-executing them. */
+    struct smp_replay_cache *replay;
+
+    /* Optional; answers repeated idempotent reads without re-executing
+     * them.
+     */
+    struct smp_rsp_cache *rsp_cache;
+
+    /* If true, a packet carrying a single request with a payload of at most
+     * SMP_IN_PLACE_REQ_MAX bytes is answered in the request buffer rather
+     * than in a newly allocated one.  The payload is copied to the stack
+     * before the buffer is reused, so the transport's request buffers must be
+     * as large as its response buffers.
+     */
+    bool rsp_in_place;
+
+    /* Optional; records how long each command takes. */
+    struct smp_lat *lat;
+
+    /* Optional; records the most recent requests. */
+    struct smp_trace *trace;
+
+    /* Optional; if set, only authenticated requests are processed. */
+    struct smp_auth *auth;
+
+    /* If true, a request that elicits an error response does not abort the
+     * rest of its packet: the error response is sent in a packet of its own
+     * and processing continues with the next request.  A request whose
+     * payload runs past the end of the packet still aborts it, as the next
+     * request cannot be located.
+     */
+    bool err_continue;
+
+    /* Maintained by the streamer. */
+    struct smp_timing timing;
+
+    /* Deferred responses not yet completed; maintained by the streamer,
+     * under its lock.  A transport must not hand the streamer to another
+     * client while this is nonzero.
+     */
+    uint16_t async_pending;
 };
 
 /**
@@ -72,9 +441,10 @@ struct smp_streamer {
  *
  * Processes all SMP requests in an incoming packet.  Requests are processed
  * sequentially from the start of the packet to the end.  Each response is sent
- * individually in its own packet.  If a request elicits an error response,
- * processing of the packet is aborted.  This function consumes the supplied
- * request buffer regardless of the outcome.
+ * individually in its own packet, unless the streamer coalesces responses.
+ * If a request elicits an error response, processing of the packet is
+ * aborted, unless the streamer continues past errors.  This function consumes
+ * the supplied request buffer regardless of the outcome.
  *
  * @param streamer              The streamer providing the required SMP
  *                                  callbacks.
@@ -84,6 +454,185 @@ struct smp_streamer {
  */
 int smp_process_request_packet(struct smp_streamer *streamer, void *req);
 
+/**
+ * @brief Retrieves the SMP streamer that is processing the request of a
+ *        management context.
+ *
+ * @param ctxt                  The context passed to a command handler.
+ *
+ * @return                      The streamer; NULL if the request did not
+ *                                  arrive over SMP.
+ */
+struct smp_streamer *smp_ctxt_streamer(const struct mgmt_ctxt *ctxt);
+
+/* Request classes of an SMP scheduler, from most to least urgent. */
+#define SMP_PRIO_HIGH           0
+#define SMP_PRIO_NORMAL         1
+#define SMP_PRIO_COUNT          2
+
+struct smp_sched;
+
+/** @typedef smp_sched_lock_fn
+ * @brief Locks or unlocks an SMP scheduler's queues.
+ *
+ * @param sched                 The scheduler.
+ * @param arg                   Optional scheduler argument.
+ */
+typedef void smp_sched_lock_fn(struct smp_sched *sched, void *arg);
+
+/**
+ * @brief A request packet waiting in an SMP scheduler.
+ */
+struct smp_sched_item {
+    struct smp_streamer *streamer;
+    void *req;
+};
+
+/**
+ * @brief One priority class of an SMP scheduler; a ring of packets.
+ */
+struct smp_sched_queue {
+    struct smp_sched_item *items;
+    uint8_t size;
+    uint8_t head;
+    uint8_t len;
+};
+
+/**
+ * @brief Orders received request packets by the priority of their commands.
+ *
+ * Transports put packets in with smp_sched_put() and a worker takes them out
+ * with smp_sched_run().  Packets of a class are processed in arrival order,
+ * and high-priority packets overtake normal ones that are still queued, so a
+ * heartbeat waits at most for the one request in progress plus the
+ * high-priority requests ahead of it.  To keep bulk transfers moving, a
+ * normal packet is let through after every `burst` consecutive high-priority
+ * ones.  Use SMP_SCHED_DEFINE() to allocate one.
+ *
+ * The scheduler is opt-in, for out-of-tree transports that serve many peers
+ * from one worker.  The in-tree transports (smp_net, smp_l2cap) do not use
+ * it; they process their packets in arrival order.
+ */
+struct smp_sched {
+    struct smp_sched_queue queues[SMP_PRIO_COUNT];
+
+    /* High-priority packets served in a row while normal ones wait; 0 for
+     * no limit.
+     */
+    uint8_t burst;
+
+    /* High-priority packets served since the last normal one. */
+    uint8_t run;
+
+    /* Optional; required if packets are put in from a thread or interrupt
+     * other than the worker's.
+     */
+    smp_sched_lock_fn *lock_cb;
+    smp_sched_lock_fn *unlock_cb;
+    void *lock_arg;
+};
+
+/**
+ * @brief Defines a static SMP scheduler.
+ *
+ * @param name_                 Name of the scheduler object.
+ * @param high_count_           Number of high-priority packets that can be
+ *                                  queued.
+ * @param normal_count_         Number of normal packets that can be queued.
+ * @param burst_                See smp_sched.burst.
+ */
+#define SMP_SCHED_DEFINE(name_, high_count_, normal_count_, burst_)       \
+    static struct smp_sched_item name_##_high[(high_count_)];             \
+    static struct smp_sched_item name_##_normal[(normal_count_)];         \
+    static struct smp_sched name_ = {                                     \
+        .queues = {                                                       \
+            [SMP_PRIO_HIGH] = {                                           \
+                .items = name_##_high,                                    \
+                .size = (high_count_),                                    \
+            },                                                            \
+            [SMP_PRIO_NORMAL] = {                                         \
+                .items = name_##_normal,                                  \
+                .size = (normal_count_),                                  \
+            },                                                            \
+        },                                                                \
+        .burst = (burst_),                                                \
+    }
+
+/**
+ * @brief Determines the priority class of a request packet from the header
+ *        of its first request.
+ *
+ * @param req_hdr               The header, in network byte order, as it
+ *                                  appears at the start of the packet.
+ *
+ * @return                      SMP_PRIO_[...]
+ */
+int smp_req_prio(const struct mgmt_hdr *req_hdr);
+
+/**
+ * @brief Queues a request packet for processing by smp_sched_run().
+ *
+ * @param sched                 The scheduler to queue the packet in.
+ * @param streamer              The streamer to process the packet with.
+ * @param req                   The request packet.
+ * @param prio                  The packet's class; usually from
+ *                                  smp_req_prio().
+ *
+ * @return                      0 on success; MGMT_ERR_ENOMEM if the class's
+ *                                  queue is full, in which case the packet
+ *                                  still belongs to the caller.
+ */
+int smp_sched_put(struct smp_sched *sched, struct smp_streamer *streamer,
+                  void *req, int prio);
+
+/**
+ * @brief Processes the next queued request packet, if any.
+ *
+ * @param sched                 The scheduler to take the packet from.
+ *
+ * @return                      true if a packet was processed; false if the
+ *                                  queues were empty.
+ */
+bool smp_sched_run(struct smp_sched *sched);
+
+/**
+ * @brief Encodes and transmits a response that a handler deferred.
+ *
+ * This is the SMP implementation of mgmt_complete_async(); handlers normally
+ * call that instead.  The response is sent in its own packet, through the
+ * streamer the request arrived on, which must still be valid.  This function
+ * consumes the response buffer held by the deferred response.
+ *
+ * @param async                 The deferred response to complete.
+ * @param status                MGMT_ERR_EOK to send the response written by
+ *                                  encode_cb; otherwise, the status to send
+ *                                  in an error response.
+ * @param encode_cb             Writes the response body, including "rc";
+ *                                  NULL to send only a status of 0.
+ * @param arg                   Optional argument passed to encode_cb.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+int smp_complete_async(struct mgmt_async *async, int status,
+                       mgmt_async_encode_fn *encode_cb, void *arg);
+
+/**
+ * @brief Reads an entry from an SMP trace ring.
+ *
+ * May be called from any thread while the streamer records requests.
+ *
+ * @param trace                 The ring to read.
+ * @param idx                   Position of the entry, counted from the first
+ *                                  request ever recorded.
+ * @param out_entry             On success, the entry gets written here.
+ *
+ * @return                      0 on success; MGMT_ERR_ENOENT if the entry
+ *                                  has not been recorded yet or has been
+ *                                  overwritten.
+ */
+int smp_trace_get(const struct smp_trace *trace, uint32_t idx,
+                  struct smp_trace_entry *out_entry);
+
 #ifdef __cplusplus
 }
 #endif
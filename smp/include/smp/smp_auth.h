@@ -0,0 +1,232 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/**
+ * @file
+ * @brief Authenticated SMP sessions.
+ *
+ * A streamer with an smp_auth only processes requests that carry a tag
+ * computed with the key of the session established with its client.  The
+ * session is set up once with a challenge-response exchange over a key
+ * shared in advance (MGMT_GROUP_ID_AUTH):
+ *
+ *     challenge (read):  {}                        -> {"nonce": Nd}
+ *     open (write):      {"nonce": Nc, "proof": P} -> {"proof": Q}
+ *
+ * where P = MAC(psk, 'C' | Nd | Nc), Q = MAC(psk, 'D' | Nd | Nc), and the
+ * session key is K = MAC(psk, 'K' | Nd | Nc).  Every later request has
+ * SMP_HDR_F_AUTH set in its header flags, and its payload is followed by a
+ * trailer, counted in the header's length:
+ *
+ *     [4 bytes]: Counter, little-endian; greater than that of any request
+ *                accepted before in the session.
+ *     [8 bytes]: The first SMP_AUTH_TAG_LEN bytes of MAC(K, header | payload
+ *                | counter), over the header as sent.
+ *
+ * The tag is checked before the request is dispatched; a request without a
+ * valid tag gets a MGMT_ERR_EACCESSDENIED response.  Responses are not
+ * tagged.  The MAC is supplied by the application, so that hardware AES-CMAC
+ * or the like can be used where the SoC has it.
+ */
+
+#ifndef H_SMP_AUTH_
+#define H_SMP_AUTH_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef CONFIG_MCUMGR_SMP_AUTH_TC
+#include <tinycrypt/aes.h>
+#include <tinycrypt/cmac_mode.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct smp_streamer;
+struct smp_auth;
+struct mgmt_hdr;
+
+/**
+ * Command IDs of the authentication group.
+ */
+#define SMP_AUTH_ID_CHALLENGE   0
+#define SMP_AUTH_ID_OPEN        1
+
+/* Header flag: the request ends with an authentication trailer. */
+#define SMP_HDR_F_AUTH          0x01
+
+#define SMP_AUTH_KEY_LEN        16
+#define SMP_AUTH_NONCE_LEN      16
+
+/* Output size of the MAC; the handshake uses it in full. */
+#define SMP_AUTH_MAC_LEN        16
+
+/* Per-request tag; a truncated MAC. */
+#define SMP_AUTH_TAG_LEN        8
+
+#define SMP_AUTH_TRAILER_LEN    (4 + SMP_AUTH_TAG_LEN)
+
+/** @typedef smp_auth_mac_start_fn
+ * @brief Starts computing a MAC with the specified key.
+ *
+ * @param auth                  The authenticator.
+ * @param key                   A key of SMP_AUTH_KEY_LEN bytes.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int smp_auth_mac_start_fn(struct smp_auth *auth, const uint8_t *key);
+
+/** @typedef smp_auth_mac_update_fn
+ * @brief Feeds data to the MAC being computed.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int smp_auth_mac_update_fn(struct smp_auth *auth, const void *data,
+                                   size_t len);
+
+/** @typedef smp_auth_mac_finish_fn
+ * @brief Completes the MAC being computed.
+ *
+ * @param auth                  The authenticator.
+ * @param out_mac               On success, the SMP_AUTH_MAC_LEN-byte MAC gets
+ *                                  written here.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int smp_auth_mac_finish_fn(struct smp_auth *auth, uint8_t *out_mac);
+
+/** @typedef smp_auth_rand_fn
+ * @brief Fills a buffer with random bytes suitable for a nonce.
+ *
+ * @return                      0 on success, MGMT_ERR_[...] code on failure.
+ */
+typedef int smp_auth_rand_fn(struct smp_auth *auth, void *dst, size_t len);
+
+/**
+ * @brief Authenticates the requests of an SMP streamer's client.
+ *
+ * The callbacks and the key are filled in by the application; the rest is
+ * session state that must be zero-initialized.  A session stays open until
+ * the client completes a new handshake or the transport calls
+ * smp_auth_reset(), e.g., when the connection drops.  A challenge alone does
+ * not close it.
+ */
+struct smp_auth {
+    smp_auth_mac_start_fn *mac_start_cb;
+    smp_auth_mac_update_fn *mac_update_cb;
+    smp_auth_mac_finish_fn *mac_finish_cb;
+    smp_auth_rand_fn *rand_cb;
+
+    /* Optional; for use by the callbacks. */
+    void *arg;
+
+    /* Key of SMP_AUTH_KEY_LEN bytes shared with the authorized clients. */
+    const uint8_t *psk;
+
+    /* Nonce of the outstanding challenge; kept apart from the open
+     * session, which it replaces only once the client proves the key.
+     */
+    uint8_t nonce[SMP_AUTH_NONCE_LEN];
+
+    /* Key of the open session. */
+    uint8_t key[SMP_AUTH_KEY_LEN];
+
+    /* Counter of the last request accepted in the session. */
+    uint32_t rx_ctr;
+
+    bool challenged;
+    bool open;
+};
+
+/**
+ * @brief Closes the authenticator's session, if any.
+ *
+ * @param auth                  The authenticator to reset.
+ */
+void smp_auth_reset(struct smp_auth *auth);
+
+/**
+ * @brief Checks the authentication trailer of the request at the front of a
+ *        streamer's reader and strips it from the request's length.
+ *
+ * Called by the SMP core before a request is dispatched.  Requests on a
+ * streamer without an authenticator pass unchanged, as do the handshake
+ * requests.
+ *
+ * A request with a valid tag but a counter that was accepted before is
+ * reported as a retransmit.  The core answers it only if the streamer's
+ * replay cache still holds its response, and denies it otherwise; it is
+ * never dispatched again.
+ *
+ * @param streamer              The streamer the request arrived on.
+ * @param req_hdr               The request header (host-byte order).  On
+ *                                  success, nh_len no longer counts the
+ *                                  trailer.
+ * @param out_retransmit        On success, set to whether the request's
+ *                                  counter was accepted before.
+ *
+ * @return                      0 on success;
+ *                              MGMT_ERR_EACCESSDENIED if the request is not
+ *                                  authentic;
+ *                              MGMT_ERR_EINVAL if the request carries a
+ *                                  trailer the streamer does not expect;
+ *                              Other MGMT_ERR_[...] code on failure.
+ */
+int smp_auth_check_req(struct smp_streamer *streamer,
+                       struct mgmt_hdr *req_hdr, bool *out_retransmit);
+
+/**
+ * @brief Registers the authentication command handler group.
+ */
+void smp_auth_register_group(void);
+
+#ifdef CONFIG_MCUMGR_SMP_AUTH_TC
+/**
+ * @brief TinyCrypt AES-CMAC state of one authenticator.
+ */
+struct smp_auth_tc {
+    struct tc_aes_key_sched_struct sched;
+    struct tc_cmac_struct cmac;
+};
+
+/**
+ * @brief Sets up an authenticator to compute AES-CMAC with TinyCrypt.
+ *
+ * Each authenticator needs a state of its own, as streamers on different
+ * threads may compute MACs at the same time.  The state is kept in
+ * auth->arg.
+ *
+ * @param auth                  The authenticator to set up.
+ * @param tc                    The authenticator's CMAC state.
+ * @param psk                   The shared key.
+ * @param rand_cb               The nonce source.
+ */
+void smp_auth_tc_init(struct smp_auth *auth, struct smp_auth_tc *tc,
+                      const uint8_t *psk, smp_auth_rand_fn *rand_cb);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,54 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef H_SMP_BT_PERF_
+#define H_SMP_BT_PERF_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Connection policy of the Bluetooth SMP transport for bulk transfers.
+ *
+ * While an image upload or a long file transfer is running, every LE
+ * connection is asked for a short connection interval, the 2M PHY and the
+ * largest data length.  Once no bulk request has arrived for
+ * SMP_BT_PERF_IDLE_MS, the connections are asked to go back to low-power
+ * parameters.  The peer may reject any of the requests.
+ */
+
+/**
+ * @brief Starts applying the policy; call once at startup.
+ */
+void smp_bt_perf_init(void);
+
+/**
+ * @brief Reports bulk traffic that the policy does not recognize by itself,
+ *        e.g., of an application-defined command group.  Switches to the
+ *        fast parameters and restarts the idle timeout.
+ */
+void smp_bt_perf_bulk(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef H_SMP_BT_PERF_CONFIG_
+#define H_SMP_BT_PERF_CONFIG_
+
+/* Time without bulk requests after which the low-power parameters are
+ * restored, in milliseconds.
+ */
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF_IDLE_MS
+#define SMP_BT_PERF_IDLE_MS         CONFIG_MCUMGR_SMP_BT_PERF_IDLE_MS
+#else
+#define SMP_BT_PERF_IDLE_MS         2000
+#endif
+
+/* Number of file requests after which an fs transfer counts as bulk. */
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF_FS_REQS
+#define SMP_BT_PERF_FS_REQS         CONFIG_MCUMGR_SMP_BT_PERF_FS_REQS
+#else
+#define SMP_BT_PERF_FS_REQS         8
+#endif
+
+/* Connection interval during bulk transfers, in units of 1.25 ms. */
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF_FAST_INT_MIN
+#define SMP_BT_PERF_FAST_INT_MIN    CONFIG_MCUMGR_SMP_BT_PERF_FAST_INT_MIN
+#else
+#define SMP_BT_PERF_FAST_INT_MIN    6
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF_FAST_INT_MAX
+#define SMP_BT_PERF_FAST_INT_MAX    CONFIG_MCUMGR_SMP_BT_PERF_FAST_INT_MAX
+#else
+#define SMP_BT_PERF_FAST_INT_MAX    12
+#endif
+
+/* Connection interval and peripheral latency while idle. */
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF_SLOW_INT_MIN
+#define SMP_BT_PERF_SLOW_INT_MIN    CONFIG_MCUMGR_SMP_BT_PERF_SLOW_INT_MIN
+#else
+#define SMP_BT_PERF_SLOW_INT_MIN    24
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF_SLOW_INT_MAX
+#define SMP_BT_PERF_SLOW_INT_MAX    CONFIG_MCUMGR_SMP_BT_PERF_SLOW_INT_MAX
+#else
+#define SMP_BT_PERF_SLOW_INT_MAX    40
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF_SLOW_LATENCY
+#define SMP_BT_PERF_SLOW_LATENCY    CONFIG_MCUMGR_SMP_BT_PERF_SLOW_LATENCY
+#else
+#define SMP_BT_PERF_SLOW_LATENCY    0
+#endif
+
+/* Supervision timeout in both modes, in units of 10 ms. */
+#ifdef CONFIG_MCUMGR_SMP_BT_PERF_TIMEOUT
+#define SMP_BT_PERF_TIMEOUT         CONFIG_MCUMGR_SMP_BT_PERF_TIMEOUT
+#else
+#define SMP_BT_PERF_TIMEOUT         400
+#endif
+
+#if SMP_BT_PERF_FAST_INT_MIN > SMP_BT_PERF_FAST_INT_MAX || \
+    SMP_BT_PERF_SLOW_INT_MIN > SMP_BT_PERF_SLOW_INT_MAX
+#error "SMP_BT_PERF connection interval minimum exceeds its maximum"
+#endif
+
+#endif
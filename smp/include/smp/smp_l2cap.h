@@ -0,0 +1,61 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef H_SMP_L2CAP_
+#define H_SMP_L2CAP_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief SMP transport over a Bluetooth LE connection-oriented channel.
+ *
+ * Each SDU carries one SMP packet, of at most SMP_L2CAP_MTU bytes; see
+ * transport/smp-bluetooth.md.  The stack segments SDUs into PDUs and paces
+ * them with LE credit-based flow control, so a response of any size goes out
+ * as one SDU and a request is received without a reassembly buffer: mgmt
+ * decodes it from the chain of PDU buffers in place.
+ *
+ * Each of the SMP_L2CAP_CHAN_COUNT channels gets a streamer and a session of
+ * its own.  The receive pool is reported to clients as the number of
+ * requests they may keep in flight, so that uploads and downloads can be
+ * windowed rather than waiting out a round trip per chunk.
+ *
+ * Requests are processed on a work queue of their own
+ * (SMP_L2CAP_WORKQ_STACK_SIZE, SMP_L2CAP_WORKQ_PRIO), so that handlers can
+ * wait for work done on the system work queue.
+ */
+
+/**
+ * @brief Registers the L2CAP server on SMP_L2CAP_PSM.  Call once at startup.
+ *
+ * @return                      0 on success; MGMT_ERR_EBADSTATE if the
+ *                                  server is registered already;
+ *                                  MGMT_ERR_EUNKNOWN if the stack rejected
+ *                                  it.
+ */
+int smp_l2cap_register(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef H_SMP_L2CAP_CONFIG_
+#define H_SMP_L2CAP_CONFIG_
+
+/* LE protocol/service multiplexer the SMP server listens on; a dynamic PSM,
+ * i.e., 0x0080 to 0x00ff.
+ */
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_PSM
+#define SMP_L2CAP_PSM               CONFIG_MCUMGR_SMP_L2CAP_PSM
+#else
+#define SMP_L2CAP_PSM               0x00a5
+#endif
+
+/* Security level, 1 to 4, a connection needs before the channel is
+ * accepted.
+ */
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_SEC_LEVEL
+#define SMP_L2CAP_SEC_LEVEL         CONFIG_MCUMGR_SMP_L2CAP_SEC_LEVEL
+#else
+#define SMP_L2CAP_SEC_LEVEL         1
+#endif
+
+/* Largest request or response SDU, including the SMP header.  The stack
+ * segments SDUs into PDUs of the negotiated MPS.
+ */
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_MTU
+#define SMP_L2CAP_MTU               CONFIG_MCUMGR_SMP_L2CAP_MTU
+#else
+#define SMP_L2CAP_MTU               2048
+#endif
+
+/* Number of channels served at once, each with its own session. */
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_CHAN_COUNT
+#define SMP_L2CAP_CHAN_COUNT        CONFIG_MCUMGR_SMP_L2CAP_CHAN_COUNT
+#else
+#define SMP_L2CAP_CHAN_COUNT        1
+#endif
+
+/* Receive buffers, shared by all channels.  A request takes as many buffers
+ * as it has PDUs; a pool that holds several full-size requests lets clients
+ * keep a window of requests in flight.
+ */
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_RX_BUF_COUNT
+#define SMP_L2CAP_RX_BUF_COUNT      CONFIG_MCUMGR_SMP_L2CAP_RX_BUF_COUNT
+#else
+#define SMP_L2CAP_RX_BUF_COUNT      32
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_RX_BUF_SIZE
+#define SMP_L2CAP_RX_BUF_SIZE       CONFIG_MCUMGR_SMP_L2CAP_RX_BUF_SIZE
+#else
+#define SMP_L2CAP_RX_BUF_SIZE       256
+#endif
+
+/* Response buffers, shared by all channels; each takes SMP_L2CAP_MTU bytes
+ * plus headroom.
+ */
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_TX_BUF_COUNT
+#define SMP_L2CAP_TX_BUF_COUNT      CONFIG_MCUMGR_SMP_L2CAP_TX_BUF_COUNT
+#else
+#define SMP_L2CAP_TX_BUF_COUNT      2
+#endif
+
+/* How long to wait for a response buffer while the peer holds the channel's
+ * credits back.
+ */
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_TX_TIMEOUT_MS
+#define SMP_L2CAP_TX_TIMEOUT_MS     CONFIG_MCUMGR_SMP_L2CAP_TX_TIMEOUT_MS
+#else
+#define SMP_L2CAP_TX_TIMEOUT_MS     1000
+#endif
+
+/* Stack size and priority of the work queue that processes requests.  The
+ * command handlers run on its stack.
+ */
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_WORKQ_STACK_SIZE
+#define SMP_L2CAP_WORKQ_STACK_SIZE  CONFIG_MCUMGR_SMP_L2CAP_WORKQ_STACK_SIZE
+#else
+#define SMP_L2CAP_WORKQ_STACK_SIZE  2048
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_L2CAP_WORKQ_PRIO
+#define SMP_L2CAP_WORKQ_PRIO        CONFIG_MCUMGR_SMP_L2CAP_WORKQ_PRIO
+#else
+#define SMP_L2CAP_WORKQ_PRIO        CONFIG_SYSTEM_WORKQUEUE_PRIORITY
+#endif
+
+#if SMP_L2CAP_PSM < 0x0080 || SMP_L2CAP_PSM > 0x00ff
+#error "SMP_L2CAP_PSM must be a dynamic LE PSM"
+#endif
+
+#if SMP_L2CAP_MTU < 64 || SMP_L2CAP_MTU > 65535
+#error "SMP_L2CAP_MTU must be between 64 and 65535"
+#endif
+
+/* A partial SDU waits in the receive thread for buffers that only a complete
+ * one can release.
+ */
+#if SMP_L2CAP_RX_BUF_COUNT * SMP_L2CAP_RX_BUF_SIZE < SMP_L2CAP_MTU
+#error "SMP_L2CAP receive buffers must hold at least one full-size request"
+#endif
+
+#endif
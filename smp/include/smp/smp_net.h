@@ -0,0 +1,68 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef H_SMP_NET_
+#define H_SMP_NET_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief SMP transport over UDP.
+ *
+ * Each datagram carries one SMP packet, of at most SMP_NET_MTU bytes; see
+ * transport/smp-udp.md.  Responses go back to the address and port the
+ * request came from.
+ *
+ * Clients are told apart by their address and port.  Each of the
+ * SMP_NET_CLIENT_COUNT most recently active clients gets a streamer and a
+ * session of its own, so that, e.g., one client's file upload is not disturbed
+ * by another's requests.  When a new client arrives and every entry is taken,
+ * the least recently active client without deferred responses outstanding
+ * is forgotten, along with its session; if there is none, the datagram is
+ * dropped.
+ *
+ * With SMP_NET_MCAST_PORT set, the device also joins SMP_NET_MCAST_ADDR and
+ * processes the requests sent to the group on that port, without responding
+ * to them.
+ *
+ * Datagrams are received on a thread of their own and processed on a work
+ * queue of their own (SMP_NET_WORKQ_STACK_SIZE, SMP_NET_WORKQ_PRIO), so that
+ * handlers can wait for work done on the system work queue.
+ */
+
+/**
+ * @brief Starts listening for requests on SMP_NET_PORT, over each IP version
+ *        the network stack is built with, and for multicast requests if
+ *        enabled.  Call once the network interface is up.
+ *
+ * @return                      0 on success; MGMT_ERR_EBADSTATE if the
+ *                                  transport is open already;
+ *                                  MGMT_ERR_EUNKNOWN if a socket could not
+ *                                  be opened.
+ */
+int smp_net_open(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef H_SMP_NET_CONFIG_
+#define H_SMP_NET_CONFIG_
+
+/* UDP port to listen for requests on. */
+#ifdef CONFIG_MCUMGR_SMP_NET_PORT
+#define SMP_NET_PORT                CONFIG_MCUMGR_SMP_NET_PORT
+#else
+#define SMP_NET_PORT                1337
+#endif
+
+/* Largest request or response packet, including the SMP header.  Packets
+ * that exceed the link MTU rely on IP fragmentation.
+ */
+#ifdef CONFIG_MCUMGR_SMP_NET_MTU
+#define SMP_NET_MTU                 CONFIG_MCUMGR_SMP_NET_MTU
+#else
+#define SMP_NET_MTU                 2048
+#endif
+
+/* Number of packet buffers, shared by all clients; each takes SMP_NET_MTU
+ * bytes.
+ */
+#ifdef CONFIG_MCUMGR_SMP_NET_BUF_COUNT
+#define SMP_NET_BUF_COUNT           CONFIG_MCUMGR_SMP_NET_BUF_COUNT
+#else
+#define SMP_NET_BUF_COUNT           4
+#endif
+
+/* Number of packet buffers held back for responses.  Received datagrams
+ * never take these, so a burst of requests cannot leave the work queue unable
+ * to answer them.
+ */
+#ifdef CONFIG_MCUMGR_SMP_NET_RSP_BUF_RESERVE
+#define SMP_NET_RSP_BUF_RESERVE     CONFIG_MCUMGR_SMP_NET_RSP_BUF_RESERVE
+#else
+#define SMP_NET_RSP_BUF_RESERVE     1
+#endif
+
+/* Number of clients served with their own session. */
+#ifdef CONFIG_MCUMGR_SMP_NET_CLIENT_COUNT
+#define SMP_NET_CLIENT_COUNT        CONFIG_MCUMGR_SMP_NET_CLIENT_COUNT
+#else
+#define SMP_NET_CLIENT_COUNT        4
+#endif
+
+/* Stack size and priority of the receive thread. */
+#ifdef CONFIG_MCUMGR_SMP_NET_STACK_SIZE
+#define SMP_NET_STACK_SIZE          CONFIG_MCUMGR_SMP_NET_STACK_SIZE
+#else
+#define SMP_NET_STACK_SIZE          1024
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_NET_THREAD_PRIO
+#define SMP_NET_THREAD_PRIO         CONFIG_MCUMGR_SMP_NET_THREAD_PRIO
+#else
+#define SMP_NET_THREAD_PRIO         8
+#endif
+
+/* Stack size and priority of the work queue that processes requests.  The
+ * command handlers run on its stack.
+ */
+#ifdef CONFIG_MCUMGR_SMP_NET_WORKQ_STACK_SIZE
+#define SMP_NET_WORKQ_STACK_SIZE    CONFIG_MCUMGR_SMP_NET_WORKQ_STACK_SIZE
+#else
+#define SMP_NET_WORKQ_STACK_SIZE    2048
+#endif
+
+#ifdef CONFIG_MCUMGR_SMP_NET_WORKQ_PRIO
+#define SMP_NET_WORKQ_PRIO          CONFIG_MCUMGR_SMP_NET_WORKQ_PRIO
+#else
+#define SMP_NET_WORKQ_PRIO          CONFIG_SYSTEM_WORKQUEUE_PRIORITY
+#endif
+
+/* UDP port to listen for multicast requests on; 0 disables multicast.
+ * Requests that arrive on this port are processed but never answered, so that
+ * a client can address many devices at once.
+ */
+#ifdef CONFIG_MCUMGR_SMP_NET_MCAST_PORT
+#define SMP_NET_MCAST_PORT          CONFIG_MCUMGR_SMP_NET_MCAST_PORT
+#else
+#define SMP_NET_MCAST_PORT          0
+#endif
+
+/* Multicast group to join, IPv6 or IPv4. */
+#ifdef CONFIG_MCUMGR_SMP_NET_MCAST_ADDR
+#define SMP_NET_MCAST_ADDR          CONFIG_MCUMGR_SMP_NET_MCAST_ADDR
+#else
+#define SMP_NET_MCAST_ADDR          "ff05::1337"
+#endif
+
+#define SMP_NET_MCAST               (SMP_NET_MCAST_PORT > 0)
+
+#if SMP_NET_MCAST && SMP_NET_MCAST_PORT == SMP_NET_PORT
+#error "SMP_NET_MCAST_PORT must differ from SMP_NET_PORT"
+#endif
+
+#if SMP_NET_MTU < 64 || SMP_NET_MTU > 65535
+#error "SMP_NET_MTU must be between 64 and 65535"
+#endif
+
+#if SMP_NET_BUF_COUNT < 2
+#error "SMP_NET needs a buffer for a request and one for its response"
+#endif
+
+#if SMP_NET_RSP_BUF_RESERVE < 1 || SMP_NET_RSP_BUF_RESERVE >= SMP_NET_BUF_COUNT
+#error "SMP_NET_RSP_BUF_RESERVE must be between 1 and SMP_NET_BUF_COUNT - 1"
+#endif
+
+#endif
@@ -23,9 +23,29 @@
 #include <string.h>
 
 #include "tinycbor/cbor.h"
+#include "tinycbor/cbor_buf_reader.h"
 #include "mgmt/endian.h"
 #include "mgmt/mgmt.h"
 #include "smp/smp.h"
+#include "smp/smp_auth.h"
+
+/** State required to split a single response across several packets. */
+struct smp_rsp_state {
+    struct smp_streamer *streamer;
+    const struct mgmt_hdr *req_hdr;
+    void *req;
+
+    /* Points to the caller's response buffer pointer; replaced on flush. */
+    void **rsp;
+
+    /* Offset of this response within the response buffer; nonzero if it
+     * follows coalesced responses to earlier requests.
+     */
+    size_t base;
+
+    /* Root map of the response payload currently being encoded. */
+    struct CborEncoder payload_encoder;
+};
 
 static int
 smp_align4(int x)
@@ -40,26 +60,13 @@ smp_align4(int x)
     }
 }
 
-/**
- * Converts a request opcode to its corresponding response opcode.
- */
-static uint8_t
-smp_rsp_op(uint8_t req_op)
-{
-    if (req_op == MGMT_OP_READ) {
-        return MGMT_OP_READ_RSP;
-    } else {
-        return MGMT_OP_WRITE_RSP;
-    }
-}
-
 static void
 smp_init_rsp_hdr(const struct mgmt_hdr *req_hdr, struct mgmt_hdr *rsp_hdr)
 {
     *rsp_hdr = (struct mgmt_hdr) {
         .nh_len = 0,
         .nh_flags = 0,
-        .nh_op = smp_rsp_op(req_hdr->nh_op),
+        .nh_op = mgmt_rsp_op(req_hdr->nh_op),
         .nh_group = req_hdr->nh_group,
         .nh_seq = req_hdr->nh_seq,
         .nh_id = req_hdr->nh_id,
@@ -82,37 +89,413 @@ smp_read_hdr(struct smp_streamer *streamer, struct mgmt_hdr *dst_hdr)
 }
 
 static int
-smp_write_hdr(struct smp_streamer *streamer, const struct mgmt_hdr *src_hdr)
+smp_write_hdr(struct smp_streamer *streamer, size_t offset,
+              const struct mgmt_hdr *src_hdr)
 {
     int rc;
 
-    rc = mgmt_streamer_write_at(&streamer->mgmt_stmr, 0, src_hdr,
+    rc = mgmt_streamer_write_at(&streamer->mgmt_stmr, offset, src_hdr,
                                 sizeof *src_hdr);
     return mgmt_err_from_cbor(rc);
 }
 
+static void
+smp_lock(struct smp_streamer *streamer)
+{
+    if (streamer->lock_cb != NULL) {
+        streamer->lock_cb(streamer, streamer->mgmt_stmr.cb_arg);
+    }
+}
+
+static void
+smp_unlock(struct smp_streamer *streamer)
+{
+    if (streamer->unlock_cb != NULL) {
+        streamer->unlock_cb(streamer, streamer->mgmt_stmr.cb_arg);
+    }
+}
+
+static size_t
+smp_rsp_len(const struct smp_streamer *streamer)
+{
+    return streamer->mgmt_stmr.writer->bytes_written;
+}
+
+/**
+ * Indicates whether responses to the requests in a packet get packed into
+ * one response packet.
+ */
+static bool
+smp_coalescing(const struct smp_streamer *streamer)
+{
+    return streamer->coalesce_mtu != 0 &&
+           streamer->mgmt_stmr.cfg->truncate != NULL;
+}
+
+/**
+ * Pads the response buffer so that the next response starts at a multiple of
+ * 4, as is required of requests.
+ */
+static int
+smp_pad_rsp(struct smp_streamer *streamer)
+{
+    static const uint8_t zeros[3];
+    struct cbor_encoder_writer *writer;
+    int pad;
+
+    writer = streamer->mgmt_stmr.writer;
+    pad = smp_align4(writer->bytes_written) - writer->bytes_written;
+    if (pad == 0) {
+        return 0;
+    }
+
+    return mgmt_err_from_cbor(writer->write(writer, (const char *)zeros, pad));
+}
+
+/**
+ * Computes a 32-bit FNV-1a hash of a region of the request buffer.
+ */
+static uint32_t
+smp_replay_hash(struct cbor_decoder_reader *reader, size_t off, size_t len)
+{
+    uint8_t chunk[32];
+    uint32_t hash;
+    size_t chunk_len;
+    size_t i;
+
+    hash = 2166136261u;
+    while (len > 0) {
+        chunk_len = len < sizeof chunk ? len : sizeof chunk;
+        reader->cpy(reader, (char *)chunk, off, chunk_len);
+        for (i = 0; i < chunk_len; i++) {
+            hash = (hash ^ chunk[i]) * 16777619u;
+        }
+
+        off += chunk_len;
+        len -= chunk_len;
+    }
+
+    return hash;
+}
+
+static bool
+smp_replay_match(const struct smp_replay_entry *a,
+                 const struct smp_replay_entry *b)
+{
+    return a->req_hdr.nh_op == b->req_hdr.nh_op &&
+           a->req_hdr.nh_group == b->req_hdr.nh_group &&
+           a->req_hdr.nh_id == b->req_hdr.nh_id &&
+           a->req_hdr.nh_seq == b->req_hdr.nh_seq &&
+           a->req_hdr.nh_len == b->req_hdr.nh_len &&
+           a->req_hash == b->req_hash;
+}
+
+/**
+ * Looks up the request at the front of the reader in the streamer's replay
+ * cache.  On a miss, the request's key is remembered so that its response
+ * can be cached by smp_replay_save().
+ *
+ * @return                      The index of the cached response on a hit;
+ *                              -1 on a miss.
+ */
+static int
+smp_replay_lookup(struct smp_streamer *streamer,
+                  const struct mgmt_hdr *req_hdr)
+{
+    struct cbor_decoder_reader *reader;
+    struct smp_replay_cache *cache;
+    int i;
+
+    cache = streamer->replay;
+    if (cache == NULL) {
+        return -1;
+    }
+    cache->cur_valid = false;
+
+    reader = streamer->mgmt_stmr.reader;
+    if (reader->message_size < MGMT_HDR_SIZE + req_hdr->nh_len) {
+        return -1;
+    }
+
+    cache->cur.req_hdr = *req_hdr;
+    cache->cur.req_hash = smp_replay_hash(reader, MGMT_HDR_SIZE,
+                                          req_hdr->nh_len);
+
+    for (i = 0; i < cache->entry_count; i++) {
+        if (cache->entries[i].rsp_len != 0 &&
+            smp_replay_match(&cache->entries[i], &cache->cur)) {
+
+            return i;
+        }
+    }
+
+    cache->cur_valid = true;
+    return -1;
+}
+
+/**
+ * Appends a cached response to the response buffer.
+ */
+static int
+smp_replay_write(struct smp_streamer *streamer, int idx)
+{
+    struct cbor_encoder_writer *writer;
+    struct smp_replay_cache *cache;
+    int rc;
+
+    cache = streamer->replay;
+    writer = streamer->mgmt_stmr.writer;
+
+    rc = writer->write(writer,
+                       (const char *)cache->rsp_bufs + idx * cache->rsp_max,
+                       cache->entries[idx].rsp_len);
+    return mgmt_err_from_cbor(rc);
+}
+
+/**
+ * Copies the response just written at the specified offset of the response
+ * buffer into the replay cache, replacing the oldest entry.  Does nothing if
+ * the request is not to be cached.  This reinitializes the streamer's reader.
+ */
+static void
+smp_replay_save(struct smp_streamer *streamer, void *rsp, size_t base)
+{
+    struct cbor_decoder_reader *reader;
+    struct smp_replay_cache *cache;
+    struct smp_replay_entry *entry;
+    size_t len;
+
+    cache = streamer->replay;
+    if (cache == NULL || !cache->cur_valid) {
+        return;
+    }
+    cache->cur_valid = false;
+
+    len = smp_rsp_len(streamer) - base;
+    if (len == 0 || len > cache->rsp_max) {
+        return;
+    }
+
+    if (mgmt_streamer_init_reader(&streamer->mgmt_stmr, rsp) != 0) {
+        return;
+    }
+    reader = streamer->mgmt_stmr.reader;
+
+    entry = &cache->entries[cache->next];
+    reader->cpy(reader,
+                (char *)cache->rsp_bufs + cache->next * cache->rsp_max,
+                base, len);
+    *entry = cache->cur;
+    entry->rsp_len = len;
+
+    cache->next = (cache->next + 1) % cache->entry_count;
+}
+
+static bool
+smp_rsp_cache_match(const struct smp_rsp_cache_entry *a,
+                    const struct smp_rsp_cache_entry *b)
+{
+    return a->group == b->group &&
+           a->id == b->id &&
+           a->req_len == b->req_len &&
+           a->req_hash == b->req_hash;
+}
+
+/**
+ * Looks up the read request at the front of the reader in the streamer's
+ * response cache.  A response cached in an earlier epoch of the handler is
+ * dropped.  On a miss, the request's key is remembered so that its response
+ * can be cached by smp_rsp_cache_save().
+ *
+ * @return                      The index of the cached response on a hit;
+ *                              -1 on a miss or if the read is not cacheable.
+ */
+static int
+smp_rsp_cache_lookup(struct smp_streamer *streamer,
+                     const struct mgmt_hdr *req_hdr)
+{
+    const struct mgmt_handler *handler;
+    struct smp_rsp_cache *cache;
+    int i;
+
+    cache = streamer->rsp_cache;
+    if (cache == NULL) {
+        return -1;
+    }
+    cache->cur_valid = false;
+
+    if (req_hdr->nh_op != MGMT_OP_READ) {
+        return -1;
+    }
+
+    handler = mgmt_find_handler(req_hdr->nh_group, req_hdr->nh_id);
+    if (handler == NULL || handler->mh_read_epoch == NULL) {
+        return -1;
+    }
+
+    cache->cur = (struct smp_rsp_cache_entry) {
+        .group = req_hdr->nh_group,
+        .id = req_hdr->nh_id,
+        .req_len = req_hdr->nh_len,
+        .req_hash = smp_replay_hash(streamer->mgmt_stmr.reader,
+                                    MGMT_HDR_SIZE, req_hdr->nh_len),
+        .epoch = *handler->mh_read_epoch,
+    };
+
+    for (i = 0; i < cache->entry_count; i++) {
+        if (cache->entries[i].rsp_len != 0 &&
+            smp_rsp_cache_match(&cache->entries[i], &cache->cur)) {
+
+            if (cache->entries[i].epoch == cache->cur.epoch) {
+                return i;
+            }
+
+            /* Stale; the response gets cached anew. */
+            cache->entries[i].rsp_len = 0;
+            break;
+        }
+    }
+
+    cache->cur_valid = true;
+    return -1;
+}
+
+/**
+ * Appends a response built from a cached payload to the response buffer.
+ */
+static int
+smp_rsp_cache_write(struct smp_streamer *streamer,
+                    const struct mgmt_hdr *req_hdr, int idx)
+{
+    struct cbor_encoder_writer *writer;
+    struct smp_rsp_cache *cache;
+    struct mgmt_hdr rsp_hdr;
+    int rc;
+
+    cache = streamer->rsp_cache;
+    writer = streamer->mgmt_stmr.writer;
+
+    smp_init_rsp_hdr(req_hdr, &rsp_hdr);
+    rsp_hdr.nh_len = cache->entries[idx].rsp_len;
+    mgmt_hton_hdr(&rsp_hdr);
+
+    rc = writer->write(writer, (const char *)&rsp_hdr, sizeof rsp_hdr);
+    if (rc == 0) {
+        rc = writer->write(writer,
+                           (const char *)cache->rsp_bufs +
+                           idx * cache->rsp_max,
+                           cache->entries[idx].rsp_len);
+    }
+    return mgmt_err_from_cbor(rc);
+}
+
+/**
+ * Copies the payload of the response just written at the specified offset of
+ * the response buffer into the response cache, replacing the oldest entry.
+ * Does nothing if the request is not to be cached.  This reinitializes the
+ * streamer's reader.
+ */
+static void
+smp_rsp_cache_save(struct smp_streamer *streamer, void *rsp, size_t base)
+{
+    struct cbor_decoder_reader *reader;
+    struct smp_rsp_cache *cache;
+    struct smp_rsp_cache_entry *entry;
+    size_t len;
+
+    cache = streamer->rsp_cache;
+    if (cache == NULL || !cache->cur_valid) {
+        return;
+    }
+    cache->cur_valid = false;
+
+    len = smp_rsp_len(streamer) - base - MGMT_HDR_SIZE;
+    if (len == 0 || len > cache->rsp_max) {
+        return;
+    }
+
+    if (mgmt_streamer_init_reader(&streamer->mgmt_stmr, rsp) != 0) {
+        return;
+    }
+    reader = streamer->mgmt_stmr.reader;
+
+    entry = &cache->entries[cache->next];
+    reader->cpy(reader,
+                (char *)cache->rsp_bufs + cache->next * cache->rsp_max,
+                base + MGMT_HDR_SIZE, len);
+    *entry = cache->cur;
+    entry->rsp_len = len;
+
+    cache->next = (cache->next + 1) % cache->entry_count;
+}
+
+/**
+ * Writes the final response header, including the payload length, to the
+ * start of the response buffer.
+ */
+static int
+smp_finish_rsp_hdr(struct smp_streamer *streamer,
+                   const struct mgmt_hdr *req_hdr, struct CborEncoder *enc,
+                   size_t base)
+{
+    struct mgmt_hdr rsp_hdr;
+
+    smp_init_rsp_hdr(req_hdr, &rsp_hdr);
+    rsp_hdr.nh_len = cbor_encode_bytes_written(enc) - base - MGMT_HDR_SIZE;
+    mgmt_hton_hdr(&rsp_hdr);
+    return smp_write_hdr(streamer, base, &rsp_hdr);
+}
+
+/**
+ * Payload of an error response, {"rc": status}, for a status that fits in the
+ * initial byte of a CBOR integer; the status goes in the last byte.
+ */
+static const uint8_t smp_err_rsp_tmpl[] = { 0xa1, 0x62, 'r', 'c', 0x00 };
+
+/**
+ * Writes a response that consists of the status alone.  The common statuses
+ * are written from a pre-encoded template, without running the encoder.
+ */
 static int
 smp_build_err_rsp(struct smp_streamer *streamer,
                   const struct mgmt_hdr *req_hdr,
                   int status)
 {
+    uint8_t payload[sizeof smp_err_rsp_tmpl];
     struct CborEncoder map;
     struct mgmt_ctxt cbuf;
     struct mgmt_hdr rsp_hdr;
     int rc;
 
+    if (status >= 0 && status < 24) {
+        smp_init_rsp_hdr(req_hdr, &rsp_hdr);
+        rsp_hdr.nh_len = sizeof payload;
+        mgmt_hton_hdr(&rsp_hdr);
+        rc = smp_write_hdr(streamer, 0, &rsp_hdr);
+        if (rc != 0) {
+            return rc;
+        }
+
+        memcpy(payload, smp_err_rsp_tmpl, sizeof payload);
+        payload[sizeof payload - 1] = status;
+        rc = mgmt_streamer_write_at(&streamer->mgmt_stmr, MGMT_HDR_SIZE,
+                                    payload, sizeof payload);
+        return mgmt_err_from_cbor(rc);
+    }
+
     rc = mgmt_ctxt_init(&cbuf, &streamer->mgmt_stmr);
     if (rc != 0) {
         return rc;
     }
 
     smp_init_rsp_hdr(req_hdr, &rsp_hdr);
-    rc = smp_write_hdr(streamer, &rsp_hdr);
+    rc = smp_write_hdr(streamer, 0, &rsp_hdr);
     if (rc != 0) {
         return rc;
     }
 
-    rc = cbor_encoder_create_map(&cbuf.encoder, &map, CborIndefiniteLength);
+    /* The map holds nothing but the status. */
+    rc = cbor_encoder_create_map(&cbuf.encoder, &map, 1);
     if (rc != 0) {
         return rc;
     }
@@ -127,144 +510,364 @@ smp_build_err_rsp(struct smp_streamer *streamer,
         return rc;
     }
 
-    rsp_hdr.nh_len = cbor_encode_bytes_written(&cbuf.encoder) - MGMT_HDR_SIZE;
-    mgmt_hton_hdr(&rsp_hdr);
-    rc = smp_write_hdr(streamer, &rsp_hdr);
-    if (rc != 0) {
-        return rc;
+    return smp_finish_rsp_hdr(streamer, req_hdr, &cbuf.encoder, 0);
+}
+
+static uint32_t
+smp_trace_now(const struct smp_streamer *streamer)
+{
+    if (streamer->trace == NULL) {
+        return 0;
     }
 
-    return 0;
+    return streamer->trace->clock_cb();
 }
 
 /**
- * Processes a single SMP request and generates a response payload (i.e.,
- * everything after the management header).  On success, the response payload
- * is written to the supplied cbuf but not transmitted.  On failure, no error
- * response gets written; the caller is expected to build an error response
- * from the return code.
- *
- * @param cbuf                  A cbuf containing the request and response
- *                                  buffer.
- * @param req_hdr               The management header belonging to the incoming
- *                                  request (host-byte order).
- *
- * @return                      A MGMT_ERR_[...] error code.
+ * Hands a response packet to the transport, timing the call.
  */
 static int
-smp_handle_single_payload(struct mgmt_ctxt *cbuf,
-                          const struct mgmt_hdr *req_hdr, bool *handler_found)
+smp_tx_rsp(struct smp_streamer *streamer, void *rsp)
 {
-    const struct mgmt_handler *handler;
-    mgmt_handler_fn *handler_fn;
-    struct CborEncoder payload_encoder;
+    uint32_t t;
     int rc;
 
-    handler = mgmt_find_handler(req_hdr->nh_group, req_hdr->nh_id);
-    if (handler == NULL) {
-        return MGMT_ERR_ENOTSUP;
-    }
-
-    /* Begin response payload.  Response fields are inserted into the root
-     * map as key value pairs.
-     */
-    rc = cbor_encoder_create_map(&cbuf->encoder, &payload_encoder,
-                                 CborIndefiniteLength);
-    rc = mgmt_err_from_cbor(rc);
-    if (rc != 0) {
-        return rc;
-    }
-
-    switch (req_hdr->nh_op) {
-    case MGMT_OP_READ:
-        handler_fn = handler->mh_read;
-        break;
+    t = smp_trace_now(streamer);
+    rc = streamer->tx_rsp_cb(streamer, rsp, streamer->mgmt_stmr.cb_arg);
+    streamer->timing.tx_ticks = smp_trace_now(streamer) - t;
 
-    case MGMT_OP_WRITE:
-        handler_fn = handler->mh_write;
-        break;
-
-    default:
-        return MGMT_ERR_EINVAL;
-    }
-
-    if (handler_fn) {
-        *handler_found = true;
-        mgmt_evt(MGMT_EVT_OP_CMD_RECV, req_hdr->nh_group, req_hdr->nh_id, NULL);
+    return rc;
+}
 
-        rc = handler_fn(cbuf);
-    } else {
-        rc = MGMT_ERR_ENOTSUP;
-    }
+/**
+ * Begins a response: writes a dummy header to the beginning of the response
+ * buffer and opens the root map of the payload.  The header gets fixed up
+ * once the payload is complete.
+ */
+static int
+smp_start_rsp(struct smp_rsp_state *st, struct mgmt_ctxt *cbuf)
+{
+    struct mgmt_hdr rsp_hdr;
+    int rc;
 
+    smp_init_rsp_hdr(st->req_hdr, &rsp_hdr);
+    rc = smp_write_hdr(st->streamer, st->base, &rsp_hdr);
     if (rc != 0) {
         return rc;
     }
 
-    /* End response payload. */
-    rc = cbor_encoder_close_container(&cbuf->encoder, &payload_encoder);
+    /* Response fields are inserted into the root map as key value pairs. */
+    rc = cbor_encoder_create_map(&cbuf->encoder, &st->payload_encoder,
+                                 CborIndefiniteLength);
     return mgmt_err_from_cbor(rc);
 }
 
 /**
- * Processes a single SMP request and generates a complete response (i.e.,
- * header and payload).  On success, the response is written using the supplied
- * streamer but not transmitted.  On failure, no error response gets written;
- * the caller is expected to build an error response from the return code.
- *
- * @param streamer              The SMP streamer to use for reading the request
- *                                  and writing the response.
- * @param req_hdr               The management header belonging to the incoming
- *                                  request (host-byte order).
- *
- * @return                      A MGMT_ERR_[...] error code.
+ * Completes and transmits the response encoded so far, then begins a new
+ * response to the same request in a freshly allocated buffer.  Installed as
+ * the flush callback of the handler's management context.
  */
 static int
-smp_handle_single_req(struct smp_streamer *streamer,
-                      const struct mgmt_hdr *req_hdr, bool *handler_found)
+smp_flush_rsp(struct mgmt_ctxt *cbuf, void *arg)
 {
-    struct mgmt_ctxt cbuf;
-    struct mgmt_hdr rsp_hdr;
+    struct smp_rsp_state *st;
+    struct smp_streamer *streamer;
     int rc;
 
-    rc = mgmt_ctxt_init(&cbuf, &streamer->mgmt_stmr);
+    st = arg;
+    streamer = st->streamer;
+
+    /* A response sent in parts cannot be replayed. */
+    if (streamer->replay != NULL) {
+        streamer->replay->cur_valid = false;
+    }
+    if (streamer->rsp_cache != NULL) {
+        streamer->rsp_cache->cur_valid = false;
+    }
+
+    rc = cbor_encoder_close_container(&cbuf->encoder, &st->payload_encoder);
+    rc = mgmt_err_from_cbor(rc);
     if (rc != 0) {
         return rc;
     }
 
-    /* Write a dummy header to the beginning of the response buffer.  Some
-     * fields will need to be fixed up later.
-     */
-    smp_init_rsp_hdr(req_hdr, &rsp_hdr);
-    rc = smp_write_hdr(streamer, &rsp_hdr);
+    rc = smp_finish_rsp_hdr(streamer, st->req_hdr, &cbuf->encoder, st->base);
     if (rc != 0) {
         return rc;
     }
 
-    /* Process the request and write the response payload. */
-    rc = smp_handle_single_payload(&cbuf, req_hdr, handler_found);
+    /* The packet goes out along with any responses coalesced before this
+     * one; the continuation starts a fresh packet.
+     */
+    st->base = 0;
+    rc = smp_tx_rsp(streamer, *st->rsp);
+    *st->rsp = NULL;
     if (rc != 0) {
         return rc;
     }
 
-    /* Fix up the response header with the correct length. */
-    rsp_hdr.nh_len = cbor_encode_bytes_written(&cbuf.encoder) - MGMT_HDR_SIZE;
-    mgmt_hton_hdr(&rsp_hdr);
-    rc = smp_write_hdr(streamer, &rsp_hdr);
+    *st->rsp = mgmt_streamer_alloc_rsp(&streamer->mgmt_stmr, st->req);
+    if (*st->rsp == NULL) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, *st->rsp);
     if (rc != 0) {
         return rc;
     }
+    cbor_encoder_init(&cbuf->encoder, streamer->mgmt_stmr.writer, 0);
 
-    return 0;
+    return smp_start_rsp(st, cbuf);
 }
 
 /**
- * Attempts to transmit an SMP error response.  This function consumes both
- * supplied buffers.
- *
- * @param streamer              The SMP streamer for building and transmitting
- *                                  the response.
- * @param req_hdr               The header of the request which elicited the
+ * Prepares a deferred response to the request being handled.  Installed as
+ * the defer callback of the handler's management context.
+ */
+static int
+smp_defer_rsp(struct mgmt_ctxt *cbuf, struct mgmt_async *async, void *arg)
+{
+    struct smp_rsp_state *st;
+    void *rsp;
+
+    st = arg;
+
+    /* Allocate the response buffer now, while the request is still around to
+     * copy user data (e.g., the connection to respond on) from.
+     */
+    rsp = mgmt_streamer_alloc_rsp(&st->streamer->mgmt_stmr, st->req);
+    if (rsp == NULL) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    *async = (struct mgmt_async) {
+        .complete_cb = smp_complete_async,
+        .complete_arg = st->streamer,
+        .req_hdr = *st->req_hdr,
+        .rsp = rsp,
+    };
+
+    return 0;
+}
+
+/**
+ * Processes a single SMP request and generates a response payload (i.e.,
+ * everything after the management header).  On success, the response payload
+ * is written to the supplied cbuf but not transmitted.  On failure, no error
+ * response gets written; the caller is expected to build an error response
+ * from the return code.
+ *
+ * @param cbuf                  A cbuf containing the request and response
+ *                                  buffer.
+ * @param st                    The response state; its payload encoder
+ *                                  holds the open root map.
+ *
+ * @return                      A MGMT_ERR_[...] error code.
+ */
+static int
+smp_handle_single_payload(struct mgmt_ctxt *cbuf, struct smp_rsp_state *st,
+                          bool *handler_found)
+{
+    int rc;
+
+    rc = mgmt_dispatch(cbuf, st->req_hdr, handler_found);
+    if (rc != 0) {
+        return rc;
+    }
+
+    /* End response payload. */
+    rc = cbor_encoder_close_container(&cbuf->encoder, &st->payload_encoder);
+    return mgmt_err_from_cbor(rc);
+}
+
+/**
+ * Processes a single SMP request and generates a complete response (i.e.,
+ * header and payload).  On success, the response is written using the supplied
+ * streamer but not transmitted.  On failure, no error response gets written;
+ * the caller is expected to build an error response from the return code.
+ *
+ * @param streamer              The SMP streamer to use for reading the request
+ *                                  and writing the response.
+ * @param req_hdr               The management header belonging to the incoming
+ *                                  request (host-byte order).
+ * @param req                   The buffer holding the request.
+ * @param rsp                   Points to the buffer holding the response.  If
+ *                                  the handler flushes partial responses,
+ *                                  this gets replaced with the buffer
+ *                                  holding the last one (or NULL).
+ * @param base                  Offset in the response buffer to write the
+ *                                  response at.  Reset to 0 if the handler
+ *                                  flushed a partial response, as that
+ *                                  transmits any preceding responses too.
+ *
+ * @return                      A MGMT_ERR_[...] error code;
+ *                              MGMT_ERR_EPENDING if the handler deferred its
+ *                                  response.
+ */
+static int
+smp_handle_single_req(struct smp_streamer *streamer,
+                      const struct mgmt_hdr *req_hdr, void *req, void **rsp,
+                      size_t *base, bool *handler_found)
+{
+    struct smp_rsp_state st;
+    struct mgmt_ctxt cbuf;
+    int rc;
+
+    rc = mgmt_ctxt_init(&cbuf, &streamer->mgmt_stmr);
+    if (rc != 0) {
+        return rc;
+    }
+
+    st = (struct smp_rsp_state) {
+        .streamer = streamer,
+        .req_hdr = req_hdr,
+        .req = req,
+        .rsp = rsp,
+        .base = *base,
+    };
+    cbuf.flush_cb = smp_flush_rsp;
+    cbuf.flush_arg = &st;
+    cbuf.defer_cb = smp_defer_rsp;
+    cbuf.defer_arg = &st;
+
+    rc = smp_start_rsp(&st, &cbuf);
+    if (rc == 0) {
+        /* Process the request and write the response payload. */
+        rc = smp_handle_single_payload(&cbuf, &st, handler_found);
+    }
+    if (rc == 0) {
+        /* Fix up the response header with the correct length. */
+        rc = smp_finish_rsp_hdr(streamer, req_hdr, &cbuf.encoder, st.base);
+    }
+
+    *base = st.base;
+    return rc;
+}
+
+/**
+ * Indicates whether another response may be appended to the responses
+ * coalesced so far: at least the coalescing reserve remains below the
+ * coalescing MTU.
+ */
+static bool
+smp_coalesce_room(const struct smp_streamer *streamer)
+{
+    size_t reserve;
+
+    reserve = streamer->coalesce_reserve;
+    if (reserve == 0) {
+        reserve = streamer->coalesce_mtu / 2;
+    }
+
+    return smp_align4(smp_rsp_len(streamer)) + reserve <=
+           streamer->coalesce_mtu;
+}
+
+/**
+ * Copies part of a response buffer to a newly allocated response buffer, which
+ * is left set up for writing.  The streamer's reader is repositioned over the
+ * source buffer.
+ *
+ * @return                      The new buffer on success; NULL on failure.
+ */
+static void *
+smp_rsp_copy(struct smp_streamer *streamer, void *req, void *src, size_t off,
+             size_t len)
+{
+    struct cbor_decoder_reader *reader;
+    struct cbor_encoder_writer *writer;
+    uint8_t piece[32];
+    void *dst;
+    size_t n;
+    int rc;
+
+    dst = mgmt_streamer_alloc_rsp(&streamer->mgmt_stmr, req);
+    if (dst == NULL) {
+        return NULL;
+    }
+
+    rc = mgmt_streamer_init_reader(&streamer->mgmt_stmr, src);
+    if (rc == 0) {
+        rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, dst);
+    }
+
+    reader = streamer->mgmt_stmr.reader;
+    writer = streamer->mgmt_stmr.writer;
+    while (rc == 0 && len > 0) {
+        n = len < sizeof piece ? len : sizeof piece;
+        reader->cpy(reader, (char *)piece, off, n);
+        rc = mgmt_err_from_cbor(writer->write(writer, (const char *)piece,
+                                              n));
+        off += n;
+        len -= n;
+    }
+
+    if (rc != 0) {
+        mgmt_streamer_free_buf(&streamer->mgmt_stmr, dst);
+        return NULL;
+    }
+
+    return dst;
+}
+
+/**
+ * Sends the responses coalesced ahead of the current request, i.e., the first
+ * `pending` bytes of the response buffer.  The buffer is consumed.  If it
+ * cannot be truncated, the coalesced responses are copied to a buffer of their
+ * own rather than dropped.
+ */
+static int
+smp_tx_coalesced(struct smp_streamer *streamer, void *req, void *rsp,
+                 size_t pending)
+{
+    void *out;
+
+    if (mgmt_streamer_truncate(&streamer->mgmt_stmr, pending) == 0) {
+        return smp_tx_rsp(streamer, rsp);
+    }
+
+    out = smp_rsp_copy(streamer, req, rsp, 0, pending);
+    mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
+    if (out == NULL) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return smp_tx_rsp(streamer, out);
+}
+
+/**
+ * Moves the response at `base` of the response buffer to a buffer of its own
+ * and sends the responses coalesced ahead of it.  Used when the response
+ * pushed the coalesced ones past the coalescing MTU.  If the response cannot
+ * be moved, the responses stay together in one oversized packet, as the
+ * request has already been executed.
+ */
+static int
+smp_split_rsp(struct smp_streamer *streamer, void *req, void **rsp,
+              size_t pending, size_t base)
+{
+    void *last;
+
+    last = smp_rsp_copy(streamer, req, *rsp, base,
+                        smp_rsp_len(streamer) - base);
+    if (last == NULL) {
+        return mgmt_streamer_init_writer(&streamer->mgmt_stmr, *rsp);
+    }
+
+    mgmt_streamer_init_writer(&streamer->mgmt_stmr, *rsp);
+    smp_tx_coalesced(streamer, req, *rsp, pending);
+
+    *rsp = last;
+    return mgmt_streamer_init_writer(&streamer->mgmt_stmr, last);
+}
+
+/**
+ * Attempts to transmit an SMP error response.  This function consumes both
+ * supplied buffers.
+ *
+ * @param streamer              The SMP streamer for building and transmitting
+ *                                  the response.
+ * @param req_hdr               The header of the request which elicited the
  *                                  error.
  * @param req                   The buffer holding the request.
  * @param rsp                   The buffer holding the response, or NULL if
@@ -292,7 +895,7 @@ smp_on_err(struct smp_streamer *streamer, const struct mgmt_hdr *req_hdr,
     /* Build and transmit the error response. */
     rc = smp_build_err_rsp(streamer, req_hdr, status);
     if (rc == 0) {
-        streamer->tx_rsp_cb(streamer, rsp, streamer->mgmt_stmr.cb_arg);
+        smp_tx_rsp(streamer, rsp);
         rsp = NULL;
     }
 
@@ -301,12 +904,239 @@ smp_on_err(struct smp_streamer *streamer, const struct mgmt_hdr *req_hdr,
     mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
 }
 
+/**
+ * Answers a failed request without aborting its packet, for a streamer that
+ * continues past errors.  Responses coalesced ahead of the failed request are
+ * sent first; the error response goes out in a packet of its own, built in
+ * the buffer of the failed request's partial response if there is one, so
+ * that the request buffer keeps the requests after the failed one.  The
+ * failed request is then trimmed from the front of the request buffer.
+ *
+ * @param streamer              The SMP streamer for building and transmitting
+ *                                  the response.
+ * @param req_hdr               The header of the request which elicited the
+ *                                  error.
+ * @param req                   The buffer holding the request.
+ * @param rsp                   Points to the buffer holding the response, or
+ *                                  NULL if none was allocated.  Consumed.
+ * @param pending               Length of the responses coalesced ahead of the
+ *                                  failed request.
+ * @param base                  Offset of the failed request's response in
+ *                                  the response buffer.
+ * @param req_len               Number of bytes the failed request takes up at
+ *                                  the front of the request buffer.
+ * @param status                The status to indicate in the error response.
+ *
+ * @return                      0 on success; MGMT_ERR_[...] code if the error
+ *                                  response could not be sent, in which case
+ *                                  the caller aborts the packet.
+ */
+static int
+smp_on_err_continue(struct smp_streamer *streamer,
+                    const struct mgmt_hdr *req_hdr, void *req, void **rsp,
+                    size_t pending, size_t base, size_t req_len, int status)
+{
+    void *err_rsp;
+    int rc;
+
+    if (*rsp != NULL && base > 0) {
+        smp_tx_coalesced(streamer, req, *rsp, pending);
+        *rsp = NULL;
+    }
+
+    err_rsp = *rsp;
+    *rsp = NULL;
+    if (err_rsp == NULL) {
+        err_rsp = mgmt_streamer_alloc_rsp(&streamer->mgmt_stmr, req);
+        if (err_rsp == NULL) {
+            return MGMT_ERR_ENOMEM;
+        }
+    }
+
+    /* Clear the partial response from the buffer, if any. */
+    mgmt_streamer_reset_buf(&streamer->mgmt_stmr, err_rsp);
+    rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, err_rsp);
+    if (rc == 0) {
+        rc = smp_build_err_rsp(streamer, req_hdr, status);
+    }
+    if (rc != 0) {
+        mgmt_streamer_free_buf(&streamer->mgmt_stmr, err_rsp);
+        return rc;
+    }
+
+    rc = smp_tx_rsp(streamer, err_rsp);
+    if (rc != 0) {
+        return rc;
+    }
+
+    mgmt_streamer_trim_front(&streamer->mgmt_stmr, req, req_len);
+    return 0;
+}
+
+static uint32_t
+smp_lat_now(const struct smp_streamer *streamer)
+{
+    if (streamer->lat == NULL) {
+        return 0;
+    }
+
+    return streamer->lat->clock_cb();
+}
+
+/**
+ * Adds the time since the specified start to the latency histogram of the
+ * request's command.
+ */
+static void
+smp_lat_record(struct smp_streamer *streamer, const struct mgmt_hdr *req_hdr,
+               uint32_t start)
+{
+    struct smp_lat_entry *entry;
+    struct smp_lat *lat;
+    uint32_t elapsed;
+    uint32_t v;
+    int bucket;
+    int i;
+
+    lat = streamer->lat;
+    if (lat == NULL) {
+        return;
+    }
+
+    entry = NULL;
+    for (i = 0; i < lat->entry_count; i++) {
+        if (!lat->entries[i].used) {
+            entry = &lat->entries[i];
+            entry->used = true;
+            entry->group = req_hdr->nh_group;
+            entry->id = req_hdr->nh_id;
+            break;
+        }
+        if (lat->entries[i].group == req_hdr->nh_group &&
+            lat->entries[i].id == req_hdr->nh_id) {
+
+            entry = &lat->entries[i];
+            break;
+        }
+    }
+    if (entry == NULL) {
+        lat->untracked++;
+        return;
+    }
+
+    elapsed = lat->clock_cb() - start;
+
+    bucket = 0;
+    for (v = elapsed; v != 0; v >>= 1) {
+        bucket++;
+    }
+    if (bucket >= SMP_LAT_BUCKETS) {
+        bucket = SMP_LAT_BUCKETS - 1;
+    }
+
+    entry->buckets[bucket]++;
+    entry->count++;
+    if (elapsed > entry->max) {
+        entry->max = elapsed;
+    }
+}
+
+/**
+ * Stores a request in the streamer's trace ring, replacing the oldest entry.
+ */
+static void
+smp_trace_record(struct smp_streamer *streamer, struct smp_trace_entry *te,
+                 const struct mgmt_hdr *req_hdr, int rc)
+{
+    struct smp_trace *trace;
+    uint32_t head;
+
+    trace = streamer->trace;
+    if (trace == NULL) {
+        return;
+    }
+
+    te->group = req_hdr->nh_group;
+    te->id = req_hdr->nh_id;
+    te->seq = req_hdr->nh_seq;
+    te->req_len = req_hdr->nh_len;
+    te->rc = rc;
+
+    /* Only this thread writes the head; publish the entry after filling it
+     * in so that readers never see a stale slot at a new position.
+     */
+    head = trace->head;
+    trace->entries[head % trace->entry_count] = *te;
+    __atomic_store_n(&trace->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int
+smp_trace_get(const struct smp_trace *trace, uint32_t idx,
+              struct smp_trace_entry *out_entry)
+{
+    uint32_t head;
+
+    head = __atomic_load_n(&trace->head, __ATOMIC_ACQUIRE);
+    if (idx >= head || head - idx > trace->entry_count) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    *out_entry = trace->entries[idx % trace->entry_count];
+
+    /* The writer may have reused the slot while it was being copied. */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&trace->head, __ATOMIC_RELAXED);
+    if (head - idx > trace->entry_count) {
+        return MGMT_ERR_ENOENT;
+    }
+
+    return 0;
+}
+
+/**
+ * Rejects a request that cannot be processed, before any response buffer is
+ * allocated for it: one whose payload runs past the end of the packet, or
+ * one that no handler takes.
+ */
+static int
+smp_check_req(const struct smp_streamer *streamer,
+              const struct mgmt_hdr *req_hdr)
+{
+    if (streamer->mgmt_stmr.reader->message_size <
+        MGMT_HDR_SIZE + req_hdr->nh_len) {
+
+        return MGMT_ERR_EINVAL;
+    }
+
+    return mgmt_check_req(req_hdr);
+}
+
+/**
+ * Indicates whether the request at the front of the reader can be answered in
+ * its own buffer: the streamer allows it, the request is alone in its packet,
+ * and its payload is small enough to set aside.  req_len is the length of
+ * the request as sent, including any authentication trailer.
+ */
+static bool
+smp_can_reply_in_place(const struct smp_streamer *streamer,
+                       const struct mgmt_hdr *req_hdr, size_t req_len)
+{
+    return streamer->rsp_in_place &&
+           req_hdr->nh_len <= SMP_IN_PLACE_REQ_MAX &&
+           streamer->mgmt_stmr.reader->message_size ==
+               MGMT_HDR_SIZE + req_len;
+}
+
 /**
  * Processes all SMP requests in an incoming packet.  Requests are processed
  * sequentially from the start of the packet to the end.  Each response is sent
- * individually in its own packet.  If a request elicits an error response,
- * processing of the packet is aborted.  This function consumes the supplied
- * request buffer regardless of the outcome.
+ * individually in its own packet, or, if the streamer coalesces responses,
+ * appended to the previous one while the packet has room for it under the
+ * coalescing MTU.
+ * Deferred responses are skipped over.  If a request elicits an error
+ * response, processing of the packet is aborted, unless the streamer
+ * continues past errors and the next request can be located.  This function
+ * consumes the supplied request buffer regardless of the outcome.
  *
  * @param streamer              The streamer to use for reading, writing, and
  *                                  transmitting.
@@ -314,17 +1144,31 @@ smp_on_err(struct smp_streamer *streamer, const struct mgmt_hdr *req_hdr,
  *
  * @return                      0 on success, MGMT_ERR_[...] code on failure.
  */
-int
-smp_process_request_packet(struct smp_streamer *streamer, void *req)
+static int
+smp_process_packet(struct smp_streamer *streamer, void *req)
 {
+    uint8_t in_place_buf[SMP_IN_PLACE_REQ_MAX];
+    struct cbor_decoder_reader *saved_reader;
+    struct cbor_buf_reader in_place_reader;
+    struct smp_trace_entry te;
     struct mgmt_hdr req_hdr;
-    struct mgmt_evt_op_cmd_done_arg cmd_done_arg;
     void *rsp;
-    bool valid_hdr, handler_found;
+    bool valid_hdr, handler_found, deferred, in_place, can_continue;
+    bool retransmit;
+    uint32_t start;
+    uint32_t t;
+    size_t pending;
+    size_t req_len;
+    size_t base;
+    int replay_idx;
+    int cache_idx;
     int rc;
 
     rsp = NULL;
     valid_hdr = true;
+    base = 0;
+    pending = 0;
+    start = 0;
 
     while (1) {
         handler_found = false;
@@ -342,54 +1186,467 @@ smp_process_request_packet(struct smp_streamer *streamer, void *req)
             break;
         }
         mgmt_ntoh_hdr(&req_hdr);
-        mgmt_streamer_trim_front(&streamer->mgmt_stmr, req, MGMT_HDR_SIZE);
+        start = smp_lat_now(streamer);
+        memset(&te, 0, sizeof te);
+        te.timestamp = smp_trace_now(streamer);
+        streamer->timing.rx_ts = te.timestamp;
 
-        rsp = mgmt_streamer_alloc_rsp(&streamer->mgmt_stmr, req);
-        if (rsp == NULL) {
-            rc = MGMT_ERR_ENOMEM;
-            break;
+        /* A bad request gets its error response built in its own buffer.
+         * From here on, nh_len excludes any authentication trailer.
+         */
+        req_len = req_hdr.nh_len;
+        can_continue = streamer->err_continue &&
+                       streamer->mgmt_stmr.reader->message_size >=
+                           MGMT_HDR_SIZE + req_len;
+        retransmit = false;
+        rc = smp_check_req(streamer, &req_hdr);
+        if (rc == 0) {
+            rc = smp_auth_check_req(streamer, &req_hdr, &retransmit);
         }
+        replay_idx = -1;
+        if (rc == 0) {
+            replay_idx = smp_replay_lookup(streamer, &req_hdr);
 
-        rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, rsp);
+            /* A request whose authentication counter was accepted before
+             * can only be answered with the response it got then.
+             */
+            if (retransmit && replay_idx < 0) {
+                if (streamer->replay != NULL) {
+                    streamer->replay->cur_valid = false;
+                }
+                rc = MGMT_ERR_EACCESSDENIED;
+            }
+        }
         if (rc != 0) {
+            if (rsp != NULL) {
+                /* Deliver the responses coalesced so far. */
+                pending = smp_rsp_len(streamer);
+                base = pending;
+            }
+            if (can_continue &&
+                smp_on_err_continue(streamer, &req_hdr, req, &rsp, pending,
+                                    base, MGMT_HDR_SIZE + smp_align4(req_len),
+                                    rc) == 0) {
+
+                smp_trace_record(streamer, &te, &req_hdr, rc);
+                continue;
+            }
             break;
         }
 
-        /* Process the request payload and build the response. */
-        rc = smp_handle_single_req(streamer, &req_hdr, &handler_found);
-        if (rc != 0) {
-            break;
+        cache_idx = replay_idx < 0 ? smp_rsp_cache_lookup(streamer, &req_hdr)
+                                   : -1;
+        in_place = rsp == NULL &&
+                   smp_can_reply_in_place(streamer, &req_hdr, req_len);
+        mgmt_streamer_trim_front(&streamer->mgmt_stmr, req, MGMT_HDR_SIZE);
+
+        if (in_place) {
+            te.flags |= SMP_TRACE_F_IN_PLACE;
+
+            /* Set the payload aside and write the response over the
+             * request.  The request buffer now belongs to the response.
+             */
+            streamer->mgmt_stmr.reader->cpy(streamer->mgmt_stmr.reader,
+                                            (char *)in_place_buf, 0,
+                                            req_hdr.nh_len);
+            cbor_buf_reader_init(&in_place_reader, in_place_buf,
+                                 req_hdr.nh_len);
+
+            rsp = req;
+            req = NULL;
+            mgmt_streamer_reset_buf(&streamer->mgmt_stmr, rsp);
+            rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, rsp);
+            if (rc != 0) {
+                break;
+            }
+            base = 0;
+        } else if (rsp == NULL) {
+            t = smp_trace_now(streamer);
+            rsp = mgmt_streamer_alloc_rsp(&streamer->mgmt_stmr, req);
+            te.alloc_ticks = smp_trace_now(streamer) - t;
+            if (rsp == NULL) {
+                rc = MGMT_ERR_ENOMEM;
+                break;
+            }
+
+            rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, rsp);
+            if (rc != 0) {
+                break;
+            }
+            base = 0;
+        } else {
+            /* Append this response to the coalesced ones. */
+            te.flags |= SMP_TRACE_F_COALESCED;
+            pending = smp_rsp_len(streamer);
+            base = pending;
+            rc = smp_pad_rsp(streamer);
+            if (rc != 0) {
+                break;
+            }
+            base = smp_rsp_len(streamer);
         }
 
-        /* Send the response. */
-        rc = streamer->tx_rsp_cb(streamer, rsp, streamer->mgmt_stmr.cb_arg);
-        rsp = NULL;
+        if (replay_idx >= 0) {
+            /* Retransmitted request; resend the earlier response. */
+            te.flags |= SMP_TRACE_F_REPLAY;
+            rc = smp_replay_write(streamer, replay_idx);
+        } else if (cache_idx >= 0) {
+            /* Idempotent read in an unchanged epoch; subscribers still get
+             * to reject it.
+             */
+            te.flags |= SMP_TRACE_F_CACHED;
+            rc = mgmt_evt(MGMT_EVT_OP_CMD_RECV, req_hdr.nh_group,
+                          req_hdr.nh_id, NULL);
+            if (rc == 0) {
+                handler_found = true;
+                rc = smp_rsp_cache_write(streamer, &req_hdr, cache_idx);
+            }
+        } else {
+            /* Process the request payload and build the response.  An
+             * in-place request is decoded from its copy.
+             */
+            saved_reader = streamer->mgmt_stmr.reader;
+            if (in_place) {
+                streamer->mgmt_stmr.reader = &in_place_reader.r;
+            }
+            t = smp_trace_now(streamer);
+            streamer->timing.dispatch_ts = t;
+            rc = smp_handle_single_req(streamer, &req_hdr, req, &rsp, &base,
+                                       &handler_found);
+            te.handler_ticks = smp_trace_now(streamer) - t;
+            streamer->mgmt_stmr.reader = saved_reader;
+            if (rc == 0) {
+                smp_replay_save(streamer, rsp, base);
+                smp_rsp_cache_save(streamer, rsp, base);
+            }
+        }
+        deferred = rc == MGMT_ERR_EPENDING;
+        if (deferred) {
+            te.flags |= SMP_TRACE_F_DEFERRED;
+            streamer->async_pending++;
+
+            /* The handler sends its response later; discard the partial one,
+             * keeping any coalesced ahead of it.
+             */
+            if (base == 0) {
+                mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
+                rsp = NULL;
+                rc = 0;
+            } else {
+                rc = mgmt_streamer_truncate(&streamer->mgmt_stmr, pending);
+            }
+        }
         if (rc != 0) {
+            /* A request answered in place was alone in its packet. */
+            if (can_continue && !in_place &&
+                smp_on_err_continue(streamer, &req_hdr, req, &rsp, pending,
+                                    base, smp_align4(req_len), rc) == 0) {
+
+                smp_trace_record(streamer, &te, &req_hdr, rc);
+                if (handler_found) {
+                    smp_lat_record(streamer, &req_hdr, start);
+                    mgmt_dispatch_done(&req_hdr, rc);
+                }
+                continue;
+            }
             break;
         }
+        if (!deferred && base > 0 &&
+            smp_rsp_len(streamer) > streamer->coalesce_mtu) {
+
+            /* Too large to share the packet; send it on its own. */
+            rc = smp_split_rsp(streamer, req, &rsp, pending, base);
+            if (rc != 0) {
+                break;
+            }
+            base = 0;
+        }
+        if (!deferred) {
+            te.rsp_len = smp_rsp_len(streamer) - base;
+        }
+
+        /* Send the response, unless there is room to coalesce more. */
+        if (!deferred &&
+            (!smp_coalescing(streamer) || !smp_coalesce_room(streamer))) {
+
+            rc = smp_tx_rsp(streamer, rsp);
+            rsp = NULL;
+            if (rc != 0) {
+                break;
+            }
+        }
 
         /* Trim processed request to free up space for subsequent responses. */
-        mgmt_streamer_trim_front(&streamer->mgmt_stmr, req,
-                                 smp_align4(req_hdr.nh_len));
+        if (!in_place) {
+            mgmt_streamer_trim_front(&streamer->mgmt_stmr, req,
+                                     smp_align4(req_len));
+        }
+
+        smp_trace_record(streamer, &te, &req_hdr, MGMT_ERR_EOK);
+        if (!deferred && replay_idx < 0) {
+            smp_lat_record(streamer, &req_hdr, start);
+            mgmt_dispatch_done(&req_hdr, MGMT_ERR_EOK);
+        }
 
-        cmd_done_arg.err = MGMT_ERR_EOK;
-        mgmt_evt(MGMT_EVT_OP_CMD_DONE, req_hdr.nh_group, req_hdr.nh_id,
-                 &cmd_done_arg);
+        if (in_place) {
+            /* The request was alone in its packet. */
+            break;
+        }
     }
 
     if (rc != 0 && valid_hdr) {
+        /* Deliver the responses coalesced ahead of the failed request before
+         * the error response.
+         */
+        if (rsp != NULL && base > 0) {
+            smp_tx_coalesced(streamer, req, rsp, pending);
+            rsp = NULL;
+        }
+
         smp_on_err(streamer, &req_hdr, req, rsp, rc);
+        smp_trace_record(streamer, &te, &req_hdr, rc);
 
         if (handler_found) {
-            cmd_done_arg.err = rc;
-            mgmt_evt(MGMT_EVT_OP_CMD_DONE, req_hdr.nh_group, req_hdr.nh_id,
-                     &cmd_done_arg);
+            smp_lat_record(streamer, &req_hdr, start);
+            mgmt_dispatch_done(&req_hdr, rc);
         }
 
         return rc;
     }
 
+    /* Send any coalesced responses still held. */
+    if (rsp != NULL) {
+        smp_tx_rsp(streamer, rsp);
+        rsp = NULL;
+    }
+
     mgmt_streamer_free_buf(&streamer->mgmt_stmr, req);
-    mgmt_streamer_free_buf(&streamer->mgmt_stmr, rsp);
     return 0;
 }
+
+struct smp_streamer *
+smp_ctxt_streamer(const struct mgmt_ctxt *ctxt)
+{
+    const struct smp_rsp_state *st;
+
+    if (ctxt->flush_cb != smp_flush_rsp) {
+        return NULL;
+    }
+
+    st = ctxt->flush_arg;
+    return st->streamer;
+}
+
+int
+smp_process_request_packet(struct smp_streamer *streamer, void *req)
+{
+    int rc;
+
+    smp_lock(streamer);
+    rc = smp_process_packet(streamer, req);
+    smp_unlock(streamer);
+
+    return rc;
+}
+
+int
+smp_req_prio(const struct mgmt_hdr *req_hdr)
+{
+    const struct mgmt_handler *handler;
+    struct mgmt_hdr hdr;
+
+    hdr = *req_hdr;
+    mgmt_ntoh_hdr(&hdr);
+
+    handler = mgmt_find_handler(hdr.nh_group, hdr.nh_id);
+    if (handler != NULL && (handler->mh_flags & MGMT_HANDLER_F_HIPRI)) {
+        return SMP_PRIO_HIGH;
+    }
+
+    return SMP_PRIO_NORMAL;
+}
+
+static void
+smp_sched_lock(struct smp_sched *sched)
+{
+    if (sched->lock_cb != NULL) {
+        sched->lock_cb(sched, sched->lock_arg);
+    }
+}
+
+static void
+smp_sched_unlock(struct smp_sched *sched)
+{
+    if (sched->unlock_cb != NULL) {
+        sched->unlock_cb(sched, sched->lock_arg);
+    }
+}
+
+int
+smp_sched_put(struct smp_sched *sched, struct smp_streamer *streamer,
+              void *req, int prio)
+{
+    struct smp_sched_queue *queue;
+    struct smp_sched_item *item;
+    int rc;
+
+    if (prio < 0 || prio >= SMP_PRIO_COUNT) {
+        prio = SMP_PRIO_NORMAL;
+    }
+    queue = &sched->queues[prio];
+
+    smp_sched_lock(sched);
+
+    if (queue->len >= queue->size) {
+        rc = MGMT_ERR_ENOMEM;
+    } else {
+        item = &queue->items[(queue->head + queue->len) % queue->size];
+        item->streamer = streamer;
+        item->req = req;
+        queue->len++;
+        rc = 0;
+    }
+
+    smp_sched_unlock(sched);
+
+    return rc;
+}
+
+/**
+ * Selects the queue to serve next: the most urgent non-empty one, unless high
+ * priority packets have had their burst and a normal one is waiting.
+ */
+static struct smp_sched_queue *
+smp_sched_pick(struct smp_sched *sched)
+{
+    struct smp_sched_queue *high;
+    struct smp_sched_queue *normal;
+
+    high = &sched->queues[SMP_PRIO_HIGH];
+    normal = &sched->queues[SMP_PRIO_NORMAL];
+
+    if (high->len > 0 &&
+        (normal->len == 0 || sched->burst == 0 || sched->run < sched->burst)) {
+
+        if (normal->len > 0) {
+            sched->run++;
+        }
+        return high;
+    }
+
+    sched->run = 0;
+    if (normal->len > 0) {
+        return normal;
+    }
+
+    return NULL;
+}
+
+bool
+smp_sched_run(struct smp_sched *sched)
+{
+    struct smp_sched_queue *queue;
+    struct smp_sched_item item;
+
+    smp_sched_lock(sched);
+
+    queue = smp_sched_pick(sched);
+    if (queue != NULL) {
+        item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % queue->size;
+        queue->len--;
+    }
+
+    smp_sched_unlock(sched);
+
+    if (queue == NULL) {
+        return false;
+    }
+
+    smp_process_request_packet(item.streamer, item.req);
+    return true;
+}
+
+/**
+ * Writes a complete deferred response (header and payload) with the
+ * streamer's writer.
+ */
+static int
+smp_encode_async_rsp(struct smp_streamer *streamer, struct mgmt_async *async,
+                     mgmt_async_encode_fn *encode_cb, void *arg)
+{
+    struct smp_rsp_state st;
+    struct mgmt_ctxt cbuf;
+    int rc;
+
+    /* The request is gone; only the encoder is usable. */
+    memset(&cbuf, 0, sizeof cbuf);
+    cbor_encoder_init(&cbuf.encoder, streamer->mgmt_stmr.writer, 0);
+    cbuf.streamer = &streamer->mgmt_stmr;
+
+    st = (struct smp_rsp_state) {
+        .streamer = streamer,
+        .req_hdr = &async->req_hdr,
+        .rsp = &async->rsp,
+    };
+
+    rc = smp_start_rsp(&st, &cbuf);
+    if (rc != 0) {
+        return rc;
+    }
+
+    if (encode_cb != NULL) {
+        rc = encode_cb(&cbuf, arg);
+    } else {
+        rc = mgmt_write_rsp_status(&cbuf, MGMT_ERR_EOK);
+    }
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = cbor_encoder_close_container(&cbuf.encoder, &st.payload_encoder);
+    rc = mgmt_err_from_cbor(rc);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return smp_finish_rsp_hdr(streamer, &async->req_hdr, &cbuf.encoder, 0);
+}
+
+int
+smp_complete_async(struct mgmt_async *async, int status,
+                   mgmt_async_encode_fn *encode_cb, void *arg)
+{
+    struct smp_streamer *streamer;
+    void *rsp;
+    int rc;
+
+    streamer = async->complete_arg;
+
+    smp_lock(streamer);
+
+    rsp = async->rsp;
+    async->rsp = NULL;
+    if (streamer->async_pending > 0) {
+        streamer->async_pending--;
+    }
+
+    rc = status;
+    if (rc == 0) {
+        rc = mgmt_streamer_init_writer(&streamer->mgmt_stmr, rsp);
+    }
+    if (rc == 0) {
+        rc = smp_encode_async_rsp(streamer, async, encode_cb, arg);
+    }
+    if (rc == 0) {
+        rc = smp_tx_rsp(streamer, rsp);
+    } else {
+        smp_on_err(streamer, &async->req_hdr, NULL, rsp, rc);
+    }
+
+    smp_unlock(streamer);
+
+    mgmt_dispatch_done(&async->req_hdr, rc);
+
+    return rc;
+}
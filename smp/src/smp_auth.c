@@ -0,0 +1,358 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/** Authenticated SMP sessions; see smp_auth.h. */
+
+#include <string.h>
+
+#include "tinycbor/cbor.h"
+#include "cborattr/cborattr.h"
+#include "mgmt/mgmt.h"
+#include "smp/smp.h"
+#include "smp/smp_auth.h"
+
+static mgmt_handler_fn smp_auth_challenge;
+static mgmt_handler_fn smp_auth_open;
+
+static const struct mgmt_handler smp_auth_handlers[] = {
+    [SMP_AUTH_ID_CHALLENGE] = { smp_auth_challenge, NULL },
+    [SMP_AUTH_ID_OPEN] = { NULL, smp_auth_open },
+};
+
+#define SMP_AUTH_HANDLER_CNT \
+    sizeof smp_auth_handlers / sizeof smp_auth_handlers[0]
+
+static struct mgmt_group smp_auth_group = {
+    .mg_handlers = smp_auth_handlers,
+    .mg_handlers_count = SMP_AUTH_HANDLER_CNT,
+    .mg_group_id = MGMT_GROUP_ID_AUTH,
+};
+
+/* Labels of the values derived during the handshake. */
+#define SMP_AUTH_LABEL_CLIENT   'C'
+#define SMP_AUTH_LABEL_DEVICE   'D'
+#define SMP_AUTH_LABEL_KEY      'K'
+
+/** Compares two secrets in time independent of where they differ. */
+static bool
+smp_auth_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    uint8_t diff;
+    size_t i;
+
+    diff = 0;
+    for (i = 0; i < len; i++) {
+        diff |= a[i] ^ b[i];
+    }
+
+    return diff == 0;
+}
+
+void
+smp_auth_reset(struct smp_auth *auth)
+{
+    memset(auth->nonce, 0, sizeof auth->nonce);
+    memset(auth->key, 0, sizeof auth->key);
+    auth->rx_ctr = 0;
+    auth->challenged = false;
+    auth->open = false;
+}
+
+/**
+ * Computes MAC(psk, label | device nonce | client nonce).
+ */
+static int
+smp_auth_derive(struct smp_auth *auth, uint8_t label, const uint8_t *cnonce,
+                uint8_t *out_mac)
+{
+    int rc;
+
+    rc = auth->mac_start_cb(auth, auth->psk);
+    if (rc == 0) {
+        rc = auth->mac_update_cb(auth, &label, 1);
+    }
+    if (rc == 0) {
+        rc = auth->mac_update_cb(auth, auth->nonce, sizeof auth->nonce);
+    }
+    if (rc == 0) {
+        rc = auth->mac_update_cb(auth, cnonce, SMP_AUTH_NONCE_LEN);
+    }
+    if (rc == 0) {
+        rc = auth->mac_finish_cb(auth, out_mac);
+    }
+
+    return rc;
+}
+
+/**
+ * Computes the session MAC of the first len bytes in a reader.
+ */
+static int
+smp_auth_mac_reader(struct smp_auth *auth, struct cbor_decoder_reader *reader,
+                    size_t len, uint8_t *out_mac)
+{
+    uint8_t chunk[64];
+    size_t chunk_len;
+    size_t off;
+    int rc;
+
+    rc = auth->mac_start_cb(auth, auth->key);
+    if (rc != 0) {
+        return rc;
+    }
+
+    off = 0;
+    while (off < len) {
+        chunk_len = len - off < sizeof chunk ? len - off : sizeof chunk;
+        reader->cpy(reader, (char *)chunk, off, chunk_len);
+        rc = auth->mac_update_cb(auth, chunk, chunk_len);
+        if (rc != 0) {
+            return rc;
+        }
+
+        off += chunk_len;
+    }
+
+    return auth->mac_finish_cb(auth, out_mac);
+}
+
+static bool
+smp_auth_is_handshake(const struct mgmt_hdr *req_hdr)
+{
+    if (req_hdr->nh_group != MGMT_GROUP_ID_AUTH) {
+        return false;
+    }
+
+    return (req_hdr->nh_id == SMP_AUTH_ID_CHALLENGE &&
+            req_hdr->nh_op == MGMT_OP_READ) ||
+           (req_hdr->nh_id == SMP_AUTH_ID_OPEN &&
+            req_hdr->nh_op == MGMT_OP_WRITE);
+}
+
+int
+smp_auth_check_req(struct smp_streamer *streamer, struct mgmt_hdr *req_hdr,
+                   bool *out_retransmit)
+{
+    uint8_t trailer[SMP_AUTH_TRAILER_LEN];
+    uint8_t mac[SMP_AUTH_MAC_LEN];
+    struct cbor_decoder_reader *reader;
+    struct smp_auth *auth;
+    uint32_t ctr;
+    size_t off;
+    int rc;
+
+    auth = streamer->auth;
+    *out_retransmit = false;
+
+    if (!(req_hdr->nh_flags & SMP_HDR_F_AUTH)) {
+        if (auth == NULL || smp_auth_is_handshake(req_hdr)) {
+            return 0;
+        }
+        return MGMT_ERR_EACCESSDENIED;
+    }
+
+    if (auth == NULL) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (!auth->open || req_hdr->nh_len < SMP_AUTH_TRAILER_LEN) {
+        return MGMT_ERR_EACCESSDENIED;
+    }
+
+    reader = streamer->mgmt_stmr.reader;
+    off = MGMT_HDR_SIZE + req_hdr->nh_len - SMP_AUTH_TRAILER_LEN;
+    reader->cpy(reader, (char *)trailer, off, sizeof trailer);
+
+    ctr = (uint32_t)trailer[0] |
+          (uint32_t)trailer[1] << 8 |
+          (uint32_t)trailer[2] << 16 |
+          (uint32_t)trailer[3] << 24;
+
+    /* The tag covers everything up to and including the counter. */
+    rc = smp_auth_mac_reader(auth, reader, off + 4, mac);
+    if (rc != 0) {
+        return rc;
+    }
+    if (!smp_auth_equal(mac, trailer + 4, SMP_AUTH_TAG_LEN)) {
+        return MGMT_ERR_EACCESSDENIED;
+    }
+
+    /* An authentic request whose counter was accepted before is a
+     * retransmit, or a replay; the caller only answers it from the replay
+     * cache.  The counter does not wrap; the client opens a new session
+     * first.
+     */
+    if (ctr <= auth->rx_ctr) {
+        *out_retransmit = true;
+    } else {
+        auth->rx_ctr = ctr;
+    }
+    req_hdr->nh_len -= SMP_AUTH_TRAILER_LEN;
+
+    return 0;
+}
+
+static struct smp_auth *
+smp_auth_from_ctxt(const struct mgmt_ctxt *ctxt)
+{
+    struct smp_streamer *streamer;
+
+    streamer = smp_ctxt_streamer(ctxt);
+    if (streamer == NULL) {
+        return NULL;
+    }
+
+    return streamer->auth;
+}
+
+/**
+ * Command handler: auth challenge
+ *
+ * Hands out a fresh device nonce, replacing that of any earlier challenge.
+ * An open session stays open until the new handshake completes, so that an
+ * unauthenticated challenge cannot tear it down.
+ */
+static int
+smp_auth_challenge(struct mgmt_ctxt *ctxt)
+{
+    struct smp_auth *auth;
+    CborError err;
+    int rc;
+
+    auth = smp_auth_from_ctxt(ctxt);
+    if (auth == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    auth->challenged = false;
+    rc = auth->rand_cb(auth, auth->nonce, sizeof auth->nonce);
+    if (rc != 0) {
+        return rc;
+    }
+    auth->challenged = true;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "nonce");
+    err |= cbor_encode_byte_string(&ctxt->encoder, auth->nonce,
+                                   sizeof auth->nonce);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+/**
+ * Command handler: auth open
+ *
+ * Checks the client's proof of the shared key and opens the session,
+ * replacing any open one.  Each challenge allows one attempt; a failed
+ * attempt leaves the open session alone.
+ */
+static int
+smp_auth_open(struct mgmt_ctxt *ctxt)
+{
+    uint8_t proof[SMP_AUTH_MAC_LEN];
+    uint8_t cnonce[SMP_AUTH_NONCE_LEN];
+    uint8_t mac[SMP_AUTH_MAC_LEN];
+    uint8_t key[SMP_AUTH_MAC_LEN];
+    struct smp_auth *auth;
+    size_t cnonce_len;
+    size_t proof_len;
+    CborError err;
+    int rc;
+
+    struct cbor_attr_t attrs[] = {
+        {
+            .attribute = "nonce",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = cnonce,
+            .addr.bytestring.len = &cnonce_len,
+            .len = sizeof cnonce,
+        },
+        {
+            .attribute = "proof",
+            .type = CborAttrByteStringType,
+            .addr.bytestring.data = proof,
+            .addr.bytestring.len = &proof_len,
+            .len = sizeof proof,
+        },
+        { NULL },
+    };
+
+    auth = smp_auth_from_ctxt(ctxt);
+    if (auth == NULL) {
+        return MGMT_ERR_ENOTSUP;
+    }
+
+    cnonce_len = 0;
+    proof_len = 0;
+    err = cbor_read_object(&ctxt->it, attrs);
+    if (err != 0 || cnonce_len != sizeof cnonce ||
+        proof_len != sizeof proof) {
+
+        return MGMT_ERR_EINVAL;
+    }
+
+    if (!auth->challenged) {
+        return MGMT_ERR_EBADSTATE;
+    }
+    auth->challenged = false;
+
+    rc = smp_auth_derive(auth, SMP_AUTH_LABEL_CLIENT, cnonce, mac);
+    if (rc != 0) {
+        return rc;
+    }
+    if (!smp_auth_equal(mac, proof, sizeof mac)) {
+        return MGMT_ERR_EACCESSDENIED;
+    }
+
+    rc = smp_auth_derive(auth, SMP_AUTH_LABEL_KEY, cnonce, key);
+    if (rc != 0) {
+        return rc;
+    }
+
+    rc = smp_auth_derive(auth, SMP_AUTH_LABEL_DEVICE, cnonce, mac);
+    if (rc != 0) {
+        return rc;
+    }
+
+    memcpy(auth->key, key, sizeof auth->key);
+    auth->rx_ctr = 0;
+    auth->open = true;
+
+    err = 0;
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "rc");
+    err |= cbor_encode_int(&ctxt->encoder, MGMT_ERR_EOK);
+    err |= cbor_encode_text_stringz(&ctxt->encoder, "proof");
+    err |= cbor_encode_byte_string(&ctxt->encoder, mac, sizeof mac);
+    if (err != 0) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    return 0;
+}
+
+void
+smp_auth_register_group(void)
+{
+    mgmt_register_group(&smp_auth_group);
+}
@@ -0,0 +1,80 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+/** AES-CMAC for authenticated SMP sessions, computed with TinyCrypt. */
+
+#include <tinycrypt/aes.h>
+#include <tinycrypt/cmac_mode.h>
+#include <tinycrypt/constants.h>
+#include <mgmt/mgmt.h>
+#include "smp/smp_auth.h"
+
+static int
+smp_auth_tc_start(struct smp_auth *auth, const uint8_t *key)
+{
+    struct smp_auth_tc *tc = auth->arg;
+
+    if (tc_cmac_setup(&tc->cmac, key, &tc->sched) != TC_CRYPTO_SUCCESS) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+static int
+smp_auth_tc_update(struct smp_auth *auth, const void *data, size_t len)
+{
+    struct smp_auth_tc *tc = auth->arg;
+
+    if (tc_cmac_update(&tc->cmac, data, len) != TC_CRYPTO_SUCCESS) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+static int
+smp_auth_tc_finish(struct smp_auth *auth, uint8_t *out_mac)
+{
+    struct smp_auth_tc *tc = auth->arg;
+    int rc;
+
+    rc = tc_cmac_final(out_mac, &tc->cmac);
+    tc_cmac_erase(&tc->cmac);
+    if (rc != TC_CRYPTO_SUCCESS) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+void
+smp_auth_tc_init(struct smp_auth *auth, struct smp_auth_tc *tc,
+                 const uint8_t *psk, smp_auth_rand_fn *rand_cb)
+{
+    *auth = (struct smp_auth) {
+        .mac_start_cb = smp_auth_tc_start,
+        .mac_update_cb = smp_auth_tc_update,
+        .mac_finish_cb = smp_auth_tc_finish,
+        .rand_cb = rand_cb,
+        .arg = tc,
+        .psk = psk,
+    };
+}
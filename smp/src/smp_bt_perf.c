@@ -0,0 +1,193 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <zephyr.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <mgmt/mgmt.h>
+#include "smp/smp_bt_perf.h"
+#include "smp/smp_bt_perf_config.h"
+#ifdef CONFIG_MCUMGR_CMD_IMG_MGMT
+#include "img_mgmt/img_mgmt.h"
+#endif
+#ifdef CONFIG_MCUMGR_CMD_FS_MGMT
+#include "fs_mgmt/fs_mgmt.h"
+#endif
+
+/** Link parameters requested in one mode of the policy. */
+struct smp_bt_perf_params {
+    struct bt_le_conn_param conn;
+#ifdef CONFIG_BT_USER_PHY_UPDATE
+    struct bt_conn_le_phy_param phy;
+#endif
+#ifdef CONFIG_BT_USER_DATA_LEN_UPDATE
+    struct bt_conn_le_data_len_param data_len;
+#endif
+};
+
+static const struct smp_bt_perf_params smp_bt_perf_fast_params = {
+    .conn = {
+        .interval_min = SMP_BT_PERF_FAST_INT_MIN,
+        .interval_max = SMP_BT_PERF_FAST_INT_MAX,
+        .latency = 0,
+        .timeout = SMP_BT_PERF_TIMEOUT,
+    },
+#ifdef CONFIG_BT_USER_PHY_UPDATE
+    .phy = {
+        .options = BT_CONN_LE_PHY_OPT_NONE,
+        .pref_tx_phy = BT_GAP_LE_PHY_2M,
+        .pref_rx_phy = BT_GAP_LE_PHY_2M,
+    },
+#endif
+#ifdef CONFIG_BT_USER_DATA_LEN_UPDATE
+    .data_len = {
+        .tx_max_len = BT_GAP_DATA_LEN_MAX,
+        .tx_max_time = BT_GAP_DATA_TIME_MAX,
+    },
+#endif
+};
+
+static const struct smp_bt_perf_params smp_bt_perf_slow_params = {
+    .conn = {
+        .interval_min = SMP_BT_PERF_SLOW_INT_MIN,
+        .interval_max = SMP_BT_PERF_SLOW_INT_MAX,
+        .latency = SMP_BT_PERF_SLOW_LATENCY,
+        .timeout = SMP_BT_PERF_TIMEOUT,
+    },
+#ifdef CONFIG_BT_USER_PHY_UPDATE
+    .phy = {
+        .options = BT_CONN_LE_PHY_OPT_NONE,
+        .pref_tx_phy = BT_GAP_LE_PHY_1M,
+        .pref_rx_phy = BT_GAP_LE_PHY_1M,
+    },
+#endif
+#ifdef CONFIG_BT_USER_DATA_LEN_UPDATE
+    .data_len = {
+        .tx_max_len = BT_GAP_DATA_LEN_DEFAULT,
+        .tx_max_time = BT_GAP_DATA_TIME_DEFAULT,
+    },
+#endif
+};
+
+static int smp_bt_perf_evt(uint8_t opcode, uint16_t group, uint8_t id,
+                           void *arg, void *cb_arg);
+
+static struct mgmt_evt_sub smp_bt_perf_sub = {
+    .cb = smp_bt_perf_evt,
+    .evt_mask = MGMT_EVT_MASK(MGMT_EVT_OP_CMD_RECV),
+    .group = MGMT_EVT_GROUP_ALL,
+};
+
+static struct k_work smp_bt_perf_fast_work;
+static struct k_delayed_work smp_bt_perf_idle_work;
+
+/* Whether the fast parameters are in effect. */
+static atomic_t smp_bt_perf_fast;
+
+/* File requests since the policy last went idle. */
+static atomic_t smp_bt_perf_fs_reqs;
+
+/**
+ * Requests the specified parameters on a connection.  Each request is
+ * independent; a peer that rejects one still gets the others.
+ */
+static void
+smp_bt_perf_apply(struct bt_conn *conn, void *data)
+{
+    const struct smp_bt_perf_params *params;
+
+    params = data;
+
+    bt_conn_le_param_update(conn, &params->conn);
+#ifdef CONFIG_BT_USER_PHY_UPDATE
+    bt_conn_le_phy_update(conn, &params->phy);
+#endif
+#ifdef CONFIG_BT_USER_DATA_LEN_UPDATE
+    bt_conn_le_data_len_update(conn, &params->data_len);
+#endif
+}
+
+static void
+smp_bt_perf_fast_work_fn(struct k_work *work)
+{
+    bt_conn_foreach(BT_CONN_TYPE_LE, smp_bt_perf_apply,
+                    (void *)&smp_bt_perf_fast_params);
+}
+
+static void
+smp_bt_perf_idle_work_fn(struct k_work *work)
+{
+    atomic_set(&smp_bt_perf_fs_reqs, 0);
+    if (atomic_cas(&smp_bt_perf_fast, 1, 0)) {
+        bt_conn_foreach(BT_CONN_TYPE_LE, smp_bt_perf_apply,
+                        (void *)&smp_bt_perf_slow_params);
+    }
+}
+
+void
+smp_bt_perf_bulk(void)
+{
+    /* The requests go out from the work queue rather than the SMP thread. */
+    if (atomic_cas(&smp_bt_perf_fast, 0, 1)) {
+        k_work_submit(&smp_bt_perf_fast_work);
+    }
+
+    k_delayed_work_submit(&smp_bt_perf_idle_work,
+                          K_MSEC(SMP_BT_PERF_IDLE_MS));
+}
+
+/**
+ * Recognizes the requests of bulk transfers: every image upload chunk, and
+ * file requests once a transfer has taken SMP_BT_PERF_FS_REQS of them.
+ */
+static int
+smp_bt_perf_evt(uint8_t opcode, uint16_t group, uint8_t id, void *arg,
+                void *cb_arg)
+{
+#ifdef CONFIG_MCUMGR_CMD_IMG_MGMT
+    if (group == MGMT_GROUP_ID_IMAGE && id == IMG_MGMT_ID_UPLOAD) {
+        smp_bt_perf_bulk();
+        return 0;
+    }
+#endif
+
+#ifdef CONFIG_MCUMGR_CMD_FS_MGMT
+    if (group == MGMT_GROUP_ID_FS && id == FS_MGMT_ID_FILE) {
+        if (atomic_inc(&smp_bt_perf_fs_reqs) + 1 >= SMP_BT_PERF_FS_REQS) {
+            smp_bt_perf_bulk();
+        } else {
+            /* Keep the count of a slow transfer from going stale. */
+            k_delayed_work_submit(&smp_bt_perf_idle_work,
+                                  K_MSEC(SMP_BT_PERF_IDLE_MS));
+        }
+        return 0;
+    }
+#endif
+
+    return 0;
+}
+
+void
+smp_bt_perf_init(void)
+{
+    k_work_init(&smp_bt_perf_fast_work, smp_bt_perf_fast_work_fn);
+    k_delayed_work_init(&smp_bt_perf_idle_work, smp_bt_perf_idle_work_fn);
+    mgmt_evt_subscribe(&smp_bt_perf_sub);
+}
@@ -0,0 +1,443 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <string.h>
+#include <zephyr.h>
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/conn.h>
+#include <bluetooth/l2cap.h>
+#include <net/buf.h>
+#include "tinycbor/cbor.h"
+#include "cborattr/cborattr.h"
+#include "mgmt/mgmt.h"
+#include "mgmt/mgmt_sg_reader.h"
+#include "smp/smp.h"
+#include "smp/smp_l2cap.h"
+#include "smp/smp_l2cap_config.h"
+
+/* Number of full-size requests each channel may keep in the receive pool. */
+#define SMP_L2CAP_RX_BUFS_PER_REQ                                   \
+    ((SMP_L2CAP_MTU + SMP_L2CAP_RX_BUF_SIZE - 1) / SMP_L2CAP_RX_BUF_SIZE)
+#define SMP_L2CAP_WINDOW                                            \
+    (SMP_L2CAP_RX_BUF_COUNT / SMP_L2CAP_RX_BUFS_PER_REQ /           \
+     SMP_L2CAP_CHAN_COUNT)
+
+struct smp_l2cap_writer {
+    struct cbor_encoder_writer enc;
+    struct net_buf *buf;
+
+    /* Largest response the peer accepts. */
+    uint16_t max;
+};
+
+/** A channel and the streamer that serves it. */
+struct smp_l2cap_chan {
+    struct bt_l2cap_le_chan le;
+
+    /* Bumped on connect and disconnect, so that requests queued on an
+     * earlier connection of the entry are dropped.
+     */
+    uint16_t gen;
+    bool used;
+    bool connected;
+
+    struct smp_streamer streamer;
+    struct mgmt_sg_reader reader;
+    struct smp_l2cap_writer writer;
+    struct mgmt_session session;
+};
+
+/** Kept in the user data of a received SDU's first buffer. */
+struct smp_l2cap_rx_meta {
+    struct smp_l2cap_chan *chan;
+    uint16_t gen;
+};
+
+NET_BUF_POOL_DEFINE(smp_l2cap_rx_pool, SMP_L2CAP_RX_BUF_COUNT,
+                    SMP_L2CAP_RX_BUF_SIZE, sizeof(struct smp_l2cap_rx_meta),
+                    NULL);
+NET_BUF_POOL_DEFINE(smp_l2cap_tx_pool, SMP_L2CAP_TX_BUF_COUNT,
+                    BT_L2CAP_SDU_BUF_SIZE(SMP_L2CAP_MTU), 0, NULL);
+
+static K_FIFO_DEFINE(smp_l2cap_fifo);
+static K_MUTEX_DEFINE(smp_l2cap_mutex);
+
+/* Requests are processed on a work queue of their own rather than the system
+ * one, as handlers block on work that other subsystems do there.
+ */
+static K_THREAD_STACK_DEFINE(smp_l2cap_workq_stack,
+                             SMP_L2CAP_WORKQ_STACK_SIZE);
+static struct k_work_q smp_l2cap_workq;
+static struct k_work smp_l2cap_work;
+static bool smp_l2cap_workq_started;
+
+static struct smp_l2cap_chan smp_l2cap_chans[SMP_L2CAP_CHAN_COUNT];
+static bool smp_l2cap_registered;
+
+static int
+smp_l2cap_write(struct cbor_encoder_writer *writer, const char *data, int len)
+{
+    struct smp_l2cap_writer *wr;
+
+    wr = CONTAINER_OF(writer, struct smp_l2cap_writer, enc);
+
+    if (wr->buf->len + len > wr->max ||
+        net_buf_tailroom(wr->buf) < (size_t)len) {
+
+        return CborErrorOutOfMemory;
+    }
+
+    net_buf_add_mem(wr->buf, data, len);
+    writer->bytes_written += len;
+
+    return CborNoError;
+}
+
+static void *
+smp_l2cap_alloc_rsp(const void *req, void *arg)
+{
+    struct net_buf *nb;
+
+    /* Responses are held until the peer grants the credits to send them;
+     * wait a while for one to go out rather than fail the request.
+     */
+    nb = net_buf_alloc(&smp_l2cap_tx_pool, K_MSEC(SMP_L2CAP_TX_TIMEOUT_MS));
+    if (nb == NULL) {
+        return NULL;
+    }
+
+    net_buf_reserve(nb, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+    return nb;
+}
+
+static void
+smp_l2cap_trim_front(void *buf, size_t len, void *arg)
+{
+    struct net_buf *nb;
+    size_t n;
+
+    /* Emptied fragments stay in the chain; the span walk skips them. */
+    for (nb = buf; nb != NULL && len > 0; nb = nb->frags) {
+        n = len < nb->len ? len : nb->len;
+        net_buf_pull(nb, n);
+        len -= n;
+    }
+}
+
+static void
+smp_l2cap_reset_buf(void *buf, void *arg)
+{
+    struct net_buf *nb = buf;
+
+    net_buf_reset(nb);
+    if (nb->pool_id == net_buf_pool_get_id(&smp_l2cap_tx_pool)) {
+        net_buf_reserve(nb, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+    }
+}
+
+static int
+smp_l2cap_write_at(struct cbor_encoder_writer *writer, size_t offset,
+                   const void *data, size_t len, void *arg)
+{
+    struct smp_l2cap_writer *wr;
+    struct net_buf *nb;
+
+    wr = CONTAINER_OF(writer, struct smp_l2cap_writer, enc);
+    nb = wr->buf;
+
+    if (offset > nb->len) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (offset + len > wr->max ||
+        offset + len > nb->len + net_buf_tailroom(nb)) {
+
+        return MGMT_ERR_ENOMEM;
+    }
+
+    if (offset + len > nb->len) {
+        net_buf_add(nb, offset + len - nb->len);
+        writer->bytes_written = nb->len;
+    }
+    memcpy(nb->data + offset, data, len);
+
+    return 0;
+}
+
+static int
+smp_l2cap_truncate(struct cbor_encoder_writer *writer, size_t len, void *arg)
+{
+    struct net_buf *nb;
+
+    nb = CONTAINER_OF(writer, struct smp_l2cap_writer, enc)->buf;
+
+    if (len > nb->len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    nb->len = len;
+    writer->bytes_written = len;
+
+    return 0;
+}
+
+static int
+smp_l2cap_init_writer(struct cbor_encoder_writer *writer, void *buf,
+                      void *arg)
+{
+    struct smp_l2cap_chan *ch = arg;
+    struct smp_l2cap_writer *wr;
+    struct net_buf *nb = buf;
+
+    wr = CONTAINER_OF(writer, struct smp_l2cap_writer, enc);
+    wr->enc.write = smp_l2cap_write;
+    wr->enc.bytes_written = nb->len;
+    wr->buf = nb;
+    wr->max = ch->streamer.mgmt_stmr.mtu;
+
+    return 0;
+}
+
+static void
+smp_l2cap_free_buf(void *buf, void *arg)
+{
+    if (buf != NULL) {
+        net_buf_unref(buf);
+    }
+}
+
+/* Requests are read from their fragment chain in place; there is no
+ * init_reader.
+ */
+static const struct mgmt_streamer_cfg smp_l2cap_cbor_cfg = {
+    .alloc_rsp = smp_l2cap_alloc_rsp,
+    .trim_front = smp_l2cap_trim_front,
+    .reset_buf = smp_l2cap_reset_buf,
+    .write_at = smp_l2cap_write_at,
+    .init_writer = smp_l2cap_init_writer,
+    .free_buf = smp_l2cap_free_buf,
+    .truncate = smp_l2cap_truncate,
+    .get_span = mgmt_sg_net_buf_span,
+};
+
+static int
+smp_l2cap_tx_rsp(struct smp_streamer *ss, void *buf, void *arg)
+{
+    struct smp_l2cap_chan *ch = arg;
+    int rc;
+
+    if (!ch->connected) {
+        net_buf_unref(buf);
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    /* The stack segments the SDU and sends each PDU as credits allow. */
+    rc = bt_l2cap_chan_send(&ch->le.chan, buf);
+    if (rc < 0) {
+        net_buf_unref(buf);
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    return 0;
+}
+
+/* Deferred responses may be completed from other threads. */
+static void
+smp_l2cap_lock(struct smp_streamer *ss, void *arg)
+{
+    k_mutex_lock(&smp_l2cap_mutex, K_FOREVER);
+}
+
+static void
+smp_l2cap_unlock(struct smp_streamer *ss, void *arg)
+{
+    k_mutex_unlock(&smp_l2cap_mutex);
+}
+
+static void
+smp_l2cap_process(struct k_work *work)
+{
+    struct smp_l2cap_rx_meta *meta;
+    struct smp_l2cap_chan *ch;
+    struct net_buf *nb;
+
+    while ((nb = net_buf_get(&smp_l2cap_fifo, K_NO_WAIT)) != NULL) {
+        meta = net_buf_user_data(nb);
+        ch = meta->chan;
+        if (!ch->connected || ch->gen != meta->gen) {
+            net_buf_unref(nb);
+            continue;
+        }
+
+        smp_process_request_packet(&ch->streamer, nb);
+    }
+}
+
+static struct net_buf *
+smp_l2cap_alloc_buf(struct bt_l2cap_chan *chan)
+{
+    /* Runs on the Bluetooth receive thread; waiting for the work queue to
+     * release a buffer stalls the link instead of losing the SDU.
+     */
+    return net_buf_alloc(&smp_l2cap_rx_pool, K_FOREVER);
+}
+
+static int
+smp_l2cap_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+    struct smp_l2cap_rx_meta *meta;
+    struct smp_l2cap_chan *ch;
+
+    ch = CONTAINER_OF(chan, struct smp_l2cap_chan, le.chan);
+
+    meta = net_buf_user_data(buf);
+    meta->chan = ch;
+    meta->gen = ch->gen;
+
+    /* The stack releases its reference once this returns. */
+    net_buf_put(&smp_l2cap_fifo, net_buf_ref(buf));
+    k_work_submit_to_queue(&smp_l2cap_workq, &smp_l2cap_work);
+
+    return 0;
+}
+
+static void
+smp_l2cap_connected(struct bt_l2cap_chan *chan)
+{
+    struct smp_l2cap_chan *ch;
+    uint16_t mtu;
+
+    ch = CONTAINER_OF(chan, struct smp_l2cap_chan, le.chan);
+
+    mtu = ch->le.tx.mtu;
+    if (mtu > SMP_L2CAP_MTU) {
+        mtu = SMP_L2CAP_MTU;
+    }
+
+    k_mutex_lock(&smp_l2cap_mutex, K_FOREVER);
+    ch->streamer.mgmt_stmr.mtu = mtu;
+    ch->gen++;
+    ch->connected = true;
+    k_mutex_unlock(&smp_l2cap_mutex);
+}
+
+static void
+smp_l2cap_disconnected(struct bt_l2cap_chan *chan)
+{
+    struct smp_l2cap_chan *ch;
+
+    ch = CONTAINER_OF(chan, struct smp_l2cap_chan, le.chan);
+
+    k_mutex_lock(&smp_l2cap_mutex, K_FOREVER);
+    ch->connected = false;
+    ch->gen++;
+    ch->used = false;
+    k_mutex_unlock(&smp_l2cap_mutex);
+}
+
+static const struct bt_l2cap_chan_ops smp_l2cap_chan_ops = {
+    .connected = smp_l2cap_connected,
+    .disconnected = smp_l2cap_disconnected,
+    .alloc_buf = smp_l2cap_alloc_buf,
+    .recv = smp_l2cap_recv,
+};
+
+static int
+smp_l2cap_accept(struct bt_conn *conn, struct bt_l2cap_chan **chan)
+{
+    struct smp_l2cap_chan *ch;
+    int rc;
+    int i;
+
+    rc = -ENOMEM;
+
+    k_mutex_lock(&smp_l2cap_mutex, K_FOREVER);
+    for (i = 0; i < SMP_L2CAP_CHAN_COUNT; i++) {
+        ch = &smp_l2cap_chans[i];
+        if (!ch->used) {
+            memset(&ch->le, 0, sizeof ch->le);
+            ch->le.chan.ops = &smp_l2cap_chan_ops;
+            ch->le.rx.mtu = SMP_L2CAP_MTU;
+            ch->used = true;
+
+            *chan = &ch->le.chan;
+            rc = 0;
+            break;
+        }
+    }
+    k_mutex_unlock(&smp_l2cap_mutex);
+
+    return rc;
+}
+
+static struct bt_l2cap_server smp_l2cap_server = {
+    .psm = SMP_L2CAP_PSM,
+    .sec_level = SMP_L2CAP_SEC_LEVEL,
+    .accept = smp_l2cap_accept,
+};
+
+int
+smp_l2cap_register(void)
+{
+    struct smp_l2cap_chan *ch;
+    int i;
+
+    if (smp_l2cap_registered) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    for (i = 0; i < SMP_L2CAP_CHAN_COUNT; i++) {
+        ch = &smp_l2cap_chans[i];
+        ch->streamer = (struct smp_streamer) {
+            .mgmt_stmr = {
+                .cfg = &smp_l2cap_cbor_cfg,
+                .cb_arg = ch,
+                .reader = &ch->reader.r,
+                .writer = &ch->writer.enc,
+                .mtu = SMP_L2CAP_MTU,
+                .buf_count = SMP_L2CAP_WINDOW > 255 ? 255 :
+                             SMP_L2CAP_WINDOW > 1 ? SMP_L2CAP_WINDOW : 1,
+                .session = &ch->session,
+            },
+            .tx_rsp_cb = smp_l2cap_tx_rsp,
+            .lock_cb = smp_l2cap_lock,
+            .unlock_cb = smp_l2cap_unlock,
+        };
+    }
+
+    /* Started once; a failed registration may be retried. */
+    if (!smp_l2cap_workq_started) {
+        k_work_init(&smp_l2cap_work, smp_l2cap_process);
+        k_work_queue_start(&smp_l2cap_workq, smp_l2cap_workq_stack,
+                           K_THREAD_STACK_SIZEOF(smp_l2cap_workq_stack),
+                           SMP_L2CAP_WORKQ_PRIO, NULL);
+        k_thread_name_set(&smp_l2cap_workq.thread, "smp_l2cap_wq");
+        smp_l2cap_workq_started = true;
+    }
+
+    /* Let cborattr reference upload data that lies within one fragment. */
+    cbor_attr_set_span_fn(mgmt_sg_reader_span);
+
+    if (bt_l2cap_server_register(&smp_l2cap_server) != 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    smp_l2cap_registered = true;
+    return 0;
+}
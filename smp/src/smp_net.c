@@ -0,0 +1,654 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <string.h>
+#include <zephyr.h>
+#include <net/socket.h>
+#include <net/net_if.h>
+#include "tinycbor/cbor.h"
+#include "tinycbor/cbor_buf_reader.h"
+#include "mgmt/mgmt.h"
+#include "mgmt/mgmt_buf_pool.h"
+#include "smp/smp.h"
+#include "smp/smp_net.h"
+#include "smp/smp_net_config.h"
+
+#if defined(CONFIG_NET_IPV4) && defined(CONFIG_NET_IPV6)
+#define SMP_NET_SOCK_MAX    (2 + SMP_NET_MCAST)
+#else
+#define SMP_NET_SOCK_MAX    (1 + SMP_NET_MCAST)
+#endif
+
+/**
+ * A request or response packet.  Trimming the front advances `off` rather
+ * than moving the data.
+ */
+struct smp_net_buf {
+    /* Reserved for the FIFO that hands requests to the work queue. */
+    void *fifo_reserved;
+
+    /* The quota the buffer was taken from. */
+    struct mgmt_buf_quota *quota;
+
+    /* Sender of a request; recipient of a response. */
+    struct sockaddr addr;
+    socklen_t addr_len;
+    int sock;
+
+    uint16_t off;
+    uint16_t len;
+    uint8_t data[SMP_NET_MTU];
+};
+
+struct smp_net_writer {
+    struct cbor_encoder_writer enc;
+    struct smp_net_buf *buf;
+};
+
+/** A remote address and the streamer that serves it. */
+struct smp_net_client {
+    struct sockaddr addr;
+    socklen_t addr_len;
+    int sock;
+
+    /* k_uptime_get_32() at the latest request. */
+    uint32_t last_rx;
+    bool used;
+
+    struct smp_streamer streamer;
+    struct cbor_buf_reader reader;
+    struct smp_net_writer writer;
+    struct mgmt_session session;
+};
+
+/* Received datagrams are charged to the rx quota and responses to the rsp
+ * quota, which holds SMP_NET_RSP_BUF_RESERVE buffers back for itself.
+ */
+MGMT_BUF_POOL_DEFINE(smp_net_pool, SMP_NET_BUF_COUNT,
+                     sizeof(struct smp_net_buf));
+static struct mgmt_buf_quota smp_net_rx_quota;
+static struct mgmt_buf_quota smp_net_rsp_quota;
+static K_MUTEX_DEFINE(smp_net_pool_mutex);
+
+/* Given whenever a buffer is freed; the receive thread waits on it when the
+ * rx quota is exhausted.
+ */
+static K_SEM_DEFINE(smp_net_free_sem, 0, SMP_NET_BUF_COUNT);
+
+static K_FIFO_DEFINE(smp_net_fifo);
+static K_MUTEX_DEFINE(smp_net_mutex);
+static K_THREAD_STACK_DEFINE(smp_net_stack, SMP_NET_STACK_SIZE);
+static struct k_thread smp_net_thread;
+
+/* Requests are processed on a work queue of their own rather than the system
+ * one, as handlers block on work that other subsystems do there.
+ */
+static K_THREAD_STACK_DEFINE(smp_net_workq_stack, SMP_NET_WORKQ_STACK_SIZE);
+static struct k_work_q smp_net_workq;
+static struct k_work smp_net_work;
+
+static struct smp_net_client smp_net_clients[SMP_NET_CLIENT_COUNT];
+static int smp_net_socks[SMP_NET_SOCK_MAX];
+static int smp_net_sock_cnt;
+
+#if SMP_NET_MCAST
+/* Processes the requests sent to the multicast group, whatever their
+ * sender; see smp_net_mcast_tx_rsp().
+ */
+static struct smp_net_client smp_net_mcast_client;
+static int smp_net_mcast_sock = -1;
+#endif
+
+static int
+smp_net_write(struct cbor_encoder_writer *writer, const char *data, int len)
+{
+    struct smp_net_buf *nb;
+
+    nb = CONTAINER_OF(writer, struct smp_net_writer, enc)->buf;
+
+    if (nb->off + nb->len + len > SMP_NET_MTU) {
+        return CborErrorOutOfMemory;
+    }
+
+    memcpy(nb->data + nb->off + nb->len, data, len);
+    nb->len += len;
+    writer->bytes_written += len;
+
+    return CborNoError;
+}
+
+static void *
+smp_net_alloc_rsp(const void *req, void *arg)
+{
+    struct smp_net_buf *nb;
+
+    nb = mgmt_buf_alloc(&smp_net_rsp_quota);
+    if (nb == NULL) {
+        return NULL;
+    }
+
+    nb->quota = &smp_net_rsp_quota;
+    nb->off = 0;
+    nb->len = 0;
+    return nb;
+}
+
+static void
+smp_net_trim_front(void *buf, size_t len, void *arg)
+{
+    struct smp_net_client *client = arg;
+    struct smp_net_buf *nb = buf;
+
+    if (len > nb->len) {
+        len = nb->len;
+    }
+
+    /* Keep the reader positioned on the new front. */
+    if (client->reader.buffer == nb->data + nb->off) {
+        client->reader.buffer += len;
+        client->reader.r.message_size -= len;
+    }
+
+    nb->off += len;
+    nb->len -= len;
+}
+
+static void
+smp_net_reset_buf(void *buf, void *arg)
+{
+    struct smp_net_buf *nb = buf;
+
+    nb->off = 0;
+    nb->len = 0;
+}
+
+static int
+smp_net_write_at(struct cbor_encoder_writer *writer, size_t offset,
+                 const void *data, size_t len, void *arg)
+{
+    struct smp_net_buf *nb;
+
+    nb = CONTAINER_OF(writer, struct smp_net_writer, enc)->buf;
+
+    if (offset > nb->len) {
+        return MGMT_ERR_EINVAL;
+    }
+    if (nb->off + offset + len > SMP_NET_MTU) {
+        return MGMT_ERR_ENOMEM;
+    }
+
+    memcpy(nb->data + nb->off + offset, data, len);
+    if (offset + len > nb->len) {
+        nb->len = offset + len;
+        writer->bytes_written = nb->len;
+    }
+
+    return 0;
+}
+
+static int
+smp_net_truncate(struct cbor_encoder_writer *writer, size_t len, void *arg)
+{
+    struct smp_net_buf *nb;
+
+    nb = CONTAINER_OF(writer, struct smp_net_writer, enc)->buf;
+
+    if (len > nb->len) {
+        return MGMT_ERR_EINVAL;
+    }
+
+    nb->len = len;
+    writer->bytes_written = len;
+
+    return 0;
+}
+
+static int
+smp_net_init_reader(struct cbor_decoder_reader *reader, void *buf, void *arg)
+{
+    struct smp_net_buf *nb = buf;
+
+    /* A flat buffer reader lets cborattr reference upload data in place. */
+    cbor_buf_reader_init((struct cbor_buf_reader *)reader,
+                         nb->data + nb->off, nb->len);
+    return 0;
+}
+
+static int
+smp_net_init_writer(struct cbor_encoder_writer *writer, void *buf, void *arg)
+{
+    struct smp_net_writer *wr;
+    struct smp_net_buf *nb = buf;
+
+    wr = CONTAINER_OF(writer, struct smp_net_writer, enc);
+    wr->enc.write = smp_net_write;
+    wr->enc.bytes_written = nb->len;
+    wr->buf = nb;
+
+    return 0;
+}
+
+static void
+smp_net_free_buf(void *buf, void *arg)
+{
+    struct smp_net_buf *nb = buf;
+
+    if (nb != NULL) {
+        mgmt_buf_free(nb->quota, nb);
+        k_sem_give(&smp_net_free_sem);
+    }
+}
+
+static const struct mgmt_streamer_cfg smp_net_cbor_cfg = {
+    .alloc_rsp = smp_net_alloc_rsp,
+    .trim_front = smp_net_trim_front,
+    .reset_buf = smp_net_reset_buf,
+    .write_at = smp_net_write_at,
+    .init_reader = smp_net_init_reader,
+    .init_writer = smp_net_init_writer,
+    .free_buf = smp_net_free_buf,
+    .truncate = smp_net_truncate,
+};
+
+static int
+smp_net_tx_rsp(struct smp_streamer *ss, void *buf, void *arg)
+{
+    struct smp_net_client *client = arg;
+    struct smp_net_buf *nb = buf;
+    ssize_t sent;
+
+    sent = zsock_sendto(client->sock, nb->data + nb->off, nb->len, 0,
+                        &client->addr, client->addr_len);
+    smp_net_free_buf(buf, arg);
+
+    if (sent < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+    return 0;
+}
+
+#if SMP_NET_MCAST
+/* A multicast request is answered by every device in the group at once, so
+ * responses to it are dropped; the client asks each device for the outcome
+ * over unicast.
+ */
+static int
+smp_net_mcast_tx_rsp(struct smp_streamer *ss, void *buf, void *arg)
+{
+    smp_net_free_buf(buf, arg);
+    return 0;
+}
+#endif
+
+/* Deferred responses may be completed from other threads. */
+static void
+smp_net_lock(struct smp_streamer *ss, void *arg)
+{
+    k_mutex_lock(&smp_net_mutex, K_FOREVER);
+}
+
+static void
+smp_net_unlock(struct smp_streamer *ss, void *arg)
+{
+    k_mutex_unlock(&smp_net_mutex);
+}
+
+static void
+smp_net_pool_lock(struct mgmt_buf_pool *pool, void *arg)
+{
+    k_mutex_lock(&smp_net_pool_mutex, K_FOREVER);
+}
+
+static void
+smp_net_pool_unlock(struct mgmt_buf_pool *pool, void *arg)
+{
+    k_mutex_unlock(&smp_net_pool_mutex);
+}
+
+static bool
+smp_net_client_match(const struct smp_net_client *client,
+                     const struct smp_net_buf *req)
+{
+    return client->used &&
+           client->sock == req->sock &&
+           client->addr_len == req->addr_len &&
+           memcmp(&client->addr, &req->addr, req->addr_len) == 0;
+}
+
+/**
+ * Finds the client that sent a request, or takes over the entry of the
+ * least recently active one for it.  An entry with deferred responses still
+ * outstanding is not taken over, as they are sent to the entry's address.
+ * A client that is taken over loses its session.
+ *
+ * @return                      The client; NULL if every entry is busy.
+ */
+static struct smp_net_client *
+smp_net_client_get(const struct smp_net_buf *req)
+{
+    struct smp_net_client *client;
+    struct smp_net_client *best;
+    uint32_t now;
+    bool reset;
+    int i;
+
+    now = k_uptime_get_32();
+
+    k_mutex_lock(&smp_net_mutex, K_FOREVER);
+
+    best = NULL;
+    reset = false;
+    for (i = 0; i < SMP_NET_CLIENT_COUNT; i++) {
+        client = &smp_net_clients[i];
+        if (smp_net_client_match(client, req)) {
+            client->last_rx = now;
+            best = client;
+            break;
+        }
+
+        if (client->streamer.async_pending > 0) {
+            continue;
+        }
+
+        if (best == NULL ||
+            (best->used && !client->used) ||
+            (best->used == client->used &&
+             (int32_t)(client->last_rx - best->last_rx) < 0)) {
+
+            best = client;
+        }
+    }
+
+    if (best != NULL && !smp_net_client_match(best, req)) {
+        reset = best->used;
+        best->addr = req->addr;
+        best->addr_len = req->addr_len;
+        best->sock = req->sock;
+        best->used = true;
+        best->last_rx = now;
+    }
+
+    k_mutex_unlock(&smp_net_mutex);
+
+    /* Only this work queue processes the entry's requests, and it has
+     * nothing deferred, so no one uses the session meanwhile.
+     */
+    if (reset) {
+        mgmt_session_reset(&best->session);
+    }
+
+    return best;
+}
+
+static void
+smp_net_process(struct k_work *work)
+{
+    struct smp_net_client *client;
+    struct smp_net_buf *nb;
+
+    while ((nb = k_fifo_get(&smp_net_fifo, K_NO_WAIT)) != NULL) {
+#if SMP_NET_MCAST
+        if (nb->sock == smp_net_mcast_sock) {
+            smp_process_request_packet(&smp_net_mcast_client.streamer, nb);
+            continue;
+        }
+#endif
+        client = smp_net_client_get(nb);
+        if (client == NULL) {
+            smp_net_free_buf(nb, NULL);
+            continue;
+        }
+        smp_process_request_packet(&client->streamer, nb);
+    }
+}
+
+static void
+smp_net_rx(void *p1, void *p2, void *p3)
+{
+    struct zsock_pollfd fds[SMP_NET_SOCK_MAX];
+    struct smp_net_buf *nb;
+    ssize_t len;
+    int i;
+
+    for (i = 0; i < smp_net_sock_cnt; i++) {
+        fds[i].fd = smp_net_socks[i];
+        fds[i].events = ZSOCK_POLLIN;
+    }
+
+    while (1) {
+        if (zsock_poll(fds, smp_net_sock_cnt, -1) < 0) {
+            k_sleep(K_MSEC(100));
+            continue;
+        }
+
+        for (i = 0; i < smp_net_sock_cnt; i++) {
+            if (!(fds[i].revents & ZSOCK_POLLIN)) {
+                continue;
+            }
+
+            /* Wait for the work queue to release a buffer rather than drop
+             * the datagram.
+             */
+            while ((nb = mgmt_buf_alloc(&smp_net_rx_quota)) == NULL) {
+                k_sem_take(&smp_net_free_sem, K_FOREVER);
+            }
+            nb->quota = &smp_net_rx_quota;
+
+            nb->addr_len = sizeof nb->addr;
+            len = zsock_recvfrom(fds[i].fd, nb->data, sizeof nb->data, 0,
+                                 &nb->addr, &nb->addr_len);
+            if (len <= 0) {
+                smp_net_free_buf(nb, NULL);
+                continue;
+            }
+
+            nb->sock = fds[i].fd;
+            nb->off = 0;
+            nb->len = len;
+
+            k_fifo_put(&smp_net_fifo, nb);
+            k_work_submit_to_queue(&smp_net_workq, &smp_net_work);
+        }
+    }
+}
+
+static int
+smp_net_bind(sa_family_t family, uint16_t port)
+{
+    struct sockaddr addr;
+    socklen_t addr_len;
+    int sock;
+
+    memset(&addr, 0, sizeof addr);
+    addr.sa_family = family;
+    if (family == AF_INET) {
+        net_sin(&addr)->sin_port = htons(port);
+        addr_len = sizeof(struct sockaddr_in);
+    } else {
+        net_sin6(&addr)->sin6_port = htons(port);
+        addr_len = sizeof(struct sockaddr_in6);
+    }
+
+    sock = zsock_socket(family, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    if (zsock_bind(sock, &addr, addr_len) < 0) {
+        zsock_close(sock);
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    smp_net_socks[smp_net_sock_cnt++] = sock;
+    return 0;
+}
+
+#if SMP_NET_MCAST
+/**
+ * Joins SMP_NET_MCAST_ADDR on the default interface and listens on
+ * SMP_NET_MCAST_PORT for the requests sent to it.
+ */
+static int
+smp_net_mcast_open(void)
+{
+    struct net_if_mcast_addr *maddr;
+    struct net_if *iface;
+    sa_family_t family;
+    struct in6_addr addr6;
+    struct in_addr addr4;
+    int rc;
+
+    iface = net_if_get_default();
+    if (iface == NULL) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    maddr = NULL;
+    family = AF_UNSPEC;
+#ifdef CONFIG_NET_IPV6
+    if (net_addr_pton(AF_INET6, SMP_NET_MCAST_ADDR, &addr6) == 0) {
+        family = AF_INET6;
+        maddr = net_if_ipv6_maddr_lookup(&addr6, &iface);
+        if (maddr == NULL) {
+            maddr = net_if_ipv6_maddr_add(iface, &addr6);
+        }
+        if (maddr != NULL) {
+            net_if_ipv6_maddr_join(maddr);
+        }
+    }
+#endif
+#ifdef CONFIG_NET_IPV4
+    if (family == AF_UNSPEC &&
+        net_addr_pton(AF_INET, SMP_NET_MCAST_ADDR, &addr4) == 0) {
+
+        family = AF_INET;
+        maddr = net_if_ipv4_maddr_lookup(&addr4, &iface);
+        if (maddr == NULL) {
+            maddr = net_if_ipv4_maddr_add(iface, &addr4);
+        }
+    }
+#endif
+    (void)addr6;
+    (void)addr4;
+
+    if (maddr == NULL) {
+        return MGMT_ERR_EUNKNOWN;
+    }
+
+    rc = smp_net_bind(family, SMP_NET_MCAST_PORT);
+    if (rc != 0) {
+        return rc;
+    }
+
+    smp_net_mcast_sock = smp_net_socks[smp_net_sock_cnt - 1];
+    return 0;
+}
+#endif
+
+static void
+smp_net_client_init(struct smp_net_client *client, smp_tx_rsp_fn *tx_rsp_cb)
+{
+    client->streamer = (struct smp_streamer) {
+        .mgmt_stmr = {
+            .cfg = &smp_net_cbor_cfg,
+            .cb_arg = client,
+            .reader = &client->reader.r,
+            .writer = &client->writer.enc,
+            .mtu = SMP_NET_MTU,
+            .buf_count = SMP_NET_BUF_COUNT,
+            .session = &client->session,
+        },
+        .tx_rsp_cb = tx_rsp_cb,
+        .lock_cb = smp_net_lock,
+        .unlock_cb = smp_net_unlock,
+        .rsp_in_place = true,
+    };
+}
+
+int
+smp_net_open(void)
+{
+    k_tid_t tid;
+    int rc;
+    int i;
+
+    if (smp_net_sock_cnt > 0) {
+        return MGMT_ERR_EBADSTATE;
+    }
+
+    if (smp_net_rsp_quota.pool == NULL) {
+        smp_net_pool.lock_cb = smp_net_pool_lock;
+        smp_net_pool.unlock_cb = smp_net_pool_unlock;
+
+        rc = mgmt_buf_quota_init(&smp_net_rsp_quota, &smp_net_pool,
+                                 SMP_NET_RSP_BUF_RESERVE, 0);
+        if (rc == 0) {
+            rc = mgmt_buf_quota_init(&smp_net_rx_quota, &smp_net_pool, 0, 0);
+        }
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    for (i = 0; i < SMP_NET_CLIENT_COUNT; i++) {
+        smp_net_client_init(&smp_net_clients[i], smp_net_tx_rsp);
+    }
+#if SMP_NET_MCAST
+    smp_net_client_init(&smp_net_mcast_client, smp_net_mcast_tx_rsp);
+#endif
+
+    rc = 0;
+#ifdef CONFIG_NET_IPV4
+    rc = smp_net_bind(AF_INET, SMP_NET_PORT);
+#endif
+#ifdef CONFIG_NET_IPV6
+    if (rc == 0) {
+        rc = smp_net_bind(AF_INET6, SMP_NET_PORT);
+    }
+#endif
+    if (rc == 0 && smp_net_sock_cnt == 0) {
+        rc = MGMT_ERR_EUNKNOWN;
+    }
+#if SMP_NET_MCAST
+    if (rc == 0) {
+        rc = smp_net_mcast_open();
+    }
+#endif
+    if (rc != 0) {
+        while (smp_net_sock_cnt > 0) {
+            zsock_close(smp_net_socks[--smp_net_sock_cnt]);
+        }
+        return rc;
+    }
+
+    k_work_init(&smp_net_work, smp_net_process);
+    k_work_queue_start(&smp_net_workq, smp_net_workq_stack,
+                       K_THREAD_STACK_SIZEOF(smp_net_workq_stack),
+                       SMP_NET_WORKQ_PRIO, NULL);
+    k_thread_name_set(&smp_net_workq.thread, "smp_net_wq");
+
+    tid = k_thread_create(&smp_net_thread, smp_net_stack,
+                          K_THREAD_STACK_SIZEOF(smp_net_stack),
+                          smp_net_rx, NULL, NULL, NULL,
+                          SMP_NET_THREAD_PRIO, 0, K_NO_WAIT);
+    k_thread_name_set(tid, "smp_net");
+
+    return 0;
+}
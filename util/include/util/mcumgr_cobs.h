@@ -0,0 +1,151 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Binary framing of SMP packets over a byte stream, e.g., a UART.
+ *
+ * Each frame is a packet and its CRC16, COBS-encoded so that it contains no
+ * zero bytes, between two zero delimiters:
+ *
+ *     0x00 COBS(<packet> <crc16>) 0x00
+ *
+ * See transport/smp-console.md.  Since the console's text framing never
+ * produces a zero byte, both framings can share a serial line: bytes outside
+ * binary frames are left to the console.  The decoder works a byte at a time
+ * and can be fed from an interrupt handler.
+ */
+
+#ifndef H_MCUMGR_COBS_
+#define H_MCUMGR_COBS_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCUMGR_COBS_DELIM           0x00
+
+/* Results of mcumgr_cobs_dec_byte(), other than a packet length. */
+#define MCUMGR_COBS_DEC_MORE        0   /* Consumed; frame incomplete. */
+#define MCUMGR_COBS_DEC_TEXT        (-1) /* Not part of a binary frame. */
+#define MCUMGR_COBS_DEC_BAD         (-2) /* Frame discarded. */
+
+/**
+ * Largest frame, delimiters included, that a packet of the specified length
+ * is encoded into.
+ */
+#define MCUMGR_COBS_FRAME_MAX(len_) \
+    ((len_) + 2 + ((len_) + 2) / 254 + 1 + 2)
+
+/** Streaming decoder state. */
+struct mcumgr_cobs_dec {
+    /** Receives the decoded packet and its CRC. */
+    uint8_t *buf;
+    size_t size;
+    size_t len;
+
+    /** Code of the current block; 0 if no block has started. */
+    uint8_t code;
+    /** Data bytes left in the current block. */
+    uint8_t left;
+
+    /** Whether a frame is being received. */
+    bool in_frame;
+    /** Whether the frame being received does not fit in `buf`. */
+    bool overflow;
+};
+
+/** @typedef mcumgr_cobs_out_fn
+ * @brief Transmits part of an encoded frame.
+ *
+ * @param data                  The bytes to transmit.
+ * @param len                   The number of bytes in `data`.
+ * @param arg                   Optional argument.
+ *
+ * @return                      0 on success; nonzero to abort the frame.
+ */
+typedef int mcumgr_cobs_out_fn(const uint8_t *data, size_t len, void *arg);
+
+/**
+ * @brief Calculates the CRC16 of the console framings: polynomial 0x1021,
+ * initial value 0, no reflection.
+ *
+ * @param crc                   The CRC of the preceding data; 0 to start.
+ * @param data                  The data to add.
+ * @param len                   The number of bytes in `data`.
+ *
+ * @return                      The CRC of the data so far.
+ */
+uint16_t mcumgr_crc16(uint16_t crc, const void *data, size_t len);
+
+/**
+ * @brief Prepares a decoder.  The decoder ignores bytes until it sees the
+ * delimiter that starts a frame.
+ *
+ * @param dec                   The decoder to initialize.
+ * @param buf                   Receives decoded packets.
+ * @param size                  The size of `buf`; must be at least two
+ *                                  bytes larger than the largest packet.
+ */
+void mcumgr_cobs_dec_init(struct mcumgr_cobs_dec *dec, uint8_t *buf,
+                          size_t size);
+
+/**
+ * @brief Feeds a received byte to a decoder.
+ *
+ * A frame that fails its CRC check or does not fit in the buffer is
+ * discarded.  The delimiter that ended it is then taken to start the next
+ * frame, so a frame whose closing delimiter was lost only costs itself.
+ *
+ * @param dec                   The decoder.
+ * @param c                     The received byte.
+ *
+ * @return                      The length of the packet now held at the
+ *                                  start of the decoder buffer, if the byte
+ *                                  completed a valid frame; otherwise
+ *                                  MCUMGR_COBS_DEC_[...].  The packet must be
+ *                                  taken out before the next byte is fed.
+ */
+int mcumgr_cobs_dec_byte(struct mcumgr_cobs_dec *dec, uint8_t c);
+
+/**
+ * @brief Encodes a packet into a frame.  The frame is passed to the callback
+ * in pieces, most of which point into the packet itself, so no frame buffer
+ * is needed.
+ *
+ * @param pkt                   The packet to encode.
+ * @param len                   The length of the packet.
+ * @param out_cb                Transmits each piece of the frame.
+ * @param arg                   Optional argument passed to out_cb.
+ *
+ * @return                      0 on success; the callback's return code if
+ *                                  it aborted the frame.
+ */
+int mcumgr_cobs_encode(const void *pkt, size_t len,
+                       mcumgr_cobs_out_fn *out_cb, void *arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
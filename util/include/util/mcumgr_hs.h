@@ -0,0 +1,160 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * @file
+ * @brief Streaming LZSS codec producing and consuming heatshrink-compatible
+ *        streams.
+ *
+ * The window and lookahead sizes are fixed (MCUMGR_HS_WINDOW_BITS and
+ * MCUMGR_HS_LOOKAHEAD_BITS); a host-side heatshrink configured with the same
+ * parameters (-w 8 -l 4) interoperates with this implementation.  Both the
+ * encoder and the decoder keep all of their state in their context object,
+ * so a stream can be processed in arbitrary pieces across requests.
+ */
+
+#ifndef H_MCUMGR_HS_
+#define H_MCUMGR_HS_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MCUMGR_HS_WINDOW_BITS       8
+#define MCUMGR_HS_LOOKAHEAD_BITS    4
+
+#define MCUMGR_HS_WINDOW_SIZE       (1 << MCUMGR_HS_WINDOW_BITS)
+#define MCUMGR_HS_LOOKAHEAD_SIZE    (1 << MCUMGR_HS_LOOKAHEAD_BITS)
+
+/** Streaming decoder state. */
+struct mcumgr_hs_dec {
+    /** Most recently produced bytes. */
+    uint8_t window[MCUMGR_HS_WINDOW_SIZE];
+    /** Index in `window` of the next byte to produce. */
+    uint16_t head;
+    /** Bits of the field being read. */
+    uint16_t acc;
+    uint8_t acc_bits;
+    /** Unread bits of the input byte being read. */
+    uint8_t in_byte;
+    uint8_t in_bits;
+    /** Which part of an item is read next. */
+    uint8_t state;
+    /** Back-reference being copied. */
+    uint16_t offset;
+    uint16_t count;
+};
+
+/** Streaming encoder state. */
+struct mcumgr_hs_enc {
+    /**
+     * Window of already encoded bytes followed by the bytes waiting to be
+     * encoded.
+     */
+    uint8_t buf[2 * MCUMGR_HS_WINDOW_SIZE];
+    /** Next byte to encode; the window is the bytes before it. */
+    uint16_t pos;
+    /** End of the data in `buf`. */
+    uint16_t end;
+    /** Encoded bits not yet making up a full output byte. */
+    uint8_t out_byte;
+    uint8_t out_bits;
+};
+
+/**
+ * @brief Prepares a decoder for a new stream.
+ *
+ * @param dec                   The decoder to initialize.
+ */
+void mcumgr_hs_dec_init(struct mcumgr_hs_dec *dec);
+
+/**
+ * @brief Decodes stream data.  Decoding stops when all input has been
+ * consumed or the output buffer is full; input that is not consumed has to be
+ * passed again in the next call.
+ *
+ * @param dec                   The decoder.
+ * @param in                    The stream data to decode.
+ * @param in_len                The number of bytes in `in`.
+ * @param out_consumed          On success, the number of bytes consumed from
+ *                                  `in`.
+ * @param out                   Receives the decoded data.
+ * @param out_max               The size of `out`.
+ *
+ * @return                      The number of bytes written to `out`.
+ */
+size_t mcumgr_hs_dec_run(struct mcumgr_hs_dec *dec, const uint8_t *in,
+                         size_t in_len, size_t *out_consumed, uint8_t *out,
+                         size_t out_max);
+
+/**
+ * @brief Prepares an encoder for a new stream.
+ *
+ * @param enc                   The encoder to initialize.
+ */
+void mcumgr_hs_enc_init(struct mcumgr_hs_enc *enc);
+
+/**
+ * @brief Hands data to the encoder.
+ *
+ * @param enc                   The encoder.
+ * @param data                  The data to encode.
+ * @param len                   The number of bytes in `data`.
+ *
+ * @return                      The number of bytes accepted; the encoder
+ *                                  takes more after it has been polled.
+ */
+size_t mcumgr_hs_enc_sink(struct mcumgr_hs_enc *enc, const void *data,
+                          size_t len);
+
+/**
+ * @brief Retrieves encoded data.  Without `finish`, the last
+ * MCUMGR_HS_LOOKAHEAD_SIZE bytes handed to the encoder are held back as they
+ * may still become part of a match.
+ *
+ * @param enc                   The encoder.
+ * @param out                   Receives the encoded data.
+ * @param out_max               The size of `out`.
+ * @param finish                Whether the end of the input has been reached;
+ *                                  all data is encoded and the stream is
+ *                                  padded to a full byte.
+ *
+ * @return                      The number of bytes written to `out`.
+ */
+size_t mcumgr_hs_enc_poll(struct mcumgr_hs_enc *enc, uint8_t *out,
+                          size_t out_max, bool finish);
+
+/**
+ * @brief Indicates whether a finished encoder has produced all of its output.
+ *
+ * @param enc                   The encoder.
+ *
+ * @return                      true if nothing is left to poll.
+ */
+bool mcumgr_hs_enc_done(const struct mcumgr_hs_enc *enc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
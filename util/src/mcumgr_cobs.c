@@ -0,0 +1,237 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+#include "util/mcumgr_cobs.h"
+
+/* Longest run of nonzero bytes that one block can carry. */
+#define MCUMGR_COBS_RUN_MAX         254
+
+/** The bytes a frame encodes: the packet followed by its CRC. */
+struct mcumgr_cobs_src {
+    const uint8_t *pkt;
+    size_t len;
+    uint8_t crc[2];
+};
+
+uint16_t
+mcumgr_crc16(uint16_t crc, const void *data, size_t len)
+{
+    const uint8_t *p;
+    int i;
+
+    for (p = data; len > 0; p++, len--) {
+        crc ^= (uint16_t)*p << 8;
+        for (i = 0; i < 8; i++) {
+            if (crc & 0x8000) {
+                crc = (crc << 1) ^ 0x1021;
+            } else {
+                crc <<= 1;
+            }
+        }
+    }
+
+    return crc;
+}
+
+void
+mcumgr_cobs_dec_init(struct mcumgr_cobs_dec *dec, uint8_t *buf, size_t size)
+{
+    memset(dec, 0, sizeof *dec);
+    dec->buf = buf;
+    dec->size = size;
+}
+
+/* starts over at the beginning of a frame */
+static void
+mcumgr_cobs_dec_restart(struct mcumgr_cobs_dec *dec)
+{
+    dec->len = 0;
+    dec->code = 0;
+    dec->left = 0;
+    dec->overflow = false;
+    dec->in_frame = true;
+}
+
+static void
+mcumgr_cobs_dec_put(struct mcumgr_cobs_dec *dec, uint8_t c)
+{
+    if (dec->len < dec->size) {
+        dec->buf[dec->len++] = c;
+    } else {
+        dec->overflow = true;
+    }
+}
+
+/* checks the CRC of a complete frame; returns the packet length or 0 */
+static size_t
+mcumgr_cobs_dec_check(const struct mcumgr_cobs_dec *dec)
+{
+    uint16_t crc;
+    size_t len;
+
+    if (dec->overflow || dec->left != 0 || dec->len <= 2) {
+        return 0;
+    }
+
+    len = dec->len - 2;
+    crc = mcumgr_crc16(0, dec->buf, len);
+    if (dec->buf[len] != (uint8_t)(crc >> 8) ||
+        dec->buf[len + 1] != (uint8_t)crc) {
+
+        return 0;
+    }
+
+    return len;
+}
+
+int
+mcumgr_cobs_dec_byte(struct mcumgr_cobs_dec *dec, uint8_t c)
+{
+    size_t len;
+
+    if (c == MCUMGR_COBS_DELIM) {
+        if (!dec->in_frame || dec->code == 0) {
+            /* Opening delimiter, possibly repeated. */
+            mcumgr_cobs_dec_restart(dec);
+            return MCUMGR_COBS_DEC_MORE;
+        }
+
+        len = mcumgr_cobs_dec_check(dec);
+        if (len == 0) {
+            mcumgr_cobs_dec_restart(dec);
+            return MCUMGR_COBS_DEC_BAD;
+        }
+
+        dec->in_frame = false;
+        return (int)len;
+    }
+
+    if (!dec->in_frame) {
+        return MCUMGR_COBS_DEC_TEXT;
+    }
+
+    if (dec->left == 0) {
+        /* A new block; the previous one ended in a zero unless it was
+         * full.
+         */
+        if (dec->code != 0 && dec->code != 0xff) {
+            mcumgr_cobs_dec_put(dec, 0);
+        }
+        dec->code = c;
+        dec->left = c - 1;
+    } else {
+        mcumgr_cobs_dec_put(dec, c);
+        dec->left--;
+    }
+
+    return MCUMGR_COBS_DEC_MORE;
+}
+
+static uint8_t
+mcumgr_cobs_src_at(const struct mcumgr_cobs_src *src, size_t idx)
+{
+    if (idx < src->len) {
+        return src->pkt[idx];
+    }
+    return src->crc[idx - src->len];
+}
+
+/* passes a run of source bytes on; it may span the packet and the CRC */
+static int
+mcumgr_cobs_src_out(const struct mcumgr_cobs_src *src, size_t idx, size_t n,
+                    mcumgr_cobs_out_fn *out_cb, void *arg)
+{
+    size_t chunk;
+    int rc;
+
+    if (idx < src->len) {
+        chunk = src->len - idx;
+        if (chunk > n) {
+            chunk = n;
+        }
+        rc = out_cb(src->pkt + idx, chunk, arg);
+        if (rc != 0) {
+            return rc;
+        }
+        idx += chunk;
+        n -= chunk;
+    }
+
+    if (n > 0) {
+        return out_cb(src->crc + (idx - src->len), n, arg);
+    }
+
+    return 0;
+}
+
+int
+mcumgr_cobs_encode(const void *pkt, size_t len, mcumgr_cobs_out_fn *out_cb,
+                   void *arg)
+{
+    static const uint8_t delim = MCUMGR_COBS_DELIM;
+    struct mcumgr_cobs_src src;
+    uint16_t crc;
+    uint8_t code;
+    size_t total;
+    size_t idx;
+    size_t n;
+    int rc;
+
+    crc = mcumgr_crc16(0, pkt, len);
+    src.pkt = pkt;
+    src.len = len;
+    src.crc[0] = crc >> 8;
+    src.crc[1] = crc;
+    total = len + sizeof src.crc;
+
+    rc = out_cb(&delim, 1, arg);
+    if (rc != 0) {
+        return rc;
+    }
+
+    idx = 0;
+    while (1) {
+        n = 0;
+        while (idx + n < total && n < MCUMGR_COBS_RUN_MAX &&
+               mcumgr_cobs_src_at(&src, idx + n) != 0) {
+            n++;
+        }
+
+        code = n + 1;
+        rc = out_cb(&code, 1, arg);
+        if (rc == 0) {
+            rc = mcumgr_cobs_src_out(&src, idx, n, out_cb, arg);
+        }
+        if (rc != 0) {
+            return rc;
+        }
+
+        idx += n;
+        if (idx == total) {
+            break;
+        }
+        if (n < MCUMGR_COBS_RUN_MAX) {
+            /* Skip the zero that ended the run; the code implies it. */
+            idx++;
+        }
+    }
+
+    return out_cb(&delim, 1, arg);
+}
@@ -0,0 +1,294 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements.  See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership.  The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied.  See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <string.h>
+#include "util/mcumgr_hs.h"
+
+/* Tags that start each item of a stream. */
+#define MCUMGR_HS_TAG_BACKREF       0
+#define MCUMGR_HS_TAG_LITERAL       1
+
+/* Decoder states: which part of an item is read next. */
+#define MCUMGR_HS_DEC_TAG           0
+#define MCUMGR_HS_DEC_LITERAL       1
+#define MCUMGR_HS_DEC_OFFSET        2
+#define MCUMGR_HS_DEC_COUNT         3
+#define MCUMGR_HS_DEC_COPY          4
+
+#define MCUMGR_HS_WINDOW_MASK       (MCUMGR_HS_WINDOW_SIZE - 1)
+
+/* A back-reference only pays off if it is longer than this many bytes. */
+#define MCUMGR_HS_BREAK_EVEN \
+    ((1 + MCUMGR_HS_WINDOW_BITS + MCUMGR_HS_LOOKAHEAD_BITS) / 8)
+
+void
+mcumgr_hs_dec_init(struct mcumgr_hs_dec *dec)
+{
+    memset(dec, 0, sizeof *dec);
+    dec->state = MCUMGR_HS_DEC_TAG;
+}
+
+/**
+ * Reads a field of the specified number of bits, most significant bit first.
+ * A field can span calls; false is returned if the input runs out first.
+ */
+static bool
+mcumgr_hs_dec_bits(struct mcumgr_hs_dec *dec, int count, const uint8_t **in,
+                   const uint8_t *in_end, uint16_t *out_val)
+{
+    while (dec->acc_bits < count) {
+        if (dec->in_bits == 0) {
+            if (*in == in_end) {
+                return false;
+            }
+            dec->in_byte = *(*in)++;
+            dec->in_bits = 8;
+        }
+
+        dec->in_bits--;
+        dec->acc = (dec->acc << 1) | ((dec->in_byte >> dec->in_bits) & 1);
+        dec->acc_bits++;
+    }
+
+    *out_val = dec->acc;
+    dec->acc = 0;
+    dec->acc_bits = 0;
+    return true;
+}
+
+static void
+mcumgr_hs_dec_emit(struct mcumgr_hs_dec *dec, uint8_t c, uint8_t *out,
+                   size_t *out_len)
+{
+    dec->window[dec->head] = c;
+    dec->head = (dec->head + 1) & MCUMGR_HS_WINDOW_MASK;
+    out[(*out_len)++] = c;
+}
+
+size_t
+mcumgr_hs_dec_run(struct mcumgr_hs_dec *dec, const uint8_t *in,
+                  size_t in_len, size_t *out_consumed, uint8_t *out,
+                  size_t out_max)
+{
+    const uint8_t *in_end;
+    const uint8_t *cur;
+    size_t out_len;
+    uint16_t val;
+    uint8_t c;
+
+    cur = in;
+    in_end = in + in_len;
+    out_len = 0;
+
+    while (out_len < out_max) {
+        switch (dec->state) {
+        case MCUMGR_HS_DEC_TAG:
+            if (!mcumgr_hs_dec_bits(dec, 1, &cur, in_end, &val)) {
+                goto done;
+            }
+            if (val == MCUMGR_HS_TAG_LITERAL) {
+                dec->state = MCUMGR_HS_DEC_LITERAL;
+            } else {
+                dec->state = MCUMGR_HS_DEC_OFFSET;
+            }
+            break;
+
+        case MCUMGR_HS_DEC_LITERAL:
+            if (!mcumgr_hs_dec_bits(dec, 8, &cur, in_end, &val)) {
+                goto done;
+            }
+            mcumgr_hs_dec_emit(dec, val, out, &out_len);
+            dec->state = MCUMGR_HS_DEC_TAG;
+            break;
+
+        case MCUMGR_HS_DEC_OFFSET:
+            if (!mcumgr_hs_dec_bits(dec, MCUMGR_HS_WINDOW_BITS, &cur, in_end,
+                                    &val)) {
+                goto done;
+            }
+            dec->offset = val + 1;
+            dec->state = MCUMGR_HS_DEC_COUNT;
+            break;
+
+        case MCUMGR_HS_DEC_COUNT:
+            if (!mcumgr_hs_dec_bits(dec, MCUMGR_HS_LOOKAHEAD_BITS, &cur,
+                                    in_end, &val)) {
+                goto done;
+            }
+            dec->count = val + 1;
+            dec->state = MCUMGR_HS_DEC_COPY;
+            break;
+
+        default:
+            /* The source may overlap the bytes being produced. */
+            while (dec->count > 0 && out_len < out_max) {
+                c = dec->window[(dec->head - dec->offset) &
+                                MCUMGR_HS_WINDOW_MASK];
+                mcumgr_hs_dec_emit(dec, c, out, &out_len);
+                dec->count--;
+            }
+            if (dec->count == 0) {
+                dec->state = MCUMGR_HS_DEC_TAG;
+            }
+            break;
+        }
+    }
+
+done:
+    *out_consumed = cur - in;
+    return out_len;
+}
+
+void
+mcumgr_hs_enc_init(struct mcumgr_hs_enc *enc)
+{
+    memset(enc, 0, sizeof *enc);
+}
+
+size_t
+mcumgr_hs_enc_sink(struct mcumgr_hs_enc *enc, const void *data, size_t len)
+{
+    size_t shift;
+    size_t room;
+
+    /* Drop bytes that have left the window to make room. */
+    room = sizeof enc->buf - enc->end;
+    if (room < len && enc->pos > MCUMGR_HS_WINDOW_SIZE) {
+        shift = enc->pos - MCUMGR_HS_WINDOW_SIZE;
+        memmove(enc->buf, enc->buf + shift, enc->end - shift);
+        enc->pos -= shift;
+        enc->end -= shift;
+        room += shift;
+    }
+
+    if (len > room) {
+        len = room;
+    }
+    memcpy(enc->buf + enc->end, data, len);
+    enc->end += len;
+
+    return len;
+}
+
+/**
+ * Appends bits to the encoded stream, most significant bit first.
+ */
+static void
+mcumgr_hs_enc_bits(struct mcumgr_hs_enc *enc, uint16_t val, int count,
+                   uint8_t *out, size_t *out_len)
+{
+    while (count-- > 0) {
+        enc->out_byte = (enc->out_byte << 1) | ((val >> count) & 1);
+        enc->out_bits++;
+        if (enc->out_bits == 8) {
+            out[(*out_len)++] = enc->out_byte;
+            enc->out_byte = 0;
+            enc->out_bits = 0;
+        }
+    }
+}
+
+/**
+ * Finds the longest match for the bytes at the encode position, preferring
+ * the closest one.
+ */
+static int
+mcumgr_hs_enc_match(const struct mcumgr_hs_enc *enc, int max_len,
+                    int *out_dist)
+{
+    const uint8_t *cur;
+    int best_len;
+    int lo;
+    int len;
+    int i;
+
+    cur = enc->buf + enc->pos;
+    lo = enc->pos > MCUMGR_HS_WINDOW_SIZE ?
+         enc->pos - MCUMGR_HS_WINDOW_SIZE : 0;
+    best_len = 0;
+
+    for (i = enc->pos - 1; i >= lo && best_len < max_len; i--) {
+        if (enc->buf[i] != cur[0]) {
+            continue;
+        }
+
+        for (len = 1; len < max_len && enc->buf[i + len] == cur[len]; len++) {
+        }
+        if (len > best_len) {
+            best_len = len;
+            *out_dist = enc->pos - i;
+        }
+    }
+
+    return best_len;
+}
+
+size_t
+mcumgr_hs_enc_poll(struct mcumgr_hs_enc *enc, uint8_t *out, size_t out_max,
+                   bool finish)
+{
+    size_t out_len;
+    int avail;
+    int dist;
+    int len;
+
+    out_len = 0;
+
+    /* An item plus the pending bits never fill more than two bytes. */
+    while (out_max - out_len >= 2) {
+        avail = enc->end - enc->pos;
+        if (avail == 0 || (!finish && avail < MCUMGR_HS_LOOKAHEAD_SIZE)) {
+            break;
+        }
+
+        len = mcumgr_hs_enc_match(enc,
+                                  avail < MCUMGR_HS_LOOKAHEAD_SIZE ?
+                                  avail : MCUMGR_HS_LOOKAHEAD_SIZE,
+                                  &dist);
+        if (len > MCUMGR_HS_BREAK_EVEN) {
+            mcumgr_hs_enc_bits(enc, MCUMGR_HS_TAG_BACKREF, 1, out, &out_len);
+            mcumgr_hs_enc_bits(enc, dist - 1, MCUMGR_HS_WINDOW_BITS,
+                               out, &out_len);
+            mcumgr_hs_enc_bits(enc, len - 1, MCUMGR_HS_LOOKAHEAD_BITS,
+                               out, &out_len);
+            enc->pos += len;
+        } else {
+            mcumgr_hs_enc_bits(enc, MCUMGR_HS_TAG_LITERAL, 1, out, &out_len);
+            mcumgr_hs_enc_bits(enc, enc->buf[enc->pos], 8, out, &out_len);
+            enc->pos++;
+        }
+    }
+
+    /* Pad the final byte with zeros; they never complete an item. */
+    if (finish && enc->pos == enc->end && enc->out_bits > 0 &&
+        out_len < out_max) {
+
+        out[out_len++] = enc->out_byte << (8 - enc->out_bits);
+        enc->out_byte = 0;
+        enc->out_bits = 0;
+    }
+
+    return out_len;
+}
+
+bool
+mcumgr_hs_enc_done(const struct mcumgr_hs_enc *enc)
+{
+    return enc->pos == enc->end && enc->out_bits == 0;
+}